@@ -0,0 +1,146 @@
+/*
+ * bench_dir_index.c
+ *
+ * Cost of a Next keypress with a persistent directory index versus
+ * rebuilding the listing on every keypress, which is what NextFileInDir did:
+ * enumerate, open every file to sniff its type, sort, search linearly.
+ *
+ * Usage: bench_dir_index [files] [keypresses]
+ */
+
+#include "../dirindex.h"
+#include "benchutil.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+static int MagicFilter(const char* pszPath, const char* pszName, void* pUserData)
+{
+  (void)pszName;
+  (void)pUserData;
+
+  unsigned char magic[80];
+  FILE* fp = fopen(pszPath, "rb");
+  if (!fp) {
+    return 0;
+  }
+
+  size_t nRead = fread(magic, 1, sizeof(magic), fp);
+  fclose(fp);
+
+  return nRead == sizeof(magic) && magic[0] == 0x89;
+}
+
+/* The former per-keypress path, reduced to its essentials */
+static const char* LegacyNext(const char* pszDir, const char* pszCurrent, char* pszOut, size_t size)
+{
+  DIRINDEX index;
+  DirIndex_Init(&index);
+  DirIndex_Open(&index, pszDir, MagicFilter, NULL);
+
+  const char* pszNext = NULL;
+  for (size_t i = 0; i < DirIndex_GetCount(&index); ++i) {
+    if (!strcmp(DirIndex_GetName(&index, i), pszCurrent)) {
+      pszNext = DirIndex_GetName(&index, (i + 1) % DirIndex_GetCount(&index));
+      break;
+    }
+  }
+
+  if (pszNext) {
+    snprintf(pszOut, size, "%s", pszNext);
+  }
+
+  DirIndex_Close(&index);
+  return pszNext ? pszOut : NULL;
+}
+
+int main(int argc, char** argv)
+{
+  long nFiles = Bench_ArgLong(argc, argv, 1, 30000);
+  long nKeys = Bench_ArgLong(argc, argv, 2, 200);
+
+  char szDir[256] = "bench_dir_index_XXXXXX";
+#ifdef _WIN32
+  if (_mktemp_s(szDir, sizeof(szDir)) != 0 || _mkdir(szDir) != 0) {
+#else
+  if (!mkdtemp(szDir)) {
+#endif
+    fprintf(stderr, "Unable to create a scratch directory\n");
+    return 1;
+  }
+
+  unsigned char content[128] = { 0x89, 'P', 'N', 'G' };
+  char szPath[512];
+  for (long i = 0; i < nFiles; ++i) {
+    snprintf(szPath, sizeof(szPath), "%s%cIMG_%06ld.png", szDir, DIRINDEX_PATH_SEPARATOR, i);
+    FILE* fp = fopen(szPath, "wb");
+    if (fp) {
+      fwrite(content, 1, sizeof(content), fp);
+      fclose(fp);
+    }
+  }
+
+  char szCurrent[64] = "IMG_000000.png";
+  char szNext[64];
+
+  /* The legacy path is so slow that a handful of keypresses suffice */
+  long nLegacyKeys = nKeys < 5 ? nKeys : 5;
+  double start = Bench_Now();
+  for (long i = 0; i < nLegacyKeys; ++i) {
+    if (LegacyNext(szDir, szCurrent, szNext, sizeof(szNext))) {
+      memcpy(szCurrent, szNext, sizeof(szCurrent));
+    }
+  }
+  double legacy = (Bench_Now() - start) / (double)nLegacyKeys;
+
+  DIRINDEX index;
+  DirIndex_Init(&index);
+
+  start = Bench_Now();
+  DirIndex_Open(&index, szDir, MagicFilter, NULL);
+  double build = Bench_Now() - start;
+
+  const char* pszCurrent = DirIndex_GetName(&index, 0);
+  start = Bench_Now();
+  for (long i = 0; i < nKeys; ++i) {
+    DirIndex_Refresh(&index);
+    pszCurrent = DirIndex_Step(&index, pszCurrent, 1);
+  }
+  double step = (Bench_Now() - start) / (double)nKeys;
+
+  /* One file added between keypresses */
+  snprintf(szPath, sizeof(szPath), "%s%cIMG_added.png", szDir, DIRINDEX_PATH_SEPARATOR);
+  FILE* fp = fopen(szPath, "wb");
+  if (fp) {
+    fwrite(content, 1, sizeof(content), fp);
+    fclose(fp);
+  }
+  start = Bench_Now();
+  DirIndex_Refresh(&index);
+  pszCurrent = DirIndex_Step(&index, pszCurrent, 1);
+  double change = Bench_Now() - start;
+
+  printf("Next keypress in a directory of %ld images\n", nFiles);
+  printf("  rebuild per keypress : %10.3f ms\n", legacy * 1e3);
+  printf("  index build (once)   : %10.3f ms\n", build * 1e3);
+  printf("  index step           : %10.3f us\n", step * 1e6);
+  printf("  index step + 1 change: %10.3f us\n", change * 1e6);
+
+  DirIndex_Close(&index);
+
+  remove(szPath);
+  for (long i = 0; i < nFiles; ++i) {
+    snprintf(szPath, sizeof(szPath), "%s%cIMG_%06ld.png", szDir, DIRINDEX_PATH_SEPARATOR, i);
+    remove(szPath);
+  }
+  rmdir(szDir);
+
+  return 0;
+}
@@ -0,0 +1,215 @@
+/*
+ * bench_dir_scan.c
+ *
+ * Indexing a large flat directory of images when it is first opened: the
+ * former synchronous scan that opens every file to check its magic bytes,
+ * the same with file name extensions checked first, and the background
+ * scan on a task pool, probing by magic bytes only and extensions first.
+ * Reports when the first file could be stepped to and when the index is
+ * complete, with a cold page cache and again warm.
+ *
+ * The cache is dropped through /proc/sys/vm/drop_caches when that is
+ * writable, i.e. as root; otherwise each file's pages are evicted with
+ * posix_fadvise, which leaves directory entries and inodes cached. Run it
+ * on a disk, a tmpfs is never cold.
+ *
+ * Usage: bench_dir_scan [files] [workers]
+ */
+
+#include "../dirindex.h"
+#include "../imgformat.h"
+#include "benchutil.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#define rmdir _rmdir
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+
+#define BENCH_TMPFS_MAGIC 0x01021994
+
+enum {
+  CACHE_WARM,
+  CACHE_DROPPED,              /* Page, dentry and inode caches */
+  CACHE_EVICTED,              /* File pages only */
+};
+
+static IMGFORMATREGISTRY g_registry;
+
+static int MagicFilter(const char* pszPath, const char* pszName, void* pUserData)
+{
+  (void)pszName;
+  (void)pUserData;
+
+  FILE* fp = fopen(pszPath, "rb");
+  if (!fp) {
+    return 0;
+  }
+
+  const IMGFORMAT* pFormat = ImgFormat_ProbeFile(&g_registry, fp, NULL);
+  fclose(fp);
+
+  return pFormat != NULL;
+}
+
+static int ExtensionFilter(const char* pszPath, const char* pszName, void* pUserData)
+{
+  return ImgFormat_FindByName(&g_registry, pszName) || MagicFilter(pszPath, pszName, pUserData);
+}
+
+/* Every tenth file is text, every tenth an image without an extension */
+static void Bench_FileName(long i, char* pszName, size_t size)
+{
+  snprintf(pszName, size, "IMG_%06ld%s", i, i % 10 == 9 ? ".txt" : i % 10 == 8 ? "" : ".png");
+}
+
+static void Bench_SleepUs(long us)
+{
+#ifdef _WIN32
+  Sleep((DWORD)(us / 1000));
+#else
+  struct timespec ts = { 0, us * 1000 };
+  nanosleep(&ts, NULL);
+#endif
+}
+
+static int Bench_DropCache(const char* pszDir, long nFiles)
+{
+#ifdef __linux__
+  sync();
+  FILE* fp = fopen("/proc/sys/vm/drop_caches", "w");
+  if (fp) {
+    int bDropped = fputs("3", fp) >= 0;
+    bDropped = fclose(fp) == 0 && bDropped;
+    if (bDropped) {
+      return CACHE_DROPPED;
+    }
+  }
+
+  char szPath[512];
+  char szName[64];
+  for (long i = 0; i < nFiles; ++i) {
+    Bench_FileName(i, szName, sizeof(szName));
+    snprintf(szPath, sizeof(szPath), "%s/%s", pszDir, szName);
+    int fd = open(szPath, O_RDONLY);
+    if (fd >= 0) {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      close(fd);
+    }
+  }
+  return CACHE_EVICTED;
+#else
+  (void)pszDir;
+  (void)nFiles;
+  return CACHE_WARM;
+#endif
+}
+
+/* Without a pool the scan is synchronous */
+static void Bench_Run(const char* pszName, const char* pszDir, DIRINDEXFILTERFUNC pfnFilter, LPTASKPOOL pPool,
+    long nFiles)
+{
+  static const char* const cacheNames[] = { "warm", "dropped", "evicted" };
+
+  for (int bWarm = 0; bWarm < 2; ++bWarm) {
+    int nCache = bWarm ? CACHE_WARM : Bench_DropCache(pszDir, nFiles);
+
+    DIRINDEX index;
+    DirIndex_Init(&index);
+
+    double start = Bench_Now();
+    double first = 0.0;
+    if (!pPool) {
+      DirIndex_Open(&index, pszDir, pfnFilter, NULL);
+    }
+    else {
+      DirIndex_OpenAsync(&index, pszDir, pfnFilter, NULL, pPool);
+      while (DirIndex_IsScanning(&index)) {
+        DirIndex_Refresh(&index);
+        if (!first && DirIndex_GetCount(&index)) {
+          first = Bench_Now() - start;
+        }
+        Bench_SleepUs(200);
+      }
+    }
+    double total = Bench_Now() - start;
+    if (!first) {
+      first = total;
+    }
+
+    printf("  %-22s %-7s first %9.1f ms  complete %9.1f ms  %7zu images\n", pszName, cacheNames[nCache],
+        first * 1e3, total * 1e3, DirIndex_GetCount(&index));
+
+    DirIndex_Close(&index);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  long nFiles = Bench_ArgLong(argc, argv, 1, 100000);
+  long nWorkers = Bench_ArgLong(argc, argv, 2, 8);
+
+  ImgFormat_InitRegistry(&g_registry);
+
+  TASKPOOL pool;
+  if (TaskPool_Init(&pool, (unsigned int)nWorkers) != TASKPOOL_OK) {
+    fprintf(stderr, "Unable to start the task pool\n");
+    return 1;
+  }
+
+  char szDir[256] = "bench_dir_scan_XXXXXX";
+#ifdef _WIN32
+  if (_mktemp_s(szDir, sizeof(szDir)) != 0 || _mkdir(szDir) != 0) {
+#else
+  if (!mkdtemp(szDir)) {
+#endif
+    fprintf(stderr, "Unable to create a scratch directory\n");
+    return 1;
+  }
+
+  static const unsigned char png[128] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  static const char text[128] = "Not an image, only a name and a few bytes of text.";
+  char szPath[512];
+  char szName[64];
+  for (long i = 0; i < nFiles; ++i) {
+    Bench_FileName(i, szName, sizeof(szName));
+    snprintf(szPath, sizeof(szPath), "%s%c%s", szDir, DIRINDEX_PATH_SEPARATOR, szName);
+    FILE* fp = fopen(szPath, "wb");
+    if (fp) {
+      fwrite(i % 10 == 9 ? (const void*)text : (const void*)png, 1, 128, fp);
+      fclose(fp);
+    }
+  }
+
+  printf("Opening a directory of %ld files, %ld of them images, %ld workers, %u CPUs\n", nFiles,
+      nFiles - nFiles / 10, nWorkers, Thread_GetCPUCount());
+#ifdef __linux__
+  struct statfs fs;
+  if (statfs(szDir, &fs) == 0 && fs.f_type == BENCH_TMPFS_MAGIC) {
+    printf("  On a tmpfs, the cold runs are warm as well\n");
+  }
+#endif
+
+  Bench_Run("sync, magic", szDir, MagicFilter, NULL, nFiles);
+  Bench_Run("sync, extension first", szDir, ExtensionFilter, NULL, nFiles);
+  Bench_Run("async, magic", szDir, MagicFilter, &pool, nFiles);
+  Bench_Run("async, extension first", szDir, ExtensionFilter, &pool, nFiles);
+
+  for (long i = 0; i < nFiles; ++i) {
+    Bench_FileName(i, szName, sizeof(szName));
+    snprintf(szPath, sizeof(szPath), "%s%c%s", szDir, DIRINDEX_PATH_SEPARATOR, szName);
+    remove(szPath);
+  }
+  rmdir(szDir);
+
+  TaskPool_Cleanup(&pool);
+  return 0;
+}
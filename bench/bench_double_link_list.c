@@ -0,0 +1,86 @@
+/*
+ * bench_double_link_list.c
+ *
+ * Scaling of DoubleLinkList_Sort on file-name-like strings from 1k to 1M
+ * nodes, next to the former nested-loop swap sort where it finishes in
+ * reasonable time.
+ *
+ * Usage: bench_double_link_list [max nodes]
+ */
+
+#include "../dlnklist.h"
+#include "benchutil.h"
+
+#include <math.h>
+#include <string.h>
+
+#define LEGACY_MAX_NODES 16000
+
+static int StringComparator(const void* p1, size_t size1, const void* p2, size_t size2)
+{
+  (void)size1;
+  (void)size2;
+
+  return strcmp((const char*)p1, (const char*)p2);
+}
+
+/* The sort this list shipped with: O(n^2) comparisons, swapping payloads */
+static void LegacySort(LPDOUBLELINKLIST pList)
+{
+  for (LPDOUBLELINKLISTNODE pNode1 = pList->pBegin; pNode1; pNode1 = pNode1->pNext) {
+    for (LPDOUBLELINKLISTNODE pNode2 = pNode1->pNext; pNode2; pNode2 = pNode2->pNext) {
+      if (pList->pfnSort(pNode1->pValue, pNode1->valueSize, pNode2->pValue, pNode2->valueSize) < 0) {
+        void* temp = pNode1->pValue;
+        pNode1->pValue = pNode2->pValue;
+        pNode2->pValue = temp;
+      }
+    }
+  }
+}
+
+static void FillList(LPDOUBLELINKLIST pList, long count, unsigned int seed)
+{
+  char szName[32];
+
+  DoubleLinkList_Init(pList, StringComparator);
+  for (long i = 0; i < count; ++i) {
+    int len = snprintf(szName, sizeof(szName), "IMG_%08u.jpg", Bench_Random(&seed) % 100000000u);
+    DoubleLinkList_AppendFront(pList, szName, (size_t)len + 1, 0);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  long maxNodes = Bench_ArgLong(argc, argv, 1, 1000000);
+
+  printf("%10s %14s %14s %16s\n", "nodes", "merge (ms)", "legacy (ms)", "merge ns/nlog2n");
+
+  for (long count = 1000; count <= maxNodes; count *= 10) {
+    DOUBLELINKLIST list;
+
+    FillList(&list, count, 0xC0FFEEu);
+    double start = Bench_Now();
+    DoubleLinkList_Sort(&list);
+    double merge = Bench_Now() - start;
+    DoubleLinkList_Free(&list);
+
+    double legacy = -1.0;
+    if (count <= LEGACY_MAX_NODES) {
+      FillList(&list, count, 0xC0FFEEu);
+      start = Bench_Now();
+      LegacySort(&list);
+      legacy = Bench_Now() - start;
+      DoubleLinkList_Free(&list);
+    }
+
+    double perOp = merge * 1e9 / ((double)count * log2((double)count));
+    if (legacy >= 0) {
+      printf("%10ld %14.2f %14.2f %16.2f\n", count, merge * 1e3, legacy * 1e3, perOp);
+    }
+    else {
+      printf("%10ld %14.2f %14s %16.2f\n", count, merge * 1e3, "skipped", perOp);
+    }
+  }
+
+  return 0;
+}
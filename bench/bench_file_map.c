@@ -0,0 +1,160 @@
+/*
+ * bench_file_map.c
+ *
+ * Reading a whole file through stdio, in 1 MB freads into a buffer, against
+ * mapping it and reading it where it lies, for files of 10 MB up to 2 GB.
+ * Both passes sum every byte so the pages are really touched. Also timed is
+ * how long it takes to get at the first 4 KB, which is what a format probe
+ * needs. Timings are with the file in the page cache, after one run to
+ * warm it.
+ *
+ * Usage: bench_file_map [max MB] [runs]
+ */
+
+#include "../filemap.h"
+#include "benchutil.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define CHUNK_SIZE (1 << 20)
+#define PROBE_SIZE 4096
+
+static const char szBenchFile[] = "bench_file_map.bin";
+
+static int WriteSyntheticFile(uint64_t size, unsigned char* pChunk)
+{
+  FILE* fp = fopen(szBenchFile, "wb");
+  if (!fp) {
+    return 0;
+  }
+
+  unsigned int seed = 0x2545F491u;
+  for (size_t i = 0; i < CHUNK_SIZE; ++i) {
+    pChunk[i] = (unsigned char)Bench_Random(&seed);
+  }
+
+  for (uint64_t written = 0; written < size; written += CHUNK_SIZE) {
+    size_t cb = size - written < CHUNK_SIZE ? (size_t)(size - written) : CHUNK_SIZE;
+    pChunk[0] = (unsigned char)(written >> 20);
+    if (fwrite(pChunk, 1, cb, fp) != cb) {
+      fclose(fp);
+      return 0;
+    }
+  }
+
+  return fclose(fp) == 0;
+}
+
+static uint64_t Checksum(const unsigned char* pData, size_t size)
+{
+  uint64_t sum = 0;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t v;
+    memcpy(&v, pData + i, 8);
+    sum += v;
+  }
+  for (; i < size; ++i) {
+    sum += pData[i];
+  }
+
+  return sum;
+}
+
+static double BenchStdio(unsigned char* pChunk, size_t cbRead, uint64_t* pSum)
+{
+  double start = Bench_Now();
+
+  FILE* fp = fopen(szBenchFile, "rb");
+  if (!fp) {
+    return -1.0;
+  }
+
+  uint64_t sum = 0;
+  size_t cb;
+  while ((cb = fread(pChunk, 1, cbRead, fp)) > 0) {
+    sum += Checksum(pChunk, cb);
+    if (cbRead < CHUNK_SIZE) {
+      break;
+    }
+  }
+  fclose(fp);
+
+  *pSum = sum;
+  return Bench_Now() - start;
+}
+
+static double BenchMap(size_t cbRead, uint64_t* pSum)
+{
+  double start = Bench_Now();
+
+  FILEMAP map;
+  if (FileMap_Open(&map, szBenchFile) != FILEMAP_OK) {
+    return -1.0;
+  }
+
+  *pSum = Checksum(map.pData, cbRead < map.size ? cbRead : map.size);
+  FileMap_Close(&map);
+
+  return Bench_Now() - start;
+}
+
+static void Bench_Size(uint64_t size, unsigned char* pChunk, long nRuns)
+{
+  if (!WriteSyntheticFile(size, pChunk)) {
+    printf("  %6.0f MB  unable to write %s\n", size / 1e6, szBenchFile);
+    return;
+  }
+
+  double stdio = 1e30, mapped = 1e30, stdioProbe = 1e30, mappedProbe = 1e30;
+  uint64_t sumStdio = 0, sumMapped = 0;
+  for (long i = 0; i <= nRuns; ++i) {
+    double t = BenchStdio(pChunk, CHUNK_SIZE, &sumStdio);
+    if (i && t >= 0 && t < stdio) {
+      stdio = t;
+    }
+    t = BenchMap(SIZE_MAX, &sumMapped);
+    if (i && t >= 0 && t < mapped) {
+      mapped = t;
+    }
+
+    uint64_t sum;
+    t = BenchStdio(pChunk, PROBE_SIZE, &sum);
+    if (i && t >= 0 && t < stdioProbe) {
+      stdioProbe = t;
+    }
+    t = BenchMap(PROBE_SIZE, &sum);
+    if (i && t >= 0 && t < mappedProbe) {
+      mappedProbe = t;
+    }
+  }
+
+  printf("  %6.0f MB  stdio %9.2f ms %7.2f GB/s  mapped %9.2f ms %7.2f GB/s  %5.2fx  probe %6.1f us / %6.1f us%s\n",
+      size / 1e6, stdio * 1e3, size / stdio / 1e9, mapped * 1e3, size / mapped / 1e9, stdio / mapped,
+      stdioProbe * 1e6, mappedProbe * 1e6, sumStdio == sumMapped ? "" : "  MISMATCH");
+
+  remove(szBenchFile);
+}
+
+int main(int argc, char** argv)
+{
+  long maxMB = Bench_ArgLong(argc, argv, 1, 2048);
+  long nRuns = Bench_ArgLong(argc, argv, 2, 3);
+
+  unsigned char* pChunk = (unsigned char*)malloc(CHUNK_SIZE);
+  if (!pChunk) {
+    return 1;
+  }
+
+  printf("Sequential read of the whole file, %d KB freads against a mapping, best of %ld\n", CHUNK_SIZE >> 10,
+      nRuns);
+
+  static const long sizesMB[] = { 10, 100, 1024, 2048 };
+  for (size_t i = 0; i < sizeof(sizesMB) / sizeof(sizesMB[0]) && sizesMB[i] <= maxMB; ++i) {
+    Bench_Size((uint64_t)sizesMB[i] << 20, pChunk, nRuns);
+  }
+
+  free(pChunk);
+  return 0;
+}
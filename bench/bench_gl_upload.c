@@ -0,0 +1,210 @@
+/*
+ * bench_gl_upload.c
+ *
+ * Texture upload cost on an offscreen EGL context, e.g. Mesa's llvmpipe on
+ * a headless box. A stream of frames is uploaded into one texture, the way
+ * the viewer does when paging through a folder, with each method:
+ *
+ *   teximage+mip  glTexImage2D from client memory and glGenerateMipmap
+ *   teximage      glTexImage2D from client memory
+ *   subimage      glTexSubImage2D into kept storage
+ *   pbo orphan    through the unpack buffer ring, orphaned buffers
+ *   pbo persist   through the unpack buffer ring, persistent mapping
+ *
+ * "stall" is the time the calling thread is blocked per frame, copying
+ * into mapped memory included; "total" ends with a glFinish after the last
+ * frame, and the throughput follows from it.
+ *
+ * Usage: bench_gl_upload [frames]
+ */
+
+#include "../glupload.h"
+#include "../pixconv.h"
+#include "benchutil.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <stdint.h>
+#include <string.h>
+
+enum {
+  METHOD_TEXIMAGE_MIPMAP = 0,
+  METHOD_TEXIMAGE = 1,
+  METHOD_SUBIMAGE = 2,
+  METHOD_PBO_ORPHAN = 3,
+  METHOD_PBO_PERSISTENT = 4,
+  METHOD_COUNT
+};
+
+static const char* g_szMethods[METHOD_COUNT] = {
+  "teximage+mip", "teximage", "subimage", "pbo orphan", "pbo persist"
+};
+
+static const struct {
+  const char* szName;
+  size_t width;
+  size_t height;
+  int nFormat;
+} g_benchCases[] = {
+  { "1080p", 1920, 1080, PIXFMT_PBGRA32 },
+  { "4K", 3840, 2160, PIXFMT_PBGRA32 },
+  { "4K gray", 3840, 2160, PIXFMT_GRAY8 },
+};
+
+static int Bench_InitGL(EGLDisplay* pDisplay, EGLContext* pContext)
+{
+  PFNEGLGETPLATFORMDISPLAYEXTPROC pfnGetPlatformDisplay =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  *pDisplay = pfnGetPlatformDisplay
+      ? pfnGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL)
+      : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (*pDisplay == EGL_NO_DISPLAY || !eglInitialize(*pDisplay, NULL, NULL) || !eglBindAPI(EGL_OPENGL_API)) {
+    return 0;
+  }
+
+  const EGLint contextAttribs[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+  *pContext = eglCreateContext(*pDisplay, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+  return *pContext != EGL_NO_CONTEXT && eglMakeCurrent(*pDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, *pContext);
+}
+
+/* Frames alternate between two images, as a viewer stepping back and forth */
+static int Bench_Stream(int nMethod, uint8_t* pImages[2], size_t width, size_t height, int nFormat,
+    long nFrames, PERFCOUNTER* pStall, double* pTotal)
+{
+  size_t stride = width * (size_t)PixConv_GetBytesPerPixel(nFormat);
+
+  GLuint textureId = 0;
+  glGenTextures(1, &textureId);
+  glBindTexture(GL_TEXTURE_2D, textureId);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+      nMethod == METHOD_TEXIMAGE_MIPMAP ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+
+  GLUPLOADRING ring;
+  int bRing = nMethod == METHOD_PBO_ORPHAN || nMethod == METHOD_PBO_PERSISTENT;
+  if (bRing) {
+    GLUpload_Init(&ring, nMethod == METHOD_PBO_PERSISTENT);
+    if (nMethod == METHOD_PBO_PERSISTENT && !ring.bPersistent) {
+      GLUpload_Cleanup(&ring);
+      glDeleteTextures(1, &textureId);
+      return 0;
+    }
+  }
+
+  GLTEXLEVEL level = { 0 };
+  PerfCounter_Reset(pStall);
+  glFinish();
+
+  int status = GLTEXTURE_OK;
+  double start = Bench_Now();
+  for (long i = 0; i < nFrames && status == GLTEXTURE_OK; ++i) {
+    const uint8_t* pPixels = pImages[i & 1];
+    uint64_t frameStart = PerfCounter_Now();
+
+    switch (nMethod) {
+    case METHOD_TEXIMAGE_MIPMAP:
+      status = GLTexture_Upload(pPixels, width, height, stride, nFormat, NULL, NULL);
+      glGenerateMipmap(GL_TEXTURE_2D);
+      break;
+    case METHOD_TEXIMAGE:
+      status = GLTexture_Upload(pPixels, width, height, stride, nFormat, NULL, NULL);
+      break;
+    case METHOD_SUBIMAGE:
+      status = GLTexture_Upload(pPixels, width, height, stride, nFormat, &level, NULL);
+      break;
+    default: {
+      void* pMapped = GLUpload_Map(&ring, stride * height);
+      if (!pMapped) {
+        status = GLTEXTURE_ERROR_GL;
+        break;
+      }
+      memcpy(pMapped, pPixels, stride * height);
+      status = GLUpload_Commit(&ring, width, height, stride, nFormat, &level, NULL) == GLUPLOAD_OK
+          ? GLTEXTURE_OK : GLTEXTURE_ERROR_GL;
+      break;
+    }
+    }
+
+    PerfCounter_AddSince(pStall, frameStart);
+  }
+
+  glFinish();
+  *pTotal = Bench_Now() - start;
+
+  if (bRing) {
+    GLUpload_Cleanup(&ring);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glDeleteTextures(1, &textureId);
+
+  return status == GLTEXTURE_OK ? 1 : -1;
+}
+
+int main(int argc, char** argv)
+{
+  long nFrames = Bench_ArgLong(argc, argv, 1, 20);
+
+  EGLDisplay display = EGL_NO_DISPLAY;
+  EGLContext context = EGL_NO_CONTEXT;
+  if (!Bench_InitGL(&display, &context)) {
+    printf("No EGL OpenGL context, nothing to measure\n");
+    return 0;
+  }
+
+  printf("Texture uploads, %ld frames, %s (%s)\n", nFrames, (const char*)glGetString(GL_RENDERER),
+      GLUpload_IsPersistentSupported() ? "persistent mapping" : "no persistent mapping");
+
+  for (size_t c = 0; c < sizeof(g_benchCases) / sizeof(g_benchCases[0]); ++c) {
+    size_t width = g_benchCases[c].width;
+    size_t height = g_benchCases[c].height;
+    size_t cbImage = width * height * (size_t)PixConv_GetBytesPerPixel(g_benchCases[c].nFormat);
+
+    uint8_t* pImages[2] = { (uint8_t*)malloc(cbImage), (uint8_t*)malloc(cbImage) };
+    if (!pImages[0] || !pImages[1]) {
+      free(pImages[0]);
+      free(pImages[1]);
+      return 1;
+    }
+
+    unsigned int seed = 0x9E3779B9u;
+    for (size_t i = 0; i < cbImage; ++i) {
+      pImages[0][i] = (uint8_t)Bench_Random(&seed);
+      pImages[1][i] = (uint8_t)~pImages[0][i];
+    }
+
+    printf("\n%s (%zux%zu, %.1f MB)\n", g_benchCases[c].szName, width, height, cbImage / 1e6);
+    printf("  method        stall mean ms  stall max ms  total ms   MB/s\n");
+
+    for (int nMethod = 0; nMethod < METHOD_COUNT; ++nMethod) {
+      PERFCOUNTER stall;
+      double total = 0.0;
+      int status = Bench_Stream(nMethod, pImages, width, height, g_benchCases[c].nFormat, nFrames, &stall, &total);
+      if (status < 0) {
+        printf("  %-12s  failed\n", g_szMethods[nMethod]);
+        continue;
+      }
+      if (!status) {
+        printf("  %-12s  not supported\n", g_szMethods[nMethod]);
+        continue;
+      }
+
+      printf("  %-12s  %13.2f  %12.2f  %8.1f  %5.0f\n", g_szMethods[nMethod],
+          PerfCounter_GetMean(&stall) / 1e6, stall.maxNs / 1e6, total * 1e3,
+          cbImage * (double)nFrames / total / 1e6);
+    }
+
+    free(pImages[0]);
+    free(pImages[1]);
+  }
+
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(display, context);
+  eglTerminate(display);
+  return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * bench_hash_map.c
+ *
+ * Insert and lookup throughput of the open-addressing HASHTABLE, the HASHMAP
+ * compatibility layer on top of it, and the red-black tree HASHMAP used to be.
+ *
+ * Usage: bench_hash_map [lookups]
+ */
+
+#include "../hashmap.h"
+#include "../rbtree.h"
+#include "benchutil.h"
+
+#include <stdint.h>
+
+typedef struct _tagBENCHRESULT {
+  double insert;
+  double lookup;
+  uintptr_t checksum;
+} BENCHRESULT;
+
+/* Unique keys in random order; compareInt subtracts, so they stay small */
+static int* MakeKeys(long count, unsigned int* pSeed)
+{
+  int* pKeys = (int*)malloc(sizeof(int) * (size_t)count);
+  for (long i = 0; i < count; ++i) {
+    pKeys[i] = (int)(i * 2 + 1);
+  }
+
+  for (long i = count - 1; i > 0; --i) {
+    long j = (long)(Bench_Random(pSeed) % (unsigned int)(i + 1));
+    int tmp = pKeys[i];
+    pKeys[i] = pKeys[j];
+    pKeys[j] = tmp;
+  }
+
+  return pKeys;
+}
+
+static BENCHRESULT BenchHashTable(const int* pKeys, long count, const int* pProbe, long nLookups)
+{
+  BENCHRESULT result = { 0 };
+  HASHTABLE table;
+  HashTable_Init(&table, sizeof(int), sizeof(void*), NULL);
+
+  double start = Bench_Now();
+  for (long i = 0; i < count; ++i) {
+    void* pValue = (void*)(uintptr_t)pKeys[i];
+    HashTable_Insert(&table, &pKeys[i], &pValue);
+  }
+  result.insert = Bench_Now() - start;
+
+  start = Bench_Now();
+  for (long i = 0; i < nLookups; ++i) {
+    void** ppValue = (void**)HashTable_Find(&table, &pProbe[i]);
+    result.checksum += ppValue ? (uintptr_t)*ppValue : 0;
+  }
+  result.lookup = Bench_Now() - start;
+
+  HashTable_Cleanup(&table);
+  return result;
+}
+
+static BENCHRESULT BenchHashMap(const int* pKeys, long count, const int* pProbe, long nLookups)
+{
+  BENCHRESULT result = { 0 };
+  HASHMAP hashMap;
+  InitializeHashMap(&hashMap, sizeof(int), compareInt);
+
+  double start = Bench_Now();
+  for (long i = 0; i < count; ++i) {
+    void* pValue = (void*)(uintptr_t)pKeys[i];
+    HashMap_Insert(&hashMap, &pKeys[i], &pValue, sizeof(pValue));
+  }
+  result.insert = Bench_Now() - start;
+
+  start = Bench_Now();
+  for (long i = 0; i < nLookups; ++i) {
+    void** ppValue = (void**)HashMap_Get(&hashMap, &pProbe[i]);
+    result.checksum += ppValue ? (uintptr_t)*ppValue : 0;
+  }
+  result.lookup = Bench_Now() - start;
+
+  HashMap_Cleanup(&hashMap);
+  return result;
+}
+
+static BENCHRESULT BenchRBTree(const int* pKeys, long count, const int* pProbe, long nLookups)
+{
+  BENCHRESULT result = { 0 };
+  RBTREE tree;
+  InitializeRBTree(&tree, sizeof(int), compareInt);
+
+  double start = Bench_Now();
+  for (long i = 0; i < count; ++i) {
+    void* pValue = (void*)(uintptr_t)pKeys[i];
+    RBTree_Insert(&tree, &pKeys[i], &pValue, sizeof(pValue));
+  }
+  result.insert = Bench_Now() - start;
+
+  start = Bench_Now();
+  for (long i = 0; i < nLookups; ++i) {
+    void** ppValue = (void**)RBTree_Get(&tree, &pProbe[i]);
+    result.checksum += ppValue ? (uintptr_t)*ppValue : 0;
+  }
+  result.lookup = Bench_Now() - start;
+
+  RBTree_Cleanup(&tree);
+  return result;
+}
+
+static void PrintResult(const char* szName, BENCHRESULT result, long count, long nLookups)
+{
+  printf("  %-10s insert %8.2f Mops/s   lookup %8.2f Mops/s\n", szName,
+    count / result.insert / 1e6, nLookups / result.lookup / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+  static const long sizes[] = { 10, 1000, 1000000 };
+  long nLookups = Bench_ArgLong(argc, argv, 1, 1000000);
+  unsigned int seed = 0x1234567u;
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    long count = sizes[s];
+    int* pKeys = MakeKeys(count, &seed);
+
+    /* Three quarters hits, one quarter misses (even keys are never stored) */
+    int* pProbe = (int*)malloc(sizeof(int) * (size_t)nLookups);
+    for (long i = 0; i < nLookups; ++i) {
+      int key = pKeys[Bench_Random(&seed) % (unsigned int)count];
+      pProbe[i] = (i & 3) ? key : key + 1;
+    }
+
+    /* Small maps are rebuilt until the insert timing is measurable */
+    long nRounds = count < 100000 ? 1000000 / count : 1;
+    BENCHRESULT table = { 1e30, 1e30, 0 };
+    BENCHRESULT hashMap = { 1e30, 1e30, 0 };
+    BENCHRESULT tree = { 1e30, 1e30, 0 };
+    BENCHRESULT r;
+
+    double insertTable = 0.0;
+    double insertHashMap = 0.0;
+    double insertTree = 0.0;
+    for (long i = 0; i < nRounds; ++i) {
+      insertTable += BenchHashTable(pKeys, count, pProbe, 0).insert;
+      insertHashMap += BenchHashMap(pKeys, count, pProbe, 0).insert;
+      insertTree += BenchRBTree(pKeys, count, pProbe, 0).insert;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+      r = BenchHashTable(pKeys, count, pProbe, nLookups);
+      table.lookup = r.lookup < table.lookup ? r.lookup : table.lookup;
+      table.checksum = r.checksum;
+      r = BenchHashMap(pKeys, count, pProbe, nLookups);
+      hashMap.lookup = r.lookup < hashMap.lookup ? r.lookup : hashMap.lookup;
+      hashMap.checksum = r.checksum;
+      r = BenchRBTree(pKeys, count, pProbe, nLookups);
+      tree.lookup = r.lookup < tree.lookup ? r.lookup : tree.lookup;
+      tree.checksum = r.checksum;
+    }
+
+    table.insert = insertTable / nRounds;
+    hashMap.insert = insertHashMap / nRounds;
+    tree.insert = insertTree / nRounds;
+
+    printf("%ld entries, %ld lookups%s\n", count, nLookups,
+      table.checksum == tree.checksum && hashMap.checksum == tree.checksum ? "" : " (MISMATCH)");
+    PrintResult("hashtable", table, count, nLookups);
+    PrintResult("hashmap", hashMap, count, nLookups);
+    PrintResult("rbtree", tree, count, nLookups);
+
+    free(pProbe);
+    free(pKeys);
+  }
+
+  return 0;
+}
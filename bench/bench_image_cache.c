@@ -0,0 +1,99 @@
+/*
+ * bench_image_cache.c
+ *
+ * Synthetic browsing session against the decoded-image cache: mostly
+ * stepping forward, regularly stepping back a few images and now and then
+ * jumping elsewhere in the folder. Image sizes range from phone shots to
+ * large scans. Reports hit rate, evictions and the bytes that did not have
+ * to be decoded again for a range of budgets, plus the cost of the cache
+ * operations themselves.
+ *
+ * Usage: bench_image_cache [images] [steps]
+ */
+
+#include "../imgcache.h"
+#include "benchutil.h"
+
+#include <string.h>
+
+typedef struct _tagBENCHIMAGE {
+  char szPath[32];
+  size_t cost;
+} BENCHIMAGE;
+
+static void ReleaseNothing(void* pImage, void* pUserData)
+{
+  (void)pImage;
+  (void)pUserData;
+}
+
+int main(int argc, char** argv)
+{
+  long nImages = Bench_ArgLong(argc, argv, 1, 2000);
+  long nSteps = Bench_ArgLong(argc, argv, 2, 1000000);
+
+  BENCHIMAGE* pImages = (BENCHIMAGE*)calloc((size_t)nImages, sizeof(BENCHIMAGE));
+  if (!pImages) {
+    return 1;
+  }
+
+  unsigned int seed = 12345;
+  for (long i = 0; i < nImages; ++i) {
+    snprintf(pImages[i].szPath, sizeof(pImages[i].szPath), "IMG_%06ld.JPG", i);
+
+    /* 2 to 48 megapixels, 4 bytes per pixel */
+    size_t megapixels = 2 + Bench_Random(&seed) % 47;
+    pImages[i].cost = megapixels * 1000000 * 4;
+  }
+
+  const size_t budgetsMB[] = { 128, 256, 512, 1024, 2048 };
+
+  printf("%ld images, %ld navigation steps\n", nImages, nSteps);
+  printf("  budget MB   hit rate   evictions   GB not decoded   ns/op\n");
+
+  for (size_t b = 0; b < sizeof(budgetsMB) / sizeof(budgetsMB[0]); ++b) {
+    IMGCACHE cache;
+    ImgCache_Init(&cache, budgetsMB[b] << 20, ReleaseNothing, NULL);
+
+    unsigned int walk = 777;
+    long nCurrent = 0;
+    double savedBytes = 0.0;
+
+    double start = Bench_Now();
+    for (long i = 0; i < nSteps; ++i) {
+      unsigned int r = Bench_Random(&walk) % 100;
+      if (r < 70) {
+        nCurrent = (nCurrent + 1) % nImages;
+      }
+      else if (r < 95) {
+        nCurrent = (nCurrent + nImages - 1 - (long)(r % 3)) % nImages;
+      }
+      else {
+        nCurrent = (long)(Bench_Random(&walk) % (unsigned int)nImages);
+      }
+
+      BENCHIMAGE* pImage = &pImages[nCurrent];
+      if (ImgCache_Find(&cache, pImage->szPath, pImage->cost, 0)) {
+        savedBytes += (double)pImage->cost;
+      }
+      else {
+        ImgCache_Insert(&cache, pImage->szPath, pImage->cost, 0, pImage, pImage->cost);
+      }
+    }
+    double elapsed = Bench_Now() - start;
+
+    IMGCACHESTATS stats;
+    ImgCache_GetStats(&cache, &stats);
+    printf("  %9zu   %7.2f%%   %9llu   %14.1f   %5.0f\n",
+        budgetsMB[b],
+        100.0 * (double)stats.hits / (double)(stats.hits + stats.misses),
+        (unsigned long long)stats.evictions,
+        savedBytes / 1e9,
+        elapsed * 1e9 / (double)nSteps);
+
+    ImgCache_Cleanup(&cache);
+  }
+
+  free(pImages);
+  return 0;
+}
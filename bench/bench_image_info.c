@@ -0,0 +1,223 @@
+/*
+ * bench_image_info.c
+ *
+ * Header-only probe throughput over a synthetic directory of mixed images:
+ * PNG, APNG, JPEG, animated GIF and WebP, BMP and PPM, each with a payload
+ * of the given size. Probing with and without counting frames is compared
+ * to reading every file through once, the least any decode has to do.
+ *
+ * Usage: bench_image_info [files] [KB per file]
+ */
+
+#include "../dirindex.h"
+#include "../imageinfo.h"
+#include "benchutil.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+#define BENCH_FRAMES 8
+
+static void PutBE32(FILE* fp, uint32_t value)
+{
+  const unsigned char bytes[4] = {
+    (unsigned char)(value >> 24), (unsigned char)(value >> 16), (unsigned char)(value >> 8), (unsigned char)value
+  };
+  fwrite(bytes, 1, 4, fp);
+}
+
+static void PutLE32(FILE* fp, uint32_t value)
+{
+  const unsigned char bytes[4] = {
+    (unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24)
+  };
+  fwrite(bytes, 1, 4, fp);
+}
+
+static void PutPNGChunk(FILE* fp, const char* pszType, const unsigned char* pData, size_t size)
+{
+  PutBE32(fp, (uint32_t)size);
+  fwrite(pszType, 1, 4, fp);
+  if (size) {
+    fwrite(pData, 1, size, fp);
+  }
+  PutBE32(fp, 0);
+}
+
+/* The i-th synthetic image, 4000x3000 whatever the format */
+static void WriteImage(FILE* fp, long i, const unsigned char* pPayload, size_t size)
+{
+  static const unsigned char ihdr[13] = { 0x00, 0x00, 0x0F, 0xA0, 0x00, 0x00, 0x0B, 0xB8, 0x08, 0x02 };
+  static const unsigned char actl[8] = { 0x00, 0x00, 0x00, BENCH_FRAMES };
+  static const unsigned char jpeg[] = {
+    0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0,
+    0xFF, 0xC0, 0x00, 0x11, 0x08, 0x0B, 0xB8, 0x0F, 0xA0, 0x03
+  };
+  static const unsigned char gif[13] = { 'G', 'I', 'F', '8', '9', 'a', 0xA0, 0x0F, 0xB8, 0x0B, 0xF7 };
+  static const unsigned char gifFrame[11] = { 0x2C, 0, 0, 0, 0, 0xA0, 0x0F, 0xB8, 0x0B, 0x00, 0x08 };
+  static const unsigned char vp8x[18] = {
+    'V', 'P', '8', 'X', 0x0A, 0x00, 0x00, 0x00, 0x12, 0x00, 0x00, 0x00, 0x9F, 0x0F, 0x00, 0xB7, 0x0B, 0x00
+  };
+  static const unsigned char bmp[54] = {
+    'B', 'M', 0, 0, 0, 0, 0, 0, 0, 0, 0x36, 0, 0, 0, 0x28, 0, 0, 0, 0xA0, 0x0F, 0, 0, 0xB8, 0x0B, 0, 0,
+    0x01, 0x00, 0x18, 0x00
+  };
+
+  size_t frameSize = (size / BENCH_FRAMES) & ~(size_t)1;
+
+  switch (i % 7) {
+  case 0:
+  case 1:
+    fwrite("\x89PNG\r\n\x1A\n", 1, 8, fp);
+    PutPNGChunk(fp, "IHDR", ihdr, sizeof(ihdr));
+    if (i % 7 == 1) {
+      PutPNGChunk(fp, "acTL", actl, sizeof(actl));
+    }
+    PutPNGChunk(fp, "IDAT", pPayload, size);
+    PutPNGChunk(fp, "IEND", NULL, 0);
+    break;
+
+  case 2:
+    fwrite(jpeg, 1, sizeof(jpeg), fp);
+    fwrite(pPayload, 1, size, fp);
+    break;
+
+  case 3:
+    fwrite(gif, 1, sizeof(gif), fp);
+    fwrite(pPayload, 1, 768, fp);
+    for (int nFrame = 0; nFrame < BENCH_FRAMES; ++nFrame) {
+      fwrite(gifFrame, 1, sizeof(gifFrame), fp);
+      for (size_t done = 0; done < frameSize; done += 255) {
+        size_t block = frameSize - done < 255 ? frameSize - done : 255;
+        fputc((int)block, fp);
+        fwrite(pPayload + done, 1, block, fp);
+      }
+      fputc(0, fp);
+    }
+    fputc(0x3B, fp);
+    break;
+
+  case 4:
+    fwrite("RIFF", 1, 4, fp);
+    PutLE32(fp, (uint32_t)(4 + sizeof(vp8x) + BENCH_FRAMES * (8 + frameSize)));
+    fwrite("WEBP", 1, 4, fp);
+    fwrite(vp8x, 1, sizeof(vp8x), fp);
+    for (int nFrame = 0; nFrame < BENCH_FRAMES; ++nFrame) {
+      fwrite("ANMF", 1, 4, fp);
+      PutLE32(fp, (uint32_t)frameSize);
+      fwrite(pPayload, 1, frameSize, fp);
+    }
+    break;
+
+  case 5:
+    fwrite(bmp, 1, sizeof(bmp), fp);
+    fwrite(pPayload, 1, size, fp);
+    break;
+
+  default:
+    fputs("P6\n4000 3000\n255\n", fp);
+    fwrite(pPayload, 1, size, fp);
+    break;
+  }
+}
+
+static int ReadThrough(const char* pszPath, unsigned char* pBuffer, size_t size)
+{
+  FILE* fp = fopen(pszPath, "rb");
+  if (!fp) {
+    return 0;
+  }
+
+  while (fread(pBuffer, 1, size, fp) == size) {
+  }
+  fclose(fp);
+
+  return 1;
+}
+
+int main(int argc, char** argv)
+{
+  long nFiles = Bench_ArgLong(argc, argv, 1, 7000);
+  long nKB = Bench_ArgLong(argc, argv, 2, 32);
+
+  char szDir[256] = "bench_image_info_XXXXXX";
+#ifdef _WIN32
+  if (_mktemp_s(szDir, sizeof(szDir)) != 0 || _mkdir(szDir) != 0) {
+#else
+  if (!mkdtemp(szDir)) {
+#endif
+    fprintf(stderr, "Unable to create a scratch directory\n");
+    return 1;
+  }
+
+  size_t payloadSize = (size_t)nKB * 1024;
+  unsigned char* pPayload = (unsigned char*)malloc(payloadSize > 65536 ? payloadSize : 65536);
+  if (!pPayload) {
+    return 1;
+  }
+
+  unsigned int seed = 7;
+  for (size_t i = 0; i < payloadSize; ++i) {
+    pPayload[i] = (unsigned char)Bench_Random(&seed);
+  }
+
+  char szPath[512];
+  for (long i = 0; i < nFiles; ++i) {
+    snprintf(szPath, sizeof(szPath), "%s%cIMG_%06ld", szDir, DIRINDEX_PATH_SEPARATOR, i);
+    FILE* fp = fopen(szPath, "wb");
+    if (fp) {
+      WriteImage(fp, i, pPayload, payloadSize);
+      fclose(fp);
+    }
+  }
+
+  IMGFORMATREGISTRY registry;
+  ImgFormat_InitRegistry(&registry);
+
+  printf("%ld images of %ld KB, 2 of every 7 animated with %d frames\n", nFiles, nKB, BENCH_FRAMES);
+  printf("  mode              files/s   described   frames\n");
+
+  const int modes[] = { 0, IMAGEINFO_COUNT_FRAMES };
+  const char* modeNames[] = { "header only", "count frames" };
+  for (int nMode = 0; nMode < 2; ++nMode) {
+    long nDescribed = 0;
+    unsigned long nFrames = 0;
+    double start = Bench_Now();
+    for (long i = 0; i < nFiles; ++i) {
+      IMGINFO info;
+      snprintf(szPath, sizeof(szPath), "%s%cIMG_%06ld", szDir, DIRINDEX_PATH_SEPARATOR, i);
+      if (ImageInfo_Probe(&registry, szPath, &info, modes[nMode]) == IMAGEINFO_OK &&
+          info.width && info.nChannels && info.nBitDepth) {
+        ++nDescribed;
+        nFrames += info.nFrames;
+      }
+    }
+    double elapsed = Bench_Now() - start;
+    printf("  %-14s %10.0f   %9ld   %6lu\n", modeNames[nMode], (double)nFiles / elapsed, nDescribed, nFrames);
+  }
+
+  long nRead = 0;
+  double start = Bench_Now();
+  for (long i = 0; i < nFiles; ++i) {
+    snprintf(szPath, sizeof(szPath), "%s%cIMG_%06ld", szDir, DIRINDEX_PATH_SEPARATOR, i);
+    nRead += ReadThrough(szPath, pPayload, 65536);
+  }
+  double elapsed = Bench_Now() - start;
+  printf("  %-14s %10.0f   %9s   %6s\n", "read through", (double)nRead / elapsed, "-", "-");
+
+  for (long i = 0; i < nFiles; ++i) {
+    snprintf(szPath, sizeof(szPath), "%s%cIMG_%06ld", szDir, DIRINDEX_PATH_SEPARATOR, i);
+    remove(szPath);
+  }
+  rmdir(szDir);
+
+  free(pPayload);
+  return 0;
+}
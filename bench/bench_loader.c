@@ -0,0 +1,123 @@
+/*
+ * bench_loader.c
+ *
+ * Holding the arrow key: keypresses arrive at the keyboard repeat rate while
+ * every image takes longer than that to decode. Measures the latency from
+ * each request to its ready buffer when every keypress decodes synchronously
+ * versus the cancelling background pipeline, where only the newest request
+ * is finished.
+ *
+ * Usage: bench_loader [keypresses] [decode ms] [repeat ms]
+ */
+
+#include "../loader.h"
+#include "benchutil.h"
+
+#include <string.h>
+
+typedef struct _tagBENCHJOB {
+  int nDecodeMs;
+  double submitted;
+  double ready;
+  volatile long status;
+} BENCHJOB;
+
+static void Bench_SleepMs(double ms)
+{
+  /* Busy wait, sleeping would measure the scheduler instead */
+  double until = Bench_Now() + ms * 1e-3;
+  while (Bench_Now() < until) {
+  }
+}
+
+static int BenchDecode(void* pArg, LPLOADTOKEN pToken, void** ppResult, void* pUserData)
+{
+  (void)pUserData;
+
+  /* Busy until the deadline, polling the token like a strip decoder would */
+  BENCHJOB* pJob = (BENCHJOB*)pArg;
+  double until = Bench_Now() + pJob->nDecodeMs * 1e-3;
+  while (Bench_Now() < until) {
+    if (LoadToken_IsCancelled(pToken)) {
+      return LOADER_CANCELLED;
+    }
+  }
+
+  *ppResult = pJob;
+  return LOADER_OK;
+}
+
+static void BenchComplete(void* pArg, void* pResult, int status, uint64_t nGeneration, void* pUserData)
+{
+  (void)pResult;
+  (void)nGeneration;
+  (void)pUserData;
+
+  BENCHJOB* pJob = (BENCHJOB*)pArg;
+  pJob->ready = Bench_Now();
+  Atomic_Store(&pJob->status, status);
+}
+
+int main(int argc, char** argv)
+{
+  long nKeys = Bench_ArgLong(argc, argv, 1, 40);
+  long nDecodeMs = Bench_ArgLong(argc, argv, 2, 80);
+  long nRepeatMs = Bench_ArgLong(argc, argv, 3, 30);
+
+  BENCHJOB* pJobs = (BENCHJOB*)calloc((size_t)nKeys, sizeof(BENCHJOB));
+  if (!pJobs) {
+    return 1;
+  }
+
+  /* Synchronous: a keypress cannot even be seen before the decode ends */
+  double start = Bench_Now();
+  for (long i = 0; i < nKeys; ++i) {
+    /* The key went down at its repeat time, but is seen only now */
+    pJobs[i].submitted = start + i * nRepeatMs * 1e-3;
+    double now = Bench_Now();
+    if (now < pJobs[i].submitted) {
+      Bench_SleepMs((pJobs[i].submitted - now) * 1e3);
+    }
+    Bench_SleepMs((double)nDecodeMs);
+    pJobs[i].ready = Bench_Now();
+  }
+  double syncLast = pJobs[nKeys - 1].ready - pJobs[nKeys - 1].submitted;
+  double syncTotal = pJobs[nKeys - 1].ready - start;
+
+  /* Pipelined: every keypress supersedes the one before */
+  memset(pJobs, 0, (size_t)nKeys * sizeof(BENCHJOB));
+  const LOADERCALLBACKS callbacks = { NULL, NULL, BenchDecode, BenchComplete };
+  LOADER loader;
+  if (Loader_Init(&loader, 2, &callbacks, NULL) != LOADER_OK) {
+    free(pJobs);
+    return 1;
+  }
+
+  start = Bench_Now();
+  for (long i = 0; i < nKeys; ++i) {
+    pJobs[i].nDecodeMs = (int)nDecodeMs;
+    pJobs[i].submitted = Bench_Now();
+    Loader_Submit(&loader, &pJobs[i], 1);
+    if (i + 1 < nKeys) {
+      Bench_SleepMs((double)nRepeatMs);
+    }
+  }
+  Loader_WaitIdle(&loader);
+  Loader_Shutdown(&loader);
+
+  double asyncLast = pJobs[nKeys - 1].ready - pJobs[nKeys - 1].submitted;
+  double asyncTotal = pJobs[nKeys - 1].ready - start;
+  long nFinished = 0;
+  for (long i = 0; i < nKeys; ++i) {
+    nFinished += pJobs[i].status == LOADER_OK;
+  }
+
+  printf("%ld keypresses every %ld ms, %ld ms per decode\n", nKeys, nRepeatMs, nDecodeMs);
+  printf("  synchronous: last image ready %8.1f ms after its keypress, %8.1f ms total, %ld decoded\n",
+      syncLast * 1e3, syncTotal * 1e3, nKeys);
+  printf("  pipelined  : last image ready %8.1f ms after its keypress, %8.1f ms total, %ld decoded\n",
+      asyncLast * 1e3, asyncTotal * 1e3, nFinished);
+
+  free(pJobs);
+  return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * bench_loader_classes.c
+ *
+ * The image on screen while a folder of thumbnails is being decoded: every
+ * thumbnail is queued at once, then visible requests arrive at a steady
+ * pace, each with prefetches of its two neighbours. Measures the latency
+ * from each visible request to its ready buffer, as p50 and p99, when all
+ * requests share one first-in first-out queue, when they are ordered by
+ * class but a running thumbnail always finishes, and when a visible request
+ * also preempts one. Decoders are simulated row by row, busy the whole time
+ * and polling their token between rows.
+ *
+ * Usage: bench_loader_classes [thumbnails] [visible] [period ms] [workers]
+ */
+
+#include "../loader.h"
+#include "benchutil.h"
+
+#include <string.h>
+
+#define BENCH_ROW_MS 0.25
+#define BENCH_VISIBLE_ROWS 40
+#define BENCH_PREFETCH_ROWS 40
+#define BENCH_THUMBNAIL_ROWS 80
+
+enum {
+  MODE_FIFO,
+  MODE_CLASSES,
+  MODE_PREEMPT,
+};
+
+typedef struct _tagBENCHJOB {
+  int nRows;
+  int nDone;                  /* Rows decoded, kept when yielding */
+  int bResumable;
+  double submitted;
+  double ready;
+  volatile long status;
+  volatile long bDone;
+} BENCHJOB;
+
+static void Bench_Busy(double ms)
+{
+  double until = Bench_Now() + ms * 1e-3;
+  while (Bench_Now() < until) {
+  }
+}
+
+/* Sleeping, so the submitting thread leaves the CPUs to the workers */
+static void Bench_SleepMs(double ms)
+{
+#ifdef _WIN32
+  Sleep((DWORD)ms);
+#else
+  struct timespec ts;
+  ts.tv_sec = (time_t)(ms / 1e3);
+  ts.tv_nsec = (long)((ms - ts.tv_sec * 1e3) * 1e6);
+  nanosleep(&ts, NULL);
+#endif
+}
+
+static int BenchDecode(void* pArg, LPLOADTOKEN pToken, void** ppResult, void* pUserData)
+{
+  (void)pUserData;
+
+  BENCHJOB* pJob = (BENCHJOB*)pArg;
+  for (; pJob->nDone < pJob->nRows; ++pJob->nDone) {
+    if (LoadToken_IsCancelled(pToken)) {
+      return LOADER_CANCELLED;
+    }
+    if (pJob->bResumable && LoadToken_ShouldYield(pToken)) {
+      return LOADER_PREEMPTED;
+    }
+    Bench_Busy(BENCH_ROW_MS);
+  }
+
+  *ppResult = pJob;
+  return LOADER_OK;
+}
+
+static void BenchComplete(void* pArg, void* pResult, int status, uint64_t nGeneration, void* pUserData)
+{
+  (void)pResult;
+  (void)nGeneration;
+  (void)pUserData;
+
+  BENCHJOB* pJob = (BENCHJOB*)pArg;
+  pJob->ready = Bench_Now();
+  Atomic_Store(&pJob->status, status);
+  Atomic_Store(&pJob->bDone, 1);
+}
+
+static int Bench_CompareDouble(const void* pA, const void* pB)
+{
+  double a = *(const double*)pA;
+  double b = *(const double*)pB;
+  return a < b ? -1 : a > b;
+}
+
+static void Bench_Run(const char* pszName, int nMode, long nThumbnails, long nVisible, long nPeriodMs,
+    unsigned int nWorkers)
+{
+  long nJobs = nThumbnails + nVisible * 3;
+  BENCHJOB* pJobs = (BENCHJOB*)calloc((size_t)nJobs, sizeof(BENCHJOB));
+  double* pLatencies = (double*)calloc((size_t)nVisible, sizeof(double));
+  if (!pJobs || !pLatencies) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  const LOADERCALLBACKS callbacks = { NULL, NULL, BenchDecode, BenchComplete };
+  LOADER loader;
+  if (Loader_Init(&loader, nWorkers, &callbacks, NULL) != LOADER_OK) {
+    fprintf(stderr, "Unable to start %u workers\n", nWorkers);
+    exit(1);
+  }
+
+  /* One queue, in arrival order, is the thumbnail class without deadlines */
+  double start = Bench_Now();
+  for (long i = 0; i < nThumbnails; ++i) {
+    pJobs[i].nRows = BENCH_THUMBNAIL_ROWS;
+    pJobs[i].bResumable = nMode == MODE_PREEMPT;
+    pJobs[i].submitted = start;
+    Loader_SubmitClass(&loader, &pJobs[i], LOADER_CLASS_THUMBNAIL, LOADER_NO_DEADLINE, 0);
+  }
+
+  for (long i = 0; i < nVisible; ++i) {
+    Bench_SleepMs((double)nPeriodMs);
+
+    BENCHJOB* pVisible = &pJobs[nThumbnails + i * 3];
+    uint64_t nNow = (uint64_t)((Bench_Now() - start) * 1e3);
+    pVisible->nRows = BENCH_VISIBLE_ROWS;
+    pVisible->submitted = Bench_Now();
+    Loader_SubmitClass(&loader, pVisible, nMode == MODE_FIFO ? LOADER_CLASS_THUMBNAIL : LOADER_CLASS_VISIBLE,
+        nMode == MODE_FIFO ? LOADER_NO_DEADLINE : nNow, 0);
+
+    for (long j = 1; j <= 2; ++j) {
+      BENCHJOB* pPrefetch = &pVisible[j];
+      pPrefetch->nRows = BENCH_PREFETCH_ROWS;
+      pPrefetch->bResumable = nMode == MODE_PREEMPT;
+      pPrefetch->submitted = Bench_Now();
+      Loader_SubmitClass(&loader, pPrefetch, nMode == MODE_FIFO ? LOADER_CLASS_THUMBNAIL : LOADER_CLASS_PREFETCH,
+          nMode == MODE_FIFO ? LOADER_NO_DEADLINE : nNow + (uint64_t)j * 100, 0);
+    }
+  }
+
+  /* Visible latency only; the thumbnails left over are not waited for */
+  for (long i = 0; i < nVisible; ++i) {
+    while (!Atomic_Load(&pJobs[nThumbnails + i * 3].bDone)) {
+      Bench_SleepMs(1.0);
+    }
+  }
+  double tVisible = Bench_Now() - start;
+
+  Loader_WaitIdle(&loader);
+  double tTotal = Bench_Now() - start;
+  uint64_t nPreemptions = Loader_GetPreemptions(&loader);
+  Loader_Shutdown(&loader);
+
+  long nFailed = 0;
+  for (long i = 0; i < nJobs; ++i) {
+    nFailed += pJobs[i].status != LOADER_OK;
+  }
+  for (long i = 0; i < nVisible; ++i) {
+    BENCHJOB* pVisible = &pJobs[nThumbnails + i * 3];
+    pLatencies[i] = pVisible->ready - pVisible->submitted;
+  }
+  qsort(pLatencies, (size_t)nVisible, sizeof(double), Bench_CompareDouble);
+
+  printf("  %-10s p50 %8.1f ms  p99 %8.1f ms  visible done %7.0f ms  all done %7.0f ms  %6llu preempted%s\n",
+      pszName, pLatencies[nVisible / 2] * 1e3, pLatencies[(nVisible * 99) / 100] * 1e3, tVisible * 1e3,
+      tTotal * 1e3, (unsigned long long)nPreemptions, nFailed ? "  NOT ALL DECODED" : "");
+
+  free(pLatencies);
+  free(pJobs);
+}
+
+int main(int argc, char** argv)
+{
+  long nThumbnails = Bench_ArgLong(argc, argv, 1, 400);
+  long nVisible = Bench_ArgLong(argc, argv, 2, 50);
+  long nPeriodMs = Bench_ArgLong(argc, argv, 3, 60);
+  long nWorkers = Bench_ArgLong(argc, argv, 4, 2);
+
+  printf("%ld thumbnails of %.0f ms, %ld visible of %.0f ms every %ld ms with 2 prefetches, %ld workers, %u CPUs\n",
+      nThumbnails, BENCH_THUMBNAIL_ROWS * BENCH_ROW_MS, nVisible, BENCH_VISIBLE_ROWS * BENCH_ROW_MS, nPeriodMs,
+      nWorkers, Thread_GetCPUCount());
+
+  Bench_Run("fifo", MODE_FIFO, nThumbnails, nVisible, nPeriodMs, (unsigned int)nWorkers);
+  Bench_Run("classes", MODE_CLASSES, nThumbnails, nVisible, nPeriodMs, (unsigned int)nWorkers);
+  Bench_Run("preempt", MODE_PREEMPT, nThumbnails, nVisible, nPeriodMs, (unsigned int)nWorkers);
+
+  return 0;
+}
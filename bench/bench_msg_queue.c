@@ -0,0 +1,221 @@
+/*
+ * bench_msg_queue.c
+ *
+ * Messages per second from worker threads to one consumer: the single
+ * producer ring, the multi-producer queue with 1 to n producers, and for
+ * scale a ring behind a mutex. Producers raise the wakeup after every push
+ * as the loader does; the consumer resets it before every drain, and the
+ * count of wakeups that would have been posted shows how well they
+ * coalesce. Both sides yield rather than block when the queue is full or
+ * empty.
+ *
+ * Usage: bench_msg_queue [messages] [producers] [capacity]
+ */
+
+#include "../msgqueue.h"
+#include "../thread.h"
+#include "benchutil.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_PRODUCERS 16
+
+enum {
+  KIND_SPSC,
+  KIND_MPSC,
+  KIND_LOCKED,
+};
+
+/* The baseline: the same ring, guarded by a mutex */
+typedef struct _tagLOCKEDQUEUE {
+  MUTEX mutex;
+  void** ppSlots;
+  size_t mask;
+  size_t nHead;
+  size_t nTail;
+} LOCKEDQUEUE;
+
+typedef struct _tagBENCHQUEUE {
+  int nKind;
+  SPSCQUEUE spsc;
+  MPSCQUEUE mpsc;
+  LOCKEDQUEUE locked;
+  QUEUEWAKE wake;
+  volatile long nPosts;
+} BENCHQUEUE;
+
+typedef struct _tagPRODUCER {
+  THREAD thread;
+  BENCHQUEUE* pQueue;
+  long nMessages;
+} PRODUCER;
+
+static int Locked_Push(LOCKEDQUEUE* pQueue, void* pValue)
+{
+  int bPushed = 0;
+  Mutex_Lock(&pQueue->mutex);
+  if (pQueue->nTail - pQueue->nHead <= pQueue->mask) {
+    pQueue->ppSlots[pQueue->nTail++ & pQueue->mask] = pValue;
+    bPushed = 1;
+  }
+  Mutex_Unlock(&pQueue->mutex);
+
+  return bPushed;
+}
+
+static int Locked_Pop(LOCKEDQUEUE* pQueue, void** ppValue)
+{
+  int bPopped = 0;
+  Mutex_Lock(&pQueue->mutex);
+  if (pQueue->nHead != pQueue->nTail) {
+    *ppValue = pQueue->ppSlots[pQueue->nHead++ & pQueue->mask];
+    bPopped = 1;
+  }
+  Mutex_Unlock(&pQueue->mutex);
+
+  return bPopped;
+}
+
+static int Bench_Push(BENCHQUEUE* pQueue, void* pValue)
+{
+  switch (pQueue->nKind) {
+  case KIND_SPSC:
+    return SpscQueue_Push(&pQueue->spsc, pValue);
+  case KIND_MPSC:
+    return MpscQueue_Push(&pQueue->mpsc, pValue);
+  default:
+    return Locked_Push(&pQueue->locked, pValue);
+  }
+}
+
+static int Bench_Pop(BENCHQUEUE* pQueue, void** ppValue)
+{
+  switch (pQueue->nKind) {
+  case KIND_SPSC:
+    return SpscQueue_Pop(&pQueue->spsc, ppValue);
+  case KIND_MPSC:
+    return MpscQueue_Pop(&pQueue->mpsc, ppValue);
+  default:
+    return Locked_Pop(&pQueue->locked, ppValue);
+  }
+}
+
+static int ProduceThread(void* pArg)
+{
+  PRODUCER* pProducer = (PRODUCER*)pArg;
+  BENCHQUEUE* pQueue = pProducer->pQueue;
+
+  for (long i = 1; i <= pProducer->nMessages; ++i) {
+    while (!Bench_Push(pQueue, (void*)(uintptr_t)i)) {
+      Thread_Yield();
+    }
+    if (QueueWake_Raise(&pQueue->wake)) {
+      Atomic_Increment(&pQueue->nPosts);
+    }
+  }
+
+  return 0;
+}
+
+/* Returns messages per second */
+static double Bench_Run(BENCHQUEUE* pQueue, unsigned int nProducers, long nMessages, uint64_t* pChecksum)
+{
+  PRODUCER producers[MAX_PRODUCERS];
+  long nTotal = 0;
+
+  QueueWake_Init(&pQueue->wake);
+  pQueue->nPosts = 0;
+
+  double start = Bench_Now();
+  for (unsigned int i = 0; i < nProducers; ++i) {
+    producers[i].pQueue = pQueue;
+    producers[i].nMessages = nMessages / nProducers;
+    nTotal += producers[i].nMessages;
+    if (Thread_Create(&producers[i].thread, ProduceThread, &producers[i]) != THREAD_OK) {
+      fprintf(stderr, "Unable to start producer %u\n", i);
+      exit(1);
+    }
+  }
+
+  uint64_t checksum = 0;
+  long nReceived = 0;
+  while (nReceived < nTotal) {
+    QueueWake_Reset(&pQueue->wake);
+
+    void* pValue;
+    int bAny = 0;
+    while (Bench_Pop(pQueue, &pValue)) {
+      checksum += (uintptr_t)pValue;
+      ++nReceived;
+      bAny = 1;
+    }
+    if (!bAny) {
+      Thread_Yield();
+    }
+  }
+  double t = Bench_Now() - start;
+
+  for (unsigned int i = 0; i < nProducers; ++i) {
+    Thread_Join(&producers[i].thread);
+  }
+
+  *pChecksum = checksum;
+  return nTotal / t;
+}
+
+static void Bench_Print(const char* pszName, unsigned int nProducers, BENCHQUEUE* pQueue, long nMessages)
+{
+  uint64_t checksum;
+  double rate = Bench_Run(pQueue, nProducers, nMessages, &checksum);
+
+  /* Every producer sends 1..n */
+  uint64_t n = (uint64_t)(nMessages / nProducers);
+  uint64_t expected = nProducers * (n * (n + 1) / 2);
+
+  printf("  %-8s %2u producers %10.2f M msgs/s  %8ld wakeups%s\n", pszName, nProducers, rate / 1e6,
+      Atomic_Load(&pQueue->nPosts), checksum == expected ? "" : "  CHECKSUM MISMATCH");
+}
+
+int main(int argc, char** argv)
+{
+  long nMessages = Bench_ArgLong(argc, argv, 1, 5000000);
+  long nMaxProducers = Bench_ArgLong(argc, argv, 2, 4);
+  long capacity = Bench_ArgLong(argc, argv, 3, 1024);
+  nMaxProducers = nMaxProducers > MAX_PRODUCERS ? MAX_PRODUCERS : nMaxProducers;
+
+  printf("%ld messages, capacity %ld, %u CPUs\n", nMessages, capacity, Thread_GetCPUCount());
+
+  BENCHQUEUE* pQueue = (BENCHQUEUE*)calloc(1, sizeof(BENCHQUEUE));
+  if (!pQueue || SpscQueue_Init(&pQueue->spsc, (size_t)capacity) != MSGQUEUE_OK
+      || MpscQueue_Init(&pQueue->mpsc, (size_t)capacity) != MSGQUEUE_OK) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+
+  Mutex_Init(&pQueue->locked.mutex);
+  pQueue->locked.mask = pQueue->spsc.mask;
+  pQueue->locked.ppSlots = (void**)calloc(pQueue->locked.mask + 1, sizeof(void*));
+  if (!pQueue->locked.ppSlots) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+
+  pQueue->nKind = KIND_SPSC;
+  Bench_Print("spsc", 1, pQueue, nMessages);
+
+  for (long n = 1; n <= nMaxProducers; ++n) {
+    pQueue->nKind = KIND_MPSC;
+    Bench_Print("mpsc", (unsigned int)n, pQueue, nMessages);
+    pQueue->nKind = KIND_LOCKED;
+    Bench_Print("mutex", (unsigned int)n, pQueue, nMessages);
+  }
+
+  free(pQueue->locked.ppSlots);
+  Mutex_Destroy(&pQueue->locked.mutex);
+  MpscQueue_Cleanup(&pQueue->mpsc);
+  SpscQueue_Cleanup(&pQueue->spsc);
+  free(pQueue);
+
+  return 0;
+}
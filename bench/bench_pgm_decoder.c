@@ -0,0 +1,155 @@
+/*
+ * bench_pgm_decoder.c
+ *
+ * Compares the streaming PGM decoder with the former read-everything path
+ * (header via fscanf, whole raster via a single fread into a second buffer).
+ *
+ * Usage: bench_pgm_decoder [width] [height]
+ */
+
+#include "../pgm.h"
+#include "benchutil.h"
+
+#include <string.h>
+
+static const char szBenchFile[] = "bench_pgm_decoder.pgm";
+
+static int WriteSyntheticPGM(long width, long height)
+{
+  FILE* fp = fopen(szBenchFile, "wb");
+  if (!fp) {
+    return 0;
+  }
+
+  fprintf(fp, "P5\n# synthetic frame\n%ld %ld\n255\n", width, height);
+
+  unsigned char* row = (unsigned char*)malloc((size_t)width);
+  unsigned int seed = 0x2545F491u;
+  for (long y = 0; y < height; ++y) {
+    for (long x = 0; x < width; ++x) {
+      row[x] = (unsigned char)Bench_Random(&seed);
+    }
+    fwrite(row, 1, (size_t)width, fp);
+  }
+
+  free(row);
+  fclose(fp);
+  return 1;
+}
+
+/* The original loader: fscanf header, calloc, one-shot fread, then the
+ * consumer copies the raster once more into its own image buffer */
+static double BenchLegacy(unsigned char* pImage)
+{
+  double start = Bench_Now();
+
+  FILE* fp = fopen(szBenchFile, "rb");
+  char magic[2];
+  int width = 0;
+  int height = 0;
+  int depth = 0;
+
+  if (fread(magic, sizeof(magic), 1, fp) != 1 ||
+      fscanf(fp, "\n# synthetic frame\n%d %d\n%d", &width, &height, &depth) != 3) {
+    fclose(fp);
+    return -1.0;
+  }
+  fgetc(fp);
+
+  size_t dataLength = (size_t)width * height;
+  unsigned char* data = (unsigned char*)calloc(dataLength, 1);
+  if (fread(data, dataLength, 1, fp) != 1) {
+    dataLength = 0;
+  }
+  fclose(fp);
+
+  memcpy(pImage, data, dataLength);
+  free(data);
+
+  return Bench_Now() - start;
+}
+
+static double BenchStreaming(unsigned char* pImage, double* pFirstRows)
+{
+  double start = Bench_Now();
+
+  FILE* fp = fopen(szBenchFile, "rb");
+  PGMDECODER decoder;
+  PGMDecoder_InitFile(&decoder, fp);
+
+  if (PGMDecoder_ReadHeader(&decoder) != PGM_OK) {
+    PGMDecoder_Cleanup(&decoder);
+    fclose(fp);
+    return -1.0;
+  }
+
+  size_t stride = PGMDecoder_GetRowSize(&decoder, PGM_OUTPUT_GRAY8);
+  size_t nRow = 0;
+  *pFirstRows = 0.0;
+
+  for (;;) {
+    size_t nRead = 0;
+    PGMDecoder_ReadRows(&decoder, pImage + nRow * stride, stride, 64, PGM_OUTPUT_GRAY8, &nRead);
+    if (!nRead) {
+      break;
+    }
+
+    if (!nRow) {
+      *pFirstRows = Bench_Now() - start;
+    }
+
+    nRow += nRead;
+  }
+
+  PGMDecoder_Cleanup(&decoder);
+  fclose(fp);
+
+  return Bench_Now() - start;
+}
+
+int main(int argc, char** argv)
+{
+  long width = Bench_ArgLong(argc, argv, 1, 8192);
+  long height = Bench_ArgLong(argc, argv, 2, 8192);
+  double megabytes = (double)width * (double)height / (1024.0 * 1024.0);
+
+  if (!WriteSyntheticPGM(width, height)) {
+    fprintf(stderr, "Unable to create %s\n", szBenchFile);
+    return 1;
+  }
+
+  unsigned char* pImage = (unsigned char*)malloc((size_t)width * (size_t)height);
+  if (!pImage) {
+    remove(szBenchFile);
+    return 1;
+  }
+
+  double legacy = 1e30;
+  double streaming = 1e30;
+  double firstRows = 1e30;
+
+  for (int i = 0; i < 5; ++i) {
+    double t = BenchLegacy(pImage);
+    if (t >= 0 && t < legacy) {
+      legacy = t;
+    }
+
+    double first;
+    t = BenchStreaming(pImage, &first);
+    if (t >= 0 && t < streaming) {
+      streaming = t;
+      firstRows = first;
+    }
+  }
+
+  printf("PGM %ldx%ld (%.1f MiB)\n", width, height, megabytes);
+  printf("  legacy    : %8.2f ms  %8.1f MiB/s  peak buffers 2x frame\n",
+    legacy * 1e3, megabytes / legacy);
+  printf("  streaming : %8.2f ms  %8.1f MiB/s  peak buffers 1x frame, first rows after %.3f ms\n",
+    streaming * 1e3, megabytes / streaming, firstRows * 1e3);
+
+  free(pImage);
+  remove(szBenchFile);
+
+  return 0;
+}
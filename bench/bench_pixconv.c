@@ -0,0 +1,78 @@
+/*
+ * bench_pixconv.c
+ *
+ * Throughput of every conversion to premultiplied BGRA for each instruction
+ * set level the CPU supports.
+ *
+ * Usage: bench_pixconv [width] [height]
+ */
+
+#include "../pixconv.h"
+#include "benchutil.h"
+
+#include <stdint.h>
+
+static const struct {
+  int nFormat;
+  const char* szName;
+} g_benchFormats[] = {
+  { PIXFMT_GRAY8, "GRAY8" },
+  { PIXFMT_GRAY16, "GRAY16" },
+  { PIXFMT_RGB24, "RGB24" },
+  { PIXFMT_BGR24, "BGR24" },
+  { PIXFMT_RGBA32, "RGBA32" },
+  { PIXFMT_BGRA32, "BGRA32" },
+};
+
+int main(int argc, char** argv)
+{
+  long width = Bench_ArgLong(argc, argv, 1, 4096);
+  long height = Bench_ArgLong(argc, argv, 2, 4096);
+  size_t nPixels = (size_t)width * (size_t)height;
+
+  uint8_t* pSrc = (uint8_t*)malloc(nPixels * 4);
+  uint8_t* pDst = (uint8_t*)malloc(nPixels * 4);
+  if (!pSrc || !pDst) {
+    free(pSrc);
+    free(pDst);
+    return 1;
+  }
+
+  unsigned int seed = 0x9E3779B9u;
+  for (size_t i = 0; i < nPixels * 4; ++i) {
+    pSrc[i] = (uint8_t)Bench_Random(&seed);
+  }
+
+  printf("Conversion to PBGRA32, %ldx%ld, best of 5 (GB/s of output)\n", width, height);
+
+  for (size_t f = 0; f < sizeof(g_benchFormats) / sizeof(g_benchFormats[0]); ++f) {
+    int nFormat = g_benchFormats[f].nFormat;
+    size_t srcStride = (size_t)width * PixConv_GetBytesPerPixel(nFormat);
+
+    printf("  %-7s", g_benchFormats[f].szName);
+
+    for (int nIsa = PIXCONV_ISA_SCALAR; nIsa <= PixConv_GetCpuIsa(); ++nIsa) {
+      PixConv_SetIsa(nIsa);
+
+      double best = 1e30;
+      for (int i = 0; i < 5; ++i) {
+        double start = Bench_Now();
+        PixConv_Convert(pSrc, srcStride, nFormat, pDst, (size_t)width * 4,
+            PIXFMT_PBGRA32, (size_t)width, (size_t)height);
+        double t = Bench_Now() - start;
+        if (t < best) {
+          best = t;
+        }
+      }
+
+      printf("  %s %6.2f", PixConv_GetIsaName(nIsa), (double)nPixels * 4 / best / 1e9);
+    }
+
+    printf("\n");
+  }
+
+  free(pSrc);
+  free(pDst);
+
+  return 0;
+}
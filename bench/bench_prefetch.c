@@ -0,0 +1,348 @@
+/*
+ * bench_prefetch.c
+ *
+ * Perceived switch latency with and without neighbour prefetch. A synthetic
+ * folder is indexed and browsed like the viewer does it: mostly stepping
+ * forward, sometimes back, looking at every image for a while. The main
+ * thread plays the UI thread, owning the decoded image cache and receiving
+ * finished decodes through a mailbox; decodes are simulated by busy waiting.
+ * The latency is the time from the keypress to the image being ready.
+ *
+ * Usage: bench_prefetch [files] [keypresses] [view ms]
+ */
+
+#include "../dirindex.h"
+#include "../imgcache.h"
+#include "../loader.h"
+#include "../prefetch.h"
+#include "benchutil.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+typedef struct _tagBENCHJOB BENCHJOB;
+
+struct _tagBENCHJOB {
+  char szName[64];
+  uint64_t size;
+  int64_t mtime;
+  int nDecodeMs;
+  uint64_t nGeneration;
+  BENCHJOB* pNext;
+};
+
+/* What the UI thread's message queue is in the viewer */
+typedef struct _tagMAILBOX {
+  MUTEX mutex;
+  BENCHJOB* pHead;
+  volatile long nDecoded;
+} MAILBOX;
+
+typedef struct _tagSESSION {
+  DIRINDEX* pIndex;
+  LOADER loader;
+  IMGCACHE cache;
+  PREFETCH prefetch;
+  MAILBOX mailbox;
+  int* pDecodeMs;
+  int bPrefetch;
+} SESSION;
+
+static void Bench_SleepMs(long ms)
+{
+#ifdef _WIN32
+  Sleep((DWORD)ms);
+#else
+  struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+  nanosleep(&ts, NULL);
+#endif
+}
+
+static int BenchDecode(void* pArg, LPLOADTOKEN pToken, void** ppResult, void* pUserData)
+{
+  (void)pUserData;
+
+  BENCHJOB* pJob = (BENCHJOB*)pArg;
+  double until = Bench_Now() + pJob->nDecodeMs * 1e-3;
+  while (Bench_Now() < until) {
+    if (LoadToken_IsCancelled(pToken)) {
+      return LOADER_CANCELLED;
+    }
+  }
+
+  *ppResult = pJob;
+  return LOADER_OK;
+}
+
+static void BenchComplete(void* pArg, void* pResult, int status, uint64_t nGeneration, void* pUserData)
+{
+  (void)pResult;
+
+  MAILBOX* pMailbox = (MAILBOX*)pUserData;
+  BENCHJOB* pJob = (BENCHJOB*)pArg;
+  if (status != LOADER_OK) {
+    free(pJob);
+    return;
+  }
+
+  pJob->nGeneration = nGeneration;
+  Atomic_Increment(&pMailbox->nDecoded);
+
+  Mutex_Lock(&pMailbox->mutex);
+  pJob->pNext = pMailbox->pHead;
+  pMailbox->pHead = pJob;
+  Mutex_Unlock(&pMailbox->mutex);
+}
+
+static void ReleaseJob(void* pImage, void* pUserData)
+{
+  (void)pUserData;
+
+  free(pImage);
+}
+
+static BENCHJOB* Session_NewJob(SESSION* pSession, size_t nPos)
+{
+  BENCHJOB* pJob = (BENCHJOB*)calloc(1, sizeof(BENCHJOB));
+  if (pJob) {
+    const DIRINDEXENTRY* pEntry = &pSession->pIndex->pEntries[nPos];
+    snprintf(pJob->szName, sizeof(pJob->szName), "%s", pEntry->pszName);
+    pJob->size = pEntry->size;
+    pJob->mtime = pEntry->mtime;
+    pJob->nDecodeMs = pSession->pDecodeMs[nPos];
+  }
+
+  return pJob;
+}
+
+/*
+ * Handle finished decodes until `until`, or until the decode of generation
+ * nWaitFor arrives if that is not zero. Returns whether it did.
+ */
+static int Session_Pump(SESSION* pSession, double until, uint64_t nWaitFor)
+{
+  for (;;) {
+    Mutex_Lock(&pSession->mailbox.mutex);
+    BENCHJOB* pJob = pSession->mailbox.pHead;
+    pSession->mailbox.pHead = NULL;
+    Mutex_Unlock(&pSession->mailbox.mutex);
+
+    int bArrived = 0;
+    while (pJob) {
+      BENCHJOB* pNext = pJob->pNext;
+      bArrived |= nWaitFor && pJob->nGeneration == nWaitFor;
+      Prefetch_OnDone(&pSession->prefetch, pJob->nGeneration);
+      if (ImgCache_Insert(&pSession->cache, pJob->szName, pJob->size, pJob->mtime, pJob, 1) != IMGCACHE_OK) {
+        free(pJob);
+      }
+      pJob = pNext;
+    }
+
+    if (bArrived) {
+      return 1;
+    }
+    if (!nWaitFor && Bench_Now() >= until) {
+      return 0;
+    }
+
+    Bench_SleepMs(1);
+  }
+}
+
+/* Queue decodes of the planned neighbours that are neither cached nor
+ * queued yet, the same way the viewer does */
+static void Session_Prefetch(SESSION* pSession, size_t nCurrent)
+{
+  size_t positions[16];
+  size_t nPlanned = Prefetch_Plan(&pSession->prefetch, nCurrent, pSession->pIndex->count,
+      positions, sizeof(positions) / sizeof(positions[0]));
+
+  if (Prefetch_IsPlanStale(&pSession->prefetch, positions, nPlanned)) {
+    Loader_CancelPrefetch(&pSession->loader);
+    Prefetch_ClearPending(&pSession->prefetch);
+  }
+
+  for (size_t i = 0; i < nPlanned; ++i) {
+    const DIRINDEXENTRY* pEntry = &pSession->pIndex->pEntries[positions[i]];
+    if (Prefetch_IsPending(&pSession->prefetch, positions[i]) ||
+        ImgCache_Touch(&pSession->cache, pEntry->pszName, pEntry->size, pEntry->mtime)) {
+      continue;
+    }
+
+    BENCHJOB* pJob = Session_NewJob(pSession, positions[i]);
+    uint64_t nGeneration = pJob ? Loader_Prefetch(&pSession->loader, pJob) : 0;
+    if (nGeneration) {
+      Prefetch_AddPending(&pSession->prefetch, positions[i], nGeneration);
+    }
+  }
+}
+
+static int CompareDouble(const void* p1, const void* p2)
+{
+  double d1 = *(const double*)p1;
+  double d2 = *(const double*)p2;
+  return (d1 > d2) - (d1 < d2);
+}
+
+static void Session_Run(DIRINDEX* pIndex, int* pDecodeMs, unsigned int nDepth, long nKeys, long nViewMs,
+    double* pLatencies)
+{
+  SESSION session;
+  memset(&session, 0, sizeof(session));
+  session.pIndex = pIndex;
+  session.pDecodeMs = pDecodeMs;
+  session.bPrefetch = nDepth > 0;
+
+  Mutex_Init(&session.mailbox.mutex);
+  ImgCache_Init(&session.cache, 64, ReleaseJob, NULL);
+  Prefetch_Init(&session.prefetch, nDepth);
+
+  const LOADERCALLBACKS callbacks = { NULL, NULL, BenchDecode, BenchComplete };
+  if (Loader_Init(&session.loader, 2, &callbacks, &session.mailbox) != LOADER_OK) {
+    return;
+  }
+
+  unsigned int walk = 4242;
+  size_t nCurrent = 0;
+  uint64_t hits = 0;
+
+  for (long i = 0; i <= nKeys; ++i) {
+    /* The first image is opened directly, the rest are keypresses */
+    int bForward = 1;
+    if (i > 0) {
+      bForward = Bench_Random(&walk) % 100 < 85;
+      nCurrent = bForward ? (nCurrent + 1) % pIndex->count : (nCurrent + pIndex->count - 1) % pIndex->count;
+    }
+
+    double pressed = Bench_Now();
+    if (i > 0) {
+      Prefetch_OnStep(&session.prefetch, bForward);
+    }
+    else {
+      Prefetch_OnOpen(&session.prefetch);
+    }
+
+    /* Neighbours are queued behind the image itself, if it is not ready */
+    uint64_t nGeneration = 0;
+    const DIRINDEXENTRY* pEntry = &pIndex->pEntries[nCurrent];
+    if (ImgCache_Find(&session.cache, pEntry->pszName, pEntry->size, pEntry->mtime)) {
+      ++hits;
+    }
+    else {
+      BENCHJOB* pJob = Session_NewJob(&session, nCurrent);
+      nGeneration = pJob ? Loader_Submit(&session.loader, pJob, 1) : 0;
+      Prefetch_ClearPending(&session.prefetch);
+    }
+
+    if (session.bPrefetch) {
+      Session_Prefetch(&session, nCurrent);
+    }
+
+    if (nGeneration) {
+      Session_Pump(&session, 0.0, nGeneration);
+    }
+    if (i > 0) {
+      pLatencies[i - 1] = Bench_Now() - pressed;
+    }
+
+    /* Looking at the image */
+    Session_Pump(&session, Bench_Now() + nViewMs * 1e-3, 0);
+  }
+
+  Loader_Shutdown(&session.loader);
+  Session_Pump(&session, 0.0, 0);
+
+  qsort(pLatencies, (size_t)nKeys, sizeof(double), CompareDouble);
+  double sum = 0.0;
+  for (long i = 0; i < nKeys; ++i) {
+    sum += pLatencies[i];
+  }
+
+  char szMode[32] = "off";
+  if (nDepth) {
+    snprintf(szMode, sizeof(szMode), "%u ahead", nDepth);
+  }
+  printf("  %-9s  %7.1f  %7.1f  %7.1f  %7.1f   %6.1f%%  %7ld\n",
+      szMode,
+      sum / (double)nKeys * 1e3,
+      pLatencies[nKeys / 2] * 1e3,
+      pLatencies[nKeys * 95 / 100] * 1e3,
+      pLatencies[nKeys - 1] * 1e3,
+      100.0 * (double)hits / (double)nKeys,
+      Atomic_Load(&session.mailbox.nDecoded));
+
+  ImgCache_Cleanup(&session.cache);
+  Mutex_Destroy(&session.mailbox.mutex);
+}
+
+int main(int argc, char** argv)
+{
+  long nFiles = Bench_ArgLong(argc, argv, 1, 500);
+  long nKeys = Bench_ArgLong(argc, argv, 2, 40);
+  long nViewMs = Bench_ArgLong(argc, argv, 3, 150);
+
+  char szDir[256] = "bench_prefetch_XXXXXX";
+#ifdef _WIN32
+  if (_mktemp_s(szDir, sizeof(szDir)) != 0 || _mkdir(szDir) != 0) {
+#else
+  if (!mkdtemp(szDir)) {
+#endif
+    fprintf(stderr, "Unable to create a scratch directory\n");
+    return 1;
+  }
+
+  int* pDecodeMs = (int*)calloc((size_t)nFiles, sizeof(int));
+  double* pLatencies = (double*)calloc((size_t)nKeys, sizeof(double));
+  if (!pDecodeMs || !pLatencies) {
+    return 1;
+  }
+
+  char szPath[512];
+  unsigned int seed = 99;
+  for (long i = 0; i < nFiles; ++i) {
+    snprintf(szPath, sizeof(szPath), "%s%cIMG_%06ld.jpg", szDir, DIRINDEX_PATH_SEPARATOR, i);
+    FILE* fp = fopen(szPath, "wb");
+    if (fp) {
+      fputs("jpeg", fp);
+      fclose(fp);
+    }
+
+    /* Between a small photo and a large scan */
+    pDecodeMs[i] = 30 + (int)(Bench_Random(&seed) % 61);
+  }
+
+  DIRINDEX index;
+  DirIndex_Init(&index);
+  if (DirIndex_Open(&index, szDir, NULL, NULL) != DIRINDEX_OK || index.count < 2) {
+    fprintf(stderr, "Unable to index the scratch directory\n");
+    return 1;
+  }
+
+  printf("%ld images, %ld keypresses, %ld ms per image viewed, 30-90 ms per decode\n",
+      nFiles, nKeys, nViewMs);
+  printf("  prefetch   mean ms   p50 ms   p95 ms   max ms   cached   decodes\n");
+
+  const unsigned int depths[] = { 0, 1, 2, 4 };
+  for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); ++i) {
+    Session_Run(&index, pDecodeMs, depths[i], nKeys, nViewMs, pLatencies);
+  }
+
+  DirIndex_Close(&index);
+
+  for (long i = 0; i < nFiles; ++i) {
+    snprintf(szPath, sizeof(szPath), "%s%cIMG_%06ld.jpg", szDir, DIRINDEX_PATH_SEPARATOR, i);
+    remove(szPath);
+  }
+  rmdir(szDir);
+
+  free(pLatencies);
+  free(pDecodeMs);
+  return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * bench_pyramid.c
+ *
+ * Time to build the mip pyramid of a freshly decoded image, a 24 megapixel
+ * photo and a 100 megapixel scan in BGRA and 8-bit gray: every instruction
+ * set level on one thread, then the best level on task pools of 1, 2, 4, ...
+ * threads, the calling one included, up to every CPU and beyond.
+ *
+ * Usage: bench_pyramid [runs]
+ */
+
+#include "../pixconv.h"
+#include "../pyramid.h"
+#include "../taskpool.h"
+#include "../thread.h"
+#include "benchutil.h"
+
+#include <stdint.h>
+
+static const struct {
+  const char* szName;
+  size_t width;
+  size_t height;
+  int nFormat;
+} g_benchCases[] = {
+  { "24MP BGRA", 6000, 4000, PIXFMT_PBGRA32 },
+  { "100MP BGRA", 12288, 8192, PIXFMT_PBGRA32 },
+  { "24MP gray", 6000, 4000, PIXFMT_GRAY8 },
+  { "100MP gray", 12288, 8192, PIXFMT_GRAY8 },
+};
+
+static double Bench_Best(LPPIXBUF pSource, LPTASKPOOL pPool, long nRuns)
+{
+  double best = 1e30;
+  for (long i = 0; i < nRuns; ++i) {
+    PYRAMID pyramid;
+    double start = Bench_Now();
+    int status = Pyramid_Build(&pyramid, pSource, 1, pPool);
+    double t = Bench_Now() - start;
+    Pyramid_Cleanup(&pyramid);
+    if (status != PYRAMID_OK) {
+      return -1.0;
+    }
+    if (t < best) {
+      best = t;
+    }
+  }
+
+  return best;
+}
+
+int main(int argc, char** argv)
+{
+  long nRuns = Bench_ArgLong(argc, argv, 1, 3);
+  unsigned int nCPUs = Thread_GetCPUCount();
+  int nCpuIsa = PixConv_GetCpuIsa();
+
+  printf("Pyramid build, best of %ld, ms (%u CPUs)\n", nRuns, nCPUs);
+
+  for (size_t c = 0; c < sizeof(g_benchCases) / sizeof(g_benchCases[0]); ++c) {
+    LPPIXBUF pSource = NULL;
+    if (PixBuf_Create(g_benchCases[c].width, g_benchCases[c].height, g_benchCases[c].nFormat, NULL,
+          &pSource) != PIXBUF_OK) {
+      return 1;
+    }
+
+    /* Opaque noise; premultiplied with full alpha is the same as straight */
+    unsigned int seed = 0x9E3779B9u;
+    size_t cbSource = pSource->stride * pSource->height;
+    for (size_t i = 0; i < cbSource; ++i) {
+      pSource->pData[i] = (uint8_t)Bench_Random(&seed);
+      if (g_benchCases[c].nFormat == PIXFMT_PBGRA32 && i % 4 == 3) {
+        pSource->pData[i] = 0xFF;
+      }
+    }
+
+    printf("\n%s (%zux%zu, %.1f MB)\n", g_benchCases[c].szName, g_benchCases[c].width,
+        g_benchCases[c].height, cbSource / 1e6);
+
+    printf("  1 thread:");
+    for (int nIsa = PIXCONV_ISA_SCALAR; nIsa <= nCpuIsa; ++nIsa) {
+      PixConv_SetIsa(nIsa);
+      printf("  %s %.2f", PixConv_GetIsaName(nIsa), Bench_Best(pSource, NULL, nRuns) * 1e3);
+    }
+    printf("\n");
+
+    PixConv_SetIsa(nCpuIsa);
+    printf("  %s:", PixConv_GetIsaName(nCpuIsa));
+    for (unsigned int nThreads = 1; nThreads <= nCPUs * 2 && nThreads <= 64; nThreads *= 2) {
+      TASKPOOL pool;
+      if (nThreads > 1 && TaskPool_Init(&pool, nThreads - 1) != TASKPOOL_OK) {
+        break;
+      }
+      printf("  %ux %.2f", nThreads, Bench_Best(pSource, nThreads > 1 ? &pool : NULL, nRuns) * 1e3);
+      if (nThreads > 1) {
+        TaskPool_Cleanup(&pool);
+      }
+    }
+    printf("\n");
+
+    PixBuf_Release(pSource);
+  }
+
+  return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * bench_raster_file.c
+ *
+ * What a 1920x1080 view into a huge PGM costs when only its region is
+ * decoded, against streaming the whole raster: bytes read from the file
+ * and latency per viewport, at 1:1 in the middle and in a corner, then
+ * zoomed out down to the whole image in view. Timings are with the file in
+ * the page cache, after one run to warm it.
+ *
+ * Usage: bench_raster_file [width] [height] [runs]
+ */
+
+#include "../pgm.h"
+#include "../pixconv.h"
+#include "../rasterfile.h"
+#include "benchutil.h"
+
+#include <stdint.h>
+
+#define VIEW_WIDTH 1920
+#define VIEW_HEIGHT 1080
+
+static const char szBenchFile[] = "bench_raster_file.pgm";
+
+static int WriteSyntheticPGM(long width, long height)
+{
+  FILE* fp = fopen(szBenchFile, "wb");
+  if (!fp) {
+    return 0;
+  }
+
+  fprintf(fp, "P5\n# synthetic scan\n%ld %ld\n255\n", width, height);
+
+  unsigned char* row = (unsigned char*)malloc((size_t)width);
+  if (!row) {
+    fclose(fp);
+    return 0;
+  }
+
+  unsigned int seed = 0x2545F491u;
+  for (long y = 0; y < height; ++y) {
+    for (long x = 0; x < width; ++x) {
+      row[x] = (unsigned char)Bench_Random(&seed);
+    }
+    fwrite(row, 1, (size_t)width, fp);
+  }
+
+  free(row);
+  return fclose(fp) == 0;
+}
+
+/* The whole raster through the streaming decoder, in strips that are thrown away */
+static double BenchFullDecode(size_t width)
+{
+  double start = Bench_Now();
+
+  FILE* fp = fopen(szBenchFile, "rb");
+  if (!fp) {
+    return -1.0;
+  }
+
+  PGMDECODER decoder;
+  PGMDecoder_InitFile(&decoder, fp);
+  unsigned char* pStrip = (unsigned char*)malloc(width * 64);
+  if (pStrip && PGMDecoder_ReadHeader(&decoder) == PGM_OK) {
+    size_t nRead = 0;
+    do {
+      PGMDecoder_ReadRows(&decoder, pStrip, width, 64, PGM_OUTPUT_GRAY8, &nRead);
+    } while (nRead);
+  }
+
+  free(pStrip);
+  PGMDecoder_Cleanup(&decoder);
+  fclose(fp);
+
+  return Bench_Now() - start;
+}
+
+/* The region under a view of VIEW_WIDTH x VIEW_HEIGHT at 1/nScale, centred on cx, cy and kept inside the image */
+static void Bench_View(LPRASTERFILE pRaster, unsigned int nScale, size_t cx, size_t cy, unsigned char* pView,
+    long nRuns)
+{
+  size_t width = (size_t)VIEW_WIDTH * nScale < pRaster->width ? (size_t)VIEW_WIDTH * nScale : pRaster->width;
+  size_t height = (size_t)VIEW_HEIGHT * nScale < pRaster->height ? (size_t)VIEW_HEIGHT * nScale : pRaster->height;
+  size_t left = cx > width / 2 ? cx - width / 2 : 0;
+  size_t top = cy > height / 2 ? cy - height / 2 : 0;
+  left = left + width <= pRaster->width ? left : pRaster->width - width;
+  top = top + height <= pRaster->height ? top : pRaster->height - height;
+
+  RASTERFILESTATS before, after;
+  double best = 1e30;
+  for (long i = 0; i <= nRuns; ++i) {
+    RasterFile_GetStats(pRaster, &before);
+    double start = Bench_Now();
+    int status = RasterFile_ReadRegion(pRaster, left, top, left + width, top + height, nScale, pView,
+        VIEW_WIDTH, PIXFMT_GRAY8);
+    double t = Bench_Now() - start;
+    RasterFile_GetStats(pRaster, &after);
+
+    if (status != RASTERFILE_OK) {
+      printf("  1:%-3u failed (%d)\n", nScale, status);
+      return;
+    }
+    if (i && t < best) {
+      best = t;
+    }
+  }
+
+  uint64_t bytesRead = after.bytesRead - before.bytesRead;
+  printf("  1:%-3u %6zux%-6zu at %6zu,%-6zu %9.2f ms %9.2f MB in %5llu reads (%.2f%% of the raster)\n",
+      nScale, width, height, left, top, best * 1e3, bytesRead / 1e6, (unsigned long long)(after.reads - before.reads),
+      100.0 * (double)bytesRead / ((double)pRaster->width * (double)pRaster->height));
+}
+
+int main(int argc, char** argv)
+{
+  long width = Bench_ArgLong(argc, argv, 1, 20000);
+  long height = Bench_ArgLong(argc, argv, 2, 20000);
+  long nRuns = Bench_ArgLong(argc, argv, 3, 3);
+
+  if (!WriteSyntheticPGM(width, height)) {
+    fprintf(stderr, "Unable to create %s\n", szBenchFile);
+    remove(szBenchFile);
+    return 1;
+  }
+
+  FILE* fp = fopen(szBenchFile, "rb");
+  unsigned char* pView = (unsigned char*)malloc((size_t)VIEW_WIDTH * VIEW_HEIGHT);
+  RASTERFILE raster;
+  if (!fp || !pView || RasterFile_Init(&raster, fp) != RASTERFILE_OK) {
+    fprintf(stderr, "Unable to open %s\n", szBenchFile);
+    remove(szBenchFile);
+    return 1;
+  }
+
+  printf("PGM %ldx%ld (%.1f MB), %dx%d view, best of %ld\n", width, height, (double)width * height / 1e6,
+      VIEW_WIDTH, VIEW_HEIGHT, nRuns);
+
+  double full = 1e30;
+  for (long i = 0; i <= nRuns; ++i) {
+    double t = BenchFullDecode((size_t)width);
+    if (i && t >= 0 && t < full) {
+      full = t;
+    }
+  }
+  printf("  full  %6ldx%-6ld streamed  %9.2f ms %9.2f MB\n", width, height, full * 1e3,
+      (double)width * height / 1e6);
+
+  size_t cx = raster.width / 2;
+  size_t cy = raster.height / 2;
+  Bench_View(&raster, 1, cx, cy, pView, nRuns);
+  Bench_View(&raster, 1, raster.width, raster.height, pView, nRuns);
+
+  /* Zoomed out until the whole image is in view */
+  for (unsigned int nScale = 2; ; nScale *= 2) {
+    Bench_View(&raster, nScale, cx, cy, pView, nRuns);
+    if ((size_t)VIEW_WIDTH * nScale >= raster.width && (size_t)VIEW_HEIGHT * nScale >= raster.height) {
+      break;
+    }
+  }
+
+  RasterFile_Cleanup(&raster);
+  fclose(fp);
+  free(pView);
+  remove(szBenchFile);
+
+  return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * bench_resample.c
+ *
+ * Fit-to-window scaling cost for the cases the viewer meets most: a 4K
+ * photo on a 1080p screen, a 50 megapixel scan on a 1440p one, and 8-bit
+ * gray. Every filter at every instruction set level on one thread, then the
+ * best level on a task pool over all CPUs. Planning the filter contributions is timed apart.
+ *
+ * Usage: bench_resample [runs]
+ */
+
+#include "../pixconv.h"
+#include "../resample.h"
+#include "../taskpool.h"
+#include "../thread.h"
+#include "benchutil.h"
+
+#include <stdint.h>
+
+static const struct {
+  const char* szName;
+  size_t srcWidth;
+  size_t srcHeight;
+  size_t dstWidth;
+  size_t dstHeight;
+  int nFormat;
+} g_benchCases[] = {
+  { "4K -> 1080p", 3840, 2160, 1920, 1080, PIXFMT_PBGRA32 },
+  { "50MP -> 1440p", 8660, 5774, 2160, 1440, PIXFMT_PBGRA32 },
+  { "4K gray -> 1080p", 3840, 2160, 1920, 1080, PIXFMT_GRAY8 },
+};
+
+static double Bench_Best(LPRESAMPLER pResampler, const uint8_t* pSrc, size_t srcStride, int nFormat,
+    uint8_t* pDst, size_t dstStride, LPTASKPOOL pPool, long nRuns)
+{
+  double best = 1e30;
+  for (long i = 0; i < nRuns; ++i) {
+    double start = Bench_Now();
+    Resample_Run(pResampler, pSrc, srcStride, nFormat, pDst, dstStride, pPool);
+    double t = Bench_Now() - start;
+    if (t < best) {
+      best = t;
+    }
+  }
+
+  return best;
+}
+
+int main(int argc, char** argv)
+{
+  long nRuns = Bench_ArgLong(argc, argv, 1, 5);
+  unsigned int nCPUs = Thread_GetCPUCount();
+  int nCpuIsa = PixConv_GetCpuIsa();
+
+  TASKPOOL pool;
+  if (TaskPool_Init(&pool, 0) != TASKPOOL_OK) {
+    return 1;
+  }
+
+  printf("Resampling, best of %ld, ms per frame (%u CPUs)\n", nRuns, nCPUs);
+
+  for (size_t c = 0; c < sizeof(g_benchCases) / sizeof(g_benchCases[0]); ++c) {
+    size_t nBytesPerPixel = (size_t)PixConv_GetBytesPerPixel(g_benchCases[c].nFormat);
+    size_t srcStride = g_benchCases[c].srcWidth * nBytesPerPixel;
+    size_t dstStride = g_benchCases[c].dstWidth * 4;
+
+    uint8_t* pSrc = (uint8_t*)malloc(srcStride * g_benchCases[c].srcHeight);
+    uint8_t* pDst = (uint8_t*)malloc(dstStride * g_benchCases[c].dstHeight);
+    if (!pSrc || !pDst) {
+      free(pSrc);
+      free(pDst);
+      return 1;
+    }
+
+    /* Opaque noise; premultiplied with full alpha is the same as straight */
+    unsigned int seed = 0x9E3779B9u;
+    for (size_t i = 0; i < srcStride * g_benchCases[c].srcHeight; ++i) {
+      pSrc[i] = (uint8_t)Bench_Random(&seed);
+      if (nBytesPerPixel == 4 && i % 4 == 3) {
+        pSrc[i] = 0xFF;
+      }
+    }
+
+    printf("\n%s (%zux%zu -> %zux%zu)\n", g_benchCases[c].szName,
+        g_benchCases[c].srcWidth, g_benchCases[c].srcHeight, g_benchCases[c].dstWidth, g_benchCases[c].dstHeight);
+    printf("  filter      plan");
+    for (int nIsa = PIXCONV_ISA_SCALAR; nIsa <= nCpuIsa; ++nIsa) {
+      printf("  %8s", PixConv_GetIsaName(nIsa));
+    }
+    printf("  %5ux %s\n", nCPUs, PixConv_GetIsaName(nCpuIsa));
+
+    for (int nFilter = 0; nFilter < RESAMPLE_FILTER_COUNT; ++nFilter) {
+      RESAMPLER resampler;
+      double start = Bench_Now();
+      if (Resample_Init(&resampler, g_benchCases[c].srcWidth, g_benchCases[c].srcHeight,
+            g_benchCases[c].dstWidth, g_benchCases[c].dstHeight, nFilter) != RESAMPLE_OK) {
+        return 1;
+      }
+      double plan = Bench_Now() - start;
+
+      printf("  %-9s %6.2f", Resample_GetFilterName(nFilter), plan * 1e3);
+      for (int nIsa = PIXCONV_ISA_SCALAR; nIsa <= nCpuIsa; ++nIsa) {
+        PixConv_SetIsa(nIsa);
+        printf("  %8.2f", Bench_Best(&resampler, pSrc, srcStride, g_benchCases[c].nFormat, pDst, dstStride,
+            NULL, nRuns) * 1e3);
+      }
+
+      PixConv_SetIsa(nCpuIsa);
+      printf("  %13.2f\n", Bench_Best(&resampler, pSrc, srcStride, g_benchCases[c].nFormat, pDst, dstStride,
+          &pool, nRuns) * 1e3);
+
+      Resample_Cleanup(&resampler);
+    }
+
+    free(pSrc);
+    free(pDst);
+  }
+
+  TaskPool_Cleanup(&pool);
+  return 0;
+}
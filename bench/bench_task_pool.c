@@ -0,0 +1,176 @@
+/*
+ * bench_task_pool.c
+ *
+ * How a parallel-for over image rows scales with the number of threads: a
+ * 3x3 box blur of an 8-bit RGBA image, one row per index, through the task
+ * pool at a few grain sizes, next to the fixed bands of one new thread per
+ * core that the resampler starts for every call. One thread is the plain
+ * loop; n threads are the calling thread and n - 1 workers.
+ *
+ * Usage: bench_task_pool [threads] [width] [height] [passes]
+ */
+
+#include "../taskpool.h"
+#include "../thread.h"
+#include "benchutil.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_THREADS 64
+
+typedef struct _tagBLURJOB {
+  const uint8_t* pSrc;
+  uint8_t* pDst;
+  size_t width;
+  size_t height;
+} BLURJOB;
+
+typedef struct _tagBLURBAND {
+  BLURJOB* pJob;
+  size_t nBegin;
+  size_t nEnd;
+  THREAD thread;
+} BLURBAND;
+
+/* Rows [nBegin, nEnd), edges clamped */
+static void BlurRows(void* pArg, size_t nBegin, size_t nEnd)
+{
+  BLURJOB* pJob = (BLURJOB*)pArg;
+  size_t stride = pJob->width * 4;
+
+  for (size_t y = nBegin; y < nEnd; ++y) {
+    const uint8_t* pRows[3];
+    pRows[0] = pJob->pSrc + (y ? y - 1 : y) * stride;
+    pRows[1] = pJob->pSrc + y * stride;
+    pRows[2] = pJob->pSrc + (y + 1 < pJob->height ? y + 1 : y) * stride;
+    uint8_t* pOut = pJob->pDst + y * stride;
+
+    for (size_t x = 0; x < pJob->width; ++x) {
+      size_t left = (x ? x - 1 : x) * 4;
+      size_t right = (x + 1 < pJob->width ? x + 1 : x) * 4;
+      for (size_t c = 0; c < 4; ++c) {
+        unsigned int sum = 0;
+        for (int r = 0; r < 3; ++r) {
+          sum += pRows[r][left + c] + pRows[r][x * 4 + c] + pRows[r][right + c];
+        }
+        pOut[x * 4 + c] = (uint8_t)(sum / 9);
+      }
+    }
+  }
+}
+
+static int BlurBandThread(void* pArg)
+{
+  BLURBAND* pBand = (BLURBAND*)pArg;
+  BlurRows(pBand->pJob, pBand->nBegin, pBand->nEnd);
+  return 0;
+}
+
+/* As Resample_RunBands: equal bands, threads started and joined per call */
+static void BlurBands(BLURJOB* pJob, unsigned int nThreads)
+{
+  BLURBAND bands[MAX_THREADS];
+  int bStarted[MAX_THREADS];
+
+  for (unsigned int i = 0; i < nThreads; ++i) {
+    bands[i].pJob = pJob;
+    bands[i].nBegin = pJob->height * i / nThreads;
+    bands[i].nEnd = pJob->height * (i + 1) / nThreads;
+  }
+  for (unsigned int i = 1; i < nThreads; ++i) {
+    bStarted[i] = Thread_Create(&bands[i].thread, BlurBandThread, &bands[i]) == THREAD_OK;
+  }
+
+  BlurBandThread(&bands[0]);
+
+  for (unsigned int i = 1; i < nThreads; ++i) {
+    if (bStarted[i]) {
+      Thread_Join(&bands[i].thread);
+    }
+    else {
+      BlurBandThread(&bands[i]);
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  long nMaxThreads = Bench_ArgLong(argc, argv, 1, (long)Thread_GetCPUCount());
+  long width = Bench_ArgLong(argc, argv, 2, 6000);
+  long height = Bench_ArgLong(argc, argv, 3, 4000);
+  long nPasses = Bench_ArgLong(argc, argv, 4, 5);
+  nMaxThreads = nMaxThreads > MAX_THREADS ? MAX_THREADS : nMaxThreads;
+
+  size_t size = (size_t)width * (size_t)height * 4;
+  uint8_t* pSrc = (uint8_t*)malloc(size);
+  uint8_t* pDst = (uint8_t*)malloc(size);
+  if (!pSrc || !pDst) {
+    fprintf(stderr, "Out of memory\n");
+    free(pSrc);
+    free(pDst);
+    return 1;
+  }
+
+  unsigned int seed = 0x2545F491u;
+  for (size_t i = 0; i < size; ++i) {
+    pSrc[i] = (uint8_t)Bench_Random(&seed);
+  }
+  memset(pDst, 0, size);
+
+  BLURJOB job;
+  job.pSrc = pSrc;
+  job.pDst = pDst;
+  job.width = (size_t)width;
+  job.height = (size_t)height;
+
+  printf("3x3 blur of %ldx%ld RGBA, %ld passes, %u CPUs\n", width, height, nPasses, Thread_GetCPUCount());
+  printf("  threads      bands    grain 1    grain 16    auto     speedup  steals\n");
+
+  const size_t grains[] = { 1, 16, 0 };
+  double baseline = 0.0;
+  for (long nThreads = 1; nThreads <= nMaxThreads; ++nThreads) {
+    double start = Bench_Now();
+    for (long i = 0; i < nPasses; ++i) {
+      BlurBands(&job, (unsigned int)nThreads);
+    }
+    double tBands = (Bench_Now() - start) / nPasses;
+
+    TASKPOOL pool;
+    LPTASKPOOL pPool = NULL;
+    if (nThreads > 1) {
+      if (TaskPool_Init(&pool, (unsigned int)nThreads - 1) != TASKPOOL_OK) {
+        fprintf(stderr, "Unable to start %ld workers\n", nThreads - 1);
+        break;
+      }
+      pPool = &pool;
+    }
+
+    double times[3];
+    for (size_t g = 0; g < sizeof(grains) / sizeof(grains[0]); ++g) {
+      start = Bench_Now();
+      for (long i = 0; i < nPasses; ++i) {
+        TaskPool_ParallelFor(pPool, 0, job.height, grains[g], BlurRows, &job);
+      }
+      times[g] = (Bench_Now() - start) / nPasses;
+    }
+
+    TASKPOOLSTATS stats;
+    memset(&stats, 0, sizeof(TASKPOOLSTATS));
+    if (pPool) {
+      TaskPool_GetStats(pPool, &stats);
+      TaskPool_Cleanup(pPool);
+    }
+
+    if (nThreads == 1) {
+      baseline = times[2];
+    }
+    printf("  %7ld  %7.1f ms %7.1f ms %8.1f ms %7.1f ms %7.2fx %7llu\n", nThreads, tBands * 1e3, times[0] * 1e3,
+        times[1] * 1e3, times[2] * 1e3, baseline / times[2], (unsigned long long)stats.steals);
+  }
+
+  free(pSrc);
+  free(pDst);
+
+  return 0;
+}
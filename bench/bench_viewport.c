@@ -0,0 +1,131 @@
+/*
+ * bench_viewport.c
+ *
+ * What an input event costs before anything is drawn: zoom steps at a
+ * wandering cursor over a huge image in a 1920x1080 window, in and out
+ * between the fit and the closest zoom, each one updating the viewport,
+ * then recomputing the visible tiles from it as the GL renderer would.
+ * Tiles are made resident by a callback that only charges their size, so
+ * the time is that of the bookkeeping alone.
+ *
+ * Usage: bench_viewport [steps] [width] [height]
+ */
+
+#include "../tilemgr.h"
+#include "../viewport.h"
+#include "benchutil.h"
+
+#include <stdint.h>
+
+#define VIEW_WIDTH 1920
+#define VIEW_HEIGHT 1080
+#define TILE_SIZE 512
+#define MAX_TILES 4096
+
+static int FakeLoad(LPTILE pTile, void* pUserData)
+{
+  (void)pUserData;
+
+  pTile->pHandle = pTile;
+  pTile->cost = pTile->width * pTile->height * 4;
+  return 1;
+}
+
+static void FakeFree(LPTILE pTile, void* pUserData)
+{
+  (void)pTile;
+  (void)pUserData;
+}
+
+/* In or out for four octaves' worth of steps at a time, each at a random cursor */
+static int NextStep(unsigned int* pSeed, int* pDirection, long i, double* pX, double* pY)
+{
+  if (i % (VIEWPORT_STEPS_PER_OCTAVE * 4) == 0) {
+    *pDirection = Bench_Random(pSeed) & 1 ? 1 : -1;
+  }
+  *pX = (double)(Bench_Random(pSeed) % VIEW_WIDTH);
+  *pY = (double)(Bench_Random(pSeed) % VIEW_HEIGHT);
+
+  return *pDirection;
+}
+
+int main(int argc, char** argv)
+{
+  long nSteps = Bench_ArgLong(argc, argv, 1, 10000);
+  long width = Bench_ArgLong(argc, argv, 2, 60000);
+  long height = Bench_ArgLong(argc, argv, 3, 40000);
+
+  printf("%ldx%ld image, %dx%d view, %ld zoom steps\n", width, height, VIEW_WIDTH, VIEW_HEIGHT, nSteps);
+
+  /* The viewport alone */
+  VIEWPORT viewport;
+  Viewport_Init(&viewport);
+  Viewport_SetViewSize(&viewport, VIEW_WIDTH, VIEW_HEIGHT);
+  Viewport_SetImage(&viewport, (double)width, (double)height, VIEWPORT_MODE_FIT);
+
+  unsigned int seed = 0x2545F491u;
+  int nDirection = 1;
+  long nChanged = 0;
+  double start = Bench_Now();
+  for (long i = 0; i < nSteps; ++i) {
+    double x, y;
+    int n = NextStep(&seed, &nDirection, i, &x, &y);
+    nChanged += Viewport_ZoomStep(&viewport, n, x, y);
+    if (i % 8 == 7) {
+      nChanged += Viewport_Pan(&viewport, x - VIEW_WIDTH / 2.0, y - VIEW_HEIGHT / 2.0);
+    }
+  }
+  double t = Bench_Now() - start;
+  printf("  viewport          %9.1f ns per step, %ld of %ld events changed the view\n",
+      t * 1e9 / nSteps, nChanged, nSteps + nSteps / 8);
+
+  /* Then with the tiles of every new view looked up, loaded and evicted */
+  TILEMGR tileMgr;
+  if (TileMgr_Init(&tileMgr, (size_t)width, (size_t)height, TILE_SIZE, (size_t)256 << 20, FakeLoad, FakeFree,
+      NULL) != TILEMGR_OK) {
+    fprintf(stderr, "Unable to create the tile manager\n");
+    return 1;
+  }
+
+  LPTILE* ppTiles = (LPTILE*)malloc(MAX_TILES * sizeof(LPTILE));
+  if (!ppTiles) {
+    TileMgr_Cleanup(&tileMgr);
+    return 1;
+  }
+
+  Viewport_SetImage(&viewport, (double)width, (double)height, VIEWPORT_MODE_FIT);
+  seed = 0x2545F491u;
+  nDirection = 1;
+  size_t nTotalTiles = 0;
+  size_t nMostTiles = 0;
+  start = Bench_Now();
+  for (long i = 0; i < nSteps; ++i) {
+    double x, y;
+    int n = NextStep(&seed, &nDirection, i, &x, &y);
+    Viewport_ZoomStep(&viewport, n, x, y);
+    if (i % 8 == 7) {
+      Viewport_Pan(&viewport, x - VIEW_WIDTH / 2.0, y - VIEW_HEIGHT / 2.0);
+    }
+
+    TILEVIEW view;
+    Viewport_GetTileView(&viewport, &view);
+    size_t nTiles = 0;
+    TileMgr_Update(&tileMgr, &view, ppTiles, MAX_TILES, &nTiles);
+    nTotalTiles += nTiles;
+    nMostTiles = nTiles > nMostTiles ? nTiles : nMostTiles;
+  }
+  t = Bench_Now() - start;
+
+  TILEMGRSTATS stats;
+  TileMgr_GetStats(&tileMgr, &stats);
+  printf("  viewport + tiles  %9.1f ns per step, %.1f tiles in view on average, %zu at most\n",
+      t * 1e9 / nSteps, (double)nTotalTiles / nSteps, nMostTiles);
+  printf("                    %llu hits, %llu loads, %llu evictions, %zu resident\n",
+      (unsigned long long)stats.hits, (unsigned long long)stats.loads, (unsigned long long)stats.evictions,
+      stats.count);
+
+  free(ppTiles);
+  TileMgr_Cleanup(&tileMgr);
+
+  return 0;
+}
@@ -0,0 +1,60 @@
+/*
+ * benchutil.h
+ *
+ * Shared helpers for the micro-benchmarks
+ */
+
+#ifndef PANIVIEW_BENCHUTIL_H
+#define PANIVIEW_BENCHUTIL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* Monotonic wall clock in seconds */
+static inline double Bench_Now(void)
+{
+#ifdef _WIN32
+  LARGE_INTEGER freq;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / (double)freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+/* Cheap deterministic generator for synthetic inputs */
+static inline unsigned int Bench_Random(unsigned int* pState)
+{
+  unsigned int x = *pState;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *pState = x;
+  return x;
+}
+
+/* Read an optional positive integer argument, falling back to `def` */
+static inline long Bench_ArgLong(int argc, char** argv, int index, long def)
+{
+  if (argc > index) {
+    long value = strtol(argv[index], NULL, 10);
+    if (value > 0) {
+      return value;
+    }
+  }
+
+  return def;
+}
+
+#endif /* PANIVIEW_BENCHUTIL_H */
@@ -0,0 +1,1415 @@
+#include "dirindex.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#endif
+
+/*
+ * No UNIT_TESTING allocator hooks here: a background scan allocates names on
+ * pool threads that the index frees later, and cmocka's allocation tracking
+ * is not thread-safe.
+ */
+
+/* Beyond this many change events in one refresh a full rescan is cheaper
+ * than applying them one by one */
+#define DIRINDEX_MAX_EVENTS 256
+
+/* Listed without a stat yet; the scan tasks fill in the times */
+#define DIRINDEX_MTIME_UNKNOWN INT64_MIN
+
+/* Returned by a listing callback to end the listing early */
+#define DIRINDEX_STOPPED 1
+
+/* Most names a background scan hands to one pool task; the first batches
+ * are smaller, so the first files are found early */
+#define DIRINDEX_SCAN_BATCH 32
+
+/* Takes over the entry's name when it returns DIRINDEX_OK */
+typedef int (*DIRINDEXLISTFUNC)(const DIRINDEXENTRY* pEntry, void* pContext);
+
+typedef struct _tagDIRLISTING {
+  LPDIRINDEXENTRY pItems;
+  size_t count;
+  size_t capacity;
+} DIRLISTING, * LPDIRLISTING;
+
+/* Listed names a pool task stats and filters, freed by that task */
+struct _tagDIRSCANBATCH {
+  LPDIRSCAN pScan;
+  size_t count;
+  DIRINDEXENTRY entries[DIRINDEX_SCAN_BATCH];
+};
+
+static char* DirIndex_StrDup(const char* psz)
+{
+  size_t len = strlen(psz) + 1;
+  char* pszCopy = (char*)malloc(len);
+  if (pszCopy) {
+    memcpy(pszCopy, psz, len);
+  }
+  return pszCopy;
+}
+
+static uint32_t DirIndex_HashName(const void* pKey, size_t keySize)
+{
+  (void)keySize;
+
+  const char* pszName = *(const char* const*)pKey;
+  return HashTable_HashBytes(pszName, strlen(pszName));
+}
+
+static int DirIndex_CompareName(const void* key1, size_t key1Size, const void* key2, size_t key2Size)
+{
+  (void)key1Size;
+  (void)key2Size;
+
+  return strcmp(*(const char* const*)key1, *(const char* const*)key2);
+}
+
+static int DirIndex_CompareEntry(const void* p1, const void* p2)
+{
+  return strcmp(((const DIRINDEXENTRY*)p1)->pszName, ((const DIRINDEXENTRY*)p2)->pszName);
+}
+
+static int DirIndex_AppendEntry(LPDIRINDEXENTRY* ppEntries, size_t* pCount, size_t* pCapacity,
+    const DIRINDEXENTRY* pEntry)
+{
+  if (*pCount == *pCapacity) {
+    size_t capacity = *pCapacity ? *pCapacity * 2 : 64;
+    LPDIRINDEXENTRY pEntries = (LPDIRINDEXENTRY)realloc(*ppEntries, capacity * sizeof(DIRINDEXENTRY));
+    if (!pEntries) {
+      return DIRINDEX_ERROR_MEMORY;
+    }
+    *ppEntries = pEntries;
+    *pCapacity = capacity;
+  }
+
+  (*ppEntries)[(*pCount)++] = *pEntry;
+  return DIRINDEX_OK;
+}
+
+static void DirIndex_FreeListing(LPDIRLISTING pListing)
+{
+  for (size_t i = 0; i < pListing->count; ++i) {
+    free(pListing->pItems[i].pszName);
+  }
+  free(pListing->pItems);
+  pListing->pItems = NULL;
+  pListing->count = 0;
+  pListing->capacity = 0;
+}
+
+static int DirIndex_ListInto(const DIRINDEXENTRY* pEntry, void* pContext)
+{
+  LPDIRLISTING pListing = (LPDIRLISTING)pContext;
+  return DirIndex_AppendEntry(&pListing->pItems, &pListing->count, &pListing->capacity, pEntry);
+}
+
+/* Join a directory and a name in a buffer grown as needed */
+static const char* DirIndex_JoinPath(const char* pszDir, const char* pszName, char** ppszBuffer, size_t* pBufferSize)
+{
+  size_t dirLen = strlen(pszDir);
+  size_t nameLen = strlen(pszName);
+  size_t size = dirLen + nameLen + 2;
+
+  if (size > *pBufferSize) {
+    char* pszBuffer = (char*)realloc(*ppszBuffer, size);
+    if (!pszBuffer) {
+      return NULL;
+    }
+    *ppszBuffer = pszBuffer;
+    *pBufferSize = size;
+  }
+
+  /* Only a root such as "/" or "C:\" keeps its trailing separator */
+  char* pszPath = *ppszBuffer;
+  memcpy(pszPath, pszDir, dirLen);
+  if (!dirLen || (pszDir[dirLen - 1] != '/' && pszDir[dirLen - 1] != DIRINDEX_PATH_SEPARATOR)) {
+    pszPath[dirLen++] = DIRINDEX_PATH_SEPARATOR;
+  }
+  memcpy(pszPath + dirLen, pszName, nameLen + 1);
+
+  return pszPath;
+}
+
+/* Join the directory and a name in the scratch buffer */
+static const char* DirIndex_BuildPath(LPDIRINDEX pIndex, const char* pszName)
+{
+  return DirIndex_JoinPath(pIndex->pszDir, pszName, &pIndex->pszPathBuffer, &pIndex->pathBufferSize);
+}
+
+static int DirIndex_Accept(LPDIRINDEX pIndex, const char* pszName)
+{
+  if (!pIndex->pfnFilter) {
+    return 1;
+  }
+
+  const char* pszPath = DirIndex_BuildPath(pIndex, pszName);
+  return pszPath && pIndex->pfnFilter(pszPath, pszName, pIndex->pUserData);
+}
+
+static void DirIndex_InitNameTable(LPHASHTABLE pTable, size_t valueSize)
+{
+  HashTable_Init(pTable, sizeof(char*), valueSize, DirIndex_CompareName);
+  HashTable_SetHashFunc(pTable, DirIndex_HashName);
+}
+
+static void DirIndex_FreeRejected(LPHASHTABLE pRejected)
+{
+  size_t iter = 0;
+  LPDIRINDEXENTRY pEntry = NULL;
+
+  while (HashTable_Next(pRejected, &iter, NULL, (void**)&pEntry)) {
+    free(pEntry->pszName);
+  }
+
+  HashTable_Cleanup(pRejected);
+}
+
+/* A file rejected earlier is not filtered again until it changes */
+static int DirIndex_IsKnownReject(LPDIRINDEX pIndex, const DIRINDEXENTRY* pItem)
+{
+  LPDIRINDEXENTRY pReject = (LPDIRINDEXENTRY)HashTable_Find(&pIndex->rejected, &pItem->pszName);
+  return pReject && pReject->mtime == pItem->mtime && pReject->size == pItem->size;
+}
+
+/* Hand a rejected entry over to a rejected table, freeing its name on failure */
+static void DirIndex_AddReject(LPHASHTABLE pRejected, const DIRINDEXENTRY* pItem)
+{
+  if (HashTable_Insert(pRejected, &pItem->pszName, pItem) != HASHTABLE_OK) {
+    free(pItem->pszName);
+  }
+}
+
+#ifdef _WIN32
+
+static WCHAR* DirIndex_Utf8ToWide(const char* psz, const WCHAR* pszSuffix)
+{
+  int len = MultiByteToWideChar(CP_UTF8, 0, psz, -1, NULL, 0);
+  if (len <= 0) {
+    return NULL;
+  }
+
+  size_t suffixLen = pszSuffix ? wcslen(pszSuffix) : 0;
+  WCHAR* pszWide = (WCHAR*)malloc(((size_t)len + suffixLen) * sizeof(WCHAR));
+  if (pszWide) {
+    MultiByteToWideChar(CP_UTF8, 0, psz, -1, pszWide, len);
+    if (pszSuffix) {
+      /* A root directory already ends with the separator the suffix starts with */
+      WCHAR* pszEnd = pszWide + len - 1;
+      if (pszEnd > pszWide && pszEnd[-1] == L'\\' && pszSuffix[0] == L'\\') {
+        --pszEnd;
+      }
+      memcpy(pszEnd, pszSuffix, (suffixLen + 1) * sizeof(WCHAR));
+    }
+  }
+
+  return pszWide;
+}
+
+static char* DirIndex_WideToUtf8(const WCHAR* pszWide)
+{
+  int len = WideCharToMultiByte(CP_UTF8, 0, pszWide, -1, NULL, 0, NULL, NULL);
+  if (len <= 0) {
+    return NULL;
+  }
+
+  char* psz = (char*)malloc((size_t)len);
+  if (psz) {
+    WideCharToMultiByte(CP_UTF8, 0, pszWide, -1, psz, len, NULL, NULL);
+  }
+
+  return psz;
+}
+
+static int64_t DirIndex_FileTimeToInt(FILETIME ft)
+{
+  return (int64_t)(((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime);
+}
+
+/* The find data carries the times, bDeferStat makes no difference */
+static int DirIndex_ListFiles(const char* pszDir, int bDeferStat, DIRINDEXLISTFUNC pfnList, void* pContext)
+{
+  (void)bDeferStat;
+
+  WCHAR* pszMask = DirIndex_Utf8ToWide(pszDir, L"\\*");
+  if (!pszMask) {
+    return DIRINDEX_ERROR_MEMORY;
+  }
+
+  WIN32_FIND_DATAW ffd;
+  HANDLE hSearch = FindFirstFileExW(pszMask, FindExInfoBasic, &ffd,
+      FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+  free(pszMask);
+
+  if (hSearch == INVALID_HANDLE_VALUE) {
+    return GetLastError() == ERROR_FILE_NOT_FOUND ? DIRINDEX_OK : DIRINDEX_ERROR_IO;
+  }
+
+  int status = DIRINDEX_OK;
+  do {
+    if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+      continue;
+    }
+
+    DIRINDEXENTRY entry;
+    entry.pszName = DirIndex_WideToUtf8(ffd.cFileName);
+    entry.mtime = DirIndex_FileTimeToInt(ffd.ftLastWriteTime);
+    entry.size = ((uint64_t)ffd.nFileSizeHigh << 32) | ffd.nFileSizeLow;
+
+    status = entry.pszName ? pfnList(&entry, pContext) : DIRINDEX_ERROR_MEMORY;
+    if (status != DIRINDEX_OK) {
+      free(entry.pszName);
+      break;
+    }
+  } while (FindNextFileW(hSearch, &ffd));
+
+  FindClose(hSearch);
+  return status;
+}
+
+static int64_t DirIndex_GetDirMtime(const char* pszDir)
+{
+  WCHAR* pszWide = DirIndex_Utf8ToWide(pszDir, NULL);
+  if (!pszWide) {
+    return 0;
+  }
+
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  BOOL bFound = GetFileAttributesExW(pszWide, GetFileExInfoStandard, &data);
+  free(pszWide);
+
+  return bFound ? DirIndex_FileTimeToInt(data.ftLastWriteTime) : 0;
+}
+
+static int DirIndex_StatListed(const char* pszPath, LPDIRINDEXENTRY pEntry)
+{
+  (void)pszPath;
+  (void)pEntry;
+  return 1;
+}
+
+/* Returns 1 for a regular file, 0 for a directory or a missing file */
+static int DirIndex_StatFile(const char* pszPath, int64_t* pMtime, uint64_t* pSize)
+{
+  WCHAR* pszWide = DirIndex_Utf8ToWide(pszPath, NULL);
+  if (!pszWide) {
+    return 0;
+  }
+
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  BOOL bFound = GetFileAttributesExW(pszWide, GetFileExInfoStandard, &data);
+  free(pszWide);
+  if (!bFound || (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+    return 0;
+  }
+
+  *pMtime = DirIndex_FileTimeToInt(data.ftLastWriteTime);
+  *pSize = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+  return 1;
+}
+
+#else
+
+/* Nanosecond resolution where available, so that quick rewrites show up */
+static int64_t DirIndex_StatMtime(const struct stat* pStat)
+{
+#ifdef __linux__
+  return (int64_t)pStat->st_mtim.tv_sec * 1000000000 + pStat->st_mtim.tv_nsec;
+#else
+  return (int64_t)pStat->st_mtime;
+#endif
+}
+
+/*
+ * Lists the regular files of pszDir. With bDeferStat, names the directory
+ * entry already marks as regular files are passed on unstatted, their mtime
+ * DIRINDEX_MTIME_UNKNOWN, which leaves the stats to whoever filters them.
+ */
+static int DirIndex_ListFiles(const char* pszDir, int bDeferStat, DIRINDEXLISTFUNC pfnList, void* pContext)
+{
+  DIR* pDir = opendir(pszDir);
+  if (!pDir) {
+    return DIRINDEX_ERROR_IO;
+  }
+
+  int status = DIRINDEX_OK;
+  struct dirent* pEntry;
+  while ((pEntry = readdir(pDir)) != NULL) {
+    if (pEntry->d_name[0] == '.' &&
+        (!pEntry->d_name[1] || (pEntry->d_name[1] == '.' && !pEntry->d_name[2])))
+    {
+      continue;
+    }
+
+    DIRINDEXENTRY entry = { NULL, DIRINDEX_MTIME_UNKNOWN, 0 };
+    int bRegular = 0;
+#ifdef DT_REG
+    bRegular = bDeferStat && pEntry->d_type == DT_REG;
+#else
+    (void)bDeferStat;
+#endif
+
+    if (!bRegular) {
+      struct stat st;
+      if (fstatat(dirfd(pDir), pEntry->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+        continue;
+      }
+      entry.mtime = DirIndex_StatMtime(&st);
+      entry.size = (uint64_t)st.st_size;
+    }
+
+    entry.pszName = DirIndex_StrDup(pEntry->d_name);
+    status = entry.pszName ? pfnList(&entry, pContext) : DIRINDEX_ERROR_MEMORY;
+    if (status != DIRINDEX_OK) {
+      free(entry.pszName);
+      break;
+    }
+  }
+
+  closedir(pDir);
+  return status;
+}
+
+static int64_t DirIndex_GetDirMtime(const char* pszDir)
+{
+  struct stat st;
+  return stat(pszDir, &st) == 0 ? DirIndex_StatMtime(&st) : 0;
+}
+
+/* Returns 1 for a regular file, 0 for anything else or a missing file */
+static int DirIndex_StatFile(const char* pszPath, int64_t* pMtime, uint64_t* pSize)
+{
+  struct stat st;
+  if (stat(pszPath, &st) != 0 || !S_ISREG(st.st_mode)) {
+    return 0;
+  }
+
+  *pMtime = DirIndex_StatMtime(&st);
+  *pSize = (uint64_t)st.st_size;
+  return 1;
+}
+
+/* Completes an entry listed with the stat deferred. Returns 0 when it is gone. */
+static int DirIndex_StatListed(const char* pszPath, LPDIRINDEXENTRY pEntry)
+{
+  return pEntry->mtime != DIRINDEX_MTIME_UNKNOWN || DirIndex_StatFile(pszPath, &pEntry->mtime, &pEntry->size);
+}
+
+#endif
+
+/* Update the positions of the entries from nFrom on after an insert or a
+ * removal moved them; failing that, the table is rebuilt on the next lookup */
+static void DirIndex_MovePositions(LPDIRINDEX pIndex, size_t nFrom)
+{
+  for (size_t i = nFrom; !pIndex->bPositionsDirty && i < pIndex->count; ++i) {
+    if (HashTable_Insert(&pIndex->positions, &pIndex->pEntries[i].pszName, &i) != HASHTABLE_OK) {
+      pIndex->bPositionsDirty = 1;
+    }
+  }
+}
+
+static void DirIndex_RemoveAt(LPDIRINDEX pIndex, size_t nPos)
+{
+  if (!pIndex->bPositionsDirty) {
+    HashTable_Erase(&pIndex->positions, &pIndex->pEntries[nPos].pszName);
+  }
+
+  free(pIndex->pEntries[nPos].pszName);
+  memmove(&pIndex->pEntries[nPos], &pIndex->pEntries[nPos + 1],
+      (pIndex->count - nPos - 1) * sizeof(DIRINDEXENTRY));
+  --pIndex->count;
+  DirIndex_MovePositions(pIndex, nPos);
+}
+
+/* Position of the first entry not less than pszName */
+static size_t DirIndex_LowerBound(LPDIRINDEX pIndex, const char* pszName)
+{
+  size_t lo = 0;
+  size_t hi = pIndex->count;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (strcmp(pIndex->pEntries[mid].pszName, pszName) < 0) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+static int DirIndex_RebuildPositions(LPDIRINDEX pIndex)
+{
+  HashTable_Clear(&pIndex->positions);
+
+  int status = HashTable_Reserve(&pIndex->positions, pIndex->count);
+  for (size_t i = 0; status == HASHTABLE_OK && i < pIndex->count; ++i) {
+    status = HashTable_Insert(&pIndex->positions, &pIndex->pEntries[i].pszName, &i);
+  }
+
+  if (status != HASHTABLE_OK) {
+    HashTable_Clear(&pIndex->positions);
+    return DIRINDEX_ERROR_MEMORY;
+  }
+
+  pIndex->bPositionsDirty = 0;
+  return DIRINDEX_OK;
+}
+
+#if defined(_WIN32) || defined(__linux__)
+
+static void DirIndex_ForgetReject(LPDIRINDEX pIndex, const char* pszName)
+{
+  LPDIRINDEXENTRY pReject = (LPDIRINDEXENTRY)HashTable_Find(&pIndex->rejected, &pszName);
+  if (pReject) {
+    char* pszOwned = pReject->pszName;
+    HashTable_Erase(&pIndex->rejected, &pszName);
+    free(pszOwned);
+  }
+}
+
+static void DirIndex_RememberReject(LPDIRINDEX pIndex, const char* pszName, const DIRINDEXENTRY* pStamp)
+{
+  LPDIRINDEXENTRY pReject = (LPDIRINDEXENTRY)HashTable_Find(&pIndex->rejected, &pszName);
+  if (pReject) {
+    pReject->mtime = pStamp->mtime;
+    pReject->size = pStamp->size;
+    return;
+  }
+
+  /* Best effort: without the memo the file is merely filtered again */
+  DIRINDEXENTRY reject = { DirIndex_StrDup(pszName), pStamp->mtime, pStamp->size };
+  if (reject.pszName) {
+    DirIndex_AddReject(&pIndex->rejected, &reject);
+  }
+}
+
+/* Re-evaluate a single file after a change event. Returns 1 if the index
+ * changed. */
+static int DirIndex_UpdateFile(LPDIRINDEX pIndex, const char* pszName)
+{
+  size_t nPos = DirIndex_LowerBound(pIndex, pszName);
+  int bPresent = nPos < pIndex->count && !strcmp(pIndex->pEntries[nPos].pszName, pszName);
+
+  const char* pszPath = DirIndex_BuildPath(pIndex, pszName);
+  DIRINDEXENTRY entry = { (char*)pszName, 0, 0 };
+  int bAccept = 0;
+
+  if (pszPath && DirIndex_StatFile(pszPath, &entry.mtime, &entry.size)) {
+    if (!bPresent && DirIndex_IsKnownReject(pIndex, &entry)) {
+      return 0;
+    }
+
+    bAccept = DirIndex_Accept(pIndex, pszName);
+    if (bAccept) {
+      DirIndex_ForgetReject(pIndex, pszName);
+    }
+    else {
+      DirIndex_RememberReject(pIndex, pszName, &entry);
+    }
+  }
+  else {
+    DirIndex_ForgetReject(pIndex, pszName);
+  }
+
+  if (bPresent) {
+    if (bAccept) {
+      pIndex->pEntries[nPos].mtime = entry.mtime;
+      pIndex->pEntries[nPos].size = entry.size;
+      return 0;
+    }
+
+    DirIndex_RemoveAt(pIndex, nPos);
+    return 1;
+  }
+
+  if (!bAccept) {
+    return 0;
+  }
+
+  entry.pszName = DirIndex_StrDup(pszName);
+  if (!entry.pszName) {
+    return DIRINDEX_ERROR_MEMORY;
+  }
+
+  /* Append, then rotate the new entry into its sorted position */
+  if (DirIndex_AppendEntry(&pIndex->pEntries, &pIndex->count, &pIndex->capacity, &entry) != DIRINDEX_OK) {
+    free(entry.pszName);
+    return DIRINDEX_ERROR_MEMORY;
+  }
+
+  memmove(&pIndex->pEntries[nPos + 1], &pIndex->pEntries[nPos],
+      (pIndex->count - nPos - 1) * sizeof(DIRINDEXENTRY));
+  pIndex->pEntries[nPos] = entry;
+  DirIndex_MovePositions(pIndex, nPos);
+
+  return 1;
+}
+
+static int DirIndex_RemoveFile(LPDIRINDEX pIndex, const char* pszName)
+{
+  DirIndex_ForgetReject(pIndex, pszName);
+
+  size_t nPos = DirIndex_LowerBound(pIndex, pszName);
+  if (nPos < pIndex->count && !strcmp(pIndex->pEntries[nPos].pszName, pszName)) {
+    DirIndex_RemoveAt(pIndex, nPos);
+    return 1;
+  }
+  return 0;
+}
+
+#endif
+
+#ifdef _WIN32
+
+/* Change records read at once; network shares take no more than 64 KB */
+#define DIRINDEX_WATCH_BUFFER 16384
+
+struct _tagDIRWATCH {
+  HANDLE hDir;
+  OVERLAPPED overlapped;      /* hEvent is set once a read completed */
+  DWORD buffer[DIRINDEX_WATCH_BUFFER / sizeof(DWORD)];  /* FILE_NOTIFY_INFORMATION records */
+};
+
+static int DirIndex_ReadChanges(LPDIRWATCH pWatch)
+{
+  return ReadDirectoryChangesW(pWatch->hDir, pWatch->buffer, sizeof(pWatch->buffer), FALSE,
+      FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE, NULL,
+      &pWatch->overlapped, NULL);
+}
+
+/* Waits for a pending read to be cancelled, since it writes to the buffer */
+static void DirIndex_FreeWatch(LPDIRWATCH pWatch, int bPending)
+{
+  if (bPending) {
+    DWORD cbRead;
+    CancelIoEx(pWatch->hDir, &pWatch->overlapped);
+    GetOverlappedResult(pWatch->hDir, &pWatch->overlapped, &cbRead, TRUE);
+  }
+  if (pWatch->overlapped.hEvent) {
+    CloseHandle(pWatch->overlapped.hEvent);
+  }
+  if (pWatch->hDir != INVALID_HANDLE_VALUE) {
+    CloseHandle(pWatch->hDir);
+  }
+  free(pWatch);
+}
+
+static void DirIndex_StartWatch(LPDIRINDEX pIndex)
+{
+  WCHAR* pszWide = DirIndex_Utf8ToWide(pIndex->pszDir, NULL);
+  LPDIRWATCH pWatch = pszWide ? (LPDIRWATCH)calloc(1, sizeof(DIRWATCH)) : NULL;
+  if (!pWatch) {
+    free(pszWide);
+    return;
+  }
+
+  pWatch->hDir = CreateFileW(pszWide, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+      NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+  free(pszWide);
+  pWatch->overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+
+  if (pWatch->hDir == INVALID_HANDLE_VALUE || !pWatch->overlapped.hEvent || !DirIndex_ReadChanges(pWatch)) {
+    DirIndex_FreeWatch(pWatch, 0);
+    return;
+  }
+
+  pIndex->pWatch = pWatch;
+}
+
+static void DirIndex_StopWatch(LPDIRINDEX pIndex)
+{
+  if (pIndex->pWatch) {
+    DirIndex_FreeWatch(pIndex->pWatch, 1);
+    pIndex->pWatch = NULL;
+  }
+}
+
+static int DirIndex_HasWatch(LPDIRINDEX pIndex)
+{
+  return pIndex->pWatch != NULL;
+}
+
+/* Names in change records are counted, not terminated */
+static char* DirIndex_RecordName(const FILE_NOTIFY_INFORMATION* pInfo)
+{
+  int nWide = (int)(pInfo->FileNameLength / sizeof(WCHAR));
+  int len = WideCharToMultiByte(CP_UTF8, 0, pInfo->FileName, nWide, NULL, 0, NULL, NULL);
+  char* psz = len > 0 ? (char*)malloc((size_t)len + 1) : NULL;
+  if (psz) {
+    WideCharToMultiByte(CP_UTF8, 0, pInfo->FileName, nWide, psz, len, NULL, NULL);
+    psz[len] = '\0';
+  }
+
+  return psz;
+}
+
+/* Apply completed change records, falling back to a rescan when the system
+ * dropped some or a burst of changes arrived */
+static int DirIndex_PollWatch(LPDIRINDEX pIndex)
+{
+  LPDIRWATCH pWatch = pIndex->pWatch;
+  int nChanges = 0;
+  int nEvents = 0;
+  int bRescan = 0;
+
+  for (;;) {
+    DWORD cbRead = 0;
+    if (!GetOverlappedResult(pWatch->hDir, &pWatch->overlapped, &cbRead, FALSE)) {
+      if (GetLastError() == ERROR_IO_INCOMPLETE) {
+        break;
+      }
+      cbRead = 0;
+    }
+
+    /* Nothing read means the records did not fit and were dropped */
+    if (!cbRead) {
+      bRescan = 1;
+    }
+
+    const BYTE* p = (const BYTE*)pWatch->buffer;
+    while (!bRescan) {
+      const FILE_NOTIFY_INFORMATION* pInfo = (const FILE_NOTIFY_INFORMATION*)p;
+
+      if (++nEvents > DIRINDEX_MAX_EVENTS) {
+        bRescan = 1;
+        break;
+      }
+
+      char* pszName = DirIndex_RecordName(pInfo);
+      int result = !pszName ? DIRINDEX_ERROR_MEMORY :
+          (pInfo->Action == FILE_ACTION_REMOVED || pInfo->Action == FILE_ACTION_RENAMED_OLD_NAME) ?
+          DirIndex_RemoveFile(pIndex, pszName) :
+          DirIndex_UpdateFile(pIndex, pszName);
+      free(pszName);
+      if (result < 0) {
+        bRescan = 1;
+      }
+      else {
+        nChanges += result;
+      }
+
+      if (!pInfo->NextEntryOffset) {
+        break;
+      }
+      p += pInfo->NextEntryOffset;
+    }
+
+    /* Without a read pending, changes go unnoticed: fall back to the mtime */
+    if (!DirIndex_ReadChanges(pWatch)) {
+      DirIndex_FreeWatch(pWatch, 0);
+      pIndex->pWatch = NULL;
+      bRescan = 1;
+      break;
+    }
+  }
+
+  if (bRescan) {
+    int result = DirIndex_Rescan(pIndex);
+    return result < 0 ? result : nChanges + result;
+  }
+
+  return nChanges;
+}
+
+#elif defined(__linux__)
+
+static void DirIndex_StartWatch(LPDIRINDEX pIndex)
+{
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+
+  if (inotify_add_watch(fd, pIndex->pszDir, IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+      IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF) < 0)
+  {
+    close(fd);
+    return;
+  }
+
+  pIndex->nInotifyFd = fd;
+}
+
+static void DirIndex_StopWatch(LPDIRINDEX pIndex)
+{
+  if (pIndex->nInotifyFd >= 0) {
+    close(pIndex->nInotifyFd);
+    pIndex->nInotifyFd = -1;
+  }
+}
+
+static int DirIndex_HasWatch(LPDIRINDEX pIndex)
+{
+  return pIndex->nInotifyFd >= 0;
+}
+
+/* Apply queued inotify events, falling back to a rescan when the queue
+ * overflowed or a burst of changes arrived */
+static int DirIndex_PollWatch(LPDIRINDEX pIndex)
+{
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  int nChanges = 0;
+  int nEvents = 0;
+  int bRescan = 0;
+
+  for (;;) {
+    ssize_t len = read(pIndex->nInotifyFd, buffer, sizeof(buffer));
+    if (len <= 0) {
+      break;
+    }
+
+    for (char* p = buffer; p < buffer + len; ) {
+      const struct inotify_event* pEvent = (const struct inotify_event*)p;
+      p += sizeof(struct inotify_event) + pEvent->len;
+
+      if (pEvent->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF)) {
+        bRescan = 1;
+      }
+
+      if (bRescan || !pEvent->len || (pEvent->mask & IN_ISDIR)) {
+        continue;
+      }
+
+      if (++nEvents > DIRINDEX_MAX_EVENTS) {
+        bRescan = 1;
+        continue;
+      }
+
+      int result = (pEvent->mask & (IN_DELETE | IN_MOVED_FROM)) ?
+          DirIndex_RemoveFile(pIndex, pEvent->name) :
+          DirIndex_UpdateFile(pIndex, pEvent->name);
+      if (result < 0) {
+        bRescan = 1;
+      }
+      else {
+        nChanges += result;
+      }
+    }
+  }
+
+  if (bRescan) {
+    int result = DirIndex_Rescan(pIndex);
+    return result < 0 ? result : nChanges + result;
+  }
+
+  return nChanges;
+}
+
+#else
+
+static void DirIndex_StartWatch(LPDIRINDEX pIndex)
+{
+  (void)pIndex;
+}
+
+static void DirIndex_StopWatch(LPDIRINDEX pIndex)
+{
+  (void)pIndex;
+}
+
+static int DirIndex_HasWatch(LPDIRINDEX pIndex)
+{
+  (void)pIndex;
+  return 0;
+}
+
+static int DirIndex_PollWatch(LPDIRINDEX pIndex)
+{
+  (void)pIndex;
+  return 0;
+}
+
+#endif
+
+/* Sorts the names of a batch into accepted and rejected; the stat and the
+ * filter run outside the lock */
+static void DirIndex_ScanBatch(void* pArg)
+{
+  LPDIRSCANBATCH pBatch = (LPDIRSCANBATCH)pArg;
+  LPDIRSCAN pScan = pBatch->pScan;
+  char* pszPathBuffer = NULL;
+  size_t pathBufferSize = 0;
+
+  for (size_t i = 0; i < pBatch->count; ++i) {
+    DIRINDEXENTRY entry = pBatch->entries[i];
+
+    /* -1 when cancelled, the file is gone or the path does not fit in memory */
+    int nAccept = -1;
+    if (!Atomic_Load(&pScan->bCancelled)) {
+      const char* pszPath = DirIndex_JoinPath(pScan->pszDir, entry.pszName, &pszPathBuffer, &pathBufferSize);
+      if (pszPath && DirIndex_StatListed(pszPath, &entry)) {
+        nAccept = !pScan->pfnFilter || pScan->pfnFilter(pszPath, entry.pszName, pScan->pUserData);
+      }
+    }
+
+    int status = DIRINDEX_ERROR_IO;
+    if (nAccept >= 0) {
+      Mutex_Lock(&pScan->mutex);
+      if (nAccept > 0) {
+        status = DirIndex_AppendEntry(&pScan->pAccepted, &pScan->nAccepted, &pScan->acceptedCapacity, &entry);
+      }
+      else {
+        status = DirIndex_AppendEntry(&pScan->pRejected, &pScan->nRejected, &pScan->rejectedCapacity, &entry);
+      }
+      Mutex_Unlock(&pScan->mutex);
+    }
+    if (status != DIRINDEX_OK) {
+      free(entry.pszName);
+    }
+  }
+
+  free(pszPathBuffer);
+  free(pBatch);
+}
+
+/* Hands the batch being listed to the pool, or scans it right here when it can not be queued */
+static void DirIndex_QueueBatch(LPDIRSCAN pScan)
+{
+  LPDIRSCANBATCH pBatch = pScan->pBatch;
+  if (!pBatch) {
+    return;
+  }
+
+  pScan->pBatch = NULL;
+  if (pScan->batchSize < DIRINDEX_SCAN_BATCH) {
+    pScan->batchSize *= 2;
+  }
+
+  if (TaskPool_Submit(pScan->pPool, &pScan->group, DirIndex_ScanBatch, pBatch) != TASKPOOL_OK) {
+    DirIndex_ScanBatch(pBatch);
+  }
+}
+
+static int DirIndex_ListToScan(const DIRINDEXENTRY* pEntry, void* pContext)
+{
+  LPDIRSCAN pScan = (LPDIRSCAN)pContext;
+  if (Atomic_Load(&pScan->bCancelled)) {
+    return DIRINDEX_STOPPED;
+  }
+
+  if (!pScan->pBatch) {
+    pScan->pBatch = (LPDIRSCANBATCH)malloc(sizeof(DIRSCANBATCH));
+    if (!pScan->pBatch) {
+      return DIRINDEX_ERROR_MEMORY;
+    }
+    pScan->pBatch->pScan = pScan;
+    pScan->pBatch->count = 0;
+  }
+
+  pScan->pBatch->entries[pScan->pBatch->count++] = *pEntry;
+  if (pScan->pBatch->count == pScan->batchSize) {
+    DirIndex_QueueBatch(pScan);
+  }
+
+  return DIRINDEX_OK;
+}
+
+/* The first task of a scan, queueing the names in batches as they are listed */
+static void DirIndex_ListTask(void* pArg)
+{
+  LPDIRSCAN pScan = (LPDIRSCAN)pArg;
+  int status = DirIndex_ListFiles(pScan->pszDir, 1, DirIndex_ListToScan, pScan);
+  DirIndex_QueueBatch(pScan);
+
+  Mutex_Lock(&pScan->mutex);
+  pScan->status = status < 0 ? status : DIRINDEX_OK;
+  Mutex_Unlock(&pScan->mutex);
+}
+
+/* Runs queued tasks until the listing and every batch it queued are done */
+static void DirIndex_JoinScan(LPDIRSCAN pScan)
+{
+  TaskPool_Wait(pScan->pPool, &pScan->group);
+}
+
+/* Releases a joined scan with whatever it did not hand over */
+static void DirIndex_FreeScan(LPDIRSCAN pScan)
+{
+  for (size_t i = 0; i < pScan->nAccepted; ++i) {
+    free(pScan->pAccepted[i].pszName);
+  }
+  for (size_t i = 0; i < pScan->nRejected; ++i) {
+    free(pScan->pRejected[i].pszName);
+  }
+
+  free(pScan->pAccepted);
+  free(pScan->pRejected);
+  Mutex_Destroy(&pScan->mutex);
+  free(pScan);
+}
+
+static void DirIndex_CancelScan(LPDIRINDEX pIndex)
+{
+  LPDIRSCAN pScan = pIndex->pScan;
+  if (!pScan) {
+    return;
+  }
+
+  /* Batches still queued free their names without a look at the files */
+  Atomic_Store(&pScan->bCancelled, 1);
+  DirIndex_JoinScan(pScan);
+  DirIndex_FreeScan(pScan);
+  pIndex->pScan = NULL;
+}
+
+/* Returns NULL without a pool, or when the listing can not be queued */
+static LPDIRSCAN DirIndex_StartScan(LPDIRINDEX pIndex, LPTASKPOOL pPool)
+{
+  if (!pPool) {
+    return NULL;
+  }
+
+  LPDIRSCAN pScan = (LPDIRSCAN)calloc(1, sizeof(DIRSCAN));
+  if (!pScan) {
+    return NULL;
+  }
+
+  pScan->pPool = pPool;
+  TaskGroup_Init(&pScan->group);
+  Mutex_Init(&pScan->mutex);
+  pScan->pszDir = pIndex->pszDir;
+  pScan->pfnFilter = pIndex->pfnFilter;
+  pScan->pUserData = pIndex->pUserData;
+  pScan->batchSize = 1;
+
+  if (TaskPool_Submit(pPool, &pScan->group, DirIndex_ListTask, pScan) != TASKPOOL_OK) {
+    DirIndex_FreeScan(pScan);
+    return NULL;
+  }
+
+  pIndex->pScan = pScan;
+  return pScan;
+}
+
+/* Sorts a batch of new names into the index, taking over the batch */
+static int DirIndex_InsertBatch(LPDIRINDEX pIndex, LPDIRINDEXENTRY pBatch, size_t nBatch)
+{
+  if (!nBatch) {
+    free(pBatch);
+    return 0;
+  }
+
+  size_t count = pIndex->count + nBatch;
+  if (count > pIndex->capacity) {
+    size_t capacity = pIndex->capacity * 2 > count ? pIndex->capacity * 2 : count;
+    LPDIRINDEXENTRY pEntries = (LPDIRINDEXENTRY)realloc(pIndex->pEntries, capacity * sizeof(DIRINDEXENTRY));
+    if (!pEntries) {
+      for (size_t i = 0; i < nBatch; ++i) {
+        free(pBatch[i].pszName);
+      }
+      free(pBatch);
+      return DIRINDEX_ERROR_MEMORY;
+    }
+    pIndex->pEntries = pEntries;
+    pIndex->capacity = capacity;
+  }
+
+  /* Merge from the back, so each entry moves once */
+  qsort(pBatch, nBatch, sizeof(DIRINDEXENTRY), DirIndex_CompareEntry);
+
+  size_t i = pIndex->count;
+  size_t j = nBatch;
+  size_t k = count;
+  while (j > 0) {
+    if (i > 0 && strcmp(pIndex->pEntries[i - 1].pszName, pBatch[j - 1].pszName) > 0) {
+      pIndex->pEntries[--k] = pIndex->pEntries[--i];
+    }
+    else {
+      pIndex->pEntries[--k] = pBatch[--j];
+    }
+  }
+
+  /* Rebuilt once the scan is over, not after every batch */
+  pIndex->count = count;
+  pIndex->bPositionsDirty = 1;
+  free(pBatch);
+
+  return (int)nBatch;
+}
+
+/*
+ * Moves what the pool filtered since the last call into the index and the
+ * rejected table. Once every task of the scan is done it is released.
+ * Returns the number of entries added or a negative error.
+ */
+static int DirIndex_MergeScan(LPDIRINDEX pIndex)
+{
+  LPDIRSCAN pScan = pIndex->pScan;
+
+  /* Checked before the results are taken, so none are left behind */
+  int bDone = !Atomic_LoadAcquire(&pScan->group.nPending);
+
+  Mutex_Lock(&pScan->mutex);
+  LPDIRINDEXENTRY pAccepted = pScan->pAccepted;
+  size_t nAccepted = pScan->nAccepted;
+  LPDIRINDEXENTRY pRejected = pScan->pRejected;
+  size_t nRejected = pScan->nRejected;
+  pScan->pAccepted = NULL;
+  pScan->nAccepted = 0;
+  pScan->acceptedCapacity = 0;
+  pScan->pRejected = NULL;
+  pScan->nRejected = 0;
+  pScan->rejectedCapacity = 0;
+  int status = pScan->status;
+  Mutex_Unlock(&pScan->mutex);
+
+  for (size_t i = 0; i < nRejected; ++i) {
+    DirIndex_AddReject(&pIndex->rejected, &pRejected[i]);
+  }
+  free(pRejected);
+
+  int nAdded = DirIndex_InsertBatch(pIndex, pAccepted, nAccepted);
+
+  if (bDone) {
+    DirIndex_FreeScan(pScan);
+    pIndex->pScan = NULL;
+  }
+
+  return nAdded < 0 || status == DIRINDEX_OK ? nAdded : status;
+}
+
+void DirIndex_Init(LPDIRINDEX pIndex)
+{
+  memset(pIndex, 0, sizeof(*pIndex));
+
+  DirIndex_InitNameTable(&pIndex->positions, sizeof(size_t));
+  DirIndex_InitNameTable(&pIndex->rejected, sizeof(DIRINDEXENTRY));
+
+#ifndef _WIN32
+  pIndex->nInotifyFd = -1;
+#endif
+}
+
+/* Release any previous state and start watching pszDir */
+static int DirIndex_Begin(LPDIRINDEX pIndex, const char* pszDir, DIRINDEXFILTERFUNC pfnFilter, void* pUserData)
+{
+  DirIndex_Close(pIndex);
+
+  pIndex->pszDir = DirIndex_StrDup(pszDir);
+  if (!pIndex->pszDir) {
+    return DIRINDEX_ERROR_MEMORY;
+  }
+
+  /* Strip a trailing separator so paths join cleanly */
+  size_t len = strlen(pIndex->pszDir);
+  while (len > 1 && pIndex->pszDir[len - 2] != ':' &&
+      (pIndex->pszDir[len - 1] == '/' || pIndex->pszDir[len - 1] == DIRINDEX_PATH_SEPARATOR)) {
+    pIndex->pszDir[--len] = '\0';
+  }
+
+  pIndex->pfnFilter = pfnFilter;
+  pIndex->pUserData = pUserData;
+
+  /* Watch first so that nothing slips in between the scan and the watch */
+  DirIndex_StartWatch(pIndex);
+  return DIRINDEX_OK;
+}
+
+/*
+ * DirIndex_Open
+ *
+ * Index the files of pszDir accepted by pfnFilter (all regular files when
+ * NULL) and start watching the directory. Any previous state is released.
+ */
+int DirIndex_Open(LPDIRINDEX pIndex, const char* pszDir, DIRINDEXFILTERFUNC pfnFilter, void* pUserData)
+{
+  int status = DirIndex_Begin(pIndex, pszDir, pfnFilter, pUserData);
+  if (status != DIRINDEX_OK) {
+    return status;
+  }
+
+  status = DirIndex_Rescan(pIndex);
+  return status < 0 ? status : DIRINDEX_OK;
+}
+
+/*
+ * DirIndex_OpenAsync
+ *
+ * Like DirIndex_Open, but returns right away with the index empty: a task
+ * on pPool lists pszDir and queues the names in batches, which other tasks
+ * stat and filter as they come in, so pfnFilter must be safe to call from
+ * several threads at once. Every DirIndex_Refresh merges what they finished
+ * since, until DirIndex_IsScanning returns 0. The tasks wait on the disk
+ * most of the time, so pPool is best reserved for I/O. Scans synchronously
+ * without a pool or when the listing can not be queued.
+ */
+int DirIndex_OpenAsync(LPDIRINDEX pIndex, const char* pszDir, DIRINDEXFILTERFUNC pfnFilter, void* pUserData,
+    LPTASKPOOL pPool)
+{
+  int status = DirIndex_Begin(pIndex, pszDir, pfnFilter, pUserData);
+  if (status != DIRINDEX_OK) {
+    return status;
+  }
+
+  pIndex->dirMtime = DirIndex_GetDirMtime(pIndex->pszDir);
+  if (DirIndex_StartScan(pIndex, pPool)) {
+    return DIRINDEX_OK;
+  }
+
+  status = DirIndex_Rescan(pIndex);
+  return status < 0 ? status : DIRINDEX_OK;
+}
+
+/* Nonzero until a refresh merged the last of a background scan */
+int DirIndex_IsScanning(LPDIRINDEX pIndex)
+{
+  return pIndex->pScan != NULL;
+}
+
+/*
+ * DirIndex_FinishScan
+ *
+ * Wait for a background scan to end, running its queued tasks meanwhile,
+ * and merge the rest of it. Returns the number of entries added or a
+ * negative error.
+ */
+int DirIndex_FinishScan(LPDIRINDEX pIndex)
+{
+  if (!pIndex->pScan) {
+    return 0;
+  }
+
+  DirIndex_JoinScan(pIndex->pScan);
+  return DirIndex_MergeScan(pIndex);
+}
+
+/*
+ * DirIndex_Rescan
+ *
+ * List the directory and merge it into the index. Files whose name, size and
+ * modification time are unchanged keep their entry without being filtered
+ * again. Returns the number of entries added, removed or updated.
+ */
+int DirIndex_Rescan(LPDIRINDEX pIndex)
+{
+  DIRLISTING listing = { NULL, 0, 0 };
+
+  /* What a background scan finds first is what the listing compares to */
+  int nScanned = DirIndex_FinishScan(pIndex);
+  if (nScanned < 0) {
+    return nScanned;
+  }
+
+  pIndex->dirMtime = DirIndex_GetDirMtime(pIndex->pszDir);
+
+  int status = DirIndex_ListFiles(pIndex->pszDir, 0, DirIndex_ListInto, &listing);
+  if (status != DIRINDEX_OK) {
+    DirIndex_FreeListing(&listing);
+    return status;
+  }
+
+  if (listing.count) {
+    qsort(listing.pItems, listing.count, sizeof(DIRINDEXENTRY), DirIndex_CompareEntry);
+  }
+
+  LPDIRINDEXENTRY pMerged = NULL;
+  size_t nMerged = 0;
+  size_t nCapacity = 0;
+  int nChanges = nScanned;
+  size_t i = 0;
+  size_t j = 0;
+
+  if (listing.count) {
+    pMerged = (LPDIRINDEXENTRY)malloc(listing.count * sizeof(DIRINDEXENTRY));
+    if (!pMerged) {
+      DirIndex_FreeListing(&listing);
+      return DIRINDEX_ERROR_MEMORY;
+    }
+    nCapacity = listing.count;
+  }
+
+  /* Rejects that are still in the directory move to a fresh table */
+  HASHTABLE rejected;
+  DirIndex_InitNameTable(&rejected, sizeof(DIRINDEXENTRY));
+
+  /* Both sides are sorted; every listed name ends up merged, in the rejected
+   * table or freed */
+  while (i < pIndex->count || j < listing.count) {
+    int cmp;
+    if (i == pIndex->count) {
+      cmp = 1;
+    }
+    else if (j == listing.count) {
+      cmp = -1;
+    }
+    else {
+      cmp = strcmp(pIndex->pEntries[i].pszName, listing.pItems[j].pszName);
+    }
+
+    if (cmp < 0) {
+      /* Gone from the directory */
+      free(pIndex->pEntries[i++].pszName);
+      ++nChanges;
+    }
+    else if (cmp > 0) {
+      LPDIRINDEXENTRY pItem = &listing.pItems[j++];
+      if (!DirIndex_IsKnownReject(pIndex, pItem) && DirIndex_Accept(pIndex, pItem->pszName)) {
+        pMerged[nMerged++] = *pItem;
+        ++nChanges;
+      }
+      else {
+        DirIndex_AddReject(&rejected, pItem);
+      }
+    }
+    else {
+      LPDIRINDEXENTRY pEntry = &pIndex->pEntries[i++];
+      LPDIRINDEXENTRY pItem = &listing.pItems[j++];
+
+      if (pEntry->mtime == pItem->mtime && pEntry->size == pItem->size) {
+        pMerged[nMerged++] = *pEntry;
+        free(pItem->pszName);
+      }
+      else if (DirIndex_Accept(pIndex, pEntry->pszName)) {
+        pEntry->mtime = pItem->mtime;
+        pEntry->size = pItem->size;
+        pMerged[nMerged++] = *pEntry;
+        free(pItem->pszName);
+        ++nChanges;
+      }
+      else {
+        free(pEntry->pszName);
+        DirIndex_AddReject(&rejected, pItem);
+        ++nChanges;
+      }
+    }
+  }
+
+  DirIndex_FreeRejected(&pIndex->rejected);
+  pIndex->rejected = rejected;
+
+  free(listing.pItems);
+  free(pIndex->pEntries);
+
+  pIndex->pEntries = pMerged;
+  pIndex->count = nMerged;
+  pIndex->capacity = nCapacity;
+  pIndex->bPositionsDirty = 1;
+
+  return nChanges;
+}
+
+/*
+ * DirIndex_Refresh
+ *
+ * Bring the index up to date with the directory. Cheap when nothing
+ * changed. Returns the number of changed entries or a negative error.
+ */
+int DirIndex_Refresh(LPDIRINDEX pIndex)
+{
+  if (!pIndex->pszDir) {
+    return 0;
+  }
+
+  /* Changes made during a background scan wait until it is over */
+  int nScanned = 0;
+  if (pIndex->pScan) {
+    nScanned = DirIndex_MergeScan(pIndex);
+    if (nScanned < 0 || pIndex->pScan) {
+      return nScanned;
+    }
+  }
+
+  int status = 0;
+  if (DirIndex_HasWatch(pIndex)) {
+    status = DirIndex_PollWatch(pIndex);
+  }
+  else if (DirIndex_GetDirMtime(pIndex->pszDir) != pIndex->dirMtime) {
+    /* No notifications available, fall back to the directory mtime */
+    status = DirIndex_Rescan(pIndex);
+  }
+
+  return status < 0 ? status : nScanned + status;
+}
+
+size_t DirIndex_GetCount(LPDIRINDEX pIndex)
+{
+  return pIndex->count;
+}
+
+const char* DirIndex_GetName(LPDIRINDEX pIndex, size_t nPos)
+{
+  return nPos < pIndex->count ? pIndex->pEntries[nPos].pszName : NULL;
+}
+
+size_t DirIndex_Find(LPDIRINDEX pIndex, const char* pszName)
+{
+  /*
+   * During a background scan every refresh moves the entries, and out of
+   * memory the table cannot be rebuilt; the sorted array answers then.
+   */
+  if (pIndex->bPositionsDirty && (pIndex->pScan || DirIndex_RebuildPositions(pIndex) != DIRINDEX_OK)) {
+    size_t nPos = DirIndex_LowerBound(pIndex, pszName);
+    return nPos < pIndex->count && !strcmp(pIndex->pEntries[nPos].pszName, pszName) ?
+        nPos : DIRINDEX_NPOS;
+  }
+
+  size_t* pPos = (size_t*)HashTable_Find(&pIndex->positions, &pszName);
+  return pPos ? *pPos : DIRINDEX_NPOS;
+}
+
+/*
+ * DirIndex_Step
+ *
+ * Name of the file after (or before) pszName, wrapping around at the ends.
+ * pszName need not be in the index, e.g. when it was just deleted; its
+ * sorted neighbour is used then.
+ */
+const char* DirIndex_Step(LPDIRINDEX pIndex, const char* pszName, int bForward)
+{
+  if (!pIndex->count) {
+    return NULL;
+  }
+
+  size_t nPos = DirIndex_Find(pIndex, pszName);
+  if (nPos != DIRINDEX_NPOS) {
+    nPos = bForward ? nPos + 1 : nPos + pIndex->count - 1;
+  }
+  else {
+    nPos = DirIndex_LowerBound(pIndex, pszName);
+    if (!bForward) {
+      nPos += pIndex->count - 1;
+    }
+  }
+
+  return pIndex->pEntries[nPos % pIndex->count].pszName;
+}
+
+void DirIndex_Close(LPDIRINDEX pIndex)
+{
+  DirIndex_CancelScan(pIndex);
+  DirIndex_StopWatch(pIndex);
+
+  for (size_t i = 0; i < pIndex->count; ++i) {
+    free(pIndex->pEntries[i].pszName);
+  }
+
+  free(pIndex->pEntries);
+  free(pIndex->pszDir);
+  free(pIndex->pszPathBuffer);
+  HashTable_Cleanup(&pIndex->positions);
+  DirIndex_FreeRejected(&pIndex->rejected);
+
+  pIndex->pEntries = NULL;
+  pIndex->count = 0;
+  pIndex->capacity = 0;
+  pIndex->pszDir = NULL;
+  pIndex->pszPathBuffer = NULL;
+  pIndex->pathBufferSize = 0;
+  pIndex->bPositionsDirty = 0;
+  pIndex->dirMtime = 0;
+}
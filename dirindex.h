@@ -0,0 +1,118 @@
+/*
+ * dirindex.h
+ *
+ * Persistent sorted index of the files in one directory
+ *
+ * The index is built once, kept in memory and refreshed incrementally: from
+ * inotify events on Linux, from ReadDirectoryChangesW records on Windows, and
+ * from the directory modification time elsewhere. A rescan only
+ * runs the filter callback for files that are new or whose size or
+ * modification time changed, including files the filter rejected before.
+ *
+ * Names are UTF-8 and sorted bytewise, i.e. by code point. Locating a name is
+ * a hash lookup, so stepping to the neighbouring file is O(1). The hash
+ * table follows single inserts and removals; only a rescan rebuilds it.
+ *
+ * A large directory, or a slow filter, can also be indexed in the background
+ * on a task pool: one task lists the names and queues them in batches for
+ * others to stat and filter, and every refresh merges what they finished so
+ * far. The index can be stepped through meanwhile, over the files found until
+ * then, locating names by binary search until the scan is over. The tasks
+ * block on the disk, so the pool is best one of its own rather than the one
+ * computations are split over.
+ */
+
+#ifndef PANIVIEW_DIRINDEX_H
+#define PANIVIEW_DIRINDEX_H
+
+#include "hashmap.h"
+#include "taskpool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#define DIRINDEX_PATH_SEPARATOR '\\'
+#else
+#define DIRINDEX_PATH_SEPARATOR '/'
+#endif
+
+#define DIRINDEX_NPOS ((size_t)-1)
+
+enum {
+  DIRINDEX_OK = 0,
+  DIRINDEX_ERROR_IO = -1,
+  DIRINDEX_ERROR_MEMORY = -2,
+};
+
+/* Decide whether a file belongs to the index; pszPath is the full path */
+typedef int (*DIRINDEXFILTERFUNC)(const char* pszPath, const char* pszName, void* pUserData);
+
+typedef struct _tagDIRINDEXENTRY DIRINDEXENTRY, * LPDIRINDEXENTRY;
+typedef struct _tagDIRSCANBATCH DIRSCANBATCH, * LPDIRSCANBATCH;
+typedef struct _tagDIRSCAN DIRSCAN, * LPDIRSCAN;
+typedef struct _tagDIRWATCH DIRWATCH, * LPDIRWATCH;
+typedef struct _tagDIRINDEX DIRINDEX, * LPDIRINDEX;
+
+struct _tagDIRINDEXENTRY {
+  char* pszName;
+  int64_t mtime;
+  uint64_t size;
+};
+
+/* A directory being listed and filtered in the background */
+struct _tagDIRSCAN {
+  LPTASKPOOL pPool;
+  TASKGROUP group;            /* The listing and the batches it queued */
+  MUTEX mutex;                /* Guards the results and the status */
+  const char* pszDir;         /* The index's, unchanged while the scan runs */
+  DIRINDEXFILTERFUNC pfnFilter;
+  void* pUserData;
+  LPDIRSCANBATCH pBatch;      /* Being listed, the listing task's own */
+  size_t batchSize;           /* Names the next batch is queued at */
+  LPDIRINDEXENTRY pAccepted;  /* Filtered, not merged into the index yet */
+  size_t nAccepted;
+  size_t acceptedCapacity;
+  LPDIRINDEXENTRY pRejected;
+  size_t nRejected;
+  size_t rejectedCapacity;
+  int status;                 /* Of the listing */
+  volatile long bCancelled;
+};
+
+struct _tagDIRINDEX {
+  char* pszDir;
+  LPDIRINDEXENTRY pEntries;   /* Sorted by name */
+  size_t count;
+  size_t capacity;
+  HASHTABLE positions;        /* Name pointer -> index into pEntries */
+  int bPositionsDirty;        /* Rebuilt lazily after the entries moved */
+  HASHTABLE rejected;         /* Name -> owning entry of files filtered out */
+  DIRINDEXFILTERFUNC pfnFilter;
+  void* pUserData;
+  char* pszPathBuffer;        /* Scratch for building full paths */
+  size_t pathBufferSize;
+  int64_t dirMtime;
+  LPDIRSCAN pScan;            /* Background scan not merged completely yet */
+#ifdef _WIN32
+  LPDIRWATCH pWatch;          /* Directory handle with a change read pending */
+#else
+  int nInotifyFd;
+#endif
+};
+
+void DirIndex_Init(LPDIRINDEX pIndex);
+int DirIndex_Open(LPDIRINDEX pIndex, const char* pszDir, DIRINDEXFILTERFUNC pfnFilter, void* pUserData);
+int DirIndex_OpenAsync(LPDIRINDEX pIndex, const char* pszDir, DIRINDEXFILTERFUNC pfnFilter, void* pUserData,
+    LPTASKPOOL pPool);
+int DirIndex_IsScanning(LPDIRINDEX pIndex);
+int DirIndex_FinishScan(LPDIRINDEX pIndex);
+int DirIndex_Refresh(LPDIRINDEX pIndex);
+int DirIndex_Rescan(LPDIRINDEX pIndex);
+size_t DirIndex_GetCount(LPDIRINDEX pIndex);
+const char* DirIndex_GetName(LPDIRINDEX pIndex, size_t nPos);
+size_t DirIndex_Find(LPDIRINDEX pIndex, const char* pszName);
+const char* DirIndex_Step(LPDIRINDEX pIndex, const char* pszName, int bForward);
+void DirIndex_Close(LPDIRINDEX pIndex);
+
+#endif /* PANIVIEW_DIRINDEX_H */
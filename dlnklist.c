@@ -1,7 +1,10 @@
-#include "precomp.h"
-
 #include "dlnklist.h"
 
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #ifdef UNIT_TESTING
 extern void* _test_malloc(const size_t size, const char* file, const int line);
  
@@ -11,6 +14,15 @@ extern void* _test_calloc(const size_t num, const size_t size, const char* file,
   const int line);
 
 #define calloc(num, size) _test_calloc(num, size, __FILE__, __LINE__)
+
+extern void* _test_realloc(void* const ptr, const size_t size, const char* file,
+  const int line);
+
+#define realloc(ptr, size) _test_realloc(ptr, size, __FILE__, __LINE__)
+
+extern void _test_free(void* const ptr, const char* file, const int line);
+
+#define free(ptr) _test_free(ptr, __FILE__, __LINE__)
 #endif
 
 void DoubleLinkList_Init(LPDOUBLELINKLIST pDoubleLinkList, DOUBLELINKLISTSORTFUNC pfnSort)
@@ -45,7 +57,7 @@ LPDOUBLELINKLISTNODE DoubleLinkList_CreateNode(void)
  * `valueSize` size of the data to be copied
  * `bSeek` - set the pHead pointer to the inserted node
  * */
-void DoubleLinkList_AppendBack(LPDOUBLELINKLIST pDoubleLinkList, const void* pValue, size_t valueSize, BOOL bSeek)
+void DoubleLinkList_AppendBack(LPDOUBLELINKLIST pDoubleLinkList, const void* pValue, size_t valueSize, int bSeek)
 {
   LPDOUBLELINKLISTNODE pNode = DoubleLinkList_CreateNode();
 
@@ -81,7 +93,7 @@ void DoubleLinkList_AppendBack(LPDOUBLELINKLIST pDoubleLinkList, const void* pVa
  * `valueSize` size of the data to be copied
  * `bSeek` - set the pHead pointer to the inserted node
  * */
-void DoubleLinkList_AppendFront(LPDOUBLELINKLIST pDoubleLinkList, const void* pValue, size_t valueSize, BOOL bSeek)
+void DoubleLinkList_AppendFront(LPDOUBLELINKLIST pDoubleLinkList, const void* pValue, size_t valueSize, int bSeek)
 {
   LPDOUBLELINKLISTNODE pNode = DoubleLinkList_CreateNode();
   if (pNode) {
@@ -109,11 +121,41 @@ void DoubleLinkList_AppendFront(LPDOUBLELINKLIST pDoubleLinkList, const void* pV
   }
 }
 
+/*
+ * DoubleLinkList_Merge
+ *
+ * Merge two sorted chains linked through pNext only. Ties are taken from
+ * pLeft, which keeps the sort stable.
+ * */
+static LPDOUBLELINKLISTNODE DoubleLinkList_Merge(DOUBLELINKLISTSORTFUNC pfnSort,
+    LPDOUBLELINKLISTNODE pLeft, LPDOUBLELINKLISTNODE pRight)
+{
+  DOUBLELINKLISTNODE head;
+  LPDOUBLELINKLISTNODE pTail = &head;
+
+  while (pLeft && pRight) {
+    if (pfnSort(pLeft->pValue, pLeft->valueSize, pRight->pValue, pRight->valueSize) > 0) {
+      pTail->pNext = pRight;
+      pRight = pRight->pNext;
+    }
+    else {
+      pTail->pNext = pLeft;
+      pLeft = pLeft->pNext;
+    }
+    pTail = pTail->pNext;
+  }
+
+  pTail->pNext = pLeft ? pLeft : pRight;
+  return head.pNext;
+}
+
 /*
  * DoubleLinkList_Sort
  *
- * Sort the provided double linked list by an algorithm provided in pfnSort
- * callback function
+ * Sort the provided double linked list in ascending order of the pfnSort
+ * comparator. This is a stable bottom-up merge sort that relinks the nodes
+ * in place: bin[i] holds a sorted run of 2^i nodes, and every incoming node
+ * is carried through the occupied bins like a binary counter.
  *
  * Note: if pfnSort is not provided, the function will fail
  * */
@@ -128,16 +170,46 @@ void DoubleLinkList_Sort(LPDOUBLELINKLIST pDoubleLinkList) {
     return;
   }
 
-  for (LPDOUBLELINKLISTNODE pNode1 = pDoubleLinkList->pBegin; pNode1; pNode1 = pNode1->pNext) {
-    for (LPDOUBLELINKLISTNODE pNode2 = pNode1->pNext; pNode2; pNode2 = pNode2->pNext) {
-      if (pDoubleLinkList->pfnSort(pNode1->pValue, pNode1->valueSize, pNode2->pValue, pNode2->valueSize) < 0) {
-        /* Swap data pointers */
-        void* temp = pNode1->pValue;
-        pNode1->pValue = pNode2->pValue;
-        pNode2->pValue = temp;
-      }
+  LPDOUBLELINKLISTNODE bins[sizeof(size_t) * 8] = { 0 };
+  size_t nBins = 0;
+
+  LPDOUBLELINKLISTNODE pNode = pDoubleLinkList->pBegin;
+  while (pNode) {
+    LPDOUBLELINKLISTNODE pNext = pNode->pNext;
+    LPDOUBLELINKLISTNODE pCarry = pNode;
+    pCarry->pNext = NULL;
+
+    /* Bins hold earlier nodes than the carry, so they merge from the left */
+    size_t i = 0;
+    for (; i < nBins && bins[i]; ++i) {
+      pCarry = DoubleLinkList_Merge(pDoubleLinkList->pfnSort, bins[i], pCarry);
+      bins[i] = NULL;
+    }
+
+    bins[i] = pCarry;
+    if (i == nBins) {
+      ++nBins;
+    }
+
+    pNode = pNext;
+  }
+
+  LPDOUBLELINKLISTNODE pSorted = NULL;
+  for (size_t i = 0; i < nBins; ++i) {
+    if (bins[i]) {
+      pSorted = DoubleLinkList_Merge(pDoubleLinkList->pfnSort, bins[i], pSorted);
     }
   }
+
+  /* Restore the back links */
+  LPDOUBLELINKLISTNODE pPrev = NULL;
+  for (pNode = pSorted; pNode; pNode = pNode->pNext) {
+    pNode->pPrev = pPrev;
+    pPrev = pNode;
+  }
+
+  pDoubleLinkList->pBegin = pSorted;
+  pDoubleLinkList->pEnd = pPrev;
 }
 
 /*
@@ -7,6 +7,8 @@
 #ifndef PANIVIEW_DLNKLIST_H
 #define PANIVIEW_DLNKLIST_H
 
+#include <stddef.h>
+
 typedef struct _tagDOUBLELINKLISTNODE DOUBLELINKLISTNODE, *LPDOUBLELINKLISTNODE;
 typedef struct _tagDOUBLELINKLIST DOUBLELINKLIST, *LPDOUBLELINKLIST;
 typedef int (*DOUBLELINKLISTSORTFUNC)(const void *, size_t, const void *, size_t);
@@ -27,8 +29,9 @@ struct _tagDOUBLELINKLIST {
 
 void DoubleLinkList_Init(LPDOUBLELINKLIST pDoubleLinkList, DOUBLELINKLISTSORTFUNC pfnSort);
 LPDOUBLELINKLISTNODE DoubleLinkList_CreateNode(void);
-void DoubleLinkList_AppendBack(LPDOUBLELINKLIST pDoubleLinkList, const void* pValue, size_t valueSize, BOOL bSeek);
-void DoubleLinkList_AppendFront(LPDOUBLELINKLIST pDoubleLinkList, const void* pValue, size_t valueSize, BOOL bSeek);
+void DoubleLinkList_AppendBack(LPDOUBLELINKLIST pDoubleLinkList, const void* pValue, size_t valueSize, int bSeek);
+void DoubleLinkList_AppendFront(LPDOUBLELINKLIST pDoubleLinkList, const void* pValue, size_t valueSize, int bSeek);
 void DoubleLinkList_Sort(LPDOUBLELINKLIST pDoubleLinkList);
+void DoubleLinkList_Free(LPDOUBLELINKLIST pDoubleLinkList);
 
 #endif /* PANIVIEW_DLNKLIST_H */
@@ -0,0 +1,195 @@
+#include "filemap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef UNIT_TESTING
+extern void* _test_malloc(const size_t size, const char* file, const int line);
+
+#define malloc(size) _test_malloc(size, __FILE__, __LINE__)
+
+extern void _test_free(void* const ptr, const char* file, const int line);
+
+#define free(ptr) _test_free(ptr, __FILE__, __LINE__)
+#endif
+
+#ifdef _WIN32
+
+/* Largest single ReadFile when copying a file */
+#define FILEMAP_READ_CHUNK (16u << 20)
+
+/* Mapped pages of removable, network and optical media may fail to come in */
+static int FileMap_IsLocalFixed(const wchar_t* pszPath)
+{
+  WCHAR szVolume[MAX_PATH];
+  if (!GetVolumePathNameW(pszPath, szVolume, MAX_PATH)) {
+    return 0;
+  }
+
+  return GetDriveTypeW(szVolume) == DRIVE_FIXED;
+}
+
+/* Reads the whole file, which the caller closes, into a heap copy */
+static int FileMap_Copy(LPFILEMAP pMap, HANDLE hFile, size_t size)
+{
+  unsigned char* pData = (unsigned char*)malloc(size);
+  if (!pData) {
+    return FILEMAP_ERROR_TOO_LARGE;
+  }
+
+  for (size_t offset = 0; offset < size;) {
+    DWORD cbRead = 0;
+    DWORD cbChunk = (DWORD)(size - offset < FILEMAP_READ_CHUNK ? size - offset : FILEMAP_READ_CHUNK);
+    if (!ReadFile(hFile, pData + offset, cbChunk, &cbRead, NULL) || !cbRead) {
+      free(pData);
+      return FILEMAP_ERROR_IO;
+    }
+    offset += cbRead;
+  }
+
+  pMap->pData = pData;
+  pMap->size = size;
+  pMap->bCopied = 1;
+  return FILEMAP_OK;
+}
+
+/* The view keeps the file and the mapping object alive; both handles go at once */
+int FileMap_OpenW(LPFILEMAP pMap, const wchar_t* pszPath)
+{
+  memset(pMap, 0, sizeof(FILEMAP));
+
+  HANDLE hFile = CreateFileW(pszPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE) {
+    return FILEMAP_ERROR_IO;
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(hFile, &size)) {
+    CloseHandle(hFile);
+    return FILEMAP_ERROR_IO;
+  }
+
+  if ((uint64_t)size.QuadPart > SIZE_MAX) {
+    CloseHandle(hFile);
+    return FILEMAP_ERROR_TOO_LARGE;
+  }
+
+  /* Empty files cannot be mapped, nor need to be */
+  if (!size.QuadPart) {
+    CloseHandle(hFile);
+    return FILEMAP_OK;
+  }
+
+  if (!FileMap_IsLocalFixed(pszPath)) {
+    int status = FileMap_Copy(pMap, hFile, (size_t)size.QuadPart);
+    CloseHandle(hFile);
+    return status;
+  }
+
+  HANDLE hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(hFile);
+  if (!hMapping) {
+    return FILEMAP_ERROR_IO;
+  }
+
+  const void* pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(hMapping);
+  if (!pView) {
+    return GetLastError() == ERROR_NOT_ENOUGH_MEMORY ? FILEMAP_ERROR_TOO_LARGE : FILEMAP_ERROR_IO;
+  }
+
+  pMap->pData = (const unsigned char*)pView;
+  pMap->size = (size_t)size.QuadPart;
+  return FILEMAP_OK;
+}
+
+int FileMap_Open(LPFILEMAP pMap, const char* pszPath)
+{
+  memset(pMap, 0, sizeof(FILEMAP));
+
+  int len = MultiByteToWideChar(CP_UTF8, 0, pszPath, -1, NULL, 0);
+  WCHAR* pszWide = len > 0 ? (WCHAR*)malloc((size_t)len * sizeof(WCHAR)) : NULL;
+  if (!pszWide) {
+    return FILEMAP_ERROR_IO;
+  }
+
+  MultiByteToWideChar(CP_UTF8, 0, pszPath, -1, pszWide, len);
+  int status = FileMap_OpenW(pMap, pszWide);
+  free(pszWide);
+
+  return status;
+}
+
+void FileMap_Close(LPFILEMAP pMap)
+{
+  if (pMap->bCopied) {
+    free((void*)pMap->pData);
+  }
+  else if (pMap->pData) {
+    UnmapViewOfFile(pMap->pData);
+  }
+
+  memset(pMap, 0, sizeof(FILEMAP));
+}
+
+#else
+
+/* The mapping keeps the file referenced; the descriptor is not needed past mmap */
+int FileMap_Open(LPFILEMAP pMap, const char* pszPath)
+{
+  memset(pMap, 0, sizeof(FILEMAP));
+
+  int fd = open(pszPath, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return FILEMAP_ERROR_IO;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return FILEMAP_ERROR_IO;
+  }
+
+  if ((uint64_t)st.st_size > SIZE_MAX) {
+    close(fd);
+    return FILEMAP_ERROR_TOO_LARGE;
+  }
+
+  /* Empty files cannot be mapped, nor need to be */
+  if (!st.st_size) {
+    close(fd);
+    return FILEMAP_OK;
+  }
+
+  void* pView = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (pView == MAP_FAILED) {
+    return FILEMAP_ERROR_IO;
+  }
+
+  pMap->pData = (const unsigned char*)pView;
+  pMap->size = (size_t)st.st_size;
+  return FILEMAP_OK;
+}
+
+void FileMap_Close(LPFILEMAP pMap)
+{
+  if (pMap->pData) {
+    munmap((void*)pMap->pData, pMap->size);
+  }
+
+  memset(pMap, 0, sizeof(FILEMAP));
+}
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * filemap.h
+ *
+ * Read-only memory mappings of whole files
+ *
+ * A file is opened and mapped once, and every reader of it, the format
+ * probe, the decoders and WIC through a memory stream alike, works on the
+ * same span of bytes. Pages come in from the page cache as they are first
+ * touched, without a copy through stdio buffers, and uncompressed pixels
+ * can be used where they lie. While mapped, the file may be read, renamed
+ * or deleted by others on Windows, but not written to; elsewhere it must
+ * not be truncated meanwhile.
+ *
+ * A page of a mapped file that can not be read in faults the reader rather
+ * than failing a call, as it happens when a network share drops or a disk
+ * is pulled. On Windows, files off local fixed drives are read into memory
+ * at once instead, so such errors surface from FileMap_OpenW.
+ */
+
+#ifndef PANIVIEW_FILEMAP_H
+#define PANIVIEW_FILEMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <wchar.h>
+#endif
+
+enum {
+  FILEMAP_OK = 0,
+  FILEMAP_ERROR_IO = -1,
+  FILEMAP_ERROR_TOO_LARGE = -2,
+};
+
+typedef struct _tagFILEMAP FILEMAP, *LPFILEMAP;
+
+struct _tagFILEMAP {
+  const unsigned char* pData;   /* NULL for an empty file */
+  size_t size;
+#ifdef _WIN32
+  int bCopied;                  /* pData is a heap copy, not a view */
+#endif
+};
+
+/* Map the file at pszPath, in UTF-8 */
+int FileMap_Open(LPFILEMAP pMap, const char* pszPath);
+#ifdef _WIN32
+int FileMap_OpenW(LPFILEMAP pMap, const wchar_t* pszPath);
+#endif
+void FileMap_Close(LPFILEMAP pMap);
+
+#endif /* PANIVIEW_FILEMAP_H */
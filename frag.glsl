@@ -5,7 +5,11 @@ in vec2 uv;
 
 uniform sampler2D myTextureSampler;
 
+/* Gray images are uploaded as a single red channel */
+uniform bool grayscale;
+
 void main()
 {
-    color = texture(myTextureSampler, uv);
+    vec4 texel = texture(myTextureSampler, uv);
+    color = grayscale ? vec4(texel.rrr, 1.0) : texel;
 }
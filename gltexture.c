@@ -0,0 +1,81 @@
+#include "gltexture.h"
+#include "pixconv.h"
+
+#include <limits.h>
+#include <string.h>
+
+int GLTexture_GetFormat(int nPixFmt, LPGLTEXFORMAT pFormat)
+{
+  switch (nPixFmt) {
+  case PIXFMT_PBGRA32:
+    pFormat->internalFormat = GL_RGBA8;
+    pFormat->format = GL_BGRA;
+    pFormat->type = GL_UNSIGNED_BYTE;
+    pFormat->nBytesPerPixel = 4;
+    pFormat->bGray = 0;
+    return GLTEXTURE_OK;
+  case PIXFMT_GRAY8:
+    pFormat->internalFormat = GL_R8;
+    pFormat->format = GL_RED;
+    pFormat->type = GL_UNSIGNED_BYTE;
+    pFormat->nBytesPerPixel = 1;
+    pFormat->bGray = 1;
+    return GLTEXTURE_OK;
+  case PIXFMT_GRAY16:
+    pFormat->internalFormat = GL_R16;
+    pFormat->format = GL_RED;
+    pFormat->type = GL_UNSIGNED_SHORT;
+    pFormat->nBytesPerPixel = 2;
+    pFormat->bGray = 1;
+    return GLTEXTURE_OK;
+  }
+
+  return GLTEXTURE_ERROR_UNSUPPORTED;
+}
+
+int GLTexture_Upload(const void* pPixels, size_t width, size_t height, size_t stride, int nPixFmt,
+    LPGLTEXLEVEL pLevel, size_t* pcbUploaded)
+{
+  GLTEXFORMAT format;
+  if (GLTexture_GetFormat(nPixFmt, &format) != GLTEXTURE_OK ||
+      width > INT_MAX || height > INT_MAX || stride % format.nBytesPerPixel ||
+      stride / format.nBytesPerPixel < width || stride / format.nBytesPerPixel > INT_MAX) {
+    return GLTEXTURE_ERROR_UNSUPPORTED;
+  }
+
+  /* Rows are as long as the stride says, no implicit padding */
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(stride / format.nBytesPerPixel));
+
+  int bSameLevel = pLevel && pLevel->width == width && pLevel->height == height && pLevel->nPixFmt == nPixFmt;
+  if (bSameLevel) {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, (GLsizei)width, (GLsizei)height, format.format, format.type, pPixels);
+  }
+  else {
+    glTexImage2D(GL_TEXTURE_2D, 0, format.internalFormat, (GLsizei)width, (GLsizei)height, 0,
+        format.format, format.type, pPixels);
+  }
+
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  if (glGetError() != GL_NO_ERROR) {
+    /* Whatever the level holds now, it is not to be trusted */
+    if (pLevel) {
+      memset(pLevel, 0, sizeof(*pLevel));
+    }
+    return GLTEXTURE_ERROR_GL;
+  }
+
+  if (pLevel && !bSameLevel) {
+    pLevel->width = width;
+    pLevel->height = height;
+    pLevel->nPixFmt = nPixFmt;
+  }
+
+  if (pcbUploaded) {
+    *pcbUploaded = width * height * format.nBytesPerPixel;
+  }
+
+  return GLTEXTURE_OK;
+}
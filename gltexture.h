@@ -0,0 +1,67 @@
+/*
+ * gltexture.h
+ *
+ * Pixel buffer to OpenGL texture uploads
+ *
+ * Picks the texture layout for a pixconv format and uploads a strided
+ * image into the texture bound to GL_TEXTURE_2D. Gray images stay one
+ * channel, GL_R8 or GL_R16, a quarter or half of the bytes of their BGRA
+ * expansion; the fragment shader turns them back into gray RGB. A texture
+ * that already holds an image of the same size and format keeps its
+ * storage and only has its pixels replaced. Needs a current OpenGL 3.x
+ * context; on Windows the entry points come from GLEW.
+ */
+
+#ifndef PANIVIEW_GLTEXTURE_H
+#define PANIVIEW_GLTEXTURE_H
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <GL/glew.h>
+#else
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+enum {
+  GLTEXTURE_OK = 0,
+  GLTEXTURE_ERROR_UNSUPPORTED = -1,
+  GLTEXTURE_ERROR_GL = -2,
+};
+
+typedef struct _tagGLTEXFORMAT GLTEXFORMAT, *LPGLTEXFORMAT;
+typedef struct _tagGLTEXLEVEL GLTEXLEVEL, *LPGLTEXLEVEL;
+
+struct _tagGLTEXFORMAT {
+  GLint internalFormat;
+  GLenum format;
+  GLenum type;
+  size_t nBytesPerPixel;
+  int bGray;                  /* One channel, expanded by the shader */
+};
+
+/* What level 0 of a texture was last defined as; all zero for none */
+struct _tagGLTEXLEVEL {
+  size_t width;
+  size_t height;
+  int nPixFmt;
+};
+
+int GLTexture_GetFormat(int nPixFmt, LPGLTEXFORMAT pFormat);
+
+/*
+ * Fill level 0 of the bound texture from `height` rows `stride` bytes
+ * apart, a multiple of the pixel size. With a pixel unpack buffer bound,
+ * pPixels is an offset into it. When *pLevel matches, the storage is kept
+ * and only the pixels replaced; otherwise the level is redefined and
+ * *pLevel updated. pLevel may be NULL to always redefine. Reports the
+ * bytes handed to OpenGL in *pcbUploaded when it is not NULL.
+ */
+int GLTexture_Upload(const void* pPixels, size_t width, size_t height, size_t stride, int nPixFmt,
+    LPGLTEXLEVEL pLevel, size_t* pcbUploaded);
+
+#endif /* PANIVIEW_GLTEXTURE_H */
@@ -0,0 +1,355 @@
+#include "gltiles.h"
+#include "pixconv.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef UNIT_TESTING
+extern void* _test_malloc(const size_t size, const char* file, const int line);
+
+#define malloc(size) _test_malloc(size, __FILE__, __LINE__)
+
+extern void* _test_calloc(const size_t num, const size_t size, const char* file,
+  const int line);
+
+#define calloc(num, size) _test_calloc(num, size, __FILE__, __LINE__)
+
+extern void* _test_realloc(void* const ptr, const size_t size, const char* file,
+  const int line);
+
+#define realloc(ptr, size) _test_realloc(ptr, size, __FILE__, __LINE__)
+
+extern void _test_free(void* const ptr, const char* file, const int line);
+
+#define free(ptr) _test_free(ptr, __FILE__, __LINE__)
+#endif
+
+/* Level pixels the texture of a tile holds: the tile and its border, within the level */
+static void GLTiles_GetTextureRect(const GLTILES* pTiles, const TILE* pTile, size_t* pLeft, size_t* pTop,
+    size_t* pRight, size_t* pBottom)
+{
+  size_t levelWidth = 0;
+  size_t levelHeight = 0;
+  TileMgr_GetLevelSize(&pTiles->tileMgr, pTile->level, &levelWidth, &levelHeight);
+
+  *pLeft = pTile->x > GLTILES_BORDER ? pTile->x - GLTILES_BORDER : 0;
+  *pTop = pTile->y > GLTILES_BORDER ? pTile->y - GLTILES_BORDER : 0;
+  *pRight = pTile->x + pTile->width + GLTILES_BORDER;
+  *pRight = *pRight < levelWidth ? *pRight : levelWidth;
+  *pBottom = pTile->y + pTile->height + GLTILES_BORDER;
+  *pBottom = *pBottom < levelHeight ? *pBottom : levelHeight;
+}
+
+/*
+ * Average the level 0 blocks under a rectangle of a coarser level. The
+ * blocks along the right and bottom edges of the image are partial.
+ */
+static void GLTiles_BoxFilter(const GLTILES* pTiles, size_t nLevel, size_t left, size_t top, size_t right,
+    size_t bottom, unsigned char* pDst)
+{
+  size_t width = pTiles->tileMgr.width;
+  size_t height = pTiles->tileMgr.height;
+  size_t nFactor = (size_t)1 << nLevel;
+  int bWide = pTiles->nPixFmt == PIXFMT_GRAY16;
+  size_t nChannels = bWide ? 1 : pTiles->format.nBytesPerPixel;
+
+  for (size_t y = top; y < bottom; ++y) {
+    size_t srcTop = y * nFactor;
+    size_t srcBottom = srcTop + nFactor < height ? srcTop + nFactor : height;
+
+    for (size_t x = left; x < right; ++x) {
+      size_t srcLeft = x * nFactor;
+      size_t srcRight = srcLeft + nFactor < width ? srcLeft + nFactor : width;
+      uint64_t sums[4] = { 0 };
+
+      for (size_t sy = srcTop; sy < srcBottom; ++sy) {
+        const unsigned char* pRow = pTiles->pPixels + sy * pTiles->stride;
+        if (bWide) {
+          const uint16_t* pSample = (const uint16_t*)pRow;
+          for (size_t sx = srcLeft; sx < srcRight; ++sx) {
+            sums[0] += pSample[sx];
+          }
+        }
+        else {
+          for (size_t sx = srcLeft; sx < srcRight; ++sx) {
+            for (size_t c = 0; c < nChannels; ++c) {
+              sums[c] += pRow[sx * nChannels + c];
+            }
+          }
+        }
+      }
+
+      uint64_t count = (uint64_t)(srcBottom - srcTop) * (srcRight - srcLeft);
+      if (bWide) {
+        ((uint16_t*)pDst)[0] = (uint16_t)((sums[0] + count / 2) / count);
+      }
+      else {
+        for (size_t c = 0; c < nChannels; ++c) {
+          pDst[c] = (unsigned char)((sums[c] + count / 2) / count);
+        }
+      }
+
+      pDst += pTiles->format.nBytesPerPixel;
+    }
+  }
+}
+
+static unsigned char* GLTiles_GetScratch(LPGLTILES pTiles, size_t cbTile)
+{
+  if (pTiles->cbScratch < cbTile) {
+    unsigned char* pScratch = (unsigned char*)realloc(pTiles->pScratch, cbTile);
+    if (!pScratch) {
+      return NULL;
+    }
+    pTiles->pScratch = pScratch;
+    pTiles->cbScratch = cbTile;
+  }
+
+  return pTiles->pScratch;
+}
+
+static int GLTiles_LoadTile(LPTILE pTile, void* pUserData)
+{
+  LPGLTILES pTiles = (LPGLTILES)pUserData;
+  uint64_t start = PerfCounter_Now();
+
+  size_t left, top, right, bottom;
+  GLTiles_GetTextureRect(pTiles, pTile, &left, &top, &right, &bottom);
+  size_t texWidth = right - left;
+  size_t texHeight = bottom - top;
+  size_t nBytesPerPixel = pTiles->format.nBytesPerPixel;
+
+  const unsigned char* pSrc = NULL;
+  size_t srcStride = 0;
+  const PYRAMID* pPyramid = pTiles->pPyramid;
+  if (pTiles->pfnRead) {
+    srcStride = texWidth * nBytesPerPixel;
+    pSrc = GLTiles_GetScratch(pTiles, srcStride * texHeight);
+    if (!pSrc) {
+      pTiles->status = GLTILES_ERROR_MEMORY;
+      return 0;
+    }
+
+    if (!pTiles->pfnRead(pTiles->pReadData, pTile->level, left, top, right, bottom, pTiles->pScratch,
+        srcStride)) {
+      if (pTiles->status == GLTILES_OK) {
+        pTiles->status = GLTILES_ERROR_READ;
+      }
+      return 0;
+    }
+  }
+  else if (pTile->level == 0) {
+    pSrc = pTiles->pPixels + top * pTiles->stride + left * nBytesPerPixel;
+    srcStride = pTiles->stride;
+  }
+  else if (pPyramid && pTile->level < pPyramid->nLevels) {
+    const PIXBUF* pLevel = pPyramid->pLevels[pTile->level];
+    pSrc = PixBuf_GetRow(pLevel, top) + left * nBytesPerPixel;
+    srcStride = pLevel->stride;
+  }
+  else {
+    if (!GLTiles_GetScratch(pTiles, texWidth * texHeight * nBytesPerPixel)) {
+      pTiles->status = GLTILES_ERROR_MEMORY;
+      return 0;
+    }
+
+    GLTiles_BoxFilter(pTiles, pTile->level, left, top, right, bottom, pTiles->pScratch);
+    pSrc = pTiles->pScratch;
+    srcStride = texWidth * nBytesPerPixel;
+  }
+
+  GLuint textureId = 0;
+  glGenTextures(1, &textureId);
+  glBindTexture(GL_TEXTURE_2D, textureId);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  int status = GLTexture_Upload(pSrc, texWidth, texHeight, srcStride, pTiles->nPixFmt, NULL, NULL);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  if (status != GLTEXTURE_OK) {
+    glDeleteTextures(1, &textureId);
+    if (pTiles->status == GLTILES_OK) {
+      pTiles->status = GLTILES_ERROR_GL;
+    }
+    return 0;
+  }
+
+  pTile->pHandle = (void*)(uintptr_t)textureId;
+  pTile->cost = texWidth * texHeight * nBytesPerPixel;
+
+  PerfCounter_AddSince(&pTiles->loadCounter, start);
+  return 1;
+}
+
+static void GLTiles_FreeTile(LPTILE pTile, void* pUserData)
+{
+  (void)pUserData;
+
+  GLuint textureId = (GLuint)(uintptr_t)pTile->pHandle;
+  glDeleteTextures(1, &textureId);
+}
+
+int GLTiles_Init(LPGLTILES pTiles, const void* pPixels, size_t width, size_t height, size_t stride,
+    int nPixFmt, const PYRAMID* pPyramid, size_t tileSize, size_t budget)
+{
+  memset(pTiles, 0, sizeof(GLTILES));
+
+  if (GLTexture_GetFormat(nPixFmt, &pTiles->format) != GLTEXTURE_OK ||
+      stride / pTiles->format.nBytesPerPixel < width) {
+    return GLTILES_ERROR_INVALID;
+  }
+
+  /* Levels are only of use when they are the same image in the same format */
+  if (pPyramid && (!pPyramid->nLevels || pPyramid->pLevels[0]->width != width ||
+      pPyramid->pLevels[0]->height != height || pPyramid->pLevels[0]->nFormat != nPixFmt)) {
+    pPyramid = NULL;
+  }
+
+  if (TileMgr_Init(&pTiles->tileMgr, width, height, tileSize, budget, GLTiles_LoadTile, GLTiles_FreeTile,
+      pTiles) != TILEMGR_OK) {
+    return GLTILES_ERROR_INVALID;
+  }
+
+  pTiles->pPixels = (const unsigned char*)pPixels;
+  pTiles->pPyramid = pPyramid;
+  pTiles->stride = stride;
+  pTiles->nPixFmt = nPixFmt;
+
+  return GLTILES_OK;
+}
+
+int GLTiles_InitReader(LPGLTILES pTiles, size_t width, size_t height, int nPixFmt, GLTILESREADFUNC pfnRead,
+    void* pUserData, size_t tileSize, size_t budget)
+{
+  GLTEXFORMAT format;
+  if (!pfnRead || GLTexture_GetFormat(nPixFmt, &format) != GLTEXTURE_OK) {
+    memset(pTiles, 0, sizeof(GLTILES));
+    return GLTILES_ERROR_INVALID;
+  }
+
+  int status = GLTiles_Init(pTiles, NULL, width, height, width * format.nBytesPerPixel, nPixFmt, NULL,
+      tileSize, budget);
+  if (status == GLTILES_OK) {
+    pTiles->pfnRead = pfnRead;
+    pTiles->pReadData = pUserData;
+  }
+
+  return status;
+}
+
+void GLTiles_Cleanup(LPGLTILES pTiles)
+{
+  TileMgr_Cleanup(&pTiles->tileMgr);
+
+  if (pTiles->vertexBuffer) {
+    glDeleteBuffers(1, &pTiles->vertexBuffer);
+  }
+  if (pTiles->vertexArray) {
+    glDeleteVertexArrays(1, &pTiles->vertexArray);
+  }
+
+  free(pTiles->pScratch);
+  free(pTiles->ppVisible);
+  memset(pTiles, 0, sizeof(GLTILES));
+}
+
+int GLTiles_Update(LPGLTILES pTiles, const TILEVIEW* pView)
+{
+  pTiles->status = GLTILES_OK;
+  pTiles->nVisible = 0;
+
+  size_t nTiles = 0;
+  int status = TileMgr_Update(&pTiles->tileMgr, pView, pTiles->ppVisible, pTiles->nMaxVisible, &nTiles);
+  if (status == TILEMGR_OK && nTiles > pTiles->nMaxVisible) {
+    /* Everything in view is resident by now, the second pass only collects */
+    LPTILE* ppVisible = (LPTILE*)realloc(pTiles->ppVisible, nTiles * sizeof(LPTILE));
+    if (!ppVisible) {
+      return GLTILES_ERROR_MEMORY;
+    }
+    pTiles->ppVisible = ppVisible;
+    pTiles->nMaxVisible = nTiles;
+
+    status = TileMgr_Update(&pTiles->tileMgr, pView, pTiles->ppVisible, pTiles->nMaxVisible, &nTiles);
+  }
+
+  if (status != TILEMGR_OK) {
+    return GLTILES_ERROR_MEMORY;
+  }
+
+  pTiles->nVisible = nTiles < pTiles->nMaxVisible ? nTiles : pTiles->nMaxVisible;
+  return pTiles->status;
+}
+
+void GLTiles_Draw(LPGLTILES pTiles, GLint transformLocation, const GLfloat imageToClip[16])
+{
+  if (!pTiles->nVisible) {
+    return;
+  }
+
+  /* x, y, z, u, v for the four corners of every tile, as a triangle strip */
+  GLfloat* pVertices = (GLfloat*)malloc(pTiles->nVisible * 4 * 5 * sizeof(GLfloat));
+  if (!pVertices) {
+    return;
+  }
+
+  size_t width = pTiles->tileMgr.width;
+  size_t height = pTiles->tileMgr.height;
+  for (size_t i = 0; i < pTiles->nVisible; ++i) {
+    const TILE* pTile = pTiles->ppVisible[i];
+
+    size_t left, top, right, bottom;
+    GLTiles_GetTextureRect(pTiles, pTile, &left, &top, &right, &bottom);
+
+    /* Where the tile lands in level 0, the last pixels of a level possibly partial */
+    size_t nFactor = (size_t)1 << pTile->level;
+    GLfloat x0 = (GLfloat)(pTile->x * nFactor);
+    GLfloat y0 = (GLfloat)(pTile->y * nFactor);
+    GLfloat x1 = (GLfloat)((pTile->x + pTile->width) * nFactor < width ? (pTile->x + pTile->width) * nFactor : width);
+    GLfloat y1 = (GLfloat)((pTile->y + pTile->height) * nFactor < height ? (pTile->y + pTile->height) * nFactor : height);
+
+    GLfloat u0 = (GLfloat)(pTile->x - left) / (GLfloat)(right - left);
+    GLfloat v0 = (GLfloat)(pTile->y - top) / (GLfloat)(bottom - top);
+    GLfloat u1 = (GLfloat)(pTile->x + pTile->width - left) / (GLfloat)(right - left);
+    GLfloat v1 = (GLfloat)(pTile->y + pTile->height - top) / (GLfloat)(bottom - top);
+
+    const GLfloat corners[4][5] = {
+      { x0, y0, 0.0f, u0, v0 },
+      { x1, y0, 0.0f, u1, v0 },
+      { x0, y1, 0.0f, u0, v1 },
+      { x1, y1, 0.0f, u1, v1 },
+    };
+    memcpy(pVertices + i * 4 * 5, corners, sizeof(corners));
+  }
+
+  if (!pTiles->vertexArray) {
+    glGenVertexArrays(1, &pTiles->vertexArray);
+    glGenBuffers(1, &pTiles->vertexBuffer);
+  }
+
+  glBindVertexArray(pTiles->vertexArray);
+  glBindBuffer(GL_ARRAY_BUFFER, pTiles->vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(pTiles->nVisible * 4 * 5 * sizeof(GLfloat)), pVertices,
+      GL_STREAM_DRAW);
+  free(pVertices);
+
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), NULL);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (const void*)(3 * sizeof(GLfloat)));
+
+  glUniformMatrix4fv(transformLocation, 1, GL_FALSE, imageToClip);
+
+  for (size_t i = 0; i < pTiles->nVisible; ++i) {
+    glBindTexture(GL_TEXTURE_2D, (GLuint)(uintptr_t)pTiles->ppVisible[i]->pHandle);
+    glDrawArrays(GL_TRIANGLE_STRIP, (GLint)(i * 4), 4);
+  }
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glDisableVertexAttribArray(0);
+  glDisableVertexAttribArray(1);
+  glBindVertexArray(0);
+}
@@ -0,0 +1,84 @@
+/*
+ * gltiles.h
+ *
+ * Tiled OpenGL textures for images of any size
+ *
+ * Wraps a tile manager around a decoded image: every resident tile is a
+ * texture of its own, so images beyond GL_MAX_TEXTURE_SIZE can be shown
+ * and only the tiles in view, at the level the zoom asks for, take video
+ * memory. A tile texture reaches GLTILES_BORDER pixels into its
+ * neighbours, so linear filtering leaves no seams. Tiles are uploaded
+ * straight from the image or, for coarser levels, from its pyramid when
+ * one was built that far; otherwise they are box filtered from the image
+ * first. The image memory and the pyramid are borrowed and must outlive
+ * the tiles. Images never decoded in full are read a tile at a time, at
+ * the level it shows, through a callback instead.
+ */
+
+#ifndef PANIVIEW_GLTILES_H
+#define PANIVIEW_GLTILES_H
+
+#include "gltexture.h"
+#include "perfcounter.h"
+#include "pyramid.h"
+#include "tilemgr.h"
+
+#include <stddef.h>
+
+#define GLTILES_TILE_SIZE 512
+#define GLTILES_BORDER 1
+
+enum {
+  GLTILES_OK = 0,
+  GLTILES_ERROR_MEMORY = -1,
+  GLTILES_ERROR_INVALID = -2,
+  GLTILES_ERROR_GL = -3,
+  GLTILES_ERROR_READ = -4,
+};
+
+typedef struct _tagGLTILES GLTILES, *LPGLTILES;
+
+/*
+ * Read callback. Stores the pixels of level nLevel from left, top up to
+ * right, bottom into pDest. Returns nonzero on success.
+ */
+typedef int (*GLTILESREADFUNC)(void* pUserData, size_t nLevel, size_t left, size_t top, size_t right,
+    size_t bottom, void* pDest, size_t destStride);
+
+struct _tagGLTILES {
+  TILEMGR tileMgr;
+  const unsigned char* pPixels;   /* Level 0, borrowed */
+  const PYRAMID* pPyramid;        /* Coarser levels, borrowed, may be NULL */
+  GLTILESREADFUNC pfnRead;        /* Every level, instead of the pixels */
+  void* pReadData;
+  size_t stride;
+  int nPixFmt;
+  GLTEXFORMAT format;
+  unsigned char* pScratch;        /* A coarser level tile, box filtered, or one read */
+  size_t cbScratch;
+  LPTILE* ppVisible;
+  size_t nVisible;
+  size_t nMaxVisible;
+  GLuint vertexArray;
+  GLuint vertexBuffer;
+  int status;                     /* First upload failure since the last update */
+  PERFCOUNTER loadCounter;
+};
+
+int GLTiles_Init(LPGLTILES pTiles, const void* pPixels, size_t width, size_t height, size_t stride,
+    int nPixFmt, const PYRAMID* pPyramid, size_t tileSize, size_t budget);
+int GLTiles_InitReader(LPGLTILES pTiles, size_t width, size_t height, int nPixFmt, GLTILESREADFUNC pfnRead,
+    void* pUserData, size_t tileSize, size_t budget);
+void GLTiles_Cleanup(LPGLTILES pTiles);
+
+/* Make the tiles of the view resident, evicting others down to the budget */
+int GLTiles_Update(LPGLTILES pTiles, const TILEVIEW* pView);
+
+/*
+ * Draw the tiles of the last update with the bound program: a vec3 position
+ * at location 0, a vec2 texture coordinate at location 1, and a transform
+ * uniform taking level 0 image pixels to clip space.
+ */
+void GLTiles_Draw(LPGLTILES pTiles, GLint transformLocation, const GLfloat imageToClip[16]);
+
+#endif /* PANIVIEW_GLTILES_H */
@@ -0,0 +1,193 @@
+#include "glupload.h"
+#include "pixconv.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#define GLUPLOAD_PERSISTENT_FLAGS (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+
+/* Fences wait in slices so a lost context cannot hang the caller for good */
+#define GLUPLOAD_WAIT_TIMEOUT_NS 100000000
+
+static int GLUpload_HasExtension(const char* pszName)
+{
+  GLint nExtensions = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &nExtensions);
+  for (GLint i = 0; i < nExtensions; ++i) {
+    const char* pszExtension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+    if (pszExtension && !strcmp(pszExtension, pszName)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int GLUpload_IsPersistentSupported(void)
+{
+  GLint major = 0;
+  GLint minor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  if (major > 4 || (major == 4 && minor >= 4)) {
+    return 1;
+  }
+
+  /* Fences are core from 3.2 */
+  int bSync = major > 3 || (major == 3 && minor >= 2) || GLUpload_HasExtension("GL_ARB_sync");
+  return bSync && GLUpload_HasExtension("GL_ARB_buffer_storage");
+}
+
+int GLUpload_Init(LPGLUPLOADRING pRing, int bPersistent)
+{
+  memset(pRing, 0, sizeof(*pRing));
+  pRing->bPersistent = bPersistent && GLUpload_IsPersistentSupported();
+
+  for (size_t i = 0; i < GLUPLOAD_RING_SIZE; ++i) {
+    glGenBuffers(1, &pRing->slots[i].bufferId);
+  }
+
+  return glGetError() == GL_NO_ERROR ? GLUPLOAD_OK : GLUPLOAD_ERROR_GL;
+}
+
+void GLUpload_Cleanup(LPGLUPLOADRING pRing)
+{
+  for (size_t i = 0; i < GLUPLOAD_RING_SIZE; ++i) {
+    LPGLUPLOADSLOT pSlot = &pRing->slots[i];
+    if (pSlot->fence) {
+      glDeleteSync(pSlot->fence);
+    }
+
+    /* Deleting a buffer unmaps it */
+    if (pSlot->bufferId) {
+      glDeleteBuffers(1, &pSlot->bufferId);
+    }
+  }
+
+  memset(pRing, 0, sizeof(*pRing));
+}
+
+static void GLUpload_WaitSlot(LPGLUPLOADRING pRing, LPGLUPLOADSLOT pSlot)
+{
+  if (!pSlot->fence) {
+    return;
+  }
+
+  uint64_t start = PerfCounter_Now();
+  GLenum result = glClientWaitSync(pSlot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+  if (result == GL_TIMEOUT_EXPIRED) {
+    do {
+      result = glClientWaitSync(pSlot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLUPLOAD_WAIT_TIMEOUT_NS);
+    } while (result == GL_TIMEOUT_EXPIRED);
+
+    PerfCounter_AddSince(&pRing->waitCounter, start);
+  }
+
+  glDeleteSync(pSlot->fence);
+  pSlot->fence = 0;
+}
+
+void* GLUpload_Map(LPGLUPLOADRING pRing, size_t cbSize)
+{
+  if (pRing->bMapped || !cbSize || cbSize > PTRDIFF_MAX) {
+    return NULL;
+  }
+
+  LPGLUPLOADSLOT pSlot = &pRing->slots[pRing->nNext];
+  GLUpload_WaitSlot(pRing, pSlot);
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pSlot->bufferId);
+
+  if (pRing->bPersistent) {
+    if (pSlot->cbSize < cbSize) {
+      /* Storage is immutable, growing takes a new buffer */
+      glDeleteBuffers(1, &pSlot->bufferId);
+      glGenBuffers(1, &pSlot->bufferId);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pSlot->bufferId);
+      glBufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)cbSize, NULL, GLUPLOAD_PERSISTENT_FLAGS);
+      pSlot->pMapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)cbSize,
+          GLUPLOAD_PERSISTENT_FLAGS);
+      pSlot->cbSize = pSlot->pMapped ? cbSize : 0;
+    }
+  }
+  else {
+    /* Orphaned: if the old storage is still being read, the driver hands out new */
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)cbSize, NULL, GL_STREAM_DRAW);
+    pSlot->pMapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)cbSize,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    pSlot->cbSize = pSlot->pMapped ? cbSize : 0;
+  }
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  if (!pSlot->pMapped) {
+    glGetError();
+    return NULL;
+  }
+
+  pRing->bMapped = 1;
+  return pSlot->pMapped;
+}
+
+static void GLUpload_Release(LPGLUPLOADRING pRing, LPGLUPLOADSLOT pSlot)
+{
+  if (!pRing->bPersistent) {
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    pSlot->pMapped = NULL;
+  }
+
+  pRing->bMapped = 0;
+}
+
+int GLUpload_Commit(LPGLUPLOADRING pRing, size_t width, size_t height, size_t stride, int nPixFmt,
+    LPGLTEXLEVEL pLevel, size_t* pcbUploaded)
+{
+  if (!pRing->bMapped) {
+    return GLUPLOAD_ERROR_INVALID;
+  }
+
+  uint64_t start = PerfCounter_Now();
+
+  LPGLUPLOADSLOT pSlot = &pRing->slots[pRing->nNext];
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pSlot->bufferId);
+  GLUpload_Release(pRing, pSlot);
+
+  /* The last row need not be padded out to the stride */
+  size_t rowSize = width * (size_t)PixConv_GetBytesPerPixel(nPixFmt);
+  if (!rowSize || !height || width > INT_MAX || stride < rowSize || rowSize > pSlot->cbSize ||
+      height - 1 > (pSlot->cbSize - rowSize) / stride) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return GLUPLOAD_ERROR_INVALID;
+  }
+
+  /* Sourced from the bound buffer, the pointer is an offset into it */
+  int status = GLTexture_Upload(NULL, width, height, stride, nPixFmt, pLevel, pcbUploaded);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  if (status != GLTEXTURE_OK) {
+    return status == GLTEXTURE_ERROR_GL ? GLUPLOAD_ERROR_GL : GLUPLOAD_ERROR_INVALID;
+  }
+
+  /* A persistent mapping must not be written again before the copy is done */
+  if (pRing->bPersistent) {
+    pSlot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  pRing->nNext = (pRing->nNext + 1) % GLUPLOAD_RING_SIZE;
+
+  PerfCounter_AddSince(&pRing->submitCounter, start);
+  return GLUPLOAD_OK;
+}
+
+void GLUpload_Cancel(LPGLUPLOADRING pRing)
+{
+  if (!pRing->bMapped) {
+    return;
+  }
+
+  LPGLUPLOADSLOT pSlot = &pRing->slots[pRing->nNext];
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pSlot->bufferId);
+  GLUpload_Release(pRing, pSlot);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
@@ -0,0 +1,76 @@
+/*
+ * glupload.h
+ *
+ * Streaming texture uploads through a ring of pixel unpack buffers
+ *
+ * Pixels are written straight into a mapped buffer object and the texture
+ * is then filled from it: the glTex(Sub)Image2D call returns at once and
+ * the copy into the texture runs on the driver's side while the caller
+ * moves on. A few buffers take turns, so the next image can be written
+ * while an earlier one is still being read. With OpenGL 4.4 or
+ * ARB_buffer_storage the buffers are mapped once, persistently, and each
+ * is guarded by a fence; otherwise a buffer is orphaned and mapped anew for
+ * every image. Needs a current OpenGL 3.x context.
+ */
+
+#ifndef PANIVIEW_GLUPLOAD_H
+#define PANIVIEW_GLUPLOAD_H
+
+#include "gltexture.h"
+#include "perfcounter.h"
+
+#include <stddef.h>
+
+#define GLUPLOAD_RING_SIZE 3
+
+enum {
+  GLUPLOAD_OK = 0,
+  GLUPLOAD_ERROR_MEMORY = -1,
+  GLUPLOAD_ERROR_INVALID = -2,
+  GLUPLOAD_ERROR_GL = -3,
+};
+
+typedef struct _tagGLUPLOADSLOT GLUPLOADSLOT, *LPGLUPLOADSLOT;
+typedef struct _tagGLUPLOADRING GLUPLOADRING, *LPGLUPLOADRING;
+
+struct _tagGLUPLOADSLOT {
+  GLuint bufferId;
+  size_t cbSize;
+  void* pMapped;              /* Kept while persistent, else only until committed */
+  GLsync fence;               /* Signalled once OpenGL is done reading */
+};
+
+struct _tagGLUPLOADRING {
+  GLUPLOADSLOT slots[GLUPLOAD_RING_SIZE];
+  size_t nNext;
+  int bPersistent;
+  int bMapped;                /* The next slot is handed out to the caller */
+  PERFCOUNTER waitCounter;    /* Blocked on a slot still being read */
+  PERFCOUNTER submitCounter;  /* Spent in GLUpload_Commit */
+};
+
+/* Whether the current context can map buffers persistently */
+int GLUpload_IsPersistentSupported(void);
+
+int GLUpload_Init(LPGLUPLOADRING pRing, int bPersistent);
+void GLUpload_Cleanup(LPGLUPLOADRING pRing);
+
+/*
+ * Hand out the next buffer, at least cbSize bytes, for the caller to write
+ * an image into. Waits if OpenGL still reads from it. NULL on failure or
+ * when a buffer is already handed out.
+ */
+void* GLUpload_Map(LPGLUPLOADRING pRing, size_t cbSize);
+
+/*
+ * Fill level 0 of the bound texture from the buffer handed out, laid out
+ * as for GLTexture_Upload. The buffer is given back whether it succeeds or
+ * not.
+ */
+int GLUpload_Commit(LPGLUPLOADRING pRing, size_t width, size_t height, size_t stride, int nPixFmt,
+    LPGLTEXLEVEL pLevel, size_t* pcbUploaded);
+
+/* Give the buffer handed out back unused */
+void GLUpload_Cancel(LPGLUPLOADRING pRing);
+
+#endif /* PANIVIEW_GLUPLOAD_H */
@@ -9,215 +9,412 @@ extern void* _test_calloc(const size_t num, const size_t size, const char* file,
   const int line);
 
 #define calloc(num, size) _test_calloc(num, size, __FILE__, __LINE__)
-#endif
 
-LPHASHMAPNODE HashMap_CreateNode(HASHMAPPAIR pair)
-{
-  LPHASHMAPNODE pNewNode = (LPHASHMAPNODE)malloc(sizeof(HASHMAPNODE));
+extern void* _test_realloc(void* const ptr, const size_t size, const char* file,
+  const int line);
 
-  pNewNode->pair = pair;
-  pNewNode->pParent = NULL;
-  pNewNode->pLeft = NULL;
-  pNewNode->pRight = NULL;
-  pNewNode->color = RBT_RED;  /* New nodes are always red */
+#define realloc(ptr, size) _test_realloc(ptr, size, __FILE__, __LINE__)
 
-  return pNewNode;
-}
+extern void _test_free(void* const ptr, const char* file, const int line);
 
-void HashMap_LeftRotate(LPHASHMAP pHashMap, LPHASHMAPNODE pX)
-{
-  LPHASHMAPNODE pY = pX->pRight;
-  pX->pRight = pY->pLeft;
+#define free(ptr) _test_free(ptr, __FILE__, __LINE__)
+#endif
+
+#define HASHTABLE_MIN_CAPACITY 8
 
-  if (pY->pLeft) {
-    pY->pLeft->pParent = pX;
+static size_t HashTable_AlignOf(size_t size)
+{
+  size_t align = 1;
+  while (align < size && align < sizeof(uint64_t)) {
+    align <<= 1;
   }
+  return align;
+}
 
-  pY->pParent = pX->pParent;
+static size_t HashTable_AlignUp(size_t size, size_t align)
+{
+  return (size + align - 1) & ~(align - 1);
+}
 
-  if (!pX->pParent) {
-    pHashMap->pRoot = pY;
+/* Bytewise hash; pointer- and int-sized keys take a single mixing round */
+uint32_t HashTable_HashBytes(const void* pKey, size_t keySize)
+{
+  uint64_t h;
+
+  if (keySize == sizeof(uint64_t)) {
+    memcpy(&h, pKey, sizeof(h));
   }
-  else if (pX == pX->pParent->pLeft) {
-    pX->pParent->pLeft = pY;
+  else if (keySize == sizeof(uint32_t)) {
+    uint32_t k;
+    memcpy(&k, pKey, sizeof(k));
+    h = k;
   }
   else {
-    pX->pParent->pRight = pY;
+    const unsigned char* p = (const unsigned char*)pKey;
+    h = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < keySize; ++i) {
+      h = (h ^ p[i]) * 0x100000001B3ULL;
+    }
   }
 
-  pY->pLeft = pX;
-  pX->pParent = pY;
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ULL;
+  h ^= h >> 33;
+
+  return (uint32_t)h;
 }
 
-void HashMap_RightRotate(LPHASHMAP pHashMap, LPHASHMAPNODE pY)
+/* Zero is reserved for empty slots */
+static inline uint32_t HashTable_Hash(LPHASHTABLE pTable, const void* pKey)
 {
-  LPHASHMAPNODE pX = pY->pLeft;
-  pY->pLeft = pX->pRight;
+  uint32_t hash = pTable->hash ? pTable->hash(pKey, pTable->keySize) :
+      HashTable_HashBytes(pKey, pTable->keySize);
+  return hash ? hash : 1;
+}
 
-  if (pX->pRight) {
-    pX->pRight->pParent = pY;
-  }
+static inline unsigned char* HashTable_Entry(LPHASHTABLE pTable, size_t slot)
+{
+  return pTable->pEntries + slot * pTable->entrySize;
+}
 
-  pX->pParent = pY->pParent;
+static inline size_t HashTable_ProbeDistance(LPHASHTABLE pTable, uint32_t hash, size_t slot)
+{
+  return (slot - (hash & (pTable->capacity - 1))) & (pTable->capacity - 1);
+}
 
-  if (!pY->pParent) {
-    pHashMap->pRoot = pX;
+static inline int HashTable_KeyEqual(LPHASHTABLE pTable, const void* pKey1, const void* pKey2)
+{
+  if (pTable->compare) {
+    return pTable->compare(pKey1, pTable->keySize, pKey2, pTable->keySize) == 0;
   }
-  else if (pY == pY->pParent->pLeft) {
-    pY->pParent->pLeft = pX;
+
+  switch (pTable->keySize) {
+  case sizeof(uint32_t): {
+    uint32_t k1, k2;
+    memcpy(&k1, pKey1, sizeof(k1));
+    memcpy(&k2, pKey2, sizeof(k2));
+    return k1 == k2;
   }
-  else {
-    pY->pParent->pRight = pX;
+  case sizeof(uint64_t): {
+    uint64_t k1, k2;
+    memcpy(&k1, pKey1, sizeof(k1));
+    memcpy(&k2, pKey2, sizeof(k2));
+    return k1 == k2;
   }
+  default:
+    return memcmp(pKey1, pKey2, pTable->keySize) == 0;
+  }
+}
 
-  pX->pRight = pY;
-  pY->pParent = pX;
+void HashTable_Init(LPHASHTABLE pTable, size_t keySize, size_t valueSize,
+    int (*compare)(const void*, size_t, const void*, size_t))
+{
+  size_t valueAlign = HashTable_AlignOf(valueSize);
+  size_t keyAlign = HashTable_AlignOf(keySize);
+
+  pTable->pHashes = NULL;
+  pTable->pEntries = NULL;
+  pTable->pScratch = NULL;
+  pTable->capacity = 0;
+  pTable->count = 0;
+  pTable->keySize = keySize;
+  pTable->valueSize = valueSize;
+  pTable->valueOffset = HashTable_AlignUp(keySize, valueAlign);
+  pTable->entrySize = HashTable_AlignUp(pTable->valueOffset + valueSize,
+      keyAlign > valueAlign ? keyAlign : valueAlign);
+  pTable->compare = compare;
+  pTable->hash = NULL;
 }
 
-void HashMap_InsertFixup(LPHASHMAP pHashMap, LPHASHMAPNODE pZ)
+/* Replace the bytewise key hash, e.g. for keys that point to strings. Must
+ * be called while the table is empty. */
+void HashTable_SetHashFunc(LPHASHTABLE pTable, uint32_t (*hash)(const void* pKey, size_t keySize))
 {
-  while (pZ->pParent && pZ->pParent->color == RBT_RED) {
-    if (pZ->pParent == pZ->pParent->pParent->pLeft) {
+  pTable->hash = hash;
+}
 
-      LPHASHMAPNODE pY = pZ->pParent->pParent->pRight;
-      if (pY && pY->color == RBT_RED) {
-        pZ->pParent->color = RBT_BLACK;
-        pY->color = RBT_BLACK;
-        pZ->pParent->pParent->color = RBT_RED;
-        pZ = pZ->pParent->pParent;
-      }
-      else {
-        if (pZ == pZ->pParent->pRight) {
-          pZ = pZ->pParent;
-          HashMap_LeftRotate(pHashMap, pZ);
-        }
-        pZ->pParent->color = RBT_BLACK;
-        pZ->pParent->pParent->color = RBT_RED;
-        HashMap_RightRotate(pHashMap, pZ->pParent->pParent);
-      }
+/* Place an entry known to be absent. The entry is read from pEntry, which
+ * may be clobbered while it is displaced along the probe sequence. */
+static void HashTable_Place(LPHASHTABLE pTable, uint32_t hash, unsigned char* pEntry)
+{
+  size_t mask = pTable->capacity - 1;
+  size_t slot = hash & mask;
+  size_t dist = 0;
+  unsigned char* pSwap = pTable->pScratch + pTable->entrySize;
+
+  for (;;) {
+    uint32_t slotHash = pTable->pHashes[slot];
+
+    if (!slotHash) {
+      pTable->pHashes[slot] = hash;
+      memcpy(HashTable_Entry(pTable, slot), pEntry, pTable->entrySize);
+      return;
     }
-    else {
-      LPHASHMAPNODE pY = pZ->pParent->pParent->pLeft;
-      if (pY && pY->color == RBT_RED) {
-        pZ->pParent->color = RBT_BLACK;
-        pY->color = RBT_BLACK;
-        pZ->pParent->pParent->color = RBT_RED;
-        pZ = pZ->pParent->pParent;
-      }
-      else {
-        if (pZ == pZ->pParent->pLeft) {
-          pZ = pZ->pParent;
-          HashMap_RightRotate(pHashMap, pZ);
-        }
-        pZ->pParent->color = RBT_BLACK;
-        pZ->pParent->pParent->color = RBT_RED;
-        HashMap_LeftRotate(pHashMap, pZ->pParent->pParent);
-      }
+
+    /* Rob the richer entry: the one closer to its home slot moves on */
+    size_t slotDist = HashTable_ProbeDistance(pTable, slotHash, slot);
+    if (slotDist < dist) {
+      unsigned char* pSlotEntry = HashTable_Entry(pTable, slot);
+
+      memcpy(pSwap, pSlotEntry, pTable->entrySize);
+      memcpy(pSlotEntry, pEntry, pTable->entrySize);
+      memcpy(pEntry, pSwap, pTable->entrySize);
+
+      pTable->pHashes[slot] = hash;
+      hash = slotHash;
+      dist = slotDist;
     }
+
+    slot = (slot + 1) & mask;
+    ++dist;
   }
-  pHashMap->pRoot->color = RBT_BLACK;
 }
 
-void HashMap_InsertNode(LPHASHMAP pHashMap, LPHASHMAPNODE pZ)
+static int HashTable_Rehash(LPHASHTABLE pTable, size_t capacity)
 {
-  LPHASHMAPNODE pY = NULL;
-  LPHASHMAPNODE pX = pHashMap->pRoot;
+  uint32_t* pOldHashes = pTable->pHashes;
+  unsigned char* pOldEntries = pTable->pEntries;
+  size_t oldCapacity = pTable->capacity;
+
+  uint32_t* pHashes = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+  unsigned char* pEntries = (unsigned char*)malloc(capacity * pTable->entrySize);
+  unsigned char* pScratch = pTable->pScratch;
+  if (!pScratch) {
+    pScratch = (unsigned char*)malloc(pTable->entrySize * 2);
+  }
 
-  while (pX) {
-    pY = pX;
-    if (pHashMap->compare(pZ->pair.pKey, pZ->pair.keySize, pX->pair.pKey, pX->pair.keySize) < 0) {
-      pX = pX->pLeft;
+  if (!pHashes || !pEntries || !pScratch) {
+    free(pHashes);
+    free(pEntries);
+    if (pScratch != pTable->pScratch) {
+      free(pScratch);
     }
-    else {
-      pX = pX->pRight;
+    return HASHTABLE_ERROR_MEMORY;
+  }
+
+  pTable->pHashes = pHashes;
+  pTable->pEntries = pEntries;
+  pTable->pScratch = pScratch;
+  pTable->capacity = capacity;
+
+  for (size_t i = 0; i < oldCapacity; ++i) {
+    if (pOldHashes[i]) {
+      memcpy(pScratch, pOldEntries + i * pTable->entrySize, pTable->entrySize);
+      HashTable_Place(pTable, pOldHashes[i], pScratch);
     }
   }
 
-  pZ->pParent = pY;
-  if (!pY) {
-    pHashMap->pRoot = pZ;
+  free(pOldHashes);
+  free(pOldEntries);
+
+  return HASHTABLE_OK;
+}
+
+/* Make room for count entries without exceeding a 7/8 load factor */
+int HashTable_Reserve(LPHASHTABLE pTable, size_t count)
+{
+  size_t capacity = pTable->capacity ? pTable->capacity : HASHTABLE_MIN_CAPACITY;
+  while (count > capacity - capacity / 8) {
+    capacity <<= 1;
   }
-  else if (pHashMap->compare(pZ->pair.pKey, pZ->pair.keySize, pY->pair.pKey, pY->pair.keySize) < 0) {
-    pY->pLeft = pZ;
+
+  if (capacity == pTable->capacity) {
+    return HASHTABLE_OK;
   }
-  else {
-    pY->pRight = pZ;
+
+  return HashTable_Rehash(pTable, capacity);
+}
+
+static size_t HashTable_FindSlot(LPHASHTABLE pTable, const void* pKey, uint32_t hash)
+{
+  if (!pTable->count) {
+    return (size_t)-1;
+  }
+
+  size_t mask = pTable->capacity - 1;
+  size_t slot = hash & mask;
+
+  for (size_t dist = 0; ; ++dist) {
+    uint32_t slotHash = pTable->pHashes[slot];
+
+    /* An empty slot or a richer entry ends the probe sequence */
+    if (!slotHash || HashTable_ProbeDistance(pTable, slotHash, slot) < dist) {
+      return (size_t)-1;
+    }
+
+    if (slotHash == hash && HashTable_KeyEqual(pTable, pKey, HashTable_Entry(pTable, slot))) {
+      return slot;
+    }
+
+    slot = (slot + 1) & mask;
+  }
+}
+
+/* Insert a key or overwrite the value of an existing one */
+int HashTable_Insert(LPHASHTABLE pTable, const void* pKey, const void* pValue)
+{
+  uint32_t hash = HashTable_Hash(pTable, pKey);
+
+  size_t slot = HashTable_FindSlot(pTable, pKey, hash);
+  if (slot != (size_t)-1) {
+    memcpy(HashTable_Entry(pTable, slot) + pTable->valueOffset, pValue, pTable->valueSize);
+    return HASHTABLE_OK;
   }
 
-  HashMap_InsertFixup(pHashMap, pZ);
+  int status = HashTable_Reserve(pTable, pTable->count + 1);
+  if (status != HASHTABLE_OK) {
+    return status;
+  }
+
+  memset(pTable->pScratch, 0, pTable->entrySize);
+  memcpy(pTable->pScratch, pKey, pTable->keySize);
+  memcpy(pTable->pScratch + pTable->valueOffset, pValue, pTable->valueSize);
+  HashTable_Place(pTable, hash, pTable->pScratch);
+  ++pTable->count;
+
+  return HASHTABLE_OK;
 }
 
-void InitializeHashMap(LPHASHMAP pHashMap, size_t keySize, int (*compare)(const void*, size_t, const void*, size_t)) {
-  pHashMap->pRoot = NULL;
-  pHashMap->keySize = keySize;
-  pHashMap->compare = compare;
+void* HashTable_Find(LPHASHTABLE pTable, const void* pKey)
+{
+  size_t slot = HashTable_FindSlot(pTable, pKey, HashTable_Hash(pTable, pKey));
+  return slot != (size_t)-1 ? HashTable_Entry(pTable, slot) + pTable->valueOffset : NULL;
 }
 
-LPHASHMAPNODE HashMap_SearchNode(LPHASHMAP pHashMap, const void* pKey, size_t keySize)
+/* Remove a key with backward-shift deletion, so no tombstones accumulate.
+ * Returns nonzero if the key was present. */
+int HashTable_Erase(LPHASHTABLE pTable, const void* pKey)
 {
-  LPHASHMAPNODE pCurrent = pHashMap->pRoot;
+  size_t slot = HashTable_FindSlot(pTable, pKey, HashTable_Hash(pTable, pKey));
+  if (slot == (size_t)-1) {
+    return 0;
+  }
 
-  while (pCurrent) {
-    int cmp = pHashMap->compare(pKey, keySize, pCurrent->pair.pKey, pCurrent->pair.keySize);
-    if (cmp == 0) {
-      return pCurrent;
-    }
-    else if (cmp < 0) {
-      pCurrent = pCurrent->pLeft;
-    }
-    else {
-      pCurrent = pCurrent->pRight;
+  size_t mask = pTable->capacity - 1;
+  size_t next = (slot + 1) & mask;
+
+  while (pTable->pHashes[next] && HashTable_ProbeDistance(pTable, pTable->pHashes[next], next) > 0) {
+    pTable->pHashes[slot] = pTable->pHashes[next];
+    memcpy(HashTable_Entry(pTable, slot), HashTable_Entry(pTable, next), pTable->entrySize);
+    slot = next;
+    next = (next + 1) & mask;
+  }
+
+  pTable->pHashes[slot] = 0;
+  --pTable->count;
+
+  return 1;
+}
+
+size_t HashTable_GetCount(LPHASHTABLE pTable)
+{
+  return pTable->count;
+}
+
+/* Iterate over all entries; *pIter must start at zero. Entries may not be
+ * inserted or erased during the iteration. */
+int HashTable_Next(LPHASHTABLE pTable, size_t* pIter, void** ppKey, void** ppValue)
+{
+  for (size_t slot = *pIter; slot < pTable->capacity; ++slot) {
+    if (pTable->pHashes[slot]) {
+      unsigned char* pEntry = HashTable_Entry(pTable, slot);
+      if (ppKey) {
+        *ppKey = pEntry;
+      }
+      if (ppValue) {
+        *ppValue = pEntry + pTable->valueOffset;
+      }
+      *pIter = slot + 1;
+      return 1;
     }
   }
 
-  return NULL;
+  *pIter = pTable->capacity;
+  return 0;
+}
+
+/* Remove all entries but keep the storage */
+void HashTable_Clear(LPHASHTABLE pTable)
+{
+  if (pTable->pHashes) {
+    memset(pTable->pHashes, 0, pTable->capacity * sizeof(uint32_t));
+  }
+  pTable->count = 0;
+}
+
+void HashTable_Cleanup(LPHASHTABLE pTable)
+{
+  free(pTable->pHashes);
+  free(pTable->pEntries);
+  free(pTable->pScratch);
+
+  pTable->pHashes = NULL;
+  pTable->pEntries = NULL;
+  pTable->pScratch = NULL;
+  pTable->capacity = 0;
+  pTable->count = 0;
+}
+
+void InitializeHashMap(LPHASHMAP pHashMap, size_t keySize, int (*compare)(const void*, size_t, const void*, size_t)) {
+  HashTable_Init(&pHashMap->table, keySize, sizeof(void*), compare);
+  pHashMap->keySize = keySize;
+  pHashMap->compare = compare;
 }
 
 void HashMap_Insert(LPHASHMAP pHashMap, const void* pKey, void* pValue, size_t valueSize)
 {
-  LPHASHMAPNODE pExistingNode = HashMap_SearchNode(pHashMap, pKey, pHashMap->keySize);
+  void** ppExisting = (void**)HashTable_Find(&pHashMap->table, pKey);
 
   /* If the key already exists, update the value */
-  if (pExistingNode) {
-    pExistingNode->pair.pValue = realloc(pExistingNode->pair.pValue, valueSize);
-    memcpy(pExistingNode->pair.pValue, pValue, valueSize);
-    pExistingNode->pair.valueSize = valueSize;
+  if (ppExisting) {
+    void* pNewValue = realloc(*ppExisting, valueSize);
+    if (pNewValue) {
+      memcpy(pNewValue, pValue, valueSize);
+      *ppExisting = pNewValue;
+    }
   }
   else {
-    HASHMAPPAIR pair;
-    pair.pKey = malloc(pHashMap->keySize);
-    memcpy(pair.pKey, pKey, pHashMap->keySize);
-    pair.pValue = malloc(valueSize);
-    memcpy(pair.pValue, pValue, valueSize);
-    pair.keySize = pHashMap->keySize;
-    pair.valueSize = valueSize;
+    void* pNewValue = malloc(valueSize);
+    if (!pNewValue) {
+      return;
+    }
+    memcpy(pNewValue, pValue, valueSize);
 
-    LPHASHMAPNODE pNewNode = HashMap_CreateNode(pair);
-    HashMap_InsertNode(pHashMap, pNewNode);
+    if (HashTable_Insert(&pHashMap->table, pKey, &pNewValue) != HASHTABLE_OK) {
+      free(pNewValue);
+    }
   }
 }
 
-/* Get the value associated with a key from the Red-Black Tree hashmap */
 void* HashMap_Get(LPHASHMAP pHashMap, const void* pKey)
 {
-  LPHASHMAPNODE pNode = HashMap_SearchNode(pHashMap, pKey, pHashMap->keySize);
-  return pNode ? pNode->pair.pValue : NULL;
+  void** ppValue = (void**)HashTable_Find(&pHashMap->table, pKey);
+  return ppValue ? *ppValue : NULL;
 }
 
-void HashMap_FreeMemory(LPHASHMAPNODE pNode) {
-  if (pNode) {
-    HashMap_FreeMemory(pNode->pLeft);
-    HashMap_FreeMemory(pNode->pRight);
-    free(pNode->pair.pKey);
-    free(pNode->pair.pValue);
-    free(pNode);
+int HashMap_Erase(LPHASHMAP pHashMap, const void* pKey)
+{
+  void** ppValue = (void**)HashTable_Find(&pHashMap->table, pKey);
+  if (!ppValue) {
+    return 0;
   }
+
+  free(*ppValue);
+  return HashTable_Erase(&pHashMap->table, pKey);
 }
 
 void HashMap_Cleanup(LPHASHMAP pHashMap)
 {
-  HashMap_FreeMemory(pHashMap->pRoot);
-  pHashMap->pRoot = NULL;
+  size_t iter = 0;
+  void** ppValue = NULL;
+
+  while (HashTable_Next(&pHashMap->table, &iter, NULL, (void**)&ppValue)) {
+    free(*ppValue);
+  }
+
+  HashTable_Cleanup(&pHashMap->table);
 }
 
 int compareInt(const void* key1, size_t key1Size, const void* key2, size_t key2Size)
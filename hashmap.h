@@ -3,49 +3,72 @@
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
-/* HashMap definitions */
+/* HashTable definitions */
+
+/*
+ * Open-addressing hash table with Robin Hood probing. Keys and values have a
+ * fixed size and are stored inline in a single slot array; a parallel array
+ * keeps the 32-bit hash of every slot, zero marking an empty one.
+ *
+ * Keys are hashed bytewise unless a hash function is installed. Keys that the
+ * compare function reports as equal must always hash the same.
+ */
+typedef struct _tagHASHTABLE HASHTABLE, * LPHASHTABLE;
+
 enum {
-  RBT_RED,
-  RBT_BLACK
+  HASHTABLE_OK = 0,
+  HASHTABLE_ERROR_MEMORY = -1,
 };
 
-typedef struct _tagHASHMAPPAIR HASHMAPPAIR, * LPHASHMAPPAIR;
-typedef struct _tagHASHMAPNODE HASHMAPNODE, * LPHASHMAPNODE;
-typedef struct _tagHASHMAP HASHMAP, * LPHASHMAP;
-
-struct _tagHASHMAPPAIR {
-  void* pKey;
-  void* pValue;
+struct _tagHASHTABLE {
+  uint32_t* pHashes;
+  unsigned char* pEntries;
+  unsigned char* pScratch;    /* Two entries used while displacing */
+  size_t capacity;            /* Power of two, or zero before the first insert */
+  size_t count;
   size_t keySize;
   size_t valueSize;
+  size_t valueOffset;
+  size_t entrySize;
+  int (*compare)(const void* key1, size_t key1Size, const void* key2, size_t key2Size);
+  uint32_t (*hash)(const void* pKey, size_t keySize);
 };
 
-struct _tagHASHMAPNODE {
-  HASHMAPPAIR pair;
-  LPHASHMAPNODE pParent;
-  LPHASHMAPNODE pLeft;
-  LPHASHMAPNODE pRight;
-  int color;
-};
+uint32_t HashTable_HashBytes(const void* pKey, size_t keySize);
+void HashTable_Init(LPHASHTABLE pTable, size_t keySize, size_t valueSize,
+    int (*compare)(const void*, size_t, const void*, size_t));
+void HashTable_SetHashFunc(LPHASHTABLE pTable, uint32_t (*hash)(const void* pKey, size_t keySize));
+int HashTable_Reserve(LPHASHTABLE pTable, size_t count);
+int HashTable_Insert(LPHASHTABLE pTable, const void* pKey, const void* pValue);
+void* HashTable_Find(LPHASHTABLE pTable, const void* pKey);
+int HashTable_Erase(LPHASHTABLE pTable, const void* pKey);
+size_t HashTable_GetCount(LPHASHTABLE pTable);
+int HashTable_Next(LPHASHTABLE pTable, size_t* pIter, void** ppKey, void** ppValue);
+void HashTable_Clear(LPHASHTABLE pTable);
+void HashTable_Cleanup(LPHASHTABLE pTable);
+
+/* HashMap definitions */
+
+/*
+ * Compatibility layer over HASHTABLE for callers storing values of varying
+ * size. Each value is copied to its own heap block and the table maps the key
+ * to that block.
+ */
+typedef struct _tagHASHMAP HASHMAP, * LPHASHMAP;
 
 struct _tagHASHMAP {
-  LPHASHMAPNODE pRoot;
+  HASHTABLE table;
   size_t keySize;
   int (*compare)(const void* key1, size_t key1Size, const void* key2, size_t key2Size);
 };
 
-LPHASHMAPNODE HashMap_CreateNode(HASHMAPPAIR pair);
-void HashMap_LeftRotate(LPHASHMAP pHashMap, LPHASHMAPNODE pX);
-void HashMap_RightRotate(LPHASHMAP pHashMap, LPHASHMAPNODE pY);
-void HashMap_InsertFixup(LPHASHMAP pHashMap, LPHASHMAPNODE pZ);
-void HashMap_InsertNode(LPHASHMAP pHashMap, LPHASHMAPNODE pZ);
 void InitializeHashMap(LPHASHMAP pHashMap, size_t keySize, int (*compare)(const void*, size_t, const void*, size_t));
-LPHASHMAPNODE HashMap_SearchNode(LPHASHMAP pHashMap, const void* pKey, size_t keySize);
 void HashMap_Insert(LPHASHMAP pHashMap, const void* pKey, void* pValue, size_t valueSize);
 void* HashMap_Get(LPHASHMAP pHashMap, const void* pKey);
-void HashMap_FreeMemory(LPHASHMAPNODE pNode);
+int HashMap_Erase(LPHASHMAP pHashMap, const void* pKey);
 void HashMap_Cleanup(LPHASHMAP pHashMap);
 int compareInt(const void* key1, size_t key1Size, const void* key2, size_t key2Size);
 
@@ -0,0 +1,218 @@
+#include "imageinfo.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#ifdef UNIT_TESTING
+extern void* _test_malloc(const size_t size, const char* file, const int line);
+
+#define malloc(size) _test_malloc(size, __FILE__, __LINE__)
+
+extern void* _test_calloc(const size_t num, const size_t size, const char* file,
+  const int line);
+
+#define calloc(num, size) _test_calloc(num, size, __FILE__, __LINE__)
+
+extern void* _test_realloc(void* const ptr, const size_t size, const char* file,
+  const int line);
+
+#define realloc(ptr, size) _test_realloc(ptr, size, __FILE__, __LINE__)
+
+extern void _test_free(void* const ptr, const char* file, const int line);
+
+#define free(ptr) _test_free(ptr, __FILE__, __LINE__)
+#endif
+
+static uint32_t ImageInfo_ReadBE32(const unsigned char* p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t ImageInfo_ReadLE32(const unsigned char* p)
+{
+  return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+/* Chunks up to the first IDAT; acTL, if any, comes before it */
+static unsigned int ImageInfo_CountPNGFrames(FILE* fp, long start)
+{
+  unsigned char chunk[12];
+  if (fseek(fp, start + 8, SEEK_SET)) {
+    return 0;
+  }
+
+  while (fread(chunk, 1, 8, fp) == 8) {
+    uint32_t length = ImageInfo_ReadBE32(chunk);
+    if (!memcmp(chunk + 4, "acTL", 4)) {
+      return fread(chunk + 8, 1, 4, fp) == 4 ? ImageInfo_ReadBE32(chunk + 8) : 0;
+    }
+    if (!memcmp(chunk + 4, "IDAT", 4)) {
+      return 1;
+    }
+    if (length > 0x7FFFFFFF || fseek(fp, (long)length + 4, SEEK_CUR)) {
+      return 0;
+    }
+  }
+
+  return 0;
+}
+
+/* Every frame of an animation is an ANMF chunk */
+static unsigned int ImageInfo_CountWebPFrames(FILE* fp, long start)
+{
+  unsigned char chunk[8];
+  unsigned int nFrames = 0;
+  if (fseek(fp, start + 12, SEEK_SET)) {
+    return 0;
+  }
+
+  while (fread(chunk, 1, 8, fp) == 8) {
+    uint32_t length = ImageInfo_ReadLE32(chunk + 4);
+    if (!memcmp(chunk, "ANMF", 4)) {
+      ++nFrames;
+    }
+    if (length > 0x7FFFFFFE || fseek(fp, (long)(length + (length & 1)), SEEK_CUR)) {
+      break;
+    }
+  }
+
+  return nFrames;
+}
+
+/* Sub-blocks are short, reading them stays in the stdio buffer where seeking may not */
+static int ImageInfo_SkipGIFSubBlocks(FILE* fp)
+{
+  unsigned char block[255];
+  for (;;) {
+    int length = getc(fp);
+    if (length == EOF) {
+      return 0;
+    }
+    if (length == 0) {
+      return 1;
+    }
+    if (fread(block, 1, (size_t)length, fp) != (size_t)length) {
+      return 0;
+    }
+  }
+}
+
+/*
+ * Image descriptors between the extensions, up to the trailer. A truncated
+ * file reports the frames found so far.
+ */
+static unsigned int ImageInfo_CountGIFFrames(FILE* fp, long start)
+{
+  unsigned char header[13];
+  unsigned int nFrames = 0;
+  if (fseek(fp, start, SEEK_SET) || fread(header, 1, sizeof(header), fp) != sizeof(header)) {
+    return 0;
+  }
+
+  if ((header[10] & 0x80) && fseek(fp, 3L << ((header[10] & 0x07) + 1), SEEK_CUR)) {
+    return 0;
+  }
+
+  for (;;) {
+    int block = getc(fp);
+    if (block == 0x2C) {
+      unsigned char descriptor[9];
+      if (fread(descriptor, 1, sizeof(descriptor), fp) != sizeof(descriptor)) {
+        break;
+      }
+      if ((descriptor[8] & 0x80) && fseek(fp, 3L << ((descriptor[8] & 0x07) + 1), SEEK_CUR)) {
+        break;
+      }
+      /* LZW minimum code size, then the image data */
+      if (getc(fp) == EOF || !ImageInfo_SkipGIFSubBlocks(fp)) {
+        break;
+      }
+      ++nFrames;
+    }
+    else if (block == 0x21) {
+      if (getc(fp) == EOF || !ImageInfo_SkipGIFSubBlocks(fp)) {
+        break;
+      }
+    }
+    else {
+      break;
+    }
+  }
+
+  return nFrames;
+}
+
+/*
+ * ImageInfo_ProbeFile
+ *
+ * Fill pInfo from the file at the current position of fp. Returns
+ * IMAGEINFO_ERROR_FORMAT for a file no registered signature matches; header
+ * fields the file does not have are left 0.
+ */
+int ImageInfo_ProbeFile(const IMGFORMATREGISTRY* pRegistry, FILE* fp, LPIMGINFO pInfo, int nFlags)
+{
+  long start = ftell(fp);
+  if (start < 0) {
+    return IMAGEINFO_ERROR_IO;
+  }
+
+  const IMGFORMAT* pFormat = ImgFormat_ProbeFile(pRegistry, fp, pInfo);
+  if (!pFormat) {
+    return ferror(fp) ? IMAGEINFO_ERROR_IO : IMAGEINFO_ERROR_FORMAT;
+  }
+
+  if ((nFlags & IMAGEINFO_COUNT_FRAMES) && !pInfo->nFrames && pInfo->width) {
+    switch (pFormat->nFormat) {
+    case IMGFORMAT_PNG:
+      pInfo->nFrames = ImageInfo_CountPNGFrames(fp, start);
+      break;
+    case IMGFORMAT_GIF:
+      pInfo->nFrames = ImageInfo_CountGIFFrames(fp, start);
+      break;
+    case IMGFORMAT_WEBP:
+      pInfo->nFrames = ImageInfo_CountWebPFrames(fp, start);
+      break;
+    }
+  }
+
+  return IMAGEINFO_OK;
+}
+
+/*
+ * ImageInfo_Probe
+ *
+ * Same as ImageInfo_ProbeFile for the file at pszPath, in UTF-8.
+ */
+int ImageInfo_Probe(const IMGFORMATREGISTRY* pRegistry, const char* pszPath, LPIMGINFO pInfo, int nFlags)
+{
+  FILE* fp = NULL;
+
+#ifdef _WIN32
+  int len = MultiByteToWideChar(CP_UTF8, 0, pszPath, -1, NULL, 0);
+  WCHAR* pszWide = len > 0 ? (WCHAR*)malloc((size_t)len * sizeof(WCHAR)) : NULL;
+  if (pszWide) {
+    MultiByteToWideChar(CP_UTF8, 0, pszPath, -1, pszWide, len);
+    if (_wfopen_s(&fp, pszWide, L"rb") != 0) {
+      fp = NULL;
+    }
+    free(pszWide);
+  }
+#else
+  fp = fopen(pszPath, "rb");
+#endif
+
+  if (!fp) {
+    memset(pInfo, 0, sizeof(IMGINFO));
+    return IMAGEINFO_ERROR_IO;
+  }
+
+  int status = ImageInfo_ProbeFile(pRegistry, fp, pInfo, nFlags);
+  fclose(fp);
+
+  return status;
+}
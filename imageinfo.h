@@ -0,0 +1,30 @@
+/*
+ * imageinfo.h
+ *
+ * Image dimensions and pixel format without decoding
+ *
+ * Probing reads the first IMGFORMAT_PROBE_SIZE bytes of a file, which for
+ * every built-in format covers the size, channels and bit depth, and for
+ * still images the frame count as well. Counting the frames of an animation
+ * is optional as it walks the container: chunk headers only for PNG and
+ * WebP, but every block of a GIF.
+ */
+
+#ifndef PANIVIEW_IMAGEINFO_H
+#define PANIVIEW_IMAGEINFO_H
+
+#include "imgformat.h"
+
+enum {
+  IMAGEINFO_OK = 0,
+  IMAGEINFO_ERROR_IO = -1,
+  IMAGEINFO_ERROR_FORMAT = -2,
+};
+
+/* Flags */
+#define IMAGEINFO_COUNT_FRAMES 0x1
+
+int ImageInfo_ProbeFile(const IMGFORMATREGISTRY* pRegistry, FILE* fp, LPIMGINFO pInfo, int nFlags);
+int ImageInfo_Probe(const IMGFORMATREGISTRY* pRegistry, const char* pszPath, LPIMGINFO pInfo, int nFlags);
+
+#endif /* PANIVIEW_IMAGEINFO_H */
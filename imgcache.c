@@ -0,0 +1,257 @@
+#include "imgcache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef UNIT_TESTING
+extern void* _test_malloc(const size_t size, const char* file, const int line);
+
+#define malloc(size) _test_malloc(size, __FILE__, __LINE__)
+
+extern void* _test_calloc(const size_t num, const size_t size, const char* file,
+  const int line);
+
+#define calloc(num, size) _test_calloc(num, size, __FILE__, __LINE__)
+
+extern void* _test_realloc(void* const ptr, const size_t size, const char* file,
+  const int line);
+
+#define realloc(ptr, size) _test_realloc(ptr, size, __FILE__, __LINE__)
+
+extern void _test_free(void* const ptr, const char* file, const int line);
+
+#define free(ptr) _test_free(ptr, __FILE__, __LINE__)
+#endif
+
+static uint32_t ImgCache_HashPath(const void* pKey, size_t keySize)
+{
+  (void)keySize;
+
+  const char* pszPath = *(const char* const*)pKey;
+  return HashTable_HashBytes(pszPath, strlen(pszPath));
+}
+
+static int ImgCache_ComparePath(const void* key1, size_t key1Size, const void* key2, size_t key2Size)
+{
+  (void)key1Size;
+  (void)key2Size;
+
+  return strcmp(*(const char* const*)key1, *(const char* const*)key2);
+}
+
+static LPIMGCACHEENTRY ImgCache_Lookup(LPIMGCACHE pCache, const char* pszPath)
+{
+  LPIMGCACHEENTRY* ppEntry = (LPIMGCACHEENTRY*)HashTable_Find(&pCache->entries, &pszPath);
+  return ppEntry ? *ppEntry : NULL;
+}
+
+static void ImgCache_Unlink(LPIMGCACHE pCache, LPIMGCACHEENTRY pEntry)
+{
+  if (pEntry->pPrev) {
+    pEntry->pPrev->pNext = pEntry->pNext;
+  }
+  else {
+    pCache->pHead = pEntry->pNext;
+  }
+
+  if (pEntry->pNext) {
+    pEntry->pNext->pPrev = pEntry->pPrev;
+  }
+  else {
+    pCache->pTail = pEntry->pPrev;
+  }
+
+  pEntry->pPrev = NULL;
+  pEntry->pNext = NULL;
+}
+
+static void ImgCache_PushFront(LPIMGCACHE pCache, LPIMGCACHEENTRY pEntry)
+{
+  pEntry->pPrev = NULL;
+  pEntry->pNext = pCache->pHead;
+  if (pCache->pHead) {
+    pCache->pHead->pPrev = pEntry;
+  }
+  else {
+    pCache->pTail = pEntry;
+  }
+  pCache->pHead = pEntry;
+}
+
+/* Drop an entry and give its image back to the owner */
+static void ImgCache_Drop(LPIMGCACHE pCache, LPIMGCACHEENTRY pEntry)
+{
+  ImgCache_Unlink(pCache, pEntry);
+  HashTable_Erase(&pCache->entries, &pEntry->pszPath);
+
+  pCache->stats.bytes -= pEntry->cost;
+  --pCache->stats.count;
+
+  if (pCache->pfnRelease) {
+    pCache->pfnRelease(pEntry->pImage, pCache->pUserData);
+  }
+
+  free(pEntry->pszPath);
+  free(pEntry);
+}
+
+/* Evict from the cold end until `incoming` more bytes fit the budget */
+static void ImgCache_MakeRoom(LPIMGCACHE pCache, size_t incoming)
+{
+  while (pCache->pTail && pCache->stats.bytes + incoming > pCache->stats.budget) {
+    ImgCache_Drop(pCache, pCache->pTail);
+    ++pCache->stats.evictions;
+  }
+}
+
+void ImgCache_Init(LPIMGCACHE pCache, size_t budget, IMGCACHERELEASEFUNC pfnRelease, void* pUserData)
+{
+  memset(pCache, 0, sizeof(IMGCACHE));
+
+  HashTable_Init(&pCache->entries, sizeof(char*), sizeof(LPIMGCACHEENTRY), ImgCache_ComparePath);
+  HashTable_SetHashFunc(&pCache->entries, ImgCache_HashPath);
+
+  pCache->pfnRelease = pfnRelease;
+  pCache->pUserData = pUserData;
+  pCache->stats.budget = budget;
+}
+
+/*
+ * Look an image up and mark it most recently used. The returned handle is
+ * borrowed: it stays valid until the next call that modifies the cache, so a
+ * caller keeping it takes its own reference.
+ */
+void* ImgCache_Find(LPIMGCACHE pCache, const char* pszPath, uint64_t fileSize, int64_t mtime)
+{
+  LPIMGCACHEENTRY pEntry = ImgCache_Lookup(pCache, pszPath);
+  if (!pEntry) {
+    ++pCache->stats.misses;
+    return NULL;
+  }
+
+  if (pEntry->fileSize != fileSize || pEntry->mtime != mtime) {
+    ImgCache_Drop(pCache, pEntry);
+    ++pCache->stats.invalidations;
+    ++pCache->stats.misses;
+    return NULL;
+  }
+
+  if (pCache->pHead != pEntry) {
+    ImgCache_Unlink(pCache, pEntry);
+    ImgCache_PushFront(pCache, pEntry);
+  }
+
+  ++pCache->stats.hits;
+  return pEntry->pImage;
+}
+
+/*
+ * Whether an up-to-date image is cached, marking it most recently used.
+ * Unlike ImgCache_Find this is not counted as a hit or miss, so prefetching
+ * does not skew the statistics.
+ */
+int ImgCache_Touch(LPIMGCACHE pCache, const char* pszPath, uint64_t fileSize, int64_t mtime)
+{
+  LPIMGCACHEENTRY pEntry = ImgCache_Lookup(pCache, pszPath);
+  if (!pEntry) {
+    return 0;
+  }
+
+  if (pEntry->fileSize != fileSize || pEntry->mtime != mtime) {
+    ImgCache_Drop(pCache, pEntry);
+    ++pCache->stats.invalidations;
+    return 0;
+  }
+
+  if (pCache->pHead != pEntry) {
+    ImgCache_Unlink(pCache, pEntry);
+    ImgCache_PushFront(pCache, pEntry);
+  }
+
+  return 1;
+}
+
+/*
+ * Add an image, replacing any entry for the same path. On success the cache
+ * owns the reference passed in; on failure the caller keeps it.
+ */
+int ImgCache_Insert(LPIMGCACHE pCache, const char* pszPath, uint64_t fileSize, int64_t mtime,
+    void* pImage, size_t cost)
+{
+  if (cost > pCache->stats.budget) {
+    return IMGCACHE_ERROR_TOO_LARGE;
+  }
+
+  LPIMGCACHEENTRY pOld = ImgCache_Lookup(pCache, pszPath);
+  if (pOld) {
+    ImgCache_Drop(pCache, pOld);
+  }
+
+  LPIMGCACHEENTRY pEntry = (LPIMGCACHEENTRY)calloc(1, sizeof(IMGCACHEENTRY));
+  if (!pEntry) {
+    return IMGCACHE_ERROR_MEMORY;
+  }
+
+  size_t len = strlen(pszPath) + 1;
+  pEntry->pszPath = (char*)malloc(len);
+  if (!pEntry->pszPath) {
+    free(pEntry);
+    return IMGCACHE_ERROR_MEMORY;
+  }
+  memcpy(pEntry->pszPath, pszPath, len);
+
+  pEntry->fileSize = fileSize;
+  pEntry->mtime = mtime;
+  pEntry->pImage = pImage;
+  pEntry->cost = cost;
+
+  ImgCache_MakeRoom(pCache, cost);
+
+  if (HashTable_Insert(&pCache->entries, &pEntry->pszPath, &pEntry) != HASHTABLE_OK) {
+    free(pEntry->pszPath);
+    free(pEntry);
+    return IMGCACHE_ERROR_MEMORY;
+  }
+
+  ImgCache_PushFront(pCache, pEntry);
+  pCache->stats.bytes += cost;
+  ++pCache->stats.count;
+
+  return IMGCACHE_OK;
+}
+
+/* Returns 1 if an entry was removed */
+int ImgCache_Remove(LPIMGCACHE pCache, const char* pszPath)
+{
+  LPIMGCACHEENTRY pEntry = ImgCache_Lookup(pCache, pszPath);
+  if (!pEntry) {
+    return 0;
+  }
+
+  ImgCache_Drop(pCache, pEntry);
+  return 1;
+}
+
+void ImgCache_SetBudget(LPIMGCACHE pCache, size_t budget)
+{
+  pCache->stats.budget = budget;
+  ImgCache_MakeRoom(pCache, 0);
+}
+
+void ImgCache_GetStats(LPIMGCACHE pCache, LPIMGCACHESTATS pStats)
+{
+  *pStats = pCache->stats;
+}
+
+void ImgCache_Clear(LPIMGCACHE pCache)
+{
+  while (pCache->pHead) {
+    ImgCache_Drop(pCache, pCache->pHead);
+  }
+}
+
+void ImgCache_Cleanup(LPIMGCACHE pCache)
+{
+  ImgCache_Clear(pCache);
+  HashTable_Cleanup(&pCache->entries);
+}
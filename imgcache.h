@@ -0,0 +1,74 @@
+/*
+ * imgcache.h
+ *
+ * Memory-budgeted LRU cache of decoded images
+ *
+ * Images are keyed by path together with the file size and modification
+ * time, so a file changed on disk misses and its stale entry is dropped. The
+ * cache charges every image its byte cost and evicts least recently used
+ * images until the total fits the budget. Images are opaque handles; the
+ * cache owns one reference to each and gives it back through the release
+ * callback. Not thread-safe: use it from one thread.
+ */
+
+#ifndef PANIVIEW_IMGCACHE_H
+#define PANIVIEW_IMGCACHE_H
+
+#include "hashmap.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+  IMGCACHE_OK = 0,
+  IMGCACHE_ERROR_MEMORY = -1,
+  IMGCACHE_ERROR_TOO_LARGE = -2,
+};
+
+typedef void (*IMGCACHERELEASEFUNC)(void* pImage, void* pUserData);
+
+typedef struct _tagIMGCACHEENTRY IMGCACHEENTRY, *LPIMGCACHEENTRY;
+typedef struct _tagIMGCACHESTATS IMGCACHESTATS, *LPIMGCACHESTATS;
+typedef struct _tagIMGCACHE IMGCACHE, *LPIMGCACHE;
+
+struct _tagIMGCACHEENTRY {
+  char* pszPath;
+  uint64_t fileSize;
+  int64_t mtime;
+  void* pImage;
+  size_t cost;
+  LPIMGCACHEENTRY pPrev;      /* Towards the most recently used */
+  LPIMGCACHEENTRY pNext;      /* Towards the least recently used */
+};
+
+struct _tagIMGCACHESTATS {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;         /* Entries dropped to fit the budget */
+  uint64_t invalidations;     /* Entries dropped because the file changed */
+  size_t bytes;
+  size_t count;
+  size_t budget;
+};
+
+struct _tagIMGCACHE {
+  HASHTABLE entries;          /* Path -> LPIMGCACHEENTRY */
+  LPIMGCACHEENTRY pHead;      /* Most recently used */
+  LPIMGCACHEENTRY pTail;      /* Least recently used */
+  IMGCACHERELEASEFUNC pfnRelease;
+  void* pUserData;
+  IMGCACHESTATS stats;
+};
+
+void ImgCache_Init(LPIMGCACHE pCache, size_t budget, IMGCACHERELEASEFUNC pfnRelease, void* pUserData);
+void* ImgCache_Find(LPIMGCACHE pCache, const char* pszPath, uint64_t fileSize, int64_t mtime);
+int ImgCache_Touch(LPIMGCACHE pCache, const char* pszPath, uint64_t fileSize, int64_t mtime);
+int ImgCache_Insert(LPIMGCACHE pCache, const char* pszPath, uint64_t fileSize, int64_t mtime,
+    void* pImage, size_t cost);
+int ImgCache_Remove(LPIMGCACHE pCache, const char* pszPath);
+void ImgCache_SetBudget(LPIMGCACHE pCache, size_t budget);
+void ImgCache_GetStats(LPIMGCACHE pCache, LPIMGCACHESTATS pStats);
+void ImgCache_Clear(LPIMGCACHE pCache);
+void ImgCache_Cleanup(LPIMGCACHE pCache);
+
+#endif /* PANIVIEW_IMGCACHE_H */
@@ -0,0 +1,544 @@
+#include "imgformat.h"
+
+#include <string.h>
+
+static uint32_t ImgFormat_ReadBE16(const unsigned char* p)
+{
+  return ((uint32_t)p[0] << 8) | p[1];
+}
+
+static uint32_t ImgFormat_ReadLE16(const unsigned char* p)
+{
+  return ((uint32_t)p[1] << 8) | p[0];
+}
+
+static uint32_t ImgFormat_ReadLE24(const unsigned char* p)
+{
+  return ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+static uint32_t ImgFormat_ReadBE32(const unsigned char* p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t ImgFormat_ReadLE32(const unsigned char* p)
+{
+  return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+static int ImgFormat_SetSize(LPIMGINFO pInfo, uint32_t width, uint32_t height)
+{
+  if (!width || !height) {
+    return 0;
+  }
+
+  pInfo->width = width;
+  pInfo->height = height;
+  return 1;
+}
+
+/*
+ * IHDR is always the first chunk. An animated PNG has an acTL chunk with the
+ * frame count somewhere before the first IDAT; if neither shows up in the
+ * probed bytes, the frame count stays unknown.
+ */
+static int ImgFormat_PNGInfo(const unsigned char* pData, size_t size, LPIMGINFO pInfo)
+{
+  static const unsigned char channels[7] = { 1, 0, 3, 3, 2, 0, 4 };
+
+  if (size < 24 || memcmp(pData + 12, "IHDR", 4)) {
+    return 0;
+  }
+
+  if (size >= 26) {
+    pInfo->nBitDepth = pData[24];
+    pInfo->nChannels = pData[25] < sizeof(channels) ? channels[pData[25]] : 0;
+  }
+
+  size_t pos = 33;
+  while (pos + 8 <= size) {
+    uint32_t length = ImgFormat_ReadBE32(pData + pos);
+    if (!memcmp(pData + pos + 4, "acTL", 4)) {
+      if (pos + 12 <= size) {
+        pInfo->nFrames = ImgFormat_ReadBE32(pData + pos + 8);
+      }
+      break;
+    }
+    if (!memcmp(pData + pos + 4, "IDAT", 4)) {
+      pInfo->nFrames = 1;
+      break;
+    }
+    if (length > size) {
+      break;
+    }
+    pos += 12 + (size_t)length;
+  }
+
+  return ImgFormat_SetSize(pInfo, ImgFormat_ReadBE32(pData + 16), ImgFormat_ReadBE32(pData + 20));
+}
+
+/* Logical screen descriptor; counting frames takes walking the whole file */
+static int ImgFormat_GIFInfo(const unsigned char* pData, size_t size, LPIMGINFO pInfo)
+{
+  if (size < 10) {
+    return 0;
+  }
+
+  if (size >= 11) {
+    pInfo->nChannels = 3;
+    pInfo->nBitDepth = (pData[10] & 0x80) ? (pData[10] & 0x07) + 1u : 8u;
+  }
+
+  return ImgFormat_SetSize(pInfo, ImgFormat_ReadLE16(pData + 6), ImgFormat_ReadLE16(pData + 8));
+}
+
+/* Walk the marker segments up to the first start of frame */
+static int ImgFormat_JPEGInfo(const unsigned char* pData, size_t size, LPIMGINFO pInfo)
+{
+  size_t pos = 2;
+  while (pos + 4 <= size) {
+    if (pData[pos] != 0xFF) {
+      return 0;
+    }
+
+    unsigned char marker = pData[pos + 1];
+    if (marker == 0xFF) {
+      ++pos;
+      continue;
+    }
+
+    /* Markers without a payload */
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+      pos += 2;
+      continue;
+    }
+
+    /* SOF0..SOF15, except DHT, JPG and DAC which share the range */
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+      if (pos + 10 > size) {
+        return 0;
+      }
+      pInfo->nBitDepth = pData[pos + 4];
+      pInfo->nChannels = pData[pos + 9];
+      pInfo->nFrames = 1;
+      return ImgFormat_SetSize(pInfo, ImgFormat_ReadBE16(pData + pos + 7), ImgFormat_ReadBE16(pData + pos + 5));
+    }
+
+    if (marker == 0xD9 || marker == 0xDA) {
+      return 0;
+    }
+
+    pos += 2 + ImgFormat_ReadBE16(pData + pos + 2);
+  }
+
+  return 0;
+}
+
+/*
+ * Lossy, lossless and extended files each keep the size elsewhere. Extended
+ * files flag alpha and animation; the frames of an animation are chunks of
+ * their own further on.
+ */
+static int ImgFormat_WebPInfo(const unsigned char* pData, size_t size, LPIMGINFO pInfo)
+{
+  if (size < 30) {
+    return 0;
+  }
+
+  pInfo->nBitDepth = 8;
+  pInfo->nChannels = 3;
+  pInfo->nFrames = 1;
+
+  const unsigned char* pChunk = pData + 12;
+  if (!memcmp(pChunk, "VP8 ", 4)) {
+    if (pData[23] != 0x9D || pData[24] != 0x01 || pData[25] != 0x2A) {
+      return 0;
+    }
+    return ImgFormat_SetSize(pInfo, ImgFormat_ReadLE16(pData + 26) & 0x3FFF, ImgFormat_ReadLE16(pData + 28) & 0x3FFF);
+  }
+
+  if (!memcmp(pChunk, "VP8L", 4)) {
+    if (pData[20] != 0x2F) {
+      return 0;
+    }
+    uint32_t bits = (uint32_t)pData[21] | ((uint32_t)pData[22] << 8) | ((uint32_t)pData[23] << 16) |
+        ((uint32_t)pData[24] << 24);
+    if (bits & (1u << 28)) {
+      pInfo->nChannels = 4;
+    }
+    return ImgFormat_SetSize(pInfo, (bits & 0x3FFF) + 1, ((bits >> 14) & 0x3FFF) + 1);
+  }
+
+  if (!memcmp(pChunk, "VP8X", 4)) {
+    if (pData[20] & 0x10) {
+      pInfo->nChannels = 4;
+    }
+    if (pData[20] & 0x02) {
+      pInfo->nFrames = 0;
+    }
+    return ImgFormat_SetSize(pInfo, ImgFormat_ReadLE24(pData + 24) + 1, ImgFormat_ReadLE24(pData + 27) + 1);
+  }
+
+  return 0;
+}
+
+/* Next decimal field of a Netpbm header, skipping whitespace and comments */
+static int ImgFormat_PNMField(const unsigned char* pData, size_t size, size_t* pPos, uint32_t* pValue)
+{
+  size_t pos = *pPos;
+  for (;;) {
+    while (pos < size && (pData[pos] == ' ' || (pData[pos] >= '\t' && pData[pos] <= '\r'))) {
+      ++pos;
+    }
+    if (pos < size && pData[pos] == '#') {
+      while (pos < size && pData[pos] != '\n' && pData[pos] != '\r') {
+        ++pos;
+      }
+      continue;
+    }
+    break;
+  }
+
+  uint64_t value = 0;
+  size_t start = pos;
+  while (pos < size && pData[pos] >= '0' && pData[pos] <= '9') {
+    value = value * 10 + (pData[pos] - '0');
+    if (value > UINT32_MAX) {
+      return 0;
+    }
+    ++pos;
+  }
+
+  /* The field must be complete, i.e. followed by something */
+  if (pos == start || pos == size) {
+    return 0;
+  }
+
+  *pPos = pos;
+  *pValue = (uint32_t)value;
+  return 1;
+}
+
+/* PGM and PPM, plain or raw; the maximum value gives the bit depth */
+static int ImgFormat_PNMInfo(const unsigned char* pData, size_t size, LPIMGINFO pInfo)
+{
+  size_t pos = 2;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t maxval = 0;
+  if (!ImgFormat_PNMField(pData, size, &pos, &width) || !ImgFormat_PNMField(pData, size, &pos, &height)) {
+    return 0;
+  }
+
+  pInfo->nChannels = (pData[1] == '3' || pData[1] == '6') ? 3 : 1;
+  pInfo->nFrames = 1;
+  if (ImgFormat_PNMField(pData, size, &pos, &maxval) && maxval) {
+    while (pInfo->nBitDepth < 32 && (maxval >> pInfo->nBitDepth)) {
+      ++pInfo->nBitDepth;
+    }
+  }
+
+  return ImgFormat_SetSize(pInfo, width, height);
+}
+
+/* Any DIB header but the old OS/2 one keeps 32-bit dimensions at the same spot */
+static int ImgFormat_BMPInfo(const unsigned char* pData, size_t size, LPIMGINFO pInfo)
+{
+  if (size < 26) {
+    return 0;
+  }
+
+  uint32_t headerSize = ImgFormat_ReadLE32(pData + 14);
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t bpp = 0;
+  if (headerSize == 12) {
+    width = ImgFormat_ReadLE16(pData + 18);
+    height = ImgFormat_ReadLE16(pData + 20);
+    bpp = ImgFormat_ReadLE16(pData + 24);
+  }
+  else if (headerSize >= 40 && size >= 30) {
+    int32_t signedHeight = (int32_t)ImgFormat_ReadLE32(pData + 22);
+    width = ImgFormat_ReadLE32(pData + 18);
+    height = signedHeight < 0 ? 0u - (uint32_t)signedHeight : (uint32_t)signedHeight;
+    bpp = ImgFormat_ReadLE16(pData + 28);
+  }
+  else {
+    return 0;
+  }
+
+  /* Up to 8 bits are palette indices, 16 bits are 5-bit samples */
+  pInfo->nChannels = bpp == 32 ? 4 : 3;
+  pInfo->nBitDepth = bpp <= 8 ? bpp : (bpp == 16 ? 5 : 8);
+  pInfo->nFrames = 1;
+  return ImgFormat_SetSize(pInfo, width, height);
+}
+
+/*
+ * ImgFormat_InitRegistry
+ *
+ * Start with the built-in formats, without decoders.
+ */
+void ImgFormat_InitRegistry(LPIMGFORMATREGISTRY pRegistry)
+{
+  static const IMGFORMAT builtins[] = {
+    { IMGFORMAT_PNG, "PNG", ImgFormat_PNGInfo, NULL },
+    { IMGFORMAT_JPEG, "JPEG", ImgFormat_JPEGInfo, NULL },
+    { IMGFORMAT_GIF, "GIF", ImgFormat_GIFInfo, NULL },
+    { IMGFORMAT_WEBP, "WebP", ImgFormat_WebPInfo, NULL },
+    { IMGFORMAT_PGM, "PGM", ImgFormat_PNMInfo, NULL },
+    { IMGFORMAT_PPM, "PPM", ImgFormat_PNMInfo, NULL },
+    { IMGFORMAT_BMP, "BMP", ImgFormat_BMPInfo, NULL },
+  };
+
+  static const unsigned char webpMask[12] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF
+  };
+
+  /* "BM" alone is too weak; the reserved fields after the file size are zero */
+  static const unsigned char bmpMask[10] = {
+    0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF
+  };
+
+  memset(pRegistry, 0, sizeof(IMGFORMATREGISTRY));
+
+  for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); ++i) {
+    ImgFormat_AddFormat(pRegistry, &builtins[i]);
+  }
+
+  ImgFormat_AddSignature(pRegistry, IMGFORMAT_PNG, 0, "\x89PNG\r\n\x1A\n", NULL, 8);
+  ImgFormat_AddSignature(pRegistry, IMGFORMAT_JPEG, 0, "\xFF\xD8\xFF", NULL, 3);
+  ImgFormat_AddSignature(pRegistry, IMGFORMAT_GIF, 0, "GIF8", NULL, 4);
+  ImgFormat_AddSignature(pRegistry, IMGFORMAT_WEBP, 0, "RIFF\0\0\0\0WEBP", webpMask, 12);
+  ImgFormat_AddSignature(pRegistry, IMGFORMAT_PGM, 0, "P5", NULL, 2);
+  ImgFormat_AddSignature(pRegistry, IMGFORMAT_PGM, 0, "P2", NULL, 2);
+  ImgFormat_AddSignature(pRegistry, IMGFORMAT_PPM, 0, "P6", NULL, 2);
+  ImgFormat_AddSignature(pRegistry, IMGFORMAT_PPM, 0, "P3", NULL, 2);
+  ImgFormat_AddSignature(pRegistry, IMGFORMAT_BMP, 0, "BM\0\0\0\0\0\0\0\0", bmpMask, 10);
+
+  ImgFormat_AddExtension(pRegistry, IMGFORMAT_PNG, "png");
+  ImgFormat_AddExtension(pRegistry, IMGFORMAT_JPEG, "jpg");
+  ImgFormat_AddExtension(pRegistry, IMGFORMAT_JPEG, "jpeg");
+  ImgFormat_AddExtension(pRegistry, IMGFORMAT_JPEG, "jpe");
+  ImgFormat_AddExtension(pRegistry, IMGFORMAT_JPEG, "jfif");
+  ImgFormat_AddExtension(pRegistry, IMGFORMAT_GIF, "gif");
+  ImgFormat_AddExtension(pRegistry, IMGFORMAT_WEBP, "webp");
+  ImgFormat_AddExtension(pRegistry, IMGFORMAT_PGM, "pgm");
+  ImgFormat_AddExtension(pRegistry, IMGFORMAT_PPM, "ppm");
+  ImgFormat_AddExtension(pRegistry, IMGFORMAT_BMP, "bmp");
+  ImgFormat_AddExtension(pRegistry, IMGFORMAT_BMP, "dib");
+}
+
+static LPIMGFORMAT ImgFormat_Lookup(LPIMGFORMATREGISTRY pRegistry, int nFormat)
+{
+  for (size_t i = 0; i < pRegistry->nFormats; ++i) {
+    if (pRegistry->formats[i].nFormat == nFormat) {
+      return &pRegistry->formats[i];
+    }
+  }
+
+  return NULL;
+}
+
+/* Add a format, or replace the one with the same id */
+int ImgFormat_AddFormat(LPIMGFORMATREGISTRY pRegistry, const IMGFORMAT* pFormat)
+{
+  if (pFormat->nFormat == IMGFORMAT_UNKNOWN) {
+    return IMGFORMAT_ERROR_INVALID;
+  }
+
+  LPIMGFORMAT pSlot = ImgFormat_Lookup(pRegistry, pFormat->nFormat);
+  if (!pSlot) {
+    if (pRegistry->nFormats == IMGFORMAT_MAX_FORMATS) {
+      return IMGFORMAT_ERROR_FULL;
+    }
+    pSlot = &pRegistry->formats[pRegistry->nFormats++];
+  }
+
+  *pSlot = *pFormat;
+  return IMGFORMAT_OK;
+}
+
+/*
+ * ImgFormat_AddSignature
+ *
+ * Recognize nFormat by `length` bytes at `offset`. pMask may be NULL to
+ * compare every byte. Signatures are tried in the order they were added.
+ */
+int ImgFormat_AddSignature(LPIMGFORMATREGISTRY pRegistry, int nFormat, size_t offset,
+    const void* pBytes, const void* pMask, size_t length)
+{
+  if (!ImgFormat_Lookup(pRegistry, nFormat) || !length || length > IMGFORMAT_MAX_SIGNATURE_LENGTH ||
+      offset + length > IMGFORMAT_PROBE_SIZE) {
+    return IMGFORMAT_ERROR_INVALID;
+  }
+
+  if (pRegistry->nSignatures == IMGFORMAT_MAX_SIGNATURES) {
+    return IMGFORMAT_ERROR_FULL;
+  }
+
+  LPIMGSIGNATURE pSignature = &pRegistry->signatures[pRegistry->nSignatures++];
+  memset(pSignature, 0, sizeof(IMGSIGNATURE));
+  pSignature->nFormat = nFormat;
+  pSignature->offset = offset;
+  pSignature->length = length;
+
+  /* Bytes are stored pre-masked so matching is a single AND and compare */
+  const unsigned char* pSrc = (const unsigned char*)pBytes;
+  const unsigned char* pSrcMask = (const unsigned char*)pMask;
+  for (size_t i = 0; i < length; ++i) {
+    pSignature->mask[i] = pSrcMask ? pSrcMask[i] : 0xFF;
+    pSignature->bytes[i] = pSrc[i] & pSignature->mask[i];
+  }
+
+  return IMGFORMAT_OK;
+}
+
+static char ImgFormat_ToLower(char c)
+{
+  return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+}
+
+/* Extensions are given without the dot and compared case-insensitively */
+int ImgFormat_AddExtension(LPIMGFORMATREGISTRY pRegistry, int nFormat, const char* pszExtension)
+{
+  size_t length = strlen(pszExtension);
+  if (!ImgFormat_Lookup(pRegistry, nFormat) || !length || length >= IMGFORMAT_MAX_EXTENSION_LENGTH) {
+    return IMGFORMAT_ERROR_INVALID;
+  }
+
+  if (pRegistry->nExtensions == IMGFORMAT_MAX_EXTENSIONS) {
+    return IMGFORMAT_ERROR_FULL;
+  }
+
+  LPIMGEXTENSION pExtension = &pRegistry->extensions[pRegistry->nExtensions++];
+  memset(pExtension, 0, sizeof(IMGEXTENSION));
+  pExtension->nFormat = nFormat;
+  for (size_t i = 0; i < length; ++i) {
+    pExtension->szExtension[i] = ImgFormat_ToLower(pszExtension[i]);
+  }
+
+  return IMGFORMAT_OK;
+}
+
+int ImgFormat_SetDecoder(LPIMGFORMATREGISTRY pRegistry, int nFormat, const void* pDecoder)
+{
+  LPIMGFORMAT pFormat = ImgFormat_Lookup(pRegistry, nFormat);
+  if (!pFormat) {
+    return IMGFORMAT_ERROR_INVALID;
+  }
+
+  pFormat->pDecoder = pDecoder;
+  return IMGFORMAT_OK;
+}
+
+const IMGFORMAT* ImgFormat_Find(const IMGFORMATREGISTRY* pRegistry, int nFormat)
+{
+  for (size_t i = 0; i < pRegistry->nFormats; ++i) {
+    if (pRegistry->formats[i].nFormat == nFormat) {
+      return &pRegistry->formats[i];
+    }
+  }
+
+  return NULL;
+}
+
+static int ImgFormat_Matches(const IMGSIGNATURE* pSignature, const unsigned char* pData, size_t size)
+{
+  if (pSignature->offset + pSignature->length > size) {
+    return 0;
+  }
+
+  const unsigned char* p = pData + pSignature->offset;
+  for (size_t i = 0; i < pSignature->length; ++i) {
+    if ((p[i] & pSignature->mask[i]) != pSignature->bytes[i]) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/*
+ * ImgFormat_Probe
+ *
+ * Identify the format of a file from its first bytes. Returns NULL and sets
+ * pInfo->nFormat to IMGFORMAT_UNKNOWN if no signature matches. pInfo may be
+ * NULL when only the format is wanted.
+ */
+const IMGFORMAT* ImgFormat_Probe(const IMGFORMATREGISTRY* pRegistry, const void* pData, size_t size,
+    LPIMGINFO pInfo)
+{
+  const unsigned char* pBytes = (const unsigned char*)pData;
+
+  if (pInfo) {
+    memset(pInfo, 0, sizeof(IMGINFO));
+  }
+
+  for (size_t i = 0; i < pRegistry->nSignatures; ++i) {
+    const IMGSIGNATURE* pSignature = &pRegistry->signatures[i];
+    if (!ImgFormat_Matches(pSignature, pBytes, size)) {
+      continue;
+    }
+
+    const IMGFORMAT* pFormat = ImgFormat_Find(pRegistry, pSignature->nFormat);
+    if (pInfo) {
+      pInfo->nFormat = pFormat->nFormat;
+      if (pFormat->pfnInfo && !pFormat->pfnInfo(pBytes, size, pInfo)) {
+        memset(pInfo, 0, sizeof(IMGINFO));
+        pInfo->nFormat = pFormat->nFormat;
+      }
+    }
+
+    return pFormat;
+  }
+
+  return NULL;
+}
+
+/*
+ * ImgFormat_ProbeFile
+ *
+ * Probe from the current position of fp with a single read; the position is
+ * left after the bytes read.
+ */
+const IMGFORMAT* ImgFormat_ProbeFile(const IMGFORMATREGISTRY* pRegistry, FILE* fp, LPIMGINFO pInfo)
+{
+  unsigned char buffer[IMGFORMAT_PROBE_SIZE];
+  size_t size = fread(buffer, 1, sizeof(buffer), fp);
+
+  return ImgFormat_Probe(pRegistry, buffer, size, pInfo);
+}
+
+/*
+ * ImgFormat_FindByName
+ *
+ * The format a file name claims by its extension, or NULL. Nothing is
+ * read; only a probe tells what the file really holds.
+ */
+const IMGFORMAT* ImgFormat_FindByName(const IMGFORMATREGISTRY* pRegistry, const char* pszName)
+{
+  const char* pszDot = strrchr(pszName, '.');
+  if (!pszDot || pszDot == pszName) {
+    return NULL;
+  }
+
+  char szExtension[IMGFORMAT_MAX_EXTENSION_LENGTH];
+  size_t length = 0;
+  for (const char* p = pszDot + 1; *p; ++p) {
+    if (length + 1 == IMGFORMAT_MAX_EXTENSION_LENGTH) {
+      return NULL;
+    }
+    szExtension[length++] = ImgFormat_ToLower(*p);
+  }
+  szExtension[length] = '\0';
+
+  for (size_t i = 0; i < pRegistry->nExtensions; ++i) {
+    if (!strcmp(pRegistry->extensions[i].szExtension, szExtension)) {
+      return ImgFormat_Find(pRegistry, pRegistry->extensions[i].nFormat);
+    }
+  }
+
+  return NULL;
+}
@@ -0,0 +1,121 @@
+/*
+ * imgformat.h
+ *
+ * Table-driven image format registry
+ *
+ * Formats are recognized by signatures: byte strings expected at an offset
+ * from the start of the file, with an optional mask for bytes that vary,
+ * e.g. the chunk size in a RIFF header. Probing needs only the first
+ * IMGFORMAT_PROBE_SIZE bytes of a file, read at once; files shorter than
+ * that are fine as long as the signature fits. Where the header allows, the
+ * image dimensions are reported too. Every format carries an opaque decoder
+ * pointer the application attaches, so dispatching a decode is a lookup.
+ * Header fields the probed bytes do not cover are reported as 0.
+ *
+ * File name extensions map to formats as well. They only tell what a file
+ * claims to be, so they serve to sort files out by name before any is
+ * opened, e.g. while listing a large directory; the signature decides.
+ *
+ * New formats are registered at run time, no probing code changes. The
+ * registry is filled once at startup; probing does not modify it and is
+ * safe from any thread.
+ */
+
+#ifndef PANIVIEW_IMGFORMAT_H
+#define PANIVIEW_IMGFORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define IMGFORMAT_PROBE_SIZE 1024
+#define IMGFORMAT_MAX_FORMATS 32
+#define IMGFORMAT_MAX_SIGNATURES 64
+#define IMGFORMAT_MAX_SIGNATURE_LENGTH 16
+#define IMGFORMAT_MAX_EXTENSIONS 64
+#define IMGFORMAT_MAX_EXTENSION_LENGTH 8    /* Without the dot, NUL included */
+
+enum {
+  IMGFORMAT_OK = 0,
+  IMGFORMAT_ERROR_FULL = -1,
+  IMGFORMAT_ERROR_INVALID = -2,
+  IMGFORMAT_ERROR_IO = -3,
+};
+
+/* Built-in formats; applications may register more above IMGFORMAT_USER */
+enum {
+  IMGFORMAT_UNKNOWN = 0,
+  IMGFORMAT_PNG = 1,
+  IMGFORMAT_JPEG = 2,
+  IMGFORMAT_GIF = 3,
+  IMGFORMAT_WEBP = 4,
+  IMGFORMAT_PGM = 5,
+  IMGFORMAT_PPM = 6,
+  IMGFORMAT_BMP = 7,
+  IMGFORMAT_USER = 64,
+};
+
+typedef struct _tagIMGINFO IMGINFO, *LPIMGINFO;
+typedef struct _tagIMGSIGNATURE IMGSIGNATURE, *LPIMGSIGNATURE;
+typedef struct _tagIMGEXTENSION IMGEXTENSION, *LPIMGEXTENSION;
+typedef struct _tagIMGFORMAT IMGFORMAT, *LPIMGFORMAT;
+typedef struct _tagIMGFORMATREGISTRY IMGFORMATREGISTRY, *LPIMGFORMATREGISTRY;
+
+struct _tagIMGINFO {
+  int nFormat;
+  uint32_t width;             /* 0 when the probed bytes do not tell */
+  uint32_t height;
+  unsigned int nChannels;     /* Colour channels, alpha included */
+  unsigned int nBitDepth;     /* Bits per sample, or per palette index */
+  unsigned int nFrames;       /* 0 until counted, for animations */
+};
+
+/*
+ * Parse the header from the first bytes of a file already known to be of
+ * the format. Returns nonzero if at least width and height were filled;
+ * on failure the other fields are reset as well.
+ */
+typedef int (*IMGINFOFUNC)(const unsigned char* pData, size_t size, LPIMGINFO pInfo);
+
+struct _tagIMGSIGNATURE {
+  int nFormat;
+  size_t offset;
+  size_t length;
+  unsigned char bytes[IMGFORMAT_MAX_SIGNATURE_LENGTH];
+  unsigned char mask[IMGFORMAT_MAX_SIGNATURE_LENGTH];   /* 0xFF: must match */
+};
+
+struct _tagIMGEXTENSION {
+  int nFormat;
+  char szExtension[IMGFORMAT_MAX_EXTENSION_LENGTH];   /* Lower case */
+};
+
+struct _tagIMGFORMAT {
+  int nFormat;
+  const char* pszName;
+  IMGINFOFUNC pfnInfo;        /* Optional */
+  const void* pDecoder;       /* Owned by the application */
+};
+
+struct _tagIMGFORMATREGISTRY {
+  IMGFORMAT formats[IMGFORMAT_MAX_FORMATS];
+  size_t nFormats;
+  IMGSIGNATURE signatures[IMGFORMAT_MAX_SIGNATURES];
+  size_t nSignatures;
+  IMGEXTENSION extensions[IMGFORMAT_MAX_EXTENSIONS];
+  size_t nExtensions;
+};
+
+void ImgFormat_InitRegistry(LPIMGFORMATREGISTRY pRegistry);
+int ImgFormat_AddFormat(LPIMGFORMATREGISTRY pRegistry, const IMGFORMAT* pFormat);
+int ImgFormat_AddSignature(LPIMGFORMATREGISTRY pRegistry, int nFormat, size_t offset,
+    const void* pBytes, const void* pMask, size_t length);
+int ImgFormat_AddExtension(LPIMGFORMATREGISTRY pRegistry, int nFormat, const char* pszExtension);
+int ImgFormat_SetDecoder(LPIMGFORMATREGISTRY pRegistry, int nFormat, const void* pDecoder);
+const IMGFORMAT* ImgFormat_Find(const IMGFORMATREGISTRY* pRegistry, int nFormat);
+const IMGFORMAT* ImgFormat_Probe(const IMGFORMATREGISTRY* pRegistry, const void* pData, size_t size,
+    LPIMGINFO pInfo);
+const IMGFORMAT* ImgFormat_ProbeFile(const IMGFORMATREGISTRY* pRegistry, FILE* fp, LPIMGINFO pInfo);
+const IMGFORMAT* ImgFormat_FindByName(const IMGFORMATREGISTRY* pRegistry, const char* pszName);
+
+#endif /* PANIVIEW_IMGFORMAT_H */
@@ -0,0 +1,400 @@
+#include "loader.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * No UNIT_TESTING allocator hooks here: requests are allocated and freed on
+ * different threads, and cmocka's allocation tracking is not thread-safe.
+ */
+
+int LoadToken_IsCancelled(LPLOADTOKEN pToken)
+{
+  return pToken && Atomic_Load(&pToken->bCancelled) != 0;
+}
+
+int LoadToken_ShouldYield(LPLOADTOKEN pToken)
+{
+  return pToken && Atomic_Load(&pToken->bYield) != 0;
+}
+
+/* The classes a request of nClass cancels when it supersedes */
+static unsigned int Loader_SupersededClasses(int nClass)
+{
+  unsigned int mask = 1u << nClass;
+  if (nClass == LOADER_CLASS_VISIBLE) {
+    mask |= 1u << LOADER_CLASS_PREFETCH;
+  }
+
+  return mask;
+}
+
+static int Loader_IsQueueEmptyLocked(LPLOADER pLoader)
+{
+  for (int i = 0; i < LOADER_CLASSES; ++i) {
+    if (pLoader->queues[i].pHead) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/*
+ * Insert by deadline, after the requests with the same one, or before them
+ * for a preempted request going back; the caller holds the mutex. Requests
+ * usually come in deadline order, so the tail is checked first.
+ */
+static void Loader_InsertLocked(LPLOADER pLoader, LPLOADREQUEST pRequest, int bFront)
+{
+  LPLOADQUEUE pQueue = &pLoader->queues[pRequest->nClass];
+  pRequest->pNext = NULL;
+
+  if (!pQueue->pTail || (!bFront && pQueue->pTail->nDeadline <= pRequest->nDeadline)) {
+    if (pQueue->pTail) {
+      pQueue->pTail->pNext = pRequest;
+    }
+    else {
+      pQueue->pHead = pRequest;
+    }
+    pQueue->pTail = pRequest;
+    return;
+  }
+
+  LPLOADREQUEST* ppLink = &pQueue->pHead;
+  while (*ppLink && ((*ppLink)->nDeadline < pRequest->nDeadline
+      || (!bFront && (*ppLink)->nDeadline == pRequest->nDeadline))) {
+    ppLink = &(*ppLink)->pNext;
+  }
+
+  pRequest->pNext = *ppLink;
+  *ppLink = pRequest;
+  if (!pRequest->pNext) {
+    pQueue->pTail = pRequest;
+  }
+}
+
+/*
+ * A request of nClass is waiting and no worker is free: ask the running
+ * request of the lowest class below it, latest deadline first, to yield.
+ * The caller holds the mutex.
+ */
+static void Loader_PreemptLocked(LPLOADER pLoader, int nClass)
+{
+  if (pLoader->nBusy < pLoader->nWorkers) {
+    return;
+  }
+
+  LPLOADREQUEST pVictim = NULL;
+  for (unsigned int i = 0; i < pLoader->nWorkers; ++i) {
+    LPLOADREQUEST pRunning = pLoader->pWorkers[i].pRunning;
+    if (!pRunning || pRunning->nClass <= nClass || Atomic_Load(&pRunning->token.bYield)
+        || Atomic_Load(&pRunning->token.bCancelled)) {
+      continue;
+    }
+
+    if (!pVictim || pRunning->nClass > pVictim->nClass
+        || (pRunning->nClass == pVictim->nClass && pRunning->nDeadline > pVictim->nDeadline)) {
+      pVictim = pRunning;
+    }
+  }
+
+  if (pVictim) {
+    Atomic_Store(&pVictim->token.bYield, 1);
+  }
+}
+
+static void Loader_Complete(LPLOADER pLoader, LPLOADREQUEST pRequest, void* pResult, int status)
+{
+  pLoader->callbacks.pfnComplete(pRequest->pArg, pResult, status, pRequest->nGeneration, pLoader->pUserData);
+  free(pRequest);
+}
+
+/* Unlink the queues of the classes in mask and cancel what of them is in
+ * flight; the caller holds the mutex. Returns the detached requests, which
+ * must be completed outside the lock. */
+static LPLOADREQUEST Loader_DetachLocked(LPLOADER pLoader, unsigned int mask)
+{
+  LPLOADREQUEST pDetached = NULL;
+
+  for (int i = LOADER_CLASSES - 1; i >= 0; --i) {
+    LPLOADQUEUE pQueue = &pLoader->queues[i];
+    if (!(mask & (1u << i)) || !pQueue->pHead) {
+      continue;
+    }
+
+    pQueue->pTail->pNext = pDetached;
+    pDetached = pQueue->pHead;
+    pQueue->pHead = NULL;
+    pQueue->pTail = NULL;
+  }
+
+  for (unsigned int i = 0; i < pLoader->nWorkers; ++i) {
+    LPLOADREQUEST pRunning = pLoader->pWorkers[i].pRunning;
+    if (pRunning && (mask & (1u << pRunning->nClass))) {
+      Atomic_Store(&pRunning->token.bCancelled, 1);
+    }
+  }
+
+  return pDetached;
+}
+
+/* Pop the next request, highest class first; the caller holds the mutex */
+static LPLOADREQUEST Loader_PopLocked(LPLOADER pLoader)
+{
+  for (int i = 0; i < LOADER_CLASSES; ++i) {
+    LPLOADQUEUE pQueue = &pLoader->queues[i];
+    LPLOADREQUEST pRequest = pQueue->pHead;
+    if (pRequest) {
+      pQueue->pHead = pRequest->pNext;
+      if (!pQueue->pHead) {
+        pQueue->pTail = NULL;
+      }
+      pRequest->pNext = NULL;
+      return pRequest;
+    }
+  }
+
+  return NULL;
+}
+
+static void Loader_CompleteCancelled(LPLOADER pLoader, LPLOADREQUEST pQueue)
+{
+  while (pQueue) {
+    LPLOADREQUEST pNext = pQueue->pNext;
+    Loader_Complete(pLoader, pQueue, NULL, LOADER_CANCELLED);
+    pQueue = pNext;
+  }
+}
+
+static int Loader_WorkerProc(void* pArg)
+{
+  LPLOADERWORKER pWorker = (LPLOADERWORKER)pArg;
+  LPLOADER pLoader = pWorker->pLoader;
+
+  if (pLoader->callbacks.pfnThreadStart) {
+    pLoader->callbacks.pfnThreadStart(pLoader->pUserData);
+  }
+
+  Mutex_Lock(&pLoader->mutex);
+  for (;;) {
+    while (Loader_IsQueueEmptyLocked(pLoader) && !pLoader->bShutdown) {
+      CondVar_Wait(&pLoader->workCond, &pLoader->mutex);
+    }
+
+    LPLOADREQUEST pRequest = Loader_PopLocked(pLoader);
+    if (!pRequest) {
+      break;
+    }
+
+    pWorker->pRunning = pRequest;
+    ++pLoader->nBusy;
+    Mutex_Unlock(&pLoader->mutex);
+
+    void* pResult = NULL;
+    int status = LOADER_CANCELLED;
+    if (!LoadToken_IsCancelled(&pRequest->token)) {
+      status = pLoader->callbacks.pfnDecode(pRequest->pArg, &pRequest->token, &pResult, pLoader->pUserData);
+    }
+
+    /* Stop cancellation from touching the request before it is freed */
+    Mutex_Lock(&pLoader->mutex);
+    pWorker->pRunning = NULL;
+
+    /* Yielded to a higher class: back to the front of its queue, not completed */
+    if (status == LOADER_PREEMPTED && !LoadToken_IsCancelled(&pRequest->token)) {
+      Atomic_Store(&pRequest->token.bYield, 0);
+      Loader_InsertLocked(pLoader, pRequest, 1);
+      ++pLoader->nPreemptions;
+      --pLoader->nBusy;
+      continue;
+    }
+    Mutex_Unlock(&pLoader->mutex);
+
+    /* A decode that finished despite being cancelled still reports so, the
+     * result is stale either way */
+    if (LoadToken_IsCancelled(&pRequest->token)) {
+      status = LOADER_CANCELLED;
+    }
+    Loader_Complete(pLoader, pRequest, pResult, status);
+
+    Mutex_Lock(&pLoader->mutex);
+    if (--pLoader->nBusy == 0 && Loader_IsQueueEmptyLocked(pLoader)) {
+      CondVar_Broadcast(&pLoader->idleCond);
+    }
+  }
+  Mutex_Unlock(&pLoader->mutex);
+
+  if (pLoader->callbacks.pfnThreadStop) {
+    pLoader->callbacks.pfnThreadStop(pLoader->pUserData);
+  }
+
+  return 0;
+}
+
+int Loader_Init(LPLOADER pLoader, unsigned int nThreads, const LOADERCALLBACKS* pCallbacks, void* pUserData)
+{
+  memset(pLoader, 0, sizeof(LOADER));
+  pLoader->callbacks = *pCallbacks;
+  pLoader->pUserData = pUserData;
+
+  Mutex_Init(&pLoader->mutex);
+  CondVar_Init(&pLoader->workCond);
+  CondVar_Init(&pLoader->idleCond);
+
+  if (!nThreads) {
+    nThreads = 1;
+  }
+
+  pLoader->pWorkers = (LPLOADERWORKER)calloc(nThreads, sizeof(LOADERWORKER));
+  if (!pLoader->pWorkers) {
+    Loader_Shutdown(pLoader);
+    return LOADER_ERROR_MEMORY;
+  }
+
+  for (unsigned int i = 0; i < nThreads; ++i) {
+    pLoader->pWorkers[i].pLoader = pLoader;
+    if (Thread_Create(&pLoader->pWorkers[i].thread, Loader_WorkerProc, &pLoader->pWorkers[i]) != THREAD_OK) {
+      Loader_Shutdown(pLoader);
+      return LOADER_ERROR_THREAD;
+    }
+    pLoader->nWorkers = i + 1;
+  }
+
+  return LOADER_OK;
+}
+
+/*
+ * Queue a request of nClass and return its generation, which increases with
+ * every submission. The loader owns pArg from here on; if the request cannot
+ * be queued it is completed right away with an error and zero is returned.
+ */
+uint64_t Loader_SubmitClass(LPLOADER pLoader, void* pArg, int nClass, uint64_t nDeadline, int bSupersede)
+{
+  LPLOADREQUEST pRequest = (LPLOADREQUEST)calloc(1, sizeof(LOADREQUEST));
+  if (!pRequest) {
+    pLoader->callbacks.pfnComplete(pArg, NULL, LOADER_ERROR_MEMORY, 0, pLoader->pUserData);
+    return 0;
+  }
+  pRequest->pArg = pArg;
+  pRequest->nClass = nClass < 0 ? 0 : (nClass >= LOADER_CLASSES ? LOADER_CLASSES - 1 : nClass);
+  pRequest->nDeadline = nDeadline;
+
+  LPLOADREQUEST pCancelled = NULL;
+
+  Mutex_Lock(&pLoader->mutex);
+  if (pLoader->bShutdown || !pLoader->nWorkers) {
+    Mutex_Unlock(&pLoader->mutex);
+    Loader_Complete(pLoader, pRequest, NULL, LOADER_ERROR_THREAD);
+    return 0;
+  }
+
+  if (bSupersede) {
+    pCancelled = Loader_DetachLocked(pLoader, Loader_SupersededClasses(pRequest->nClass));
+  }
+
+  pRequest->nGeneration = ++pLoader->nGeneration;
+  Loader_InsertLocked(pLoader, pRequest, 0);
+  Loader_PreemptLocked(pLoader, pRequest->nClass);
+
+  uint64_t nGeneration = pRequest->nGeneration;
+  CondVar_Signal(&pLoader->workCond);
+  Mutex_Unlock(&pLoader->mutex);
+
+  Loader_CompleteCancelled(pLoader, pCancelled);
+
+  return nGeneration;
+}
+
+/* A visible request without a deadline, as Loader_SubmitClass */
+uint64_t Loader_Submit(LPLOADER pLoader, void* pArg, int bSupersede)
+{
+  return Loader_SubmitClass(pLoader, pArg, LOADER_CLASS_VISIBLE, LOADER_NO_DEADLINE, bSupersede);
+}
+
+/* Queue a low priority request, decoded only while no visible one waits */
+uint64_t Loader_Prefetch(LPLOADER pLoader, void* pArg)
+{
+  return Loader_SubmitClass(pLoader, pArg, LOADER_CLASS_PREFETCH, LOADER_NO_DEADLINE, 0);
+}
+
+static void Loader_Cancel(LPLOADER pLoader, unsigned int mask)
+{
+  Mutex_Lock(&pLoader->mutex);
+  LPLOADREQUEST pCancelled = Loader_DetachLocked(pLoader, mask);
+  if (!pLoader->nBusy && Loader_IsQueueEmptyLocked(pLoader)) {
+    CondVar_Broadcast(&pLoader->idleCond);
+  }
+  Mutex_Unlock(&pLoader->mutex);
+
+  Loader_CompleteCancelled(pLoader, pCancelled);
+}
+
+void Loader_CancelAll(LPLOADER pLoader)
+{
+  Loader_Cancel(pLoader, (1u << LOADER_CLASSES) - 1);
+}
+
+void Loader_CancelPrefetch(LPLOADER pLoader)
+{
+  Loader_Cancel(pLoader, 1u << LOADER_CLASS_PREFETCH);
+}
+
+void Loader_CancelClass(LPLOADER pLoader, int nClass)
+{
+  if (nClass >= 0 && nClass < LOADER_CLASSES) {
+    Loader_Cancel(pLoader, 1u << nClass);
+  }
+}
+
+uint64_t Loader_GetGeneration(LPLOADER pLoader)
+{
+  Mutex_Lock(&pLoader->mutex);
+  uint64_t nGeneration = pLoader->nGeneration;
+  Mutex_Unlock(&pLoader->mutex);
+
+  return nGeneration;
+}
+
+uint64_t Loader_GetPreemptions(LPLOADER pLoader)
+{
+  Mutex_Lock(&pLoader->mutex);
+  uint64_t nPreemptions = pLoader->nPreemptions;
+  Mutex_Unlock(&pLoader->mutex);
+
+  return nPreemptions;
+}
+
+/* Block until the queues are drained and no decode is running */
+void Loader_WaitIdle(LPLOADER pLoader)
+{
+  Mutex_Lock(&pLoader->mutex);
+  while (!Loader_IsQueueEmptyLocked(pLoader) || pLoader->nBusy) {
+    CondVar_Wait(&pLoader->idleCond, &pLoader->mutex);
+  }
+  Mutex_Unlock(&pLoader->mutex);
+}
+
+/* Cancel everything and join the workers; every request gets completed */
+void Loader_Shutdown(LPLOADER pLoader)
+{
+  Mutex_Lock(&pLoader->mutex);
+  LPLOADREQUEST pCancelled = Loader_DetachLocked(pLoader, (1u << LOADER_CLASSES) - 1);
+  pLoader->bShutdown = 1;
+  CondVar_Broadcast(&pLoader->workCond);
+  Mutex_Unlock(&pLoader->mutex);
+
+  Loader_CompleteCancelled(pLoader, pCancelled);
+
+  for (unsigned int i = 0; i < pLoader->nWorkers; ++i) {
+    Thread_Join(&pLoader->pWorkers[i].thread);
+  }
+
+  free(pLoader->pWorkers);
+  pLoader->pWorkers = NULL;
+  pLoader->nWorkers = 0;
+
+  CondVar_Destroy(&pLoader->idleCond);
+  CondVar_Destroy(&pLoader->workCond);
+  Mutex_Destroy(&pLoader->mutex);
+}
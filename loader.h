@@ -0,0 +1,138 @@
+/*
+ * loader.h
+ *
+ * Background load pipeline with priorities and cancellation
+ *
+ * Requests are queued to a small pool of worker threads that run the decode
+ * callback. Every request carries a cancellation token the decoder polls
+ * between units of work. Submitting a superseding request, e.g. the next
+ * image while the arrow key is held, drops every queued request of its
+ * class and cancels the ones in flight, so only the latest one is decoded
+ * to the end. A superseding visible request drops the prefetches too, as
+ * they were planned around the image it replaces.
+ *
+ * Each class has a queue of its own: the image to show first, then the
+ * prefetches of its neighbours, then thumbnails. A worker always takes the
+ * head of the first queue that is not empty. Within a class the earliest
+ * deadline goes first, and equal ones in the order they came.
+ *
+ * When a request arrives and every worker is busy with a lower class, one
+ * of those is asked to yield through its token. A decoder that polls
+ * LoadToken_ShouldYield between rows or tiles saves its progress in its
+ * argument and returns LOADER_PREEMPTED; the request goes back to the
+ * front of its queue and its decode is called again later to resume.
+ * Decoders that never poll it simply run to the end.
+ */
+
+#ifndef PANIVIEW_LOADER_H
+#define PANIVIEW_LOADER_H
+
+#include "thread.h"
+
+#include <stdint.h>
+
+enum {
+  LOADER_OK = 0,
+  LOADER_ERROR_MEMORY = -1,
+  LOADER_ERROR_THREAD = -2,
+  LOADER_ERROR_DECODE = -3,
+  LOADER_CANCELLED = -4,
+  LOADER_PREEMPTED = -5,      /* From pfnDecode only: queue it again to resume */
+};
+
+/* Priority classes, served in this order */
+enum {
+  LOADER_CLASS_VISIBLE = 0,
+  LOADER_CLASS_PREFETCH = 1,
+  LOADER_CLASS_THUMBNAIL = 2,
+  LOADER_CLASSES = 3,
+};
+
+/* Deadlines are in any unit the caller picks, as long as it is the same throughout */
+#define LOADER_NO_DEADLINE UINT64_MAX
+
+typedef struct _tagLOADTOKEN LOADTOKEN, *LPLOADTOKEN;
+typedef struct _tagLOADREQUEST LOADREQUEST, *LPLOADREQUEST;
+typedef struct _tagLOADQUEUE LOADQUEUE, *LPLOADQUEUE;
+typedef struct _tagLOADERCALLBACKS LOADERCALLBACKS, *LPLOADERCALLBACKS;
+typedef struct _tagLOADERWORKER LOADERWORKER, *LPLOADERWORKER;
+typedef struct _tagLOADER LOADER, *LPLOADER;
+
+struct _tagLOADTOKEN {
+  volatile long bCancelled;
+  volatile long bYield;       /* A higher class waits for this worker */
+};
+
+struct _tagLOADREQUEST {
+  uint64_t nGeneration;
+  void* pArg;
+  LOADTOKEN token;
+  int nClass;
+  uint64_t nDeadline;
+  LPLOADREQUEST pNext;
+};
+
+/* Sorted by deadline */
+struct _tagLOADQUEUE {
+  LPLOADREQUEST pHead;
+  LPLOADREQUEST pTail;
+};
+
+struct _tagLOADERCALLBACKS {
+  /* Optional per-worker setup and teardown, e.g. COM initialization */
+  void (*pfnThreadStart)(void* pUserData);
+  void (*pfnThreadStop)(void* pUserData);
+
+  /*
+   * Runs on a worker. Returns LOADER_OK and stores the result, an error, or
+   * LOADER_PREEMPTED to be called again later with the same arguments.
+   */
+  int (*pfnDecode)(void* pArg, LPLOADTOKEN pToken, void** ppResult, void* pUserData);
+
+  /*
+   * Called exactly once per submitted request, on a worker or on the thread
+   * that cancelled the request. Owns pArg and pResult (NULL unless decoded)
+   * from then on, also when the status is LOADER_CANCELLED.
+   */
+  void (*pfnComplete)(void* pArg, void* pResult, int status, uint64_t nGeneration, void* pUserData);
+};
+
+struct _tagLOADERWORKER {
+  THREAD thread;
+  LPLOADER pLoader;
+  LPLOADREQUEST pRunning;     /* Request in flight, or NULL */
+};
+
+struct _tagLOADER {
+  LOADERCALLBACKS callbacks;
+  void* pUserData;
+
+  MUTEX mutex;
+  CONDVAR workCond;           /* Signalled when requests are queued */
+  CONDVAR idleCond;           /* Broadcast when the last busy worker goes idle */
+  LOADQUEUE queues[LOADER_CLASSES];
+  unsigned int nBusy;
+  uint64_t nGeneration;       /* Last one handed out */
+  uint64_t nPreemptions;      /* Decodes that yielded */
+  int bShutdown;
+
+  LPLOADERWORKER pWorkers;
+  unsigned int nWorkers;
+};
+
+int LoadToken_IsCancelled(LPLOADTOKEN pToken);
+int LoadToken_ShouldYield(LPLOADTOKEN pToken);
+
+int Loader_Init(LPLOADER pLoader, unsigned int nThreads, const LOADERCALLBACKS* pCallbacks, void* pUserData);
+uint64_t Loader_Submit(LPLOADER pLoader, void* pArg, int bSupersede);
+uint64_t Loader_Prefetch(LPLOADER pLoader, void* pArg);
+uint64_t Loader_SubmitClass(LPLOADER pLoader, void* pArg, int nClass, uint64_t nDeadline, int bSupersede);
+void Loader_CancelAll(LPLOADER pLoader);
+void Loader_CancelPrefetch(LPLOADER pLoader);
+void Loader_CancelClass(LPLOADER pLoader, int nClass);
+uint64_t Loader_GetGeneration(LPLOADER pLoader);
+uint64_t Loader_GetPreemptions(LPLOADER pLoader);
+void Loader_WaitIdle(LPLOADER pLoader);
+void Loader_Shutdown(LPLOADER pLoader);
+
+#endif /* PANIVIEW_LOADER_H */
@@ -0,0 +1,170 @@
+#include "msgqueue.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef UNIT_TESTING
+extern void* _test_calloc(const size_t num, const size_t size, const char* file,
+  const int line);
+
+#define calloc(num, size) _test_calloc(num, size, __FILE__, __LINE__)
+
+extern void _test_free(void* const ptr, const char* file, const int line);
+
+#define free(ptr) _test_free(ptr, __FILE__, __LINE__)
+#endif
+
+/* Indices are compared as distances, so a ring is at most half their range */
+#define MSGQUEUE_MAX_CAPACITY ((size_t)1 << 30)
+
+/* At least 2: in a single cell, full would look free for the next index */
+static size_t MsgQueue_RoundCapacity(size_t capacity)
+{
+  size_t n = 2;
+  while (n < capacity && n < MSGQUEUE_MAX_CAPACITY) {
+    n <<= 1;
+  }
+
+  return n;
+}
+
+int SpscQueue_Init(LPSPSCQUEUE pQueue, size_t capacity)
+{
+  memset(pQueue, 0, sizeof(SPSCQUEUE));
+
+  capacity = MsgQueue_RoundCapacity(capacity);
+  pQueue->ppSlots = (void**)calloc(capacity, sizeof(void*));
+  if (!pQueue->ppSlots) {
+    return MSGQUEUE_ERROR_MEMORY;
+  }
+
+  pQueue->mask = (unsigned long)capacity - 1;
+  return MSGQUEUE_OK;
+}
+
+void SpscQueue_Cleanup(LPSPSCQUEUE pQueue)
+{
+  free(pQueue->ppSlots);
+  memset(pQueue, 0, sizeof(SPSCQUEUE));
+}
+
+int SpscQueue_Push(LPSPSCQUEUE pQueue, void* pValue)
+{
+  unsigned long nTail = (unsigned long)pQueue->nTail;
+
+  if (nTail - (unsigned long)pQueue->nHeadCache > pQueue->mask) {
+    pQueue->nHeadCache = Atomic_LoadAcquire(&pQueue->nHead);
+    if (nTail - (unsigned long)pQueue->nHeadCache > pQueue->mask) {
+      return 0;
+    }
+  }
+
+  pQueue->ppSlots[nTail & pQueue->mask] = pValue;
+  Atomic_StoreRelease(&pQueue->nTail, (long)(nTail + 1));
+  return 1;
+}
+
+int SpscQueue_Pop(LPSPSCQUEUE pQueue, void** ppValue)
+{
+  unsigned long nHead = (unsigned long)pQueue->nHead;
+
+  if (nHead == (unsigned long)pQueue->nTailCache) {
+    pQueue->nTailCache = Atomic_LoadAcquire(&pQueue->nTail);
+    if (nHead == (unsigned long)pQueue->nTailCache) {
+      return 0;
+    }
+  }
+
+  *ppValue = pQueue->ppSlots[nHead & pQueue->mask];
+  Atomic_StoreRelease(&pQueue->nHead, (long)(nHead + 1));
+  return 1;
+}
+
+int MpscQueue_Init(LPMPSCQUEUE pQueue, size_t capacity)
+{
+  memset(pQueue, 0, sizeof(MPSCQUEUE));
+
+  capacity = MsgQueue_RoundCapacity(capacity);
+  pQueue->pCells = (LPMPSCCELL)calloc(capacity, sizeof(MPSCCELL));
+  if (!pQueue->pCells) {
+    return MSGQUEUE_ERROR_MEMORY;
+  }
+
+  for (size_t i = 0; i < capacity; ++i) {
+    pQueue->pCells[i].nSequence = (long)i;
+  }
+
+  pQueue->mask = (unsigned long)capacity - 1;
+  return MSGQUEUE_OK;
+}
+
+void MpscQueue_Cleanup(LPMPSCQUEUE pQueue)
+{
+  free(pQueue->pCells);
+  memset(pQueue, 0, sizeof(MPSCQUEUE));
+}
+
+/*
+ * MpscQueue_Push
+ *
+ * A cell whose sequence equals the tail is free to claim. One a lap behind
+ * it still holds a value the consumer has not taken, so the queue is full;
+ * one ahead of it was claimed by another producer since the tail was read.
+ */
+int MpscQueue_Push(LPMPSCQUEUE pQueue, void* pValue)
+{
+  unsigned long nTail = (unsigned long)Atomic_Load(&pQueue->nTail);
+
+  for (;;) {
+    LPMPSCCELL pCell = &pQueue->pCells[nTail & pQueue->mask];
+    long diff = (long)((unsigned long)Atomic_LoadAcquire(&pCell->nSequence) - nTail);
+
+    if (!diff) {
+      unsigned long nSeen = (unsigned long)Atomic_CompareExchange(&pQueue->nTail, (long)(nTail + 1), (long)nTail);
+      if (nSeen == nTail) {
+        pCell->pValue = pValue;
+        Atomic_StoreRelease(&pCell->nSequence, (long)(nTail + 1));
+        return 1;
+      }
+      nTail = nSeen;
+    }
+    else if (diff < 0) {
+      return 0;
+    }
+    else {
+      nTail = (unsigned long)Atomic_Load(&pQueue->nTail);
+    }
+  }
+}
+
+int MpscQueue_Pop(LPMPSCQUEUE pQueue, void** ppValue)
+{
+  unsigned long nHead = (unsigned long)pQueue->nHead;
+  LPMPSCCELL pCell = &pQueue->pCells[nHead & pQueue->mask];
+
+  if ((unsigned long)Atomic_LoadAcquire(&pCell->nSequence) != nHead + 1) {
+    return 0;
+  }
+
+  /* Free for the push a lap ahead */
+  *ppValue = pCell->pValue;
+  Atomic_StoreRelease(&pCell->nSequence, (long)(nHead + pQueue->mask + 1));
+  pQueue->nHead = (long)(nHead + 1);
+  return 1;
+}
+
+void QueueWake_Init(LPQUEUEWAKE pWake)
+{
+  pWake->bRaised = 0;
+}
+
+int QueueWake_Raise(LPQUEUEWAKE pWake)
+{
+  return !Atomic_Exchange(&pWake->bRaised, 1);
+}
+
+/* An exchange rather than a store, so the drain sees every push that found it raised */
+void QueueWake_Reset(LPQUEUEWAKE pWake)
+{
+  Atomic_Exchange(&pWake->bRaised, 0);
+}
@@ -0,0 +1,100 @@
+/*
+ * msgqueue.h
+ *
+ * Bounded lock-free queues for handing results to the UI thread
+ *
+ * Workers push pointers to finished work and the UI thread pops them in its
+ * message loop, so neither side ever blocks on the other. The single
+ * producer queue is a plain ring whose two indices each sit on a cache line
+ * of their own, with a copy of the other side's index next to them that is
+ * only reloaded when the ring looks full or empty. The multi-producer queue
+ * lets producers claim slots with a compare-exchange on the tail and
+ * publish each slot through a sequence number of its own, after Vyukov's
+ * bounded queue; its single consumer needs no atomic read-modify-write.
+ *
+ * A QUEUEWAKE coalesces wakeups: only the first push after the consumer
+ * last drained the queue is told to post the window message, however many
+ * follow before the consumer gets to it.
+ */
+
+#ifndef PANIVIEW_MSGQUEUE_H
+#define PANIVIEW_MSGQUEUE_H
+
+#include "thread.h"
+
+#include <stddef.h>
+
+#define MSGQUEUE_CACHE_LINE 64
+
+enum {
+  MSGQUEUE_OK = 0,
+  MSGQUEUE_ERROR_MEMORY = -1,
+};
+
+typedef struct _tagSPSCQUEUE SPSCQUEUE, *LPSPSCQUEUE;
+typedef struct _tagMPSCCELL MPSCCELL, *LPMPSCCELL;
+typedef struct _tagMPSCQUEUE MPSCQUEUE, *LPMPSCQUEUE;
+typedef struct _tagQUEUEWAKE QUEUEWAKE, *LPQUEUEWAKE;
+
+/* Indices count up forever and wrap; the slot is the index masked */
+struct _tagSPSCQUEUE {
+  void** ppSlots;
+  unsigned long mask;
+  char padding0[MSGQUEUE_CACHE_LINE];
+  volatile long nHead;        /* Next to pop, written by the consumer */
+  long nTailCache;            /* The consumer's last look at nTail */
+  char padding1[MSGQUEUE_CACHE_LINE];
+  volatile long nTail;        /* Next to push, written by the producer */
+  long nHeadCache;            /* The producer's last look at nHead */
+  char padding2[MSGQUEUE_CACHE_LINE];
+};
+
+struct _tagMPSCCELL {
+  volatile long nSequence;    /* Index it can be pushed at, or that plus 1 once full */
+  void* pValue;
+};
+
+struct _tagMPSCQUEUE {
+  LPMPSCCELL pCells;
+  unsigned long mask;
+  char padding0[MSGQUEUE_CACHE_LINE];
+  volatile long nTail;        /* Next to claim, shared by the producers */
+  char padding1[MSGQUEUE_CACHE_LINE];
+  long nHead;                 /* Next to pop, the consumer's alone */
+  char padding2[MSGQUEUE_CACHE_LINE];
+};
+
+struct _tagQUEUEWAKE {
+  volatile long bRaised;
+};
+
+/* Room for capacity values, rounded up to a power of 2 and at least 2 */
+int SpscQueue_Init(LPSPSCQUEUE pQueue, size_t capacity);
+void SpscQueue_Cleanup(LPSPSCQUEUE pQueue);
+
+/* Nonzero when queued, 0 when the queue is full */
+int SpscQueue_Push(LPSPSCQUEUE pQueue, void* pValue);
+
+/* Nonzero when a value was taken, 0 when the queue is empty */
+int SpscQueue_Pop(LPSPSCQUEUE pQueue, void** ppValue);
+
+int MpscQueue_Init(LPMPSCQUEUE pQueue, size_t capacity);
+void MpscQueue_Cleanup(LPMPSCQUEUE pQueue);
+int MpscQueue_Push(LPMPSCQUEUE pQueue, void* pValue);
+
+/*
+ * As SpscQueue_Pop. A producer that claimed the slot at the head and has
+ * not filled it yet makes the queue look empty until it does; it then
+ * raises the wakeup like any other push.
+ */
+int MpscQueue_Pop(LPMPSCQUEUE pQueue, void** ppValue);
+
+void QueueWake_Init(LPQUEUEWAKE pWake);
+
+/* After a push: nonzero when this one has to wake the consumer */
+int QueueWake_Raise(LPQUEUEWAKE pWake);
+
+/* Before draining: pushes from here on wake the consumer again */
+void QueueWake_Reset(LPQUEUEWAKE pWake);
+
+#endif /* PANIVIEW_MSGQUEUE_H */
@@ -0,0 +1,63 @@
+#include "navburst.h"
+
+#include <string.h>
+
+void NavBurst_Init(LPNAVBURST pBurst, uint64_t nSettleMs)
+{
+  memset(pBurst, 0, sizeof(NAVBURST));
+  pBurst->nSettleMs = nSettleMs;
+}
+
+int NavBurst_OnStep(LPNAVBURST pBurst, uint64_t nNow, int bRepeat)
+{
+  int bQuiet = !pBurst->bStepped || nNow - pBurst->nLastStep >= pBurst->nSettleMs;
+
+  ++pBurst->stats.steps;
+  pBurst->nLastStep = nNow;
+  pBurst->bStepped = 1;
+
+  if (!bRepeat && bQuiet) {
+    pBurst->bDeferred = 0;
+    ++pBurst->stats.decodes;
+    return 1;
+  }
+
+  pBurst->bDeferred = 1;
+  ++pBurst->stats.deferred;
+  return 0;
+}
+
+int NavBurst_OnRelease(LPNAVBURST pBurst)
+{
+  if (!pBurst->bDeferred) {
+    return 0;
+  }
+
+  pBurst->bDeferred = 0;
+  ++pBurst->stats.decodes;
+  return 1;
+}
+
+int NavBurst_OnTimer(LPNAVBURST pBurst, uint64_t nNow)
+{
+  if (!pBurst->bDeferred || nNow - pBurst->nLastStep < pBurst->nSettleMs) {
+    return 0;
+  }
+
+  return NavBurst_OnRelease(pBurst);
+}
+
+uint64_t NavBurst_GetDelay(LPNAVBURST pBurst, uint64_t nNow)
+{
+  if (!pBurst->bDeferred || nNow - pBurst->nLastStep >= pBurst->nSettleMs) {
+    return 0;
+  }
+
+  return pBurst->nSettleMs - (nNow - pBurst->nLastStep);
+}
+
+void NavBurst_Reset(LPNAVBURST pBurst)
+{
+  pBurst->bStepped = 0;
+  pBurst->bDeferred = 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * navburst.h
+ *
+ * Coalescing of navigation steps while a key is held
+ *
+ * A held arrow key steps through the directory at the keyboard repeat rate,
+ * faster than most images decode. Decoding every one of them only to cancel
+ * it at the next step keeps the decoders and the disk busy with images
+ * nobody sees. The burst tracker decides per step whether to decode now or
+ * to show a placeholder and wait: a step after a quiet spell decodes right
+ * away, so single steps cost nothing extra, while repeats and steps that
+ * follow each other within nSettleMs are deferred. The last deferred step
+ * is decoded when the key goes up, or once no step came for nSettleMs.
+ *
+ * Times are in milliseconds from any monotonic clock.
+ */
+
+#ifndef PANIVIEW_NAVBURST_H
+#define PANIVIEW_NAVBURST_H
+
+#include <stdint.h>
+
+typedef struct _tagNAVBURSTSTATS NAVBURSTSTATS, *LPNAVBURSTSTATS;
+typedef struct _tagNAVBURST NAVBURST, *LPNAVBURST;
+
+struct _tagNAVBURSTSTATS {
+  uint64_t steps;
+  uint64_t deferred;          /* Steps that only got a placeholder */
+  uint64_t decodes;           /* Steps decoded, right away or once settled */
+};
+
+struct _tagNAVBURST {
+  uint64_t nSettleMs;         /* Quiet time that ends a burst */
+  uint64_t nLastStep;         /* Time of the latest step */
+  int bStepped;               /* nLastStep is valid */
+  int bDeferred;              /* The latest step waits for its decode */
+  NAVBURSTSTATS stats;
+};
+
+void NavBurst_Init(LPNAVBURST pBurst, uint64_t nSettleMs);
+
+/*
+ * A step to another image at nNow, bRepeat when it came from an
+ * auto-repeated key. Nonzero when it is to be decoded right away, 0 when
+ * only a placeholder should be shown until the burst settles.
+ */
+int NavBurst_OnStep(LPNAVBURST pBurst, uint64_t nNow, int bRepeat);
+
+/* The key went up: nonzero when the latest step still has to be decoded */
+int NavBurst_OnRelease(LPNAVBURST pBurst);
+
+/* Nonzero once the latest step was deferred and no other came for nSettleMs */
+int NavBurst_OnTimer(LPNAVBURST pBurst, uint64_t nNow);
+
+/* Milliseconds until a deferred step settles, 0 when due or none is deferred */
+uint64_t NavBurst_GetDelay(LPNAVBURST pBurst, uint64_t nNow);
+
+/* A file opened directly ends any burst, nothing is left to decode */
+void NavBurst_Reset(LPNAVBURST pBurst);
+
+#endif /* PANIVIEW_NAVBURST_H */
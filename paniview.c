@@ -8,8 +8,27 @@
 #include "precomp.h"
 #include "resource.h"
 
-#include "dlnklist.h"
+#include "dirindex.h"
+#include "filemap.h"
+#include "gltexture.h"
+#include "gltiles.h"
+#include "glupload.h"
 #include "hashmap.h"
+#include "imageinfo.h"
+#include "imgcache.h"
+#include "imgformat.h"
+#include "loader.h"
+#include "msgqueue.h"
+#include "navburst.h"
+#include "pixbuf.h"
+#include "pgm.h"
+#include "pixconv.h"
+#include "prefetch.h"
+#include "pyramid.h"
+#include "rasterfile.h"
+#include "resample.h"
+#include "taskpool.h"
+#include "viewport.h"
 
 #include <GL/glew.h>
 #include <GL/wglew.h>
@@ -22,6 +41,7 @@
 #define WM_ZOOMIN     WM_USER + 5
 #define WM_ACTUALSIZE WM_USER + 6
 #define WM_FIT        WM_USER + 7
+#define WM_LOADCOMPLETE WM_USER + 8 /* Finished loads are queued; one message for all of them */
 
 /* COM object releaser */
 #define SAFE_RELEASE(obj) \
@@ -94,12 +114,13 @@ enum {
 };
 
 enum {
-  MIME_UNKNOWN = 0,
-  MIME_IMAGE_PNG = 1,
-  MIME_IMAGE_JPG = 2,
-  MIME_IMAGE_GIF = 3,
-  MIME_IMAGE_WEBP = 4,
-  MIME_IMAGE_PGM = 5,
+  MIME_UNKNOWN = IMGFORMAT_UNKNOWN,
+  MIME_IMAGE_PNG = IMGFORMAT_PNG,
+  MIME_IMAGE_JPG = IMGFORMAT_JPEG,
+  MIME_IMAGE_GIF = IMGFORMAT_GIF,
+  MIME_IMAGE_WEBP = IMGFORMAT_WEBP,
+  MIME_IMAGE_PGM = IMGFORMAT_PGM,
+  MIME_IMAGE_BMP = IMGFORMAT_BMP,
 };
 
 typedef struct _tagSETTINGS SETTINGS, * LPSETTINGS;
@@ -122,6 +143,8 @@ struct _tagSETTINGS {
   int nRendererType;
   int nToolbarTheme;
   BOOL bFit;
+  unsigned long nImageCacheMB;  /* Budget of the decoded image cache */
+  unsigned long nPrefetchDepth; /* Neighbours decoded ahead, 0 disables */
 };
 
 struct _tagNAVIASSOCENTRY {
@@ -133,12 +156,6 @@ HINSTANCE g_hInst;
 
 const unsigned char g_cfgMagic[4] = { 'P', 'N', 'V', 0xE5 };
 
-const unsigned char g_pngMagic[] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
-const unsigned char g_gifMagic[] = { 'G', 'I', 'F', '8'};
-const unsigned char g_jpgMagic[] = { 0xFF, 0xD8, 0xFF };
-const unsigned char g_webpMagic[] = { 'R', 'I', 'F', 'F', 'W', 'E', 'B', 'P' };
-const unsigned char g_pgmMagic[] = { 'P', '5' };
-
 const WCHAR szPaniView[] = L"PaniView";
 const WCHAR szPaniViewClassName[] = L"PaniView_Main";
 const WCHAR szRenderCtlClassName[] = L"PaniView_Renderer";
@@ -154,8 +171,6 @@ BOOL GetApplicationDataSitePath(PWSTR* ppStr);
 
 unsigned long crc32(unsigned char *data, size_t length);
 
-int compareHWND(const void* key1, size_t key1Size, const void* key2, size_t key2Size);
-
 /* Direct2D Utility functions forward declaration */
 static inline D2D1_MATRIX_3X2_F D2DUtilMatrixIdentity(void);
 static inline D2D1_MATRIX_3X2_F D2DUtilMakeTranslationMatrix(D2D1_SIZE_F size);
@@ -176,8 +191,52 @@ BOOL Settings_LoadFile(SETTINGS *pSettings, PWSTR pszPath);
 BOOL Settings_SaveFile(SETTINGS *pSettings, PWSTR pszPath);
 BOOL Settings_LoadDefault(SETTINGS *pSettings);
 
-IWICBitmapSource* WICDecodeFromFilename(LPWSTR pszPath);
-IWICBitmapSource* WICLoadFromMemory(int width, int height, unsigned char* data, REFWICPixelFormatGUID pixelFormat);
+HRESULT WICDecodeFromFilename(PCWSTR pszPath, LPLOADTOKEN pToken, IWICBitmapSource** ppBitmap);
+HRESULT WICDecodeFromFileMap(PCWSTR pszPath, const FILEMAP* pMap, LPLOADTOKEN pToken, IWICBitmapSource** ppBitmap);
+HRESULT WICConvertBitmapSource(IWICBitmapSource* pSource, LPLOADTOKEN pToken, IWICBitmapSource** ppResult);
+IWICBitmap* WICCreatePBGRABitmap(UINT width, UINT height, IWICBitmapLock** ppLock, UINT* pcbStride, BYTE** ppData);
+IWICBitmapLock* WICLockBitmapSource(IWICBitmapSource* pSource, UINT* pcbStride, BYTE** ppData);
+void WICSetCurrentBitmap(IWICBitmapSource* pBitmap);
+
+/* IWICBitmap over a pixel buffer */
+typedef struct _tagPIXBUFBITMAP {
+  IWICBitmap base;
+  volatile LONG nRefs;
+  LPPIXBUF pPixBuf;
+  PYRAMID pyramid;              /* Built once decoded, no levels until then */
+} PIXBUFBITMAP, * LPPIXBUFBITMAP;
+
+typedef struct _tagPIXBUFBITMAPLOCK {
+  IWICBitmapLock base;
+  volatile LONG nRefs;
+  LPPIXBUFBITMAP pBitmap;       /* Referenced */
+  WICRect rc;
+} PIXBUFBITMAPLOCK, * LPPIXBUFBITMAPLOCK;
+
+IWICBitmap* PixBufBitmap_Create(UINT width, UINT height, int nFormat, const PIXBUFALLOCATOR* pAllocator);
+IWICBitmap* PixBufBitmap_CreateFromPixBuf(LPPIXBUF pPixBuf);
+LPPIXBUF PixBufBitmap_GetPixBuf(IWICBitmapSource* pSource);
+HRESULT PixBufBitmap_BuildPyramid(IWICBitmapSource* pSource);
+const PYRAMID* PixBufBitmap_GetPyramid(IWICBitmapSource* pSource);
+void* DIBPixBuf_Alloc(const PIXBUF* pPixBuf, void** ppHandle, void* pUserData);
+void DIBPixBuf_Free(void* pData, void* pHandle, void* pUserData);
+void FileMapPixBuf_Free(void* pData, void* pHandle, void* pUserData);
+
+/* IWICBitmapSource over a raster left in its file, read a region at a time */
+typedef struct _tagRASTERBITMAP {
+  IWICBitmapSource base;
+  volatile LONG nRefs;
+  FILEMAP map;
+  RASTERFILE raster;
+  IWICBitmap* pPreview;         /* Made the first time a renderer asks */
+} RASTERBITMAP, * LPRASTERBITMAP;
+
+HRESULT RasterBitmap_CreateFromFileMap(LPFILEMAP pMap, IWICBitmapSource** ppBitmap);
+LPRASTERFILE RasterBitmap_GetRasterFile(IWICBitmapSource* pSource);
+unsigned int RasterBitmap_GetPreviewScale(uint64_t width, uint64_t height);
+IWICBitmapSource* RasterBitmap_GetPreview(IWICBitmapSource* pSource);
+int RasterBitmap_ReadLevel(void* pUserData, size_t nLevel, size_t left, size_t top, size_t right, size_t bottom,
+    void* pDest, size_t destStride);
 
 /* Window */
 typedef struct _tagWINDOW WINDOW, * LPWINDOW;
@@ -212,15 +271,37 @@ void Window_OnPaint(LPWINDOW pWindow);
 void Window_OnDestroy(LPWINDOW pWindow);
 
 /* Window Map */
-HASHMAP g_windowMap;
+HASHTABLE g_windowMap;
+
+/* Images of the directory being browsed, kept between keypresses */
+DIRINDEX g_dirIndex;
+
+/*
+ * Decoder attached to every format of the registry. It reads the file from
+ * its mapping; one whose bitmap keeps using the mapped bytes takes the
+ * mapping over and leaves pMap empty.
+ */
+typedef struct _tagIMGDECODER {
+  HRESULT (*pfnDecode)(PCWSTR pszPath, LPFILEMAP pMap, LPLOADTOKEN pToken, IWICBitmapSource** ppBitmap);
+} IMGDECODER, * LPIMGDECODER;
+
+/* Known formats, filled at startup and read-only afterwards */
+IMGFORMATREGISTRY g_imageFormats;
+
+void ImageFormats_Initialize(void);
 
 void WindowMap_Initialize(void);
 void WindowMap_Add(HWND hWnd, LPWINDOW pWindow);
 LPWINDOW WindowMap_Find(HWND hWnd);
+void WindowMap_Remove(HWND hWnd);
 
 /* RenderCtl2 */
 struct _tagRENDERCTL2 {
   WINDOW base;
+
+  BOOL m_bDragging;           /* Panned by the mouse, which is captured */
+  POINT m_ptDrag;             /* Where the cursor was at the last move */
+  int m_nWheelDelta;          /* Rotation short of a whole zoom step */
 };
 
 void RenderCtl2_Init(LPRENDERCTL2 pRenderCtl);
@@ -232,6 +313,11 @@ void RenderCtl2_OnCreate(LPRENDERCTL2 pRenderCtl, LPCREATESTRUCT lpcs);
 void RenderCtl2_OnSize(LPRENDERCTL2 pRenderCtl, UINT state, int cx, int cy);
 void RenderCtl2_OnPaint(LPRENDERCTL2 pRenderCtl);
 BOOL RenderCtl2_OnCommand(LPRENDERCTL2 pRenderCtl, WPARAM wParam, LPARAM lParam);
+void RenderCtl2_OnZoom(LPRENDERCTL2 pRenderCtl, UINT message, WPARAM wParam, LPARAM lParam);
+void RenderCtl2_OnMouseWheel(LPRENDERCTL2 pRenderCtl, UINT message, WPARAM wParam, LPARAM lParam);
+void RenderCtl2_OnLButtonDown(LPRENDERCTL2 pRenderCtl, int x, int y);
+void RenderCtl2_OnMouseMove(LPRENDERCTL2 pRenderCtl, int x, int y);
+void RenderCtl2_OnLButtonUp(LPRENDERCTL2 pRenderCtl);
 void RenderCtl2_OnDestroy(LPRENDERCTL2 pRenderCtl);
 
 /* PaniView Frame */
@@ -254,6 +340,7 @@ void PaniViewFrame_OnFileOpenCommand(LPPANIVIEWFRAME pPaniViewFrame);
 void PaniViewFrame_OnViewPrevCommand(LPPANIVIEWFRAME pPaniViewFrame);
 void PaniViewFrame_OnViewNextCommand(LPPANIVIEWFRAME pPaniViewFrame);
 void PaniViewFrame_OnViewFitCommand(LPPANIVIEWFRAME pPaniViewFrame);
+void PaniViewFrame_OnViewZoomCommand(LPPANIVIEWFRAME pPaniViewFrame, UINT message);
 
 /* Direct2D renderer context data structure */
 typedef struct _tagD2DRENDERERCONTEXT {
@@ -263,6 +350,11 @@ typedef struct _tagD2DRENDERERCONTEXT {
   ID2D1HwndRenderTarget* m_pRenderTarget;
   ID2D1Bitmap* m_pD2DBitmap;
 
+  /* Drawn instead of m_pD2DBitmap when the image is shrunk enough for a
+   * pyramid level; 0 when there is none */
+  ID2D1Bitmap* m_pD2DLevelBitmap;
+  size_t m_nLevel;
+
   ID2D1SolidColorBrush* m_pLightSlateGrayBrush;
   ID2D1SolidColorBrush* m_pCornflowerBlueBrush;
 } D2DRENDERERCONTEXT, * LPD2DRENDERERCONTEXT;
@@ -271,6 +363,8 @@ typedef struct _tagD2DRENDERERCONTEXT {
 HRESULT D2DRendererContext_CreateDeviceResources(LPD2DRENDERERCONTEXT pD2DRendererContext, HWND hWnd);
 void D2DRendererContext_DiscardDeviceResources(LPD2DRENDERERCONTEXT pD2DRendererContext);
 void D2DRendererContext_Draw(LPD2DRENDERERCONTEXT pD2DRendererContext, LPRENDERCTL2 pRenderCtl);
+ID2D1Bitmap* D2DRendererContext_SelectLevel(LPD2DRENDERERCONTEXT pD2DRendererContext, IWICBitmapSource* pSource,
+    float scale);
 void D2DRendererContext_LoadWICBitmap(LPD2DRENDERERCONTEXT pD2DRendererContext, IWICBitmapSource* pIWICBitmapSource);
 void D2DRendererContext_Release(LPD2DRENDERERCONTEXT pD2DRendererContext);
 void D2DRendererContext_Resize(LPD2DRENDERERCONTEXT pD2DRendererContext, int cx, int cy);
@@ -293,6 +387,15 @@ typedef struct _tagOPENGLRENDERERCONTEXT {
   float m_viewportHeight;
   float m_imageWidth;
   float m_imageHeight;
+  BOOL m_bGrayscale;          /* Texture holds one channel, see frag.glsl */
+  GLTEXLEVEL m_textureLevel;  /* Kept while images keep their size and format */
+  GLUPLOADRING m_uploadRing;
+  IWICBitmapSource* m_pBitmapSource;  /* Holds the pixels tiles and pyramid levels are read from */
+  size_t m_nPyramidLevel;             /* Level of the image m_textureId holds */
+
+  /* Large images are drawn from tiles instead of m_textureId */
+  BOOL m_bTiled;
+  GLTILES m_tiles;
 } OPENGLRENDERERCONTEXT, * LPOPENGLRENDERERCONTEXT;
 
 /* OpenGL Renderer context forward declarations */
@@ -301,6 +404,12 @@ void OpenGLRendererContext_CreateDeviceResources(LPOPENGLRENDERERCONTEXT pGLRend
 void OpenGLRendererContext_CreateTexture(LPOPENGLRENDERERCONTEXT pGLRendererContext);
 void OpenGLRendererContext_Draw(LPOPENGLRENDERERCONTEXT pGLRendererContext, LPRENDERCTL2 pRenderCtl);
 void OpenGLRendererContext_DrawVBO(LPOPENGLRENDERERCONTEXT pGLRendererContext);
+void OpenGLRendererContext_DrawTiles(LPOPENGLRENDERERCONTEXT pGLRendererContext);
+void OpenGLRendererContext_GetImageToClip(LPOPENGLRENDERERCONTEXT pGLRendererContext, GLfloat imageToClip[16]);
+size_t OpenGLRendererContext_SelectLevel(LPOPENGLRENDERERCONTEXT pGLRendererContext);
+void OpenGLRendererContext_UploadTexture(LPOPENGLRENDERERCONTEXT pGLRendererContext, IWICBitmapSource* pBitmapSource,
+    const PIXBUF* pPixBuf, UINT width, UINT height, int nFormat);
+void OpenGLRendererContext_ReleaseTiles(LPOPENGLRENDERERCONTEXT pGLRendererContext);
 GLuint OpenGLRendererContext_LoadShader(LPOPENGLRENDERERCONTEXT lpGLRendererContext, PCWSTR shaderFilePath, GLuint shaderType);
 GLuint OpenGLRendererContext_LoadShaders(LPOPENGLRENDERERCONTEXT pGLRendererContext, PCWSTR vertexFilePath, PCWSTR fragmentFilePath);
 void OpenGLRendererContext_LoadWICBitmap(LPOPENGLRENDERERCONTEXT pGLRendererContext, IWICBitmapSource* pBitmapSource);
@@ -313,13 +422,29 @@ LPOPENGLRENDERERCONTEXT CreateOpenGLRenderer(void);
 typedef struct _tagGDIRENDERERCONTEXT {
   RENDERERCONTEXT base;
 
-  HBITMAP m_hBitmap;
+  IWICBitmapSource* m_pBitmapSource;   /* Referenced, rescaled from on resize */
+  LPPIXBUF m_pPixBuf;                 /* Its pixels when they are in a DIB section */
   int m_width;
   int m_height;
+
+  /* The visible part of the image at its size on screen, blitted 1:1 */
+  HDC m_hScaledDC;
+  HBITMAP m_hScaledBitmap;            /* Selected into m_hScaledDC */
+  HBITMAP m_hOldBitmap;
+  BOOL m_bScaledOwned;                /* Else the image's own DIB section */
+  POINT m_ptScaledOrigin;             /* Where the kept part starts in it */
+  int m_scaledWidth;                  /* Whole image on screen */
+  int m_scaledHeight;
+  RECT m_rcScaledCrop;                /* Part kept, in scaled image coordinates */
+  HBRUSH m_hBackgroundBrush;
+
 } GDIRENDERERCONTEXT, * LPGDIRENDERERCONTEXT;
 
 /* GDI Renderer context forward declarations */
 void GDIRendererContext_Draw(LPGDIRENDERERCONTEXT pGDIRendererContext, LPRENDERCTL2 pRenderCtl);
+BOOL GDIRendererContext_UpdateScaledBitmap(LPGDIRENDERERCONTEXT pGDIRendererContext, HDC hdc, int width, int height,
+    const RECT* prcCrop);
+void GDIRendererContext_DeleteScaledBitmap(LPGDIRENDERERCONTEXT pGDIRendererContext);
 void GDIRendererContext_LoadWICBitmap(LPGDIRENDERERCONTEXT pGDIRendererContext, IWICBitmapSource* pBitmapSource);
 void GDIRendererContext_Release(LPGDIRENDERERCONTEXT pGDIRendererContext);
 void GDIRendererContext_Resize(LPGDIRENDERERCONTEXT pGDIRendererContext, int cx, int cy);
@@ -329,12 +454,99 @@ LPGDIRENDERERCONTEXT CreateGDIRenderer(void);
 HRESULT InvokeFileOpenDialog(LPWSTR* ppszPath);
 
 int GetFileMIMEType(PCWSTR pszPath);
+BOOL IndexDirOfFile(PCWSTR pszFile, PWSTR pszDir, char* pszNameUtf8, int cbName);
 BOOL NextFileInDir(PWSTR pszCurrent, BOOL fNext, PWSTR lpPathOut);
 
 INT_PTR CALLBACK AboutDlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
 INT_PTR CALLBACK SettingsDlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
 INT_PTR CALLBACK EULADlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
 
+/* Decoder threads for navigation; more only add cancelled work */
+#define PANIVIEW_LOADER_THREADS 2
+
+/* Workers of the pool resampling and mip levels are split over, 0 for one
+ * less than the CPUs since the thread waiting works along */
+#define PANIVIEW_TASKPOOL_THREADS 0
+
+/* Workers of the pool directory scans list, stat and filter files on; they
+ * wait on the disk far more than they compute, so more than the CPUs pay off */
+#define PANIVIEW_IO_THREADS 8
+
+/* Finished loads waiting for the UI thread; far more than can be in flight */
+#define PANIVIEW_LOAD_QUEUE_SIZE 256
+
+/* Default budget of the decoded image cache, about a dozen 12 MP photos */
+#define PANIVIEW_DEFAULT_CACHE_MB 512
+
+/* Images decoded ahead in the direction of navigation */
+#define PANIVIEW_DEFAULT_PREFETCH 2
+
+/*
+ * Prefetch deadlines, in milliseconds after the navigation that planned
+ * them, per step away from the current image. Longer than the key repeat
+ * interval, so the nearest neighbour of the latest step is decoded before
+ * the farther ones still queued from the steps before it.
+ */
+#define PANIVIEW_PREFETCH_SPACING_MS 100
+
+/*
+ * Quiet time after a navigation step that ends a burst of them. Longer than
+ * the key repeat interval and than a quick double click on the toolbar, so
+ * the steps in between only get a placeholder and the decode waits for the
+ * image the user stops at.
+ */
+#define PANIVIEW_NAV_SETTLE_MS 150
+
+/* Frame timer that decodes the image a burst of steps settled on */
+#define PANIVIEW_NAV_TIMER 1
+
+/* Frame timer that merges a background directory scan until it indexed the
+ * file shown, whose neighbours are prefetched then */
+#define PANIVIEW_SCAN_TIMER 2
+#define PANIVIEW_SCAN_POLL_MS 100
+
+/* Filter the GDI renderer scales images to the window with */
+#define PANIVIEW_GDI_FILTER RESAMPLE_FILTER_LANCZOS3
+
+/* The OpenGL renderer tiles images with a side beyond this, or beyond what
+ * the driver takes in one texture */
+#define PANIVIEW_GL_TILE_THRESHOLD 4096
+
+/* Video memory the tiles of one image may keep resident */
+#define PANIVIEW_GL_TILE_BUDGET_MB 256
+
+/* Decoded images get mip levels down to one no larger than this either
+ * way, built on the task pool; smaller images get none */
+#define PANIVIEW_PYRAMID_MIN_SIZE 256
+
+/* Uncompressed PGM and BMP files from this many megapixels on are never
+ * decoded in full; the OpenGL renderer reads the tiles in view from the
+ * file, the others draw a preview no larger than this either way */
+#define PANIVIEW_RASTER_MIN_MP 256
+#define PANIVIEW_RASTER_PREVIEW_SIZE 4096
+
+/* The mouse wheel scrolls this many pixels a notch; with Ctrl held it
+ * zooms a step at the cursor instead */
+#define PANIVIEW_WHEEL_SCROLL 64
+
+/* Identity of a file version, the key of the decoded image cache */
+typedef struct _tagFILESTAMP {
+  char szPath[MAX_PATH * 3];    /* UTF-8 */
+  uint64_t size;
+  int64_t mtime;
+} FILESTAMP, * LPFILESTAMP;
+
+/* Background load request, owned by the loader until it is completed */
+typedef struct _tagLOADJOB {
+  WCHAR szPath[MAX_PATH];
+  FILESTAMP stamp;
+  BOOL bPrefetch;
+  uint64_t nMaxCost;          /* Not decoded when the cache could not keep it, 0 for any size */
+  IWICBitmapSource* pBitmap;
+  HRESULT hr;
+  uint64_t nGeneration;
+} LOADJOB, * LPLOADJOB;
+
 struct _tagPANIVIEWAPP {
   PANIVIEWFRAME mainFrame;
   RENDERCTL2 renderCtl;
@@ -344,10 +556,23 @@ struct _tagPANIVIEWAPP {
   PWSTR m_appCfgPath;
 
   IWICImagingFactory* m_pIWICFactory;
-  IWICFormatConverter* m_pConvertedSourceBitmap;
+  IWICBitmapSource* m_pConvertedSourceBitmap;
 
   LPRENDERERCONTEXT m_rendererContext;
+  VIEWPORT m_viewport;            /* How the image lies in the render control */
   PWSTR pszImagePath;
+
+  TASKPOOL m_taskPool;            /* Shared by all work split over the CPUs */
+  TASKPOOL m_ioPool;              /* Blocking file system work, kept off m_taskPool */
+  LOADER m_loader;
+  MPSCQUEUE m_loadQueue;          /* LPLOADJOBs from the loader's workers */
+  QUEUEWAKE m_loadWake;
+  IMGCACHE m_imageCache;
+  PREFETCH m_prefetch;
+  NAVBURST m_navBurst;            /* Steps coalesced while a key is held */
+  uint64_t m_nPendingLoad;        /* Generation of the load to present next */
+  WCHAR m_szNavPath[MAX_PATH];    /* Last file navigated to */
+  WCHAR m_szPrefetchPath[MAX_PATH]; /* File shown before the scan reached it */
 };
 
 /* Application object methods forward declarations */
@@ -364,12 +589,30 @@ void PaniViewApp_UpdateViewport(void);
 void PaniViewApp_SetFilePath(PWSTR pszPath);
 void PaniViewApp_NextFile(void);
 void PaniViewApp_PrevFile(void);
+void PaniViewApp_StepFile(BOOL fNext, BOOL bRepeat);
+void PaniViewApp_SettleNavigation(BOOL bReleased);
 void PaniViewApp_ToggleFit(void);
 LPRENDERERCONTEXT PaniViewApp_GetRendererContext(void);
 HRESULT PaniViewApp_InitializeWIC(void);
-HRESULT PaniViewApp_LoadFromFilePGM(PWSTR pszPath, FILE* pf);
-HRESULT PaniViewApp_LoadFromFileWIC(PWSTR pszPath);
+HRESULT PaniViewApp_DecodePGM(LPFILEMAP pMap, LPLOADTOKEN pToken, IWICBitmapSource** ppBitmap);
+HRESULT PaniViewApp_DecodeFile(PCWSTR pszPath, uint64_t nMaxCost, LPLOADTOKEN pToken, IWICBitmapSource** ppBitmap);
+void PaniViewApp_PresentBitmap(PWSTR pszPath, IWICBitmapSource* pBitmap);
 HRESULT PaniViewApp_LoadFromFile(PWSTR pszPath);
+BOOL PaniViewApp_InitializeLoader(LPPANIVIEWAPP pApp);
+void PaniViewApp_RequestFile(PWSTR pszPath);
+void PaniViewApp_ShowPlaceholder(PWSTR pszPath);
+void PaniViewApp_OnLoadComplete(LPLOADJOB pJob);
+void PaniViewApp_OnLoadsQueued(void);
+void PaniViewApp_ShutdownLoader(LPPANIVIEWAPP pApp);
+LPTASKPOOL PaniViewApp_GetTaskPool(void);
+LPTASKPOOL PaniViewApp_GetIOPool(void);
+void PaniViewApp_FreeLoadJob(LPLOADJOB pJob);
+void PaniViewApp_InitializeImageCache(LPPANIVIEWAPP pApp);
+IWICBitmapSource* PaniViewApp_FindCachedImage(LPFILESTAMP pStamp);
+void PaniViewApp_CacheImage(LPFILESTAMP pStamp, IWICBitmapSource* pBitmap);
+void PaniViewApp_PrefetchNeighbours(PCWSTR pszPath);
+void PaniViewApp_RetryPrefetch(void);
+BOOL GetFileStamp(PCWSTR pszPath, LPFILESTAMP pStamp);
 void PaniViewApp_OnCommand(WPARAM wParam, LPARAM lParam);
 
 /*
@@ -422,6 +665,20 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR lpCmdL
                               classes, lock single instance mutexes, etc. */
 
   WindowMap_Initialize();
+  ImageFormats_Initialize();
+  DirIndex_Init(&g_dirIndex);
+
+  /* Without the pools, work runs on the thread asking for it */
+  TaskPool_Init(&pApp->m_taskPool, PANIVIEW_TASKPOOL_THREADS);
+  TaskPool_Init(&pApp->m_ioPool, PANIVIEW_IO_THREADS);
+
+  if (!PaniViewApp_InitializeLoader(pApp)) {
+    PopupError(ERROR_NOT_ENOUGH_MEMORY, NULL);
+    return -1;
+  }
+  PaniViewApp_InitializeImageCache(pApp);
+  Prefetch_Init(&pApp->m_prefetch, pApp->m_settings.nPrefetchDepth);
+  NavBurst_Init(&pApp->m_navBurst, PANIVIEW_NAV_SETTLE_MS);
 
   PaniViewFrame_Init(&pApp->mainFrame);
   HWND hWndMain = PaniViewFrame_Create(&pApp->mainFrame);
@@ -440,7 +697,10 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR lpCmdL
     if (nArgs > 0) {
       PathUnquoteSpaces(ppszArgv[0]);
 
-      PaniViewApp_LoadFromFile(ppszArgv[0]);
+      hr = PaniViewApp_LoadFromFile(ppszArgv[0]);
+      if (FAILED(hr)) {
+        PopupError(hr, NULL);
+      }
     }
   }
 
@@ -456,6 +716,11 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR lpCmdL
     DispatchMessage(&msg);  /* Proceed message into dispatcher */
   }
 
+  PaniViewApp_ShutdownLoader(pApp);
+  ImgCache_Cleanup(&pApp->m_imageCache);
+  DirIndex_Close(&g_dirIndex);
+  TaskPool_Cleanup(&pApp->m_ioPool);
+  TaskPool_Cleanup(&pApp->m_taskPool);
   CoUninitialize();
 
   if (!PaniViewApp_SaveSettings(pApp)) {
@@ -642,27 +907,6 @@ unsigned long crc32(unsigned char *data, size_t length)
   return checksum;
 }
 
-int compareHWND(const void* key1, size_t key1Size, const void* key2, size_t key2Size)
-{
-  if (key1Size != sizeof(HWND) || key2Size != sizeof(HWND)) {
-    /* Error: Incorrect key size */
-    return -1;
-  }
-
-  HWND hwndKey1 = *((const HWND*)key1);
-  HWND hwndKey2 = *((const HWND*)key2);
-
-  if (hwndKey1 < hwndKey2) {
-    return -1;
-  }
-  else if (hwndKey1 > hwndKey2) {
-    return 1;
-  }
-  else {
-    return 0;
-  }
-}
-
 static inline D2D1_MATRIX_3X2_F D2DUtilMatrixIdentity(void) {
   D2D1_MATRIX_3X2_F mat = { 0 };
   mat._11 = 1.f;
@@ -736,15 +980,18 @@ BOOL Settings_LoadFile(SETTINGS *pSettings, PWSTR pszPath)
 
     if (!memcmp(magic, g_cfgMagic, sizeof(g_cfgMagic)))
     {
+      /* Files written before fields were appended are shorter; the missing
+       * fields keep their defaults */
+      Settings_LoadDefault(tmpCfg);
       fseek(pfd, 0, SEEK_SET);
-      fread(tmpCfg, sizeof(SETTINGS), 1, pfd);
+      size_t cbRead = fread(tmpCfg, 1, sizeof(SETTINGS), pfd);
 
       unsigned long fileChecksum = tmpCfg->checksum;
       tmpCfg->checksum = 0xFFFFFFFFUL;
-      unsigned long calcChecksum = crc32((unsigned char *)tmpCfg, sizeof(SETTINGS));
+      unsigned long calcChecksum = crc32((unsigned char *)tmpCfg, cbRead);
       tmpCfg->checksum = fileChecksum;
 
-      if (fileChecksum == calcChecksum) {
+      if (cbRead >= offsetof(SETTINGS, nImageCacheMB) && fileChecksum == calcChecksum) {
         memcpy(pSettings, tmpCfg, sizeof(SETTINGS));
         bStatus = TRUE;
       }
@@ -790,6 +1037,8 @@ BOOL Settings_LoadDefault(SETTINGS *pSettings)
   pSettings->bNaviLoop = TRUE;
   pSettings->nRendererType = RENDERER_D2D;
   pSettings->nToolbarTheme = TOOLBARTHEME_DEFAULT_24PX;
+  pSettings->nImageCacheMB = PANIVIEW_DEFAULT_CACHE_MB;
+  pSettings->nPrefetchDepth = PANIVIEW_DEFAULT_PREFETCH;
 
   return TRUE;
 }
@@ -832,6 +1081,7 @@ BOOL PaniViewApp_Initialize(LPPANIVIEWAPP pApp)
 
   PaniViewApp_InitializeWIC();
   pApp->m_rendererContext = CreateRendererContext();
+  Viewport_Init(&pApp->m_viewport);
 
   return TRUE;
 }
@@ -990,1689 +1240,3800 @@ HRESULT PaniViewApp_InitializeWIC(void)
   return hr;
 }
 
-HRESULT PaniViewApp_LoadFromFilePGM(PWSTR pszPath, FILE* pf)
+/*
+ * PaniViewApp_DecodePGM
+ * Decode a mapped PGM file into a new gray bitmap of the file's depth,
+ * polling the token between strips. 8-bit binary rows that are all there
+ * need no decoding: the bitmap is made over the mapping, which it takes
+ * over. Safe to call from a loader worker.
+ */
+HRESULT PaniViewApp_DecodePGM(LPFILEMAP pMap, LPLOADTOKEN pToken, IWICBitmapSource** ppBitmap)
 {
-  HRESULT hr = E_FAIL;
+  HRESULT hr = S_OK;
+
+  IWICBitmap* pIWICBitmap = NULL;
 
-  IWICBitmapSource* pConvertedSourceBitmap = NULL;
+  PGMDECODER decoder;
+  PGMDecoder_InitMemory(&decoder, pMap->pData, pMap->size);
+
+  if (PGMDecoder_ReadHeader(&decoder) != PGM_OK ||
+      decoder.header.width > INT_MAX / 4 || decoder.header.height > INT_MAX)
+  {
+    hr = WINCODEC_ERR_BADHEADER;
+    goto fail;
+  }
 
-  int width;
-  int height;
-  int depth;
-  fscanf_s(pf, "%d %d\n%d\n", &width, &height, &depth);
+  UINT width = (UINT)decoder.header.width;
+  UINT height = (UINT)decoder.header.height;
+
+  /* Samples stay gray: the OpenGL renderer uploads them as one channel, the
+   * others get PBGRA when they read the bitmap */
+  BOOL bWide = decoder.header.maxval > 255;
+  int nFormat = bWide ? PIXFMT_GRAY16 : PIXFMT_GRAY8;
+  int nOutputFormat = bWide ? PGM_OUTPUT_GRAY16 : PGM_OUTPUT_GRAY8;
+
+  size_t nRawRows = 0;
+  const unsigned char* pRawRows = PGMDecoder_GetRawRows(&decoder, &nRawRows);
+  LPFILEMAP pOwnedMap = pRawRows && nRawRows == height ? (LPFILEMAP)malloc(sizeof(FILEMAP)) : NULL;
+  if (pOwnedMap) {
+    PIXBUFALLOCATOR allocator = { NULL, FileMapPixBuf_Free, pOwnedMap };
+    LPPIXBUF pPixBuf = NULL;
+
+    *pOwnedMap = *pMap;
+    if (PixBuf_Wrap((void*)pRawRows, width, height, width, PIXFMT_GRAY8, &allocator, &pPixBuf) != PIXBUF_OK) {
+      free(pOwnedMap);
+    }
+    else {
+      /* The pixel buffer unmaps the file with its last reference */
+      memset(pMap, 0, sizeof(FILEMAP));
+      pIWICBitmap = PixBufBitmap_CreateFromPixBuf(pPixBuf);
+      PixBuf_Release(pPixBuf);
+      if (!pIWICBitmap) {
+        hr = E_OUTOFMEMORY;
+        goto fail;
+      }
 
-  if (depth != 255) {
-    return E_FAIL;
+      goto done;
+    }
   }
 
-  size_t dataLength = (size_t)width * height;
-  unsigned char* data = (unsigned char*)calloc(dataLength, 1);
-  if (!data) {
-    return E_FAIL;
+  pIWICBitmap = PixBufBitmap_Create(width, height, nFormat, NULL);
+  if (!pIWICBitmap) {
+    hr = E_OUTOFMEMORY;
+    goto fail;
   }
+  LPPIXBUF pPixBuf = PixBufBitmap_GetPixBuf((IWICBitmapSource*)pIWICBitmap);
+
+  /* Rows arrive in strips; a truncated file keeps the rows decoded so far */
+  const UINT nStripRows = 256;
+  UINT nRow = 0;
+  while (nRow < height) {
+    if (LoadToken_IsCancelled(pToken)) {
+      hr = HRESULT_FROM_WIN32(ERROR_CANCELLED);
+      goto fail;
+    }
 
-  fread(data, dataLength, 1, pf);
+    size_t nRead = 0;
+    int status = PGMDecoder_ReadRows(&decoder, PixBuf_GetRow(pPixBuf, nRow), pPixBuf->stride,
+        min(nStripRows, height - nRow), nOutputFormat, &nRead);
 
-  pConvertedSourceBitmap = WICLoadFromMemory(width, height, data, &GUID_WICPixelFormat8bppGray);
-  LPRENDERERCONTEXT pRendererContext = PaniViewApp_GetRendererContext();
-  if (pRendererContext) {
-    pRendererContext->LoadWICBitmap(pRendererContext, pConvertedSourceBitmap);
+    nRow += (UINT)nRead;
+    if (status != PGM_OK || !nRead) {
+      break;
+    }
   }
 
-  /* Copy path to window data */
-  PaniViewApp_SetFilePath(pszPath);
+  if (nRow < height) {
+    memset(PixBuf_GetRow(pPixBuf, nRow), 0, pPixBuf->stride * (height - nRow));
+  }
+
+done:
+  *ppBitmap = (IWICBitmapSource*)pIWICBitmap;
+  pIWICBitmap = NULL;
 
-  free(data);
+fail:
+  SAFE_RELEASE(pIWICBitmap);
+  PGMDecoder_Cleanup(&decoder);
 
   return hr;
 }
 
-HRESULT PaniViewApp_LoadFromFileWIC(PWSTR pszPath)
+/*
+ * PaniViewApp_EstimateCost
+ * The least the image cache would charge for a file decoded from its
+ * header alone, as PaniViewApp_CacheImage does without the pyramid: the
+ * preview of a raster left in its file, gray PGMs at one or two bytes per
+ * pixel, anything else at PBGRA
+ */
+static uint64_t PaniViewApp_EstimateCost(const IMGFORMAT* pFormat, const IMGINFO* pInfo, BOOL bRaster)
 {
-  HRESULT hr = S_OK;
-
-  IWICBitmapSource* pConvertedSourceBitmap = NULL;
-
-  pConvertedSourceBitmap = WICDecodeFromFilename(pszPath);
+  int nPixFmt = PIXFMT_PBGRA32;
+  if (pFormat->nFormat == IMGFORMAT_PGM) {
+    nPixFmt = pInfo->nBitDepth > 8 ? PIXFMT_GRAY16 : PIXFMT_GRAY8;
+  }
 
-  LPRENDERERCONTEXT pRendererContext = PaniViewApp_GetRendererContext();
-  if (pRendererContext) {
-    pRendererContext->LoadWICBitmap(pRendererContext, pConvertedSourceBitmap);
+  uint64_t width = pInfo->width;
+  uint64_t height = pInfo->height;
+  if (bRaster) {
+    unsigned int nScale = RasterBitmap_GetPreviewScale(width, height);
+    width = (width + nScale - 1) / nScale;
+    height = (height + nScale - 1) / nScale;
   }
 
-  PaniViewApp_SetFilePath(pszPath);
-  return hr;
+  return width * height * (uint64_t)PixConv_GetBytesPerPixel(nPixFmt);
 }
 
-HRESULT PaniViewApp_LoadFromFile(PWSTR pszPath)
+/*
+ * PaniViewApp_DecodeFile
+ * Decode any supported file without touching the application state, so it
+ * runs on the loader workers as well. The new bitmap is a PixBufBitmap of
+ * PBGRA or single-channel gray pixels with its pyramid, a RasterBitmap
+ * reading a huge uncompressed raster from its file mapping, or, where no
+ * pixel buffer could be had, a 32bppPBGRA WIC bitmap. A file whose header
+ * tells it would cost the cache more than nMaxCost (unless 0) fails with
+ * ERROR_FILE_TOO_LARGE before anything is decoded.
+ */
+HRESULT PaniViewApp_DecodeFile(PCWSTR pszPath, uint64_t nMaxCost, LPLOADTOKEN pToken, IWICBitmapSource** ppBitmap)
 {
-  FILE* pf = NULL;
-  errno_t err;
+  FILEMAP map;
 
-  err = _wfopen_s(&pf, pszPath, L"rb");
-  if (err || !pf)
-  {
-    MessageBox(NULL, L"Cound not open file", NULL, MB_OK | MB_ICONERROR);
-    return E_FAIL;
+  *ppBitmap = NULL;
+
+  /* Mapped once; the probe, the decoders and WIC all read the same bytes */
+  if (FileMap_OpenW(&map, pszPath) != FILEMAP_OK) {
+    return HRESULT_FROM_WIN32(ERROR_OPEN_FAILED);
   }
 
-  const char pgmMagic[] = { 'P', '5' };
+  /* Formats without a decoder of their own are left to WIC to sniff */
+  IMGINFO info = { 0 };
+  const IMGFORMAT* pFormat = ImgFormat_Probe(&g_imageFormats, map.pData, min(map.size, (size_t)IMGFORMAT_PROBE_SIZE), &info);
+  const IMGDECODER* pDecoder = pFormat ? (const IMGDECODER*)pFormat->pDecoder : NULL;
 
-  char magic[2];
-  fread(magic, sizeof(magic), 1, pf);
+  /* Huge uncompressed rasters stay in the mapping; compressed ones and ASCII
+   * PGM are decoded in full after all */
+  BOOL bRaster = pFormat && (pFormat->nFormat == IMGFORMAT_PGM || pFormat->nFormat == IMGFORMAT_BMP) &&
+      (uint64_t)info.width * info.height >= (uint64_t)PANIVIEW_RASTER_MIN_MP * 1000000;
+
+  if (nMaxCost && pFormat && PaniViewApp_EstimateCost(pFormat, &info, bRaster) > nMaxCost) {
+    FileMap_Close(&map);
+    return HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+  }
 
   HRESULT hResult = E_FAIL;
-  if (!memcmp(magic, pgmMagic, sizeof(magic)))
-  {
-    hResult = PaniViewApp_LoadFromFilePGM(pszPath, pf);
+  if (bRaster) {
+    hResult = RasterBitmap_CreateFromFileMap(&map, ppBitmap);
+  }
+
+  if (SUCCEEDED(hResult)) {
+    /* Mapped for reading regions, nothing decoded yet */
+  }
+  else if (pDecoder) {
+    hResult = pDecoder->pfnDecode(pszPath, &map, pToken, ppBitmap);
   }
   else {
-    hResult = PaniViewApp_LoadFromFileWIC(pszPath);
+    hResult = WICDecodeFromFileMap(pszPath, &map, pToken, ppBitmap);
   }
 
-  fclose(pf);
+  /* Unless the bitmap kept it */
+  FileMap_Close(&map);
 
-  PaniViewApp_SetTitle(GetApp(), pszPath);
-  PaniViewApp_UpdateViewport();
+  /* Levels for zooming out are built once here, on the decoding thread,
+   * and cached with the image; without them renderers filter level 0 */
+  if (SUCCEEDED(hResult) && !LoadToken_IsCancelled(pToken)) {
+    PixBufBitmap_BuildPyramid(*ppBitmap);
+  }
 
   return hResult;
 }
 
-void PaniViewApp_OnCommand(WPARAM wParam, LPARAM lParam)
+/*
+ * PaniViewApp_PresentBitmap
+ * Make a decoded bitmap the current image. UI thread only.
+ */
+void PaniViewApp_PresentBitmap(PWSTR pszPath, IWICBitmapSource* pBitmap)
 {
-  UNREFERENCED_PARAMETER(lParam);
+  LPPANIVIEWAPP pApp = GetApp();
 
-  switch ((int)wParam)
-  {
-  case IDM_FILE_OPEN:
-    PaniViewApp_OnMenuOpen();
-    break;
+  WICSetCurrentBitmap(pBitmap);
 
-  case IDM_FILE_EXIT:
-    PaniViewApp_OnMenuExit();
-    break;
+  /* Before the renderer, which picks the levels to upload by the scale */
+  UINT width = 0;
+  UINT height = 0;
+  pBitmap->lpVtbl->GetSize(pBitmap, &width, &height);
+  Viewport_SetImage(&pApp->m_viewport, width, height,
+      pApp->m_settings.bFit ? VIEWPORT_MODE_FIT : VIEWPORT_MODE_FREE);
+
+  LPRENDERERCONTEXT pRendererContext = PaniViewApp_GetRendererContext();
+  if (pRendererContext) {
+    pRendererContext->LoadWICBitmap(pRendererContext, pBitmap);
   }
+
+  /* Copy path to window data */
+  PaniViewApp_SetFilePath(pszPath);
+  StringCchCopy(pApp->m_szNavPath, MAX_PATH, pszPath);
+
+  PaniViewApp_SetTitle(pApp, pszPath);
+  PaniViewApp_UpdateViewport();
 }
 
-void PaniViewApp_PrevFile(void)
+/*
+ * PaniViewApp_LoadFromFile
+ * Decode and present a file synchronously, superseding any background load
+ */
+HRESULT PaniViewApp_LoadFromFile(PWSTR pszPath)
 {
-  HRESULT hr = S_OK;
-
   LPPANIVIEWAPP pApp = GetApp();
 
-  WCHAR szNextFile[MAX_PATH] = { 0 };
-  NextFileInDir(pApp->pszImagePath, FALSE, szNextFile);
+  /* A navigation finishing later must not replace this image */
+  pApp->m_nPendingLoad = 0;
+  NavBurst_Reset(&pApp->m_navBurst);
+  KillTimer(pApp->mainFrame.base.hWnd, PANIVIEW_NAV_TIMER);
+  Loader_CancelAll(&pApp->m_loader);
+  Prefetch_ClearPending(&pApp->m_prefetch);
+  Prefetch_OnOpen(&pApp->m_prefetch);
+
+  FILESTAMP stamp;
+  BOOL bStamped = GetFileStamp(pszPath, &stamp);
+
+  IWICBitmapSource* pCached = bStamped ? PaniViewApp_FindCachedImage(&stamp) : NULL;
+  if (pCached) {
+    PaniViewApp_PresentBitmap(pszPath, pCached);
+    PaniViewApp_PrefetchNeighbours(pszPath);
+    return S_OK;
+  }
 
-  if (szNextFile[0] != '\0')
-  {
-    hr = PaniViewApp_LoadFromFile(szNextFile);
-    if (FAILED(hr)) {
-      PopupError(hr, NULL);
-      assert(FALSE);
+  IWICBitmapSource* pBitmap = NULL;
+  HRESULT hr = PaniViewApp_DecodeFile(pszPath, 0, NULL, &pBitmap);
+  if (SUCCEEDED(hr)) {
+    if (bStamped) {
+      PaniViewApp_CacheImage(&stamp, pBitmap);
     }
+    PaniViewApp_PresentBitmap(pszPath, pBitmap);
+    PaniViewApp_PrefetchNeighbours(pszPath);
   }
+
+  SAFE_RELEASE(pBitmap);
+  return hr;
 }
 
-void PaniViewApp_NextFile(void)
+/* Loader worker setup: WIC objects are created from the MTA */
+static void PaniViewApp_LoaderThreadStart(void* pUserData)
 {
-  HRESULT hr = S_OK;
+  UNREFERENCED_PARAMETER(pUserData);
 
-  LPPANIVIEWAPP pApp = GetApp();
+  CoInitializeEx(NULL, COINIT_MULTITHREADED);
+}
 
-  WCHAR szNextFile[MAX_PATH] = { 0 };
-  NextFileInDir(pApp->pszImagePath, TRUE, szNextFile);
+static void PaniViewApp_LoaderThreadStop(void* pUserData)
+{
+  UNREFERENCED_PARAMETER(pUserData);
 
-  if (szNextFile[0] != '\0')
-  {
-    hr = PaniViewApp_LoadFromFile(szNextFile);
-    if (FAILED(hr)) {
-      PopupError(hr, NULL);
-      assert(FALSE);
-    }
-  }
+  CoUninitialize();
 }
 
-void PaniViewApp_ToggleFit(void)
+static int PaniViewApp_LoaderDecode(void* pArg, LPLOADTOKEN pToken, void** ppResult, void* pUserData)
 {
-  LPPANIVIEWAPP pApp = GetApp();
+  UNREFERENCED_PARAMETER(pUserData);
 
-  pApp->m_settings.bFit = !pApp->m_settings.bFit;
+  LPLOADJOB pJob = (LPLOADJOB)pArg;
+  pJob->hr = PaniViewApp_DecodeFile(pJob->szPath, pJob->nMaxCost, pToken, &pJob->pBitmap);
+  *ppResult = pJob->pBitmap;
 
-  PaniViewApp_UpdateViewport();
+  if (pJob->hr == HRESULT_FROM_WIN32(ERROR_CANCELLED)) {
+    return LOADER_CANCELLED;
+  }
+
+  return SUCCEEDED(pJob->hr) ? LOADER_OK : LOADER_ERROR_DECODE;
 }
 
-void PaniView_PreRegisterClass(LPWNDCLASSEX lpwcex)
+/*
+ * Hand finished and failed loads to the UI thread, drop cancelled ones.
+ * Only the first load queued since the UI thread last drained the queue
+ * posts WM_LOADCOMPLETE, so a burst of them costs a single message.
+ */
+static void PaniViewApp_LoaderComplete(void* pArg, void* pResult, int status, uint64_t nGeneration, void* pUserData)
 {
-  lpwcex->style = CS_HREDRAW | CS_VREDRAW;
-  lpwcex->lpszClassName = szPaniViewClassName;
-  lpwcex->lpszMenuName = MAKEINTRESOURCE(IDM_MAIN);
+  UNREFERENCED_PARAMETER(pResult);
+
+  LPPANIVIEWAPP pApp = (LPPANIVIEWAPP)pUserData;
+  LPLOADJOB pJob = (LPLOADJOB)pArg;
+  pJob->nGeneration = nGeneration;
+
+  if ((status != LOADER_OK && status != LOADER_ERROR_DECODE) || !MpscQueue_Push(&pApp->m_loadQueue, pJob)) {
+    PaniViewApp_FreeLoadJob(pJob);
+    return;
+  }
+
+  /* Without a window the queue is emptied at shutdown */
+  if (QueueWake_Raise(&pApp->m_loadWake) && !PostMessage(pApp->mainFrame.base.hWnd, WM_LOADCOMPLETE, 0, 0)) {
+    QueueWake_Reset(&pApp->m_loadWake);
+  }
 }
 
-void PaniView_PreCreate(LPCREATESTRUCT lpcs)
+void PaniViewApp_FreeLoadJob(LPLOADJOB pJob)
 {
-  UNREFERENCED_PARAMETER(lpcs);
+  SAFE_RELEASE(pJob->pBitmap);
+  free(pJob);
 }
 
-LPWINDOW g_currentWindow = NULL;
+BOOL PaniViewApp_InitializeLoader(LPPANIVIEWAPP pApp)
+{
+  static const LOADERCALLBACKS callbacks = {
+    PaniViewApp_LoaderThreadStart,
+    PaniViewApp_LoaderThreadStop,
+    PaniViewApp_LoaderDecode,
+    PaniViewApp_LoaderComplete
+  };
 
-void WindowMap_Initialize(void)
+  if (MpscQueue_Init(&pApp->m_loadQueue, PANIVIEW_LOAD_QUEUE_SIZE) != MSGQUEUE_OK) {
+    return FALSE;
+  }
+  QueueWake_Init(&pApp->m_loadWake);
+
+  if (Loader_Init(&pApp->m_loader, PANIVIEW_LOADER_THREADS, &callbacks, pApp) != LOADER_OK) {
+    MpscQueue_Cleanup(&pApp->m_loadQueue);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/*
+ * PaniViewApp_ShutdownLoader
+ * Stop the workers, then free the loads they finished that were never shown
+ */
+void PaniViewApp_ShutdownLoader(LPPANIVIEWAPP pApp)
 {
-  InitializeHashMap(&g_windowMap, sizeof(HWND), compareHWND);
+  Loader_Shutdown(&pApp->m_loader);
+
+  void* pJob;
+  while (MpscQueue_Pop(&pApp->m_loadQueue, &pJob)) {
+    PaniViewApp_FreeLoadJob((LPLOADJOB)pJob);
+  }
+  MpscQueue_Cleanup(&pApp->m_loadQueue);
 }
 
-void WindowMap_Add(HWND hWnd, LPWINDOW pWindow)
+/*
+ * PaniViewApp_GetTaskPool
+ * The pool shared by all work split over the CPUs, NULL when it could not
+ * be started and the calling thread is to do the work alone
+ */
+LPTASKPOOL PaniViewApp_GetTaskPool(void)
 {
-  HashMap_Insert(&g_windowMap, &hWnd, &pWindow, sizeof(LPWINDOW));
+  LPPANIVIEWAPP pApp = GetApp();
+
+  return TaskPool_GetWorkerCount(&pApp->m_taskPool) ? &pApp->m_taskPool : NULL;
 }
 
-LPWINDOW WindowMap_Find(HWND hWnd)
+/*
+ * PaniViewApp_GetIOPool
+ * The pool for work that blocks on the file system, NULL when it could not
+ * be started
+ */
+LPTASKPOOL PaniViewApp_GetIOPool(void)
 {
-  LPWINDOW *ppWindow = (LPWINDOW*)HashMap_Get(&g_windowMap, &hWnd);
+  LPPANIVIEWAPP pApp = GetApp();
 
-  return ppWindow ? *ppWindow : NULL;
+  return TaskPool_GetWorkerCount(&pApp->m_ioPool) ? &pApp->m_ioPool : NULL;
 }
 
-LRESULT CALLBACK StaticWndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+/*
+ * PaniViewApp_RequestFile
+ * Queue a file for background decoding, cancelling the loads it supersedes
+ */
+void PaniViewApp_RequestFile(PWSTR pszPath)
 {
-  LPWINDOW pWindow = WindowMap_Find(hWnd);
+  LPPANIVIEWAPP pApp = GetApp();
 
-  if (!pWindow) {
-    if (g_currentWindow) {
-      pWindow = g_currentWindow;
-      WindowMap_Add(hWnd, pWindow);
-      pWindow->hWnd = hWnd;
+  LPLOADJOB pJob = (LPLOADJOB)calloc(1, sizeof(LOADJOB));
+  if (!pJob) {
+    PopupError(ERROR_NOT_ENOUGH_MEMORY, NULL);
+    return;
+  }
+  StringCchCopy(pJob->szPath, MAX_PATH, pszPath);
+
+  /* Navigation continues from the requested file, not the displayed one,
+   * so a held key keeps moving while the decodes are cancelled */
+  StringCchCopy(pApp->m_szNavPath, MAX_PATH, pszPath);
+
+  /* A cached image is shown right away and supersedes pending loads. Those
+   * keep running, their images go to the cache and prefetching continues */
+  if (GetFileStamp(pszPath, &pJob->stamp)) {
+    IWICBitmapSource* pCached = PaniViewApp_FindCachedImage(&pJob->stamp);
+    if (pCached) {
+      pApp->m_nPendingLoad = 0;
+      PaniViewApp_PresentBitmap(pszPath, pCached);
+      PaniViewApp_PrefetchNeighbours(pszPath);
+      free(pJob);
+      return;
     }
   }
 
-  if (pWindow) {
-    return pWindow->WndProc(pWindow, message, wParam, lParam);
+  /* Superseding cancels the prefetches too, the plan is made again below.
+   * Due now, it goes before anything else of its class, and preempts the
+   * lower classes if they hold every worker */
+  pApp->m_nPendingLoad = Loader_SubmitClass(&pApp->m_loader, pJob, LOADER_CLASS_VISIBLE, GetTickCount64(), TRUE);
+  Prefetch_ClearPending(&pApp->m_prefetch);
+  if (!pApp->m_nPendingLoad) {
+    PopupError(ERROR_NOT_ENOUGH_MEMORY, NULL);
+    return;
   }
-  else {
-    return DefWindowProc(hWnd, message, wParam, lParam);
-  }
-}
 
-void Window_Init(LPWINDOW pWindow)
-{
-  pWindow->WndProc = (LRESULT (*)(LPWINDOW, UINT, WPARAM, LPARAM)) Window_WndProc;
-  pWindow->DefaultWndProc = (LRESULT (*)(LPWINDOW, UINT, WPARAM, LPARAM)) Window_DefaultWindowProc;
-  pWindow->OnCreate = (void (*)(LPWINDOW, LPCREATESTRUCT)) Window_OnCreate;
-  pWindow->OnCommand = (BOOL (*)(LPWINDOW, WPARAM, LPARAM)) Window_OnCommand;
-  pWindow->OnPaint = (void (*)(LPWINDOW)) Window_OnPaint;
-  pWindow->OnDestroy = (void (*)(LPWINDOW)) Window_OnDestroy;
+  PaniViewApp_PrefetchNeighbours(pszPath);
 }
 
-HWND Window_Create(LPWINDOW pWindow, HWND hParent)
+/*
+ * PaniViewApp_ShowPlaceholder
+ * Move to a file in the middle of a burst of steps without decoding it: its
+ * cached image if there is one, otherwise its name and the dimensions from
+ * its header in the title, over the image shown so far. The loads still in
+ * flight are for files already stepped past.
+ */
+void PaniViewApp_ShowPlaceholder(PWSTR pszPath)
 {
-  pWindow->PreRegisterClass(pWindow, &pWindow->wcex);
-
-  if (pWindow->wcex.lpszClassName) {
-    Window_RegisterClass(pWindow);
-    pWindow->cs.lpszClass = pWindow->wcex.lpszClassName;
-  }
-
-  pWindow->PreCreate(pWindow, &pWindow->cs);
+  LPPANIVIEWAPP pApp = GetApp();
 
-  LPCREATESTRUCT lpcs = &pWindow->cs;
-  HWND hWnd = NULL;
+  StringCchCopy(pApp->m_szNavPath, MAX_PATH, pszPath);
+  pApp->m_nPendingLoad = 0;
+  Loader_CancelClass(&pApp->m_loader, LOADER_CLASS_VISIBLE);
+  Loader_CancelPrefetch(&pApp->m_loader);
+  Prefetch_ClearPending(&pApp->m_prefetch);
 
-  /* Set parent, if set explicitly */
-  if (hParent && IsWindow(hParent)) {
-    lpcs->hwndParent = hParent;
+  FILESTAMP stamp;
+  if (!GetFileStamp(pszPath, &stamp)) {
+    PaniViewApp_SetTitle(pApp, pszPath);
+    return;
   }
 
-  g_currentWindow = pWindow;
-  hWnd = CreateWindowEx(0, lpcs->lpszClass, lpcs->lpszName, lpcs->style, lpcs->x, lpcs->y, lpcs->cx, lpcs->cy, lpcs->hwndParent, lpcs->hMenu, GetModuleHandle(NULL), NULL);
-  g_currentWindow = NULL;
+  IWICBitmapSource* pCached = PaniViewApp_FindCachedImage(&stamp);
+  if (pCached) {
+    PaniViewApp_PresentBitmap(pszPath, pCached);
+    return;
+  }
 
-  return hWnd;
+  WCHAR szTitle[MAX_PATH + 32] = { 0 };
+  IMGINFO info;
+  if (ImageInfo_Probe(&g_imageFormats, stamp.szPath, &info, 0) == IMAGEINFO_OK && info.width && info.height) {
+    StringCchPrintf(szTitle, ARRAYSIZE(szTitle), L"%s (%u x %u)", pszPath, info.width, info.height);
+  }
+  else {
+    StringCchCopy(szTitle, ARRAYSIZE(szTitle), pszPath);
+  }
+  PaniViewApp_SetTitle(pApp, szTitle);
 }
 
-void Window_RegisterClass(LPWINDOW pWindow)
+/*
+ * PaniViewApp_OnLoadsQueued
+ * Handle every load queued since the last WM_LOADCOMPLETE. The wakeup is
+ * reset first, so loads queued while these are handled post a new one.
+ */
+void PaniViewApp_OnLoadsQueued(void)
 {
-  WNDCLASSEX wcex = { 0 };
+  LPPANIVIEWAPP pApp = GetApp();
 
-  if (!GetClassInfoEx(GetModuleHandle(NULL), pWindow->pszClassName, &wcex))
-  {
-    pWindow->wcex.cbSize = sizeof(WNDCLASSEX);
-    pWindow->wcex.hInstance = GetModuleHandle(NULL);
-    pWindow->wcex.lpfnWndProc = StaticWndProc;
+  QueueWake_Reset(&pApp->m_loadWake);
 
-    RegisterClassEx(&pWindow->wcex);
+  void* pJob;
+  while (MpscQueue_Pop(&pApp->m_loadQueue, &pJob)) {
+    PaniViewApp_OnLoadComplete((LPLOADJOB)pJob);
   }
 }
 
-LRESULT Window_WndProc(LPWINDOW pWindow, UINT message, WPARAM wParam, LPARAM lParam)
+/*
+ * PaniViewApp_OnLoadComplete
+ * Cache a background load and present it if it is still the latest request
+ */
+void PaniViewApp_OnLoadComplete(LPLOADJOB pJob)
 {
-  return pWindow->DefaultWndProc(pWindow, message, wParam, lParam);
-}
+  LPPANIVIEWAPP pApp = GetApp();
 
-LRESULT Window_DefaultWindowProc(LPWINDOW pWindow, UINT message, WPARAM wParam, LPARAM lParam)
-{
-  switch (message) {
-  case WM_CREATE:
-    pWindow->OnCreate(pWindow, (LPCREATESTRUCT)lParam);
-    return 0;
-    break;
+  if (pJob->bPrefetch) {
+    Prefetch_OnDone(&pApp->m_prefetch, pJob->nGeneration);
+  }
 
-  case WM_PAINT:
-    pWindow->OnPaint(pWindow);
-    return 0;
-    break;
+  if (SUCCEEDED(pJob->hr) && pJob->stamp.szPath[0]) {
+    PaniViewApp_CacheImage(&pJob->stamp, pJob->pBitmap);
+  }
 
-  case WM_DESTROY:
-    pWindow->OnDestroy(pWindow);
-    return 0;
-    break;
+  if (!pJob->bPrefetch && pJob->nGeneration && pJob->nGeneration == pApp->m_nPendingLoad) {
+    pApp->m_nPendingLoad = 0;
 
-  case WM_COMMAND:
-    if (pWindow->OnCommand(pWindow, wParam, lParam))
-    {
-      return 0;
+    if (SUCCEEDED(pJob->hr)) {
+      PaniViewApp_PresentBitmap(pJob->szPath, pJob->pBitmap);
+    }
+    else {
+      PopupError(pJob->hr, NULL);
     }
-    break;
   }
 
-  return DefWindowProc(pWindow->hWnd, message, wParam, lParam);
+  PaniViewApp_FreeLoadJob(pJob);
 }
 
-/* Default OnCreate stub */
-void Window_OnCreate(LPWINDOW pWindow, LPCREATESTRUCT lpcs)
+/*
+ * GetFileStamp
+ * Fill the cache key of a file: its UTF-8 path, size and write time
+ */
+BOOL GetFileStamp(PCWSTR pszPath, LPFILESTAMP pStamp)
 {
-  UNREFERENCED_PARAMETER(pWindow);
-  UNREFERENCED_PARAMETER(lpcs);
-}
+  WIN32_FILE_ATTRIBUTE_DATA fad;
+  if (!GetFileAttributesEx(pszPath, GetFileExInfoStandard, &fad)) {
+    return FALSE;
+  }
 
-/* Default OnCommand stub */
-BOOL Window_OnCommand(LPWINDOW pWindow, WPARAM wParam, LPARAM lParam)
-{
-  UNREFERENCED_PARAMETER(pWindow);
-  UNREFERENCED_PARAMETER(wParam);
-  UNREFERENCED_PARAMETER(lParam);
-  return FALSE;
+  if (!WideCharToMultiByte(CP_UTF8, 0, pszPath, -1, pStamp->szPath, sizeof(pStamp->szPath), NULL, NULL)) {
+    pStamp->szPath[0] = '\0';
+    return FALSE;
+  }
+
+  pStamp->size = ((uint64_t)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+  pStamp->mtime = (int64_t)(((uint64_t)fad.ftLastWriteTime.dwHighDateTime << 32) |
+      fad.ftLastWriteTime.dwLowDateTime);
+
+  return TRUE;
 }
 
-/* Default OnPaint stub */
-void Window_OnPaint(LPWINDOW pWindow)
+static void PaniViewApp_ReleaseCachedImage(void* pImage, void* pUserData)
 {
-  PAINTSTRUCT ps;
-  HDC hdc;
-  hdc = BeginPaint(pWindow->hWnd, &ps);
+  UNREFERENCED_PARAMETER(pUserData);
 
-  EndPaint(pWindow->hWnd, &ps);
+  IWICBitmapSource* pBitmap = (IWICBitmapSource*)pImage;
+  SAFE_RELEASE(pBitmap);
 }
 
-/* Default OnDestroy stub */
-void Window_OnDestroy(LPWINDOW pWindow)
+void PaniViewApp_InitializeImageCache(LPPANIVIEWAPP pApp)
 {
-  UNREFERENCED_PARAMETER(pWindow);
+  size_t budget = (size_t)pApp->m_settings.nImageCacheMB << 20;
+  ImgCache_Init(&pApp->m_imageCache, budget, PaniViewApp_ReleaseCachedImage, NULL);
 }
 
-void RenderCtl2_Init(LPRENDERCTL2 pRenderCtl)
+/*
+ * PaniViewApp_FindCachedImage
+ * Consult the decoded image cache; the bitmap returned is borrowed
+ */
+IWICBitmapSource* PaniViewApp_FindCachedImage(LPFILESTAMP pStamp)
 {
-  Window_Init((LPWINDOW)pRenderCtl);
+  LPPANIVIEWAPP pApp = GetApp();
 
-  pRenderCtl->base.PreCreate = (void (*)(LPWINDOW, LPCREATESTRUCT))RenderCtl2_PreCreate;
-  pRenderCtl->base.PreRegisterClass = (void (*)(LPWINDOW, LPWNDCLASSEX))RenderCtl2_PreRegister;
-  pRenderCtl->base.WndProc = (LRESULT (*)(LPWINDOW, UINT, WPARAM, LPARAM))RenderCtl2_WndProc;
+  IWICBitmapSource* pBitmap = (IWICBitmapSource*)ImgCache_Find(&pApp->m_imageCache,
+      pStamp->szPath, pStamp->size, pStamp->mtime);
 
-  pRenderCtl->base.OnCreate = (void (*)(LPWINDOW, LPCREATESTRUCT)) RenderCtl2_OnCreate;
-  pRenderCtl->base.OnCommand = (BOOL (*)(LPWINDOW, WPARAM, LPARAM)) RenderCtl2_OnCommand;
-  pRenderCtl->base.OnPaint = (void (*)(LPWINDOW)) RenderCtl2_OnPaint;
-  pRenderCtl->base.OnDestroy = (void (*)(LPWINDOW)) RenderCtl2_OnDestroy;
+  return pBitmap;
 }
 
-HWND RenderCtl2_Create(LPRENDERCTL2 pRenderCtl, HWND hParent)
+/*
+ * PaniViewApp_CacheImage
+ * Keep a decoded bitmap for later, charged at the size of its pixels and
+ * of its pyramid levels, or of the preview of a raster left in its file
+ */
+void PaniViewApp_CacheImage(LPFILESTAMP pStamp, IWICBitmapSource* pBitmap)
 {
-  return Window_Create((LPWINDOW)pRenderCtl, hParent);
+  LPPANIVIEWAPP pApp = GetApp();
+
+  UINT width = 0;
+  UINT height = 0;
+  if (FAILED(pBitmap->lpVtbl->GetSize(pBitmap, &width, &height))) {
+    return;
+  }
+
+  /* Gray pixel buffers take a quarter or half of the PBGRA size */
+  LPPIXBUF pPixBuf = PixBufBitmap_GetPixBuf(pBitmap);
+  size_t cost = pPixBuf ? pPixBuf->stride * pPixBuf->height : (size_t)width * height * 4;
+  const PYRAMID* pPyramid = PixBufBitmap_GetPyramid(pBitmap);
+  if (pPyramid) {
+    cost += pPyramid->cbSize;
+  }
+
+  LPRASTERFILE pRaster = RasterBitmap_GetRasterFile(pBitmap);
+  if (pRaster) {
+    unsigned int nScale = RasterBitmap_GetPreviewScale(pRaster->width, pRaster->height);
+    cost = ((pRaster->width + nScale - 1) / nScale) * ((pRaster->height + nScale - 1) / nScale) *
+        (size_t)PixConv_GetBytesPerPixel(pRaster->nPixFmt);
+  }
+
+  pBitmap->lpVtbl->AddRef(pBitmap);
+  if (ImgCache_Insert(&pApp->m_imageCache, pStamp->szPath, pStamp->size, pStamp->mtime,
+      pBitmap, cost) != IMGCACHE_OK) {
+    SAFE_RELEASE(pBitmap);
+  }
 }
 
-LRESULT RenderCtl2_WndProc(LPRENDERCTL2 pRenderCtl, UINT message, WPARAM wParam, LPARAM lParam)
+/*
+ * PaniViewApp_PrefetchNeighbours
+ * Queue low priority decodes of the files planned around pszPath
+ */
+void PaniViewApp_PrefetchNeighbours(PCWSTR pszPath)
 {
-  switch (message)
-  {
-  case WM_SIZE:
-    RenderCtl2_OnSize(pRenderCtl, (UINT)wParam, LOWORD(lParam), HIWORD(lParam));
-    return 0;
-    break;
+  LPPANIVIEWAPP pApp = GetApp();
+
+  /* Supersedes a plan still waiting for the scan */
+  KillTimer(pApp->mainFrame.base.hWnd, PANIVIEW_SCAN_TIMER);
+  pApp->m_szPrefetchPath[0] = L'\0';
+
+  if (!pApp->m_prefetch.nDepth) {
+    return;
   }
 
-  return pRenderCtl->base.DefaultWndProc((LPWINDOW)pRenderCtl, message, wParam, lParam);
+  WCHAR szDir[MAX_PATH] = { 0 };
+  char szNameUtf8[MAX_PATH * 3] = { 0 };
+  if (!IndexDirOfFile(pszPath, szDir, szNameUtf8, sizeof(szNameUtf8))) {
+    return;
+  }
+
+  /* The background scan has not found the file yet: try again after
+   * later refreshes merged more of it, until it is over */
+  size_t nCurrent = DirIndex_Find(&g_dirIndex, szNameUtf8);
+  if (nCurrent == DIRINDEX_NPOS) {
+    if (DirIndex_IsScanning(&g_dirIndex)) {
+      StringCchCopy(pApp->m_szPrefetchPath, MAX_PATH, pszPath);
+      SetTimer(pApp->mainFrame.base.hWnd, PANIVIEW_SCAN_TIMER, PANIVIEW_SCAN_POLL_MS, NULL);
+    }
+    return;
+  }
+
+  size_t positions[PREFETCH_MAX_PENDING];
+  size_t nPlanned = Prefetch_Plan(&pApp->m_prefetch, nCurrent, DirIndex_GetCount(&g_dirIndex),
+      positions, ARRAYSIZE(positions));
+  ULONGLONG nNow = GetTickCount64();
+
+  /* Keep what is still wanted running, otherwise start over */
+  if (Prefetch_IsPlanStale(&pApp->m_prefetch, positions, nPlanned)) {
+    Loader_CancelPrefetch(&pApp->m_loader);
+    Prefetch_ClearPending(&pApp->m_prefetch);
+  }
+
+  for (size_t i = 0; i < nPlanned; ++i) {
+    if (Prefetch_IsPending(&pApp->m_prefetch, positions[i])) {
+      continue;
+    }
+
+    WCHAR szName[MAX_PATH] = { 0 };
+    if (!MultiByteToWideChar(CP_UTF8, 0, DirIndex_GetName(&g_dirIndex, positions[i]), -1, szName, MAX_PATH)) {
+      continue;
+    }
+
+    LPLOADJOB pJob = (LPLOADJOB)calloc(1, sizeof(LOADJOB));
+    if (!pJob) {
+      return;
+    }
+    pJob->bPrefetch = TRUE;
+    pJob->nMaxCost = pApp->m_imageCache.stats.budget;
+    StringCchCopy(pJob->szPath, MAX_PATH, szDir);
+    PathCchAppend(pJob->szPath, MAX_PATH, szName);
+
+    if (!GetFileStamp(pJob->szPath, &pJob->stamp) ||
+        ImgCache_Touch(&pApp->m_imageCache, pJob->stamp.szPath, pJob->stamp.size, pJob->stamp.mtime)) {
+      free(pJob);
+      continue;
+    }
+
+    /* Planned nearest first */
+    uint64_t nGeneration = Loader_SubmitClass(&pApp->m_loader, pJob, LOADER_CLASS_PREFETCH,
+        nNow + (i + 1) * PANIVIEW_PREFETCH_SPACING_MS, FALSE);
+    if (nGeneration) {
+      Prefetch_AddPending(&pApp->m_prefetch, positions[i], nGeneration);
+    }
+  }
 }
 
-void RenderCtl2_PreCreate(LPRENDERCTL2 pRenderCtl, LPCREATESTRUCT lpcs)
+/*
+ * PaniViewApp_RetryPrefetch
+ * Plan the prefetches a background scan held up, refreshing the index first
+ */
+void PaniViewApp_RetryPrefetch(void)
 {
-  UNREFERENCED_PARAMETER(pRenderCtl);
+  LPPANIVIEWAPP pApp = GetApp();
+  WCHAR szPath[MAX_PATH] = { 0 };
 
-  lpcs->x = 10;
-  lpcs->y = 10;
-  lpcs->cx = 100;
-  lpcs->cy = 100;
-  lpcs->style = WS_CHILD | WS_VISIBLE;
+  /* PaniViewApp_PrefetchNeighbours clears the path it is given */
+  StringCchCopy(szPath, MAX_PATH, pApp->m_szPrefetchPath);
+  if (!szPath[0]) {
+    KillTimer(pApp->mainFrame.base.hWnd, PANIVIEW_SCAN_TIMER);
+    return;
+  }
+
+  PaniViewApp_PrefetchNeighbours(szPath);
 }
 
-void RenderCtl2_PreRegister(LPRENDERCTL2 pRenderCtl, LPWNDCLASSEX lpwcex)
+void PaniViewApp_OnCommand(WPARAM wParam, LPARAM lParam)
 {
-  UNREFERENCED_PARAMETER(pRenderCtl);
+  UNREFERENCED_PARAMETER(lParam);
 
-  lpwcex->style = CS_VREDRAW | CS_HREDRAW;
-  lpwcex->hCursor = LoadCursor(NULL, IDC_ARROW);
-  /* I think there is no need to specify GDI background brush since all screen
-   * is drawn by D2D */
-  lpwcex->lpszClassName = szRenderCtlClassName;
+  switch ((int)wParam)
+  {
+  case IDM_FILE_OPEN:
+    PaniViewApp_OnMenuOpen();
+    break;
+
+  case IDM_FILE_EXIT:
+    PaniViewApp_OnMenuExit();
+    break;
+  }
 }
 
-void RenderCtl2_OnCreate(LPRENDERCTL2 pRenderCtl, LPCREATESTRUCT lpcs)
+void PaniViewApp_PrevFile(void)
 {
-  UNREFERENCED_PARAMETER(pRenderCtl);
-  UNREFERENCED_PARAMETER(lpcs);
+  PaniViewApp_StepFile(FALSE, FALSE);
 }
 
-void RenderCtl2_OnSize(LPRENDERCTL2 pRenderCtl, UINT state, int cx, int cy)
+void PaniViewApp_NextFile(void)
 {
-  UNREFERENCED_PARAMETER(pRenderCtl);
-  UNREFERENCED_PARAMETER(state);
-  UNREFERENCED_PARAMETER(cx);
-  UNREFERENCED_PARAMETER(cy);
-
-  LPRENDERERCONTEXT pRendererContext = PaniViewApp_GetRendererContext();
-  if (pRendererContext) {
-    pRendererContext->Resize(pRendererContext, cx, cy);
-  }
+  PaniViewApp_StepFile(TRUE, FALSE);
 }
 
-void RenderCtl2_OnPaint(LPRENDERCTL2 pRenderCtl)
+/*
+ * PaniViewApp_StepFile
+ * Step to the next or previous file, bRepeat when a held key repeated. The
+ * position moves at once; within a burst only a placeholder is shown and
+ * the decode waits until the steps settle.
+ */
+void PaniViewApp_StepFile(BOOL fNext, BOOL bRepeat)
 {
-  LPRENDERERCONTEXT pRendererContext = PaniViewApp_GetRendererContext();
-  if (pRendererContext)
-  {
-    pRendererContext->Draw(pRendererContext, pRenderCtl);
+  LPPANIVIEWAPP pApp = GetApp();
 
-    ValidateRect(pRenderCtl->base.hWnd, NULL);
+  if (pApp->m_szNavPath[0] == L'\0') {
+    return;
   }
-  else {
-    PAINTSTRUCT ps = { 0 };
-    HDC hdc;
 
-    hdc = BeginPaint(pRenderCtl->base.hWnd, &ps);
+  WCHAR szNextFile[MAX_PATH] = { 0 };
+  NextFileInDir(pApp->m_szNavPath, fNext, szNextFile);
 
-    RECT rcClient;
-    GetClientRect(pRenderCtl->base.hWnd, &rcClient);
+  if (szNextFile[0] != '\0')
+  {
+    Prefetch_OnStep(&pApp->m_prefetch, fNext);
 
-    HBRUSH hBrush = CreateSolidBrush(RGB(255, 0, 0));
-    FillRect(hdc, &rcClient, hBrush);
+    ULONGLONG nNow = GetTickCount64();
+    if (NavBurst_OnStep(&pApp->m_navBurst, nNow, bRepeat)) {
+      PaniViewApp_RequestFile(szNextFile);
+    }
+    else {
+      PaniViewApp_ShowPlaceholder(szNextFile);
+      SetTimer(pApp->mainFrame.base.hWnd, PANIVIEW_NAV_TIMER,
+          (UINT)NavBurst_GetDelay(&pApp->m_navBurst, nNow), NULL);
+    }
+  }
+}
 
-    EndPaint(pRenderCtl->base.hWnd, &ps);
+/*
+ * PaniViewApp_SettleNavigation
+ * Decode the file a burst of steps stopped at, once the key went up or the
+ * settle timer fired
+ */
+void PaniViewApp_SettleNavigation(BOOL bReleased)
+{
+  LPPANIVIEWAPP pApp = GetApp();
+  HWND hWnd = pApp->mainFrame.base.hWnd;
+
+  ULONGLONG nNow = GetTickCount64();
+  int bDue = bReleased ? NavBurst_OnRelease(&pApp->m_navBurst) : NavBurst_OnTimer(&pApp->m_navBurst, nNow);
+  if (!bDue) {
+    /* Fired a little early, or with nothing left to decode */
+    UINT nDelay = (UINT)NavBurst_GetDelay(&pApp->m_navBurst, nNow);
+    if (nDelay) {
+      SetTimer(hWnd, PANIVIEW_NAV_TIMER, nDelay, NULL);
+    }
+    else {
+      KillTimer(hWnd, PANIVIEW_NAV_TIMER);
+    }
+    return;
   }
+
+  KillTimer(hWnd, PANIVIEW_NAV_TIMER);
+
+  /* Requesting copies the path over m_szNavPath */
+  WCHAR szPath[MAX_PATH] = { 0 };
+  StringCchCopy(szPath, MAX_PATH, pApp->m_szNavPath);
+  PaniViewApp_RequestFile(szPath);
 }
 
-BOOL RenderCtl2_OnCommand(LPRENDERCTL2 pRenderCtl, WPARAM wParam, LPARAM lParam)
+void PaniViewApp_ToggleFit(void)
 {
-  UNREFERENCED_PARAMETER(pRenderCtl);
-  UNREFERENCED_PARAMETER(wParam);
-  UNREFERENCED_PARAMETER(lParam);
+  LPPANIVIEWAPP pApp = GetApp();
 
-  return FALSE;
+  pApp->m_settings.bFit = !pApp->m_settings.bFit;
+
+  /* Off, the image is shown 1:1 around the middle of the window */
+  LPVIEWPORT pViewport = &pApp->m_viewport;
+  if (pApp->m_settings.bFit) {
+    Viewport_Fit(pViewport);
+  }
+  else {
+    Viewport_ZoomAt(pViewport, 1.0, pViewport->viewWidth / 2.0, pViewport->viewHeight / 2.0);
+  }
+
+  PaniViewApp_UpdateViewport();
 }
 
-void RenderCtl2_OnDestroy(LPRENDERCTL2 pRenderCtl)
+void PaniView_PreRegisterClass(LPWNDCLASSEX lpwcex)
 {
-  UNREFERENCED_PARAMETER(pRenderCtl);
+  lpwcex->style = CS_HREDRAW | CS_VREDRAW;
+  lpwcex->lpszClassName = szPaniViewClassName;
+  lpwcex->lpszMenuName = MAKEINTRESOURCE(IDM_MAIN);
 }
 
-void PaniViewFrame_Init(LPPANIVIEWFRAME pPaniViewFrame)
+void PaniView_PreCreate(LPCREATESTRUCT lpcs)
 {
-  ZeroMemory(pPaniViewFrame, sizeof(PANIVIEWFRAME));
+  UNREFERENCED_PARAMETER(lpcs);
+}
 
-  Window_Init((LPWINDOW)pPaniViewFrame);
+LPWINDOW g_currentWindow = NULL;
 
-  pPaniViewFrame->base.PreCreate = (void (*)(LPWINDOW, LPCREATESTRUCT)) PaniViewFrame_PreCreate;
-  pPaniViewFrame->base.PreRegisterClass = (void (*)(LPWINDOW, LPWNDCLASSEX)) PaniViewFrame_PreRegister;
-  pPaniViewFrame->base.WndProc = (LRESULT (*)(LPWINDOW, UINT, WPARAM, LPARAM)) PaniViewFrame_WndProc;
+void WindowMap_Initialize(void)
+{
+  /* Handles are compared bytewise; the window pointer is stored inline */
+  HashTable_Init(&g_windowMap, sizeof(HWND), sizeof(LPWINDOW), NULL);
+}
 
-  pPaniViewFrame->base.OnCreate = (void (*)(LPWINDOW, LPCREATESTRUCT)) PaniViewFrame_OnCreate;
-  pPaniViewFrame->base.OnCommand = (BOOL (*)(LPWINDOW, WPARAM, LPARAM)) PaniViewFrame_OnCommand;
-  pPaniViewFrame->base.OnDestroy = (void (*)(LPWINDOW)) PaniViewFrame_OnDestroy;
+void WindowMap_Add(HWND hWnd, LPWINDOW pWindow)
+{
+  HashTable_Insert(&g_windowMap, &hWnd, &pWindow);
 }
 
-HWND PaniViewFrame_Create(LPPANIVIEWFRAME pPaniViewFrame)
+LPWINDOW WindowMap_Find(HWND hWnd)
 {
-  HWND hWnd = Window_Create((LPWINDOW)pPaniViewFrame, NULL);
+  LPWINDOW *ppWindow = (LPWINDOW*)HashTable_Find(&g_windowMap, &hWnd);
 
-  if (!hWnd) {
-    return NULL;
-  }
+  return ppWindow ? *ppWindow : NULL;
+}
 
-  /* Create paging toolbar control */
-  HWND hWndToolbar = CreateWindowEx(0, TOOLBARCLASSNAME,
-    NULL, /* No text, name or title */
-    WS_CHILD | TBSTYLE_WRAPABLE | TBSTYLE_FLAT | TBSTYLE_LIST |
-    TBSTYLE_TOOLTIPS | CCS_NODIVIDER | CCS_NORESIZE,
-    0, 0, 0, 0, /* Will be sized on first WM_SIZE */
-    pPaniViewFrame->base.hWnd,
-    NULL, /* No menu nor control id */
-    GetModuleHandle(NULL),
-    NULL); /* No custom window data */
-  if (!hWndToolbar) {
-    assert(FALSE);
-    return FALSE;
+void WindowMap_Remove(HWND hWnd)
+{
+  HashTable_Erase(&g_windowMap, &hWnd);
+}
+
+LRESULT CALLBACK StaticWndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+  LPWINDOW pWindow = WindowMap_Find(hWnd);
+
+  if (!pWindow) {
+    if (g_currentWindow) {
+      pWindow = g_currentWindow;
+      WindowMap_Add(hWnd, pWindow);
+      pWindow->hWnd = hWnd;
+    }
   }
 
-  SendMessage(hWndToolbar, TB_SETEXTENDEDSTYLE, 0,
-    (LPARAM)TBSTYLE_EX_MIXEDBUTTONS);
+  if (pWindow) {
+    LRESULT lResult = pWindow->WndProc(pWindow, message, wParam, lParam);
 
-  HIMAGELIST hImageList = ImageList_LoadImage(
-    GetModuleHandle(NULL),
-    MAKEINTRESOURCE(IDB_TOOLBARSTRIP24),
-    24, /* Width */
-    0,  /* Do not reserve space for growth */
-    CLR_DEFAULT, /* No transparency mask */
-    IMAGE_BITMAP, /* Type of image to load */
-    LR_CREATEDIBSECTION | LR_DEFAULTCOLOR);
-  assert(hImageList);
+    /* Handles get recycled, drop the mapping with the window */
+    if (message == WM_NCDESTROY) {
+      WindowMap_Remove(hWnd);
+    }
 
-  /*
-   *  Select the imagelist into toolbar
-   *
-   *  Q: Is there a toolbar macro exists for this?
-   *  A: No. Probably no toolbar macros exist (basing on MSDN reference list)
-   *  Q: But maybe they forgot to add it, and there is in official SDK headers?
-   *  TODO: Need check
-   *  */
-  SendMessage(hWndToolbar, TB_SETIMAGELIST,
-    (WPARAM)0,  /* Image list id */
-    (LPARAM)hImageList);
+    return lResult;
+  }
+  else {
+    return DefWindowProc(hWnd, message, wParam, lParam);
+  }
+}
 
-  /* Initialize button info */
-  TBBUTTON tbButtons[] = {
-    { 0, IDM_PREV, TBSTATE_ENABLED, BTNS_AUTOSIZE, {0}, 0,
-        (INT_PTR)L"Previous" },
-    { 1, IDM_NEXT, TBSTATE_ENABLED, BTNS_AUTOSIZE, {0}, 0,
-        (INT_PTR)L"Next" },
-    { 2, IDM_ZOOMOUT, TBSTATE_ENABLED, BTNS_AUTOSIZE, {0}, 0,
-        (INT_PTR)L"Zoom Out" },
-    { 3, IDM_ZOOMIN, TBSTATE_ENABLED, BTNS_AUTOSIZE, {0}, 0,
-        (INT_PTR)L"Zoom In" },
-    { 4, IDM_ACTUALSIZE, TBSTATE_ENABLED, BTNS_AUTOSIZE, {0}, 0,
-        (INT_PTR)L"Actual Size" },
-    { 5, IDM_FITSIZE, TBSTATE_ENABLED, BTNS_AUTOSIZE, {0}, 0,
-        (INT_PTR)L"Fit" },
-    { 6, 0, TBSTATE_ENABLED, BTNS_AUTOSIZE, {0}, 0,
-        (INT_PTR)L"Rotate" },
-    { 7, 0, TBSTATE_ENABLED, BTNS_AUTOSIZE, {0}, 0,
-        (INT_PTR)L"Pan" },
-  };
+void Window_Init(LPWINDOW pWindow)
+{
+  pWindow->WndProc = (LRESULT (*)(LPWINDOW, UINT, WPARAM, LPARAM)) Window_WndProc;
+  pWindow->DefaultWndProc = (LRESULT (*)(LPWINDOW, UINT, WPARAM, LPARAM)) Window_DefaultWindowProc;
+  pWindow->OnCreate = (void (*)(LPWINDOW, LPCREATESTRUCT)) Window_OnCreate;
+  pWindow->OnCommand = (BOOL (*)(LPWINDOW, WPARAM, LPARAM)) Window_OnCommand;
+  pWindow->OnPaint = (void (*)(LPWINDOW)) Window_OnPaint;
+  pWindow->OnDestroy = (void (*)(LPWINDOW)) Window_OnDestroy;
+}
 
-  /* Add buttons */
-  SendMessage(hWndToolbar, TB_BUTTONSTRUCTSIZE, (WPARAM)sizeof(TBBUTTON), 0);
-  SendMessage(hWndToolbar, TB_ADDBUTTONS, (WPARAM)8, (LPARAM)&tbButtons);
+HWND Window_Create(LPWINDOW pWindow, HWND hParent)
+{
+  pWindow->PreRegisterClass(pWindow, &pWindow->wcex);
 
-  /* Resize the toolbar, and then show it. */
-  SendMessage(hWndToolbar, TB_AUTOSIZE, 0, 0);
-  ShowWindow(hWndToolbar, TRUE);
+  if (pWindow->wcex.lpszClassName) {
+    Window_RegisterClass(pWindow);
+    pWindow->cs.lpszClass = pWindow->wcex.lpszClassName;
+  }
 
-  pPaniViewFrame->hToolbar = hWndToolbar;
+  pWindow->PreCreate(pWindow, &pWindow->cs);
+
+  LPCREATESTRUCT lpcs = &pWindow->cs;
+  HWND hWnd = NULL;
+
+  /* Set parent, if set explicitly */
+  if (hParent && IsWindow(hParent)) {
+    lpcs->hwndParent = hParent;
+  }
+
+  g_currentWindow = pWindow;
+  hWnd = CreateWindowEx(0, lpcs->lpszClass, lpcs->lpszName, lpcs->style, lpcs->x, lpcs->y, lpcs->cx, lpcs->cy, lpcs->hwndParent, lpcs->hMenu, GetModuleHandle(NULL), NULL);
+  g_currentWindow = NULL;
 
   return hWnd;
 }
 
-LRESULT PaniViewFrame_WndProc(LPPANIVIEWFRAME pPaniViewFrame, UINT message, WPARAM wParam, LPARAM lParam)
+void Window_RegisterClass(LPWINDOW pWindow)
+{
+  WNDCLASSEX wcex = { 0 };
+
+  if (!GetClassInfoEx(GetModuleHandle(NULL), pWindow->pszClassName, &wcex))
+  {
+    pWindow->wcex.cbSize = sizeof(WNDCLASSEX);
+    pWindow->wcex.hInstance = GetModuleHandle(NULL);
+    pWindow->wcex.lpfnWndProc = StaticWndProc;
+
+    RegisterClassEx(&pWindow->wcex);
+  }
+}
+
+LRESULT Window_WndProc(LPWINDOW pWindow, UINT message, WPARAM wParam, LPARAM lParam)
+{
+  return pWindow->DefaultWndProc(pWindow, message, wParam, lParam);
+}
+
+LRESULT Window_DefaultWindowProc(LPWINDOW pWindow, UINT message, WPARAM wParam, LPARAM lParam)
+{
+  switch (message) {
+  case WM_CREATE:
+    pWindow->OnCreate(pWindow, (LPCREATESTRUCT)lParam);
+    return 0;
+    break;
+
+  case WM_PAINT:
+    pWindow->OnPaint(pWindow);
+    return 0;
+    break;
+
+  case WM_DESTROY:
+    pWindow->OnDestroy(pWindow);
+    return 0;
+    break;
+
+  case WM_COMMAND:
+    if (pWindow->OnCommand(pWindow, wParam, lParam))
+    {
+      return 0;
+    }
+    break;
+  }
+
+  return DefWindowProc(pWindow->hWnd, message, wParam, lParam);
+}
+
+/* Default OnCreate stub */
+void Window_OnCreate(LPWINDOW pWindow, LPCREATESTRUCT lpcs)
+{
+  UNREFERENCED_PARAMETER(pWindow);
+  UNREFERENCED_PARAMETER(lpcs);
+}
+
+/* Default OnCommand stub */
+BOOL Window_OnCommand(LPWINDOW pWindow, WPARAM wParam, LPARAM lParam)
+{
+  UNREFERENCED_PARAMETER(pWindow);
+  UNREFERENCED_PARAMETER(wParam);
+  UNREFERENCED_PARAMETER(lParam);
+  return FALSE;
+}
+
+/* Default OnPaint stub */
+void Window_OnPaint(LPWINDOW pWindow)
+{
+  PAINTSTRUCT ps;
+  HDC hdc;
+  hdc = BeginPaint(pWindow->hWnd, &ps);
+
+  EndPaint(pWindow->hWnd, &ps);
+}
+
+/* Default OnDestroy stub */
+void Window_OnDestroy(LPWINDOW pWindow)
+{
+  UNREFERENCED_PARAMETER(pWindow);
+}
+
+void RenderCtl2_Init(LPRENDERCTL2 pRenderCtl)
+{
+  Window_Init((LPWINDOW)pRenderCtl);
+
+  pRenderCtl->base.PreCreate = (void (*)(LPWINDOW, LPCREATESTRUCT))RenderCtl2_PreCreate;
+  pRenderCtl->base.PreRegisterClass = (void (*)(LPWINDOW, LPWNDCLASSEX))RenderCtl2_PreRegister;
+  pRenderCtl->base.WndProc = (LRESULT (*)(LPWINDOW, UINT, WPARAM, LPARAM))RenderCtl2_WndProc;
+
+  pRenderCtl->base.OnCreate = (void (*)(LPWINDOW, LPCREATESTRUCT)) RenderCtl2_OnCreate;
+  pRenderCtl->base.OnCommand = (BOOL (*)(LPWINDOW, WPARAM, LPARAM)) RenderCtl2_OnCommand;
+  pRenderCtl->base.OnPaint = (void (*)(LPWINDOW)) RenderCtl2_OnPaint;
+  pRenderCtl->base.OnDestroy = (void (*)(LPWINDOW)) RenderCtl2_OnDestroy;
+}
+
+HWND RenderCtl2_Create(LPRENDERCTL2 pRenderCtl, HWND hParent)
+{
+  return Window_Create((LPWINDOW)pRenderCtl, hParent);
+}
+
+LRESULT RenderCtl2_WndProc(LPRENDERCTL2 pRenderCtl, UINT message, WPARAM wParam, LPARAM lParam)
 {
   switch (message)
   {
   case WM_SIZE:
-    PaniViewFrame_OnSize(pPaniViewFrame, (UINT)wParam, (int)(LOWORD(lParam)), (int)(HIWORD(lParam)));
+    RenderCtl2_OnSize(pRenderCtl, (UINT)wParam, LOWORD(lParam), HIWORD(lParam));
+    return 0;
+    break;
+
+  case WM_ZOOMIN:
+  case WM_ZOOMOUT:
+  case WM_ACTUALSIZE:
+  case WM_FIT:
+    RenderCtl2_OnZoom(pRenderCtl, message, wParam, lParam);
+    return 0;
+    break;
+
+  case WM_MOUSEWHEEL:
+  case WM_MOUSEHWHEEL:
+    RenderCtl2_OnMouseWheel(pRenderCtl, message, wParam, lParam);
+    return 0;
+    break;
+
+  case WM_LBUTTONDOWN:
+    RenderCtl2_OnLButtonDown(pRenderCtl, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
+    return 0;
+    break;
+
+  case WM_MOUSEMOVE:
+    RenderCtl2_OnMouseMove(pRenderCtl, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
+    return 0;
+    break;
+
+  case WM_LBUTTONUP:
+    RenderCtl2_OnLButtonUp(pRenderCtl);
+    return 0;
+    break;
+
+  case WM_CAPTURECHANGED:
+    pRenderCtl->m_bDragging = FALSE;
     return 0;
     break;
   }
 
-  return pPaniViewFrame->base.DefaultWndProc((LPWINDOW)pPaniViewFrame, message, wParam, lParam);
+  return pRenderCtl->base.DefaultWndProc((LPWINDOW)pRenderCtl, message, wParam, lParam);
 }
 
-void PaniViewFrame_PreCreate(LPPANIVIEWFRAME pPaniViewFrame, LPCREATESTRUCT lpcs)
+void RenderCtl2_PreCreate(LPRENDERCTL2 pRenderCtl, LPCREATESTRUCT lpcs)
 {
-  UNREFERENCED_PARAMETER(pPaniViewFrame);
+  UNREFERENCED_PARAMETER(pRenderCtl);
 
-  lpcs->style = WS_OVERLAPPEDWINDOW | WS_VISIBLE;
-  lpcs->cx = CW_USEDEFAULT;
-  lpcs->cy = CW_USEDEFAULT;
-  lpcs->lpszName = szPaniView;
+  lpcs->x = 10;
+  lpcs->y = 10;
+  lpcs->cx = 100;
+  lpcs->cy = 100;
+  lpcs->style = WS_CHILD | WS_VISIBLE;
 }
 
-void PaniViewFrame_PreRegister(LPPANIVIEWFRAME pPaniViewFrame, LPWNDCLASSEX lpwcex)
+void RenderCtl2_PreRegister(LPRENDERCTL2 pRenderCtl, LPWNDCLASSEX lpwcex)
 {
-  UNREFERENCED_PARAMETER(pPaniViewFrame);
+  UNREFERENCED_PARAMETER(pRenderCtl);
 
-  lpwcex->style = CS_HREDRAW | CS_VREDRAW;
-  lpwcex->hIcon = LoadIcon(GetModuleHandle(NULL), MAKEINTRESOURCE(IDI_ICON));
+  lpwcex->style = CS_VREDRAW | CS_HREDRAW;
   lpwcex->hCursor = LoadCursor(NULL, IDC_ARROW);
-  lpwcex->hbrBackground = (HBRUSH)(COLOR_BTNFACE + 1);
-  lpwcex->lpszClassName = szPaniViewClassName;
-  lpwcex->lpszMenuName = MAKEINTRESOURCE(IDM_MAIN);
-}
+  /* I think there is no need to specify GDI background brush since all screen
+   * is drawn by D2D */
+  lpwcex->lpszClassName = szRenderCtlClassName;
+}
+
+void RenderCtl2_OnCreate(LPRENDERCTL2 pRenderCtl, LPCREATESTRUCT lpcs)
+{
+  UNREFERENCED_PARAMETER(pRenderCtl);
+  UNREFERENCED_PARAMETER(lpcs);
+}
+
+void RenderCtl2_OnSize(LPRENDERCTL2 pRenderCtl, UINT state, int cx, int cy)
+{
+  UNREFERENCED_PARAMETER(pRenderCtl);
+  UNREFERENCED_PARAMETER(state);
+
+  LPPANIVIEWAPP pApp = GetApp();
+  Viewport_SetViewSize(&pApp->m_viewport, cx, cy);
+
+  LPRENDERERCONTEXT pRendererContext = PaniViewApp_GetRendererContext();
+  if (pRendererContext) {
+    pRendererContext->Resize(pRendererContext, cx, cy);
+  }
+}
+
+void RenderCtl2_OnPaint(LPRENDERCTL2 pRenderCtl)
+{
+  LPRENDERERCONTEXT pRendererContext = PaniViewApp_GetRendererContext();
+  if (pRendererContext)
+  {
+    pRendererContext->Draw(pRendererContext, pRenderCtl);
+
+    ValidateRect(pRenderCtl->base.hWnd, NULL);
+  }
+  else {
+    PAINTSTRUCT ps = { 0 };
+    HDC hdc;
+
+    hdc = BeginPaint(pRenderCtl->base.hWnd, &ps);
+
+    RECT rcClient;
+    GetClientRect(pRenderCtl->base.hWnd, &rcClient);
+
+    HBRUSH hBrush = CreateSolidBrush(RGB(255, 0, 0));
+    FillRect(hdc, &rcClient, hBrush);
+
+    EndPaint(pRenderCtl->base.hWnd, &ps);
+  }
+}
+
+BOOL RenderCtl2_OnCommand(LPRENDERCTL2 pRenderCtl, WPARAM wParam, LPARAM lParam)
+{
+  UNREFERENCED_PARAMETER(pRenderCtl);
+  UNREFERENCED_PARAMETER(wParam);
+  UNREFERENCED_PARAMETER(lParam);
+
+  return FALSE;
+}
+
+/*
+ * RenderCtl2_OnZoom
+ * WM_ZOOMIN, WM_ZOOMOUT, WM_ACTUALSIZE and WM_FIT. With wParam nonzero the
+ * image point at the client coordinates in lParam stays where it is, else
+ * the one in the middle of the window.
+ */
+void RenderCtl2_OnZoom(LPRENDERCTL2 pRenderCtl, UINT message, WPARAM wParam, LPARAM lParam)
+{
+  UNREFERENCED_PARAMETER(pRenderCtl);
+
+  LPPANIVIEWAPP pApp = GetApp();
+  LPVIEWPORT pViewport = &pApp->m_viewport;
+
+  double x = pViewport->viewWidth / 2.0;
+  double y = pViewport->viewHeight / 2.0;
+  if (wParam) {
+    x = GET_X_LPARAM(lParam);
+    y = GET_Y_LPARAM(lParam);
+  }
+
+  int bChanged = 0;
+  switch (message) {
+  case WM_ZOOMIN:
+    bChanged = Viewport_ZoomStep(pViewport, 1, x, y);
+    break;
+  case WM_ZOOMOUT:
+    bChanged = Viewport_ZoomStep(pViewport, -1, x, y);
+    break;
+  case WM_ACTUALSIZE:
+    bChanged = Viewport_ZoomAt(pViewport, 1.0, x, y);
+    break;
+  case WM_FIT:
+    bChanged = Viewport_Fit(pViewport);
+    break;
+  }
+
+  if (bChanged) {
+    PaniViewApp_UpdateViewport();
+  }
+}
+
+/*
+ * RenderCtl2_OnMouseWheel
+ * The wheel scrolls the image, sideways with Shift held or when tilted;
+ * with Ctrl held it zooms at the cursor. Fine-grained wheels add up to
+ * whole zoom steps.
+ */
+void RenderCtl2_OnMouseWheel(LPRENDERCTL2 pRenderCtl, UINT message, WPARAM wParam, LPARAM lParam)
+{
+  LPPANIVIEWAPP pApp = GetApp();
+
+  int delta = GET_WHEEL_DELTA_WPARAM(wParam);
+  UINT keys = GET_KEYSTATE_WPARAM(wParam);
+
+  if (message == WM_MOUSEWHEEL && (keys & MK_CONTROL)) {
+    pRenderCtl->m_nWheelDelta += delta;
+    int nSteps = pRenderCtl->m_nWheelDelta / WHEEL_DELTA;
+    pRenderCtl->m_nWheelDelta -= nSteps * WHEEL_DELTA;
+    if (!nSteps) {
+      return;
+    }
+
+    /* Wheel messages carry screen coordinates */
+    POINT pt = { GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam) };
+    ScreenToClient(pRenderCtl->base.hWnd, &pt);
+
+    if (Viewport_ZoomStep(&pApp->m_viewport, nSteps, pt.x, pt.y)) {
+      PaniViewApp_UpdateViewport();
+    }
+    return;
+  }
+
+  double scroll = (double)delta * PANIVIEW_WHEEL_SCROLL / WHEEL_DELTA;
+  int bChanged = 0;
+  if (message == WM_MOUSEHWHEEL) {
+    bChanged = Viewport_Pan(&pApp->m_viewport, -scroll, 0.0);
+  }
+  else if (keys & MK_SHIFT) {
+    bChanged = Viewport_Pan(&pApp->m_viewport, scroll, 0.0);
+  }
+  else {
+    bChanged = Viewport_Pan(&pApp->m_viewport, 0.0, scroll);
+  }
+
+  if (bChanged) {
+    PaniViewApp_UpdateViewport();
+  }
+}
+
+void RenderCtl2_OnLButtonDown(LPRENDERCTL2 pRenderCtl, int x, int y)
+{
+  SetCapture(pRenderCtl->base.hWnd);
+
+  pRenderCtl->m_bDragging = TRUE;
+  pRenderCtl->m_ptDrag.x = x;
+  pRenderCtl->m_ptDrag.y = y;
+}
+
+/* Dragged: the image follows the cursor */
+void RenderCtl2_OnMouseMove(LPRENDERCTL2 pRenderCtl, int x, int y)
+{
+  if (!pRenderCtl->m_bDragging) {
+    return;
+  }
+
+  LPPANIVIEWAPP pApp = GetApp();
+  int dx = x - pRenderCtl->m_ptDrag.x;
+  int dy = y - pRenderCtl->m_ptDrag.y;
+  pRenderCtl->m_ptDrag.x = x;
+  pRenderCtl->m_ptDrag.y = y;
+
+  if (Viewport_Pan(&pApp->m_viewport, dx, dy)) {
+    PaniViewApp_UpdateViewport();
+  }
+}
+
+void RenderCtl2_OnLButtonUp(LPRENDERCTL2 pRenderCtl)
+{
+  if (pRenderCtl->m_bDragging) {
+    ReleaseCapture();
+  }
+}
+
+void RenderCtl2_OnDestroy(LPRENDERCTL2 pRenderCtl)
+{
+  UNREFERENCED_PARAMETER(pRenderCtl);
+}
+
+void PaniViewFrame_Init(LPPANIVIEWFRAME pPaniViewFrame)
+{
+  ZeroMemory(pPaniViewFrame, sizeof(PANIVIEWFRAME));
+
+  Window_Init((LPWINDOW)pPaniViewFrame);
+
+  pPaniViewFrame->base.PreCreate = (void (*)(LPWINDOW, LPCREATESTRUCT)) PaniViewFrame_PreCreate;
+  pPaniViewFrame->base.PreRegisterClass = (void (*)(LPWINDOW, LPWNDCLASSEX)) PaniViewFrame_PreRegister;
+  pPaniViewFrame->base.WndProc = (LRESULT (*)(LPWINDOW, UINT, WPARAM, LPARAM)) PaniViewFrame_WndProc;
+
+  pPaniViewFrame->base.OnCreate = (void (*)(LPWINDOW, LPCREATESTRUCT)) PaniViewFrame_OnCreate;
+  pPaniViewFrame->base.OnCommand = (BOOL (*)(LPWINDOW, WPARAM, LPARAM)) PaniViewFrame_OnCommand;
+  pPaniViewFrame->base.OnDestroy = (void (*)(LPWINDOW)) PaniViewFrame_OnDestroy;
+}
+
+HWND PaniViewFrame_Create(LPPANIVIEWFRAME pPaniViewFrame)
+{
+  HWND hWnd = Window_Create((LPWINDOW)pPaniViewFrame, NULL);
+
+  if (!hWnd) {
+    return NULL;
+  }
+
+  /* Create paging toolbar control */
+  HWND hWndToolbar = CreateWindowEx(0, TOOLBARCLASSNAME,
+    NULL, /* No text, name or title */
+    WS_CHILD | TBSTYLE_WRAPABLE | TBSTYLE_FLAT | TBSTYLE_LIST |
+    TBSTYLE_TOOLTIPS | CCS_NODIVIDER | CCS_NORESIZE,
+    0, 0, 0, 0, /* Will be sized on first WM_SIZE */
+    pPaniViewFrame->base.hWnd,
+    NULL, /* No menu nor control id */
+    GetModuleHandle(NULL),
+    NULL); /* No custom window data */
+  if (!hWndToolbar) {
+    assert(FALSE);
+    return FALSE;
+  }
+
+  SendMessage(hWndToolbar, TB_SETEXTENDEDSTYLE, 0,
+    (LPARAM)TBSTYLE_EX_MIXEDBUTTONS);
+
+  HIMAGELIST hImageList = ImageList_LoadImage(
+    GetModuleHandle(NULL),
+    MAKEINTRESOURCE(IDB_TOOLBARSTRIP24),
+    24, /* Width */
+    0,  /* Do not reserve space for growth */
+    CLR_DEFAULT, /* No transparency mask */
+    IMAGE_BITMAP, /* Type of image to load */
+    LR_CREATEDIBSECTION | LR_DEFAULTCOLOR);
+  assert(hImageList);
+
+  /*
+   *  Select the imagelist into toolbar
+   *
+   *  Q: Is there a toolbar macro exists for this?
+   *  A: No. Probably no toolbar macros exist (basing on MSDN reference list)
+   *  Q: But maybe they forgot to add it, and there is in official SDK headers?
+   *  TODO: Need check
+   *  */
+  SendMessage(hWndToolbar, TB_SETIMAGELIST,
+    (WPARAM)0,  /* Image list id */
+    (LPARAM)hImageList);
+
+  /* Initialize button info */
+  TBBUTTON tbButtons[] = {
+    { 0, IDM_PREV, TBSTATE_ENABLED, BTNS_AUTOSIZE, {0}, 0,
+        (INT_PTR)L"Previous" },
+    { 1, IDM_NEXT, TBSTATE_ENABLED, BTNS_AUTOSIZE, {0}, 0,
+        (INT_PTR)L"Next" },
+    { 2, IDM_ZOOMOUT, TBSTATE_ENABLED, BTNS_AUTOSIZE, {0}, 0,
+        (INT_PTR)L"Zoom Out" },
+    { 3, IDM_ZOOMIN, TBSTATE_ENABLED, BTNS_AUTOSIZE, {0}, 0,
+        (INT_PTR)L"Zoom In" },
+    { 4, IDM_ACTUALSIZE, TBSTATE_ENABLED, BTNS_AUTOSIZE, {0}, 0,
+        (INT_PTR)L"Actual Size" },
+    { 5, IDM_FITSIZE, TBSTATE_ENABLED, BTNS_AUTOSIZE, {0}, 0,
+        (INT_PTR)L"Fit" },
+    { 6, 0, TBSTATE_ENABLED, BTNS_AUTOSIZE, {0}, 0,
+        (INT_PTR)L"Rotate" },
+    { 7, 0, TBSTATE_ENABLED, BTNS_AUTOSIZE, {0}, 0,
+        (INT_PTR)L"Pan" },
+  };
+
+  /* Add buttons */
+  SendMessage(hWndToolbar, TB_BUTTONSTRUCTSIZE, (WPARAM)sizeof(TBBUTTON), 0);
+  SendMessage(hWndToolbar, TB_ADDBUTTONS, (WPARAM)8, (LPARAM)&tbButtons);
+
+  /* Resize the toolbar, and then show it. */
+  SendMessage(hWndToolbar, TB_AUTOSIZE, 0, 0);
+  ShowWindow(hWndToolbar, TRUE);
+
+  pPaniViewFrame->hToolbar = hWndToolbar;
+
+  return hWnd;
+}
+
+LRESULT PaniViewFrame_WndProc(LPPANIVIEWFRAME pPaniViewFrame, UINT message, WPARAM wParam, LPARAM lParam)
+{
+  switch (message)
+  {
+  case WM_SIZE:
+    PaniViewFrame_OnSize(pPaniViewFrame, (UINT)wParam, (int)(LOWORD(lParam)), (int)(HIWORD(lParam)));
+    return 0;
+    break;
+
+  case WM_LOADCOMPLETE:
+    PaniViewApp_OnLoadsQueued();
+    return 0;
+    break;
+
+  /* Arrow keys step through the directory, bit 30 is set on repeats */
+  case WM_KEYDOWN:
+    if (wParam == VK_LEFT || wParam == VK_RIGHT) {
+      PaniViewApp_StepFile(wParam == VK_RIGHT, (lParam & (1 << 30)) != 0);
+      return 0;
+    }
+    break;
+
+  case WM_KEYUP:
+    if (wParam == VK_LEFT || wParam == VK_RIGHT) {
+      PaniViewApp_SettleNavigation(TRUE);
+      return 0;
+    }
+    break;
+
+  case WM_TIMER:
+    if (wParam == PANIVIEW_NAV_TIMER) {
+      PaniViewApp_SettleNavigation(FALSE);
+      return 0;
+    }
+    if (wParam == PANIVIEW_SCAN_TIMER) {
+      PaniViewApp_RetryPrefetch();
+      return 0;
+    }
+    break;
+
+  /* The wheel goes to the window with the focus, which is this one */
+  case WM_MOUSEWHEEL:
+  case WM_MOUSEHWHEEL:
+    return SendMessage(GetApp()->renderCtl.base.hWnd, message, wParam, lParam);
+    break;
+  }
+
+  return pPaniViewFrame->base.DefaultWndProc((LPWINDOW)pPaniViewFrame, message, wParam, lParam);
+}
+
+void PaniViewFrame_PreCreate(LPPANIVIEWFRAME pPaniViewFrame, LPCREATESTRUCT lpcs)
+{
+  UNREFERENCED_PARAMETER(pPaniViewFrame);
+
+  lpcs->style = WS_OVERLAPPEDWINDOW | WS_VISIBLE;
+  lpcs->cx = CW_USEDEFAULT;
+  lpcs->cy = CW_USEDEFAULT;
+  lpcs->lpszName = szPaniView;
+}
+
+void PaniViewFrame_PreRegister(LPPANIVIEWFRAME pPaniViewFrame, LPWNDCLASSEX lpwcex)
+{
+  UNREFERENCED_PARAMETER(pPaniViewFrame);
+
+  lpwcex->style = CS_HREDRAW | CS_VREDRAW;
+  lpwcex->hIcon = LoadIcon(GetModuleHandle(NULL), MAKEINTRESOURCE(IDI_ICON));
+  lpwcex->hCursor = LoadCursor(NULL, IDC_ARROW);
+  lpwcex->hbrBackground = (HBRUSH)(COLOR_BTNFACE + 1);
+  lpwcex->lpszClassName = szPaniViewClassName;
+  lpwcex->lpszMenuName = MAKEINTRESOURCE(IDM_MAIN);
+}
+
+void PaniViewFrame_OnCreate(LPPANIVIEWFRAME pPaniViewFrame, LPCREATESTRUCT lpcs)
+{
+  UNREFERENCED_PARAMETER(pPaniViewFrame);
+  UNREFERENCED_PARAMETER(lpcs);
+}
+
+void PaniViewFrame_OnSize(LPPANIVIEWFRAME pPaniViewFrame, UINT state, int cx, int cy)
+{
+  UNREFERENCED_PARAMETER(state);
+
+  SIZE tbSize;
+  SendMessage(pPaniViewFrame->hToolbar, TB_GETMAXSIZE, 0, (LPARAM)&tbSize);
+
+  SetWindowPos(pPaniViewFrame->hToolbar, NULL,
+    (cx - tbSize.cx) / 2, /* Center horizontally */
+    cy - (tbSize.cy), /* Snap to bottom */
+    tbSize.cx, /* Apply maximum toolbar size */
+    tbSize.cy,
+    SWP_NOZORDER);
+
+  LPPANIVIEWAPP pApp = GetApp();
+  SetWindowPos(pApp->renderCtl.base.hWnd, NULL,
+    0, 0,
+    cx,
+    cy - (tbSize.cy),  /* Subtract the toolbar's heigth */
+    SWP_NOZORDER);
+}
+
+BOOL PaniViewFrame_OnCommand(LPPANIVIEWFRAME pPaniViewFrame, WPARAM wParam, LPARAM lParam)
+{
+  UNREFERENCED_PARAMETER(lParam);
+
+  int id = LOWORD(wParam);
+
+  switch (id) {
+  case IDM_FILE_OPEN:
+    PaniViewFrame_OnFileOpenCommand(pPaniViewFrame);
+    break;
+
+  case IDM_PREV:
+    PaniViewFrame_OnViewPrevCommand(pPaniViewFrame);
+    break;
+
+  case IDM_NEXT:
+    PaniViewFrame_OnViewNextCommand(pPaniViewFrame);
+    break;
+
+  case IDM_FITSIZE:
+    PaniViewFrame_OnViewFitCommand(pPaniViewFrame);
+    break;
+
+  case IDM_ZOOMIN:
+    PaniViewFrame_OnViewZoomCommand(pPaniViewFrame, WM_ZOOMIN);
+    break;
+
+  case IDM_ZOOMOUT:
+    PaniViewFrame_OnViewZoomCommand(pPaniViewFrame, WM_ZOOMOUT);
+    break;
+
+  case IDM_ACTUALSIZE:
+    PaniViewFrame_OnViewZoomCommand(pPaniViewFrame, WM_ACTUALSIZE);
+    break;
+
+  case IDM_SETTINGS:
+    DialogBox(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_SETTINGS),
+      pPaniViewFrame->base.hWnd, (DLGPROC)SettingsDlgProc);
+    break;
+    
+
+  case IDM_ABOUT:
+    DialogBox(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_ABOUT),
+      pPaniViewFrame->base.hWnd, (DLGPROC)AboutDlgProc);
+    break;
+
+  case IDM_FILE_EXIT:
+    PostQuitMessage(0);
+    break;
+  }
+
+  return FALSE;
+}
+
+void PaniViewFrame_OnDestroy(LPPANIVIEWFRAME pPaniViewFrame)
+{
+  UNREFERENCED_PARAMETER(pPaniViewFrame);
+
+  PostQuitMessage(0);
+}
+
+void PaniViewFrame_OnFileOpenCommand(LPPANIVIEWFRAME pPaniViewFrame)
+{
+  UNREFERENCED_PARAMETER(pPaniViewFrame);
+
+  HRESULT hr = S_OK;
+
+  LPWSTR szFilePath;
+  hr = InvokeFileOpenDialog(&szFilePath);
+
+  if (SUCCEEDED(hr))
+  {
+    hr = PaniViewApp_LoadFromFile(szFilePath);
+
+    if (FAILED(hr)) {
+      PopupError(hr, NULL);
+      assert(FALSE);
+    }
+  }
+}
+
+void PaniViewFrame_OnViewPrevCommand(LPPANIVIEWFRAME pPaniViewFrame)
+{
+  UNREFERENCED_PARAMETER(pPaniViewFrame);
+
+  PaniViewApp_PrevFile();
+}
+
+void PaniViewFrame_OnViewNextCommand(LPPANIVIEWFRAME pPaniViewFrame)
+{
+  UNREFERENCED_PARAMETER(pPaniViewFrame);
+
+  PaniViewApp_NextFile();
+}
+
+void PaniViewFrame_OnViewFitCommand(LPPANIVIEWFRAME pPaniViewFrame)
+{
+  UNREFERENCED_PARAMETER(pPaniViewFrame);
+
+  PaniViewApp_ToggleFit();
+}
+
+/* Zoomed around the middle of the render control */
+void PaniViewFrame_OnViewZoomCommand(LPPANIVIEWFRAME pPaniViewFrame, UINT message)
+{
+  UNREFERENCED_PARAMETER(pPaniViewFrame);
+
+  LPPANIVIEWAPP pApp = GetApp();
+  SendMessage(pApp->renderCtl.base.hWnd, message, 0, 0);
+}
+
+size_t GetPfFileSize(FILE* fp)
+{
+  size_t size = 0;
+
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  return size;
+}
+
+void OrthoMatrix(GLfloat mat[4][4], GLfloat width, GLfloat height)
+{
+  /*
+  memset(&mat[0][0], 0, sizeof(*mat) * 4 * 4);
+  */
+
+  mat[0][0] = 2.0f / -width;
+  mat[1][1] = 2.0f / -height;
+  mat[3][3] = 1.0f;
+}
+
+void MatrixMultiply(GLfloat mat1[4][4], GLfloat mat2[4][4], GLfloat mat3[4][4])
+{
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      mat3[i][j] = 0;
+      for (int k = 0; k < 4; ++k) {
+        mat3[i][k] += mat1[i][k] * mat2[k][j];
+      }
+    }
+  }
+}
+
+int Rect_GetWidth(LPRECT prc)
+{
+  return prc->right - prc->left;
+}
+
+int Rect_GetHeight(LPRECT prc)
+{
+  return prc->bottom - prc->top;
+}
+
+BOOL RectBlt(HDC hdcDest, RECT rcDest, HDC hdcSrc, RECT rcSrc, DWORD rop)
+{
+  if (rcDest.left < 0)
+  {
+    float factor = (float)abs(rcDest.left) / (float)(abs(rcDest.left) + rcDest.right);
+
+    rcSrc.left = (LONG)(rcSrc.right * factor);
+    rcSrc.right -= rcSrc.left;
+    rcDest.left = 0;
+
+  }
+
+  if (rcDest.top < 0)
+  {
+    float factor = (float)abs(rcDest.top) / (float)(abs(rcDest.top) + rcDest.bottom);
+
+    rcSrc.top = (LONG)(rcSrc.bottom * factor);
+    rcSrc.bottom -= rcSrc.top;
+    rcDest.top = 0;
+  }
+
+  return StretchBlt(hdcDest,
+    rcDest.left,
+    rcDest.top,
+    Rect_GetWidth(&rcDest),
+    Rect_GetHeight(&rcDest),
+    hdcSrc,
+    rcSrc.left, rcSrc.top, rcSrc.right, rcSrc.bottom,
+    rop);
+}
+
+void RectMatrixMultiply(LPRECT prc, float mat[4][4])
+{
+  prc->left *= (LONG)mat[0][0];
+  prc->right *= (LONG)mat[0][0];
+  prc->top *= (LONG)mat[1][1];
+  prc->bottom *= (LONG)mat[1][1];
+}
+
+void RectTranslate(LPRECT prc, float x, float y)
+{
+  prc->left += (LONG)x;
+  prc->right += (LONG)x;
+  prc->top += (LONG)y;
+  prc->bottom += (LONG)y;
+}
+
+/*********************************
+ *  Direct2D Renderer functions  *
+ *********************************/
+
+HRESULT D2DRendererContext_CreateDeviceResources(LPD2DRENDERERCONTEXT pD2DRendererContext, HWND hWnd)
+{
+  ID2D1HwndRenderTarget** ppRenderTarget = &pD2DRendererContext->m_pRenderTarget;
+  ID2D1Factory** ppD2DFactory = &pD2DRendererContext->m_pD2DFactory;
+
+  HRESULT hr = S_OK;
+
+  if (!*ppRenderTarget) {
+    RECT rcClient;
+    D2D1_SIZE_U size;
+
+    GetClientRect(hWnd, &rcClient);
+    size = (D2D1_SIZE_U){
+      rcClient.right - rcClient.left,
+      rcClient.bottom - rcClient.top
+    };
+
+    /* TODO: Research */
+    D2D1_RENDER_TARGET_PROPERTIES rtProp = { 0 };
+    rtProp.type = D2D1_RENDER_TARGET_TYPE_DEFAULT;
+    rtProp.pixelFormat.format = DXGI_FORMAT_UNKNOWN;
+    rtProp.pixelFormat.alphaMode = D2D1_ALPHA_MODE_UNKNOWN;
+    rtProp.dpiX = DEFAULT_DPI;
+    rtProp.dpiY = DEFAULT_DPI;
+    rtProp.usage = D2D1_RENDER_TARGET_USAGE_NONE;
+    rtProp.minLevel = D2D1_FEATURE_LEVEL_DEFAULT;
+
+    D2D1_HWND_RENDER_TARGET_PROPERTIES rtHwndProp = { 0 };
+    rtHwndProp.hwnd = hWnd;
+    rtHwndProp.pixelSize = size; /* CHECK */
+    rtHwndProp.presentOptions = D2D1_PRESENT_OPTIONS_NONE;
+
+    /* Create a Direct2D render target */
+    hr = dxID2D1Factory_CreateHwndRenderTarget(
+      *ppD2DFactory,
+      &rtProp,
+      &rtHwndProp,
+      ppRenderTarget
+    );
+  }
+
+  return hr;
+}
+
+void D2DRendererContext_DiscardDeviceResources(LPD2DRENDERERCONTEXT pD2DRendererContext)
+{
+  SAFE_RELEASE(pD2DRendererContext->m_pD2DLevelBitmap);
+  pD2DRendererContext->m_nLevel = 0;
+  SAFE_RELEASE(pD2DRendererContext->m_pRenderTarget);
+}
+
+/*
+ * D2DRendererContext_SelectLevel
+ * The bitmap to draw the image from at scale: the pyramid level the scale
+ * asks for, made once and kept until the level changes, or the full image
+ */
+ID2D1Bitmap* D2DRendererContext_SelectLevel(LPD2DRENDERERCONTEXT pD2DRendererContext, IWICBitmapSource* pSource,
+    float scale)
+{
+  const PYRAMID* pPyramid = PixBufBitmap_GetPyramid(pSource);
+  size_t nLevel = pPyramid ? Pyramid_SelectLevel(pPyramid, scale) : 0;
+
+  if (!nLevel) {
+    return pD2DRendererContext->m_pD2DBitmap;
+  }
+
+  if (nLevel != pD2DRendererContext->m_nLevel || !pD2DRendererContext->m_pD2DLevelBitmap) {
+    SAFE_RELEASE(pD2DRendererContext->m_pD2DLevelBitmap);
+    pD2DRendererContext->m_nLevel = 0;
+
+    IWICBitmap* pLevelBitmap = PixBufBitmap_CreateFromPixBuf(pPyramid->pLevels[nLevel]);
+    if (!pLevelBitmap) {
+      return pD2DRendererContext->m_pD2DBitmap;
+    }
+
+    HRESULT hr = dxID2D1RenderTarget_CreateBitmapFromWicBitmap(
+      (ID2D1RenderTarget*)pD2DRendererContext->m_pRenderTarget,
+      (IWICBitmapSource*)pLevelBitmap,
+      NULL,
+      &pD2DRendererContext->m_pD2DLevelBitmap
+    );
+    SAFE_RELEASE(pLevelBitmap);
+
+    if (FAILED(hr)) {
+      return pD2DRendererContext->m_pD2DBitmap;
+    }
+    pD2DRendererContext->m_nLevel = nLevel;
+  }
+
+  return pD2DRendererContext->m_pD2DLevelBitmap;
+}
+
+void D2DRendererContext_Draw(LPD2DRENDERERCONTEXT pD2DRendererContext, LPRENDERCTL2 pRenderCtl)
+{
+  LPPANIVIEWAPP pApp = GetApp();
+
+  ID2D1HwndRenderTarget** ppRenderTarget = &pD2DRendererContext->m_pRenderTarget;
+  IWICBitmapSource** ppConvertedSourceBitmap = &pApp->m_pConvertedSourceBitmap;
+  ID2D1Bitmap** ppD2DBitmap = &pD2DRendererContext->m_pD2DBitmap;
+
+  HRESULT hr = S_OK;
+
+  hr = D2DRendererContext_CreateDeviceResources(pD2DRendererContext, pRenderCtl->base.hWnd);
+  if (SUCCEEDED(hr)) {
+
+    dxID2D1RenderTarget_BeginDraw((ID2D1RenderTarget*)*ppRenderTarget);
+
+    D2D1_MATRIX_3X2_F mat = D2DUtilMatrixIdentity();
+
+    dxID2D1RenderTarget_SetTransform((ID2D1RenderTarget*)*ppRenderTarget, &mat);
+
+    D2D1_COLOR_F clearColor = D2DColorFromRGB(RGB(0xFF, 0xFF, 0xFF));
+
+    dxID2D1RenderTarget_Clear((ID2D1RenderTarget*)*ppRenderTarget, &clearColor);
+
+    /*  D2DBitmap may have been released due to device loss.
+     *  If so, re-create it from the source bitmap */
+    if (*ppConvertedSourceBitmap && !*ppD2DBitmap)
+    {
+      dxID2D1RenderTarget_CreateBitmapFromWicBitmap(
+        (ID2D1RenderTarget*)*ppRenderTarget,
+        RasterBitmap_GetPreview(*ppConvertedSourceBitmap),
+        NULL,
+        ppD2DBitmap
+      );
+    }
+
+    /* Draw the image where the viewport puts it */
+    if (*ppD2DBitmap)
+    {
+      D2D1_SIZE_F bmpSize;
+      bmpSize = dxID2D1Bitmap_GetSize(*ppD2DBitmap);
+
+      /* A raster's preview has fewer pixels than the image the viewport holds */
+      const VIEWXFORM* pXform = &pApp->m_viewport.xform;
+      float bmpScale = bmpSize.width > 0.0f ? (float)pApp->m_viewport.imageWidth / bmpSize.width : 1.0f;
+
+      D2D1_MATRIX_3X2_F matBitmap = D2DUtilMatrixIdentity();
+      matBitmap._11 = bmpScale;
+      matBitmap._22 = bmpScale;
+
+      D2D1_MATRIX_3X2_F matViewport = { 0 };
+      matViewport._11 = (float)pXform->m11;
+      matViewport._12 = (float)pXform->m12;
+      matViewport._21 = (float)pXform->m21;
+      matViewport._22 = (float)pXform->m22;
+      matViewport._31 = (float)pXform->dx;
+      matViewport._32 = (float)pXform->dy;
+
+      D2D1_MATRIX_3X2_F matView = D2DUtilMatrixMultiply(&matBitmap, &matViewport);
+
+      dxID2D1RenderTarget_SetTransform((ID2D1RenderTarget*)*ppRenderTarget, &matView);
+
+      D2D1_RECT_F imgRect = {
+        0.0f, 0.0f,
+        bmpSize.width, bmpSize.height
+      };
+
+      /* Shrunk: linear interpolation from the nearest pyramid level */
+      ID2D1Bitmap* pDrawBitmap = D2DRendererContext_SelectLevel(pD2DRendererContext,
+          *ppConvertedSourceBitmap, (float)pXform->m11 * bmpScale);
+
+      dxID2D1RenderTarget_DrawBitmap(
+        (ID2D1RenderTarget*)*ppRenderTarget,
+        pDrawBitmap,
+        &imgRect, /* Destination rectangle */
+        1.0f, /* Opacity */
+        D2D1_BITMAP_INTERPOLATION_MODE_LINEAR,
+        NULL);  /* No source rectangle (full image) */
+    }
+
+    hr = dxID2D1RenderTarget_EndDraw((ID2D1RenderTarget*)*ppRenderTarget, NULL, NULL);
+    if (hr == (HRESULT)D2DERR_RECREATE_TARGET) {
+      hr = S_OK;
+      D2DRendererContext_DiscardDeviceResources(pD2DRendererContext);
+    }
+  }
+}
+
+void D2DRendererContext_LoadWICBitmap(LPD2DRENDERERCONTEXT pD2DRendererContext, IWICBitmapSource* pIWICBitmapSource)
+{
+  HRESULT hr = S_OK;
+
+  ID2D1HwndRenderTarget** ppRenderTarget = &pD2DRendererContext->m_pRenderTarget;
+  ID2D1Bitmap** ppD2DBitmap = &pD2DRendererContext->m_pD2DBitmap;
+  ID2D1Bitmap* pD2DDirtyBitmap = NULL;
+
+  /* A raster left in its file is drawn from its preview */
+  hr = dxID2D1RenderTarget_CreateBitmapFromWicBitmap(
+    (ID2D1RenderTarget*)*ppRenderTarget,
+    RasterBitmap_GetPreview(pIWICBitmapSource),
+    NULL,
+    &pD2DDirtyBitmap
+  );
+
+  if (FAILED(hr)) {
+    PopupError(hr, NULL);
+    assert(FALSE);
+    goto fail;
+  }
+
+  /* Done successfully. Actually do the changes into structure. */
+  SAFE_RELEASE(*ppD2DBitmap);
+  *ppD2DBitmap = pD2DDirtyBitmap;
+
+  /* Levels of the previous image */
+  SAFE_RELEASE(pD2DRendererContext->m_pD2DLevelBitmap);
+  pD2DRendererContext->m_nLevel = 0;
+
+fail:
+  // SAFE_RELEASE(pD2DDirtyBitmap);
+
+  return;
+}
+
+void D2DRendererContext_Release(LPD2DRENDERERCONTEXT pD2DRendererContext)
+{
+  SAFE_RELEASE(pD2DRendererContext->m_pD2DFactory);
+  SAFE_RELEASE(pD2DRendererContext->m_pD2DLevelBitmap);
+  SAFE_RELEASE(pD2DRendererContext->m_pRenderTarget);
+  SAFE_RELEASE(pD2DRendererContext->m_pLightSlateGrayBrush);
+  SAFE_RELEASE(pD2DRendererContext->m_pCornflowerBlueBrush);
+
+  free(pD2DRendererContext);
+}
+
+void D2DRendererContext_Resize(LPD2DRENDERERCONTEXT pD2DRendererContext, int cx, int cy)
+{
+  ID2D1HwndRenderTarget** ppRenderTarget = &pD2DRendererContext->m_pRenderTarget;
+
+  if (*ppRenderTarget)
+  {
+    dxID2D1HwndRenderTarget_Resize(*ppRenderTarget, &(D2D1_SIZE_U){ cx, cy });
+  }
+}
+
+void InitializeD2DRendererContextStruct(LPD2DRENDERERCONTEXT pD2DRendererContext)
+{
+  pD2DRendererContext->base.Release = (void (*)(LPRENDERERCONTEXT))& D2DRendererContext_Release;
+  pD2DRendererContext->base.Resize = (void (*)(LPRENDERERCONTEXT, int, int))& D2DRendererContext_Resize;
+  pD2DRendererContext->base.Draw = (void (*)(LPRENDERERCONTEXT, LPRENDERCTL2))& D2DRendererContext_Draw;
+  pD2DRendererContext->base.LoadWICBitmap = (void (*)(LPRENDERERCONTEXT, IWICBitmapSource*))& D2DRendererContext_LoadWICBitmap;
+}
+
+LPD2DRENDERERCONTEXT CreateD2DRenderer(void)
+{
+  LPD2DRENDERERCONTEXT pD2DRendererContext = NULL;
+  ID2D1Factory** ppD2DFactory = NULL;
+  HRESULT hr = S_OK;
+
+  pD2DRendererContext = (LPD2DRENDERERCONTEXT) calloc(1, sizeof(D2DRENDERERCONTEXT));
+  if (!pD2DRendererContext) {
+    return NULL;
+  }
+
+  ppD2DFactory = &pD2DRendererContext->m_pD2DFactory;
+
+  InitializeD2DRendererContextStruct(pD2DRendererContext);
+
+  hr = D2D1CreateFactory(D2D1_FACTORY_TYPE_SINGLE_THREADED, &IID_ID2D1Factory1, NULL, (LPVOID) ppD2DFactory);
+  if (FAILED(hr)) {
+    PopupError(hr, NULL);
+    /* will wndData be freed on WM_DESTROY after `return` returns FALSE? */
+    assert(FALSE);
+    return NULL;
+  }
+
+  return pD2DRendererContext;
+}
+
+/*******************************
+ *  OpenGL Renderer functions  *
+ *******************************/
+
+const GLfloat g_vertexBufferData[] = {
+   1.0f,  1.0f,  0.0f,
+  -1.0f,  1.0f,  0.0f,
+   1.0f, -1.0f,  0.0f,
+  -1.0f, -1.0f,  0.0f,
+};
+
+const GLfloat g_uvBufferData[] = {
+   1.0f,  0.0f,
+   0.0f,  0.0f,
+   1.0f,  1.0f,
+   0.0f,  1.0f,
+};
+
+void OpenGLRendererContext_CreateVBO(LPOPENGLRENDERERCONTEXT pGLRendererContext)
+{
+  /* Create VBO and bind data to it */
+  glGenVertexArrays(1, &pGLRendererContext->m_vertexArray);
+  glBindVertexArray(pGLRendererContext->m_vertexArray);
+
+  /* Initialize vertex buffer */
+  glGenBuffers(1, &pGLRendererContext->m_vertexBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, pGLRendererContext->m_vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertexBufferData), g_vertexBufferData, GL_STATIC_DRAW);
+
+  /* Initialize uv buffer */
+  glGenBuffers(1, &pGLRendererContext->m_uvBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, pGLRendererContext->m_uvBuffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(g_uvBufferData), g_uvBufferData, GL_STATIC_DRAW);
+}
+
+void OpenGLRendererContext_CreateDeviceResources(LPOPENGLRENDERERCONTEXT pGLRendererContext, LPRENDERCTL2 pRenderCtl)
+{
+  if (!pGLRendererContext->m_hGLContext)
+  {
+    /* Choose HDC pixel format */
+    PIXELFORMATDESCRIPTOR pfd = { 0 };
+    pfd.nSize = sizeof(PIXELFORMATDESCRIPTOR);
+    pfd.nVersion = 1;
+    pfd.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL | PFD_DOUBLEBUFFER;
+    pfd.iPixelType = PFD_TYPE_RGBA;
+    pfd.cColorBits = 32;
+    pfd.cDepthBits = 32;
+    pfd.iLayerType = PFD_MAIN_PLANE;
+
+    HDC hDC = GetDC(pRenderCtl->base.hWnd);
+
+    int pixFmtId = ChoosePixelFormat(hDC, &pfd);
+    if (!pixFmtId) {
+      // Wrong pixel format
+    }
+
+    if (!SetPixelFormat(hDC, pixFmtId, &pfd)) {
+      // Error while setting the pixel format
+    }
+
+    HGLRC hGLContext = wglCreateContext(hDC);
+    wglMakeCurrent(hDC, hGLContext);
+
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK) {
+      free(pGLRendererContext);
+      return;
+    }
+
+    GLint attribs[] = {
+      WGL_CONTEXT_MAJOR_VERSION_ARB,
+      3,
+      WGL_CONTEXT_MINOR_VERSION_ARB,
+      1,
+      WGL_CONTEXT_FLAGS_ARB,
+      0,
+      0
+    };
+
+    if (wglewIsSupported("WGL_ARB_create_context") == 1)
+    {
+      HGLRC hGLEWContext = wglCreateContextAttribsARB(hDC, 0, attribs);
+
+      wglMakeCurrent(NULL, NULL);
+      wglDeleteContext(hGLContext);
+      pGLRendererContext->m_hGLContext = hGLEWContext;
+
+      wglMakeCurrent(hDC, pGLRendererContext->m_hGLContext);
+    }
+
+    if (!pGLRendererContext->m_hGLContext) {
+      // Failed to initialize GL context
+    }
+
+    static const WCHAR szVertFileName[] = L"vert.glsl";
+    static const WCHAR szFragFileName[] = L"frag.glsl";
+
+    LPPANIVIEWAPP pApp = GetApp();
+    PWSTR pszSite = PaniViewApp_GetAppDataSitePath(pApp);
+
+    size_t lenVertPath = wcslen(pszSite) + ARRAYSIZE(szVertFileName) + 1;
+    PWSTR pszVertPath = (PWSTR)calloc(1, lenVertPath * sizeof(WCHAR));
+    if (pszVertPath) {
+      StringCchCopy(pszVertPath, lenVertPath, pszSite);
+      PathCchAppend(pszVertPath, lenVertPath, szVertFileName);
+    }
+
+    size_t lenFragPath = wcslen(pszSite) + ARRAYSIZE(szFragFileName) + 1;
+    PWSTR pszFragPath = (PWSTR)calloc(1, lenFragPath * sizeof(WCHAR));
+    if (pszFragPath) {
+      StringCchCopy(pszFragPath, lenFragPath, pszSite);
+      PathCchAppend(pszFragPath, lenFragPath, szFragFileName);
+    }
+
+    pGLRendererContext->m_programId = OpenGLRendererContext_LoadShaders(pGLRendererContext, pszVertPath, pszFragPath);
+
+    free(pszVertPath);
+    free(pszFragPath);
+
+    OpenGLRendererContext_CreateTexture(pGLRendererContext);
+    OpenGLRendererContext_CreateVBO(pGLRendererContext);
+    GLUpload_Init(&pGLRendererContext->m_uploadRing, TRUE);
+  }
+}
+
+void OpenGLRendererContext_CreateTexture(LPOPENGLRENDERERCONTEXT pGLRendererContext)
+{
+  GLuint* textureId = &pGLRendererContext->m_textureId;
+
+  if (!*textureId)
+  {
+    glGenTextures(1, textureId);
+    glBindTexture(GL_TEXTURE_2D, *textureId);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+}
+
+void OpenGLRendererContext_Draw(LPOPENGLRENDERERCONTEXT pGLRendererContext, LPRENDERCTL2 pRenderCtl)
+{
+  OpenGLRendererContext_CreateDeviceResources(pGLRendererContext, pRenderCtl);
+
+  /* Clear */
+  glClearColor(1.0f, 0.0f, 0.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  /* Attach shader */
+  glUseProgram(pGLRendererContext->m_programId);
+
+  glUniform1i(glGetUniformLocation(pGLRendererContext->m_programId, "grayscale"), pGLRendererContext->m_bGrayscale);
+
+  if (pGLRendererContext->m_bTiled) {
+    OpenGLRendererContext_DrawTiles(pGLRendererContext);
+  }
+  else {
+    /* Zoomed or resized past a power of two: the texture is swapped for the
+     * level the new scale asks for */
+    size_t nLevel = OpenGLRendererContext_SelectLevel(pGLRendererContext);
+    if (nLevel != pGLRendererContext->m_nPyramidLevel) {
+      const PIXBUF* pLevel = PixBufBitmap_GetPyramid(pGLRendererContext->m_pBitmapSource)->pLevels[nLevel];
+      OpenGLRendererContext_UploadTexture(pGLRendererContext, NULL, pLevel, (UINT)pLevel->width,
+          (UINT)pLevel->height, pLevel->nFormat);
+      pGLRendererContext->m_nPyramidLevel = nLevel;
+    }
+
+    /* Attach texture */
+    glBindTexture(GL_TEXTURE_2D, pGLRendererContext->m_textureId);
+
+    /* Draw plane */
+    OpenGLRendererContext_DrawVBO(pGLRendererContext);
+  }
+
+  /* Swap buffers */
+  HDC hdc = GetDC(pRenderCtl->base.hWnd);
+  SwapBuffers(hdc);
+  ReleaseDC(pRenderCtl->base.hWnd, hdc);
+}
+
+void OpenGLRendererContext_DrawVBO(LPOPENGLRENDERERCONTEXT pGLRendererContext)
+{
+  GLuint* vertexArray = &pGLRendererContext->m_vertexArray;
+  GLuint* vertexBuffer = &pGLRendererContext->m_vertexBuffer;
+  GLuint* uvBuffer = &pGLRendererContext->m_uvBuffer;
+
+  /* Bind vertex array */
+  glBindVertexArray(*vertexArray);
+
+  /* Select vertex buffer */
+  glEnableVertexAttribArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, *vertexBuffer);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+
+  /* Select uv buffer */
+  glEnableVertexAttribArray(1);
+  glBindBuffer(GL_ARRAY_BUFFER, *uvBuffer);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+
+  /* The quad from -1 to 1, top row up, spans the image's pixels */
+  float halfWidth = pGLRendererContext->m_imageWidth / 2.0f;
+  float halfHeight = pGLRendererContext->m_imageHeight / 2.0f;
+
+  GLfloat imageToClip[16];
+  OpenGLRendererContext_GetImageToClip(pGLRendererContext, imageToClip);
+
+  GLfloat transform[16];
+  for (int i = 0; i < 4; ++i) {
+    transform[i] = imageToClip[i] * halfWidth;
+    transform[4 + i] = imageToClip[4 + i] * -halfHeight;
+    transform[8 + i] = imageToClip[8 + i];
+    transform[12 + i] = imageToClip[i] * halfWidth + imageToClip[4 + i] * halfHeight + imageToClip[12 + i];
+  }
+
+  GLuint transformUniform = glGetUniformLocation(pGLRendererContext->m_programId, "transform");
+  glUniformMatrix4fv(transformUniform, 1, GL_FALSE, transform);
+
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
-void PaniViewFrame_OnCreate(LPPANIVIEWFRAME pPaniViewFrame, LPCREATESTRUCT lpcs)
-{
-  UNREFERENCED_PARAMETER(pPaniViewFrame);
-  UNREFERENCED_PARAMETER(lpcs);
+  glDisableVertexAttribArray(0);
+  glDisableVertexAttribArray(1);
+
+  glBindVertexArray(0);
 }
 
-void PaniViewFrame_OnSize(LPPANIVIEWFRAME pPaniViewFrame, UINT state, int cx, int cy)
+/*
+ * OpenGLRendererContext_DrawTiles
+ * Draw the image where the viewport puts it, as DrawVBO does, from the
+ * tiles in view at the level its scale asks for
+ */
+void OpenGLRendererContext_DrawTiles(LPOPENGLRENDERERCONTEXT pGLRendererContext)
 {
-  UNREFERENCED_PARAMETER(state);
+  if (pGLRendererContext->m_imageWidth <= 0.0f || pGLRendererContext->m_viewportWidth <= 0.0f
+      || pGLRendererContext->m_viewportHeight <= 0.0f) {
+    return;
+  }
 
-  SIZE tbSize;
-  SendMessage(pPaniViewFrame->hToolbar, TB_GETMAXSIZE, 0, (LPARAM)&tbSize);
+  TILEVIEW view;
+  Viewport_GetTileView(&GetApp()->m_viewport, &view);
+  GLTiles_Update(&pGLRendererContext->m_tiles, &view);
 
-  SetWindowPos(pPaniViewFrame->hToolbar, NULL,
-    (cx - tbSize.cx) / 2, /* Center horizontally */
-    cy - (tbSize.cy), /* Snap to bottom */
-    tbSize.cx, /* Apply maximum toolbar size */
-    tbSize.cy,
-    SWP_NOZORDER);
+  GLfloat imageToClip[16];
+  OpenGLRendererContext_GetImageToClip(pGLRendererContext, imageToClip);
 
-  LPPANIVIEWAPP pApp = GetApp();
-  SetWindowPos(pApp->renderCtl.base.hWnd, NULL,
-    0, 0,
-    cx,
-    cy - (tbSize.cy),  /* Subtract the toolbar's heigth */
-    SWP_NOZORDER);
+  GLTiles_Draw(&pGLRendererContext->m_tiles,
+      glGetUniformLocation(pGLRendererContext->m_programId, "transform"), imageToClip);
 }
 
-BOOL PaniViewFrame_OnCommand(LPPANIVIEWFRAME pPaniViewFrame, WPARAM wParam, LPARAM lParam)
+/*
+ * OpenGLRendererContext_GetImageToClip
+ * The viewport's transform followed by window pixels to clip space, top
+ * row up, as a column-major 4x4 for the "transform" uniform
+ */
+void OpenGLRendererContext_GetImageToClip(LPOPENGLRENDERERCONTEXT pGLRendererContext, GLfloat imageToClip[16])
 {
-  UNREFERENCED_PARAMETER(lParam);
+  const VIEWXFORM* pXform = &GetApp()->m_viewport.xform;
+  float sx = 2.0f / pGLRendererContext->m_viewportWidth;
+  float sy = -2.0f / pGLRendererContext->m_viewportHeight;
+
+  memset(imageToClip, 0, 16 * sizeof(GLfloat));
+  imageToClip[0] = (float)pXform->m11 * sx;
+  imageToClip[1] = (float)pXform->m12 * sy;
+  imageToClip[4] = (float)pXform->m21 * sx;
+  imageToClip[5] = (float)pXform->m22 * sy;
+  imageToClip[10] = 1.0f;
+  imageToClip[12] = (float)pXform->dx * sx - 1.0f;
+  imageToClip[13] = (float)pXform->dy * sy + 1.0f;
+  imageToClip[15] = 1.0f;
+}
 
-  int id = LOWORD(wParam);
+/*
+ * OpenGLRendererContext_SelectLevel
+ * The pyramid level of the current image the viewport's scale asks for, 0
+ * when it has no pyramid
+ */
+size_t OpenGLRendererContext_SelectLevel(LPOPENGLRENDERERCONTEXT pGLRendererContext)
+{
+  const PYRAMID* pPyramid = PixBufBitmap_GetPyramid(pGLRendererContext->m_pBitmapSource);
+  if (!pPyramid || pGLRendererContext->m_viewportWidth <= 0.0f || pGLRendererContext->m_viewportHeight <= 0.0f) {
+    return 0;
+  }
 
-  switch (id) {
-  case IDM_FILE_OPEN:
-    PaniViewFrame_OnFileOpenCommand(pPaniViewFrame);
-    break;
+  return Pyramid_SelectLevel(pPyramid, GetApp()->m_viewport.scale);
+}
 
-  case IDM_PREV:
-    PaniViewFrame_OnViewPrevCommand(pPaniViewFrame);
-    break;
+GLuint OpenGLRendererContext_LoadShader(LPOPENGLRENDERERCONTEXT lpGLRendererContext, PCWSTR shaderFilePath, GLuint shaderType)
+{
+  UNREFERENCED_PARAMETER(lpGLRendererContext);
 
-  case IDM_NEXT:
-    PaniViewFrame_OnViewNextCommand(pPaniViewFrame);
-    break;
+  GLuint shaderId = glCreateShader(shaderType);
 
-  case IDM_FITSIZE:
-    PaniViewFrame_OnViewFitCommand(pPaniViewFrame);
-    break;
+  FILE* pShaderFile = NULL;
+  errno_t err;
+  err = _wfopen_s(&pShaderFile, shaderFilePath, L"r");
 
-  case IDM_SETTINGS:
-    DialogBox(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_SETTINGS),
-      pPaniViewFrame->base.hWnd, (DLGPROC)SettingsDlgProc);
-    break;
-    
+  if (!err && pShaderFile)
+  {
+    size_t fileSize = GetPfFileSize(pShaderFile);
 
-  case IDM_ABOUT:
-    DialogBox(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_ABOUT),
-      pPaniViewFrame->base.hWnd, (DLGPROC)AboutDlgProc);
-    break;
+    char* pShaderCode = (char*)calloc(1, fileSize);
+    if (!pShaderCode) {
+      fclose(pShaderFile);
+      return 0;
+    }
 
-  case IDM_FILE_EXIT:
-    PostQuitMessage(0);
-    break;
-  }
+    fread(pShaderCode, 1, fileSize, pShaderFile);
+    pShaderCode[fileSize] = '\0';
 
-  return FALSE;
-}
+    fclose(pShaderFile);
 
-void PaniViewFrame_OnDestroy(LPPANIVIEWFRAME pPaniViewFrame)
-{
-  UNREFERENCED_PARAMETER(pPaniViewFrame);
+    /* Compile shader */
+    glShaderSource(shaderId, 1, (const char**)&pShaderCode, NULL);
+    glCompileShader(shaderId);
 
-  PostQuitMessage(0);
-}
+    GLint result = GL_FALSE;
+    int infoLogLength;
 
-void PaniViewFrame_OnFileOpenCommand(LPPANIVIEWFRAME pPaniViewFrame)
-{
-  UNREFERENCED_PARAMETER(pPaniViewFrame);
+    /* Check shader */
+    glGetShaderiv(shaderId, GL_COMPILE_STATUS, &result);
+    glGetShaderiv(shaderId, GL_INFO_LOG_LENGTH, &infoLogLength);
 
-  HRESULT hr = S_OK;
+    if (infoLogLength > 0)
+    {
+      char* pShaderErrorMessage = (char*)calloc(1, infoLogLength);
+      glGetShaderInfoLog(shaderId, infoLogLength, NULL, pShaderErrorMessage);
 
-  LPWSTR szFilePath;
-  hr = InvokeFileOpenDialog(&szFilePath);
+      printf("%s\n", pShaderErrorMessage);
 
-  if (SUCCEEDED(hr))
-  {
-    hr = PaniViewApp_LoadFromFile(szFilePath);
+      free(pShaderErrorMessage);
+      free(pShaderCode);
 
-    if (FAILED(hr)) {
-      PopupError(hr, NULL);
-      assert(FALSE);
+      exit(EXIT_FAILURE);
     }
+
+    // free(pShaderCode);
+  }
+  else {
+    fwprintf(stderr, L"Impossible to open %s. Are you in the right directory?", shaderFilePath);
+    exit(EXIT_FAILURE);
   }
+
+  return shaderId;
 }
 
-void PaniViewFrame_OnViewPrevCommand(LPPANIVIEWFRAME pPaniViewFrame)
+GLuint OpenGLRendererContext_LoadShaders(LPOPENGLRENDERERCONTEXT pGLRendererContext, PCWSTR vertexFilePath, PCWSTR fragmentFilePath)
 {
-  UNREFERENCED_PARAMETER(pPaniViewFrame);
+  /* Create shader objects */
+  GLuint vertexShaderId;
+  GLuint fragmentShaderId;
 
-  PaniViewApp_PrevFile();
-}
+  vertexShaderId = OpenGLRendererContext_LoadShader(pGLRendererContext, vertexFilePath, GL_VERTEX_SHADER);
+  fragmentShaderId = OpenGLRendererContext_LoadShader(pGLRendererContext, fragmentFilePath, GL_FRAGMENT_SHADER);
 
-void PaniViewFrame_OnViewNextCommand(LPPANIVIEWFRAME pPaniViewFrame)
-{
-  UNREFERENCED_PARAMETER(pPaniViewFrame);
+  /* Link the program */
+  GLuint programId = glCreateProgram();
+  glAttachShader(programId, vertexShaderId);
+  glAttachShader(programId, fragmentShaderId);
+  glLinkProgram(programId);
 
-  PaniViewApp_NextFile();
-}
+  /* Check the program */
+  GLint result = GL_FALSE;
+  int infoLogLength;
 
-void PaniViewFrame_OnViewFitCommand(LPPANIVIEWFRAME pPaniViewFrame)
-{
-  UNREFERENCED_PARAMETER(pPaniViewFrame);
+  glGetProgramiv(programId, GL_LINK_STATUS, &result);
+  glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &infoLogLength);
 
-  PaniViewApp_ToggleFit();
-}
+  if (infoLogLength)
+  {
+    char* programErrorMessage = (char*)calloc(1, infoLogLength + 1);
+    glGetProgramInfoLog(programId, infoLogLength, NULL, programErrorMessage);
 
-size_t GetPfFileSize(FILE* fp)
-{
-  size_t size = 0;
+    printf("%s\n", programErrorMessage);
 
-  fseek(fp, 0, SEEK_END);
-  size = ftell(fp);
-  fseek(fp, 0, SEEK_SET);
+    free(programErrorMessage);
 
-  return size;
-}
+    exit(EXIT_FAILURE);
+  }
 
-void OrthoMatrix(GLfloat mat[4][4], GLfloat width, GLfloat height)
-{
-  /*
-  memset(&mat[0][0], 0, sizeof(*mat) * 4 * 4);
-  */
+  glDetachShader(programId, vertexShaderId);
+  glDetachShader(programId, fragmentShaderId);
 
-  mat[0][0] = 2.0f / -width;
-  mat[1][1] = 2.0f / -height;
-  mat[3][3] = 1.0f;
-}
+  glDeleteShader(vertexShaderId);
+  glDeleteShader(fragmentShaderId);
 
-void MatrixMultiply(GLfloat mat1[4][4], GLfloat mat2[4][4], GLfloat mat3[4][4])
-{
-  for (int i = 0; i < 4; ++i) {
-    for (int j = 0; j < 4; ++j) {
-      mat3[i][j] = 0;
-      for (int k = 0; k < 4; ++k) {
-        mat3[i][k] += mat1[i][k] * mat2[k][j];
-      }
-    }
-  }
+  return programId;
 }
 
-int Rect_GetWidth(LPRECT prc)
+void OpenGLRendererContext_LoadWICBitmap(LPOPENGLRENDERERCONTEXT pGLRendererContext, IWICBitmapSource* pBitmapSource)
 {
-  return prc->right - prc->left;
-}
+  OpenGLRendererContext_CreateTexture(pGLRendererContext);
 
-int Rect_GetHeight(LPRECT prc)
-{
-  return prc->bottom - prc->top;
-}
+  UINT width;
+  UINT height;
+  pBitmapSource->lpVtbl->GetSize(pBitmapSource, &width, &height);
 
-BOOL RectBlt(HDC hdcDest, RECT rcDest, HDC hdcSrc, RECT rcSrc, DWORD rop)
-{
-  if (rcDest.left < 0)
-  {
-    float factor = (float)abs(rcDest.left) / (float)(abs(rcDest.left) + rcDest.right);
+  /* Gray pixel buffers and rasters go up as a single channel */
+  LPPIXBUF pPixBuf = PixBufBitmap_GetPixBuf(pBitmapSource);
+  LPRASTERFILE pRaster = RasterBitmap_GetRasterFile(pBitmapSource);
+  int nFormat = pPixBuf ? pPixBuf->nFormat : (pRaster ? pRaster->nPixFmt : PIXFMT_PBGRA32);
 
-    rcSrc.left = (LONG)(rcSrc.right * factor);
-    rcSrc.right -= rcSrc.left;
-    rcDest.left = 0;
+  GLTEXFORMAT format = {0};
+  GLTexture_GetFormat(nFormat, &format);
 
+  pGLRendererContext->m_imageWidth = (float)width;
+  pGLRendererContext->m_imageHeight = (float)height;
+  pGLRendererContext->m_bGrayscale = format.bGray;
+
+  /* Too large for one texture, or for keeping all of it in video memory:
+   * tiles are uploaded from the pixel buffer as they come into view, the
+   * coarser ones from the pyramid built with the image */
+  OpenGLRendererContext_ReleaseTiles(pGLRendererContext);
+
+  pBitmapSource->lpVtbl->AddRef(pBitmapSource);
+  pGLRendererContext->m_pBitmapSource = pBitmapSource;
+  const PYRAMID* pPyramid = PixBufBitmap_GetPyramid(pBitmapSource);
+
+  /* Never decoded in full: every tile is read from the file when it comes
+   * into view, sampled down to its level */
+  if (pRaster) {
+    if (GLTiles_InitReader(&pGLRendererContext->m_tiles, width, height, nFormat, RasterBitmap_ReadLevel,
+        pBitmapSource, GLTILES_TILE_SIZE, (size_t)PANIVIEW_GL_TILE_BUDGET_MB << 20) == GLTILES_OK) {
+      pGLRendererContext->m_bTiled = TRUE;
+    }
+    return;
   }
 
-  if (rcDest.top < 0)
-  {
-    float factor = (float)abs(rcDest.top) / (float)(abs(rcDest.top) + rcDest.bottom);
+  GLint maxTextureSize = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+  UINT tileThreshold = min((UINT)PANIVIEW_GL_TILE_THRESHOLD, (UINT)maxTextureSize);
+  if (pPixBuf && (width > tileThreshold || height > tileThreshold) &&
+      GLTiles_Init(&pGLRendererContext->m_tiles, pPixBuf->pData, width, height, pPixBuf->stride, nFormat,
+          pPyramid, GLTILES_TILE_SIZE, (size_t)PANIVIEW_GL_TILE_BUDGET_MB << 20) == GLTILES_OK) {
+    pGLRendererContext->m_bTiled = TRUE;
+    return;
+  }
 
-    rcSrc.top = (LONG)(rcSrc.bottom * factor);
-    rcSrc.bottom -= rcSrc.top;
-    rcDest.top = 0;
+  /* Zoomed out, only the level the scale asks for goes up, sampled linearly;
+   * a level rounded up at an odd edge is stretched by under one of its
+   * pixels over the whole image */
+  size_t nLevel = OpenGLRendererContext_SelectLevel(pGLRendererContext);
+  if (nLevel) {
+    pPixBuf = pPyramid->pLevels[nLevel];
+    width = (UINT)pPixBuf->width;
+    height = (UINT)pPixBuf->height;
   }
 
-  return StretchBlt(hdcDest,
-    rcDest.left,
-    rcDest.top,
-    Rect_GetWidth(&rcDest),
-    Rect_GetHeight(&rcDest),
-    hdcSrc,
-    rcSrc.left, rcSrc.top, rcSrc.right, rcSrc.bottom,
-    rop);
+  OpenGLRendererContext_UploadTexture(pGLRendererContext, pBitmapSource, pPixBuf, width, height, nFormat);
+  pGLRendererContext->m_nPyramidLevel = nLevel;
 }
 
-void RectMatrixMultiply(LPRECT prc, float mat[4][4])
+/*
+ * OpenGLRendererContext_UploadTexture
+ * Fill m_textureId from a pixel buffer, or from the bitmap source when
+ * there is none
+ */
+void OpenGLRendererContext_UploadTexture(LPOPENGLRENDERERCONTEXT pGLRendererContext, IWICBitmapSource* pBitmapSource,
+    const PIXBUF* pPixBuf, UINT width, UINT height, int nFormat)
 {
-  prc->left *= (LONG)mat[0][0];
-  prc->right *= (LONG)mat[0][0];
-  prc->top *= (LONG)mat[1][1];
-  prc->bottom *= (LONG)mat[1][1];
-}
+  GLTEXFORMAT format = {0};
+  GLTexture_GetFormat(nFormat, &format);
 
-void RectTranslate(LPRECT prc, float x, float y)
-{
-  prc->left += (LONG)x;
-  prc->right += (LONG)x;
-  prc->top += (LONG)y;
-  prc->bottom += (LONG)y;
-}
+  glBindTexture(GL_TEXTURE_2D, pGLRendererContext->m_textureId);
+
+  /* Stream through the unpack buffer ring: the pixels are written straight
+   * into mapped memory and OpenGL fills the texture from there without
+   * holding up this thread */
+  LPGLUPLOADRING pRing = &pGLRendererContext->m_uploadRing;
+  BOOL bUploaded = FALSE;
+  UINT cbStride = width * (UINT)format.nBytesPerPixel;
+  BYTE* pMapped = (BYTE*)GLUpload_Map(pRing, (size_t)cbStride * height);
+  if (pMapped) {
+    BOOL bCopied = pPixBuf
+        ? PixConv_Convert(pPixBuf->pData, pPixBuf->stride, nFormat, pMapped, cbStride, nFormat,
+            width, height) == PIXCONV_OK
+        : SUCCEEDED(pBitmapSource->lpVtbl->CopyPixels(pBitmapSource, NULL, cbStride, cbStride * height, pMapped));
+    if (bCopied) {
+      bUploaded = GLUpload_Commit(pRing, width, height, cbStride, nFormat,
+          &pGLRendererContext->m_textureLevel, NULL) == GLUPLOAD_OK;
+    }
+    else {
+      GLUpload_Cancel(pRing);
+    }
+  }
 
-/*********************************
- *  Direct2D Renderer functions  *
- *********************************/
+  /* No buffer to be had: straight from the bitmap memory, blocking */
+  if (!bUploaded) {
+    BYTE* pPixels = NULL;
+    unsigned char* data = NULL;
+    IWICBitmapLock* pLock = NULL;
+    if (pPixBuf) {
+      cbStride = (UINT)pPixBuf->stride;
+      pPixels = pPixBuf->pData;
+    }
+    else {
+      pLock = WICLockBitmapSource(pBitmapSource, &cbStride, &pPixels);
+    }
 
-HRESULT D2DRendererContext_CreateDeviceResources(LPD2DRENDERERCONTEXT pD2DRendererContext, HWND hWnd)
-{
-  ID2D1HwndRenderTarget** ppRenderTarget = &pD2DRendererContext->m_pRenderTarget;
-  ID2D1Factory** ppD2DFactory = &pD2DRendererContext->m_pD2DFactory;
+    if (!pPixels) {
+      cbStride = width * 4;
+      data = calloc(1, width * height * 4);
+      pBitmapSource->lpVtbl->CopyPixels(pBitmapSource, NULL, width * 4, width * height * 4, data);
+      pPixels = data;
+    }
 
-  HRESULT hr = S_OK;
+    GLTexture_Upload(pPixels, width, height, cbStride, nFormat, &pGLRendererContext->m_textureLevel, NULL);
 
-  if (!*ppRenderTarget) {
-    RECT rcClient;
-    D2D1_SIZE_U size;
+    SAFE_RELEASE(pLock);
+    free(data);
+  }
 
-    GetClientRect(hWnd, &rcClient);
-    size = (D2D1_SIZE_U){
-      rcClient.right - rcClient.left,
-      rcClient.bottom - rcClient.top
-    };
+  /* Sampled with GL_LINEAR alone, level 0 is all there is to fill */
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
 
-    /* TODO: Research */
-    D2D1_RENDER_TARGET_PROPERTIES rtProp = { 0 };
-    rtProp.type = D2D1_RENDER_TARGET_TYPE_DEFAULT;
-    rtProp.pixelFormat.format = DXGI_FORMAT_UNKNOWN;
-    rtProp.pixelFormat.alphaMode = D2D1_ALPHA_MODE_UNKNOWN;
-    rtProp.dpiX = DEFAULT_DPI;
-    rtProp.dpiY = DEFAULT_DPI;
-    rtProp.usage = D2D1_RENDER_TARGET_USAGE_NONE;
-    rtProp.minLevel = D2D1_FEATURE_LEVEL_DEFAULT;
+/*
+ * OpenGLRendererContext_ReleaseTiles
+ * Drop the tiles of the current image and the pixels they were read from
+ */
+void OpenGLRendererContext_ReleaseTiles(LPOPENGLRENDERERCONTEXT pGLRendererContext)
+{
+  if (pGLRendererContext->m_bTiled) {
+    GLTiles_Cleanup(&pGLRendererContext->m_tiles);
+    pGLRendererContext->m_bTiled = FALSE;
+  }
 
-    D2D1_HWND_RENDER_TARGET_PROPERTIES rtHwndProp = { 0 };
-    rtHwndProp.hwnd = hWnd;
-    rtHwndProp.pixelSize = size; /* CHECK */
-    rtHwndProp.presentOptions = D2D1_PRESENT_OPTIONS_NONE;
+  SAFE_RELEASE(pGLRendererContext->m_pBitmapSource);
+  pGLRendererContext->m_nPyramidLevel = 0;
+}
 
-    /* Create a Direct2D render target */
-    hr = dxID2D1Factory_CreateHwndRenderTarget(
-      *ppD2DFactory,
-      &rtProp,
-      &rtHwndProp,
-      ppRenderTarget
-    );
+void OpenGLRendererContext_Release(LPOPENGLRENDERERCONTEXT pGLRendererContext)
+{
+  /* Unmaps the persistent buffers while the context is still current */
+  if (pGLRendererContext->m_hGLContext) {
+    OpenGLRendererContext_ReleaseTiles(pGLRendererContext);
+    GLUpload_Cleanup(&pGLRendererContext->m_uploadRing);
   }
 
-  return hr;
+  /* TODO */
 }
 
-void D2DRendererContext_DiscardDeviceResources(LPD2DRENDERERCONTEXT pD2DRendererContext)
+void OpenGLRendererContext_Resize(LPOPENGLRENDERERCONTEXT pGLRendererContext, int cx, int cy)
 {
-  SAFE_RELEASE(pD2DRendererContext->m_pRenderTarget);
+  pGLRendererContext->m_viewportWidth = (float)cx;
+  pGLRendererContext->m_viewportHeight = (float)cy;
+  glViewport(0, 0, cx, cy);
 }
 
-void D2DRendererContext_Draw(LPD2DRENDERERCONTEXT pD2DRendererContext, LPRENDERCTL2 pRenderCtl)
+void InitializeOpenGLRendererContextStruct(LPOPENGLRENDERERCONTEXT pGLRendererContext)
 {
-  LPPANIVIEWAPP pApp = GetApp();
+  pGLRendererContext->base.Release = (void (*)(LPRENDERERCONTEXT)) & OpenGLRendererContext_Release;
+  pGLRendererContext->base.Resize = (void (*)(LPRENDERERCONTEXT, int, int)) & OpenGLRendererContext_Resize;
+  pGLRendererContext->base.Draw = (void (*)(LPRENDERERCONTEXT, LPRENDERCTL2)) & OpenGLRendererContext_Draw;
+  pGLRendererContext->base.LoadWICBitmap = (void (*)(LPRENDERERCONTEXT, IWICBitmapSource*)) & OpenGLRendererContext_LoadWICBitmap;
+}
 
-  ID2D1HwndRenderTarget** ppRenderTarget = &pD2DRendererContext->m_pRenderTarget;
-  IWICFormatConverter** ppConvertedSourceBitmap = &pApp->m_pConvertedSourceBitmap;
-  ID2D1Bitmap** ppD2DBitmap = &pD2DRendererContext->m_pD2DBitmap;
+LPOPENGLRENDERERCONTEXT CreateOpenGLRenderer(void)
+{
+  LPOPENGLRENDERERCONTEXT pGLRendererContext = NULL;
 
-  HRESULT hr = S_OK;
+  pGLRendererContext = (LPOPENGLRENDERERCONTEXT) calloc(1, sizeof(OPENGLRENDERERCONTEXT));
+  if (!pGLRendererContext)
+  {
+    return NULL;
+  }
+  InitializeOpenGLRendererContextStruct(pGLRendererContext);
 
-  hr = D2DRendererContext_CreateDeviceResources(pD2DRendererContext, pRenderCtl->base.hWnd);
-  if (SUCCEEDED(hr)) {
+  return pGLRendererContext;
+}
 
-    dxID2D1RenderTarget_BeginDraw((ID2D1RenderTarget*)*ppRenderTarget);
+/****************************
+ *  GDI Renderer functions  *
+ ****************************/
 
-    D2D1_MATRIX_3X2_F mat = D2DUtilMatrixIdentity();
+void GDIRendererContext_Draw(LPGDIRENDERERCONTEXT pGDIRendererContext, LPRENDERCTL2 pRenderCtl)
+{
+  LPPANIVIEWAPP pApp = GetApp();
 
-    dxID2D1RenderTarget_SetTransform((ID2D1RenderTarget*)*ppRenderTarget, &mat);
+  PAINTSTRUCT ps = {0};
+  HDC hdc = BeginPaint(pRenderCtl->base.hWnd, &ps);
 
-    D2D1_COLOR_F clearColor = D2DColorFromRGB(RGB(0xFF, 0xFF, 0xFF));
+  RECT rc = {0};
+  GetClientRect(pRenderCtl->base.hWnd, &rc);
 
-    dxID2D1RenderTarget_Clear((ID2D1RenderTarget*)*ppRenderTarget, &clearColor);
+  /* Where the viewport puts the image; a raster's preview has fewer pixels
+   * than the image the viewport holds */
+  const VIEWPORT* pViewport = &pApp->m_viewport;
+  double scale = pViewport->scale;
+  if (pGDIRendererContext->m_width > 0) {
+    scale *= pViewport->imageWidth / pGDIRendererContext->m_width;
+  }
 
-    /* Retrieve the size of the drawing area. */
-    D2D1_SIZE_F rtSize;
-    rtSize = dxID2D1HwndRenderTarget_GetSize(*ppRenderTarget);
+  int imageWidth = (int)(pGDIRendererContext->m_width * scale + 0.5);
+  int imageHeight = (int)(pGDIRendererContext->m_height * scale + 0.5);
+
+  /* Only the part inside the window is kept scaled */
+  RECT rcImage = {0};
+  rcImage.left = (int)pViewport->xform.dx;
+  rcImage.top = (int)pViewport->xform.dy;
+  rcImage.right = rcImage.left + imageWidth;
+  rcImage.bottom = rcImage.top + imageHeight;
+
+  RECT rcVisible = {0};
+  BOOL bImage = IntersectRect(&rcVisible, &rcImage, &rc);
+  if (bImage) {
+    RECT rcCrop = rcVisible;
+    OffsetRect(&rcCrop, -rcImage.left, -rcImage.top);
+    bImage = GDIRendererContext_UpdateScaledBitmap(pGDIRendererContext, hdc, imageWidth, imageHeight, &rcCrop);
+  }
 
-    /*  D2DBitmap may have been released due to device loss.
-     *  If so, re-create it from the source bitmap */
-    if (*ppConvertedSourceBitmap && !*ppD2DBitmap)
-    {
-      dxID2D1RenderTarget_CreateBitmapFromWicBitmap(
-        (ID2D1RenderTarget*)*ppRenderTarget,
-        (IWICBitmapSource*)*ppConvertedSourceBitmap,
-        NULL,
-        ppD2DBitmap
-      );
-    }
+  /* Background around the image only, the image is never painted twice */
+  if (!pGDIRendererContext->m_hBackgroundBrush) {
+    pGDIRendererContext->m_hBackgroundBrush = CreateSolidBrush(RGB(0, 0xFF, 0));
+  }
 
-    /* Draw an image and scale it to the current window size */
-    if (*ppD2DBitmap)
-    {
-      D2D1_MATRIX_3X2_F matAnchor;
-      D2D1_MATRIX_3X2_F matPosition;
-      D2D1_MATRIX_3X2_F matView;
+  int nSavedDC = SaveDC(hdc);
+  if (bImage) {
+    ExcludeClipRect(hdc, rcVisible.left, rcVisible.top, rcVisible.right, rcVisible.bottom);
+  }
+  FillRect(hdc, &ps.rcPaint, pGDIRendererContext->m_hBackgroundBrush);
+  RestoreDC(hdc, nSavedDC);
+
+  /* A 1:1 copy of the damaged part */
+  RECT rcBlit = {0};
+  if (bImage && IntersectRect(&rcBlit, &rcVisible, &ps.rcPaint)) {
+    BitBlt(hdc, rcBlit.left, rcBlit.top, Rect_GetWidth(&rcBlit), Rect_GetHeight(&rcBlit),
+        pGDIRendererContext->m_hScaledDC,
+        rcBlit.left - rcVisible.left + pGDIRendererContext->m_ptScaledOrigin.x,
+        rcBlit.top - rcVisible.top + pGDIRendererContext->m_ptScaledOrigin.y, SRCCOPY);
+  }
 
-      D2D1_SIZE_F bmpSize;
-      bmpSize = dxID2D1Bitmap_GetSize(*ppD2DBitmap);
+  EndPaint(pRenderCtl->base.hWnd, &ps);
+}
 
-      if (pApp->m_settings.bFit) {
-        if (bmpSize.width > rtSize.width) {
-          float ratio = bmpSize.height / bmpSize.width;
-          bmpSize.width = rtSize.width;
-          bmpSize.height = rtSize.width * ratio;
-        }
+/*
+ * Make the scaled bitmap hold `prcCrop` of the image drawn `width` by
+ * `height`. Kept as long as the image, its size on screen and the crop
+ * stay the same, so a repaint is only a blit.
+ */
+BOOL GDIRendererContext_UpdateScaledBitmap(LPGDIRENDERERCONTEXT pGDIRendererContext, HDC hdc, int width, int height,
+    const RECT* prcCrop)
+{
+  if (pGDIRendererContext->m_hScaledBitmap
+      && pGDIRendererContext->m_scaledWidth == width && pGDIRendererContext->m_scaledHeight == height
+      && EqualRect(&pGDIRendererContext->m_rcScaledCrop, prcCrop)) {
+    return TRUE;
+  }
 
-        if (bmpSize.height > rtSize.height) {
-          float ratio = bmpSize.width / bmpSize.height;
-          bmpSize.width = rtSize.height * ratio;
-          bmpSize.height = rtSize.height;
-        }
-      }
+  GDIRendererContext_DeleteScaledBitmap(pGDIRendererContext);
 
-      matAnchor = D2DUtilMakeTranslationMatrix((D2D1_SIZE_F) {
-        -(bmpSize.width / 2.0f),
-          -(bmpSize.height / 2.0f)
-      });
+  IWICBitmapSource* pBitmapSource = pGDIRendererContext->m_pBitmapSource;
+  if (!pBitmapSource) {
+    return FALSE;
+  }
 
-      matPosition = D2DUtilMakeTranslationMatrix((D2D1_SIZE_F) {
-        roundf(rtSize.width / 2.0f),
-          roundf(rtSize.height / 2.0f)
-      });
+  UINT srcWidth = pGDIRendererContext->m_width;
+  UINT srcHeight = pGDIRendererContext->m_height;
+  BOOL bScaled = (UINT)width != srcWidth || (UINT)height != srcHeight;
 
-      matView = D2DUtilMatrixMultiply(&matAnchor, &matPosition);
+  if (!pGDIRendererContext->m_hScaledDC) {
+    pGDIRendererContext->m_hScaledDC = CreateCompatibleDC(hdc);
+  }
 
-      dxID2D1RenderTarget_SetTransform((ID2D1RenderTarget*)*ppRenderTarget, &matView);
+  /* Shown 1:1 from a DIB section: blitted from the decoded pixels as they are */
+  LPPIXBUF pPixBuf = pGDIRendererContext->m_pPixBuf;
+  if (!bScaled && pPixBuf && pPixBuf->pHandle) {
+    pGDIRendererContext->m_hOldBitmap = (HBITMAP)SelectObject(pGDIRendererContext->m_hScaledDC,
+        (HGDIOBJ)pPixBuf->pHandle);
+    pGDIRendererContext->m_hScaledBitmap = (HBITMAP)pPixBuf->pHandle;
+    pGDIRendererContext->m_bScaledOwned = FALSE;
+    pGDIRendererContext->m_ptScaledOrigin.x = prcCrop->left;
+    pGDIRendererContext->m_ptScaledOrigin.y = prcCrop->top;
+    pGDIRendererContext->m_scaledWidth = width;
+    pGDIRendererContext->m_scaledHeight = height;
+    pGDIRendererContext->m_rcScaledCrop = *prcCrop;
+    return TRUE;
+  }
 
-      D2D1_RECT_F imgRect = {
-        0.0f, 0.0f,
-        bmpSize.width, bmpSize.height
-      };
+  int cropWidth = prcCrop->right - prcCrop->left;
+  int cropHeight = prcCrop->bottom - prcCrop->top;
+
+  /* Top-down 32bpp DIB section, rows laid out as the resampler writes them */
+  BITMAPINFO bmi = {0};
+  bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+  bmi.bmiHeader.biWidth = cropWidth;
+  bmi.bmiHeader.biHeight = -cropHeight;
+  bmi.bmiHeader.biPlanes = 1;
+  bmi.bmiHeader.biBitCount = 32;
+  bmi.bmiHeader.biCompression = BI_RGB;
+
+  BYTE* pBits = NULL;
+  HBITMAP hBitmap = CreateDIBSection(hdc, &bmi, DIB_RGB_COLORS, (void**)&pBits, NULL, 0);
+  if (!hBitmap) {
+    return FALSE;
+  }
 
-      dxID2D1RenderTarget_DrawBitmap(
-        (ID2D1RenderTarget*)*ppRenderTarget,
-        *ppD2DBitmap,
-        &imgRect, /* Destination rectangle */
-        1.0f, /* Opacity */
-        D2D1_BITMAP_INTERPOLATION_MODE_LINEAR,
-        NULL);  /* No source rectangle (full image) */
-    }
+  /* Read straight from the decoded pixels when the resampler takes their
+   * format or they can be locked; 16-bit gray is expanded by CopyPixels */
+  int nFormat = PIXFMT_PBGRA32;
+  UINT cbStride = 0;
+  BYTE* pPixels = NULL;
+  BYTE* pCopy = NULL;
+  IWICBitmapLock* pLock = NULL;
+
+  /* Shrunk: resampled from the pyramid level nearest the size on screen,
+   * which has the resampler read a fraction of the pixels */
+  const PYRAMID* pPyramid = PixBufBitmap_GetPyramid(pBitmapSource);
+  if (bScaled && pPyramid && pPixBuf->nFormat != PIXFMT_GRAY16) {
+    double scale = max((double)width / srcWidth, (double)height / srcHeight);
+    pPixBuf = pPyramid->pLevels[Pyramid_SelectLevel(pPyramid, scale)];
+    srcWidth = (UINT)pPixBuf->width;
+    srcHeight = (UINT)pPixBuf->height;
+  }
 
-    hr = dxID2D1RenderTarget_EndDraw((ID2D1RenderTarget*)*ppRenderTarget, NULL, NULL);
-    if (hr == (HRESULT)D2DERR_RECREATE_TARGET) {
-      hr = S_OK;
-      D2DRendererContext_DiscardDeviceResources(pD2DRendererContext);
-    }
+  if (pPixBuf && (pPixBuf->nFormat == PIXFMT_PBGRA32 || pPixBuf->nFormat == PIXFMT_GRAY8)) {
+    nFormat = pPixBuf->nFormat;
+    cbStride = (UINT)pPixBuf->stride;
+    pPixels = pPixBuf->pData;
+  }
+  else {
+    pLock = WICLockBitmapSource(pBitmapSource, &cbStride, &pPixels);
   }
-}
 
-void D2DRendererContext_LoadWICBitmap(LPD2DRENDERERCONTEXT pD2DRendererContext, IWICBitmapSource* pIWICBitmapSource)
-{
-  HRESULT hr = S_OK;
+  if (!pPixels) {
+    cbStride = srcWidth * 4;
+    pCopy = (BYTE*)malloc((size_t)cbStride * srcHeight);
+    if (pCopy && SUCCEEDED(pBitmapSource->lpVtbl->CopyPixels(pBitmapSource, NULL, cbStride,
+        cbStride * srcHeight, pCopy))) {
+      pPixels = pCopy;
+    }
+  }
 
-  ID2D1HwndRenderTarget** ppRenderTarget = &pD2DRendererContext->m_pRenderTarget;
-  ID2D1Bitmap** ppD2DBitmap = &pD2DRendererContext->m_pD2DBitmap;
-  ID2D1Bitmap* pD2DDirtyBitmap = NULL;
+  /* Zoomed in, only the part in the window is resampled */
+  int status = RESAMPLE_ERROR_MEMORY;
+  if (pPixels && bScaled) {
+    RESAMPLER resampler;
+    status = Resample_InitRegion(&resampler, srcWidth, srcHeight, width, height, prcCrop->left, prcCrop->top,
+        prcCrop->right, prcCrop->bottom, PANIVIEW_GDI_FILTER);
+    if (status == RESAMPLE_OK) {
+      status = Resample_Run(&resampler, pPixels, cbStride, nFormat, pBits, (size_t)cropWidth * 4,
+          PaniViewApp_GetTaskPool());
+      Resample_Cleanup(&resampler);
+    }
+  }
+  else if (pPixels) {
+    /* Shown 1:1, only the part in the window is copied */
+    const BYTE* pRow = pPixels + (size_t)prcCrop->top * cbStride
+        + (size_t)prcCrop->left * PixConv_GetBytesPerPixel(nFormat);
+    PixConv_Convert(pRow, cbStride, nFormat, pBits, (size_t)cropWidth * 4, PIXFMT_PBGRA32,
+        (size_t)cropWidth, (size_t)cropHeight);
+    status = RESAMPLE_OK;
+  }
 
-  hr = dxID2D1RenderTarget_CreateBitmapFromWicBitmap(
-    (ID2D1RenderTarget*)*ppRenderTarget,
-    pIWICBitmapSource,
-    NULL,
-    &pD2DDirtyBitmap
-  );
+  SAFE_RELEASE(pLock);
+  free(pCopy);
 
-  if (FAILED(hr)) {
-    PopupError(hr, NULL);
-    assert(FALSE);
-    goto fail;
+  if (status != RESAMPLE_OK) {
+    DeleteObject(hBitmap);
+    return FALSE;
   }
 
-  /* Done successfully. Actually do the changes into structure. */
-  SAFE_RELEASE(*ppD2DBitmap);
-  *ppD2DBitmap = pD2DDirtyBitmap;
+  pGDIRendererContext->m_hOldBitmap = (HBITMAP)SelectObject(pGDIRendererContext->m_hScaledDC, (HGDIOBJ)hBitmap);
 
-fail:
-  // SAFE_RELEASE(pD2DDirtyBitmap);
+  pGDIRendererContext->m_hScaledBitmap = hBitmap;
+  pGDIRendererContext->m_bScaledOwned = TRUE;
+  pGDIRendererContext->m_ptScaledOrigin.x = 0;
+  pGDIRendererContext->m_ptScaledOrigin.y = 0;
+  pGDIRendererContext->m_scaledWidth = width;
+  pGDIRendererContext->m_scaledHeight = height;
+  pGDIRendererContext->m_rcScaledCrop = *prcCrop;
 
-  return;
+  return TRUE;
 }
 
-void D2DRendererContext_Release(LPD2DRENDERERCONTEXT pD2DRendererContext)
+void GDIRendererContext_DeleteScaledBitmap(LPGDIRENDERERCONTEXT pGDIRendererContext)
 {
-  SAFE_RELEASE(pD2DRendererContext->m_pD2DFactory);
-  SAFE_RELEASE(pD2DRendererContext->m_pRenderTarget);
-  SAFE_RELEASE(pD2DRendererContext->m_pLightSlateGrayBrush);
-  SAFE_RELEASE(pD2DRendererContext->m_pCornflowerBlueBrush);
-
-  free(pD2DRendererContext);
+  if (pGDIRendererContext->m_hScaledBitmap) {
+    SelectObject(pGDIRendererContext->m_hScaledDC, (HGDIOBJ)pGDIRendererContext->m_hOldBitmap);
+    if (pGDIRendererContext->m_bScaledOwned) {
+      DeleteObject(pGDIRendererContext->m_hScaledBitmap);
+    }
+    pGDIRendererContext->m_hScaledBitmap = NULL;
+  }
 }
 
-void D2DRendererContext_Resize(LPD2DRENDERERCONTEXT pD2DRendererContext, int cx, int cy)
+void GDIRendererContext_LoadWICBitmap(LPGDIRENDERERCONTEXT pGDIRendererContext, IWICBitmapSource* pBitmapSource)
 {
-  ID2D1HwndRenderTarget** ppRenderTarget = &pD2DRendererContext->m_pRenderTarget;
+  /* A raster left in its file is drawn from its preview */
+  pBitmapSource = RasterBitmap_GetPreview(pBitmapSource);
 
-  if (*ppRenderTarget)
-  {
-    dxID2D1HwndRenderTarget_Resize(*ppRenderTarget, &(D2D1_SIZE_U){ cx, cy });
-  }
-}
+  UINT width;
+  UINT height;
+  pBitmapSource->lpVtbl->GetSize(pBitmapSource, &width, &height);
 
-void InitializeD2DRendererContextStruct(LPD2DRENDERERCONTEXT pD2DRendererContext)
-{
-  pD2DRendererContext->base.Release = (void (*)(LPRENDERERCONTEXT))& D2DRendererContext_Release;
-  pD2DRendererContext->base.Resize = (void (*)(LPRENDERERCONTEXT, int, int))& D2DRendererContext_Resize;
-  pD2DRendererContext->base.Draw = (void (*)(LPRENDERERCONTEXT, LPRENDERCTL2))& D2DRendererContext_Draw;
-  pD2DRendererContext->base.LoadWICBitmap = (void (*)(LPRENDERERCONTEXT, IWICBitmapSource*))& D2DRendererContext_LoadWICBitmap;
+  /* Referenced rather than copied, the image cache holds the pixels anyway */
+  GDIRendererContext_DeleteScaledBitmap(pGDIRendererContext);
+
+  pBitmapSource->lpVtbl->AddRef(pBitmapSource);
+  SAFE_RELEASE(pGDIRendererContext->m_pBitmapSource);
+  pGDIRendererContext->m_pBitmapSource = pBitmapSource;
+  pGDIRendererContext->m_pPixBuf = PixBufBitmap_GetPixBuf(pBitmapSource);
+  pGDIRendererContext->m_width = width;
+  pGDIRendererContext->m_height = height;
 }
 
-LPD2DRENDERERCONTEXT CreateD2DRenderer(void)
+void GDIRendererContext_Release(LPGDIRENDERERCONTEXT pGDIRendererContext)
 {
-  LPD2DRENDERERCONTEXT pD2DRendererContext = NULL;
-  ID2D1Factory** ppD2DFactory = NULL;
-  HRESULT hr = S_OK;
-
-  pD2DRendererContext = (LPD2DRENDERERCONTEXT) calloc(1, sizeof(D2DRENDERERCONTEXT));
-  if (!pD2DRendererContext) {
-    return NULL;
+  GDIRendererContext_DeleteScaledBitmap(pGDIRendererContext);
+  if (pGDIRendererContext->m_hScaledDC) {
+    DeleteDC(pGDIRendererContext->m_hScaledDC);
   }
-
-  ppD2DFactory = &pD2DRendererContext->m_pD2DFactory;
-
-  InitializeD2DRendererContextStruct(pD2DRendererContext);
-
-  hr = D2D1CreateFactory(D2D1_FACTORY_TYPE_SINGLE_THREADED, &IID_ID2D1Factory1, NULL, (LPVOID) ppD2DFactory);
-  if (FAILED(hr)) {
-    PopupError(hr, NULL);
-    /* will wndData be freed on WM_DESTROY after `return` returns FALSE? */
-    assert(FALSE);
-    return NULL;
+  if (pGDIRendererContext->m_hBackgroundBrush) {
+    DeleteObject(pGDIRendererContext->m_hBackgroundBrush);
   }
+  SAFE_RELEASE(pGDIRendererContext->m_pBitmapSource);
 
-  return pD2DRendererContext;
+  free(pGDIRendererContext);
 }
 
-/*******************************
- *  OpenGL Renderer functions  *
- *******************************/
-
-const GLfloat g_vertexBufferData[] = {
-   1.0f,  1.0f,  0.0f,
-  -1.0f,  1.0f,  0.0f,
-   1.0f, -1.0f,  0.0f,
-  -1.0f, -1.0f,  0.0f,
-};
-
-const GLfloat g_uvBufferData[] = {
-   1.0f,  0.0f,
-   0.0f,  0.0f,
-   1.0f,  1.0f,
-   0.0f,  1.0f,
-};
-
-void OpenGLRendererContext_CreateVBO(LPOPENGLRENDERERCONTEXT pGLRendererContext)
+void GDIRendererContext_Resize(LPGDIRENDERERCONTEXT pGDIRendererContext, int cx, int cy)
 {
-  /* Create VBO and bind data to it */
-  glGenVertexArrays(1, &pGLRendererContext->m_vertexArray);
-  glBindVertexArray(pGLRendererContext->m_vertexArray);
-
-  /* Initialize vertex buffer */
-  glGenBuffers(1, &pGLRendererContext->m_vertexBuffer);
-  glBindBuffer(GL_ARRAY_BUFFER, pGLRendererContext->m_vertexBuffer);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertexBufferData), g_vertexBufferData, GL_STATIC_DRAW);
+  UNREFERENCED_PARAMETER(pGDIRendererContext);
+  UNREFERENCED_PARAMETER(cx);
+  UNREFERENCED_PARAMETER(cy);
+}
 
-  /* Initialize uv buffer */
-  glGenBuffers(1, &pGLRendererContext->m_uvBuffer);
-  glBindBuffer(GL_ARRAY_BUFFER, pGLRendererContext->m_uvBuffer);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(g_uvBufferData), g_uvBufferData, GL_STATIC_DRAW);
+void InitializeGDIRendererContextStruct(LPGDIRENDERERCONTEXT pGDIRendererContext)
+{
+  pGDIRendererContext->base.Release = (void (*)(LPRENDERERCONTEXT)) & GDIRendererContext_Release;
+  pGDIRendererContext->base.Resize = (void (*)(LPRENDERERCONTEXT, int, int)) & GDIRendererContext_Resize;
+  pGDIRendererContext->base.Draw = (void (*)(LPRENDERERCONTEXT, LPRENDERCTL2)) & GDIRendererContext_Draw;
+  pGDIRendererContext->base.LoadWICBitmap = (void (*)(LPRENDERERCONTEXT, IWICBitmapSource*)) &GDIRendererContext_LoadWICBitmap;
 }
 
-void OpenGLRendererContext_CreateDeviceResources(LPOPENGLRENDERERCONTEXT pGLRendererContext, LPRENDERCTL2 pRenderCtl)
+LPGDIRENDERERCONTEXT CreateGDIRenderer(void)
 {
-  if (!pGLRendererContext->m_hGLContext)
+  LPGDIRENDERERCONTEXT pGDIRendererContext = NULL;
+
+  pGDIRendererContext = (LPGDIRENDERERCONTEXT)calloc(1, sizeof(GDIRENDERERCONTEXT));
+  if (!pGDIRendererContext)
   {
-    /* Choose HDC pixel format */
-    PIXELFORMATDESCRIPTOR pfd = { 0 };
-    pfd.nSize = sizeof(PIXELFORMATDESCRIPTOR);
-    pfd.nVersion = 1;
-    pfd.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL | PFD_DOUBLEBUFFER;
-    pfd.iPixelType = PFD_TYPE_RGBA;
-    pfd.cColorBits = 32;
-    pfd.cDepthBits = 32;
-    pfd.iLayerType = PFD_MAIN_PLANE;
+    return NULL;
+  }
+  InitializeGDIRendererContextStruct(pGDIRendererContext);
 
-    HDC hDC = GetDC(pRenderCtl->base.hWnd);
+  return pGDIRendererContext;
+}
 
-    int pixFmtId = ChoosePixelFormat(hDC, &pfd);
-    if (!pixFmtId) {
-      // Wrong pixel format
-    }
+/********************
+ *  Render Control  *
+ ********************/
 
-    if (!SetPixelFormat(hDC, pixFmtId, &pfd)) {
-      // Error while setting the pixel format
-    }
+LPRENDERERCONTEXT CreateRendererContext(void)
+{
+  LPPANIVIEWAPP pApp = GetApp();
+  LPRENDERERCONTEXT pRendererContext = NULL;
 
-    HGLRC hGLContext = wglCreateContext(hDC);
-    wglMakeCurrent(hDC, hGLContext);
+  switch (pApp->m_settings.nRendererType)
+  {
+  case RENDERER_D2D:
+    pRendererContext = (LPRENDERERCONTEXT) CreateD2DRenderer();
+    break;
 
-    glewExperimental = GL_TRUE;
-    if (glewInit() != GLEW_OK) {
-      free(pGLRendererContext);
-      return;
-    }
+  case RENDERER_OPENGL:
+    pRendererContext = (LPRENDERERCONTEXT) CreateOpenGLRenderer();
+    break;
 
-    GLint attribs[] = {
-      WGL_CONTEXT_MAJOR_VERSION_ARB,
-      3,
-      WGL_CONTEXT_MINOR_VERSION_ARB,
-      1,
-      WGL_CONTEXT_FLAGS_ARB,
-      0,
-      0
-    };
+  case RENDERER_GDI:
+    pRendererContext = (LPRENDERERCONTEXT) CreateGDIRenderer();
+    break;
+  }
 
-    if (wglewIsSupported("WGL_ARB_create_context") == 1)
-    {
-      HGLRC hGLEWContext = wglCreateContextAttribsARB(hDC, 0, attribs);
+  return pRendererContext;
+}
 
-      wglMakeCurrent(NULL, NULL);
-      wglDeleteContext(hGLContext);
-      pGLRendererContext->m_hGLContext = hGLEWContext;
+COMDLG_FILTERSPEC c_rgReadTypes[] = {
+  {L"Common picture file formats", L"*.jpg;*.jpeg;*.png;*.bmp;*.gif;*.pgm"},
+  {L"Windows/OS2 Bitmap", L"*.bmp"},
+  {L"Portable Network Graphics", L"*.png"},
+  {L"Joint Picture Expert Group", L"*.jpg;*.jpeg"},
+  {L"CompuServe Graphics Interchange Format", L"*.gif"},
+  {L"Portable Graymap Format", L"*.pgm"},
+  {L"All files", L"*.*"},
+};
 
-      wglMakeCurrent(hDC, pGLRendererContext->m_hGLContext);
-    }
+HRESULT InvokeFileOpenDialog(LPWSTR *ppszPath)
+{
+  HRESULT hr = S_OK;
 
-    if (!pGLRendererContext->m_hGLContext) {
-      // Failed to initialize GL context
-    }
+  IFileDialog *pFileDialog = NULL;
+  IShellItem *pShellItemResult = NULL;
 
-    static const WCHAR szVertFileName[] = L"vert.glsl";
-    static const WCHAR szFragFileName[] = L"frag.glsl";
+  hr = CoCreateInstance(&CLSID_FileOpenDialog, NULL, CLSCTX_INPROC_SERVER,
+      &IID_IFileDialog, (LPVOID)&pFileDialog);
+  if (FAILED(hr)) {
+    PopupError(hr, NULL);
+    assert(SUCCEEDED(hr));
+    goto error;
+  }
 
-    LPPANIVIEWAPP pApp = GetApp();
-    PWSTR pszSite = PaniViewApp_GetAppDataSitePath(pApp);
+  hr = pFileDialog->lpVtbl->SetFileTypes( pFileDialog,
+      ARRAYSIZE(c_rgReadTypes), c_rgReadTypes);
+  if (FAILED(hr)) {
+    PopupError(hr, NULL);
+    assert(SUCCEEDED(hr));
+    goto error;
+  }
 
-    size_t lenVertPath = wcslen(pszSite) + ARRAYSIZE(szVertFileName) + 1;
-    PWSTR pszVertPath = (PWSTR)calloc(1, lenVertPath * sizeof(WCHAR));
-    if (pszVertPath) {
-      StringCchCopy(pszVertPath, lenVertPath, pszSite);
-      PathCchAppend(pszVertPath, lenVertPath, szVertFileName);
-    }
+  hr = pFileDialog->lpVtbl->Show(pFileDialog, NULL);
+  if (hr == HRESULT_FROM_WIN32(ERROR_CANCELLED))
+  {
+      goto error;
+  }
+  else if (FAILED(hr))
+  {
+      PopupError(hr, NULL);
+      assert(SUCCEEDED(hr));
+      goto error;
+  }
 
-    size_t lenFragPath = wcslen(pszSite) + ARRAYSIZE(szFragFileName) + 1;
-    PWSTR pszFragPath = (PWSTR)calloc(1, lenFragPath * sizeof(WCHAR));
-    if (pszFragPath) {
-      StringCchCopy(pszFragPath, lenFragPath, pszSite);
-      PathCchAppend(pszFragPath, lenFragPath, szFragFileName);
-    }
+  hr = pFileDialog->lpVtbl->GetResult(pFileDialog, &pShellItemResult);
+  if (FAILED(hr)) {
+    PopupError(hr, NULL);
+    assert(SUCCEEDED(hr));
+    goto error;
+  }
 
-    pGLRendererContext->m_programId = OpenGLRendererContext_LoadShaders(pGLRendererContext, pszVertPath, pszFragPath);
+  hr = pShellItemResult->lpVtbl->GetDisplayName(pShellItemResult,
+      SIGDN_FILESYSPATH, ppszPath);
+  if (FAILED(hr)) {
+    PopupError(hr, NULL);
+    assert(SUCCEEDED(hr));
+    goto error;
+  }
 
-    free(pszVertPath);
-    free(pszFragPath);
+error:
+  SAFE_RELEASE(pShellItemResult);
+  SAFE_RELEASE(pFileDialog);
 
-    OpenGLRendererContext_CreateTexture(pGLRendererContext);
-    OpenGLRendererContext_CreateVBO(pGLRendererContext);
-  }
+  return hr;
 }
 
-void OpenGLRendererContext_CreateTexture(LPOPENGLRENDERERCONTEXT pGLRendererContext)
+/*
+ * PixBufBitmap
+ * A 32bppPBGRA IWICBitmap over a PIXBUF, so decoders write into memory the
+ * renderers can use in place, such as a DIB section. Unlike WIC bitmaps,
+ * locks do not exclude each other; writers are done before the bitmap is
+ * shared. Gray images keep their compact storage: CopyPixels expands them
+ * to PBGRA, Lock is refused, and renderers that know better read the
+ * PIXBUF directly.
+ */
+static HRESULT PixBufBitmap_CheckRect(LPPIXBUF pPixBuf, const WICRect* prc, WICRect* prcOut)
 {
-  GLuint* textureId = &pGLRendererContext->m_textureId;
-
-  if (!*textureId)
-  {
-    glGenTextures(1, textureId);
-    glBindTexture(GL_TEXTURE_2D, *textureId);
+  WICRect rc = { 0, 0, (INT)pPixBuf->width, (INT)pPixBuf->height };
+  if (prc) {
+    if (prc->X < 0 || prc->Y < 0 || prc->Width < 0 || prc->Height < 0 ||
+        (size_t)prc->X + (size_t)prc->Width > pPixBuf->width ||
+        (size_t)prc->Y + (size_t)prc->Height > pPixBuf->height) {
+      return E_INVALIDARG;
+    }
+    rc = *prc;
+  }
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  *prcOut = rc;
+  return S_OK;
+}
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+static HRESULT STDMETHODCALLTYPE PixBufBitmapLock_QueryInterface(IWICBitmapLock* This, REFIID riid, void** ppvObject)
+{
+  if (IsEqualGUID(riid, &IID_IUnknown) || IsEqualGUID(riid, &IID_IWICBitmapLock)) {
+    This->lpVtbl->AddRef(This);
+    *ppvObject = This;
+    return S_OK;
   }
+
+  *ppvObject = NULL;
+  return E_NOINTERFACE;
 }
 
-void OpenGLRendererContext_Draw(LPOPENGLRENDERERCONTEXT pGLRendererContext, LPRENDERCTL2 pRenderCtl)
+static ULONG STDMETHODCALLTYPE PixBufBitmapLock_AddRef(IWICBitmapLock* This)
 {
-  OpenGLRendererContext_CreateDeviceResources(pGLRendererContext, pRenderCtl);
+  return (ULONG)InterlockedIncrement(&((LPPIXBUFBITMAPLOCK)This)->nRefs);
+}
 
-  /* Clear */
-  glClearColor(1.0f, 0.0f, 0.0f, 1.0f);
-  glClear(GL_COLOR_BUFFER_BIT);
+static ULONG STDMETHODCALLTYPE PixBufBitmapLock_Release(IWICBitmapLock* This)
+{
+  LPPIXBUFBITMAPLOCK pLock = (LPPIXBUFBITMAPLOCK)This;
 
-  /* Attach shader */
-  glUseProgram(pGLRendererContext->m_programId);
+  LONG nRefs = InterlockedDecrement(&pLock->nRefs);
+  if (!nRefs) {
+    IWICBitmap* pIWICBitmap = (IWICBitmap*)pLock->pBitmap;
+    pIWICBitmap->lpVtbl->Release(pIWICBitmap);
+    free(pLock);
+  }
 
-  /* Attach texture */
-  glBindTexture(GL_TEXTURE_2D, pGLRendererContext->m_textureId);
+  return (ULONG)nRefs;
+}
 
-  /* Draw plane */
-  OpenGLRendererContext_DrawVBO(pGLRendererContext);
+static HRESULT STDMETHODCALLTYPE PixBufBitmapLock_GetSize(IWICBitmapLock* This, UINT* puiWidth, UINT* puiHeight)
+{
+  LPPIXBUFBITMAPLOCK pLock = (LPPIXBUFBITMAPLOCK)This;
 
-  /* Swap buffers */
-  HDC hdc = GetDC(pRenderCtl->base.hWnd);
-  SwapBuffers(hdc);
-  ReleaseDC(pRenderCtl->base.hWnd, hdc);
+  *puiWidth = (UINT)pLock->rc.Width;
+  *puiHeight = (UINT)pLock->rc.Height;
+  return S_OK;
 }
 
-void OpenGLRendererContext_DrawVBO(LPOPENGLRENDERERCONTEXT pGLRendererContext)
+static HRESULT STDMETHODCALLTYPE PixBufBitmapLock_GetStride(IWICBitmapLock* This, UINT* pcbStride)
 {
-  GLuint* vertexArray = &pGLRendererContext->m_vertexArray;
-  GLuint* vertexBuffer = &pGLRendererContext->m_vertexBuffer;
-  GLuint* uvBuffer = &pGLRendererContext->m_uvBuffer;
+  *pcbStride = (UINT)((LPPIXBUFBITMAPLOCK)This)->pBitmap->pPixBuf->stride;
+  return S_OK;
+}
 
-  /* Bind vertex array */
-  glBindVertexArray(*vertexArray);
+static HRESULT STDMETHODCALLTYPE PixBufBitmapLock_GetDataPointer(IWICBitmapLock* This, UINT* pcbBufferSize,
+    WICInProcPointer* ppbData)
+{
+  LPPIXBUFBITMAPLOCK pLock = (LPPIXBUFBITMAPLOCK)This;
+  LPPIXBUF pPixBuf = pLock->pBitmap->pPixBuf;
 
-  /* Select vertex buffer */
-  glEnableVertexAttribArray(0);
-  glBindBuffer(GL_ARRAY_BUFFER, *vertexBuffer);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+  *ppbData = PixBuf_GetRow(pPixBuf, (size_t)pLock->rc.Y) + (size_t)pLock->rc.X * 4;
+  *pcbBufferSize = pLock->rc.Height ? (UINT)(pPixBuf->stride * (pLock->rc.Height - 1) + (size_t)pLock->rc.Width * 4) : 0;
+  return S_OK;
+}
 
-  /* Select uv buffer */
-  glEnableVertexAttribArray(1);
-  glBindBuffer(GL_ARRAY_BUFFER, *uvBuffer);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+static HRESULT STDMETHODCALLTYPE PixBufBitmapLock_GetPixelFormat(IWICBitmapLock* This, WICPixelFormatGUID* pPixelFormat)
+{
+  UNREFERENCED_PARAMETER(This);
 
-  float width = pGLRendererContext->m_imageWidth;
-  float height = pGLRendererContext->m_imageHeight;
+  *pPixelFormat = GUID_WICPixelFormat32bppPBGRA;
+  return S_OK;
+}
 
-  if (width > pGLRendererContext->m_viewportWidth) {
-    float ratio = height / width;
-    width = pGLRendererContext->m_viewportWidth;
-    height = pGLRendererContext->m_viewportWidth * ratio;
-  }
+static IWICBitmapLockVtbl g_pixBufBitmapLockVtbl = {
+  .QueryInterface = PixBufBitmapLock_QueryInterface,
+  .AddRef = PixBufBitmapLock_AddRef,
+  .Release = PixBufBitmapLock_Release,
+  .GetSize = PixBufBitmapLock_GetSize,
+  .GetStride = PixBufBitmapLock_GetStride,
+  .GetDataPointer = PixBufBitmapLock_GetDataPointer,
+  .GetPixelFormat = PixBufBitmapLock_GetPixelFormat,
+};
 
-  if (height > pGLRendererContext->m_viewportHeight)
-  {
-    float ratio = width / height;
-    width = pGLRendererContext->m_viewportHeight * ratio;
-    height = pGLRendererContext->m_viewportHeight;
+static HRESULT STDMETHODCALLTYPE PixBufBitmap_QueryInterface(IWICBitmap* This, REFIID riid, void** ppvObject)
+{
+  if (IsEqualGUID(riid, &IID_IUnknown) || IsEqualGUID(riid, &IID_IWICBitmapSource) ||
+      IsEqualGUID(riid, &IID_IWICBitmap)) {
+    This->lpVtbl->AddRef(This);
+    *ppvObject = This;
+    return S_OK;
   }
 
-  GLfloat scale[4][4] = {
-    {  -width / 2.0f,  0.0f,  0.0f,  0.0f },
-    {  0.0f,  -height / 2.0f,  0.0f,  0.0f },
-    {  0.0f,  0.0f,  0.0f,  0.0f },
-    {  0.0f,  0.0f,  0.0f,  1.0f },
-  };
+  *ppvObject = NULL;
+  return E_NOINTERFACE;
+}
 
-  GLfloat ortho[4][4] = { 0 };
-  GLfloat transform[4][4] = { 0 };
+static ULONG STDMETHODCALLTYPE PixBufBitmap_AddRef(IWICBitmap* This)
+{
+  return (ULONG)InterlockedIncrement(&((LPPIXBUFBITMAP)This)->nRefs);
+}
 
-  OrthoMatrix(ortho, pGLRendererContext->m_viewportWidth, pGLRendererContext->m_viewportHeight);
-  MatrixMultiply(scale, ortho, transform);
+static ULONG STDMETHODCALLTYPE PixBufBitmap_Release(IWICBitmap* This)
+{
+  LPPIXBUFBITMAP pBitmap = (LPPIXBUFBITMAP)This;
 
-  GLuint transformUniform = glGetUniformLocation(pGLRendererContext->m_programId, "transform");
-  glUniformMatrix4fv(transformUniform, 1, GL_FALSE, &transform[0][0]);
+  LONG nRefs = InterlockedDecrement(&pBitmap->nRefs);
+  if (!nRefs) {
+    Pyramid_Cleanup(&pBitmap->pyramid);
+    PixBuf_Release(pBitmap->pPixBuf);
+    free(pBitmap);
+  }
 
-  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  return (ULONG)nRefs;
+}
 
-  glDisableVertexAttribArray(0);
-  glDisableVertexAttribArray(1);
+static HRESULT STDMETHODCALLTYPE PixBufBitmap_GetSize(IWICBitmap* This, UINT* puiWidth, UINT* puiHeight)
+{
+  LPPIXBUF pPixBuf = ((LPPIXBUFBITMAP)This)->pPixBuf;
 
-  glBindVertexArray(0);
+  *puiWidth = (UINT)pPixBuf->width;
+  *puiHeight = (UINT)pPixBuf->height;
+  return S_OK;
 }
 
-GLuint OpenGLRendererContext_LoadShader(LPOPENGLRENDERERCONTEXT lpGLRendererContext, PCWSTR shaderFilePath, GLuint shaderType)
+static HRESULT STDMETHODCALLTYPE PixBufBitmap_GetPixelFormat(IWICBitmap* This, WICPixelFormatGUID* pPixelFormat)
 {
-  UNREFERENCED_PARAMETER(lpGLRendererContext);
-
-  GLuint shaderId = glCreateShader(shaderType);
+  UNREFERENCED_PARAMETER(This);
 
-  FILE* pShaderFile = NULL;
-  errno_t err;
-  err = _wfopen_s(&pShaderFile, shaderFilePath, L"r");
+  *pPixelFormat = GUID_WICPixelFormat32bppPBGRA;
+  return S_OK;
+}
 
-  if (!err && pShaderFile)
-  {
-    size_t fileSize = GetPfFileSize(pShaderFile);
+static HRESULT STDMETHODCALLTYPE PixBufBitmap_GetResolution(IWICBitmap* This, double* pDpiX, double* pDpiY)
+{
+  UNREFERENCED_PARAMETER(This);
 
-    char* pShaderCode = (char*)calloc(1, fileSize);
-    if (!pShaderCode) {
-      fclose(pShaderFile);
-      return 0;
-    }
+  *pDpiX = 96.0;
+  *pDpiY = 96.0;
+  return S_OK;
+}
 
-    fread(pShaderCode, 1, fileSize, pShaderFile);
-    pShaderCode[fileSize] = '\0';
+static HRESULT STDMETHODCALLTYPE PixBufBitmap_CopyPalette(IWICBitmap* This, IWICPalette* pIPalette)
+{
+  UNREFERENCED_PARAMETER(This);
+  UNREFERENCED_PARAMETER(pIPalette);
 
-    fclose(pShaderFile);
+  return WINCODEC_ERR_PALETTEUNAVAILABLE;
+}
 
-    /* Compile shader */
-    glShaderSource(shaderId, 1, (const char**)&pShaderCode, NULL);
-    glCompileShader(shaderId);
+static HRESULT STDMETHODCALLTYPE PixBufBitmap_CopyPixels(IWICBitmap* This, const WICRect* prc, UINT cbStride,
+    UINT cbBufferSize, BYTE* pbBuffer)
+{
+  LPPIXBUF pPixBuf = ((LPPIXBUFBITMAP)This)->pPixBuf;
 
-    GLint result = GL_FALSE;
-    int infoLogLength;
+  WICRect rc;
+  HRESULT hr = PixBufBitmap_CheckRect(pPixBuf, prc, &rc);
+  if (FAILED(hr) || !rc.Width || !rc.Height) {
+    return hr;
+  }
 
-    /* Check shader */
-    glGetShaderiv(shaderId, GL_COMPILE_STATUS, &result);
-    glGetShaderiv(shaderId, GL_INFO_LOG_LENGTH, &infoLogLength);
+  size_t cbRow = (size_t)rc.Width * 4;
+  if (cbStride < cbRow || cbBufferSize < (size_t)cbStride * (rc.Height - 1) + cbRow) {
+    return WINCODEC_ERR_INSUFFICIENTBUFFER;
+  }
 
-    if (infoLogLength > 0)
-    {
-      char* pShaderErrorMessage = (char*)calloc(1, infoLogLength);
-      glGetShaderInfoLog(shaderId, infoLogLength, NULL, pShaderErrorMessage);
+  size_t nBytesPerPixel = (size_t)PixConv_GetBytesPerPixel(pPixBuf->nFormat);
+  PixConv_Convert(PixBuf_GetRow(pPixBuf, (size_t)rc.Y) + (size_t)rc.X * nBytesPerPixel, pPixBuf->stride,
+      pPixBuf->nFormat, pbBuffer, cbStride, PIXFMT_PBGRA32, (size_t)rc.Width, (size_t)rc.Height);
 
-      printf("%s\n", pShaderErrorMessage);
+  return S_OK;
+}
 
-      free(pShaderErrorMessage);
-      free(pShaderCode);
+static HRESULT STDMETHODCALLTYPE PixBufBitmap_Lock(IWICBitmap* This, const WICRect* prcLock, DWORD flags,
+    IWICBitmapLock** ppILock)
+{
+  UNREFERENCED_PARAMETER(flags);
 
-      exit(EXIT_FAILURE);
-    }
+  LPPIXBUFBITMAP pBitmap = (LPPIXBUFBITMAP)This;
+  if (pBitmap->pPixBuf->nFormat != PIXFMT_PBGRA32) {
+    return WINCODEC_ERR_UNSUPPORTEDOPERATION;
+  }
 
-    // free(pShaderCode);
+  WICRect rc;
+  HRESULT hr = PixBufBitmap_CheckRect(pBitmap->pPixBuf, prcLock, &rc);
+  if (FAILED(hr)) {
+    return hr;
   }
-  else {
-    fwprintf(stderr, L"Impossible to open %s. Are you in the right directory?", shaderFilePath);
-    exit(EXIT_FAILURE);
+
+  LPPIXBUFBITMAPLOCK pLock = (LPPIXBUFBITMAPLOCK)calloc(1, sizeof(PIXBUFBITMAPLOCK));
+  if (!pLock) {
+    return E_OUTOFMEMORY;
   }
 
-  return shaderId;
+  pLock->base.lpVtbl = &g_pixBufBitmapLockVtbl;
+  pLock->nRefs = 1;
+  pLock->pBitmap = pBitmap;
+  pLock->rc = rc;
+  This->lpVtbl->AddRef(This);
+
+  *ppILock = (IWICBitmapLock*)pLock;
+  return S_OK;
 }
 
-GLuint OpenGLRendererContext_LoadShaders(LPOPENGLRENDERERCONTEXT pGLRendererContext, PCWSTR vertexFilePath, PCWSTR fragmentFilePath)
+static HRESULT STDMETHODCALLTYPE PixBufBitmap_SetPalette(IWICBitmap* This, IWICPalette* pIPalette)
 {
-  /* Create shader objects */
-  GLuint vertexShaderId;
-  GLuint fragmentShaderId;
+  UNREFERENCED_PARAMETER(This);
+  UNREFERENCED_PARAMETER(pIPalette);
 
-  vertexShaderId = OpenGLRendererContext_LoadShader(pGLRendererContext, vertexFilePath, GL_VERTEX_SHADER);
-  fragmentShaderId = OpenGLRendererContext_LoadShader(pGLRendererContext, fragmentFilePath, GL_FRAGMENT_SHADER);
+  return WINCODEC_ERR_UNSUPPORTEDOPERATION;
+}
 
-  /* Link the program */
-  GLuint programId = glCreateProgram();
-  glAttachShader(programId, vertexShaderId);
-  glAttachShader(programId, fragmentShaderId);
-  glLinkProgram(programId);
+static HRESULT STDMETHODCALLTYPE PixBufBitmap_SetResolution(IWICBitmap* This, double dpiX, double dpiY)
+{
+  UNREFERENCED_PARAMETER(This);
+  UNREFERENCED_PARAMETER(dpiX);
+  UNREFERENCED_PARAMETER(dpiY);
 
-  /* Check the program */
-  GLint result = GL_FALSE;
-  int infoLogLength;
+  return WINCODEC_ERR_UNSUPPORTEDOPERATION;
+}
 
-  glGetProgramiv(programId, GL_LINK_STATUS, &result);
-  glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &infoLogLength);
+static IWICBitmapVtbl g_pixBufBitmapVtbl = {
+  .QueryInterface = PixBufBitmap_QueryInterface,
+  .AddRef = PixBufBitmap_AddRef,
+  .Release = PixBufBitmap_Release,
+  .GetSize = PixBufBitmap_GetSize,
+  .GetPixelFormat = PixBufBitmap_GetPixelFormat,
+  .GetResolution = PixBufBitmap_GetResolution,
+  .CopyPalette = PixBufBitmap_CopyPalette,
+  .CopyPixels = PixBufBitmap_CopyPixels,
+  .Lock = PixBufBitmap_Lock,
+  .SetPalette = PixBufBitmap_SetPalette,
+  .SetResolution = PixBufBitmap_SetResolution,
+};
 
-  if (infoLogLength)
-  {
-    char* programErrorMessage = (char*)calloc(1, infoLogLength + 1);
-    glGetProgramInfoLog(programId, infoLogLength, NULL, programErrorMessage);
+IWICBitmap* PixBufBitmap_Create(UINT width, UINT height, int nFormat, const PIXBUFALLOCATOR* pAllocator)
+{
+  LPPIXBUFBITMAP pBitmap = (LPPIXBUFBITMAP)calloc(1, sizeof(PIXBUFBITMAP));
+  if (!pBitmap) {
+    return NULL;
+  }
 
-    printf("%s\n", programErrorMessage);
+  if (PixBuf_Create(width, height, nFormat, pAllocator, &pBitmap->pPixBuf) != PIXBUF_OK) {
+    free(pBitmap);
+    return NULL;
+  }
 
-    free(programErrorMessage);
+  pBitmap->base.lpVtbl = &g_pixBufBitmapVtbl;
+  pBitmap->nRefs = 1;
+  return (IWICBitmap*)pBitmap;
+}
 
-    exit(EXIT_FAILURE);
+/* A PixBufBitmap over an existing pixel buffer, referenced */
+IWICBitmap* PixBufBitmap_CreateFromPixBuf(LPPIXBUF pPixBuf)
+{
+  LPPIXBUFBITMAP pBitmap = (LPPIXBUFBITMAP)calloc(1, sizeof(PIXBUFBITMAP));
+  if (!pBitmap) {
+    return NULL;
   }
 
-  glDetachShader(programId, vertexShaderId);
-  glDetachShader(programId, fragmentShaderId);
+  pBitmap->pPixBuf = PixBuf_AddRef(pPixBuf);
+  pBitmap->base.lpVtbl = &g_pixBufBitmapVtbl;
+  pBitmap->nRefs = 1;
+  return (IWICBitmap*)pBitmap;
+}
 
-  glDeleteShader(vertexShaderId);
-  glDeleteShader(fragmentShaderId);
+/* The pixel buffer behind a PixBufBitmap, NULL for any other source */
+LPPIXBUF PixBufBitmap_GetPixBuf(IWICBitmapSource* pSource)
+{
+  if (!pSource || (const void*)pSource->lpVtbl != (const void*)&g_pixBufBitmapVtbl) {
+    return NULL;
+  }
 
-  return programId;
+  return ((LPPIXBUFBITMAP)pSource)->pPixBuf;
 }
 
-void OpenGLRendererContext_LoadWICBitmap(LPOPENGLRENDERERCONTEXT pGLRendererContext, IWICBitmapSource* pBitmapSource)
+/*
+ * PixBufBitmap_BuildPyramid
+ * Give a freshly decoded PixBufBitmap its mip pyramid, before it is shared
+ * with any other thread. Other sources and small images are left alone.
+ */
+HRESULT PixBufBitmap_BuildPyramid(IWICBitmapSource* pSource)
 {
-  OpenGLRendererContext_CreateTexture(pGLRendererContext);
+  LPPIXBUF pPixBuf = PixBufBitmap_GetPixBuf(pSource);
+  if (!pPixBuf || (pPixBuf->width <= PANIVIEW_PYRAMID_MIN_SIZE && pPixBuf->height <= PANIVIEW_PYRAMID_MIN_SIZE)) {
+    return S_FALSE;
+  }
 
-  UINT width;
-  UINT height;
-  pBitmapSource->lpVtbl->GetSize(pBitmapSource, &width, &height);
+  LPPIXBUFBITMAP pBitmap = (LPPIXBUFBITMAP)pSource;
+  Pyramid_Cleanup(&pBitmap->pyramid);
 
-  unsigned char* data = calloc(1, width * height * 4);
-  pBitmapSource->lpVtbl->CopyPixels(pBitmapSource, NULL, width * 4, width * height * 4, data);
+  switch (Pyramid_Build(&pBitmap->pyramid, pPixBuf, PANIVIEW_PYRAMID_MIN_SIZE, PaniViewApp_GetTaskPool())) {
+  case PYRAMID_OK:
+    return S_OK;
+  case PYRAMID_ERROR_MEMORY:
+    return E_OUTOFMEMORY;
+  }
 
-  glBindTexture(GL_TEXTURE_2D, pGLRendererContext->m_textureId);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, (const void*)data);
-  glGenerateMipmap(GL_TEXTURE_2D);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  return S_FALSE;
+}
 
-  free(data);
+/* The levels of a PixBufBitmap, NULL for any other source or before they are built */
+const PYRAMID* PixBufBitmap_GetPyramid(IWICBitmapSource* pSource)
+{
+  if (!PixBufBitmap_GetPixBuf(pSource) || ((LPPIXBUFBITMAP)pSource)->pyramid.nLevels < 2) {
+    return NULL;
+  }
 
-  pGLRendererContext->m_imageWidth = (float)width;
-  pGLRendererContext->m_imageHeight = (float)height;
+  return &((LPPIXBUFBITMAP)pSource)->pyramid;
 }
 
-void OpenGLRendererContext_Release(LPOPENGLRENDERERCONTEXT pGLRendererContext)
+/*
+ * RasterBitmap
+ * A 32bppPBGRA IWICBitmapSource over a PGM or BMP raster that stays in its
+ * file mapping: CopyPixels reads just the rows and columns asked for, and
+ * only their pages are brought in. The mapping lives with the bitmap. Once
+ * presented it is used from the UI thread only, like the renderers.
+ */
+static HRESULT STDMETHODCALLTYPE RasterBitmap_QueryInterface(IWICBitmapSource* This, REFIID riid,
+    void** ppvObject)
 {
-  UNREFERENCED_PARAMETER(pGLRendererContext);
+  if (IsEqualGUID(riid, &IID_IUnknown) || IsEqualGUID(riid, &IID_IWICBitmapSource)) {
+    This->lpVtbl->AddRef(This);
+    *ppvObject = This;
+    return S_OK;
+  }
 
-  /* TODO */
+  *ppvObject = NULL;
+  return E_NOINTERFACE;
 }
 
-void OpenGLRendererContext_Resize(LPOPENGLRENDERERCONTEXT pGLRendererContext, int cx, int cy)
+static ULONG STDMETHODCALLTYPE RasterBitmap_AddRef(IWICBitmapSource* This)
 {
-  pGLRendererContext->m_viewportWidth = (float)cx;
-  pGLRendererContext->m_viewportHeight = (float)cy;
-  glViewport(0, 0, cx, cy);
+  return (ULONG)InterlockedIncrement(&((LPRASTERBITMAP)This)->nRefs);
 }
 
-void InitializeOpenGLRendererContextStruct(LPOPENGLRENDERERCONTEXT pGLRendererContext)
+static ULONG STDMETHODCALLTYPE RasterBitmap_Release(IWICBitmapSource* This)
 {
-  pGLRendererContext->base.Release = (void (*)(LPRENDERERCONTEXT)) & OpenGLRendererContext_Release;
-  pGLRendererContext->base.Resize = (void (*)(LPRENDERERCONTEXT, int, int)) & OpenGLRendererContext_Resize;
-  pGLRendererContext->base.Draw = (void (*)(LPRENDERERCONTEXT, LPRENDERCTL2)) & OpenGLRendererContext_Draw;
-  pGLRendererContext->base.LoadWICBitmap = (void (*)(LPRENDERERCONTEXT, IWICBitmapSource*)) & OpenGLRendererContext_LoadWICBitmap;
+  LPRASTERBITMAP pBitmap = (LPRASTERBITMAP)This;
+
+  LONG nRefs = InterlockedDecrement(&pBitmap->nRefs);
+  if (!nRefs) {
+    SAFE_RELEASE(pBitmap->pPreview);
+    RasterFile_Cleanup(&pBitmap->raster);
+    FileMap_Close(&pBitmap->map);
+    free(pBitmap);
+  }
+
+  return (ULONG)nRefs;
 }
 
-LPOPENGLRENDERERCONTEXT CreateOpenGLRenderer(void)
+static HRESULT STDMETHODCALLTYPE RasterBitmap_GetSize(IWICBitmapSource* This, UINT* puiWidth, UINT* puiHeight)
 {
-  LPOPENGLRENDERERCONTEXT pGLRendererContext = NULL;
+  LPRASTERFILE pRaster = &((LPRASTERBITMAP)This)->raster;
 
-  pGLRendererContext = (LPOPENGLRENDERERCONTEXT) calloc(1, sizeof(OPENGLRENDERERCONTEXT));
-  if (!pGLRendererContext)
-  {
-    return NULL;
-  }
-  InitializeOpenGLRendererContextStruct(pGLRendererContext);
+  *puiWidth = (UINT)pRaster->width;
+  *puiHeight = (UINT)pRaster->height;
+  return S_OK;
+}
 
-  return pGLRendererContext;
+static HRESULT STDMETHODCALLTYPE RasterBitmap_GetPixelFormat(IWICBitmapSource* This,
+    WICPixelFormatGUID* pPixelFormat)
+{
+  UNREFERENCED_PARAMETER(This);
+
+  *pPixelFormat = GUID_WICPixelFormat32bppPBGRA;
+  return S_OK;
 }
 
-/****************************
- *  GDI Renderer functions  *
- ****************************/
+static HRESULT STDMETHODCALLTYPE RasterBitmap_GetResolution(IWICBitmapSource* This, double* pDpiX, double* pDpiY)
+{
+  UNREFERENCED_PARAMETER(This);
 
-void GDIRendererContext_Draw(LPGDIRENDERERCONTEXT pGDIRendererContext, LPRENDERCTL2 pRenderCtl)
+  *pDpiX = 96.0;
+  *pDpiY = 96.0;
+  return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE RasterBitmap_CopyPalette(IWICBitmapSource* This, IWICPalette* pIPalette)
 {
-  HDC hdc;
-  hdc = GetDC(pRenderCtl->base.hWnd);
+  UNREFERENCED_PARAMETER(This);
+  UNREFERENCED_PARAMETER(pIPalette);
 
-  HDC hBitmapDC = CreateCompatibleDC(hdc);
-  HBITMAP hOldBitmap = (HBITMAP) SelectObject(hBitmapDC, (HGDIOBJ) pGDIRendererContext->m_hBitmap);
+  return WINCODEC_ERR_PALETTEUNAVAILABLE;
+}
 
-  RECT rc = {0};
-  GetClientRect(pRenderCtl->base.hWnd, &rc);
+static HRESULT STDMETHODCALLTYPE RasterBitmap_CopyPixels(IWICBitmapSource* This, const WICRect* prc,
+    UINT cbStride, UINT cbBufferSize, BYTE* pbBuffer)
+{
+  LPRASTERFILE pRaster = &((LPRASTERBITMAP)This)->raster;
+
+  WICRect rc = { 0, 0, (INT)pRaster->width, (INT)pRaster->height };
+  if (prc) {
+    if (prc->X < 0 || prc->Y < 0 || prc->Width < 0 || prc->Height < 0 ||
+        (size_t)prc->X + (size_t)prc->Width > pRaster->width ||
+        (size_t)prc->Y + (size_t)prc->Height > pRaster->height) {
+      return E_INVALIDARG;
+    }
+    rc = *prc;
+  }
 
-  FillRect(hdc, &rc, CreateSolidBrush(RGB(0, 0xFF, 0)));
+  if (!rc.Width || !rc.Height) {
+    return S_OK;
+  }
 
-  int imageWidth = pGDIRendererContext->m_width;
-  int imageHeight = pGDIRendererContext->m_height;
+  size_t cbRow = (size_t)rc.Width * 4;
+  if (cbStride < cbRow || cbBufferSize < (size_t)cbStride * (rc.Height - 1) + cbRow) {
+    return WINCODEC_ERR_INSUFFICIENTBUFFER;
+  }
 
-  int viewWidth = Rect_GetWidth(&rc);
-  int viewHeight = Rect_GetHeight(&rc);
+  switch (RasterFile_ReadRegion(pRaster, (size_t)rc.X, (size_t)rc.Y, (size_t)rc.X + rc.Width,
+      (size_t)rc.Y + rc.Height, 1, pbBuffer, cbStride, PIXFMT_PBGRA32)) {
+  case RASTERFILE_OK:
+    return S_OK;
+  case RASTERFILE_ERROR_MEMORY:
+    return E_OUTOFMEMORY;
+  }
 
-  RECT rcDest = {0};
-  rcDest.left = 0;
-  rcDest.top = 0;
-  rcDest.right = Rect_GetWidth(&rc);
-  rcDest.bottom = Rect_GetHeight(&rc);
+  return HRESULT_FROM_WIN32(ERROR_READ_FAULT);
+}
 
-  RECT rcSrc = {0};
-  rcSrc.left = 0;
-  rcSrc.top = 0;
-  rcSrc.right = imageWidth;
-  rcSrc.bottom = imageHeight;
+static IWICBitmapSourceVtbl g_rasterBitmapVtbl = {
+  .QueryInterface = RasterBitmap_QueryInterface,
+  .AddRef = RasterBitmap_AddRef,
+  .Release = RasterBitmap_Release,
+  .GetSize = RasterBitmap_GetSize,
+  .GetPixelFormat = RasterBitmap_GetPixelFormat,
+  .GetResolution = RasterBitmap_GetResolution,
+  .CopyPalette = RasterBitmap_CopyPalette,
+  .CopyPixels = RasterBitmap_CopyPixels,
+};
 
-  RectTranslate(&rcDest, -((float)viewWidth / 2.0f), -((float)viewHeight / 2.0f));
+/*
+ * RasterBitmap_CreateFromFileMap
+ * Read regions of the raster of a mapped file, taking the mapping over.
+ * Fails for anything but an uncompressed raster, which is then decoded in
+ * full instead, and leaves the mapping to the caller.
+ */
+HRESULT RasterBitmap_CreateFromFileMap(LPFILEMAP pMap, IWICBitmapSource** ppBitmap)
+{
+  HRESULT hr = S_OK;
 
-  if (imageWidth > viewWidth) {
-    float ratio = imageHeight / (float)imageWidth;
-    imageWidth = viewWidth;
-    imageHeight = (int)(viewWidth * ratio);
+  LPRASTERBITMAP pBitmap = (LPRASTERBITMAP)calloc(1, sizeof(RASTERBITMAP));
+  if (!pBitmap) {
+    return E_OUTOFMEMORY;
   }
 
-  if (imageHeight > viewHeight)
-  {
-    float ratio = imageWidth / (float)imageHeight;
-    imageWidth = (int)(viewHeight * ratio);
-    imageHeight = viewHeight;
+  switch (RasterFile_InitMemory(&pBitmap->raster, pMap->pData, pMap->size)) {
+  case RASTERFILE_OK:
+    break;
+  case RASTERFILE_ERROR_MEMORY:
+    hr = E_OUTOFMEMORY;
+    break;
+  case RASTERFILE_ERROR_UNSUPPORTED:
+    hr = WINCODEC_ERR_UNSUPPORTEDOPERATION;
+    break;
+  default:
+    hr = WINCODEC_ERR_BADHEADER;
+    break;
+  }
+  if (FAILED(hr)) {
+    goto fail;
   }
 
-  float mat[4][4] = {
-    {  2.0f / (float)viewWidth,  0.0f,  0.0f,  0.0f},
-    {  0.0f,  2.0f / (float)viewHeight,  0.0f,  0.0f},
-    {  0.0f,  0.0f,  0.0f,  0.0f },
-    {  0.0f,  0.0f,  0.0f,  1.0f },
-  };
-  float mat2[4][4] = {
-    { (float)imageWidth / 2.0f, 0.0f, 0.0f, 0.0f },
-    { 0.0f, (float)imageHeight / 2.0f, 0.0f, 0.0f },
-    { 0.0f, 0.0f, 0.0f, 0.0f },
-    { 0.0f, 0.0f, 0.0f, 1.0f },
-  };
+  if (pBitmap->raster.width > INT_MAX || pBitmap->raster.height > INT_MAX) {
+    RasterFile_Cleanup(&pBitmap->raster);
+    hr = WINCODEC_ERR_IMAGESIZEOUTOFRANGE;
+    goto fail;
+  }
 
-  float mat3[4][4] = {0};
-  MatrixMultiply(mat, mat2, mat3);
+  pBitmap->map = *pMap;
+  memset(pMap, 0, sizeof(FILEMAP));
 
-  RectMatrixMultiply(&rcDest, mat3);
-  RectTranslate(&rcDest, (float)viewWidth / 2.0f, (float)viewHeight / 2.0f);
+  pBitmap->base.lpVtbl = &g_rasterBitmapVtbl;
+  pBitmap->nRefs = 1;
+  *ppBitmap = (IWICBitmapSource*)pBitmap;
+  return S_OK;
 
-  // RectTranslate(&rcDest, 40.f, 40.f);
+fail:
+  free(pBitmap);
 
-  SetStretchBltMode(hdc, HALFTONE);
-  RectBlt(hdc, rcDest, hBitmapDC, rcSrc, SRCCOPY);
+  return hr;
+}
 
-  SelectObject(hBitmapDC, (HGDIOBJ) hOldBitmap);
+/* The raster behind a RasterBitmap, NULL for any other source */
+LPRASTERFILE RasterBitmap_GetRasterFile(IWICBitmapSource* pSource)
+{
+  if (!pSource || (const void*)pSource->lpVtbl != (const void*)&g_rasterBitmapVtbl) {
+    return NULL;
+  }
 
-  ReleaseDC(pRenderCtl->base.hWnd, hdc);
+  return &((LPRASTERBITMAP)pSource)->raster;
 }
 
-void GDIRendererContext_LoadWICBitmap(LPGDIRENDERERCONTEXT pGDIRendererContext, IWICBitmapSource* pBitmapSource)
+/* The power of two a raster is sampled down by to fit the preview size */
+unsigned int RasterBitmap_GetPreviewScale(uint64_t width, uint64_t height)
 {
-  UINT width;
-  UINT height;
-  pBitmapSource->lpVtbl->GetSize(pBitmapSource, &width, &height);
-  pGDIRendererContext->m_width = width;
-  pGDIRendererContext->m_height = height;
+  unsigned int nScale = 1;
+  while ((width + nScale - 1) / nScale > PANIVIEW_RASTER_PREVIEW_SIZE ||
+      (height + nScale - 1) / nScale > PANIVIEW_RASTER_PREVIEW_SIZE) {
+    nScale *= 2;
+  }
 
-  unsigned char* data = (unsigned char*)calloc(1, width * height * 4);
+  return nScale;
+}
 
-  pBitmapSource->lpVtbl->CopyPixels(pBitmapSource, NULL, width * 4, width * height * 4, data);
+/*
+ * RasterBitmap_GetPreview
+ * What renderers without tiles draw instead of a RasterBitmap: the raster
+ * sampled down to the preview size, read once and kept with the bitmap.
+ * Any other source, or a raster whose preview cannot be read, is returned
+ * as it is.
+ */
+IWICBitmapSource* RasterBitmap_GetPreview(IWICBitmapSource* pSource)
+{
+  LPRASTERFILE pRaster = RasterBitmap_GetRasterFile(pSource);
+  if (!pRaster) {
+    return pSource;
+  }
 
-  pGDIRendererContext->m_hBitmap = CreateBitmap(width, height, 1, 32, data);
+  LPRASTERBITMAP pBitmap = (LPRASTERBITMAP)pSource;
+  if (!pBitmap->pPreview) {
+    unsigned int nScale = RasterBitmap_GetPreviewScale(pRaster->width, pRaster->height);
+    IWICBitmap* pPreview = PixBufBitmap_Create((UINT)((pRaster->width + nScale - 1) / nScale),
+        (UINT)((pRaster->height + nScale - 1) / nScale), pRaster->nPixFmt, NULL);
+    if (!pPreview) {
+      return pSource;
+    }
 
-  free(data);
-}
+    LPPIXBUF pPixBuf = PixBufBitmap_GetPixBuf((IWICBitmapSource*)pPreview);
+    if (RasterFile_ReadRegion(pRaster, 0, 0, pRaster->width, pRaster->height, nScale, pPixBuf->pData,
+        pPixBuf->stride, pPixBuf->nFormat) != RASTERFILE_OK) {
+      SAFE_RELEASE(pPreview);
+      return pSource;
+    }
 
-void GDIRendererContext_Release(LPGDIRENDERERCONTEXT pGDIRendererContext)
-{
-  DeleteObject(pGDIRendererContext->m_hBitmap);
+    PixBufBitmap_BuildPyramid((IWICBitmapSource*)pPreview);
+    pBitmap->pPreview = pPreview;
+  }
 
-  free(pGDIRendererContext);
+  return (IWICBitmapSource*)pBitmap->pPreview;
 }
 
-void GDIRendererContext_Resize(LPGDIRENDERERCONTEXT pGDIRendererContext, int cx, int cy)
+/*
+ * RasterBitmap_ReadLevel
+ * Tile reader of the OpenGL renderer, pUserData being the RasterBitmap:
+ * a rectangle of level n is the level 0 one sampled at 1/2^n
+ */
+int RasterBitmap_ReadLevel(void* pUserData, size_t nLevel, size_t left, size_t top, size_t right, size_t bottom,
+    void* pDest, size_t destStride)
 {
-  UNREFERENCED_PARAMETER(pGDIRendererContext);
-  UNREFERENCED_PARAMETER(cx);
-  UNREFERENCED_PARAMETER(cy);
+  LPRASTERFILE pRaster = RasterBitmap_GetRasterFile((IWICBitmapSource*)pUserData);
+  if (!pRaster) {
+    return FALSE;
+  }
+
+  size_t nFactor = (size_t)1 << nLevel;
+  return RasterFile_ReadRegion(pRaster, left * nFactor, top * nFactor, min(right * nFactor, pRaster->width),
+      min(bottom * nFactor, pRaster->height), (unsigned int)nFactor, pDest, destStride,
+      pRaster->nPixFmt) == RASTERFILE_OK;
 }
 
-void InitializeGDIRendererContextStruct(LPGDIRENDERERCONTEXT pGDIRendererContext)
+/*
+ * FileMapPixBuf_Free
+ * Release of pixel buffers wrapped around the rows of a mapped file:
+ * pUserData is the heap copy of its FILEMAP
+ */
+void FileMapPixBuf_Free(void* pData, void* pHandle, void* pUserData)
 {
-  pGDIRendererContext->base.Release = (void (*)(LPRENDERERCONTEXT)) & GDIRendererContext_Release;
-  pGDIRendererContext->base.Resize = (void (*)(LPRENDERERCONTEXT, int, int)) & GDIRendererContext_Resize;
-  pGDIRendererContext->base.Draw = (void (*)(LPRENDERERCONTEXT, LPRENDERCTL2)) & GDIRendererContext_Draw;
-  pGDIRendererContext->base.LoadWICBitmap = (void (*)(LPRENDERERCONTEXT, IWICBitmapSource*)) &GDIRendererContext_LoadWICBitmap;
+  UNREFERENCED_PARAMETER(pData);
+  UNREFERENCED_PARAMETER(pHandle);
+
+  FileMap_Close((LPFILEMAP)pUserData);
+  free(pUserData);
 }
 
-LPGDIRENDERERCONTEXT CreateGDIRenderer(void)
+/*
+ * DIBPixBuf_Alloc
+ * Back pixel buffers with top-down 32bpp DIB sections; the HBITMAP is the
+ * handle, so the GDI renderer can select the decoded image as it is
+ */
+void* DIBPixBuf_Alloc(const PIXBUF* pPixBuf, void** ppHandle, void* pUserData)
 {
-  LPGDIRENDERERCONTEXT pGDIRendererContext = NULL;
+  UNREFERENCED_PARAMETER(pUserData);
 
-  pGDIRendererContext = (LPGDIRENDERERCONTEXT)calloc(1, sizeof(GDIRENDERERCONTEXT));
-  if (!pGDIRendererContext)
-  {
+  if (pPixBuf->nFormat != PIXFMT_PBGRA32 || pPixBuf->width > INT_MAX || pPixBuf->height > INT_MAX) {
     return NULL;
   }
-  InitializeGDIRendererContextStruct(pGDIRendererContext);
 
-  return pGDIRendererContext;
-}
+  BITMAPINFO bmi = {0};
+  bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+  bmi.bmiHeader.biWidth = (LONG)pPixBuf->width;
+  bmi.bmiHeader.biHeight = -(LONG)pPixBuf->height;
+  bmi.bmiHeader.biPlanes = 1;
+  bmi.bmiHeader.biBitCount = 32;
+  bmi.bmiHeader.biCompression = BI_RGB;
+
+  void* pBits = NULL;
+  HBITMAP hBitmap = CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, &pBits, NULL, 0);
+  if (!hBitmap) {
+    return NULL;
+  }
 
-/********************
- *  Render Control  *
- ********************/
+  *ppHandle = hBitmap;
+  return pBits;
+}
 
-LPRENDERERCONTEXT CreateRendererContext(void)
+void DIBPixBuf_Free(void* pData, void* pHandle, void* pUserData)
 {
-  LPPANIVIEWAPP pApp = GetApp();
-  LPRENDERERCONTEXT pRendererContext = NULL;
-
-  switch (pApp->m_settings.nRendererType)
-  {
-  case RENDERER_D2D:
-    pRendererContext = (LPRENDERERCONTEXT) CreateD2DRenderer();
-    break;
-
-  case RENDERER_OPENGL:
-    pRendererContext = (LPRENDERERCONTEXT) CreateOpenGLRenderer();
-    break;
-
-  case RENDERER_GDI:
-    pRendererContext = (LPRENDERERCONTEXT) CreateGDIRenderer();
-    break;
-  }
+  UNREFERENCED_PARAMETER(pData);
+  UNREFERENCED_PARAMETER(pUserData);
 
-  return pRendererContext;
+  DeleteObject((HBITMAP)pHandle);
 }
 
-COMDLG_FILTERSPEC c_rgReadTypes[] = {
-  {L"Common picture file formats", L"*.jpg;*.jpeg;*.png;*.bmp;*.gif;*.pgm"},
-  {L"Windows/OS2 Bitmap", L"*.bmp"},
-  {L"Portable Network Graphics", L"*.png"},
-  {L"Joint Picture Expert Group", L"*.jpg;*.jpeg"},
-  {L"CompuServe Graphics Interchange Format", L"*.gif"},
-  {L"Portable Graymap Format", L"*.pgm"},
-  {L"All files", L"*.*"},
-};
+/*
+ * WICPixelFormatToPixFmt
+ * Map a WIC pixel format onto the matching pixconv format, PIXFMT_UNKNOWN
+ * when pixconv has no kernel for it
+ */
+static int WICPixelFormatToPixFmt(const WICPixelFormatGUID* pFormat)
+{
+  static const struct {
+    const WICPixelFormatGUID* pGuid;
+    int nFormat;
+  } formatMap[] = {
+    { &GUID_WICPixelFormat8bppGray, PIXFMT_GRAY8 },
+    { &GUID_WICPixelFormat16bppGray, PIXFMT_GRAY16 },
+    { &GUID_WICPixelFormat24bppRGB, PIXFMT_RGB24 },
+    { &GUID_WICPixelFormat24bppBGR, PIXFMT_BGR24 },
+    { &GUID_WICPixelFormat32bppRGBA, PIXFMT_RGBA32 },
+    { &GUID_WICPixelFormat32bppBGRA, PIXFMT_BGRA32 },
+    { &GUID_WICPixelFormat32bppPBGRA, PIXFMT_PBGRA32 },
+  };
+
+  for (size_t i = 0; i < ARRAYSIZE(formatMap); ++i) {
+    if (IsEqualGUID(pFormat, formatMap[i].pGuid)) {
+      return formatMap[i].nFormat;
+    }
+  }
 
-HRESULT InvokeFileOpenDialog(LPWSTR *ppszPath)
+  return PIXFMT_UNKNOWN;
+}
+
+/*
+ * WICCreatePBGRABitmap
+ * Allocate a 32bppPBGRA bitmap and hand out a write lock on all of it. The
+ * pixels live in a DIB section when one can be had, so decoders write
+ * straight into memory the GDI renderer blits from.
+ */
+IWICBitmap* WICCreatePBGRABitmap(UINT width, UINT height, IWICBitmapLock** ppLock, UINT* pcbStride, BYTE** ppData)
 {
   HRESULT hr = S_OK;
 
-  IFileDialog *pFileDialog = NULL;
-  IShellItem *pShellItemResult = NULL;
+  IWICBitmap* pIWICBitmap = NULL;
+  IWICBitmapLock* pLock = NULL;
 
-  hr = CoCreateInstance(&CLSID_FileOpenDialog, NULL, CLSCTX_INPROC_SERVER,
-      &IID_IFileDialog, (LPVOID)&pFileDialog);
-  if (FAILED(hr)) {
-    PopupError(hr, NULL);
-    assert(SUCCEEDED(hr));
-    goto error;
+  LPPANIVIEWAPP pApp = GetApp();
+
+  static const PIXBUFALLOCATOR dibAllocator = { DIBPixBuf_Alloc, DIBPixBuf_Free, NULL };
+  pIWICBitmap = PixBufBitmap_Create(width, height, PIXFMT_PBGRA32, &dibAllocator);
+  if (!pIWICBitmap) {
+    hr = pApp->m_pIWICFactory->lpVtbl->CreateBitmap(
+      pApp->m_pIWICFactory,
+      width, height,
+      &GUID_WICPixelFormat32bppPBGRA,
+      WICBitmapCacheOnLoad,
+      &pIWICBitmap);
+    if (FAILED(hr)) {
+      goto fail;
+    }
   }
 
-  hr = pFileDialog->lpVtbl->SetFileTypes( pFileDialog,
-      ARRAYSIZE(c_rgReadTypes), c_rgReadTypes);
+  WICRect rcLock = { 0, 0, (INT)width, (INT)height };
+  hr = pIWICBitmap->lpVtbl->Lock(pIWICBitmap, &rcLock, WICBitmapLockWrite, &pLock);
   if (FAILED(hr)) {
-    PopupError(hr, NULL);
-    assert(SUCCEEDED(hr));
-    goto error;
+    goto fail;
   }
 
-  hr = pFileDialog->lpVtbl->Show(pFileDialog, NULL);
-  if (hr == HRESULT_FROM_WIN32(ERROR_CANCELLED))
-  {
-      goto error;
-  }
-  else if (FAILED(hr))
-  {
-      PopupError(hr, NULL);
-      assert(SUCCEEDED(hr));
-      goto error;
+  UINT cbBufferSize = 0;
+  pLock->lpVtbl->GetStride(pLock, pcbStride);
+  hr = pLock->lpVtbl->GetDataPointer(pLock, &cbBufferSize, ppData);
+  if (FAILED(hr)) {
+    goto fail;
   }
 
-  hr = pFileDialog->lpVtbl->GetResult(pFileDialog, &pShellItemResult);
+  *ppLock = pLock;
+
+fail:
   if (FAILED(hr)) {
-    PopupError(hr, NULL);
-    assert(SUCCEEDED(hr));
-    goto error;
+    SAFE_RELEASE(pLock);
+    SAFE_RELEASE(pIWICBitmap);
   }
 
-  hr = pShellItemResult->lpVtbl->GetDisplayName(pShellItemResult,
-      SIGDN_FILESYSPATH, ppszPath);
+  return pIWICBitmap;
+}
+
+/*
+ * WICLockBitmapSource
+ * Read-lock the pixels of an in-memory bitmap so that renderers can upload
+ * them in place. Returns NULL for sources that are not IWICBitmap.
+ */
+IWICBitmapLock* WICLockBitmapSource(IWICBitmapSource* pSource, UINT* pcbStride, BYTE** ppData)
+{
+  IWICBitmap* pIWICBitmap = NULL;
+  IWICBitmapLock* pLock = NULL;
+
+  HRESULT hr = pSource->lpVtbl->QueryInterface(pSource, &IID_IWICBitmap, (void**)&pIWICBitmap);
   if (FAILED(hr)) {
-    PopupError(hr, NULL);
-    assert(SUCCEEDED(hr));
-    goto error;
+    return NULL;
   }
 
-error:
-  SAFE_RELEASE(pShellItemResult);
-  SAFE_RELEASE(pFileDialog);
+  UINT width = 0;
+  UINT height = 0;
+  pIWICBitmap->lpVtbl->GetSize(pIWICBitmap, &width, &height);
 
-  return hr;
+  WICRect rcLock = { 0, 0, (INT)width, (INT)height };
+  hr = pIWICBitmap->lpVtbl->Lock(pIWICBitmap, &rcLock, WICBitmapLockRead, &pLock);
+  if (SUCCEEDED(hr)) {
+    UINT cbBufferSize = 0;
+    pLock->lpVtbl->GetStride(pLock, pcbStride);
+    hr = pLock->lpVtbl->GetDataPointer(pLock, &cbBufferSize, ppData);
+    if (FAILED(hr)) {
+      SAFE_RELEASE(pLock);
+    }
+  }
+
+  SAFE_RELEASE(pIWICBitmap);
+  return pLock;
 }
 
-IWICBitmapSource* WICLoadFromMemory(int width, int height, unsigned char* data, REFWICPixelFormatGUID pixelFormat)
+/*
+ * WICSetCurrentBitmap
+ * Make the bitmap the current application image
+ */
+void WICSetCurrentBitmap(IWICBitmapSource* pBitmap)
 {
-  (void)pixelFormat;
+  LPPANIVIEWAPP pApp = GetApp();
+
+  pBitmap->lpVtbl->AddRef(pBitmap);
+  SAFE_RELEASE(pApp->m_pConvertedSourceBitmap);
+  pApp->m_pConvertedSourceBitmap = pBitmap;
+}
 
+/*
+ * WICConvertBitmapSource
+ * Materialize the source as a new bitmap. Gray stays gray, copied strip by
+ * strip into a PixBufBitmap. Other formats known to pixconv become
+ * 32bppPBGRA strip by strip with the SIMD kernels, polling the token in
+ * between; anything else goes through a WIC format converter.
+ */
+HRESULT WICConvertBitmapSource(IWICBitmapSource* pSource, LPLOADTOKEN pToken, IWICBitmapSource** ppResult)
+{
   HRESULT hr = S_OK;
 
-  IWICBitmap* pIWICBitmap;
-  IWICFormatConverter* pConvertedSourceBitmap = NULL;
+  IWICBitmapSource* pResult = NULL;
+  IWICFormatConverter* pFormatConverter = NULL;
+  IWICBitmapLock* pLock = NULL;
+  BYTE* pStrip = NULL;
 
   LPPANIVIEWAPP pApp = GetApp();
 
-  hr = pApp->m_pIWICFactory->lpVtbl->CreateBitmapFromMemory(
-    pApp->m_pIWICFactory,
-    width, height,
-    &GUID_WICPixelFormat8bppGray,
-    width, width * height,
-    (BYTE*) data,
-    &pIWICBitmap
-  );
+  WICPixelFormatGUID srcFormat;
+  hr = pSource->lpVtbl->GetPixelFormat(pSource, &srcFormat);
   if (FAILED(hr)) {
-    PopupError(hr, NULL);
-    assert(FALSE);
     goto fail;
   }
 
-  /* Convert the image to 32bppPBGRA */
-  hr = pApp->m_pIWICFactory->lpVtbl->CreateFormatConverter(
-    pApp->m_pIWICFactory,
-    &pConvertedSourceBitmap);
+  UINT width = 0;
+  UINT height = 0;
+  hr = pSource->lpVtbl->GetSize(pSource, &width, &height);
   if (FAILED(hr)) {
-    PopupError(hr, NULL);
-    assert(FALSE);
     goto fail;
   }
 
-  hr = pConvertedSourceBitmap->lpVtbl->Initialize(
-    pConvertedSourceBitmap,
-    (IWICBitmapSource*) pIWICBitmap, /* Input bitmap to convert */
-    &GUID_WICPixelFormat32bppPBGRA, /* Destination pixel format */
-    WICBitmapDitherTypeNone,  /* No dither pattern */
-    NULL, /* Do not specify particular color pallete */
-    0.0f, /* Alpha threshold */
-    WICBitmapPaletteTypeCustom);  /* Palette transform type */
-  if (FAILED(hr)) {
-    PopupError(hr, NULL);
-    assert(FALSE);
-    goto fail;
+  int nSrcFormat = WICPixelFormatToPixFmt(&srcFormat);
+  if ((nSrcFormat == PIXFMT_GRAY8 || nSrcFormat == PIXFMT_GRAY16) && width <= INT_MAX / 4 && height <= INT_MAX) {
+    IWICBitmap* pIWICBitmap = PixBufBitmap_Create(width, height, nSrcFormat, NULL);
+    if (!pIWICBitmap) {
+      hr = E_OUTOFMEMORY;
+      goto fail;
+    }
+    pResult = (IWICBitmapSource*)pIWICBitmap;
+
+    LPPIXBUF pPixBuf = PixBufBitmap_GetPixBuf(pResult);
+    UINT cbStride = (UINT)pPixBuf->stride;
+    UINT nStripRows = 256;
+
+    for (UINT nRow = 0; nRow < height; nRow += nStripRows) {
+      if (LoadToken_IsCancelled(pToken)) {
+        hr = HRESULT_FROM_WIN32(ERROR_CANCELLED);
+        goto fail;
+      }
+
+      UINT nRows = min(nStripRows, height - nRow);
+      WICRect rcStrip = { 0, (INT)nRow, (INT)width, (INT)nRows };
+
+      hr = pSource->lpVtbl->CopyPixels(pSource, &rcStrip, cbStride, cbStride * nRows, PixBuf_GetRow(pPixBuf, nRow));
+      if (FAILED(hr)) {
+        goto fail;
+      }
+    }
   }
+  else if (nSrcFormat != PIXFMT_UNKNOWN && width <= INT_MAX / 4 && height <= INT_MAX) {
+    UINT cbDstStride = 0;
+    BYTE* pData = NULL;
+    IWICBitmap* pIWICBitmap = WICCreatePBGRABitmap(width, height, &pLock, &cbDstStride, &pData);
+    if (!pIWICBitmap) {
+      hr = E_FAIL;
+      goto fail;
+    }
+    pResult = (IWICBitmapSource*)pIWICBitmap;
 
-  SAFE_RELEASE(pApp->m_pConvertedSourceBitmap);
-  pApp->m_pConvertedSourceBitmap = pConvertedSourceBitmap;
+    /* Already premultiplied BGRA decodes straight into the bitmap */
+    if (nSrcFormat == PIXFMT_PBGRA32) {
+      hr = pSource->lpVtbl->CopyPixels(pSource, NULL, cbDstStride, cbDstStride * height, pData);
+      if (FAILED(hr)) {
+        goto fail;
+      }
+    }
+    else {
+      UINT cbSrcStride = width * (UINT)PixConv_GetBytesPerPixel(nSrcFormat);
+      UINT nStripRows = 256;
 
-fail:
-  if (FAILED(hr)) {
-    SAFE_RELEASE(pConvertedSourceBitmap);
+      pStrip = (BYTE*)malloc((size_t)cbSrcStride * nStripRows);
+      if (!pStrip) {
+        hr = E_OUTOFMEMORY;
+        goto fail;
+      }
+
+      for (UINT nRow = 0; nRow < height; nRow += nStripRows) {
+        if (LoadToken_IsCancelled(pToken)) {
+          hr = HRESULT_FROM_WIN32(ERROR_CANCELLED);
+          goto fail;
+        }
+
+        UINT nRows = min(nStripRows, height - nRow);
+        WICRect rcStrip = { 0, (INT)nRow, (INT)width, (INT)nRows };
+
+        hr = pSource->lpVtbl->CopyPixels(pSource, &rcStrip, cbSrcStride, cbSrcStride * nRows, pStrip);
+        if (FAILED(hr)) {
+          goto fail;
+        }
+
+        PixConv_Convert(pStrip, cbSrcStride, nSrcFormat,
+            pData + (size_t)nRow * cbDstStride, cbDstStride, PIXFMT_PBGRA32, width, nRows);
+      }
+    }
+
+    SAFE_RELEASE(pLock);
   }
-  SAFE_RELEASE(pIWICBitmap);
+  else {
+    hr = pApp->m_pIWICFactory->lpVtbl->CreateFormatConverter(
+      pApp->m_pIWICFactory,
+      &pFormatConverter);
+    if (FAILED(hr)) {
+      goto fail;
+    }
+
+    hr = pFormatConverter->lpVtbl->Initialize(
+      pFormatConverter,
+      pSource, /* Input bitmap to convert */
+      &GUID_WICPixelFormat32bppPBGRA, /* Destination pixel format */
+      WICBitmapDitherTypeNone,  /* No dither pattern */
+      NULL, /* Do not specify particular color pallete */
+      0.0f, /* Alpha threshold */
+      WICBitmapPaletteTypeCustom);  /* Palette transform type */
+    if (FAILED(hr)) {
+      goto fail;
+    }
+
+    /* Run the converter once so every renderer sees the same pixels */
+    UINT cbDstStride = 0;
+    BYTE* pData = NULL;
+    IWICBitmap* pIWICBitmap = WICCreatePBGRABitmap(width, height, &pLock, &cbDstStride, &pData);
+    if (!pIWICBitmap) {
+      hr = E_FAIL;
+      goto fail;
+    }
+    pResult = (IWICBitmapSource*)pIWICBitmap;
+
+    hr = pFormatConverter->lpVtbl->CopyPixels(pFormatConverter, NULL, cbDstStride, cbDstStride * height, pData);
+    if (FAILED(hr)) {
+      goto fail;
+    }
+
+    SAFE_RELEASE(pLock);
+  }
+
+  *ppResult = pResult;
+  pResult = NULL;
 
-  return (IWICBitmapSource*) pConvertedSourceBitmap;
+fail:
+  free(pStrip);
+  SAFE_RELEASE(pLock);
+  SAFE_RELEASE(pFormatConverter);
+  SAFE_RELEASE(pResult);
+
+  return hr;
 }
 
-IWICBitmapSource* WICDecodeFromFilename(LPWSTR pszPath)
+/*
+ * WICDecodeFromFilename
+ * Decode the first frame of a file into a new 32bppPBGRA or gray bitmap
+ */
+HRESULT WICDecodeFromFilename(PCWSTR pszPath, LPLOADTOKEN pToken, IWICBitmapSource** ppBitmap)
 {
   HRESULT hr = S_OK;
 
   IWICBitmapDecoder* pDecoder = NULL;
   IWICBitmapFrameDecode* pFrame = NULL;
-  IWICFormatConverter* pConvertedSourceBitmap = NULL;
 
   LPPANIVIEWAPP pApp = GetApp();
 
@@ -2685,105 +5046,131 @@ IWICBitmapSource* WICDecodeFromFilename(LPWSTR pszPath)
     WICDecodeMetadataCacheOnDemand, /* Cache metadata when needed */
     &pDecoder);
   if (FAILED(hr)) {
-    PopupError(hr, NULL);
-    assert(FALSE);
     goto fail;
   }
 
   /* Decode image */
   hr = pDecoder->lpVtbl->GetFrame(pDecoder, 0, &pFrame);
   if (FAILED(hr)) {
-    PopupError(hr, NULL);
-    assert(FALSE);
+    goto fail;
+  }
+
+  if (LoadToken_IsCancelled(pToken)) {
+    hr = HRESULT_FROM_WIN32(ERROR_CANCELLED);
     goto fail;
   }
 
   /* Convert the frame to 32bppPBGRA */
-  hr = pApp->m_pIWICFactory->lpVtbl->CreateFormatConverter(
-    pApp->m_pIWICFactory,
-    &pConvertedSourceBitmap);
+  hr = WICConvertBitmapSource((IWICBitmapSource*)pFrame, pToken, ppBitmap);
+
+fail:
+
+  SAFE_RELEASE(pDecoder);
+  SAFE_RELEASE(pFrame);
+
+  return hr;
+}
+
+/*
+ * WICDecodeFromFileMap
+ * Decode the first frame of a mapped file through a stream over the
+ * mapping; the pixels are copied out before it returns, so the mapping can
+ * go right after. Files too large for a memory stream are read by WIC.
+ */
+HRESULT WICDecodeFromFileMap(PCWSTR pszPath, const FILEMAP* pMap, LPLOADTOKEN pToken, IWICBitmapSource** ppBitmap)
+{
+  HRESULT hr = S_OK;
+
+  IWICStream* pStream = NULL;
+  IWICBitmapDecoder* pDecoder = NULL;
+  IWICBitmapFrameDecode* pFrame = NULL;
+
+  LPPANIVIEWAPP pApp = GetApp();
+
+  if (!pMap->pData || pMap->size > MAXDWORD) {
+    return WICDecodeFromFilename(pszPath, pToken, ppBitmap);
+  }
+
+  hr = pApp->m_pIWICFactory->lpVtbl->CreateStream(pApp->m_pIWICFactory, &pStream);
   if (FAILED(hr)) {
-    PopupError(hr, NULL);
-    assert(FALSE);
     goto fail;
   }
 
-  hr = pConvertedSourceBitmap->lpVtbl->Initialize(
-    pConvertedSourceBitmap,
-    (IWICBitmapSource*)pFrame, /* Input bitmap to convert */
-    &GUID_WICPixelFormat32bppPBGRA, /* Destination pixel format */
-    WICBitmapDitherTypeNone,  /* No dither pattern */
-    NULL, /* Do not specify particular color pallete */
-    0.f,  /* Alpha threshold */
-    WICBitmapPaletteTypeCustom);  /* Palette transform type */
+  hr = pStream->lpVtbl->InitializeFromMemory(pStream, (BYTE*)pMap->pData, (DWORD)pMap->size);
   if (FAILED(hr)) {
-    PopupError(hr, NULL);
-    assert(FALSE);
     goto fail;
   }
 
-  SAFE_RELEASE(pApp->m_pConvertedSourceBitmap);
-  pApp->m_pConvertedSourceBitmap = pConvertedSourceBitmap;
+  hr = pApp->m_pIWICFactory->lpVtbl->CreateDecoderFromStream(pApp->m_pIWICFactory, (IStream*)pStream, NULL,
+      WICDecodeMetadataCacheOnDemand, &pDecoder);
+  if (FAILED(hr)) {
+    goto fail;
+  }
+
+  hr = pDecoder->lpVtbl->GetFrame(pDecoder, 0, &pFrame);
+  if (FAILED(hr)) {
+    goto fail;
+  }
+
+  if (LoadToken_IsCancelled(pToken)) {
+    hr = HRESULT_FROM_WIN32(ERROR_CANCELLED);
+    goto fail;
+  }
+
+  hr = WICConvertBitmapSource((IWICBitmapSource*)pFrame, pToken, ppBitmap);
 
 fail:
 
-  SAFE_RELEASE(pDecoder);
   SAFE_RELEASE(pFrame);
+  SAFE_RELEASE(pDecoder);
+  SAFE_RELEASE(pStream);
 
-  if (FAILED(hr)) {
-    SAFE_RELEASE(pConvertedSourceBitmap);
-  }
+  return hr;
+}
+
+static HRESULT PGMDecoder_Decode(PCWSTR pszPath, LPFILEMAP pMap, LPLOADTOKEN pToken, IWICBitmapSource** ppBitmap)
+{
+  UNREFERENCED_PARAMETER(pszPath);
 
-  return (IWICBitmapSource *) pConvertedSourceBitmap;
+  return PaniViewApp_DecodePGM(pMap, pToken, ppBitmap);
 }
 
-int WstringComparator(const void *str1, size_t size1, const void *str2, size_t size2)
+static HRESULT WICDecoder_Decode(PCWSTR pszPath, LPFILEMAP pMap, LPLOADTOKEN pToken, IWICBitmapSource** ppBitmap)
 {
-  UNREFERENCED_PARAMETER(size1);
-  UNREFERENCED_PARAMETER(size2);
+  return WICDecodeFromFileMap(pszPath, pMap, pToken, ppBitmap);
+}
 
-  return wcscmp(str1, str2);
+/*
+ * ImageFormats_Initialize
+ * Attach the decoders to the formats recognized by signature
+ */
+void ImageFormats_Initialize(void)
+{
+  static const IMGDECODER pgmDecoder = { PGMDecoder_Decode };
+  static const IMGDECODER wicDecoder = { WICDecoder_Decode };
+
+  ImgFormat_InitRegistry(&g_imageFormats);
+  ImgFormat_SetDecoder(&g_imageFormats, IMGFORMAT_PNG, &wicDecoder);
+  ImgFormat_SetDecoder(&g_imageFormats, IMGFORMAT_JPEG, &wicDecoder);
+  ImgFormat_SetDecoder(&g_imageFormats, IMGFORMAT_GIF, &wicDecoder);
+  ImgFormat_SetDecoder(&g_imageFormats, IMGFORMAT_WEBP, &wicDecoder);
+  ImgFormat_SetDecoder(&g_imageFormats, IMGFORMAT_PGM, &pgmDecoder);
+  ImgFormat_SetDecoder(&g_imageFormats, IMGFORMAT_BMP, &wicDecoder);
 }
 
 int GetFileMIMEType(PCWSTR pszPath)
 {
   FILE* fp = NULL;
-  unsigned char magicBuffer[80] = { 0 };
-  size_t fileSize = 0;
   int mime = MIME_UNKNOWN;
   errno_t err;
 
   err = _wfopen_s(&fp, pszPath, L"rb");
   if (!err && fp)
   {
-    fseek(fp, 0, SEEK_END);
-    fileSize = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-
-    if (fileSize > 80)
-    {
-      fread(magicBuffer, 80, 1, fp);
-
-      if (!memcmp(magicBuffer, g_pngMagic, sizeof(g_pngMagic)))
-      {
-        mime = MIME_IMAGE_PNG;
-      }
-      else if (!memcmp(magicBuffer, g_gifMagic, sizeof(g_gifMagic)))
-      {
-        mime = MIME_IMAGE_GIF;
-      }
-      else if (!memcmp(magicBuffer, g_jpgMagic, sizeof(g_jpgMagic)))
-      {
-        mime = MIME_IMAGE_JPG;
-      }
-      else if (!memcmp(magicBuffer, g_webpMagic, 4) && !memcmp(&magicBuffer[8], &g_webpMagic[4], 4))
-      {
-        mime = MIME_IMAGE_WEBP;
-      }
-      else if (!memcmp(magicBuffer, g_pgmMagic, sizeof(g_pgmMagic)))
-      {
-        mime = MIME_IMAGE_PGM;
-      }
+    /* Formats only described, e.g. PPM, are not offered */
+    const IMGFORMAT* pFormat = ImgFormat_ProbeFile(&g_imageFormats, fp, NULL);
+    if (pFormat && pFormat->pDecoder) {
+      mime = pFormat->nFormat;
     }
 
     fclose(fp);
@@ -2792,111 +5179,84 @@ int GetFileMIMEType(PCWSTR pszPath)
   return mime;
 }
 
-BOOL NextFileInDir(PWSTR pszCurrent, BOOL fNext, PWSTR lpPathOut) {
-  WCHAR szDir[MAX_PATH] = { 0 };
-  WCHAR szMask[MAX_PATH] = { 0 };
-  WCHAR szPath[MAX_PATH] = { 0 };
-  LPWSTR pszFileName = NULL;
-
-  /* Get file directory */
-  GetFullPathName(pszCurrent, MAX_PATH, szDir, &pszFileName);
-  PathCchRemoveFileSpec(szDir, MAX_PATH);
-
-  /* Prepare search filter mask string */
-  StringCchCopy(szMask, MAX_PATH, szDir);
-  PathCchAppend(szMask, MAX_PATH, L"*.*");
-
-  /* Search files in folder by specified mask */
-  WIN32_FIND_DATA ffd = { 0 };
-
-  HANDLE hSearch;
-  hSearch = FindFirstFile(szMask, &ffd);
+/*
+ * Directory index filter: only files of a format with a decoder. A known
+ * image extension is taken at its word, so most files are never opened;
+ * only the others are probed. Called from the scan threads.
+ */
+int ImageFileFilter(const char* pszPath, const char* pszName, void* pUserData)
+{
+  UNREFERENCED_PARAMETER(pUserData);
 
-  DOUBLELINKLIST dirList = { 0 };
-  dirList.pfnSort = WstringComparator;
+  const IMGFORMAT* pFormat = ImgFormat_FindByName(&g_imageFormats, pszName);
+  if (pFormat && pFormat->pDecoder) {
+    return TRUE;
+  }
 
-  if (hSearch == INVALID_HANDLE_VALUE)
+  WCHAR szPath[MAX_PATH] = { 0 };
+  if (!MultiByteToWideChar(CP_UTF8, 0, pszPath, -1, szPath, MAX_PATH)) {
     return FALSE;
+  }
 
-  do {
-    /* Skip special paths */
-    if (
-      !wcscmp(ffd.cFileName, L".") ||
-      !wcscmp(ffd.cFileName, L"..") ||
-      ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY
-      )
-    {
-      continue;
-    }
+  return GetFileMIMEType(szPath) != MIME_UNKNOWN;
+}
 
-    /* Concatenate base path and filename */
-    StringCchCopy(szPath, MAX_PATH, szDir);
-    PathCchAppend(szPath, MAX_PATH, ffd.cFileName);
+/*
+ * IndexDirOfFile
+ * Point g_dirIndex at the directory of pszFile and bring it up to date.
+ * Returns the directory in pszDir (MAX_PATH) and the UTF-8 file name.
+ */
+BOOL IndexDirOfFile(PCWSTR pszFile, PWSTR pszDir, char* pszNameUtf8, int cbName)
+{
+  char szDirUtf8[MAX_PATH * 3] = { 0 };
+  LPWSTR pszFileName = NULL;
 
-    int mime = GetFileMIMEType(szPath);
-    if (!mime) {
-      continue;
-    }
+  /* Get file directory and name */
+  GetFullPathName(pszFile, MAX_PATH, pszDir, &pszFileName);
+  if (!pszFileName ||
+      !WideCharToMultiByte(CP_UTF8, 0, pszFileName, -1, pszNameUtf8, cbName, NULL, NULL)) {
+    return FALSE;
+  }
 
-    /* Make path string shared */
-    LPWSTR lpszPath = calloc(1, sizeof(szPath));
-    if (lpszPath) {
-      StringCchCopy(lpszPath, MAX_PATH, szPath);
-      size_t len;
-      StringCchLength(lpszPath, STRSAFE_MAX_CCH, &len);
+  PathCchRemoveFileSpec(pszDir, MAX_PATH);
+  if (!WideCharToMultiByte(CP_UTF8, 0, pszDir, -1, szDirUtf8, sizeof(szDirUtf8), NULL, NULL)) {
+    return FALSE;
+  }
 
-      /* Append path to list */
-      DoubleLinkList_AppendFront(&dirList, lpszPath, (len + 1) * sizeof(WCHAR), TRUE);
+  /*
+   * The directory is indexed once, in the background, later keypresses only
+   * pick up changes. Until the scan is over they also pick up what it found
+   * since and step among those files.
+   */
+  if (!g_dirIndex.pszDir || strcmp(g_dirIndex.pszDir, szDirUtf8)) {
+    if (DirIndex_OpenAsync(&g_dirIndex, szDirUtf8, ImageFileFilter, NULL, PaniViewApp_GetIOPool()) != DIRINDEX_OK) {
+      return FALSE;
     }
-  } while (FindNextFile(hSearch, &ffd));
-
-  FindClose(hSearch);
+  }
+  else if (DirIndex_Refresh(&g_dirIndex) < 0) {
+    return FALSE;
+  }
 
-  /* Sort the filenames in alphabetical order */
-  DoubleLinkList_Sort(&dirList);
+  return TRUE;
+}
 
-  PCWSTR pNextPathData = NULL;
-  for (DOUBLELINKLISTNODE *node = dirList.pBegin; node; node = node->pNext) {
-    if (!(wcscmp(node->pValue, pszCurrent))) {
-      if (fNext) {
-        if (node->pNext && node->pNext->pValue) {
-          pNextPathData = (PCWSTR) node->pNext->pValue;
-        }
-        else {
-          pNextPathData = (PCWSTR) dirList.pBegin->pValue;
-        }
-      }
-      else {
-        if (node->pPrev && node->pPrev->pValue) {
-          pNextPathData = (PCWSTR) node->pPrev->pValue;
-        }
-        else {
-          pNextPathData = (PCWSTR) dirList.pEnd->pValue;
-        }
-      }
+BOOL NextFileInDir(PWSTR pszCurrent, BOOL fNext, PWSTR lpPathOut) {
+  WCHAR szDir[MAX_PATH] = { 0 };
+  WCHAR szName[MAX_PATH] = { 0 };
+  char szNameUtf8[MAX_PATH * 3] = { 0 };
 
-      break;
-    }
+  if (!IndexDirOfFile(pszCurrent, szDir, szNameUtf8, sizeof(szNameUtf8))) {
+    return FALSE;
   }
 
-  if (pNextPathData) {
-    StringCchCopy(lpPathOut, MAX_PATH, pNextPathData);
+  const char* pszNext = DirIndex_Step(&g_dirIndex, szNameUtf8, fNext);
+  if (!pszNext || !MultiByteToWideChar(CP_UTF8, 0, pszNext, -1, szName, MAX_PATH)) {
+    return FALSE;
   }
 
-  /* Destroy the list */
-  for (DOUBLELINKLISTNODE *node = dirList.pBegin; node;) {
-    if (node->pNext) {
-      node->pNext->pPrev = NULL;
-    }
-
-    if (node->pValue) {
-      free(node->pValue);
-    }
-
-    DOUBLELINKLISTNODE *next = node->pNext;
-    free(node);
-    node = next;
-  }
+  /* Concatenate base path and filename */
+  StringCchCopy(lpPathOut, MAX_PATH, szDir);
+  PathCchAppend(lpPathOut, MAX_PATH, szName);
 
   return TRUE;
 }
@@ -0,0 +1,61 @@
+#include "perfcounter.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+uint64_t PerfCounter_Now(void)
+{
+#ifdef _WIN32
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER counter;
+  if (!freq.QuadPart) {
+    QueryPerformanceFrequency(&freq);
+  }
+  QueryPerformanceCounter(&counter);
+
+  /* Split so the multiplication cannot overflow on long uptimes */
+  uint64_t ticks = (uint64_t)counter.QuadPart;
+  uint64_t hz = (uint64_t)freq.QuadPart;
+  return (ticks / hz) * 1000000000u + (ticks % hz) * 1000000000u / hz;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+void PerfCounter_Reset(LPPERFCOUNTER pCounter)
+{
+  memset(pCounter, 0, sizeof(PERFCOUNTER));
+}
+
+void PerfCounter_Add(LPPERFCOUNTER pCounter, uint64_t ns)
+{
+  pCounter->count++;
+  pCounter->totalNs += ns;
+  pCounter->lastNs = ns;
+  if (ns > pCounter->maxNs) {
+    pCounter->maxNs = ns;
+  }
+}
+
+uint64_t PerfCounter_AddSince(LPPERFCOUNTER pCounter, uint64_t start)
+{
+  uint64_t now = PerfCounter_Now();
+  uint64_t ns = now > start ? now - start : 0;
+  PerfCounter_Add(pCounter, ns);
+  return ns;
+}
+
+uint64_t PerfCounter_GetMean(const PERFCOUNTER* pCounter)
+{
+  return pCounter->count ? pCounter->totalNs / pCounter->count : 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * perfcounter.h
+ *
+ * Timing counters for hot paths
+ *
+ * A counter accumulates the durations of one kind of event, e.g. a paint,
+ * as a count, a total, the longest and the last one, all in nanoseconds of
+ * a monotonic clock. Counters are plain structs, not synchronized; keep one
+ * per thread or guard it with the owner's lock.
+ */
+
+#ifndef PANIVIEW_PERFCOUNTER_H
+#define PANIVIEW_PERFCOUNTER_H
+
+#include <stdint.h>
+
+typedef struct _tagPERFCOUNTER PERFCOUNTER, *LPPERFCOUNTER;
+
+struct _tagPERFCOUNTER {
+  uint64_t count;
+  uint64_t totalNs;
+  uint64_t maxNs;
+  uint64_t lastNs;
+};
+
+/* Monotonic clock, only differences are meaningful */
+uint64_t PerfCounter_Now(void);
+
+void PerfCounter_Reset(LPPERFCOUNTER pCounter);
+void PerfCounter_Add(LPPERFCOUNTER pCounter, uint64_t ns);
+
+/* Adds the time elapsed since `start`, a PerfCounter_Now value; returns it */
+uint64_t PerfCounter_AddSince(LPPERFCOUNTER pCounter, uint64_t start);
+
+/* 0 when nothing was counted */
+uint64_t PerfCounter_GetMean(const PERFCOUNTER* pCounter);
+
+#endif /* PANIVIEW_PERFCOUNTER_H */
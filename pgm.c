@@ -0,0 +1,488 @@
+#include "pgm.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef UNIT_TESTING
+extern void* _test_malloc(const size_t size, const char* file, const int line);
+
+#define malloc(size) _test_malloc(size, __FILE__, __LINE__)
+
+extern void* _test_calloc(const size_t num, const size_t size, const char* file,
+  const int line);
+
+#define calloc(num, size) _test_calloc(num, size, __FILE__, __LINE__)
+
+extern void _test_free(void* const ptr, const char* file, const int line);
+
+#define free(ptr) _test_free(ptr, __FILE__, __LINE__)
+#endif
+
+/* Size of the input staging buffer. Rows larger than this are read directly
+ * into the destination. */
+#define PGM_BUFFER_SIZE 65536
+
+static int PGM_IsSpace(int c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static int PGM_IsDigit(int c)
+{
+  return c >= '0' && c <= '9';
+}
+
+size_t PGM_FileReadCallback(void* pUserData, void* pBuffer, size_t size)
+{
+  return fread(pBuffer, 1, size, (FILE*)pUserData);
+}
+
+void PGMDecoder_Init(LPPGMDECODER pDecoder, PGMREADFUNC pfnRead, void* pUserData)
+{
+  memset(pDecoder, 0, sizeof(PGMDECODER));
+  pDecoder->pfnRead = pfnRead;
+  pDecoder->pUserData = pUserData;
+}
+
+void PGMDecoder_InitFile(LPPGMDECODER pDecoder, FILE* fp)
+{
+  PGMDecoder_Init(pDecoder, PGM_FileReadCallback, fp);
+}
+
+/* The whole input is already in the buffer, so the read callback is never called */
+void PGMDecoder_InitMemory(LPPGMDECODER pDecoder, const void* pData, size_t size)
+{
+  PGMDecoder_Init(pDecoder, NULL, NULL);
+  pDecoder->pBuffer = (unsigned char*)pData;
+  pDecoder->nBufferFill = pData ? size : 0;
+  pDecoder->bEOF = 1;
+  pDecoder->bBorrowedBuffer = 1;
+}
+
+static int PGMDecoder_Fill(LPPGMDECODER pDecoder)
+{
+  if (pDecoder->nBufferPos < pDecoder->nBufferFill) {
+    return 1;
+  }
+
+  if (pDecoder->bEOF) {
+    return 0;
+  }
+
+  size_t nRead = pDecoder->pfnRead(pDecoder->pUserData, pDecoder->pBuffer, PGM_BUFFER_SIZE);
+  pDecoder->nBufferPos = 0;
+  pDecoder->nBufferFill = nRead;
+
+  if (!nRead) {
+    pDecoder->bEOF = 1;
+    return 0;
+  }
+
+  return 1;
+}
+
+static int PGMDecoder_GetByte(LPPGMDECODER pDecoder)
+{
+  if (!PGMDecoder_Fill(pDecoder)) {
+    return -1;
+  }
+
+  return pDecoder->pBuffer[pDecoder->nBufferPos++];
+}
+
+/*
+ * PGMDecoder_ReadBytes
+ *
+ * Copy `size` raw bytes of the stream into `pDest`. Whatever is left in the
+ * staging buffer goes first, large remainders bypass the buffer entirely.
+ * Returns the number of bytes delivered.
+ */
+static size_t PGMDecoder_ReadBytes(LPPGMDECODER pDecoder, unsigned char* pDest, size_t size)
+{
+  size_t nDone = 0;
+
+  while (nDone < size) {
+    size_t nAvail = pDecoder->nBufferFill - pDecoder->nBufferPos;
+
+    if (nAvail) {
+      size_t nCopy = size - nDone < nAvail ? size - nDone : nAvail;
+      memcpy(pDest + nDone, pDecoder->pBuffer + pDecoder->nBufferPos, nCopy);
+      pDecoder->nBufferPos += nCopy;
+      nDone += nCopy;
+    }
+    else if (pDecoder->bEOF) {
+      break;
+    }
+    else if (size - nDone >= PGM_BUFFER_SIZE) {
+      size_t nRead = pDecoder->pfnRead(pDecoder->pUserData, pDest + nDone, size - nDone);
+      if (!nRead) {
+        pDecoder->bEOF = 1;
+        break;
+      }
+      nDone += nRead;
+    }
+    else if (!PGMDecoder_Fill(pDecoder)) {
+      break;
+    }
+  }
+
+  return nDone;
+}
+
+/*
+ * PGMDecoder_ReadNumber
+ *
+ * Parse an unsigned decimal token, skipping leading whitespace and `#`
+ * comments. Exactly one terminating character is consumed, which is what
+ * the P5 header expects after the maxval field.
+ */
+static int PGMDecoder_ReadNumber(LPPGMDECODER pDecoder, uint64_t limit, uint64_t* pValue)
+{
+  int c;
+
+  for (;;) {
+    c = PGMDecoder_GetByte(pDecoder);
+    if (c < 0) {
+      return PGM_ERROR_TRUNCATED;
+    }
+
+    if (c == '#') {
+      do {
+        c = PGMDecoder_GetByte(pDecoder);
+      } while (c >= 0 && c != '\n' && c != '\r');
+      continue;
+    }
+
+    if (!PGM_IsSpace(c)) {
+      break;
+    }
+  }
+
+  if (!PGM_IsDigit(c)) {
+    return PGM_ERROR_FORMAT;
+  }
+
+  uint64_t value = 0;
+  while (PGM_IsDigit(c)) {
+    uint64_t digit = (uint64_t)(c - '0');
+    if (value > (limit - digit) / 10) {
+      return PGM_ERROR_UNSUPPORTED;
+    }
+
+    value = value * 10 + digit;
+
+    c = PGMDecoder_GetByte(pDecoder);
+  }
+
+  if (c == '#') {
+    do {
+      c = PGMDecoder_GetByte(pDecoder);
+    } while (c >= 0 && c != '\n' && c != '\r');
+  }
+  else if (c >= 0 && !PGM_IsSpace(c)) {
+    return PGM_ERROR_FORMAT;
+  }
+
+  *pValue = value;
+  return PGM_OK;
+}
+
+int PGMDecoder_ReadHeader(LPPGMDECODER pDecoder)
+{
+  if (pDecoder->bHeaderRead) {
+    return PGM_ERROR_STATE;
+  }
+
+  if (!pDecoder->pBuffer && !pDecoder->bBorrowedBuffer) {
+    pDecoder->pBuffer = (unsigned char*)malloc(PGM_BUFFER_SIZE);
+    if (!pDecoder->pBuffer) {
+      return PGM_ERROR_MEMORY;
+    }
+  }
+
+  int c1 = PGMDecoder_GetByte(pDecoder);
+  int c2 = PGMDecoder_GetByte(pDecoder);
+  if (c1 < 0 || c2 < 0) {
+    return PGM_ERROR_TRUNCATED;
+  }
+
+  if (c1 != 'P' || (c2 != '2' && c2 != '5')) {
+    return PGM_ERROR_FORMAT;
+  }
+
+  PGMHEADER header = { 0 };
+  header.nEncoding = c2 == '2' ? PGM_ENCODING_ASCII : PGM_ENCODING_BINARY;
+
+  uint64_t maxval = 0;
+  int status;
+
+  status = PGMDecoder_ReadNumber(pDecoder, UINT64_MAX, &header.width);
+  if (status == PGM_OK) {
+    status = PGMDecoder_ReadNumber(pDecoder, UINT64_MAX, &header.height);
+  }
+  if (status == PGM_OK) {
+    status = PGMDecoder_ReadNumber(pDecoder, 65535, &maxval);
+  }
+  if (status != PGM_OK) {
+    return status;
+  }
+
+  if (!header.width || !header.height || !maxval) {
+    return PGM_ERROR_FORMAT;
+  }
+
+  /* A 16-bit row must be addressable and the whole frame must be sizeable */
+  if (header.width > SIZE_MAX / 2 || header.height > UINT64_MAX / 2 / header.width) {
+    return PGM_ERROR_UNSUPPORTED;
+  }
+
+  header.maxval = (unsigned int)maxval;
+
+  pDecoder->header = header;
+  pDecoder->nRow = 0;
+  pDecoder->bHeaderRead = 1;
+
+  return PGM_OK;
+}
+
+size_t PGMDecoder_GetRowSize(LPPGMDECODER pDecoder, int nOutputFormat)
+{
+  size_t width = (size_t)pDecoder->header.width;
+
+  return nOutputFormat == PGM_OUTPUT_GRAY16 ? width * 2 : width;
+}
+
+/*
+ * PGMDecoder_PrepareScaleTable
+ *
+ * Build the maxval -> output range lookup table. Returns PGM_OK without a
+ * table when samples already span the full output range.
+ */
+static int PGMDecoder_PrepareScaleTable(LPPGMDECODER pDecoder, int nOutputFormat)
+{
+  unsigned int maxval = pDecoder->header.maxval;
+
+  if ((nOutputFormat == PGM_OUTPUT_GRAY8 && maxval == 255) ||
+      (nOutputFormat == PGM_OUTPUT_GRAY16 && maxval == 65535)) {
+    free(pDecoder->pScaleTable);
+    pDecoder->pScaleTable = NULL;
+    return PGM_OK;
+  }
+
+  if (pDecoder->pScaleTable && pDecoder->nScaleTableFormat == nOutputFormat) {
+    return PGM_OK;
+  }
+
+  free(pDecoder->pScaleTable);
+  pDecoder->pScaleTable = NULL;
+
+  if (nOutputFormat == PGM_OUTPUT_GRAY8) {
+    uint8_t* pTable = (uint8_t*)malloc((size_t)maxval + 1);
+    if (!pTable) {
+      return PGM_ERROR_MEMORY;
+    }
+
+    for (unsigned int v = 0; v <= maxval; ++v) {
+      pTable[v] = (uint8_t)((v * 255u + maxval / 2) / maxval);
+    }
+
+    pDecoder->pScaleTable = pTable;
+  }
+  else {
+    uint16_t* pTable = (uint16_t*)malloc(((size_t)maxval + 1) * sizeof(uint16_t));
+    if (!pTable) {
+      return PGM_ERROR_MEMORY;
+    }
+
+    for (unsigned int v = 0; v <= maxval; ++v) {
+      pTable[v] = (uint16_t)(((uint64_t)v * 65535u + maxval / 2) / maxval);
+    }
+
+    pDecoder->pScaleTable = pTable;
+  }
+
+  pDecoder->nScaleTableFormat = nOutputFormat;
+  return PGM_OK;
+}
+
+static void PGMDecoder_StoreSample(LPPGMDECODER pDecoder, void* pRow, size_t x, unsigned int v, int nOutputFormat)
+{
+  unsigned int maxval = pDecoder->header.maxval;
+
+  if (v > maxval) {
+    v = maxval;
+  }
+
+  if (nOutputFormat == PGM_OUTPUT_GRAY16) {
+    const uint16_t* pTable = (const uint16_t*)pDecoder->pScaleTable;
+    ((uint16_t*)pRow)[x] = pTable ? pTable[v] : (uint16_t)v;
+  }
+  else {
+    const uint8_t* pTable = (const uint8_t*)pDecoder->pScaleTable;
+    ((uint8_t*)pRow)[x] = pTable ? pTable[v] : (uint8_t)v;
+  }
+}
+
+static int PGMDecoder_ReadRowASCII(LPPGMDECODER pDecoder, void* pRow, int nOutputFormat)
+{
+  size_t width = (size_t)pDecoder->header.width;
+
+  for (size_t x = 0; x < width; ++x) {
+    uint64_t v;
+    int status = PGMDecoder_ReadNumber(pDecoder, 65535, &v);
+    if (status != PGM_OK) {
+      return status;
+    }
+
+    PGMDecoder_StoreSample(pDecoder, pRow, x, (unsigned int)v, nOutputFormat);
+  }
+
+  return PGM_OK;
+}
+
+static int PGMDecoder_ReadRowBinary(LPPGMDECODER pDecoder, void* pRow, int nOutputFormat)
+{
+  size_t width = (size_t)pDecoder->header.width;
+  unsigned int maxval = pDecoder->header.maxval;
+
+  if (maxval < 256) {
+    /* One byte per sample; read straight into the destination row */
+    uint8_t* pSrc = (uint8_t*)pRow;
+    if (PGMDecoder_ReadBytes(pDecoder, pSrc, width) != width) {
+      return PGM_ERROR_TRUNCATED;
+    }
+
+    if (nOutputFormat == PGM_OUTPUT_GRAY16) {
+      /* Widen in place, back to front so no sample is overwritten early */
+      for (size_t x = width; x-- > 0;) {
+        PGMDecoder_StoreSample(pDecoder, pRow, x, pSrc[x], nOutputFormat);
+      }
+    }
+    else if (pDecoder->pScaleTable) {
+      for (size_t x = 0; x < width; ++x) {
+        PGMDecoder_StoreSample(pDecoder, pRow, x, pSrc[x], nOutputFormat);
+      }
+    }
+
+    return PGM_OK;
+  }
+
+  /* Two big-endian bytes per sample */
+  uint8_t* pSrc = (uint8_t*)pRow;
+  if (nOutputFormat == PGM_OUTPUT_GRAY8) {
+    if (!pDecoder->pScratchRow) {
+      pDecoder->pScratchRow = (unsigned char*)malloc(width * 2);
+      if (!pDecoder->pScratchRow) {
+        return PGM_ERROR_MEMORY;
+      }
+    }
+
+    pSrc = pDecoder->pScratchRow;
+  }
+
+  if (PGMDecoder_ReadBytes(pDecoder, pSrc, width * 2) != width * 2) {
+    return PGM_ERROR_TRUNCATED;
+  }
+
+  for (size_t x = 0; x < width; ++x) {
+    unsigned int v = ((unsigned int)pSrc[x * 2] << 8) | pSrc[x * 2 + 1];
+    PGMDecoder_StoreSample(pDecoder, pRow, x, v, nOutputFormat);
+  }
+
+  return PGM_OK;
+}
+
+/*
+ * PGMDecoder_ReadRows
+ *
+ * Decode up to `nRows` rows into `pDest`, one row every `destStride` bytes.
+ * May be called repeatedly until all rows are delivered; the number of rows
+ * actually written is stored into `pnRowsRead` even when an error is
+ * returned, so a truncated file still yields its leading rows.
+ */
+int PGMDecoder_ReadRows(LPPGMDECODER pDecoder, void* pDest, size_t destStride, size_t nRows, int nOutputFormat, size_t* pnRowsRead)
+{
+  if (pnRowsRead) {
+    *pnRowsRead = 0;
+  }
+
+  if (!pDecoder->bHeaderRead) {
+    return PGM_ERROR_STATE;
+  }
+
+  if (nOutputFormat != PGM_OUTPUT_GRAY8 && nOutputFormat != PGM_OUTPUT_GRAY16) {
+    return PGM_ERROR_UNSUPPORTED;
+  }
+
+  int status = PGMDecoder_PrepareScaleTable(pDecoder, nOutputFormat);
+  if (status != PGM_OK) {
+    return status;
+  }
+
+  uint64_t nRemaining = pDecoder->header.height - pDecoder->nRow;
+  if ((uint64_t)nRows > nRemaining) {
+    nRows = (size_t)nRemaining;
+  }
+
+  unsigned char* pRow = (unsigned char*)pDest;
+  for (size_t i = 0; i < nRows; ++i) {
+    if (pDecoder->header.nEncoding == PGM_ENCODING_ASCII) {
+      status = PGMDecoder_ReadRowASCII(pDecoder, pRow, nOutputFormat);
+    }
+    else {
+      status = PGMDecoder_ReadRowBinary(pDecoder, pRow, nOutputFormat);
+    }
+
+    if (status != PGM_OK) {
+      return status;
+    }
+
+    pDecoder->nRow++;
+    if (pnRowsRead) {
+      (*pnRowsRead)++;
+    }
+
+    pRow += destStride;
+  }
+
+  return PGM_OK;
+}
+
+/*
+ * PGMDecoder_GetRawRows
+ *
+ * The rows not yet delivered, as they lie in memory, for a decoder reading
+ * from memory a binary file whose samples need no conversion to GRAY8.
+ * `pnRows` receives how many whole rows are present, fewer than remain when
+ * the file is truncated. Nothing is consumed. Returns NULL when the rows
+ * cannot be used in place.
+ */
+const unsigned char* PGMDecoder_GetRawRows(LPPGMDECODER pDecoder, size_t* pnRows)
+{
+  *pnRows = 0;
+
+  if (!pDecoder->bHeaderRead || !pDecoder->bBorrowedBuffer ||
+      pDecoder->header.nEncoding != PGM_ENCODING_BINARY || pDecoder->header.maxval != 255) {
+    return NULL;
+  }
+
+  size_t width = (size_t)pDecoder->header.width;
+  uint64_t nRows = (pDecoder->nBufferFill - pDecoder->nBufferPos) / width;
+  uint64_t nRemaining = pDecoder->header.height - pDecoder->nRow;
+
+  *pnRows = (size_t)(nRows < nRemaining ? nRows : nRemaining);
+  return pDecoder->pBuffer + pDecoder->nBufferPos;
+}
+
+void PGMDecoder_Cleanup(LPPGMDECODER pDecoder)
+{
+  if (!pDecoder->bBorrowedBuffer) {
+    free(pDecoder->pBuffer);
+  }
+  free(pDecoder->pScaleTable);
+  free(pDecoder->pScratchRow);
+
+  pDecoder->pBuffer = NULL;
+  pDecoder->pScaleTable = NULL;
+  pDecoder->pScratchRow = NULL;
+}
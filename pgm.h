@@ -0,0 +1,93 @@
+/*
+ * pgm.h
+ *
+ * Streaming Netpbm PGM (P2/P5) decoder
+ *
+ * The decoder pulls bytes through a read callback and delivers the raster
+ * row by row straight into the caller's buffer, so a frame never has to be
+ * held twice in memory and the first rows are available before the rest of
+ * the file has been read.
+ *
+ * A file already mapped into memory can be decoded in place instead: the
+ * mapping then serves as the staging buffer, and the raw rows of an 8-bit
+ * binary file can be used as they lie without being copied at all.
+ */
+
+#ifndef PANIVIEW_PGM_H
+#define PANIVIEW_PGM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct _tagPGMHEADER PGMHEADER, *LPPGMHEADER;
+typedef struct _tagPGMDECODER PGMDECODER, *LPPGMDECODER;
+
+/*
+ * Read callback. Returns the number of bytes stored into `pBuffer`, zero on
+ * end of stream or error.
+ */
+typedef size_t (*PGMREADFUNC)(void* pUserData, void* pBuffer, size_t size);
+
+enum {
+  PGM_OK = 0,
+  PGM_ERROR_IO = -1,
+  PGM_ERROR_FORMAT = -2,
+  PGM_ERROR_UNSUPPORTED = -3,
+  PGM_ERROR_MEMORY = -4,
+  PGM_ERROR_TRUNCATED = -5,
+  PGM_ERROR_STATE = -6,
+};
+
+enum {
+  PGM_ENCODING_ASCII = 2,   /* P2 */
+  PGM_ENCODING_BINARY = 5,  /* P5 */
+};
+
+enum {
+  PGM_OUTPUT_GRAY8 = 1,   /* Samples rescaled to 0..255 */
+  PGM_OUTPUT_GRAY16 = 2,  /* Native-endian samples rescaled to 0..65535 */
+};
+
+struct _tagPGMHEADER {
+  int nEncoding;
+  uint64_t width;
+  uint64_t height;
+  unsigned int maxval;
+};
+
+struct _tagPGMDECODER {
+  PGMREADFUNC pfnRead;
+  void* pUserData;
+
+  PGMHEADER header;
+  uint64_t nRow;      /* Next row to be delivered */
+  int bHeaderRead;
+
+  /* Input staging buffer */
+  unsigned char* pBuffer;
+  size_t nBufferPos;
+  size_t nBufferFill;
+  int bEOF;
+  int bBorrowedBuffer;  /* pBuffer is the caller's memory, never written */
+
+  /* Sample rescaling table, built lazily for the requested output */
+  void* pScaleTable;
+  int nScaleTableFormat;
+
+  /* Scratch row for 16-bit to 8-bit narrowing */
+  unsigned char* pScratchRow;
+};
+
+void PGMDecoder_Init(LPPGMDECODER pDecoder, PGMREADFUNC pfnRead, void* pUserData);
+void PGMDecoder_InitFile(LPPGMDECODER pDecoder, FILE* fp);
+void PGMDecoder_InitMemory(LPPGMDECODER pDecoder, const void* pData, size_t size);
+int PGMDecoder_ReadHeader(LPPGMDECODER pDecoder);
+size_t PGMDecoder_GetRowSize(LPPGMDECODER pDecoder, int nOutputFormat);
+int PGMDecoder_ReadRows(LPPGMDECODER pDecoder, void* pDest, size_t destStride, size_t nRows, int nOutputFormat, size_t* pnRowsRead);
+const unsigned char* PGMDecoder_GetRawRows(LPPGMDECODER pDecoder, size_t* pnRows);
+void PGMDecoder_Cleanup(LPPGMDECODER pDecoder);
+
+size_t PGM_FileReadCallback(void* pUserData, void* pBuffer, size_t size);
+
+#endif /* PANIVIEW_PGM_H */
@@ -0,0 +1,157 @@
+#include "pixbuf.h"
+#include "pixconv.h"
+#include "thread.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef UNIT_TESTING
+extern void* _test_malloc(const size_t size, const char* file, const int line);
+
+#define malloc(size) _test_malloc(size, __FILE__, __LINE__)
+
+extern void* _test_calloc(const size_t num, const size_t size, const char* file,
+  const int line);
+
+#define calloc(num, size) _test_calloc(num, size, __FILE__, __LINE__)
+
+extern void* _test_realloc(void* const ptr, const size_t size, const char* file,
+  const int line);
+
+#define realloc(ptr, size) _test_realloc(ptr, size, __FILE__, __LINE__)
+
+extern void _test_free(void* const ptr, const char* file, const int line);
+
+#define free(ptr) _test_free(ptr, __FILE__, __LINE__)
+#endif
+
+/* The block malloc returned is kept just below the aligned pixels */
+static void* PixBuf_HeapAlloc(const PIXBUF* pPixBuf, void** ppHandle, void* pUserData)
+{
+  (void)ppHandle;
+  (void)pUserData;
+
+  size_t size = pPixBuf->stride * pPixBuf->height;
+  if (size > SIZE_MAX - PIXBUF_ALIGNMENT - sizeof(void*)) {
+    return NULL;
+  }
+
+  unsigned char* pBlock = (unsigned char*)malloc(size + PIXBUF_ALIGNMENT + sizeof(void*));
+  if (!pBlock) {
+    return NULL;
+  }
+
+  uintptr_t data = ((uintptr_t)pBlock + sizeof(void*) + PIXBUF_ALIGNMENT - 1) & ~(uintptr_t)(PIXBUF_ALIGNMENT - 1);
+  ((void**)data)[-1] = pBlock;
+  return (void*)data;
+}
+
+static void PixBuf_HeapFree(void* pData, void* pHandle, void* pUserData)
+{
+  (void)pHandle;
+  (void)pUserData;
+
+  free(((void**)pData)[-1]);
+}
+
+int PixBuf_Create(size_t width, size_t height, int nFormat, const PIXBUFALLOCATOR* pAllocator,
+    LPPIXBUF* ppPixBuf)
+{
+  *ppPixBuf = NULL;
+
+  size_t nBytesPerPixel = (size_t)PixConv_GetBytesPerPixel(nFormat);
+  if (!width || !height || !nBytesPerPixel || width > (SIZE_MAX - 3) / nBytesPerPixel) {
+    return PIXBUF_ERROR_INVALID;
+  }
+
+  size_t stride = (width * nBytesPerPixel + 3) & ~(size_t)3;
+  if (height > SIZE_MAX / stride) {
+    return PIXBUF_ERROR_INVALID;
+  }
+
+  LPPIXBUF pPixBuf = (LPPIXBUF)calloc(1, sizeof(PIXBUF));
+  if (!pPixBuf) {
+    return PIXBUF_ERROR_MEMORY;
+  }
+
+  pPixBuf->nRefs = 1;
+  pPixBuf->width = width;
+  pPixBuf->height = height;
+  pPixBuf->stride = stride;
+  pPixBuf->nFormat = nFormat;
+
+  if (pAllocator) {
+    pPixBuf->allocator = *pAllocator;
+  }
+  else {
+    pPixBuf->allocator.pfnAlloc = PixBuf_HeapAlloc;
+    pPixBuf->allocator.pfnFree = PixBuf_HeapFree;
+  }
+
+  pPixBuf->pData = (unsigned char*)pPixBuf->allocator.pfnAlloc(pPixBuf, &pPixBuf->pHandle,
+      pPixBuf->allocator.pUserData);
+  if (!pPixBuf->pData) {
+    free(pPixBuf);
+    return PIXBUF_ERROR_MEMORY;
+  }
+
+  *ppPixBuf = pPixBuf;
+  return PIXBUF_OK;
+}
+
+static void PixBuf_BorrowedFree(void* pData, void* pHandle, void* pUserData)
+{
+  (void)pData;
+  (void)pHandle;
+  (void)pUserData;
+}
+
+int PixBuf_Wrap(void* pData, size_t width, size_t height, size_t stride, int nFormat,
+    const PIXBUFALLOCATOR* pAllocator, LPPIXBUF* ppPixBuf)
+{
+  *ppPixBuf = NULL;
+
+  size_t nBytesPerPixel = (size_t)PixConv_GetBytesPerPixel(nFormat);
+  if (!pData || !width || !height || !nBytesPerPixel || width > SIZE_MAX / nBytesPerPixel ||
+      stride < width * nBytesPerPixel || height > SIZE_MAX / stride) {
+    return PIXBUF_ERROR_INVALID;
+  }
+
+  LPPIXBUF pPixBuf = (LPPIXBUF)calloc(1, sizeof(PIXBUF));
+  if (!pPixBuf) {
+    return PIXBUF_ERROR_MEMORY;
+  }
+
+  pPixBuf->nRefs = 1;
+  pPixBuf->pData = (unsigned char*)pData;
+  pPixBuf->width = width;
+  pPixBuf->height = height;
+  pPixBuf->stride = stride;
+  pPixBuf->nFormat = nFormat;
+
+  if (pAllocator) {
+    pPixBuf->allocator = *pAllocator;
+  }
+  else {
+    pPixBuf->allocator.pfnFree = PixBuf_BorrowedFree;
+  }
+
+  *ppPixBuf = pPixBuf;
+  return PIXBUF_OK;
+}
+
+LPPIXBUF PixBuf_AddRef(LPPIXBUF pPixBuf)
+{
+  Atomic_Increment(&pPixBuf->nRefs);
+  return pPixBuf;
+}
+
+void PixBuf_Release(LPPIXBUF pPixBuf)
+{
+  if (!pPixBuf || Atomic_Decrement(&pPixBuf->nRefs) > 0) {
+    return;
+  }
+
+  pPixBuf->allocator.pfnFree(pPixBuf->pData, pPixBuf->pHandle, pPixBuf->allocator.pUserData);
+  free(pPixBuf);
+}
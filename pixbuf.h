@@ -0,0 +1,72 @@
+/*
+ * pixbuf.h
+ *
+ * Reference-counted pixel buffers with pluggable storage
+ *
+ * A pixel buffer is the memory a decoder writes an image into and every
+ * consumer reads it from, so pixels are produced once and not copied on the
+ * way to the screen. Where the memory comes from is up to an allocator:
+ * aligned heap memory by default, or e.g. a DIB section a renderer can blit
+ * from as is, in which case the allocator hands back its native handle
+ * along with the pixels. Pixels that already exist elsewhere, e.g. the raw
+ * rows of a mapped file, can be wrapped as they are. Buffers are shared by the loader, the image cache
+ * and the renderer, and freed with the last reference, on any thread.
+ */
+
+#ifndef PANIVIEW_PIXBUF_H
+#define PANIVIEW_PIXBUF_H
+
+#include <stddef.h>
+
+enum {
+  PIXBUF_OK = 0,
+  PIXBUF_ERROR_MEMORY = -1,
+  PIXBUF_ERROR_INVALID = -2,
+};
+
+/* Start of the pixels in heap buffers, enough for any SIMD load */
+#define PIXBUF_ALIGNMENT 64
+
+typedef struct _tagPIXBUF PIXBUF, *LPPIXBUF;
+typedef struct _tagPIXBUFALLOCATOR PIXBUFALLOCATOR, *LPPIXBUFALLOCATOR;
+
+struct _tagPIXBUFALLOCATOR {
+  /*
+   * Returns memory for pPixBuf->height rows of pPixBuf->stride bytes, or
+   * NULL. May store a native handle owning that memory in *ppHandle.
+   */
+  void* (*pfnAlloc)(const PIXBUF* pPixBuf, void** ppHandle, void* pUserData);
+  void (*pfnFree)(void* pData, void* pHandle, void* pUserData);
+  void* pUserData;
+};
+
+struct _tagPIXBUF {
+  volatile long nRefs;
+  unsigned char* pData;
+  size_t width;
+  size_t height;
+  size_t stride;              /* Row size rounded up to 4 bytes, as DIBs want, unless wrapped */
+  int nFormat;                /* PIXFMT_* */
+  void* pHandle;              /* From the allocator, NULL for heap memory */
+  PIXBUFALLOCATOR allocator;
+};
+
+/* A NULL allocator takes aligned heap memory. The buffer starts with one reference. */
+int PixBuf_Create(size_t width, size_t height, int nFormat, const PIXBUFALLOCATOR* pAllocator,
+    LPPIXBUF* ppPixBuf);
+/*
+ * Wrap rows of existing pixels, which must stay valid until the allocator's
+ * pfnFree is called on the last release; pfnAlloc is not used. A NULL
+ * allocator leaves the memory to the caller.
+ */
+int PixBuf_Wrap(void* pData, size_t width, size_t height, size_t stride, int nFormat,
+    const PIXBUFALLOCATOR* pAllocator, LPPIXBUF* ppPixBuf);
+LPPIXBUF PixBuf_AddRef(LPPIXBUF pPixBuf);
+void PixBuf_Release(LPPIXBUF pPixBuf);
+
+static inline unsigned char* PixBuf_GetRow(const PIXBUF* pPixBuf, size_t y)
+{
+  return pPixBuf->pData + y * pPixBuf->stride;
+}
+
+#endif /* PANIVIEW_PIXBUF_H */
@@ -0,0 +1,677 @@
+#include "pixconv.h"
+#include "thread.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PIXCONV_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+/* GCC and Clang only emit vector instructions for functions explicitly
+ * targeting the extension; MSVC accepts the intrinsics anywhere. */
+#if defined(PIXCONV_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PIXCONV_TARGET_SSE2 __attribute__((target("sse2")))
+#define PIXCONV_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PIXCONV_TARGET_SSE2
+#define PIXCONV_TARGET_AVX2
+#endif
+
+/* Detected by whichever thread converts first, so accessed atomically */
+static volatile long g_nPixConvIsa = -1;
+
+int PixConv_GetBytesPerPixel(int nFormat)
+{
+  switch (nFormat) {
+  case PIXFMT_GRAY8:
+    return 1;
+  case PIXFMT_GRAY16:
+    return 2;
+  case PIXFMT_RGB24:
+  case PIXFMT_BGR24:
+    return 3;
+  case PIXFMT_RGBA32:
+  case PIXFMT_BGRA32:
+  case PIXFMT_PBGRA32:
+    return 4;
+  }
+
+  return 0;
+}
+
+/*
+ * PixConv_MulDiv255
+ *
+ * Exact round(c * a / 255) without a division
+ */
+static inline uint8_t PixConv_MulDiv255(unsigned int c, unsigned int a)
+{
+  unsigned int t = c * a + 128;
+  return (uint8_t)((t + (t >> 8)) >> 8);
+}
+
+static inline uint8_t PixConv_Unpremultiply(unsigned int c, unsigned int a)
+{
+  unsigned int v = (c * 255 + a / 2) / a;
+  return (uint8_t)(v > 255 ? 255 : v);
+}
+
+/*******************
+ *  Scalar kernels *
+ *******************/
+
+static void PixConv_Gray8ToPBGRA_Scalar(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+
+  for (size_t i = 0; i < nPixels; ++i, d += 4) {
+    d[0] = d[1] = d[2] = s[i];
+    d[3] = 0xFF;
+  }
+}
+
+static void PixConv_Gray16ToPBGRA_Scalar(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint16_t* s = (const uint16_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+
+  for (size_t i = 0; i < nPixels; ++i, d += 4) {
+    d[0] = d[1] = d[2] = (uint8_t)(s[i] >> 8);
+    d[3] = 0xFF;
+  }
+}
+
+static void PixConv_RGB24ToPBGRA_Scalar(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+
+  for (size_t i = 0; i < nPixels; ++i, s += 3, d += 4) {
+    d[0] = s[2];
+    d[1] = s[1];
+    d[2] = s[0];
+    d[3] = 0xFF;
+  }
+}
+
+static void PixConv_BGR24ToPBGRA_Scalar(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+
+  for (size_t i = 0; i < nPixels; ++i, s += 3, d += 4) {
+    d[0] = s[0];
+    d[1] = s[1];
+    d[2] = s[2];
+    d[3] = 0xFF;
+  }
+}
+
+static void PixConv_RGBAToPBGRA_Scalar(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+
+  for (size_t i = 0; i < nPixels; ++i, s += 4, d += 4) {
+    uint8_t a = s[3];
+    d[0] = PixConv_MulDiv255(s[2], a);
+    d[1] = PixConv_MulDiv255(s[1], a);
+    d[2] = PixConv_MulDiv255(s[0], a);
+    d[3] = a;
+  }
+}
+
+static void PixConv_BGRAToPBGRA_Scalar(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+
+  for (size_t i = 0; i < nPixels; ++i, s += 4, d += 4) {
+    uint8_t a = s[3];
+    d[0] = PixConv_MulDiv255(s[0], a);
+    d[1] = PixConv_MulDiv255(s[1], a);
+    d[2] = PixConv_MulDiv255(s[2], a);
+    d[3] = a;
+  }
+}
+
+static void PixConv_Copy32_Scalar(const void* pSrc, void* pDst, size_t nPixels)
+{
+  memcpy(pDst, pSrc, nPixels * 4);
+}
+
+static void PixConv_PBGRAToGray8_Scalar(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+
+  /* BT.601 luma; weights sum to 256 so gray survives a round trip */
+  for (size_t i = 0; i < nPixels; ++i, s += 4) {
+    d[i] = (uint8_t)((29u * s[0] + 150u * s[1] + 77u * s[2] + 128u) >> 8);
+  }
+}
+
+static void PixConv_PBGRAToGray16_Scalar(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint16_t* d = (uint16_t*)pDst;
+
+  for (size_t i = 0; i < nPixels; ++i, s += 4) {
+    d[i] = (uint16_t)(((29u * s[0] + 150u * s[1] + 77u * s[2] + 128u) >> 8) * 257u);
+  }
+}
+
+static void PixConv_PBGRAToRGB24_Scalar(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+
+  for (size_t i = 0; i < nPixels; ++i, s += 4, d += 3) {
+    d[0] = s[2];
+    d[1] = s[1];
+    d[2] = s[0];
+  }
+}
+
+static void PixConv_PBGRAToBGR24_Scalar(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+
+  for (size_t i = 0; i < nPixels; ++i, s += 4, d += 3) {
+    d[0] = s[0];
+    d[1] = s[1];
+    d[2] = s[2];
+  }
+}
+
+static void PixConv_PBGRAToRGBA_Scalar(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+
+  for (size_t i = 0; i < nPixels; ++i, s += 4, d += 4) {
+    uint8_t a = s[3];
+    if (a == 0xFF) {
+      d[0] = s[2];
+      d[1] = s[1];
+      d[2] = s[0];
+    }
+    else if (a) {
+      d[0] = PixConv_Unpremultiply(s[2], a);
+      d[1] = PixConv_Unpremultiply(s[1], a);
+      d[2] = PixConv_Unpremultiply(s[0], a);
+    }
+    else {
+      d[0] = d[1] = d[2] = 0;
+    }
+    d[3] = a;
+  }
+}
+
+static void PixConv_PBGRAToBGRA_Scalar(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+
+  for (size_t i = 0; i < nPixels; ++i, s += 4, d += 4) {
+    uint8_t a = s[3];
+    if (a == 0xFF) {
+      d[0] = s[0];
+      d[1] = s[1];
+      d[2] = s[2];
+    }
+    else if (a) {
+      d[0] = PixConv_Unpremultiply(s[0], a);
+      d[1] = PixConv_Unpremultiply(s[1], a);
+      d[2] = PixConv_Unpremultiply(s[2], a);
+    }
+    else {
+      d[0] = d[1] = d[2] = 0;
+    }
+    d[3] = a;
+  }
+}
+
+#ifdef PIXCONV_X86
+
+/*****************
+ *  SSE2 kernels *
+ *****************/
+
+/* Store 16 gray samples as 16 opaque BGRA pixels */
+PIXCONV_TARGET_SSE2
+static inline void PixConv_ExpandGray_SSE2(__m128i g, uint8_t* d)
+{
+  const __m128i ones = _mm_set1_epi8(-1);
+
+  __m128i ggLo = _mm_unpacklo_epi8(g, g);
+  __m128i ggHi = _mm_unpackhi_epi8(g, g);
+  __m128i gaLo = _mm_unpacklo_epi8(g, ones);
+  __m128i gaHi = _mm_unpackhi_epi8(g, ones);
+
+  _mm_storeu_si128((__m128i*)(d + 0), _mm_unpacklo_epi16(ggLo, gaLo));
+  _mm_storeu_si128((__m128i*)(d + 16), _mm_unpackhi_epi16(ggLo, gaLo));
+  _mm_storeu_si128((__m128i*)(d + 32), _mm_unpacklo_epi16(ggHi, gaHi));
+  _mm_storeu_si128((__m128i*)(d + 48), _mm_unpackhi_epi16(ggHi, gaHi));
+}
+
+/* Premultiply two pixels widened to 16-bit lanes, keeping alpha intact */
+PIXCONV_TARGET_SSE2
+static inline __m128i PixConv_Premultiply_SSE2(__m128i px)
+{
+  const __m128i round = _mm_set1_epi16(128);
+  const __m128i alphaMask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+  __m128i a = _mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+  a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+
+  __m128i t = _mm_add_epi16(_mm_mullo_epi16(px, a), round);
+  t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+
+  return _mm_or_si128(_mm_andnot_si128(alphaMask, t), _mm_and_si128(alphaMask, px));
+}
+
+PIXCONV_TARGET_SSE2
+static void PixConv_Gray8ToPBGRA_SSE2(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+  size_t i = 0;
+
+  for (; i + 16 <= nPixels; i += 16) {
+    PixConv_ExpandGray_SSE2(_mm_loadu_si128((const __m128i*)(s + i)), d + i * 4);
+  }
+
+  PixConv_Gray8ToPBGRA_Scalar(s + i, d + i * 4, nPixels - i);
+}
+
+PIXCONV_TARGET_SSE2
+static void PixConv_Gray16ToPBGRA_SSE2(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint16_t* s = (const uint16_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+  size_t i = 0;
+
+  for (; i + 16 <= nPixels; i += 16) {
+    __m128i lo = _mm_srli_epi16(_mm_loadu_si128((const __m128i*)(s + i)), 8);
+    __m128i hi = _mm_srli_epi16(_mm_loadu_si128((const __m128i*)(s + i + 8)), 8);
+    PixConv_ExpandGray_SSE2(_mm_packus_epi16(lo, hi), d + i * 4);
+  }
+
+  PixConv_Gray16ToPBGRA_Scalar(s + i, d + i * 4, nPixels - i);
+}
+
+PIXCONV_TARGET_SSE2
+static void PixConv_BGRAToPBGRA_SSE2(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+
+  for (; i + 4 <= nPixels; i += 4) {
+    __m128i px = _mm_loadu_si128((const __m128i*)(s + i * 4));
+    __m128i lo = PixConv_Premultiply_SSE2(_mm_unpacklo_epi8(px, zero));
+    __m128i hi = PixConv_Premultiply_SSE2(_mm_unpackhi_epi8(px, zero));
+    _mm_storeu_si128((__m128i*)(d + i * 4), _mm_packus_epi16(lo, hi));
+  }
+
+  PixConv_BGRAToPBGRA_Scalar(s + i * 4, d + i * 4, nPixels - i);
+}
+
+PIXCONV_TARGET_SSE2
+static void PixConv_RGBAToPBGRA_SSE2(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+
+  for (; i + 4 <= nPixels; i += 4) {
+    __m128i px = _mm_loadu_si128((const __m128i*)(s + i * 4));
+    __m128i lo = _mm_unpacklo_epi8(px, zero);
+    __m128i hi = _mm_unpackhi_epi8(px, zero);
+
+    /* Swap R and B lanes */
+    lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+    hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+
+    lo = PixConv_Premultiply_SSE2(lo);
+    hi = PixConv_Premultiply_SSE2(hi);
+    _mm_storeu_si128((__m128i*)(d + i * 4), _mm_packus_epi16(lo, hi));
+  }
+
+  PixConv_RGBAToPBGRA_Scalar(s + i * 4, d + i * 4, nPixels - i);
+}
+
+/*****************
+ *  AVX2 kernels *
+ *****************/
+
+/* Turn eight 32-bit gray lanes into opaque BGRA pixels */
+PIXCONV_TARGET_AVX2
+static inline __m256i PixConv_SpreadGray_AVX2(__m256i g)
+{
+  const __m256i alpha = _mm256_set1_epi32((int)0xFF000000u);
+
+  __m256i v = _mm256_or_si256(g, _mm256_slli_epi32(g, 8));
+  v = _mm256_or_si256(v, _mm256_slli_epi32(g, 16));
+  return _mm256_or_si256(v, alpha);
+}
+
+/* Premultiply four pixels widened to 16-bit lanes, keeping alpha intact */
+PIXCONV_TARGET_AVX2
+static inline __m256i PixConv_Premultiply_AVX2(__m256i px)
+{
+  const __m256i round = _mm256_set1_epi16(128);
+  const __m256i alphaMask = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+
+  __m256i a = _mm256_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+  a = _mm256_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+
+  __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(px, a), round);
+  t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+
+  return _mm256_or_si256(_mm256_andnot_si256(alphaMask, t), _mm256_and_si256(alphaMask, px));
+}
+
+PIXCONV_TARGET_AVX2
+static void PixConv_Gray8ToPBGRA_AVX2(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+  size_t i = 0;
+
+  for (; i + 16 <= nPixels; i += 16) {
+    __m128i g = _mm_loadu_si128((const __m128i*)(s + i));
+    __m256i lo = PixConv_SpreadGray_AVX2(_mm256_cvtepu8_epi32(g));
+    __m256i hi = PixConv_SpreadGray_AVX2(_mm256_cvtepu8_epi32(_mm_srli_si128(g, 8)));
+    _mm256_storeu_si256((__m256i*)(d + i * 4), lo);
+    _mm256_storeu_si256((__m256i*)(d + i * 4 + 32), hi);
+  }
+
+  PixConv_Gray8ToPBGRA_Scalar(s + i, d + i * 4, nPixels - i);
+}
+
+PIXCONV_TARGET_AVX2
+static void PixConv_Gray16ToPBGRA_AVX2(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint16_t* s = (const uint16_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+  size_t i = 0;
+
+  for (; i + 8 <= nPixels; i += 8) {
+    __m256i g = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(s + i)));
+    _mm256_storeu_si256((__m256i*)(d + i * 4), PixConv_SpreadGray_AVX2(_mm256_srli_epi32(g, 8)));
+  }
+
+  PixConv_Gray16ToPBGRA_Scalar(s + i, d + i * 4, nPixels - i);
+}
+
+PIXCONV_TARGET_AVX2
+static void PixConv_Packed24ToPBGRA_AVX2(const uint8_t* s, uint8_t* d, size_t nPixels, __m256i shuffle, PIXCONVROWFUNC pfnTail)
+{
+  const __m256i alpha = _mm256_set1_epi32((int)0xFF000000u);
+  size_t i = 0;
+
+  /* Each lane takes four pixels from a 16-byte load; the upper load reads
+   * four bytes past the eighth pixel, so stop early enough to stay in bounds */
+  for (; i + 10 <= nPixels; i += 8) {
+    __m128i lo = _mm_loadu_si128((const __m128i*)(s + i * 3));
+    __m128i hi = _mm_loadu_si128((const __m128i*)(s + i * 3 + 12));
+    __m256i px = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    px = _mm256_or_si256(_mm256_shuffle_epi8(px, shuffle), alpha);
+    _mm256_storeu_si256((__m256i*)(d + i * 4), px);
+  }
+
+  pfnTail(s + i * 3, d + i * 4, nPixels - i);
+}
+
+PIXCONV_TARGET_AVX2
+static void PixConv_RGB24ToPBGRA_AVX2(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const __m256i shuffle = _mm256_setr_epi8(
+    2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+    2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+
+  PixConv_Packed24ToPBGRA_AVX2((const uint8_t*)pSrc, (uint8_t*)pDst, nPixels, shuffle,
+      PixConv_RGB24ToPBGRA_Scalar);
+}
+
+PIXCONV_TARGET_AVX2
+static void PixConv_BGR24ToPBGRA_AVX2(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const __m256i shuffle = _mm256_setr_epi8(
+    0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+    0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+
+  PixConv_Packed24ToPBGRA_AVX2((const uint8_t*)pSrc, (uint8_t*)pDst, nPixels, shuffle,
+      PixConv_BGR24ToPBGRA_Scalar);
+}
+
+PIXCONV_TARGET_AVX2
+static void PixConv_BGRAToPBGRA_AVX2(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+  const __m256i zero = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 8 <= nPixels; i += 8) {
+    __m256i px = _mm256_loadu_si256((const __m256i*)(s + i * 4));
+    __m256i lo = PixConv_Premultiply_AVX2(_mm256_unpacklo_epi8(px, zero));
+    __m256i hi = PixConv_Premultiply_AVX2(_mm256_unpackhi_epi8(px, zero));
+    _mm256_storeu_si256((__m256i*)(d + i * 4), _mm256_packus_epi16(lo, hi));
+  }
+
+  PixConv_BGRAToPBGRA_Scalar(s + i * 4, d + i * 4, nPixels - i);
+}
+
+PIXCONV_TARGET_AVX2
+static void PixConv_RGBAToPBGRA_AVX2(const void* pSrc, void* pDst, size_t nPixels)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+  const __m256i zero = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 8 <= nPixels; i += 8) {
+    __m256i px = _mm256_loadu_si256((const __m256i*)(s + i * 4));
+    __m256i lo = _mm256_unpacklo_epi8(px, zero);
+    __m256i hi = _mm256_unpackhi_epi8(px, zero);
+
+    /* Swap R and B lanes */
+    lo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+    hi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+
+    lo = PixConv_Premultiply_AVX2(lo);
+    hi = PixConv_Premultiply_AVX2(hi);
+    _mm256_storeu_si256((__m256i*)(d + i * 4), _mm256_packus_epi16(lo, hi));
+  }
+
+  PixConv_RGBAToPBGRA_Scalar(s + i * 4, d + i * 4, nPixels - i);
+}
+
+#define PIXCONV_SSE2(fn) fn
+#define PIXCONV_AVX2(fn) fn
+#else
+#define PIXCONV_SSE2(fn) NULL
+#define PIXCONV_AVX2(fn) NULL
+#endif  /* PIXCONV_X86 */
+
+typedef struct _tagPIXCONVKERNEL {
+  int nSrcFormat;
+  int nDstFormat;
+  PIXCONVROWFUNC pfnKernel[3];  /* Indexed by ISA, NULL where not specialised */
+} PIXCONVKERNEL;
+
+static const PIXCONVKERNEL g_pixConvKernels[] = {
+  { PIXFMT_GRAY8, PIXFMT_PBGRA32, { PixConv_Gray8ToPBGRA_Scalar,
+      PIXCONV_SSE2(PixConv_Gray8ToPBGRA_SSE2), PIXCONV_AVX2(PixConv_Gray8ToPBGRA_AVX2) } },
+  { PIXFMT_GRAY16, PIXFMT_PBGRA32, { PixConv_Gray16ToPBGRA_Scalar,
+      PIXCONV_SSE2(PixConv_Gray16ToPBGRA_SSE2), PIXCONV_AVX2(PixConv_Gray16ToPBGRA_AVX2) } },
+  { PIXFMT_RGB24, PIXFMT_PBGRA32, { PixConv_RGB24ToPBGRA_Scalar,
+      NULL, PIXCONV_AVX2(PixConv_RGB24ToPBGRA_AVX2) } },
+  { PIXFMT_BGR24, PIXFMT_PBGRA32, { PixConv_BGR24ToPBGRA_Scalar,
+      NULL, PIXCONV_AVX2(PixConv_BGR24ToPBGRA_AVX2) } },
+  { PIXFMT_RGBA32, PIXFMT_PBGRA32, { PixConv_RGBAToPBGRA_Scalar,
+      PIXCONV_SSE2(PixConv_RGBAToPBGRA_SSE2), PIXCONV_AVX2(PixConv_RGBAToPBGRA_AVX2) } },
+  { PIXFMT_BGRA32, PIXFMT_PBGRA32, { PixConv_BGRAToPBGRA_Scalar,
+      PIXCONV_SSE2(PixConv_BGRAToPBGRA_SSE2), PIXCONV_AVX2(PixConv_BGRAToPBGRA_AVX2) } },
+  { PIXFMT_PBGRA32, PIXFMT_PBGRA32, { PixConv_Copy32_Scalar, NULL, NULL } },
+
+  { PIXFMT_PBGRA32, PIXFMT_GRAY8, { PixConv_PBGRAToGray8_Scalar, NULL, NULL } },
+  { PIXFMT_PBGRA32, PIXFMT_GRAY16, { PixConv_PBGRAToGray16_Scalar, NULL, NULL } },
+  { PIXFMT_PBGRA32, PIXFMT_RGB24, { PixConv_PBGRAToRGB24_Scalar, NULL, NULL } },
+  { PIXFMT_PBGRA32, PIXFMT_BGR24, { PixConv_PBGRAToBGR24_Scalar, NULL, NULL } },
+  { PIXFMT_PBGRA32, PIXFMT_RGBA32, { PixConv_PBGRAToRGBA_Scalar, NULL, NULL } },
+  { PIXFMT_PBGRA32, PIXFMT_BGRA32, { PixConv_PBGRAToBGRA_Scalar, NULL, NULL } },
+};
+
+/*
+ * PixConv_GetCpuIsa
+ *
+ * Detect the best instruction set extension usable on this CPU and OS
+ */
+int PixConv_GetCpuIsa(void)
+{
+#if defined(PIXCONV_X86) && (defined(__GNUC__) || defined(__clang__))
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return PIXCONV_ISA_AVX2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return PIXCONV_ISA_SSE2;
+  }
+#elif defined(PIXCONV_X86) && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  int nIds = info[0];
+
+  __cpuid(info, 1);
+  int bSSE2 = (info[3] >> 26) & 1;
+  int bOSXSAVE = (info[2] >> 27) & 1;
+  int bAVX = (info[2] >> 28) & 1;
+
+  /* AVX state must be enabled by the OS, not only present in the CPU */
+  if (nIds >= 7 && bOSXSAVE && bAVX && (_xgetbv(0) & 6) == 6) {
+    __cpuidex(info, 7, 0);
+    if ((info[1] >> 5) & 1) {
+      return PIXCONV_ISA_AVX2;
+    }
+  }
+
+  if (bSSE2) {
+    return PIXCONV_ISA_SSE2;
+  }
+#endif
+
+  return PIXCONV_ISA_SCALAR;
+}
+
+int PixConv_GetIsa(void)
+{
+  long nIsa = Atomic_Load(&g_nPixConvIsa);
+  if (nIsa < 0) {
+    nIsa = PixConv_GetCpuIsa();
+    Atomic_Store(&g_nPixConvIsa, nIsa);
+  }
+
+  return (int)nIsa;
+}
+
+/*
+ * PixConv_SetIsa
+ *
+ * Restrict kernel selection to the given ISA level. Levels above what the
+ * CPU supports are clamped.
+ */
+void PixConv_SetIsa(int nIsa)
+{
+  int nCpuIsa = PixConv_GetCpuIsa();
+
+  if (nIsa < PIXCONV_ISA_SCALAR) {
+    nIsa = PIXCONV_ISA_SCALAR;
+  }
+
+  Atomic_Store(&g_nPixConvIsa, nIsa > nCpuIsa ? nCpuIsa : nIsa);
+}
+
+const char* PixConv_GetIsaName(int nIsa)
+{
+  switch (nIsa) {
+  case PIXCONV_ISA_SSE2:
+    return "sse2";
+  case PIXCONV_ISA_AVX2:
+    return "avx2";
+  }
+
+  return "scalar";
+}
+
+PIXCONVROWFUNC PixConv_GetRowFuncIsa(int nSrcFormat, int nDstFormat, int nIsa)
+{
+  for (size_t i = 0; i < sizeof(g_pixConvKernels) / sizeof(g_pixConvKernels[0]); ++i) {
+    const PIXCONVKERNEL* pKernel = &g_pixConvKernels[i];
+
+    if (pKernel->nSrcFormat == nSrcFormat && pKernel->nDstFormat == nDstFormat) {
+      /* Fall back to the best lower level kernel */
+      for (int level = nIsa; level >= PIXCONV_ISA_SCALAR; --level) {
+        if (level <= PIXCONV_ISA_AVX2 && pKernel->pfnKernel[level]) {
+          return pKernel->pfnKernel[level];
+        }
+      }
+    }
+  }
+
+  return NULL;
+}
+
+PIXCONVROWFUNC PixConv_GetRowFunc(int nSrcFormat, int nDstFormat)
+{
+  return PixConv_GetRowFuncIsa(nSrcFormat, nDstFormat, PixConv_GetIsa());
+}
+
+/*
+ * PixConv_Convert
+ *
+ * Convert a `width` x `height` rectangle between two buffers. One side
+ * must be PIXFMT_PBGRA32 unless both formats are the same.
+ */
+int PixConv_Convert(const void* pSrc, size_t srcStride, int nSrcFormat,
+    void* pDst, size_t dstStride, int nDstFormat, size_t width, size_t height)
+{
+  const uint8_t* s = (const uint8_t*)pSrc;
+  uint8_t* d = (uint8_t*)pDst;
+
+  if (nSrcFormat == nDstFormat) {
+    size_t rowSize = width * (size_t)PixConv_GetBytesPerPixel(nSrcFormat);
+    if (!rowSize) {
+      return PIXCONV_ERROR_UNSUPPORTED;
+    }
+
+    for (size_t y = 0; y < height; ++y) {
+      memcpy(d + y * dstStride, s + y * srcStride, rowSize);
+    }
+
+    return PIXCONV_OK;
+  }
+
+  PIXCONVROWFUNC pfnRow = PixConv_GetRowFunc(nSrcFormat, nDstFormat);
+  if (!pfnRow) {
+    return PIXCONV_ERROR_UNSUPPORTED;
+  }
+
+  for (size_t y = 0; y < height; ++y) {
+    pfnRow(s + y * srcStride, d + y * dstStride, width);
+  }
+
+  return PIXCONV_OK;
+}
@@ -0,0 +1,52 @@
+/*
+ * pixconv.h
+ *
+ * Pixel format conversion kernels
+ *
+ * Every supported format converts to and from premultiplied BGRA32, the
+ * layout all renderers consume. Row kernels exist in scalar, SSE2 and AVX2
+ * flavours and the fastest one supported by the running CPU is picked at
+ * runtime.
+ */
+
+#ifndef PANIVIEW_PIXCONV_H
+#define PANIVIEW_PIXCONV_H
+
+#include <stddef.h>
+
+enum {
+  PIXFMT_UNKNOWN = 0,
+  PIXFMT_GRAY8 = 1,
+  PIXFMT_GRAY16 = 2,    /* Native-endian 16-bit samples */
+  PIXFMT_RGB24 = 3,
+  PIXFMT_BGR24 = 4,
+  PIXFMT_RGBA32 = 5,    /* Straight alpha */
+  PIXFMT_BGRA32 = 6,    /* Straight alpha */
+  PIXFMT_PBGRA32 = 7,   /* Premultiplied alpha */
+  PIXFMT_COUNT
+};
+
+enum {
+  PIXCONV_ISA_SCALAR = 0,
+  PIXCONV_ISA_SSE2 = 1,
+  PIXCONV_ISA_AVX2 = 2,
+};
+
+enum {
+  PIXCONV_OK = 0,
+  PIXCONV_ERROR_UNSUPPORTED = -1,
+};
+
+typedef void (*PIXCONVROWFUNC)(const void* pSrc, void* pDst, size_t nPixels);
+
+int PixConv_GetBytesPerPixel(int nFormat);
+int PixConv_GetCpuIsa(void);
+int PixConv_GetIsa(void);
+void PixConv_SetIsa(int nIsa);
+const char* PixConv_GetIsaName(int nIsa);
+PIXCONVROWFUNC PixConv_GetRowFunc(int nSrcFormat, int nDstFormat);
+PIXCONVROWFUNC PixConv_GetRowFuncIsa(int nSrcFormat, int nDstFormat, int nIsa);
+int PixConv_Convert(const void* pSrc, size_t srcStride, int nSrcFormat,
+    void* pDst, size_t dstStride, int nDstFormat, size_t width, size_t height);
+
+#endif /* PANIVIEW_PIXCONV_H */
@@ -35,6 +35,7 @@
 #undef _NO_BOOL_TYPEDEF
 #endif
 
+#include <limits.h>
 #include <math.h>
 
 /* WinAPI headers */
@@ -0,0 +1,145 @@
+#include "prefetch.h"
+
+#include <string.h>
+
+void Prefetch_Init(LPPREFETCH pPrefetch, unsigned int nDepth)
+{
+  memset(pPrefetch, 0, sizeof(PREFETCH));
+  pPrefetch->nDepth = nDepth;
+}
+
+/* A file was opened directly, nothing is known about the next move */
+void Prefetch_OnOpen(LPPREFETCH pPrefetch)
+{
+  pPrefetch->nDirection = 0;
+  pPrefetch->nStreak = 0;
+}
+
+void Prefetch_OnStep(LPPREFETCH pPrefetch, int bForward)
+{
+  int nDirection = bForward ? 1 : -1;
+  if (pPrefetch->nDirection == nDirection) {
+    ++pPrefetch->nStreak;
+  }
+  else {
+    pPrefetch->nDirection = nDirection;
+    pPrefetch->nStreak = 1;
+  }
+}
+
+/* Append the position nDistance steps away, unless it is already planned */
+static size_t Prefetch_Add(size_t nCurrent, size_t nCount, int nDirection, size_t nDistance,
+    size_t* pPositions, size_t nPlanned)
+{
+  size_t nStep = nDistance % nCount;
+  size_t nPos = nDirection > 0 ? (nCurrent + nStep) % nCount : (nCurrent + nCount - nStep) % nCount;
+  if (nPos == nCurrent) {
+    return nPlanned;
+  }
+
+  for (size_t i = 0; i < nPlanned; ++i) {
+    if (pPositions[i] == nPos) {
+      return nPlanned;
+    }
+  }
+
+  pPositions[nPlanned] = nPos;
+  return nPlanned + 1;
+}
+
+/*
+ * Prefetch_Plan
+ *
+ * Fill pPositions with up to nMax positions to decode around nCurrent, most
+ * likely next first. Returns the number of positions planned.
+ */
+size_t Prefetch_Plan(LPPREFETCH pPrefetch, size_t nCurrent, size_t nCount, size_t* pPositions, size_t nMax)
+{
+  if (nCount < 2 || nCurrent >= nCount) {
+    return 0;
+  }
+
+  size_t nPlanned = 0;
+  size_t nDepth = pPrefetch->nDepth;
+  int nAhead = pPrefetch->nDirection ? pPrefetch->nDirection : 1;
+
+  if (pPrefetch->nStreak >= 2) {
+    /* Settled direction: look ahead, keep one behind */
+    for (size_t i = 1; i <= nDepth && nPlanned < nMax; ++i) {
+      nPlanned = Prefetch_Add(nCurrent, nCount, nAhead, i, pPositions, nPlanned);
+    }
+    if (nDepth && nPlanned < nMax) {
+      nPlanned = Prefetch_Add(nCurrent, nCount, -nAhead, 1, pPositions, nPlanned);
+    }
+  }
+  else {
+    /* Either way is likely, the last step's direction first */
+    for (size_t i = 1; i <= nDepth && nPlanned < nMax; ++i) {
+      nPlanned = Prefetch_Add(nCurrent, nCount, nAhead, i, pPositions, nPlanned);
+      if (nPlanned < nMax) {
+        nPlanned = Prefetch_Add(nCurrent, nCount, -nAhead, i, pPositions, nPlanned);
+      }
+    }
+  }
+
+  return nPlanned;
+}
+
+int Prefetch_IsPending(LPPREFETCH pPrefetch, size_t nPos)
+{
+  for (size_t i = 0; i < pPrefetch->nPending; ++i) {
+    if (pPrefetch->pending[i].nPos == nPos) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* Returns 0 when the table is full; such a request is just not tracked */
+int Prefetch_AddPending(LPPREFETCH pPrefetch, size_t nPos, uint64_t nGeneration)
+{
+  if (pPrefetch->nPending == PREFETCH_MAX_PENDING) {
+    return 0;
+  }
+
+  pPrefetch->pending[pPrefetch->nPending].nPos = nPos;
+  pPrefetch->pending[pPrefetch->nPending].nGeneration = nGeneration;
+  ++pPrefetch->nPending;
+  return 1;
+}
+
+/* A request finished; returns 1 if it was one of the prefetches */
+int Prefetch_OnDone(LPPREFETCH pPrefetch, uint64_t nGeneration)
+{
+  for (size_t i = 0; i < pPrefetch->nPending; ++i) {
+    if (pPrefetch->pending[i].nGeneration == nGeneration) {
+      pPrefetch->pending[i] = pPrefetch->pending[--pPrefetch->nPending];
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* Whether something pending is no longer part of the plan */
+int Prefetch_IsPlanStale(LPPREFETCH pPrefetch, const size_t* pPositions, size_t nPlanned)
+{
+  for (size_t i = 0; i < pPrefetch->nPending; ++i) {
+    size_t j = 0;
+    while (j < nPlanned && pPositions[j] != pPrefetch->pending[i].nPos) {
+      ++j;
+    }
+    if (j == nPlanned) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* The pending requests were cancelled */
+void Prefetch_ClearPending(LPPREFETCH pPrefetch)
+{
+  pPrefetch->nPending = 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * prefetch.h
+ *
+ * Direction-aware planner for decoding the neighbours of the current image
+ *
+ * The planner follows the navigation steps and picks which positions of the
+ * sorted directory to decode ahead of time, nearest first. While the user
+ * keeps stepping one way, the next nDepth images that way are planned and a
+ * single one behind, for the occasional look back. Right after opening a
+ * file or reversing, both directions are planned alike. Positions wrap
+ * around at the ends of the directory, like navigation does.
+ *
+ * The planner also remembers which positions were queued and not finished
+ * yet, so a new plan that still wants them keeps them running instead of
+ * cancelling and queueing them again.
+ */
+
+#ifndef PANIVIEW_PREFETCH_H
+#define PANIVIEW_PREFETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PREFETCH_MAX_PENDING 32
+
+typedef struct _tagPREFETCHPENDING PREFETCHPENDING, *LPPREFETCHPENDING;
+typedef struct _tagPREFETCH PREFETCH, *LPPREFETCH;
+
+struct _tagPREFETCHPENDING {
+  size_t nPos;
+  uint64_t nGeneration;       /* Of the load request */
+};
+
+struct _tagPREFETCH {
+  unsigned int nDepth;        /* Images planned in the direction of travel */
+  int nDirection;             /* +1 forward, -1 backward, 0 unknown */
+  unsigned int nStreak;       /* Consecutive steps in nDirection */
+  PREFETCHPENDING pending[PREFETCH_MAX_PENDING];
+  size_t nPending;
+};
+
+void Prefetch_Init(LPPREFETCH pPrefetch, unsigned int nDepth);
+void Prefetch_OnOpen(LPPREFETCH pPrefetch);
+void Prefetch_OnStep(LPPREFETCH pPrefetch, int bForward);
+size_t Prefetch_Plan(LPPREFETCH pPrefetch, size_t nCurrent, size_t nCount, size_t* pPositions, size_t nMax);
+int Prefetch_IsPending(LPPREFETCH pPrefetch, size_t nPos);
+int Prefetch_AddPending(LPPREFETCH pPrefetch, size_t nPos, uint64_t nGeneration);
+int Prefetch_OnDone(LPPREFETCH pPrefetch, uint64_t nGeneration);
+int Prefetch_IsPlanStale(LPPREFETCH pPrefetch, const size_t* pPositions, size_t nPlanned);
+void Prefetch_ClearPending(LPPREFETCH pPrefetch);
+
+#endif /* PANIVIEW_PREFETCH_H */
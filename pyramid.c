@@ -0,0 +1,322 @@
+#include "pyramid.h"
+#include "pixconv.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PYRAMID_X86
+#include <immintrin.h>
+#endif
+
+#if defined(PYRAMID_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PYRAMID_TARGET_SSE2 __attribute__((target("sse2")))
+#define PYRAMID_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PYRAMID_TARGET_SSE2
+#define PYRAMID_TARGET_AVX2
+#endif
+
+#ifdef UNIT_TESTING
+extern void* _test_malloc(const size_t size, const char* file, const int line);
+
+#define malloc(size) _test_malloc(size, __FILE__, __LINE__)
+
+extern void* _test_calloc(const size_t num, const size_t size, const char* file,
+  const int line);
+
+#define calloc(num, size) _test_calloc(num, size, __FILE__, __LINE__)
+
+extern void* _test_realloc(void* const ptr, const size_t size, const char* file,
+  const int line);
+
+#define realloc(ptr, size) _test_realloc(ptr, size, __FILE__, __LINE__)
+
+extern void _test_free(void* const ptr, const char* file, const int line);
+
+#define free(ptr) _test_free(ptr, __FILE__, __LINE__)
+#endif
+
+/* Destination rows per task below which splitting costs more than it saves */
+#define PYRAMID_MIN_ROWS_PER_TASK 32
+
+/* One destination row from two source rows, the same row twice at an odd bottom edge */
+typedef void (*PYRAMIDROWFUNC)(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, size_t nSrcWidth);
+
+/************
+ *  Scalar  *
+ ************/
+
+/* Works from any even column on, so the SIMD kernels leave it their tails */
+static void Pyramid_Row8_Scalar(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, size_t nSrcWidth,
+    size_t nChannels)
+{
+  for (size_t x = 0; x < nSrcWidth; x += 2) {
+    size_t x0 = x * nChannels;
+    size_t x1 = (x + 1 < nSrcWidth ? x + 1 : x) * nChannels;
+    for (size_t c = 0; c < nChannels; ++c) {
+      unsigned int sum = pRow0[x0 + c] + pRow0[x1 + c] + pRow1[x0 + c] + pRow1[x1 + c];
+      *pDst++ = (uint8_t)((sum + 2) >> 2);
+    }
+  }
+}
+
+static void Pyramid_RowBGRA_Scalar(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, size_t nSrcWidth)
+{
+  Pyramid_Row8_Scalar(pRow0, pRow1, pDst, nSrcWidth, 4);
+}
+
+static void Pyramid_RowGray8_Scalar(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, size_t nSrcWidth)
+{
+  Pyramid_Row8_Scalar(pRow0, pRow1, pDst, nSrcWidth, 1);
+}
+
+static void Pyramid_RowGray16_Scalar(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, size_t nSrcWidth)
+{
+  const uint16_t* s0 = (const uint16_t*)pRow0;
+  const uint16_t* s1 = (const uint16_t*)pRow1;
+  uint16_t* d = (uint16_t*)pDst;
+
+  for (size_t x = 0; x < nSrcWidth; x += 2) {
+    size_t x1 = x + 1 < nSrcWidth ? x + 1 : x;
+    uint32_t sum = (uint32_t)s0[x] + s0[x1] + s1[x] + s1[x1];
+    *d++ = (uint16_t)((sum + 2) >> 2);
+  }
+}
+
+#ifdef PYRAMID_X86
+
+/**********
+ *  SSE2  *
+ **********/
+
+/* Four destination pixels from eight source pixels of each row */
+PYRAMID_TARGET_SSE2
+static void Pyramid_RowBGRA_SSE2(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, size_t nSrcWidth)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i round = _mm_set1_epi16(2);
+  size_t x = 0;
+
+  for (; x + 8 <= nSrcWidth; x += 8) {
+    __m128i sums[2];
+    for (int h = 0; h < 2; ++h) {
+      __m128i a = _mm_loadu_si128((const __m128i*)(pRow0 + x * 4 + h * 16));
+      __m128i b = _mm_loadu_si128((const __m128i*)(pRow1 + x * 4 + h * 16));
+      __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+      __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+      __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+      sums[h] = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+    }
+    _mm_storeu_si128((__m128i*)(pDst + x * 2), _mm_packus_epi16(sums[0], sums[1]));
+  }
+
+  Pyramid_Row8_Scalar(pRow0 + x * 4, pRow1 + x * 4, pDst + x * 2, nSrcWidth - x, 4);
+}
+
+/* Sixteen destination pixels from 32 source pixels of each row */
+PYRAMID_TARGET_SSE2
+static void Pyramid_RowGray8_SSE2(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, size_t nSrcWidth)
+{
+  const __m128i even = _mm_set1_epi16(0x00FF);
+  const __m128i round = _mm_set1_epi16(2);
+  size_t x = 0;
+
+  for (; x + 32 <= nSrcWidth; x += 32) {
+    __m128i sums[2];
+    for (int h = 0; h < 2; ++h) {
+      __m128i a = _mm_loadu_si128((const __m128i*)(pRow0 + x + h * 16));
+      __m128i b = _mm_loadu_si128((const __m128i*)(pRow1 + x + h * 16));
+      __m128i sum = _mm_add_epi16(_mm_and_si128(a, even), _mm_srli_epi16(a, 8));
+      sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_and_si128(b, even), _mm_srli_epi16(b, 8)));
+      sums[h] = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+    }
+    _mm_storeu_si128((__m128i*)(pDst + x / 2), _mm_packus_epi16(sums[0], sums[1]));
+  }
+
+  Pyramid_Row8_Scalar(pRow0 + x, pRow1 + x, pDst + x / 2, nSrcWidth - x, 1);
+}
+
+/**********
+ *  AVX2  *
+ **********/
+
+/* Eight destination pixels from sixteen source pixels of each row */
+PYRAMID_TARGET_AVX2
+static void Pyramid_RowBGRA_AVX2(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, size_t nSrcWidth)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i round = _mm256_set1_epi16(2);
+  size_t x = 0;
+
+  for (; x + 16 <= nSrcWidth; x += 16) {
+    __m256i sums[2];
+    for (int h = 0; h < 2; ++h) {
+      __m256i a = _mm256_loadu_si256((const __m256i*)(pRow0 + x * 4 + h * 32));
+      __m256i b = _mm256_loadu_si256((const __m256i*)(pRow1 + x * 4 + h * 32));
+      __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+      __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+      __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+      sums[h] = _mm256_srli_epi16(_mm256_add_epi16(sum, round), 2);
+    }
+
+    /* Packing works within lanes: pixel pairs come out 0 2 1 3 */
+    __m256i px = _mm256_permute4x64_epi64(_mm256_packus_epi16(sums[0], sums[1]), 0xD8);
+    _mm256_storeu_si256((__m256i*)(pDst + x * 2), px);
+  }
+
+  if (x < nSrcWidth) {
+    Pyramid_RowBGRA_SSE2(pRow0 + x * 4, pRow1 + x * 4, pDst + x * 2, nSrcWidth - x);
+  }
+}
+
+/* 32 destination pixels from 64 source pixels of each row */
+PYRAMID_TARGET_AVX2
+static void Pyramid_RowGray8_AVX2(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, size_t nSrcWidth)
+{
+  const __m256i even = _mm256_set1_epi16(0x00FF);
+  const __m256i round = _mm256_set1_epi16(2);
+  size_t x = 0;
+
+  for (; x + 64 <= nSrcWidth; x += 64) {
+    __m256i sums[2];
+    for (int h = 0; h < 2; ++h) {
+      __m256i a = _mm256_loadu_si256((const __m256i*)(pRow0 + x + h * 32));
+      __m256i b = _mm256_loadu_si256((const __m256i*)(pRow1 + x + h * 32));
+      __m256i sum = _mm256_add_epi16(_mm256_and_si256(a, even), _mm256_srli_epi16(a, 8));
+      sum = _mm256_add_epi16(sum, _mm256_add_epi16(_mm256_and_si256(b, even), _mm256_srli_epi16(b, 8)));
+      sums[h] = _mm256_srli_epi16(_mm256_add_epi16(sum, round), 2);
+    }
+
+    __m256i px = _mm256_permute4x64_epi64(_mm256_packus_epi16(sums[0], sums[1]), 0xD8);
+    _mm256_storeu_si256((__m256i*)(pDst + x / 2), px);
+  }
+
+  if (x < nSrcWidth) {
+    Pyramid_RowGray8_SSE2(pRow0 + x, pRow1 + x, pDst + x / 2, nSrcWidth - x);
+  }
+}
+
+#endif /* PYRAMID_X86 */
+
+/**************
+ *  Dispatch  *
+ **************/
+
+typedef struct _tagPYRAMIDJOB {
+  const PIXBUF* pSrc;
+  LPPIXBUF pDst;
+  PYRAMIDROWFUNC pfnRow;
+} PYRAMIDJOB;
+
+static PYRAMIDROWFUNC Pyramid_GetRowFunc(int nFormat)
+{
+  int nIsa = PixConv_GetIsa();
+  (void)nIsa;
+
+  switch (nFormat) {
+  case PIXFMT_PBGRA32:
+#ifdef PYRAMID_X86
+    if (nIsa >= PIXCONV_ISA_AVX2) {
+      return Pyramid_RowBGRA_AVX2;
+    }
+    if (nIsa >= PIXCONV_ISA_SSE2) {
+      return Pyramid_RowBGRA_SSE2;
+    }
+#endif
+    return Pyramid_RowBGRA_Scalar;
+  case PIXFMT_GRAY8:
+#ifdef PYRAMID_X86
+    if (nIsa >= PIXCONV_ISA_AVX2) {
+      return Pyramid_RowGray8_AVX2;
+    }
+    if (nIsa >= PIXCONV_ISA_SSE2) {
+      return Pyramid_RowGray8_SSE2;
+    }
+#endif
+    return Pyramid_RowGray8_Scalar;
+  case PIXFMT_GRAY16:
+    /* Rare enough, 16-bit PGMs only, to stay scalar */
+    return Pyramid_RowGray16_Scalar;
+  }
+
+  return NULL;
+}
+
+/* Destination rows [nBegin, nEnd), on whichever thread of the pool takes them */
+static void Pyramid_Rows(void* pArg, size_t nBegin, size_t nEnd)
+{
+  const PYRAMIDJOB* pJob = (const PYRAMIDJOB*)pArg;
+  const PIXBUF* pSrc = pJob->pSrc;
+
+  for (size_t y = nBegin; y < nEnd; ++y) {
+    size_t y1 = y * 2 + 1 < pSrc->height ? y * 2 + 1 : y * 2;
+    pJob->pfnRow(PixBuf_GetRow(pSrc, y * 2), PixBuf_GetRow(pSrc, y1), PixBuf_GetRow(pJob->pDst, y), pSrc->width);
+  }
+}
+
+int Pyramid_Build(LPPYRAMID pPyramid, LPPIXBUF pSource, size_t minSize, LPTASKPOOL pPool)
+{
+  memset(pPyramid, 0, sizeof(PYRAMID));
+
+  PYRAMIDROWFUNC pfnRow = Pyramid_GetRowFunc(pSource->nFormat);
+  if (!pfnRow) {
+    return PYRAMID_ERROR_UNSUPPORTED;
+  }
+
+  minSize = minSize ? minSize : 1;
+
+  pPyramid->pLevels[0] = PixBuf_AddRef(pSource);
+  pPyramid->nLevels = 1;
+
+  PYRAMIDJOB job;
+  job.pfnRow = pfnRow;
+
+  /* Each level is read from the one before, finished by the time it is */
+  const PIXBUF* pSrc = pSource;
+  while ((pSrc->width > minSize || pSrc->height > minSize) && pPyramid->nLevels < PYRAMID_MAX_LEVELS) {
+    LPPIXBUF pDst = NULL;
+    if (PixBuf_Create((pSrc->width + 1) / 2, (pSrc->height + 1) / 2, pSrc->nFormat, NULL, &pDst) != PIXBUF_OK) {
+      Pyramid_Cleanup(pPyramid);
+      return PYRAMID_ERROR_MEMORY;
+    }
+
+    job.pSrc = pSrc;
+    job.pDst = pDst;
+    TaskPool_ParallelFor(pPool, 0, pDst->height, PYRAMID_MIN_ROWS_PER_TASK, Pyramid_Rows, &job);
+
+    pPyramid->pLevels[pPyramid->nLevels++] = pDst;
+    pPyramid->cbSize += pDst->stride * pDst->height;
+    pSrc = pDst;
+  }
+
+  return PYRAMID_OK;
+}
+
+void Pyramid_Cleanup(LPPYRAMID pPyramid)
+{
+  for (size_t i = 0; i < pPyramid->nLevels; ++i) {
+    PixBuf_Release(pPyramid->pLevels[i]);
+  }
+
+  memset(pPyramid, 0, sizeof(PYRAMID));
+}
+
+size_t Pyramid_SelectLevel(const PYRAMID* pPyramid, double scale)
+{
+  size_t nLevel = 0;
+  if (!pPyramid->nLevels) {
+    return 0;
+  }
+  if (!(scale > 0.0)) {
+    return pPyramid->nLevels - 1;
+  }
+
+  while (nLevel + 1 < pPyramid->nLevels && ldexp(scale, (int)nLevel + 1) <= 1.0) {
+    ++nLevel;
+  }
+
+  return nLevel;
+}
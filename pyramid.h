@@ -0,0 +1,54 @@
+/*
+ * pyramid.h
+ *
+ * Box-filtered mip pyramids of decoded images
+ *
+ * Level 0 is the decoded image itself; every further level averages 2x2
+ * blocks of the one before, its size halved and rounded up, so the pixel
+ * past an odd edge is averaged with itself. Levels are built once, when
+ * the image is decoded, split by rows over a task pool with the same
+ * scalar, SSE2 and AVX2 level pixconv picks, and kept with the image for
+ * as long as it is cached. Any renderer zoomed out then starts from the
+ * nearest level instead of filtering the full image again. Premultiplied
+ * BGRA32, 8-bit and 16-bit gray are accepted; levels keep the format.
+ */
+
+#ifndef PANIVIEW_PYRAMID_H
+#define PANIVIEW_PYRAMID_H
+
+#include "pixbuf.h"
+#include "taskpool.h"
+
+#include <stddef.h>
+
+#define PYRAMID_MAX_LEVELS 32
+
+enum {
+  PYRAMID_OK = 0,
+  PYRAMID_ERROR_MEMORY = -1,
+  PYRAMID_ERROR_UNSUPPORTED = -2,
+};
+
+typedef struct _tagPYRAMID PYRAMID, *LPPYRAMID;
+
+struct _tagPYRAMID {
+  size_t nLevels;                         /* Level 0 included */
+  LPPIXBUF pLevels[PYRAMID_MAX_LEVELS];   /* Level 0 is the source, referenced */
+  size_t cbSize;                          /* Bytes of the levels past 0 */
+};
+
+/*
+ * Build the levels of pSource down to the first one no larger than
+ * minSize either way, the rows of each over pPool and the calling thread,
+ * or on the calling thread alone without a pool.
+ */
+int Pyramid_Build(LPPYRAMID pPyramid, LPPIXBUF pSource, size_t minSize, LPTASKPOOL pPool);
+void Pyramid_Cleanup(LPPYRAMID pPyramid);
+
+/*
+ * The coarsest level whose pixels do not come out larger than a screen
+ * pixel at scale screen pixels per level 0 pixel
+ */
+size_t Pyramid_SelectLevel(const PYRAMID* pPyramid, double scale);
+
+#endif /* PANIVIEW_PYRAMID_H */
@@ -0,0 +1,423 @@
+#ifndef _WIN32
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include "rasterfile.h"
+#include "pgm.h"
+#include "pixconv.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+#ifdef UNIT_TESTING
+extern void* _test_malloc(const size_t size, const char* file, const int line);
+
+#define malloc(size) _test_malloc(size, __FILE__, __LINE__)
+
+extern void* _test_calloc(const size_t num, const size_t size, const char* file,
+  const int line);
+
+#define calloc(num, size) _test_calloc(num, size, __FILE__, __LINE__)
+
+extern void* _test_realloc(void* const ptr, const size_t size, const char* file,
+  const int line);
+
+#define realloc(ptr, size) _test_realloc(ptr, size, __FILE__, __LINE__)
+
+extern void _test_free(void* const ptr, const char* file, const int line);
+
+#define free(ptr) _test_free(ptr, __FILE__, __LINE__)
+#endif
+
+/* BITMAPFILEHEADER and BITMAPINFOHEADER, then the three masks of BI_BITFIELDS */
+#define RASTERFILE_BMP_HEADER_SIZE 66
+
+static int RasterFile_Seek(FILE* fp, uint64_t offset, int nOrigin)
+{
+#ifdef _WIN32
+  return _fseeki64(fp, (__int64)offset, nOrigin) == 0;
+#else
+  return fseeko(fp, (off_t)offset, nOrigin) == 0;
+#endif
+}
+
+static uint64_t RasterFile_Tell(FILE* fp)
+{
+#ifdef _WIN32
+  __int64 offset = _ftelli64(fp);
+#else
+  off_t offset = ftello(fp);
+#endif
+  return offset < 0 ? 0 : (uint64_t)offset;
+}
+
+/* Up to size bytes at offset, either copied from memory or read from the file */
+static size_t RasterFile_ReadAt(LPRASTERFILE pRaster, uint64_t offset, void* pDest, size_t size)
+{
+  if (offset >= pRaster->fileSize) {
+    return 0;
+  }
+
+  size = pRaster->fileSize - offset < size ? (size_t)(pRaster->fileSize - offset) : size;
+  if (pRaster->pMemory) {
+    memcpy(pDest, pRaster->pMemory + offset, size);
+    return size;
+  }
+
+  if (!RasterFile_Seek(pRaster->fp, offset, SEEK_SET)) {
+    return 0;
+  }
+
+  return fread(pDest, 1, size, pRaster->fp);
+}
+
+static uint32_t RasterFile_ReadLE16(const unsigned char* p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t RasterFile_ReadLE32(const unsigned char* p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * RasterFile_InitPGM
+ *
+ * The PGM decoder parses the header; the raster starts where it stopped,
+ * less whatever it buffered past it.
+ */
+static int RasterFile_InitPGM(LPRASTERFILE pRaster)
+{
+  PGMDECODER decoder;
+  if (pRaster->pMemory) {
+    PGMDecoder_InitMemory(&decoder, pRaster->pMemory, (size_t)pRaster->fileSize);
+  }
+  else {
+    PGMDecoder_InitFile(&decoder, pRaster->fp);
+  }
+
+  int status = PGMDecoder_ReadHeader(&decoder);
+  uint64_t offset = pRaster->pMemory ? decoder.nBufferPos
+      : RasterFile_Tell(pRaster->fp) - (decoder.nBufferFill - decoder.nBufferPos);
+  PGMHEADER header = decoder.header;
+  PGMDecoder_Cleanup(&decoder);
+
+  if (status == PGM_ERROR_MEMORY) {
+    return RASTERFILE_ERROR_MEMORY;
+  }
+  if (status != PGM_OK) {
+    return RASTERFILE_ERROR_FORMAT;
+  }
+  if (header.nEncoding != PGM_ENCODING_BINARY) {
+    return RASTERFILE_ERROR_UNSUPPORTED;
+  }
+  if (header.width > SIZE_MAX / 2 || header.height > SIZE_MAX) {
+    return RASTERFILE_ERROR_UNSUPPORTED;
+  }
+
+  unsigned int maxval = header.maxval;
+  pRaster->dataOffset = offset;
+  pRaster->width = (size_t)header.width;
+  pRaster->height = (size_t)header.height;
+  pRaster->maxval = maxval;
+  pRaster->nLayout = maxval > 255 ? RASTERFILE_LAYOUT_GRAY16BE : RASTERFILE_LAYOUT_GRAY8;
+  pRaster->nPixFmt = maxval > 255 ? PIXFMT_GRAY16 : PIXFMT_GRAY8;
+  pRaster->nBytesPerSample = maxval > 255 ? 2 : 1;
+  pRaster->stride = header.width * pRaster->nBytesPerSample;
+
+  /* Both ranges are offered whatever the depth of the file */
+  pRaster->pScale8 = (uint8_t*)malloc((size_t)maxval + 1);
+  pRaster->pScale16 = (uint16_t*)malloc(((size_t)maxval + 1) * sizeof(uint16_t));
+  if (!pRaster->pScale8 || !pRaster->pScale16) {
+    return RASTERFILE_ERROR_MEMORY;
+  }
+
+  for (unsigned int v = 0; v <= maxval; ++v) {
+    pRaster->pScale8[v] = (uint8_t)((v * 255u + maxval / 2) / maxval);
+    pRaster->pScale16[v] = (uint16_t)(((uint64_t)v * 65535u + maxval / 2) / maxval);
+  }
+
+  return RASTERFILE_OK;
+}
+
+/* Windows 3 and later info headers only; the OS/2 one and compression go to a full decode */
+static int RasterFile_InitBMP(LPRASTERFILE pRaster)
+{
+  unsigned char header[RASTERFILE_BMP_HEADER_SIZE] = { 0 };
+  size_t cbHeader = RasterFile_ReadAt(pRaster, 0, header, sizeof(header));
+  if (cbHeader < 54) {
+    return RASTERFILE_ERROR_FORMAT;
+  }
+
+  uint32_t headerSize = RasterFile_ReadLE32(header + 14);
+  if (headerSize < 40) {
+    return RASTERFILE_ERROR_UNSUPPORTED;
+  }
+
+  int32_t width = (int32_t)RasterFile_ReadLE32(header + 18);
+  int32_t height = (int32_t)RasterFile_ReadLE32(header + 22);
+  uint32_t bpp = RasterFile_ReadLE16(header + 28);
+  uint32_t compression = RasterFile_ReadLE32(header + 30);
+  uint32_t nColors = RasterFile_ReadLE32(header + 46);
+
+  if (width <= 0 || !height || height == INT32_MIN) {
+    return RASTERFILE_ERROR_FORMAT;
+  }
+
+  /* Bit fields are fine as long as they are the plain BGRX ones */
+  if (compression == 3 && bpp == 32 && cbHeader == RASTERFILE_BMP_HEADER_SIZE &&
+      RasterFile_ReadLE32(header + 54) == 0x00FF0000 && RasterFile_ReadLE32(header + 58) == 0x0000FF00 &&
+      RasterFile_ReadLE32(header + 62) == 0x000000FF) {
+    compression = 0;
+  }
+
+  if (compression != 0) {
+    return RASTERFILE_ERROR_UNSUPPORTED;
+  }
+
+  switch (bpp) {
+  case 8:
+    pRaster->nLayout = RASTERFILE_LAYOUT_INDEX8;
+    break;
+  case 24:
+    pRaster->nLayout = RASTERFILE_LAYOUT_BGR24;
+    break;
+  case 32:
+    pRaster->nLayout = RASTERFILE_LAYOUT_BGRX32;
+    break;
+  default:
+    return RASTERFILE_ERROR_UNSUPPORTED;
+  }
+
+  pRaster->dataOffset = RasterFile_ReadLE32(header + 10);
+  pRaster->width = (size_t)width;
+  pRaster->height = height < 0 ? (size_t)(-(int64_t)height) : (size_t)height;
+  pRaster->bBottomUp = height > 0;
+  pRaster->nPixFmt = PIXFMT_PBGRA32;
+  pRaster->nBytesPerSample = bpp / 8;
+  pRaster->stride = ((uint64_t)width * bpp + 31) / 32 * 4;
+
+  /* Entries past the ones the file has stay opaque black */
+  for (size_t i = 0; i < 256; ++i) {
+    pRaster->palette[i][3] = 0xFF;
+  }
+
+  if (bpp == 8) {
+    if (!nColors || nColors > 256) {
+      nColors = 256;
+    }
+
+    unsigned char entries[256][4];
+    size_t nRead = RasterFile_ReadAt(pRaster, 14 + (uint64_t)headerSize, entries, 4 * (size_t)nColors) / 4;
+    for (size_t i = 0; i < nRead; ++i) {
+      memcpy(pRaster->palette[i], entries[i], 3);
+    }
+  }
+
+  return RASTERFILE_OK;
+}
+
+static int RasterFile_InitHeader(LPRASTERFILE pRaster)
+{
+  unsigned char magic[2] = { 0 };
+  if (RasterFile_ReadAt(pRaster, 0, magic, 2) != 2 || (pRaster->fp && !RasterFile_Seek(pRaster->fp, 0, SEEK_SET))) {
+    RasterFile_Cleanup(pRaster);
+    return RASTERFILE_ERROR_FORMAT;
+  }
+
+  int status = RASTERFILE_ERROR_FORMAT;
+  if (magic[0] == 'P' && (magic[1] == '5' || magic[1] == '2')) {
+    status = RasterFile_InitPGM(pRaster);
+  }
+  else if (magic[0] == 'B' && magic[1] == 'M') {
+    status = RasterFile_InitBMP(pRaster);
+  }
+
+  /* Row offsets are computed in 64 bits, row spans in size_t */
+  if (status == RASTERFILE_OK &&
+      (pRaster->stride > SIZE_MAX || pRaster->height > (UINT64_MAX - pRaster->dataOffset) / pRaster->stride)) {
+    status = RASTERFILE_ERROR_UNSUPPORTED;
+  }
+
+  if (status != RASTERFILE_OK) {
+    RasterFile_Cleanup(pRaster);
+  }
+
+  return status;
+}
+
+int RasterFile_Init(LPRASTERFILE pRaster, FILE* fp)
+{
+  memset(pRaster, 0, sizeof(RASTERFILE));
+  pRaster->fp = fp;
+
+  if (!RasterFile_Seek(fp, 0, SEEK_END)) {
+    return RASTERFILE_ERROR_IO;
+  }
+  pRaster->fileSize = RasterFile_Tell(fp);
+
+  return RasterFile_InitHeader(pRaster);
+}
+
+int RasterFile_InitMemory(LPRASTERFILE pRaster, const void* pData, size_t size)
+{
+  memset(pRaster, 0, sizeof(RASTERFILE));
+  if (!pData) {
+    return RASTERFILE_ERROR_FORMAT;
+  }
+
+  pRaster->pMemory = (const unsigned char*)pData;
+  pRaster->fileSize = size;
+
+  return RasterFile_InitHeader(pRaster);
+}
+
+void RasterFile_Cleanup(LPRASTERFILE pRaster)
+{
+  free(pRaster->pScale8);
+  free(pRaster->pScale16);
+  free(pRaster->pSpan);
+  memset(pRaster, 0, sizeof(RASTERFILE));
+}
+
+/*
+ * RasterFile_ReadSpan
+ *
+ * The cbSpan bytes at offset. In memory they are used where they lie;
+ * otherwise they are read into the span buffer, and so is a span cut short
+ * by the end of the file, with what lies past it zeroed.
+ */
+static int RasterFile_ReadSpan(LPRASTERFILE pRaster, uint64_t offset, size_t cbSpan, const unsigned char** ppSpan)
+{
+  size_t cbAvail = 0;
+  if (offset < pRaster->fileSize) {
+    cbAvail = pRaster->fileSize - offset < cbSpan ? (size_t)(pRaster->fileSize - offset) : cbSpan;
+  }
+
+  if (pRaster->pMemory && cbAvail == cbSpan) {
+    ++pRaster->stats.reads;
+    pRaster->stats.bytesRead += cbSpan;
+    *ppSpan = pRaster->pMemory + offset;
+    return RASTERFILE_OK;
+  }
+
+  size_t cbRead = 0;
+  if (cbAvail) {
+    if (!pRaster->pMemory && !RasterFile_Seek(pRaster->fp, offset, SEEK_SET)) {
+      return RASTERFILE_ERROR_IO;
+    }
+
+    cbRead = RasterFile_ReadAt(pRaster, offset, pRaster->pSpan, cbAvail);
+    ++pRaster->stats.reads;
+    pRaster->stats.bytesRead += cbRead;
+  }
+
+  if (cbRead < cbSpan) {
+    memset(pRaster->pSpan + cbRead, 0, cbSpan - cbRead);
+  }
+
+  *ppSpan = pRaster->pSpan;
+  return RASTERFILE_OK;
+}
+
+/* One sample as read into pixel x of an output row */
+static void RasterFile_StoreSample(const RASTERFILE* pRaster, const unsigned char* pSample, unsigned char* pRow,
+    size_t x, int nPixFmt)
+{
+  unsigned int v = 0;
+  unsigned char* pPixel = pRow + x * 4;
+
+  switch (pRaster->nLayout) {
+  case RASTERFILE_LAYOUT_GRAY8:
+  case RASTERFILE_LAYOUT_GRAY16BE:
+    v = pRaster->nLayout == RASTERFILE_LAYOUT_GRAY8 ? pSample[0] : ((unsigned int)pSample[0] << 8) | pSample[1];
+    v = v < pRaster->maxval ? v : pRaster->maxval;
+    if (nPixFmt == PIXFMT_GRAY16) {
+      ((uint16_t*)pRow)[x] = pRaster->pScale16[v];
+    }
+    else if (nPixFmt == PIXFMT_GRAY8) {
+      pRow[x] = pRaster->pScale8[v];
+    }
+    else {
+      pPixel[0] = pPixel[1] = pPixel[2] = pRaster->pScale8[v];
+      pPixel[3] = 0xFF;
+    }
+    break;
+  case RASTERFILE_LAYOUT_INDEX8:
+    memcpy(pPixel, pRaster->palette[pSample[0]], 4);
+    break;
+  default:
+    pPixel[0] = pSample[0];
+    pPixel[1] = pSample[1];
+    pPixel[2] = pSample[2];
+    pPixel[3] = 0xFF;
+    break;
+  }
+}
+
+int RasterFile_ReadRegion(LPRASTERFILE pRaster, size_t left, size_t top, size_t right, size_t bottom,
+    unsigned int nScale, void* pDest, size_t destStride, int nPixFmt)
+{
+  if (left >= right || top >= bottom || right > pRaster->width || bottom > pRaster->height || !nScale) {
+    return RASTERFILE_ERROR_INVALID;
+  }
+
+  int bGray = pRaster->nLayout == RASTERFILE_LAYOUT_GRAY8 || pRaster->nLayout == RASTERFILE_LAYOUT_GRAY16BE;
+  if (nPixFmt != PIXFMT_PBGRA32 && !(bGray && (nPixFmt == PIXFMT_GRAY8 || nPixFmt == PIXFMT_GRAY16))) {
+    return RASTERFILE_ERROR_UNSUPPORTED;
+  }
+
+  /* Every output pixel is the centre of its block, or the last of the region when the block is cut short */
+  size_t outWidth = (right - left - 1) / nScale + 1;
+  size_t outHeight = (bottom - top - 1) / nScale + 1;
+  size_t half = nScale / 2;
+  size_t firstColumn = left + half < right ? left + half : right - 1;
+  size_t lastColumn = left + (outWidth - 1) * nScale + half;
+  lastColumn = lastColumn < right ? lastColumn : right - 1;
+
+  size_t nBytesPerSample = pRaster->nBytesPerSample;
+  size_t cbSpan = (lastColumn - firstColumn + 1) * nBytesPerSample;
+  if (pRaster->cbSpan < cbSpan) {
+    unsigned char* pSpan = (unsigned char*)realloc(pRaster->pSpan, cbSpan);
+    if (!pSpan) {
+      return RASTERFILE_ERROR_MEMORY;
+    }
+    pRaster->pSpan = pSpan;
+    pRaster->cbSpan = cbSpan;
+  }
+
+  /* Rows go in file order, so a bottom-up file is read forwards as well */
+  for (size_t i = 0; i < outHeight; ++i) {
+    size_t y = pRaster->bBottomUp ? outHeight - 1 - i : i;
+    size_t row = top + y * nScale + half;
+    row = row < bottom ? row : bottom - 1;
+    uint64_t fileRow = pRaster->bBottomUp ? pRaster->height - 1 - row : row;
+
+    const unsigned char* pSpan = NULL;
+    int status = RasterFile_ReadSpan(pRaster,
+        pRaster->dataOffset + fileRow * pRaster->stride + (uint64_t)firstColumn * nBytesPerSample, cbSpan, &pSpan);
+    if (status != RASTERFILE_OK) {
+      return status;
+    }
+
+    unsigned char* pRow = (unsigned char*)pDest + y * destStride;
+    for (size_t x = 0; x < outWidth; ++x) {
+      size_t column = left + x * nScale + half;
+      column = column < right ? column : right - 1;
+      RasterFile_StoreSample(pRaster, pSpan + (column - firstColumn) * nBytesPerSample, pRow, x,
+          nPixFmt);
+    }
+  }
+
+  return RASTERFILE_OK;
+}
+
+void RasterFile_GetStats(const RASTERFILE* pRaster, LPRASTERFILESTATS pStats)
+{
+  *pStats = pRaster->stats;
+}
@@ -0,0 +1,93 @@
+/*
+ * rasterfile.h
+ *
+ * Region decoding of uncompressed rasters straight from their file
+ *
+ * Binary PGM (P5) and uncompressed BMP keep every row at a fixed offset,
+ * so a view into an image far larger than memory only needs the rows and
+ * columns it shows. A region is read with one seek and one read per row it
+ * samples, covering just its columns; at a scale of 1/n only every n-th row
+ * is touched and every n-th pixel kept, the one at the centre of its n x n
+ * block, so a zoomed out view of a huge scan reads a fraction of the file.
+ * The file stays open and is borrowed; reads are counted for tuning. A
+ * file mapped into memory is read the same way, without the copies.
+ */
+
+#ifndef PANIVIEW_RASTERFILE_H
+#define PANIVIEW_RASTERFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum {
+  RASTERFILE_OK = 0,
+  RASTERFILE_ERROR_IO = -1,
+  RASTERFILE_ERROR_FORMAT = -2,
+  RASTERFILE_ERROR_UNSUPPORTED = -3,
+  RASTERFILE_ERROR_MEMORY = -4,
+  RASTERFILE_ERROR_INVALID = -5,
+};
+
+/* How samples are laid out in the file */
+enum {
+  RASTERFILE_LAYOUT_GRAY8 = 1,      /* PGM, maxval below 256 */
+  RASTERFILE_LAYOUT_GRAY16BE = 2,   /* PGM, maxval 256 and up */
+  RASTERFILE_LAYOUT_INDEX8 = 3,     /* BMP, 8-bit palette indices */
+  RASTERFILE_LAYOUT_BGR24 = 4,      /* BMP */
+  RASTERFILE_LAYOUT_BGRX32 = 5,     /* BMP, the fourth byte ignored */
+};
+
+typedef struct _tagRASTERFILESTATS RASTERFILESTATS, *LPRASTERFILESTATS;
+typedef struct _tagRASTERFILE RASTERFILE, *LPRASTERFILE;
+
+struct _tagRASTERFILESTATS {
+  uint64_t reads;       /* Row spans read */
+  uint64_t bytesRead;
+};
+
+struct _tagRASTERFILE {
+  FILE* fp;                   /* Borrowed, NULL when reading from memory */
+  const unsigned char* pMemory;   /* Borrowed, the whole file mapped */
+  uint64_t fileSize;
+  uint64_t dataOffset;        /* First row in the file */
+  uint64_t stride;            /* Bytes from one row in the file to the next */
+  size_t width;
+  size_t height;
+  int bBottomUp;
+  int nLayout;
+  int nPixFmt;                /* What the samples decode to by default, PIXFMT_* */
+  size_t nBytesPerSample;
+  unsigned int maxval;
+
+  uint8_t* pScale8;           /* PGM samples to 0..255 */
+  uint16_t* pScale16;         /* PGM samples to 0..65535 */
+  uint8_t palette[256][4];    /* BMP indices to opaque BGRA */
+
+  unsigned char* pSpan;       /* The columns of one row, as read */
+  size_t cbSpan;
+
+  RASTERFILESTATS stats;
+};
+
+/*
+ * Read the header of the PGM or BMP in fp. Anything compressed, ASCII PGM
+ * included, is RASTERFILE_ERROR_UNSUPPORTED and left to a full decode.
+ */
+int RasterFile_Init(LPRASTERFILE pRaster, FILE* fp);
+/* The same over the whole file in memory, which must outlive pRaster; rows are read where they lie */
+int RasterFile_InitMemory(LPRASTERFILE pRaster, const void* pData, size_t size);
+void RasterFile_Cleanup(LPRASTERFILE pRaster);
+
+/*
+ * Decode the pixels from left, top up to right, bottom at 1/nScale into
+ * pDest: (right - left + nScale - 1) / nScale pixels per row, as many rows
+ * likewise. nPixFmt is PIXFMT_PBGRA32, or PIXFMT_GRAY8 and PIXFMT_GRAY16
+ * for PGM. Rows past the end of a truncated file come out black.
+ */
+int RasterFile_ReadRegion(LPRASTERFILE pRaster, size_t left, size_t top, size_t right, size_t bottom,
+    unsigned int nScale, void* pDest, size_t destStride, int nPixFmt);
+
+void RasterFile_GetStats(const RASTERFILE* pRaster, LPRASTERFILESTATS pStats);
+
+#endif /* PANIVIEW_RASTERFILE_H */
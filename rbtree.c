@@ -0,0 +1,230 @@
+#include "rbtree.h"
+
+#ifdef UNIT_TESTING
+extern void* _test_malloc(const size_t size, const char* file, const int line);
+
+#define malloc(size) _test_malloc(size, __FILE__, __LINE__)
+
+extern void* _test_calloc(const size_t num, const size_t size, const char* file,
+  const int line);
+
+#define calloc(num, size) _test_calloc(num, size, __FILE__, __LINE__)
+
+extern void* _test_realloc(void* const ptr, const size_t size, const char* file,
+  const int line);
+
+#define realloc(ptr, size) _test_realloc(ptr, size, __FILE__, __LINE__)
+
+extern void _test_free(void* const ptr, const char* file, const int line);
+
+#define free(ptr) _test_free(ptr, __FILE__, __LINE__)
+#endif
+
+LPRBTREENODE RBTree_CreateNode(RBTREEPAIR pair)
+{
+  LPRBTREENODE pNewNode = (LPRBTREENODE)malloc(sizeof(RBTREENODE));
+
+  pNewNode->pair = pair;
+  pNewNode->pParent = NULL;
+  pNewNode->pLeft = NULL;
+  pNewNode->pRight = NULL;
+  pNewNode->color = RBT_RED;  /* New nodes are always red */
+
+  return pNewNode;
+}
+
+void RBTree_LeftRotate(LPRBTREE pTree, LPRBTREENODE pX)
+{
+  LPRBTREENODE pY = pX->pRight;
+  pX->pRight = pY->pLeft;
+
+  if (pY->pLeft) {
+    pY->pLeft->pParent = pX;
+  }
+
+  pY->pParent = pX->pParent;
+
+  if (!pX->pParent) {
+    pTree->pRoot = pY;
+  }
+  else if (pX == pX->pParent->pLeft) {
+    pX->pParent->pLeft = pY;
+  }
+  else {
+    pX->pParent->pRight = pY;
+  }
+
+  pY->pLeft = pX;
+  pX->pParent = pY;
+}
+
+void RBTree_RightRotate(LPRBTREE pTree, LPRBTREENODE pY)
+{
+  LPRBTREENODE pX = pY->pLeft;
+  pY->pLeft = pX->pRight;
+
+  if (pX->pRight) {
+    pX->pRight->pParent = pY;
+  }
+
+  pX->pParent = pY->pParent;
+
+  if (!pY->pParent) {
+    pTree->pRoot = pX;
+  }
+  else if (pY == pY->pParent->pLeft) {
+    pY->pParent->pLeft = pX;
+  }
+  else {
+    pY->pParent->pRight = pX;
+  }
+
+  pX->pRight = pY;
+  pY->pParent = pX;
+}
+
+void RBTree_InsertFixup(LPRBTREE pTree, LPRBTREENODE pZ)
+{
+  while (pZ->pParent && pZ->pParent->color == RBT_RED) {
+    if (pZ->pParent == pZ->pParent->pParent->pLeft) {
+
+      LPRBTREENODE pY = pZ->pParent->pParent->pRight;
+      if (pY && pY->color == RBT_RED) {
+        pZ->pParent->color = RBT_BLACK;
+        pY->color = RBT_BLACK;
+        pZ->pParent->pParent->color = RBT_RED;
+        pZ = pZ->pParent->pParent;
+      }
+      else {
+        if (pZ == pZ->pParent->pRight) {
+          pZ = pZ->pParent;
+          RBTree_LeftRotate(pTree, pZ);
+        }
+        pZ->pParent->color = RBT_BLACK;
+        pZ->pParent->pParent->color = RBT_RED;
+        RBTree_RightRotate(pTree, pZ->pParent->pParent);
+      }
+    }
+    else {
+      LPRBTREENODE pY = pZ->pParent->pParent->pLeft;
+      if (pY && pY->color == RBT_RED) {
+        pZ->pParent->color = RBT_BLACK;
+        pY->color = RBT_BLACK;
+        pZ->pParent->pParent->color = RBT_RED;
+        pZ = pZ->pParent->pParent;
+      }
+      else {
+        if (pZ == pZ->pParent->pLeft) {
+          pZ = pZ->pParent;
+          RBTree_RightRotate(pTree, pZ);
+        }
+        pZ->pParent->color = RBT_BLACK;
+        pZ->pParent->pParent->color = RBT_RED;
+        RBTree_LeftRotate(pTree, pZ->pParent->pParent);
+      }
+    }
+  }
+  pTree->pRoot->color = RBT_BLACK;
+}
+
+void RBTree_InsertNode(LPRBTREE pTree, LPRBTREENODE pZ)
+{
+  LPRBTREENODE pY = NULL;
+  LPRBTREENODE pX = pTree->pRoot;
+
+  while (pX) {
+    pY = pX;
+    if (pTree->compare(pZ->pair.pKey, pZ->pair.keySize, pX->pair.pKey, pX->pair.keySize) < 0) {
+      pX = pX->pLeft;
+    }
+    else {
+      pX = pX->pRight;
+    }
+  }
+
+  pZ->pParent = pY;
+  if (!pY) {
+    pTree->pRoot = pZ;
+  }
+  else if (pTree->compare(pZ->pair.pKey, pZ->pair.keySize, pY->pair.pKey, pY->pair.keySize) < 0) {
+    pY->pLeft = pZ;
+  }
+  else {
+    pY->pRight = pZ;
+  }
+
+  RBTree_InsertFixup(pTree, pZ);
+}
+
+void InitializeRBTree(LPRBTREE pTree, size_t keySize, int (*compare)(const void*, size_t, const void*, size_t)) {
+  pTree->pRoot = NULL;
+  pTree->keySize = keySize;
+  pTree->compare = compare;
+}
+
+LPRBTREENODE RBTree_SearchNode(LPRBTREE pTree, const void* pKey, size_t keySize)
+{
+  LPRBTREENODE pCurrent = pTree->pRoot;
+
+  while (pCurrent) {
+    int cmp = pTree->compare(pKey, keySize, pCurrent->pair.pKey, pCurrent->pair.keySize);
+    if (cmp == 0) {
+      return pCurrent;
+    }
+    else if (cmp < 0) {
+      pCurrent = pCurrent->pLeft;
+    }
+    else {
+      pCurrent = pCurrent->pRight;
+    }
+  }
+
+  return NULL;
+}
+
+void RBTree_Insert(LPRBTREE pTree, const void* pKey, void* pValue, size_t valueSize)
+{
+  LPRBTREENODE pExistingNode = RBTree_SearchNode(pTree, pKey, pTree->keySize);
+
+  /* If the key already exists, update the value */
+  if (pExistingNode) {
+    pExistingNode->pair.pValue = realloc(pExistingNode->pair.pValue, valueSize);
+    memcpy(pExistingNode->pair.pValue, pValue, valueSize);
+    pExistingNode->pair.valueSize = valueSize;
+  }
+  else {
+    RBTREEPAIR pair;
+    pair.pKey = malloc(pTree->keySize);
+    memcpy(pair.pKey, pKey, pTree->keySize);
+    pair.pValue = malloc(valueSize);
+    memcpy(pair.pValue, pValue, valueSize);
+    pair.keySize = pTree->keySize;
+    pair.valueSize = valueSize;
+
+    LPRBTREENODE pNewNode = RBTree_CreateNode(pair);
+    RBTree_InsertNode(pTree, pNewNode);
+  }
+}
+
+/* Get the value associated with a key from the Red-Black Tree */
+void* RBTree_Get(LPRBTREE pTree, const void* pKey)
+{
+  LPRBTREENODE pNode = RBTree_SearchNode(pTree, pKey, pTree->keySize);
+  return pNode ? pNode->pair.pValue : NULL;
+}
+
+void RBTree_FreeMemory(LPRBTREENODE pNode) {
+  if (pNode) {
+    RBTree_FreeMemory(pNode->pLeft);
+    RBTree_FreeMemory(pNode->pRight);
+    free(pNode->pair.pKey);
+    free(pNode->pair.pValue);
+    free(pNode);
+  }
+}
+
+void RBTree_Cleanup(LPRBTREE pTree)
+{
+  RBTree_FreeMemory(pTree->pRoot);
+  pTree->pRoot = NULL;
+}
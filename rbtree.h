@@ -0,0 +1,56 @@
+/*
+ * rbtree.h
+ *
+ * Ordered key/value map backed by a red-black tree
+ */
+
+#ifndef PANIVIEW_RBTREE_H
+#define PANIVIEW_RBTREE_H
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+enum {
+  RBT_RED,
+  RBT_BLACK
+};
+
+typedef struct _tagRBTREEPAIR RBTREEPAIR, * LPRBTREEPAIR;
+typedef struct _tagRBTREENODE RBTREENODE, * LPRBTREENODE;
+typedef struct _tagRBTREE RBTREE, * LPRBTREE;
+
+struct _tagRBTREEPAIR {
+  void* pKey;
+  void* pValue;
+  size_t keySize;
+  size_t valueSize;
+};
+
+struct _tagRBTREENODE {
+  RBTREEPAIR pair;
+  LPRBTREENODE pParent;
+  LPRBTREENODE pLeft;
+  LPRBTREENODE pRight;
+  int color;
+};
+
+struct _tagRBTREE {
+  LPRBTREENODE pRoot;
+  size_t keySize;
+  int (*compare)(const void* key1, size_t key1Size, const void* key2, size_t key2Size);
+};
+
+LPRBTREENODE RBTree_CreateNode(RBTREEPAIR pair);
+void RBTree_LeftRotate(LPRBTREE pTree, LPRBTREENODE pX);
+void RBTree_RightRotate(LPRBTREE pTree, LPRBTREENODE pY);
+void RBTree_InsertFixup(LPRBTREE pTree, LPRBTREENODE pZ);
+void RBTree_InsertNode(LPRBTREE pTree, LPRBTREENODE pZ);
+void InitializeRBTree(LPRBTREE pTree, size_t keySize, int (*compare)(const void*, size_t, const void*, size_t));
+LPRBTREENODE RBTree_SearchNode(LPRBTREE pTree, const void* pKey, size_t keySize);
+void RBTree_Insert(LPRBTREE pTree, const void* pKey, void* pValue, size_t valueSize);
+void* RBTree_Get(LPRBTREE pTree, const void* pKey);
+void RBTree_FreeMemory(LPRBTREENODE pNode);
+void RBTree_Cleanup(LPRBTREE pTree);
+
+#endif  /* PANIVIEW_RBTREE_H */
@@ -0,0 +1,858 @@
+#include "resample.h"
+#include "pixconv.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RESAMPLE_X86
+#include <immintrin.h>
+#endif
+
+#if defined(RESAMPLE_X86) && (defined(__GNUC__) || defined(__clang__))
+#define RESAMPLE_TARGET_SSE2 __attribute__((target("sse2")))
+#define RESAMPLE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define RESAMPLE_TARGET_SSE2
+#define RESAMPLE_TARGET_AVX2
+#endif
+
+/* Helpers shared by the SSE2 and AVX2 kernels must be compiled into the
+ * caller: a call from AVX2 code into SSE2-only code switches encodings,
+ * which some CPUs make very expensive. */
+#if defined(__GNUC__) || defined(__clang__)
+#define RESAMPLE_INLINE static inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define RESAMPLE_INLINE static __forceinline
+#else
+#define RESAMPLE_INLINE static inline
+#endif
+
+#ifdef UNIT_TESTING
+extern void* _test_malloc(const size_t size, const char* file, const int line);
+
+#define malloc(size) _test_malloc(size, __FILE__, __LINE__)
+
+extern void* _test_calloc(const size_t num, const size_t size, const char* file,
+  const int line);
+
+#define calloc(num, size) _test_calloc(num, size, __FILE__, __LINE__)
+
+extern void* _test_realloc(void* const ptr, const size_t size, const char* file,
+  const int line);
+
+#define realloc(ptr, size) _test_realloc(ptr, size, __FILE__, __LINE__)
+
+extern void _test_free(void* const ptr, const char* file, const int line);
+
+#define free(ptr) _test_free(ptr, __FILE__, __LINE__)
+#endif
+
+#define RESAMPLE_ONE (1 << RESAMPLE_WEIGHT_BITS)
+#define RESAMPLE_ROUND (1 << (RESAMPLE_WEIGHT_BITS - 1))
+
+/* Rows per band below which splitting costs more than it saves */
+#define RESAMPLE_MIN_ROWS_PER_BAND 16
+
+/* Premultiplied output needs colour <= alpha, which ringing filters break */
+typedef void (*RESAMPLEHORZFUNC)(const uint8_t* pSrc, uint8_t* pDst, const RESAMPLEAXIS* pAxis,
+    int bPremultiplied);
+typedef void (*RESAMPLEVERTFUNC)(const uint8_t* const* ppRows, uint8_t* pDst, size_t nBytes,
+    const int16_t* pWeights, size_t nTaps, int bPremultiplied);
+
+static const double g_resampleSupport[RESAMPLE_FILTER_COUNT] = { 0.5, 1.0, 2.0, 3.0 };
+
+static double Resample_Sinc(double x)
+{
+  const double pi = 3.14159265358979323846;
+
+  if (x == 0.0) {
+    return 1.0;
+  }
+
+  x *= pi;
+  return sin(x) / x;
+}
+
+static double Resample_Kernel(int nFilter, double x)
+{
+  double t = fabs(x);
+
+  switch (nFilter) {
+  case RESAMPLE_FILTER_BOX:
+    return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+  case RESAMPLE_FILTER_BILINEAR:
+    return t < 1.0 ? 1.0 - t : 0.0;
+  case RESAMPLE_FILTER_BICUBIC:
+    /* Catmull-Rom, a = -0.5 */
+    if (t < 1.0) {
+      return (1.5 * t - 2.5) * t * t + 1.0;
+    }
+    if (t < 2.0) {
+      return ((-0.5 * t + 2.5) * t - 4.0) * t + 2.0;
+    }
+    return 0.0;
+  case RESAMPLE_FILTER_LANCZOS3:
+    return t < 3.0 ? Resample_Sinc(x) * Resample_Sinc(x / 3.0) : 0.0;
+  }
+
+  return 0.0;
+}
+
+static void Resample_CleanupAxis(LPRESAMPLEAXIS pAxis)
+{
+  free(pAxis->pStart);
+  free(pAxis->pWeights);
+  memset(pAxis, 0, sizeof(RESAMPLEAXIS));
+}
+
+/*
+ * Resample_InitAxis
+ *
+ * Every output gets the same number of taps, with its window moved inside
+ * the source and the weights padded with zeros, so the kernels never test
+ * for the edges. The fixed-point weights of an output sum to exactly one.
+ * Only the nCount outputs from nFirst on of the nDst scaled ones are planned.
+ */
+static int Resample_InitAxis(LPRESAMPLEAXIS pAxis, size_t nSrc, size_t nDst, size_t nFirst, size_t nCount,
+    int nFilter)
+{
+  memset(pAxis, 0, sizeof(RESAMPLEAXIS));
+  pAxis->nSrc = nSrc;
+  pAxis->nDst = nCount;
+
+  /* A plain copy needs no weights at all */
+  if (nSrc == nDst && nCount == nDst) {
+    pAxis->bIdentity = 1;
+    pAxis->nTaps = 1;
+    return RESAMPLE_OK;
+  }
+
+  double scale = (double)nSrc / (double)nDst;
+  double filterScale = scale < 1.0 ? 1.0 : scale;
+  double support = g_resampleSupport[nFilter] * filterScale;
+
+  size_t nTaps = (size_t)ceil(support) * 2 + 1;
+  if (nTaps > nSrc) {
+    nTaps = nSrc;
+  }
+
+  pAxis->nTaps = nTaps;
+  pAxis->pStart = (uint32_t*)malloc(nCount * sizeof(uint32_t));
+  pAxis->pWeights = (int16_t*)calloc(nCount * nTaps, sizeof(int16_t));
+  double* pKernel = (double*)malloc(nTaps * sizeof(double));
+  if (!pAxis->pStart || !pAxis->pWeights || !pKernel) {
+    free(pKernel);
+    Resample_CleanupAxis(pAxis);
+    return RESAMPLE_ERROR_MEMORY;
+  }
+
+  for (size_t x = 0; x < nCount; ++x) {
+    double center = ((double)(nFirst + x) + 0.5) * scale;
+    double first = center - support + 0.5;
+    double last = center + support + 0.5;
+
+    size_t lo = first < 0.0 ? 0 : (size_t)first;
+    size_t hi = last > (double)nSrc ? nSrc : (size_t)last;
+    if (hi - lo > nTaps) {
+      hi = lo + nTaps;
+    }
+
+    double sum = 0.0;
+    for (size_t i = lo; i < hi; ++i) {
+      pKernel[i - lo] = Resample_Kernel(nFilter, ((double)i + 0.5 - center) / filterScale);
+      sum += pKernel[i - lo];
+    }
+
+    size_t start = lo + nTaps > nSrc ? nSrc - nTaps : lo;
+    int16_t* pWeights = pAxis->pWeights + x * nTaps + (lo - start);
+    pAxis->pStart[x] = (uint32_t)start;
+
+    /* Rounding leftovers go to the largest weight */
+    int total = 0;
+    size_t nLargest = 0;
+    for (size_t i = 0; i < hi - lo; ++i) {
+      double w = sum != 0.0 ? pKernel[i] / sum * RESAMPLE_ONE : 0.0;
+      pWeights[i] = (int16_t)(w >= 0.0 ? (int)(w + 0.5) : -(int)(0.5 - w));
+      total += pWeights[i];
+      if (abs(pWeights[i]) > abs(pWeights[nLargest])) {
+        nLargest = i;
+      }
+    }
+    pWeights[nLargest] = (int16_t)(pWeights[nLargest] + RESAMPLE_ONE - total);
+  }
+
+  free(pKernel);
+  return RESAMPLE_OK;
+}
+
+static inline uint8_t Resample_Clamp(int32_t v)
+{
+  v >>= RESAMPLE_WEIGHT_BITS;
+  return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+/*******************
+ *  Scalar kernels *
+ *******************/
+
+static void Resample_HorzBGRA_Scalar(const uint8_t* pSrc, uint8_t* pDst, const RESAMPLEAXIS* pAxis,
+    int bPremultiplied)
+{
+  const uint32_t* pStart = pAxis->pStart;
+  const int16_t* pWeights = pAxis->pWeights;
+  size_t nTaps = pAxis->nTaps;
+  size_t nDst = pAxis->nDst;
+
+  for (size_t x = 0; x < nDst; ++x, pDst += 4) {
+    const uint8_t* s = pSrc + (size_t)pStart[x] * 4;
+    const int16_t* w = pWeights + x * nTaps;
+
+    int32_t b = RESAMPLE_ROUND, g = RESAMPLE_ROUND, r = RESAMPLE_ROUND, a = RESAMPLE_ROUND;
+    for (size_t k = 0; k < nTaps; ++k, s += 4) {
+      b += w[k] * s[0];
+      g += w[k] * s[1];
+      r += w[k] * s[2];
+      a += w[k] * s[3];
+    }
+
+    pDst[0] = Resample_Clamp(b);
+    pDst[1] = Resample_Clamp(g);
+    pDst[2] = Resample_Clamp(r);
+    pDst[3] = Resample_Clamp(a);
+    if (bPremultiplied) {
+      for (int c = 0; c < 3; ++c) {
+        if (pDst[c] > pDst[3]) {
+          pDst[c] = pDst[3];
+        }
+      }
+    }
+  }
+}
+
+static void Resample_HorzGray_Scalar(const uint8_t* pSrc, uint8_t* pDst, const RESAMPLEAXIS* pAxis,
+    int bPremultiplied)
+{
+  const uint32_t* pStart = pAxis->pStart;
+  const int16_t* pWeights = pAxis->pWeights;
+  size_t nTaps = pAxis->nTaps;
+  size_t nDst = pAxis->nDst;
+
+  (void)bPremultiplied;
+
+  for (size_t x = 0; x < nDst; ++x) {
+    const uint8_t* s = pSrc + pStart[x];
+    const int16_t* w = pWeights + x * nTaps;
+
+    int32_t v = RESAMPLE_ROUND;
+    for (size_t k = 0; k < nTaps; ++k) {
+      v += w[k] * s[k];
+    }
+
+    pDst[x] = Resample_Clamp(v);
+  }
+}
+
+/* Byte-wise over a row; the channel layout only matters for the alpha clamp */
+static void Resample_Vert_Scalar(const uint8_t* const* ppRows, uint8_t* pDst, size_t nBytes,
+    const int16_t* pWeights, size_t nTaps, int bPremultiplied)
+{
+  for (size_t x = 0; x < nBytes; ++x) {
+    int32_t v = RESAMPLE_ROUND;
+    for (size_t k = 0; k < nTaps; ++k) {
+      v += pWeights[k] * ppRows[k][x];
+    }
+    pDst[x] = Resample_Clamp(v);
+  }
+
+  if (bPremultiplied) {
+    for (size_t x = 0; x + 4 <= nBytes; x += 4) {
+      for (int c = 0; c < 3; ++c) {
+        if (pDst[x + c] > pDst[x + 3]) {
+          pDst[x + c] = pDst[x + 3];
+        }
+      }
+    }
+  }
+}
+
+#ifdef RESAMPLE_X86
+
+/*****************
+ *  SSE2 kernels *
+ *****************/
+
+/* Weight pair for _mm_madd_epi16 against interleaved samples */
+RESAMPLE_INLINE int Resample_PackWeights(int16_t w0, int16_t w1)
+{
+  return (int)((uint32_t)(uint16_t)w0 | ((uint32_t)(uint16_t)w1 << 16));
+}
+
+RESAMPLE_INLINE int Resample_Load32(const uint8_t* p)
+{
+  int v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+RESAMPLE_TARGET_SSE2
+RESAMPLE_INLINE __m128i Resample_ClampToAlpha_SSE2(__m128i px)
+{
+  __m128i a = _mm_srli_epi32(px, 24);
+  a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+  a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+  return _mm_min_epu8(px, a);
+}
+
+/* Two taps per step: BGRA of both pixels interleaved as b0 b1 g0 g1 ... */
+RESAMPLE_TARGET_SSE2
+RESAMPLE_INLINE __m128i Resample_HorzPixel_SSE2(const uint8_t* s, const int16_t* w, size_t k, size_t nTaps, __m128i acc)
+{
+  const __m128i zero = _mm_setzero_si128();
+
+  for (; k + 1 < nTaps; k += 2) {
+    __m128i px = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(s + k * 4)), zero);
+    px = _mm_unpacklo_epi16(px, _mm_srli_si128(px, 8));
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(px, _mm_set1_epi32(Resample_Load32((const uint8_t*)(w + k)))));
+  }
+
+  if (k < nTaps) {
+    __m128i px = _mm_unpacklo_epi8(_mm_cvtsi32_si128(Resample_Load32(s + k * 4)), zero);
+    px = _mm_unpacklo_epi16(px, zero);
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(px, _mm_set1_epi32(Resample_PackWeights(w[k], 0))));
+  }
+
+  return acc;
+}
+
+RESAMPLE_TARGET_SSE2
+RESAMPLE_INLINE void Resample_StorePixel_SSE2(uint8_t* pDst, __m128i acc, int bPremultiplied)
+{
+  acc = _mm_srai_epi32(acc, RESAMPLE_WEIGHT_BITS);
+  acc = _mm_packs_epi32(acc, acc);
+  __m128i px = _mm_packus_epi16(acc, acc);
+  if (bPremultiplied) {
+    px = Resample_ClampToAlpha_SSE2(px);
+  }
+
+  int v = _mm_cvtsi128_si32(px);
+  memcpy(pDst, &v, sizeof(v));
+}
+
+RESAMPLE_TARGET_SSE2
+static void Resample_HorzBGRA_SSE2(const uint8_t* pSrc, uint8_t* pDst, const RESAMPLEAXIS* pAxis,
+    int bPremultiplied)
+{
+  const uint32_t* pStart = pAxis->pStart;
+  const int16_t* pWeights = pAxis->pWeights;
+  size_t nTaps = pAxis->nTaps;
+  size_t nDst = pAxis->nDst;
+
+  for (size_t x = 0; x < nDst; ++x, pDst += 4) {
+    const uint8_t* s = pSrc + (size_t)pStart[x] * 4;
+    const int16_t* w = pWeights + x * nTaps;
+
+    __m128i acc = Resample_HorzPixel_SSE2(s, w, 0, nTaps, _mm_set1_epi32(RESAMPLE_ROUND));
+    Resample_StorePixel_SSE2(pDst, acc, bPremultiplied);
+  }
+}
+
+RESAMPLE_TARGET_SSE2
+RESAMPLE_INLINE int32_t Resample_Sum_SSE2(__m128i v)
+{
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(v);
+}
+
+RESAMPLE_TARGET_SSE2
+static void Resample_HorzGray_SSE2(const uint8_t* pSrc, uint8_t* pDst, const RESAMPLEAXIS* pAxis,
+    int bPremultiplied)
+{
+  const uint32_t* pStart = pAxis->pStart;
+  const int16_t* pWeights = pAxis->pWeights;
+  size_t nTaps = pAxis->nTaps;
+  size_t nDst = pAxis->nDst;
+  const __m128i zero = _mm_setzero_si128();
+  (void)bPremultiplied;
+
+  for (size_t x = 0; x < nDst; ++x) {
+    const uint8_t* s = pSrc + pStart[x];
+    const int16_t* w = pWeights + x * nTaps;
+
+    __m128i acc = _mm_setzero_si128();
+    size_t k = 0;
+    for (; k + 8 <= nTaps; k += 8) {
+      __m128i px = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(s + k)), zero);
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(px, _mm_loadu_si128((const __m128i*)(w + k))));
+    }
+
+    int32_t v = RESAMPLE_ROUND + Resample_Sum_SSE2(acc);
+    for (; k < nTaps; ++k) {
+      v += w[k] * s[k];
+    }
+
+    pDst[x] = Resample_Clamp(v);
+  }
+}
+
+/* Two rows per step, 16 bytes per column block */
+RESAMPLE_TARGET_SSE2
+static void Resample_Vert_SSE2(const uint8_t* const* ppRows, uint8_t* pDst, size_t nBytes,
+    const int16_t* pWeights, size_t nTaps, int bPremultiplied)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i round = _mm_set1_epi32(RESAMPLE_ROUND);
+
+  size_t x = 0;
+  for (; x + 16 <= nBytes; x += 16) {
+    __m128i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+
+    size_t k = 0;
+    for (; k + 1 < nTaps; k += 2) {
+      __m128i r0 = _mm_loadu_si128((const __m128i*)(ppRows[k] + x));
+      __m128i r1 = _mm_loadu_si128((const __m128i*)(ppRows[k + 1] + x));
+      __m128i w = _mm_set1_epi32(Resample_PackWeights(pWeights[k], pWeights[k + 1]));
+
+      __m128i lo = _mm_unpacklo_epi8(r0, r1);
+      __m128i hi = _mm_unpackhi_epi8(r0, r1);
+      acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), w));
+      acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), w));
+      acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), w));
+      acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), w));
+    }
+
+    if (k < nTaps) {
+      __m128i r0 = _mm_loadu_si128((const __m128i*)(ppRows[k] + x));
+      __m128i w = _mm_set1_epi32(Resample_PackWeights(pWeights[k], 0));
+
+      __m128i lo = _mm_unpacklo_epi8(r0, zero);
+      __m128i hi = _mm_unpackhi_epi8(r0, zero);
+      acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(lo, zero), w));
+      acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(lo, zero), w));
+      acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi16(hi, zero), w));
+      acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi16(hi, zero), w));
+    }
+
+    acc0 = _mm_srai_epi32(acc0, RESAMPLE_WEIGHT_BITS);
+    acc1 = _mm_srai_epi32(acc1, RESAMPLE_WEIGHT_BITS);
+    acc2 = _mm_srai_epi32(acc2, RESAMPLE_WEIGHT_BITS);
+    acc3 = _mm_srai_epi32(acc3, RESAMPLE_WEIGHT_BITS);
+    __m128i px = _mm_packus_epi16(_mm_packs_epi32(acc0, acc1), _mm_packs_epi32(acc2, acc3));
+    if (bPremultiplied) {
+      px = Resample_ClampToAlpha_SSE2(px);
+    }
+    _mm_storeu_si128((__m128i*)(pDst + x), px);
+  }
+
+  if (x < nBytes) {
+    const uint8_t* rows[2048];
+    if (nTaps <= sizeof(rows) / sizeof(rows[0])) {
+      for (size_t k = 0; k < nTaps; ++k) {
+        rows[k] = ppRows[k] + x;
+      }
+      Resample_Vert_Scalar(rows, pDst + x, nBytes - x, pWeights, nTaps, bPremultiplied);
+    }
+  }
+}
+
+/*****************
+ *  AVX2 kernels *
+ *****************/
+
+RESAMPLE_TARGET_AVX2
+RESAMPLE_INLINE __m256i Resample_ClampToAlpha_AVX2(__m256i px)
+{
+  __m256i a = _mm256_srli_epi32(px, 24);
+  a = _mm256_or_si256(a, _mm256_slli_epi32(a, 8));
+  a = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+  return _mm256_min_epu8(px, a);
+}
+
+/* Four taps per step, a pair in each lane */
+RESAMPLE_TARGET_AVX2
+static void Resample_HorzBGRA_AVX2(const uint8_t* pSrc, uint8_t* pDst, const RESAMPLEAXIS* pAxis,
+    int bPremultiplied)
+{
+  const uint32_t* pStart = pAxis->pStart;
+  const int16_t* pWeights = pAxis->pWeights;
+  size_t nTaps = pAxis->nTaps;
+  size_t nDst = pAxis->nDst;
+  const __m256i interleave = _mm256_setr_epi8(
+      0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15,
+      0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+  const __m256i pairs = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+
+  for (size_t x = 0; x < nDst; ++x, pDst += 4) {
+    const uint8_t* s = pSrc + (size_t)pStart[x] * 4;
+    const int16_t* w = pWeights + x * nTaps;
+
+    __m256i acc = _mm256_setzero_si256();
+    size_t k = 0;
+    for (; k + 4 <= nTaps; k += 4) {
+      __m256i px = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(s + k * 4)));
+      px = _mm256_shuffle_epi8(px, interleave);
+      /* Weights w0 w1 in the low lane, w2 w3 in the high one */
+      __m256i wk = _mm256_castsi128_si256(_mm_loadl_epi64((const __m128i*)(w + k)));
+      wk = _mm256_permutevar8x32_epi32(wk, pairs);
+      acc = _mm256_add_epi32(acc, _mm256_madd_epi16(px, wk));
+    }
+
+    __m128i acc128 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    acc128 = _mm_add_epi32(acc128, _mm_set1_epi32(RESAMPLE_ROUND));
+    acc128 = Resample_HorzPixel_SSE2(s, w, k, nTaps, acc128);
+    Resample_StorePixel_SSE2(pDst, acc128, bPremultiplied);
+  }
+}
+
+RESAMPLE_TARGET_AVX2
+static void Resample_HorzGray_AVX2(const uint8_t* pSrc, uint8_t* pDst, const RESAMPLEAXIS* pAxis,
+    int bPremultiplied)
+{
+  const uint32_t* pStart = pAxis->pStart;
+  const int16_t* pWeights = pAxis->pWeights;
+  size_t nTaps = pAxis->nTaps;
+  size_t nDst = pAxis->nDst;
+  const __m128i zero = _mm_setzero_si128();
+  (void)bPremultiplied;
+
+  for (size_t x = 0; x < nDst; ++x) {
+    const uint8_t* s = pSrc + pStart[x];
+    const int16_t* w = pWeights + x * nTaps;
+
+    __m256i acc = _mm256_setzero_si256();
+    size_t k = 0;
+    for (; k + 16 <= nTaps; k += 16) {
+      __m256i px = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(s + k)));
+      acc = _mm256_add_epi32(acc, _mm256_madd_epi16(px, _mm256_loadu_si256((const __m256i*)(w + k))));
+    }
+
+    __m128i acc128 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    for (; k + 8 <= nTaps; k += 8) {
+      __m128i px = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(s + k)), zero);
+      acc128 = _mm_add_epi32(acc128, _mm_madd_epi16(px, _mm_loadu_si128((const __m128i*)(w + k))));
+    }
+
+    int32_t v = RESAMPLE_ROUND + Resample_Sum_SSE2(acc128);
+    for (; k < nTaps; ++k) {
+      v += w[k] * s[k];
+    }
+
+    pDst[x] = Resample_Clamp(v);
+  }
+}
+
+/* Same as the SSE2 kernel over 32 bytes; the in-lane unpacks and packs cancel out */
+RESAMPLE_TARGET_AVX2
+static void Resample_Vert_AVX2(const uint8_t* const* ppRows, uint8_t* pDst, size_t nBytes,
+    const int16_t* pWeights, size_t nTaps, int bPremultiplied)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i round = _mm256_set1_epi32(RESAMPLE_ROUND);
+
+  size_t x = 0;
+  for (; x + 32 <= nBytes; x += 32) {
+    __m256i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+
+    size_t k = 0;
+    for (; k + 1 < nTaps; k += 2) {
+      __m256i r0 = _mm256_loadu_si256((const __m256i*)(ppRows[k] + x));
+      __m256i r1 = _mm256_loadu_si256((const __m256i*)(ppRows[k + 1] + x));
+      __m256i w = _mm256_set1_epi32(Resample_PackWeights(pWeights[k], pWeights[k + 1]));
+
+      __m256i lo = _mm256_unpacklo_epi8(r0, r1);
+      __m256i hi = _mm256_unpackhi_epi8(r0, r1);
+      acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), w));
+      acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), w));
+      acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), w));
+      acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), w));
+    }
+
+    if (k < nTaps) {
+      __m256i r0 = _mm256_loadu_si256((const __m256i*)(ppRows[k] + x));
+      __m256i w = _mm256_set1_epi32(Resample_PackWeights(pWeights[k], 0));
+
+      __m256i lo = _mm256_unpacklo_epi8(r0, zero);
+      __m256i hi = _mm256_unpackhi_epi8(r0, zero);
+      acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi16(lo, zero), w));
+      acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi16(lo, zero), w));
+      acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi16(hi, zero), w));
+      acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi16(hi, zero), w));
+    }
+
+    acc0 = _mm256_srai_epi32(acc0, RESAMPLE_WEIGHT_BITS);
+    acc1 = _mm256_srai_epi32(acc1, RESAMPLE_WEIGHT_BITS);
+    acc2 = _mm256_srai_epi32(acc2, RESAMPLE_WEIGHT_BITS);
+    acc3 = _mm256_srai_epi32(acc3, RESAMPLE_WEIGHT_BITS);
+    __m256i px = _mm256_packus_epi16(_mm256_packs_epi32(acc0, acc1), _mm256_packs_epi32(acc2, acc3));
+    if (bPremultiplied) {
+      px = Resample_ClampToAlpha_AVX2(px);
+    }
+    _mm256_storeu_si256((__m256i*)(pDst + x), px);
+  }
+
+  if (x < nBytes) {
+    const uint8_t* rows[2048];
+    if (nTaps <= sizeof(rows) / sizeof(rows[0])) {
+      for (size_t k = 0; k < nTaps; ++k) {
+        rows[k] = ppRows[k] + x;
+      }
+      Resample_Vert_SSE2(rows, pDst + x, nBytes - x, pWeights, nTaps, bPremultiplied);
+    }
+  }
+}
+
+#endif /* RESAMPLE_X86 */
+
+/**************
+ *  Dispatch  *
+ **************/
+
+typedef struct _tagRESAMPLEJOB {
+  LPRESAMPLER pResampler;
+  const uint8_t* pSrc;
+  size_t srcStride;
+  size_t nBytesPerPixel;
+  uint8_t* pDst;
+  size_t dstStride;
+  size_t tempStride;
+  size_t nFirstRow;           /* First source row in the intermediate buffer */
+  RESAMPLEHORZFUNC pfnHorz;
+  RESAMPLEVERTFUNC pfnVert;
+  PIXCONVROWFUNC pfnExpand;   /* Gray to BGRA, on a row of scratch */
+  uint8_t* pScratch;          /* A row of scratch per band, gray only */
+  size_t cbScratch;
+  size_t nRows;               /* Of the pass running */
+  size_t nBands;
+} RESAMPLEJOB;
+
+static void Resample_HorzRows(const RESAMPLEJOB* pJob, size_t nBegin, size_t nEnd)
+{
+  const RESAMPLEAXIS* pAxis = &pJob->pResampler->horz;
+  int bPremultiplied = pJob->nBytesPerPixel == 4;
+
+  for (size_t y = nBegin; y < nEnd; ++y) {
+    const uint8_t* s = pJob->pSrc + (pJob->nFirstRow + y) * pJob->srcStride;
+    uint8_t* d = pJob->pResampler->pTemp + y * pJob->tempStride;
+    if (pAxis->bIdentity) {
+      memcpy(d, s, pJob->tempStride);
+    }
+    else {
+      pJob->pfnHorz(s, d, pAxis, bPremultiplied);
+    }
+  }
+}
+
+static void Resample_VertRows(const RESAMPLEJOB* pJob, size_t nBegin, size_t nEnd, uint8_t* pScratch)
+{
+  const RESAMPLEAXIS* pAxis = &pJob->pResampler->vert;
+  const uint8_t* rows[2048];
+  int bPremultiplied = pJob->nBytesPerPixel == 4;
+
+  for (size_t y = nBegin; y < nEnd; ++y) {
+    uint8_t* d = pJob->pDst + y * pJob->dstStride;
+    uint8_t* pOut = pJob->pfnExpand ? pScratch : d;
+
+    if (pAxis->bIdentity) {
+      memcpy(pOut, pJob->pResampler->pTemp + (y - pJob->nFirstRow) * pJob->tempStride, pJob->tempStride);
+    }
+    else {
+      size_t nTaps = pAxis->nTaps;
+      const uint8_t* pFirst = pJob->pResampler->pTemp + (pAxis->pStart[y] - pJob->nFirstRow) * pJob->tempStride;
+      for (size_t k = 0; k < nTaps; ++k) {
+        rows[k] = pFirst + k * pJob->tempStride;
+      }
+      pJob->pfnVert(rows, pOut, pJob->tempStride, pAxis->pWeights + y * nTaps, nTaps, bPremultiplied);
+    }
+
+    if (pJob->pfnExpand) {
+      pJob->pfnExpand(pScratch, d, pJob->pResampler->horz.nDst);
+    }
+  }
+}
+
+/* Bands [nBegin, nEnd) of the horizontal pass, on whichever thread of the pool takes them */
+static void Resample_HorzBands(void* pArg, size_t nBegin, size_t nEnd)
+{
+  const RESAMPLEJOB* pJob = (const RESAMPLEJOB*)pArg;
+
+  Resample_HorzRows(pJob, pJob->nRows * nBegin / pJob->nBands, pJob->nRows * nEnd / pJob->nBands);
+}
+
+static void Resample_VertBands(void* pArg, size_t nBegin, size_t nEnd)
+{
+  const RESAMPLEJOB* pJob = (const RESAMPLEJOB*)pArg;
+
+  for (size_t i = nBegin; i < nEnd; ++i) {
+    Resample_VertRows(pJob, pJob->nRows * i / pJob->nBands, pJob->nRows * (i + 1) / pJob->nBands,
+        pJob->pScratch ? pJob->pScratch + pJob->cbScratch * i : NULL);
+  }
+}
+
+/*
+ * Resample_Init
+ *
+ * Plan the scaling of a srcWidth x srcHeight image to dstWidth x dstHeight.
+ * The plan can be run any number of times on images of that size.
+ */
+int Resample_Init(LPRESAMPLER pResampler, size_t srcWidth, size_t srcHeight, size_t dstWidth,
+    size_t dstHeight, int nFilter)
+{
+  return Resample_InitRegion(pResampler, srcWidth, srcHeight, dstWidth, dstHeight, 0, 0, dstWidth, dstHeight,
+      nFilter);
+}
+
+int Resample_InitRegion(LPRESAMPLER pResampler, size_t srcWidth, size_t srcHeight, size_t dstWidth,
+    size_t dstHeight, size_t left, size_t top, size_t right, size_t bottom, int nFilter)
+{
+  memset(pResampler, 0, sizeof(RESAMPLER));
+
+  if (!srcWidth || !srcHeight || !dstWidth || !dstHeight || nFilter < 0 || nFilter >= RESAMPLE_FILTER_COUNT ||
+      srcHeight > UINT32_MAX || srcWidth > UINT32_MAX ||
+      left >= right || right > dstWidth || top >= bottom || bottom > dstHeight) {
+    return RESAMPLE_ERROR_INVALID;
+  }
+
+  pResampler->nFilter = nFilter;
+
+  int status = Resample_InitAxis(&pResampler->horz, srcWidth, dstWidth, left, right - left, nFilter);
+  if (status == RESAMPLE_OK) {
+    status = Resample_InitAxis(&pResampler->vert, srcHeight, dstHeight, top, bottom - top, nFilter);
+  }
+
+  /* The vertical kernels keep one row pointer per tap on the stack */
+  if (status == RESAMPLE_OK && pResampler->vert.nTaps > 2048) {
+    status = RESAMPLE_ERROR_UNSUPPORTED;
+  }
+
+  if (status != RESAMPLE_OK) {
+    Resample_Cleanup(pResampler);
+  }
+
+  return status;
+}
+
+void Resample_Cleanup(LPRESAMPLER pResampler)
+{
+  Resample_CleanupAxis(&pResampler->horz);
+  Resample_CleanupAxis(&pResampler->vert);
+  free(pResampler->pTemp);
+  memset(pResampler, 0, sizeof(RESAMPLER));
+}
+
+/*
+ * Resample_Run
+ *
+ * Scale a PIXFMT_PBGRA32 or PIXFMT_GRAY8 image into a PIXFMT_PBGRA32 one.
+ * Both passes are split in bands of rows over pPool, with the calling
+ * thread working along; without a pool it does all of it. Runs of the same
+ * resampler must not overlap.
+ */
+int Resample_Run(LPRESAMPLER pResampler, const void* pSrc, size_t srcStride, int nSrcFormat,
+    void* pDst, size_t dstStride, LPTASKPOOL pPool)
+{
+  RESAMPLEJOB job;
+  memset(&job, 0, sizeof(job));
+  job.pResampler = pResampler;
+  job.pSrc = (const uint8_t*)pSrc;
+  job.srcStride = srcStride;
+  job.pDst = (uint8_t*)pDst;
+  job.dstStride = dstStride;
+
+  int nIsa = PixConv_GetIsa();
+  switch (nSrcFormat) {
+  case PIXFMT_PBGRA32:
+    job.nBytesPerPixel = 4;
+    job.pfnHorz = Resample_HorzBGRA_Scalar;
+#ifdef RESAMPLE_X86
+    if (nIsa >= PIXCONV_ISA_AVX2) {
+      job.pfnHorz = Resample_HorzBGRA_AVX2;
+    }
+    else if (nIsa >= PIXCONV_ISA_SSE2) {
+      job.pfnHorz = Resample_HorzBGRA_SSE2;
+    }
+#endif
+    break;
+  case PIXFMT_GRAY8:
+    job.nBytesPerPixel = 1;
+    job.pfnExpand = PixConv_GetRowFunc(PIXFMT_GRAY8, PIXFMT_PBGRA32);
+    job.pfnHorz = Resample_HorzGray_Scalar;
+#ifdef RESAMPLE_X86
+    if (nIsa >= PIXCONV_ISA_AVX2) {
+      job.pfnHorz = Resample_HorzGray_AVX2;
+    }
+    else if (nIsa >= PIXCONV_ISA_SSE2) {
+      job.pfnHorz = Resample_HorzGray_SSE2;
+    }
+#endif
+    break;
+  default:
+    return RESAMPLE_ERROR_UNSUPPORTED;
+  }
+
+  job.pfnVert = Resample_Vert_Scalar;
+#ifdef RESAMPLE_X86
+  if (nIsa >= PIXCONV_ISA_AVX2) {
+    job.pfnVert = Resample_Vert_AVX2;
+  }
+  else if (nIsa >= PIXCONV_ISA_SSE2) {
+    job.pfnVert = Resample_Vert_SSE2;
+  }
+#endif
+
+  /* Only the source rows some output row reads go through the first pass */
+  const RESAMPLEAXIS* pVert = &pResampler->vert;
+  size_t nLastRow = pVert->nSrc;
+  if (!pVert->bIdentity) {
+    job.nFirstRow = pVert->pStart[0];
+    nLastRow = pVert->pStart[pVert->nDst - 1] + pVert->nTaps;
+  }
+  size_t nTempRows = nLastRow - job.nFirstRow;
+  job.tempStride = pResampler->horz.nDst * job.nBytesPerPixel;
+
+  /* A band for every worker and the calling thread */
+  job.nBands = pPool ? (size_t)TaskPool_GetWorkerCount(pPool) + 1 : 1;
+  size_t nMaxBands = pVert->nDst / RESAMPLE_MIN_ROWS_PER_BAND;
+  if (job.nBands > nMaxBands) {
+    job.nBands = nMaxBands ? nMaxBands : 1;
+  }
+
+  /* Gray output rows are expanded from a scratch row per band */
+  job.cbScratch = job.pfnExpand ? pResampler->horz.nDst : 0;
+  size_t cbTemp = nTempRows * job.tempStride + job.cbScratch * job.nBands;
+  if (cbTemp > pResampler->cbTemp) {
+    free(pResampler->pTemp);
+    pResampler->cbTemp = 0;
+    pResampler->pTemp = (unsigned char*)malloc(cbTemp);
+    if (!pResampler->pTemp) {
+      return RESAMPLE_ERROR_MEMORY;
+    }
+    pResampler->cbTemp = cbTemp;
+  }
+
+  job.pScratch = job.cbScratch ? pResampler->pTemp + nTempRows * job.tempStride : NULL;
+
+  job.nRows = nTempRows;
+  TaskPool_ParallelFor(pPool, 0, job.nBands, 1, Resample_HorzBands, &job);
+  job.nRows = pVert->nDst;
+  TaskPool_ParallelFor(pPool, 0, job.nBands, 1, Resample_VertBands, &job);
+
+  return RESAMPLE_OK;
+}
+
+const char* Resample_GetFilterName(int nFilter)
+{
+  switch (nFilter) {
+  case RESAMPLE_FILTER_BOX:
+    return "box";
+  case RESAMPLE_FILTER_BILINEAR:
+    return "bilinear";
+  case RESAMPLE_FILTER_BICUBIC:
+    return "bicubic";
+  case RESAMPLE_FILTER_LANCZOS3:
+    return "lanczos3";
+  }
+
+  return "unknown";
+}
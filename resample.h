@@ -0,0 +1,77 @@
+/*
+ * resample.h
+ *
+ * Separable image resampling
+ *
+ * A resampler is planned once for a source and destination size: the filter
+ * contributions of every output column and row are computed up front as
+ * fixed-point weights, then each run is a horizontal pass into an
+ * intermediate buffer followed by a vertical pass, both split in bands of
+ * rows over a task pool. The inner loops use the same scalar, SSE2 and
+ * AVX2 level pixconv picks. Premultiplied BGRA32 and 8-bit gray are
+ * accepted; the output is always premultiplied BGRA32, ready to be blitted
+ * 1:1.
+ */
+
+#ifndef PANIVIEW_RESAMPLE_H
+#define PANIVIEW_RESAMPLE_H
+
+#include "taskpool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+  RESAMPLE_OK = 0,
+  RESAMPLE_ERROR_MEMORY = -1,
+  RESAMPLE_ERROR_INVALID = -2,
+  RESAMPLE_ERROR_UNSUPPORTED = -3,
+};
+
+enum {
+  RESAMPLE_FILTER_BOX = 0,
+  RESAMPLE_FILTER_BILINEAR = 1,
+  RESAMPLE_FILTER_BICUBIC = 2,      /* Catmull-Rom */
+  RESAMPLE_FILTER_LANCZOS3 = 3,
+  RESAMPLE_FILTER_COUNT
+};
+
+/* Weights are fixed-point with this many fractional bits */
+#define RESAMPLE_WEIGHT_BITS 14
+
+typedef struct _tagRESAMPLEAXIS RESAMPLEAXIS, *LPRESAMPLEAXIS;
+typedef struct _tagRESAMPLER RESAMPLER, *LPRESAMPLER;
+
+struct _tagRESAMPLEAXIS {
+  size_t nSrc;
+  size_t nDst;                /* Outputs planned, the region's when cropped */
+  size_t nTaps;               /* Same for every output, zero-padded */
+  uint32_t* pStart;           /* First source index of each output */
+  int16_t* pWeights;          /* nDst * nTaps */
+  int bIdentity;              /* Same size, a plain copy */
+};
+
+struct _tagRESAMPLER {
+  RESAMPLEAXIS horz;
+  RESAMPLEAXIS vert;
+  int nFilter;
+  unsigned char* pTemp;       /* Horizontal pass output, kept between runs */
+  size_t cbTemp;
+};
+
+int Resample_Init(LPRESAMPLER pResampler, size_t srcWidth, size_t srcHeight, size_t dstWidth,
+    size_t dstHeight, int nFilter);
+
+/*
+ * Plan only the part left, top to right, bottom of the dstWidth x dstHeight
+ * output, e.g. the part of a zoomed in image the window shows. Runs write
+ * just that part, each pixel as the whole output would have it.
+ */
+int Resample_InitRegion(LPRESAMPLER pResampler, size_t srcWidth, size_t srcHeight, size_t dstWidth,
+    size_t dstHeight, size_t left, size_t top, size_t right, size_t bottom, int nFilter);
+void Resample_Cleanup(LPRESAMPLER pResampler);
+int Resample_Run(LPRESAMPLER pResampler, const void* pSrc, size_t srcStride, int nSrcFormat,
+    void* pDst, size_t dstStride, LPTASKPOOL pPool);
+const char* Resample_GetFilterName(int nFilter);
+
+#endif /* PANIVIEW_RESAMPLE_H */
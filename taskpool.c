@@ -0,0 +1,550 @@
+#include "taskpool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef UNIT_TESTING
+extern void* _test_calloc(const size_t num, const size_t size, const char* file,
+  const int line);
+
+#define calloc(num, size) _test_calloc(num, size, __FILE__, __LINE__)
+
+extern void* _test_realloc(void* const ptr, const size_t size, const char* file,
+  const int line);
+
+#define realloc(ptr, size) _test_realloc(ptr, size, __FILE__, __LINE__)
+
+extern void _test_free(void* const ptr, const char* file, const int line);
+
+#define free(ptr) _test_free(ptr, __FILE__, __LINE__)
+#endif
+
+#define TASKDEQUE_INITIAL_CAPACITY 256
+
+/* Pieces per worker an automatic grain cuts a parallel-for into */
+#define TASKPOOL_PIECES_PER_WORKER 8
+
+/* The worker running on this thread, if any, to queue on its own deque */
+static THREAD_LOCAL LPTASKWORKER g_pCurrentWorker;
+
+static int TaskDeque_Init(LPTASKDEQUE pDeque)
+{
+  memset(pDeque, 0, sizeof(TASKDEQUE));
+
+  pDeque->pTasks = (LPTASK)calloc(TASKDEQUE_INITIAL_CAPACITY, sizeof(TASK));
+  if (!pDeque->pTasks) {
+    return TASKPOOL_ERROR_MEMORY;
+  }
+
+  pDeque->capacity = TASKDEQUE_INITIAL_CAPACITY;
+  Mutex_Init(&pDeque->mutex);
+  return TASKPOOL_OK;
+}
+
+static void TaskDeque_Cleanup(LPTASKDEQUE pDeque)
+{
+  if (pDeque->pTasks) {
+    Mutex_Destroy(&pDeque->mutex);
+    free(pDeque->pTasks);
+  }
+
+  memset(pDeque, 0, sizeof(TASKDEQUE));
+}
+
+/* Doubles the ring when full; the wrapped part moves past the old end */
+static int TaskDeque_PushLocked(LPTASKDEQUE pDeque, const TASK* pTask)
+{
+  size_t count = (size_t)pDeque->nCount;
+  if (count == pDeque->capacity) {
+    LPTASK pTasks = (LPTASK)realloc(pDeque->pTasks, pDeque->capacity * 2 * sizeof(TASK));
+    if (!pTasks) {
+      return TASKPOOL_ERROR_MEMORY;
+    }
+
+    memcpy(pTasks + pDeque->capacity, pTasks, pDeque->head * sizeof(TASK));
+    pDeque->pTasks = pTasks;
+    pDeque->capacity *= 2;
+  }
+
+  pDeque->pTasks[(pDeque->head + count) % pDeque->capacity] = *pTask;
+  Atomic_Store(&pDeque->nCount, (long)count + 1);
+  return TASKPOOL_OK;
+}
+
+static int TaskDeque_Push(LPTASKDEQUE pDeque, const TASK* pTask)
+{
+  Mutex_Lock(&pDeque->mutex);
+  int status = TaskDeque_PushLocked(pDeque, pTask);
+  Mutex_Unlock(&pDeque->mutex);
+
+  return status;
+}
+
+/* Newest first, for the owner */
+static int TaskDeque_PopTail(LPTASKDEQUE pDeque, LPTASK pTask)
+{
+  if (!Atomic_Load(&pDeque->nCount)) {
+    return 0;
+  }
+
+  int bFound = 0;
+  Mutex_Lock(&pDeque->mutex);
+  size_t count = (size_t)pDeque->nCount;
+  if (count) {
+    *pTask = pDeque->pTasks[(pDeque->head + count - 1) % pDeque->capacity];
+    Atomic_Store(&pDeque->nCount, (long)count - 1);
+    bFound = 1;
+  }
+  Mutex_Unlock(&pDeque->mutex);
+
+  return bFound;
+}
+
+/*
+ * The first task of pGroup from the head, or from the tail when bNewest,
+ * for a thread waiting for that group; the tasks behind it close the gap
+ */
+static int TaskDeque_TakeGroup(LPTASKDEQUE pDeque, LPTASKGROUP pGroup, int bNewest, LPTASK pTask)
+{
+  if (!Atomic_Load(&pDeque->nCount)) {
+    return 0;
+  }
+
+  int bFound = 0;
+  Mutex_Lock(&pDeque->mutex);
+  size_t count = (size_t)pDeque->nCount;
+  for (size_t n = 0; n < count && !bFound; ++n) {
+    size_t i = bNewest ? count - 1 - n : n;
+    if (pDeque->pTasks[(pDeque->head + i) % pDeque->capacity].pGroup != pGroup) {
+      continue;
+    }
+
+    *pTask = pDeque->pTasks[(pDeque->head + i) % pDeque->capacity];
+    for (; i + 1 < count; ++i) {
+      pDeque->pTasks[(pDeque->head + i) % pDeque->capacity] = pDeque->pTasks[(pDeque->head + i + 1) % pDeque->capacity];
+    }
+    Atomic_Store(&pDeque->nCount, (long)count - 1);
+    bFound = 1;
+  }
+  Mutex_Unlock(&pDeque->mutex);
+
+  return bFound;
+}
+
+/* Oldest first, half of them and no more than nMax, for thieves */
+static size_t TaskDeque_StealHead(LPTASKDEQUE pDeque, LPTASK pTasks, size_t nMax)
+{
+  if (!Atomic_Load(&pDeque->nCount)) {
+    return 0;
+  }
+
+  Mutex_Lock(&pDeque->mutex);
+  size_t count = (size_t)pDeque->nCount;
+  size_t n = (count + 1) / 2;
+  n = n > nMax ? nMax : n;
+  for (size_t i = 0; i < n; ++i) {
+    pTasks[i] = pDeque->pTasks[(pDeque->head + i) % pDeque->capacity];
+  }
+  pDeque->head = (pDeque->head + n) % pDeque->capacity;
+  Atomic_Store(&pDeque->nCount, (long)(count - n));
+  Mutex_Unlock(&pDeque->mutex);
+
+  return n;
+}
+
+static unsigned int TaskPool_Random(unsigned int* pSeed)
+{
+  unsigned int x = *pSeed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *pSeed = x;
+  return x;
+}
+
+/* Wake a sleeping worker, and the waiting threads that could help too */
+static void TaskPool_NotifyQueued(LPTASKPOOL pPool)
+{
+  /*
+   * nQueued was raised before these are read, and a thread raises these
+   * before it reads nQueued and sleeps, so one of the two sees the other.
+   */
+  int bSleeping = Atomic_Load(&pPool->nSleeping) != 0;
+  int bWaiting = Atomic_Load(&pPool->nWaiting) != 0;
+  if (!bSleeping && !bWaiting) {
+    return;
+  }
+
+  Mutex_Lock(&pPool->mutex);
+  if (bSleeping) {
+    CondVar_Signal(&pPool->workCond);
+  }
+  if (bWaiting) {
+    CondVar_Broadcast(&pPool->doneCond);
+  }
+  Mutex_Unlock(&pPool->mutex);
+}
+
+/* A task left the deques to be run */
+static void TaskPool_Dequeued(LPTASKPOOL pPool, const TASK* pTask)
+{
+  Atomic_Decrement(&pPool->nQueued);
+  if (pTask->pGroup) {
+    Atomic_Decrement(&pTask->pGroup->nQueued);
+  }
+}
+
+/* Counts the task in its group first, so the group can not finish before it runs */
+static int TaskPool_Push(LPTASKPOOL pPool, const TASK* pTask)
+{
+  if (pTask->pGroup) {
+    Atomic_Increment(&pTask->pGroup->nPending);
+    Atomic_Increment(&pTask->pGroup->nQueued);
+  }
+
+  LPTASKWORKER pWorker = g_pCurrentWorker;
+  if (!pWorker || pWorker->pPool != pPool) {
+    unsigned long nNext = (unsigned long)Atomic_Increment(&pPool->nNext);
+    pWorker = &pPool->pWorkers[nNext % pPool->nWorkers];
+  }
+
+  if (TaskDeque_Push(&pWorker->deque, pTask) != TASKPOOL_OK) {
+    if (pTask->pGroup) {
+      Atomic_Decrement(&pTask->pGroup->nQueued);
+      Atomic_Decrement(&pTask->pGroup->nPending);
+    }
+    return TASKPOOL_ERROR_MEMORY;
+  }
+
+  Atomic_Increment(&pPool->nQueued);
+  TaskPool_NotifyQueued(pPool);
+  return TASKPOOL_OK;
+}
+
+/* Queue the upper halves of the range while it is above the grain, then work the rest */
+static void TaskPool_RunRange(LPTASKPOOL pPool, const TASK* pTask)
+{
+  size_t nBegin = pTask->nBegin;
+  size_t nEnd = pTask->nEnd;
+
+  while (nEnd - nBegin > pTask->nGrain) {
+    TASK upper = *pTask;
+    upper.nBegin = nBegin + (nEnd - nBegin) / 2;
+    upper.nEnd = nEnd;
+    if (TaskPool_Push(pPool, &upper) != TASKPOOL_OK) {
+      break;
+    }
+    nEnd = upper.nBegin;
+  }
+
+  pTask->pfnRange(pTask->pArg, nBegin, nEnd);
+}
+
+static void TaskPool_Run(LPTASKPOOL pPool, const TASK* pTask)
+{
+  if (pTask->pfnRun) {
+    pTask->pfnRun(pTask->pArg);
+  }
+  else {
+    TaskPool_RunRange(pPool, pTask);
+  }
+
+  /* The group may be gone once it reaches 0, so only the pool is touched after */
+  if (pTask->pGroup && !Atomic_Decrement(&pTask->pGroup->nPending) && Atomic_Load(&pPool->nWaiting)) {
+    Mutex_Lock(&pPool->mutex);
+    CondVar_Broadcast(&pPool->doneCond);
+    Mutex_Unlock(&pPool->mutex);
+  }
+}
+
+/*
+ * TaskPool_FindTask
+ *
+ * A worker takes from its own deque first. Otherwise it tries every other
+ * deque once starting from a random one, takes half of the first it finds
+ * tasks in, keeps one to run and queues the others on its own deque.
+ */
+static int TaskPool_FindTask(LPTASKPOOL pPool, LPTASKWORKER pWorker, LPTASK pTask)
+{
+  if (TaskDeque_PopTail(&pWorker->deque, pTask)) {
+    TaskPool_Dequeued(pPool, pTask);
+    return 1;
+  }
+
+  if (!Atomic_Load(&pPool->nQueued)) {
+    return 0;
+  }
+
+  unsigned int nStart = TaskPool_Random(&pWorker->seed);
+  for (unsigned int i = 0; i < pPool->nWorkers; ++i) {
+    LPTASKWORKER pVictim = &pPool->pWorkers[(nStart + i) % pPool->nWorkers];
+    if (pVictim == pWorker) {
+      continue;
+    }
+
+    TASK tasks[TASKPOOL_MAX_STEAL];
+    size_t n = TaskDeque_StealHead(&pVictim->deque, tasks, TASKPOOL_MAX_STEAL);
+    if (!n) {
+      continue;
+    }
+
+    /* The rest stay counted in nQueued while they move */
+    *pTask = tasks[0];
+    TaskPool_Dequeued(pPool, pTask);
+    if (n > 1) {
+      Mutex_Lock(&pWorker->deque.mutex);
+      size_t nPushed = 1;
+      while (nPushed < n && TaskDeque_PushLocked(&pWorker->deque, &tasks[nPushed]) == TASKPOOL_OK) {
+        ++nPushed;
+      }
+      Mutex_Unlock(&pWorker->deque.mutex);
+
+      /* Out of memory: run what did not fit right here */
+      for (; nPushed < n; ++nPushed) {
+        TaskPool_Dequeued(pPool, &tasks[nPushed]);
+        TaskPool_Run(pPool, &tasks[nPushed]);
+        Atomic_Increment(&pWorker->nExecuted);
+      }
+    }
+
+    Atomic_Increment(&pWorker->nSteals);
+    Atomic_Add(&pWorker->nStolen, (long)n);
+    return 1;
+  }
+
+  return 0;
+}
+
+/*
+ * TaskPool_FindGroupTask
+ *
+ * A thread waiting for pGroup takes a task of that group only, from its own
+ * deque first when it is a worker, newest first, then from the heads of the
+ * others. Whatever else is queued stays for the workers.
+ */
+static int TaskPool_FindGroupTask(LPTASKPOOL pPool, LPTASKWORKER pWorker, LPTASKGROUP pGroup, LPTASK pTask)
+{
+  if (!Atomic_Load(&pGroup->nQueued)) {
+    return 0;
+  }
+
+  if (pWorker && TaskDeque_TakeGroup(&pWorker->deque, pGroup, 1, pTask)) {
+    TaskPool_Dequeued(pPool, pTask);
+    return 1;
+  }
+
+  unsigned int nStart = pWorker ? pWorker->nIndex : (unsigned int)Atomic_Increment(&pPool->nNext);
+  for (unsigned int i = 0; i < pPool->nWorkers; ++i) {
+    LPTASKWORKER pVictim = &pPool->pWorkers[(nStart + i) % pPool->nWorkers];
+    if (pVictim != pWorker && TaskDeque_TakeGroup(&pVictim->deque, pGroup, 0, pTask)) {
+      TaskPool_Dequeued(pPool, pTask);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static int TaskPool_WorkerThread(void* pArg)
+{
+  LPTASKWORKER pWorker = (LPTASKWORKER)pArg;
+  LPTASKPOOL pPool = pWorker->pPool;
+  g_pCurrentWorker = pWorker;
+
+  for (;;) {
+    TASK task;
+    if (TaskPool_FindTask(pPool, pWorker, &task)) {
+      TaskPool_Run(pPool, &task);
+      Atomic_Increment(&pWorker->nExecuted);
+      continue;
+    }
+
+    /* Sleep until something is queued; quit only once nothing is */
+    Mutex_Lock(&pPool->mutex);
+    Atomic_Increment(&pPool->nSleeping);
+    while (!Atomic_Load(&pPool->nQueued) && !Atomic_Load(&pPool->bQuit)) {
+      CondVar_Wait(&pPool->workCond, &pPool->mutex);
+    }
+    Atomic_Decrement(&pPool->nSleeping);
+    int bQuit = Atomic_Load(&pPool->bQuit) && !Atomic_Load(&pPool->nQueued);
+    Mutex_Unlock(&pPool->mutex);
+
+    if (bQuit) {
+      break;
+    }
+  }
+
+  g_pCurrentWorker = NULL;
+  return 0;
+}
+
+/* Join the first nStarted workers once the queue is drained, and free the pool */
+static void TaskPool_Stop(LPTASKPOOL pPool, unsigned int nStarted)
+{
+  Mutex_Lock(&pPool->mutex);
+  Atomic_Store(&pPool->bQuit, 1);
+  CondVar_Broadcast(&pPool->workCond);
+  Mutex_Unlock(&pPool->mutex);
+
+  for (unsigned int i = 0; i < nStarted; ++i) {
+    Thread_Join(&pPool->pWorkers[i].thread);
+  }
+
+  for (unsigned int i = 0; i < pPool->nWorkers; ++i) {
+    TaskDeque_Cleanup(&pPool->pWorkers[i].deque);
+  }
+
+  CondVar_Destroy(&pPool->doneCond);
+  CondVar_Destroy(&pPool->workCond);
+  Mutex_Destroy(&pPool->mutex);
+  free(pPool->pWorkers);
+  memset(pPool, 0, sizeof(TASKPOOL));
+}
+
+int TaskPool_Init(LPTASKPOOL pPool, unsigned int nWorkers)
+{
+  memset(pPool, 0, sizeof(TASKPOOL));
+
+  if (!nWorkers) {
+    unsigned int nCPUs = Thread_GetCPUCount();
+    nWorkers = nCPUs > 1 ? nCPUs - 1 : 1;
+  }
+
+  pPool->pWorkers = (LPTASKWORKER)calloc(nWorkers, sizeof(TASKWORKER));
+  if (!pPool->pWorkers) {
+    return TASKPOOL_ERROR_MEMORY;
+  }
+
+  for (unsigned int i = 0; i < nWorkers; ++i) {
+    LPTASKWORKER pWorker = &pPool->pWorkers[i];
+    if (TaskDeque_Init(&pWorker->deque) != TASKPOOL_OK) {
+      for (unsigned int j = 0; j < i; ++j) {
+        TaskDeque_Cleanup(&pPool->pWorkers[j].deque);
+      }
+      free(pPool->pWorkers);
+      pPool->pWorkers = NULL;
+      return TASKPOOL_ERROR_MEMORY;
+    }
+
+    pWorker->pPool = pPool;
+    pWorker->nIndex = i;
+    pWorker->seed = 0x9E3779B9u * (i + 1);
+  }
+
+  Mutex_Init(&pPool->mutex);
+  CondVar_Init(&pPool->workCond);
+  CondVar_Init(&pPool->doneCond);
+  pPool->nWorkers = nWorkers;
+
+  /* Started last, so a worker never sees a deque of the pool not set up yet */
+  for (unsigned int i = 0; i < nWorkers; ++i) {
+    if (Thread_Create(&pPool->pWorkers[i].thread, TaskPool_WorkerThread, &pPool->pWorkers[i]) != THREAD_OK) {
+      TaskPool_Stop(pPool, i);
+      return TASKPOOL_ERROR_THREAD;
+    }
+  }
+
+  return TASKPOOL_OK;
+}
+
+void TaskPool_Cleanup(LPTASKPOOL pPool)
+{
+  if (pPool->pWorkers) {
+    TaskPool_Stop(pPool, pPool->nWorkers);
+  }
+}
+
+void TaskGroup_Init(LPTASKGROUP pGroup)
+{
+  pGroup->nPending = 0;
+  pGroup->nQueued = 0;
+}
+
+int TaskPool_Submit(LPTASKPOOL pPool, LPTASKGROUP pGroup, TASKFUNC pfnRun, void* pArg)
+{
+  TASK task;
+  memset(&task, 0, sizeof(TASK));
+  task.pfnRun = pfnRun;
+  task.pArg = pArg;
+  task.pGroup = pGroup;
+
+  return TaskPool_Push(pPool, &task);
+}
+
+void TaskPool_Wait(LPTASKPOOL pPool, LPTASKGROUP pGroup)
+{
+  LPTASKWORKER pWorker = g_pCurrentWorker;
+  if (pWorker && pWorker->pPool != pPool) {
+    pWorker = NULL;
+  }
+
+  while (Atomic_Load(&pGroup->nPending)) {
+    TASK task;
+    if (TaskPool_FindGroupTask(pPool, pWorker, pGroup, &task)) {
+      TaskPool_Run(pPool, &task);
+      Atomic_Increment(pWorker ? &pWorker->nExecuted : &pPool->nExecutedOutside);
+      continue;
+    }
+
+    /* Nothing of the group to help with: sleep until it is done or more of it is queued */
+    Mutex_Lock(&pPool->mutex);
+    Atomic_Increment(&pPool->nWaiting);
+    while (Atomic_Load(&pGroup->nPending) && !Atomic_Load(&pGroup->nQueued)) {
+      CondVar_Wait(&pPool->doneCond, &pPool->mutex);
+    }
+    Atomic_Decrement(&pPool->nWaiting);
+    Mutex_Unlock(&pPool->mutex);
+  }
+}
+
+void TaskPool_ParallelFor(LPTASKPOOL pPool, size_t nBegin, size_t nEnd, size_t nGrain, TASKRANGEFUNC pfnRange,
+    void* pArg)
+{
+  if (nBegin >= nEnd) {
+    return;
+  }
+
+  if (!pPool) {
+    pfnRange(pArg, nBegin, nEnd);
+    return;
+  }
+
+  if (!nGrain) {
+    nGrain = (nEnd - nBegin) / ((size_t)pPool->nWorkers * TASKPOOL_PIECES_PER_WORKER);
+    nGrain = nGrain ? nGrain : 1;
+  }
+
+  TASKGROUP group;
+  TaskGroup_Init(&group);
+
+  TASK task;
+  memset(&task, 0, sizeof(TASK));
+  task.pfnRange = pfnRange;
+  task.pArg = pArg;
+  task.pGroup = &group;
+  task.nBegin = nBegin;
+  task.nEnd = nEnd;
+  task.nGrain = nGrain;
+
+  /* The whole range is this thread's to start with; its pieces count in the group */
+  TaskPool_RunRange(pPool, &task);
+  TaskPool_Wait(pPool, &group);
+}
+
+unsigned int TaskPool_GetWorkerCount(const TASKPOOL* pPool)
+{
+  return pPool->nWorkers;
+}
+
+void TaskPool_GetStats(LPTASKPOOL pPool, LPTASKPOOLSTATS pStats)
+{
+  memset(pStats, 0, sizeof(TASKPOOLSTATS));
+
+  pStats->executed = (uint64_t)Atomic_Load(&pPool->nExecutedOutside);
+  for (unsigned int i = 0; i < pPool->nWorkers; ++i) {
+    LPTASKWORKER pWorker = &pPool->pWorkers[i];
+    pStats->executed += (uint64_t)Atomic_Load(&pWorker->nExecuted);
+    pStats->steals += (uint64_t)Atomic_Load(&pWorker->nSteals);
+    pStats->stolen += (uint64_t)Atomic_Load(&pWorker->nStolen);
+  }
+}
@@ -0,0 +1,137 @@
+/*
+ * taskpool.h
+ *
+ * Work-stealing pool of worker threads
+ *
+ * Every worker owns a deque of tasks. A worker queues the tasks it submits
+ * at the tail of its own deque and takes its work back from there, newest
+ * first, while it is still in cache. An idle worker steals half the deque
+ * of another from the head, oldest first, which for split ranges are the
+ * largest pieces, so one steal feeds it for a while. Tasks submitted from
+ * other threads are dealt round-robin over the workers.
+ *
+ * Tasks count down the TASKGROUP they were submitted with when they finish.
+ * A thread waiting for a group runs queued tasks of that group meanwhile
+ * rather than blocking, so a task can wait for the tasks it submitted, as a
+ * nested parallel-for does, without tying up a worker. Tasks of any other
+ * group are left to the workers: a thread waiting for a short parallel-for
+ * never picks up unrelated work that might take much longer. TaskPool_ParallelFor splits
+ * a range in halves down to a grain size, queueing the upper halves for
+ * others to steal and working through the lower ones itself.
+ */
+
+#ifndef PANIVIEW_TASKPOOL_H
+#define PANIVIEW_TASKPOOL_H
+
+#include "thread.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Most tasks one steal takes */
+#define TASKPOOL_MAX_STEAL 32
+
+enum {
+  TASKPOOL_OK = 0,
+  TASKPOOL_ERROR_MEMORY = -1,
+  TASKPOOL_ERROR_THREAD = -2,
+};
+
+typedef void (*TASKFUNC)(void* pArg);
+typedef void (*TASKRANGEFUNC)(void* pArg, size_t nBegin, size_t nEnd);
+
+typedef struct _tagTASKGROUP TASKGROUP, *LPTASKGROUP;
+typedef struct _tagTASK TASK, *LPTASK;
+typedef struct _tagTASKDEQUE TASKDEQUE, *LPTASKDEQUE;
+typedef struct _tagTASKWORKER TASKWORKER, *LPTASKWORKER;
+typedef struct _tagTASKPOOL TASKPOOL, *LPTASKPOOL;
+typedef struct _tagTASKPOOLSTATS TASKPOOLSTATS, *LPTASKPOOLSTATS;
+
+struct _tagTASKGROUP {
+  volatile long nPending;     /* Submitted and not finished */
+  volatile long nQueued;      /* Submitted and still in a deque */
+};
+
+struct _tagTASK {
+  TASKFUNC pfnRun;            /* NULL for a piece of a parallel-for */
+  TASKRANGEFUNC pfnRange;
+  void* pArg;
+  LPTASKGROUP pGroup;
+  size_t nBegin;
+  size_t nEnd;
+  size_t nGrain;
+};
+
+/* Ring of tasks; the owner works the tail, thieves the head */
+struct _tagTASKDEQUE {
+  MUTEX mutex;
+  LPTASK pTasks;
+  size_t capacity;
+  size_t head;
+  volatile long nCount;       /* Read without the lock to skip empty deques */
+};
+
+struct _tagTASKWORKER {
+  LPTASKPOOL pPool;
+  unsigned int nIndex;
+  unsigned int seed;          /* Picks the victims to steal from */
+  TASKDEQUE deque;
+  THREAD thread;
+  volatile long nExecuted;
+  volatile long nSteals;
+  volatile long nStolen;
+  char padding[64];           /* Keeps neighbouring workers off each other's cache lines */
+};
+
+struct _tagTASKPOOL {
+  LPTASKWORKER pWorkers;
+  unsigned int nWorkers;
+  volatile long nQueued;      /* Tasks in any deque */
+  volatile long nNext;        /* Round-robin for submissions from outside */
+  volatile long nSleeping;    /* Workers waiting on workCond */
+  volatile long nWaiting;     /* Threads waiting on doneCond */
+  volatile long bQuit;
+  volatile long nExecutedOutside;
+  MUTEX mutex;
+  CONDVAR workCond;
+  CONDVAR doneCond;
+};
+
+struct _tagTASKPOOLSTATS {
+  uint64_t executed;          /* Tasks run, by workers and waiting threads */
+  uint64_t steals;            /* Successful steals */
+  uint64_t stolen;            /* Tasks they took */
+};
+
+/*
+ * Start nWorkers threads, or one less than there are CPUs for 0, since the
+ * thread that waits for a group works along with them.
+ */
+int TaskPool_Init(LPTASKPOOL pPool, unsigned int nWorkers);
+
+/* Runs every task still queued, then stops the workers */
+void TaskPool_Cleanup(LPTASKPOOL pPool);
+
+void TaskGroup_Init(LPTASKGROUP pGroup);
+
+/*
+ * Queue pfnRun(pArg), counted in pGroup unless it is NULL. On failure the
+ * task is not queued nor counted, and the caller may run it itself.
+ */
+int TaskPool_Submit(LPTASKPOOL pPool, LPTASKGROUP pGroup, TASKFUNC pfnRun, void* pArg);
+
+/* Run queued tasks of pGroup, and no others, until all of them have finished */
+void TaskPool_Wait(LPTASKPOOL pPool, LPTASKGROUP pGroup);
+
+/*
+ * Call pfnRange over [nBegin, nEnd) in pieces of at most nGrain, or of an
+ * eighth of the range per worker for 0, and return when all are done. The
+ * calling thread works too; without a pool it does all of it.
+ */
+void TaskPool_ParallelFor(LPTASKPOOL pPool, size_t nBegin, size_t nEnd, size_t nGrain, TASKRANGEFUNC pfnRange,
+    void* pArg);
+
+unsigned int TaskPool_GetWorkerCount(const TASKPOOL* pPool);
+void TaskPool_GetStats(LPTASKPOOL pPool, LPTASKPOOLSTATS pStats);
+
+#endif /* PANIVIEW_TASKPOOL_H */
@@ -0,0 +1,154 @@
+/*
+ * gltest.h
+ *
+ * Offscreen OpenGL for the unit tests
+ *
+ * A 3.3 core context made current without a surface, through Mesa's
+ * surfaceless EGL platform where it exists, e.g. llvmpipe on a headless
+ * box. Tests render into framebuffers of their own and skip when no
+ * context can be had.
+ */
+
+#ifndef PANIVIEW_GLTEST_H
+#define PANIVIEW_GLTEST_H
+
+#include "../gltexture.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct _tagGLTESTCONTEXT {
+  EGLDisplay display;
+  EGLContext context;
+} GLTESTCONTEXT, *LPGLTESTCONTEXT;
+
+/* Nonzero once a context is current, zero when EGL or OpenGL 3.3 is not available */
+static inline int GLTest_Init(LPGLTESTCONTEXT pContext)
+{
+  pContext->display = EGL_NO_DISPLAY;
+  pContext->context = EGL_NO_CONTEXT;
+
+  PFNEGLGETPLATFORMDISPLAYEXTPROC pfnGetPlatformDisplay =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  pContext->display = pfnGetPlatformDisplay
+      ? pfnGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL)
+      : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (pContext->display == EGL_NO_DISPLAY || !eglInitialize(pContext->display, NULL, NULL) ||
+      !eglBindAPI(EGL_OPENGL_API)) {
+    return 0;
+  }
+
+  const EGLint contextAttribs[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+  pContext->context = eglCreateContext(pContext->display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+  if (pContext->context == EGL_NO_CONTEXT) {
+    return 0;
+  }
+  if (!eglMakeCurrent(pContext->display, EGL_NO_SURFACE, EGL_NO_SURFACE, pContext->context)) {
+    eglDestroyContext(pContext->display, pContext->context);
+    pContext->context = EGL_NO_CONTEXT;
+    return 0;
+  }
+
+  return 1;
+}
+
+static inline void GLTest_Cleanup(LPGLTESTCONTEXT pContext)
+{
+  if (pContext->context != EGL_NO_CONTEXT) {
+    eglMakeCurrent(pContext->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(pContext->display, pContext->context);
+    pContext->context = EGL_NO_CONTEXT;
+  }
+  if (pContext->display != EGL_NO_DISPLAY) {
+    eglTerminate(pContext->display);
+    pContext->display = EGL_NO_DISPLAY;
+  }
+}
+
+/* A file of the source tree, NUL terminated, freed by the caller */
+static inline char* GLTest_ReadTextFile(const char* pszName)
+{
+  char szPath[1024];
+  snprintf(szPath, sizeof(szPath), "%s/%s", PANIVIEW_SOURCE_DIR, pszName);
+
+  FILE* fp = fopen(szPath, "rb");
+  if (!fp) {
+    return NULL;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  char* pszText = (char*)malloc((size_t)size + 1);
+  if (pszText) {
+    pszText[fread(pszText, 1, (size_t)size, fp)] = '\0';
+  }
+
+  fclose(fp);
+  return pszText;
+}
+
+static inline GLuint GLTest_CompileShader(const char* pszName, GLenum type)
+{
+  char* pszSource = GLTest_ReadTextFile(pszName);
+  if (!pszSource) {
+    return 0;
+  }
+
+  GLuint shaderId = glCreateShader(type);
+  glShaderSource(shaderId, 1, (const char**)&pszSource, NULL);
+  glCompileShader(shaderId);
+  free(pszSource);
+
+  GLint result = GL_FALSE;
+  glGetShaderiv(shaderId, GL_COMPILE_STATUS, &result);
+  if (result != GL_TRUE) {
+    char szLog[1024] = "";
+    glGetShaderInfoLog(shaderId, sizeof(szLog), NULL, szLog);
+    fprintf(stderr, "%s: %s\n", pszName, szLog);
+    glDeleteShader(shaderId);
+    return 0;
+  }
+
+  return shaderId;
+}
+
+/* The viewer's own shaders linked and in use, 0 if they fail to build */
+static inline GLuint GLTest_CreateProgram(void)
+{
+  GLuint vertexShaderId = GLTest_CompileShader("vert.glsl", GL_VERTEX_SHADER);
+  GLuint fragmentShaderId = GLTest_CompileShader("frag.glsl", GL_FRAGMENT_SHADER);
+  if (!vertexShaderId || !fragmentShaderId) {
+    glDeleteShader(vertexShaderId);
+    glDeleteShader(fragmentShaderId);
+    return 0;
+  }
+
+  GLuint programId = glCreateProgram();
+  glAttachShader(programId, vertexShaderId);
+  glAttachShader(programId, fragmentShaderId);
+  glLinkProgram(programId);
+  glDeleteShader(vertexShaderId);
+  glDeleteShader(fragmentShaderId);
+
+  GLint result = GL_FALSE;
+  glGetProgramiv(programId, GL_LINK_STATUS, &result);
+  if (result != GL_TRUE) {
+    glDeleteProgram(programId);
+    return 0;
+  }
+
+  glUseProgram(programId);
+  return programId;
+}
+
+#endif /* PANIVIEW_GLTEST_H */
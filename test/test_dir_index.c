@@ -0,0 +1,299 @@
+#include "../dirindex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+typedef struct _tagTESTDIR {
+  char szPath[256];
+} TESTDIR;
+
+static void TestDir_Create(TESTDIR* pDir)
+{
+#ifdef _WIN32
+  strcpy(pDir->szPath, "dirindex_XXXXXX");
+  assert_int_equal(0, _mktemp_s(pDir->szPath, sizeof(pDir->szPath)));
+  assert_int_equal(0, _mkdir(pDir->szPath));
+#else
+  const char* pszTmp = getenv("TMPDIR");
+  snprintf(pDir->szPath, sizeof(pDir->szPath), "%s/dirindex_XXXXXX", pszTmp ? pszTmp : "/tmp");
+  assert_non_null(mkdtemp(pDir->szPath));
+#endif
+}
+
+static void TestDir_Path(TESTDIR* pDir, const char* pszName, char* pszPath, size_t size)
+{
+  snprintf(pszPath, size, "%s%c%s", pDir->szPath, DIRINDEX_PATH_SEPARATOR, pszName);
+}
+
+static void TestDir_Write(TESTDIR* pDir, const char* pszName, const char* pszContent)
+{
+  char szPath[512];
+  TestDir_Path(pDir, pszName, szPath, sizeof(szPath));
+
+  FILE* fp = fopen(szPath, "wb");
+  assert_non_null(fp);
+  fputs(pszContent, fp);
+  fclose(fp);
+}
+
+static void TestDir_Remove(TESTDIR* pDir, const char* pszName)
+{
+  char szPath[512];
+  TestDir_Path(pDir, pszName, szPath, sizeof(szPath));
+  remove(szPath);
+}
+
+#define ASYNC_FILES 100
+
+static int TestDir_IsImage(const char* pszPath)
+{
+  char magic[3] = { 0 };
+  FILE* fp = fopen(pszPath, "rb");
+  if (!fp) {
+    return 0;
+  }
+
+  size_t nRead = fread(magic, 1, sizeof(magic), fp);
+  fclose(fp);
+
+  return nRead == sizeof(magic) && !memcmp(magic, "img", sizeof(magic));
+}
+
+/* Accept files whose content starts with "img", counting the calls */
+static int ImageFilter(const char* pszPath, const char* pszName, void* pUserData)
+{
+  (void)pszName;
+
+  ++*(int*)pUserData;
+  return TestDir_IsImage(pszPath);
+}
+
+/* The same for the scan tasks, which call it concurrently */
+static int ThreadedImageFilter(const char* pszPath, const char* pszName, void* pUserData)
+{
+  (void)pszName;
+
+  Atomic_Increment((volatile long*)pUserData);
+  return TestDir_IsImage(pszPath);
+}
+
+static void dir_index_navigation_test(void** state)
+{
+  (void)state;
+
+  TESTDIR dir;
+  TestDir_Create(&dir);
+
+  TestDir_Write(&dir, "c.png", "img");
+  TestDir_Write(&dir, "a.png", "img");
+  TestDir_Write(&dir, "notes.txt", "text");
+  TestDir_Write(&dir, "b.jpg", "img");
+  TestDir_Write(&dir, "\xD0\xB1.png", "img");  /* Cyrillic, sorts last */
+
+  int nFilterCalls = 0;
+  DIRINDEX index;
+  DirIndex_Init(&index);
+  assert_int_equal(DIRINDEX_OK, DirIndex_Open(&index, dir.szPath, ImageFilter, &nFilterCalls));
+  assert_int_equal(5, nFilterCalls);
+
+  assert_int_equal(4, DirIndex_GetCount(&index));
+  assert_string_equal("a.png", DirIndex_GetName(&index, 0));
+  assert_string_equal("b.jpg", DirIndex_GetName(&index, 1));
+  assert_string_equal("c.png", DirIndex_GetName(&index, 2));
+  assert_string_equal("\xD0\xB1.png", DirIndex_GetName(&index, 3));
+  assert_null(DirIndex_GetName(&index, 4));
+
+  assert_int_equal(2, DirIndex_Find(&index, "c.png"));
+  assert_int_equal(DIRINDEX_NPOS, DirIndex_Find(&index, "notes.txt"));
+
+  /* Stepping wraps around at both ends */
+  assert_string_equal("b.jpg", DirIndex_Step(&index, "a.png", 1));
+  assert_string_equal("\xD0\xB1.png", DirIndex_Step(&index, "a.png", 0));
+  assert_string_equal("a.png", DirIndex_Step(&index, "\xD0\xB1.png", 1));
+
+  /* Names outside the index step to their sorted neighbours */
+  assert_string_equal("c.png", DirIndex_Step(&index, "bb.png", 1));
+  assert_string_equal("b.jpg", DirIndex_Step(&index, "bb.png", 0));
+  assert_string_equal("a.png", DirIndex_Step(&index, "\xD0\xB2.png", 1));
+
+  /* Nothing changed, nothing is filtered again */
+  nFilterCalls = 0;
+  assert_int_equal(0, DirIndex_Rescan(&index));
+  assert_int_equal(0, DirIndex_Refresh(&index));
+  assert_int_equal(0, nFilterCalls);
+
+  DirIndex_Close(&index);
+
+  TestDir_Remove(&dir, "a.png");
+  TestDir_Remove(&dir, "b.jpg");
+  TestDir_Remove(&dir, "c.png");
+  TestDir_Remove(&dir, "notes.txt");
+  TestDir_Remove(&dir, "\xD0\xB1.png");
+  assert_int_equal(0, rmdir(dir.szPath));
+}
+
+static void dir_index_refresh_test(void** state)
+{
+  (void)state;
+
+  TESTDIR dir;
+  TestDir_Create(&dir);
+
+  TestDir_Write(&dir, "1.png", "img");
+  TestDir_Write(&dir, "2.png", "img");
+  TestDir_Write(&dir, "3.png", "img");
+
+  int nFilterCalls = 0;
+  DIRINDEX index;
+  DirIndex_Init(&index);
+  assert_int_equal(DIRINDEX_OK, DirIndex_Open(&index, dir.szPath, ImageFilter, &nFilterCalls));
+  assert_int_equal(3, DirIndex_GetCount(&index));
+
+  /* Added, removed and rewritten files */
+  TestDir_Remove(&dir, "2.png");
+  TestDir_Write(&dir, "0.png", "img");
+  TestDir_Write(&dir, "4.txt", "txt");
+  TestDir_Write(&dir, "3.png", "not an image any more");
+
+  /* Directory timestamps may be coarse, so force the rescan where there
+   * are no change notifications */
+  if (DirIndex_Refresh(&index) == 0) {
+    assert_true(DirIndex_Rescan(&index) > 0);
+  }
+
+  assert_int_equal(2, DirIndex_GetCount(&index));
+  assert_string_equal("0.png", DirIndex_GetName(&index, 0));
+  assert_string_equal("1.png", DirIndex_GetName(&index, 1));
+  assert_int_equal(1, DirIndex_Find(&index, "1.png"));
+  assert_int_equal(DIRINDEX_NPOS, DirIndex_Find(&index, "2.png"));
+  assert_int_equal(DIRINDEX_NPOS, DirIndex_Find(&index, "3.png"));
+  for (size_t i = 0; i < DirIndex_GetCount(&index); ++i) {
+    assert_int_equal(i, DirIndex_Find(&index, DirIndex_GetName(&index, i)));
+  }
+
+  /* The deleted current file still has neighbours */
+  assert_string_equal("0.png", DirIndex_Step(&index, "2.png", 1));
+  assert_string_equal("1.png", DirIndex_Step(&index, "2.png", 0));
+
+  /* A file turning into an image is picked up as well */
+  TestDir_Write(&dir, "4.txt", "img but named oddly");
+  if (DirIndex_Refresh(&index) == 0) {
+    assert_true(DirIndex_Rescan(&index) > 0);
+  }
+  assert_int_equal(2, DirIndex_Find(&index, "4.txt"));
+  assert_int_equal(1, DirIndex_Find(&index, "1.png"));
+
+  DirIndex_Close(&index);
+
+  TestDir_Remove(&dir, "0.png");
+  TestDir_Remove(&dir, "1.png");
+  TestDir_Remove(&dir, "3.png");
+  TestDir_Remove(&dir, "4.txt");
+  assert_int_equal(0, rmdir(dir.szPath));
+}
+
+static void dir_index_async_test(void** state)
+{
+  (void)state;
+
+  TESTDIR dir;
+  TestDir_Create(&dir);
+
+  /* Named images, images without an extension and other files */
+  char szName[32];
+  for (int i = 0; i < ASYNC_FILES; ++i) {
+    snprintf(szName, sizeof(szName), "%03d%s", i, i % 5 == 4 ? ".txt" : i % 5 == 3 ? "" : ".png");
+    TestDir_Write(&dir, szName, i % 5 == 4 ? "txt" : "img");
+  }
+
+  int nSyncCalls = 0;
+  DIRINDEX expected;
+  DirIndex_Init(&expected);
+  assert_int_equal(DIRINDEX_OK, DirIndex_Open(&expected, dir.szPath, ImageFilter, &nSyncCalls));
+  assert_int_equal(ASYNC_FILES * 4 / 5, DirIndex_GetCount(&expected));
+
+  TASKPOOL pool;
+  assert_int_equal(TASKPOOL_OK, TaskPool_Init(&pool, 4));
+
+  volatile long nCalls = 0;
+  DIRINDEX index;
+  DirIndex_Init(&index);
+  assert_int_equal(DIRINDEX_OK, DirIndex_OpenAsync(&index, dir.szPath, ThreadedImageFilter, (void*)&nCalls, &pool));
+
+  /* Stepping works on what was found so far, the index stays sorted */
+  while (DirIndex_IsScanning(&index)) {
+    assert_true(DirIndex_Refresh(&index) >= 0);
+    DirIndex_Step(&index, "050.png", 1);
+    for (size_t i = 1; i < DirIndex_GetCount(&index); ++i) {
+      assert_true(strcmp(DirIndex_GetName(&index, i - 1), DirIndex_GetName(&index, i)) < 0);
+    }
+    Thread_Yield();
+  }
+
+  assert_int_equal(DirIndex_GetCount(&expected), DirIndex_GetCount(&index));
+  for (size_t i = 0; i < DirIndex_GetCount(&expected); ++i) {
+    assert_string_equal(DirIndex_GetName(&expected, i), DirIndex_GetName(&index, i));
+    assert_int_equal(i, DirIndex_Find(&index, DirIndex_GetName(&expected, i)));
+  }
+  assert_int_equal(ASYNC_FILES, Atomic_Load(&nCalls));
+
+  /* The scan kept its stats and rejects, nothing is filtered again */
+  assert_int_equal(0, DirIndex_Rescan(&index));
+  assert_int_equal(ASYNC_FILES, Atomic_Load(&nCalls));
+
+  /* Waiting for the whole scan, closing in the middle of one, and without a pool */
+  assert_int_equal(DIRINDEX_OK, DirIndex_OpenAsync(&index, dir.szPath, ThreadedImageFilter, (void*)&nCalls, &pool));
+  assert_int_equal(ASYNC_FILES * 4 / 5, DirIndex_FinishScan(&index));
+  assert_false(DirIndex_IsScanning(&index));
+  assert_int_equal(DIRINDEX_OK, DirIndex_OpenAsync(&index, dir.szPath, ThreadedImageFilter, (void*)&nCalls, &pool));
+  DirIndex_Close(&index);
+  assert_false(DirIndex_IsScanning(&index));
+  assert_int_equal(DIRINDEX_OK, DirIndex_OpenAsync(&index, dir.szPath, ThreadedImageFilter, (void*)&nCalls, NULL));
+  assert_false(DirIndex_IsScanning(&index));
+  assert_int_equal(ASYNC_FILES * 4 / 5, DirIndex_GetCount(&index));
+  DirIndex_Close(&index);
+
+  TaskPool_Cleanup(&pool);
+  DirIndex_Close(&expected);
+
+  for (int i = 0; i < ASYNC_FILES; ++i) {
+    snprintf(szName, sizeof(szName), "%03d%s", i, i % 5 == 4 ? ".txt" : i % 5 == 3 ? "" : ".png");
+    TestDir_Remove(&dir, szName);
+  }
+  assert_int_equal(0, rmdir(dir.szPath));
+}
+
+static void dir_index_missing_dir_test(void** state)
+{
+  (void)state;
+
+  DIRINDEX index;
+  DirIndex_Init(&index);
+  assert_int_equal(DIRINDEX_ERROR_IO, DirIndex_Open(&index, "this/directory/does/not/exist", NULL, NULL));
+  assert_int_equal(0, DirIndex_GetCount(&index));
+  assert_null(DirIndex_Step(&index, "a.png", 1));
+  DirIndex_Close(&index);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(dir_index_navigation_test),
+    cmocka_unit_test(dir_index_refresh_test),
+    cmocka_unit_test(dir_index_async_test),
+    cmocka_unit_test(dir_index_missing_dir_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
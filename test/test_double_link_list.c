@@ -1,17 +1,20 @@
-﻿#include "../precomp.h"
-#include "../dlnklist.h"
+﻿#include "../dlnklist.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <stdarg.h>
 #include <setjmp.h>
 #include <cmocka.h>
 
 typedef struct _tagDUMMYDATA {
   int nNumber;
-  WCHAR szDummy[80];
+  wchar_t szDummy[80];
 } DUMMYDATA;
 
 static void double_link_list_heap_test(void** state)
 {
-  UNREFERENCED_PARAMETER(state);
+  (void)state;
 
   DOUBLELINKLIST linkList;
   DoubleLinkList_Init(&linkList, NULL);
@@ -19,13 +22,15 @@ static void double_link_list_heap_test(void** state)
   int val;
   
   val = 30;
-  DoubleLinkList_AppendFront(&linkList, &val, sizeof(int), TRUE);
+  DoubleLinkList_AppendFront(&linkList, &val, sizeof(int), 1);
   
   val = 10;
-  DoubleLinkList_AppendFront(&linkList, &val, sizeof(int), TRUE);
+  DoubleLinkList_AppendFront(&linkList, &val, sizeof(int), 1);
 
   val = 45;
-  DoubleLinkList_AppendFront(&linkList, &val, sizeof(int), TRUE);
+  DoubleLinkList_AppendFront(&linkList, &val, sizeof(int), 1);
+
+  DoubleLinkList_Free(&linkList);
 }
 
 struct word_test_pair {
@@ -37,7 +42,7 @@ struct word_test_pair {
  * EDIT CAREFULLY OR DON'T EDIT AT ALL
  * Do not mess alphabetical order, better use script for check/generation
  * */
-const struct word_test_pair g_unorderedWordSet[][80] = {
+const struct word_test_pair g_unorderedWordSet[] = {
   {  8, L"abandonment" },
   { 15, L"rejecton" },
   { 17, L"Чаща" },
@@ -64,8 +69,11 @@ const struct word_test_pair g_unorderedWordSet[][80] = {
   { 13, L"imminent" },
 };
 
-static BOOL WstringTestPairComparator(const void* p1, size_t size1, const void* p2, size_t size2)
+static int WstringTestPairComparator(const void* p1, size_t size1, const void* p2, size_t size2)
 {
+  (void)size1;
+  (void)size2;
+
   return wcscmp(
     ((struct word_test_pair*)p1)->word,
     ((struct word_test_pair*)p2)->word) > 0;
@@ -73,11 +81,13 @@ static BOOL WstringTestPairComparator(const void* p1, size_t size1, const void*
 
 static void double_link_list_wstring_sort_test(void** state)
 {
+  (void)state;
+
   DOUBLELINKLIST list;
   DoubleLinkList_Init(&list, WstringTestPairComparator);
 
-  for (size_t i = 0; i < ARRAYSIZE(g_unorderedWordSet); ++i) {
-    DoubleLinkList_AppendFront(&list, &g_unorderedWordSet[i], sizeof(g_unorderedWordSet[i]), TRUE);
+  for (size_t i = 0; i < sizeof(g_unorderedWordSet) / sizeof(g_unorderedWordSet[0]); ++i) {
+    DoubleLinkList_AppendFront(&list, &g_unorderedWordSet[i], sizeof(g_unorderedWordSet[i]), 1);
   }
 
   DoubleLinkList_Sort(&list);
@@ -132,21 +142,21 @@ const int g_unorderedNumberSet[] = {
 
 static int IntegerComparator(const void* p1, size_t size1, const void* p2, size_t size2)
 {
+  (void)size1;
+  (void)size2;
+
   return *(int*)p1 - *(int*)p2;
 }
 
 static void double_link_list_int_sort_test(void** state)
 {
-  UNREFERENCED_PARAMETER(state);
+  (void)state;
 
   DOUBLELINKLIST list;
   DoubleLinkList_Init(&list, IntegerComparator);
 
-  for (size_t i = 0; i < ARRAYSIZE(g_unorderedNumberSet); ++i) {
-    void* data = test_calloc(1, sizeof(int));
-
-    *(int*)data = g_unorderedNumberSet[i];
-    DoubleLinkList_AppendFront(&list, &data, sizeof(int), TRUE);
+  for (size_t i = 0; i < sizeof(g_unorderedNumberSet) / sizeof(g_unorderedNumberSet[0]); ++i) {
+    DoubleLinkList_AppendFront(&list, &g_unorderedNumberSet[i], sizeof(int), 1);
   }
 
   DoubleLinkList_Sort(&list);
@@ -173,11 +183,69 @@ static void double_link_list_int_sort_test(void** state)
   }
 }
 
+typedef struct _tagSTABLEPAIR {
+  int nKey;
+  int nOrder;
+} STABLEPAIR;
+
+static int StablePairComparator(const void* p1, size_t size1, const void* p2, size_t size2)
+{
+  (void)size1;
+  (void)size2;
+
+  return ((const STABLEPAIR*)p1)->nKey - ((const STABLEPAIR*)p2)->nKey;
+}
+
+/* Equal keys keep their insertion order and both link directions stay
+ * consistent, over sizes that exercise partially filled merge bins */
+static void double_link_list_stable_sort_test(void** state)
+{
+  (void)state;
+
+  static const size_t sizes[] = { 1, 2, 3, 7, 64, 1000, 4097 };
+  unsigned int seed = 12345;
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    DOUBLELINKLIST list;
+    DoubleLinkList_Init(&list, StablePairComparator);
+
+    for (size_t i = 0; i < sizes[s]; ++i) {
+      seed = seed * 1103515245u + 12345u;
+      STABLEPAIR pair = { (int)((seed >> 16) % 16), (int)i };
+      DoubleLinkList_AppendFront(&list, &pair, sizeof(pair), 0);
+    }
+
+    DoubleLinkList_Sort(&list);
+
+    size_t nCount = 0;
+    LPDOUBLELINKLISTNODE pPrev = NULL;
+    for (LPDOUBLELINKLISTNODE pNode = list.pBegin; pNode; pNode = pNode->pNext) {
+      assert_ptr_equal(pPrev, pNode->pPrev);
+      assert_int_equal(sizeof(STABLEPAIR), pNode->valueSize);
+
+      if (pPrev) {
+        const STABLEPAIR* pA = (const STABLEPAIR*)pPrev->pValue;
+        const STABLEPAIR* pB = (const STABLEPAIR*)pNode->pValue;
+        assert_true(pA->nKey < pB->nKey || (pA->nKey == pB->nKey && pA->nOrder < pB->nOrder));
+      }
+
+      pPrev = pNode;
+      ++nCount;
+    }
+
+    assert_int_equal(sizes[s], nCount);
+    assert_ptr_equal(pPrev, list.pEnd);
+
+    DoubleLinkList_Free(&list);
+  }
+}
+
 int main() {
   const struct CMUnitTest tests[] = {
     cmocka_unit_test(double_link_list_heap_test),
     cmocka_unit_test(double_link_list_int_sort_test),
-    cmocka_unit_test(double_link_list_wstring_sort_test)
+    cmocka_unit_test(double_link_list_wstring_sort_test),
+    cmocka_unit_test(double_link_list_stable_sort_test)
   };
 
   return cmocka_run_group_tests(tests, NULL, NULL);
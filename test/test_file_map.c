@@ -0,0 +1,91 @@
+#include "../filemap.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+static const char szPath[] = "test_file_map.bin";
+
+static void WriteFile(const void* pData, size_t size)
+{
+  FILE* fp = fopen(szPath, "wb");
+  assert_non_null(fp);
+  assert_int_equal(size, fwrite(pData, 1, size, fp));
+  assert_int_equal(0, fclose(fp));
+}
+
+static void file_map_open_test(void** state)
+{
+  (void)state;
+
+  /* Larger than a page, so the mapping spans several */
+  static unsigned char data[3 * 4096 + 123];
+  for (size_t i = 0; i < sizeof(data); ++i) {
+    data[i] = (unsigned char)(i * 7 + (i >> 8));
+  }
+  WriteFile(data, sizeof(data));
+
+  FILEMAP map;
+  assert_int_equal(FILEMAP_OK, FileMap_Open(&map, szPath));
+  assert_non_null(map.pData);
+  assert_int_equal(sizeof(data), map.size);
+  assert_memory_equal(data, map.pData, sizeof(data));
+
+  /* Another mapping of the same file is independent */
+  FILEMAP other;
+  assert_int_equal(FILEMAP_OK, FileMap_Open(&other, szPath));
+  assert_true(other.pData != map.pData);
+  FileMap_Close(&other);
+  assert_memory_equal(data + sizeof(data) - 16, map.pData + sizeof(data) - 16, 16);
+
+  FileMap_Close(&map);
+  assert_null(map.pData);
+  assert_int_equal(0, map.size);
+
+  remove(szPath);
+}
+
+static void file_map_empty_test(void** state)
+{
+  (void)state;
+
+  WriteFile("", 0);
+
+  FILEMAP map;
+  assert_int_equal(FILEMAP_OK, FileMap_Open(&map, szPath));
+  assert_null(map.pData);
+  assert_int_equal(0, map.size);
+  FileMap_Close(&map);
+
+  remove(szPath);
+}
+
+static void file_map_missing_test(void** state)
+{
+  (void)state;
+
+  remove(szPath);
+
+  FILEMAP map;
+  assert_int_equal(FILEMAP_ERROR_IO, FileMap_Open(&map, szPath));
+  assert_null(map.pData);
+  assert_int_equal(0, map.size);
+
+  /* Closing a failed map is harmless */
+  FileMap_Close(&map);
+
+  /* Directories have nothing to map */
+  assert_int_equal(FILEMAP_ERROR_IO, FileMap_Open(&map, "."));
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(file_map_open_test),
+    cmocka_unit_test(file_map_empty_test),
+    cmocka_unit_test(file_map_missing_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,204 @@
+#include "../gltexture.h"
+#include "../pixconv.h"
+#include "gltest.h"
+#include "testutil.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+static GLTESTCONTEXT g_gl;
+static GLuint g_programId;
+static GLuint g_vertexArray;
+static GLuint g_vertexBuffer;
+
+/* The viewer's own shaders over a quad filling the viewport, identity transform */
+static int gl_setup(void** state)
+{
+  (void)state;
+
+  if (!GLTest_Init(&g_gl)) {
+    return 0;
+  }
+
+  g_programId = GLTest_CreateProgram();
+  if (!g_programId) {
+    return -1;
+  }
+
+  /* x, y, z, u, v; texture row 0 lands on framebuffer row 0 */
+  static const GLfloat quad[] = {
+    -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
+     1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
+    -1.0f,  1.0f, 0.0f, 0.0f, 1.0f,
+     1.0f,  1.0f, 0.0f, 1.0f, 1.0f,
+  };
+
+  glGenVertexArrays(1, &g_vertexArray);
+  glBindVertexArray(g_vertexArray);
+  glGenBuffers(1, &g_vertexBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, g_vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), NULL);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (const void*)(3 * sizeof(GLfloat)));
+
+  static const GLfloat identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+  glUniformMatrix4fv(glGetUniformLocation(g_programId, "transform"), 1, GL_FALSE, identity);
+
+  return glGetError() == GL_NO_ERROR ? 0 : -1;
+}
+
+static int gl_teardown(void** state)
+{
+  (void)state;
+
+  if (g_gl.context != EGL_NO_CONTEXT) {
+    glDeleteBuffers(1, &g_vertexBuffer);
+    glDeleteVertexArrays(1, &g_vertexArray);
+    glDeleteProgram(g_programId);
+  }
+  GLTest_Cleanup(&g_gl);
+
+  return 0;
+}
+
+/* Upload, draw 1:1 into an RGBA8 framebuffer and read it back as BGRA */
+static size_t RenderImage(const void* pPixels, size_t width, size_t height, size_t stride, int nPixFmt,
+    uint8_t* pOut)
+{
+  GLTEXFORMAT format;
+  assert_int_equal(GLTEXTURE_OK, GLTexture_GetFormat(nPixFmt, &format));
+
+  GLuint textureId = 0;
+  glGenTextures(1, &textureId);
+  glBindTexture(GL_TEXTURE_2D, textureId);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+  size_t cbUploaded = 0;
+  assert_int_equal(GLTEXTURE_OK, GLTexture_Upload(pPixels, width, height, stride, nPixFmt, NULL, &cbUploaded));
+
+  GLuint renderbufferId = 0;
+  GLuint framebufferId = 0;
+  glGenRenderbuffers(1, &renderbufferId);
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbufferId);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, (GLsizei)width, (GLsizei)height);
+  glGenFramebuffers(1, &framebufferId);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebufferId);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbufferId);
+  assert_int_equal(GL_FRAMEBUFFER_COMPLETE, glCheckFramebufferStatus(GL_FRAMEBUFFER));
+
+  glViewport(0, 0, (GLsizei)width, (GLsizei)height);
+  glUniform1i(glGetUniformLocation(g_programId, "grayscale"), format.bGray);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, (GLsizei)width, (GLsizei)height, GL_BGRA, GL_UNSIGNED_BYTE, pOut);
+  assert_int_equal(GL_NO_ERROR, glGetError());
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glDeleteFramebuffers(1, &framebufferId);
+  glDeleteRenderbuffers(1, &renderbufferId);
+  glDeleteTextures(1, &textureId);
+
+  return cbUploaded;
+}
+
+/* Gray drawn from one channel matches its BGRA expansion, for a quarter of the bytes */
+static void gl_texture_gray8_test(void** state)
+{
+  (void)state;
+
+  if (!g_programId) {
+    skip();
+  }
+
+  const size_t width = 61, height = 37, stride = 64;
+  uint8_t* pGray = (uint8_t*)malloc(stride * height);
+  uint8_t* pBGRA = (uint8_t*)malloc(width * height * 4);
+  uint8_t* pFromGray = (uint8_t*)malloc(width * height * 4);
+  uint8_t* pFromBGRA = (uint8_t*)malloc(width * height * 4);
+  assert_non_null(pGray);
+  assert_non_null(pBGRA);
+  assert_non_null(pFromGray);
+  assert_non_null(pFromBGRA);
+
+  Test_FillPattern(pGray, stride * height, 3);
+  PixConv_Convert(pGray, stride, PIXFMT_GRAY8, pBGRA, width * 4, PIXFMT_PBGRA32, width, height);
+
+  size_t cbGray = RenderImage(pGray, width, height, stride, PIXFMT_GRAY8, pFromGray);
+  size_t cbBGRA = RenderImage(pBGRA, width, height, width * 4, PIXFMT_PBGRA32, pFromBGRA);
+
+  assert_int_equal(width * height, cbGray);
+  assert_int_equal(cbGray * 4, cbBGRA);
+  assert_memory_equal(pBGRA, pFromBGRA, width * height * 4);
+  assert_memory_equal(pFromBGRA, pFromGray, width * height * 4);
+
+  free(pFromBGRA);
+  free(pFromGray);
+  free(pBGRA);
+  free(pGray);
+}
+
+static void gl_texture_gray16_test(void** state)
+{
+  (void)state;
+
+  if (!g_programId) {
+    skip();
+  }
+
+  const size_t width = 33, height = 20;
+  uint16_t* pGray = (uint16_t*)malloc(width * height * 2);
+  uint8_t* pBGRA = (uint8_t*)malloc(width * height * 4);
+  uint8_t* pFromGray = (uint8_t*)malloc(width * height * 4);
+  assert_non_null(pGray);
+  assert_non_null(pBGRA);
+  assert_non_null(pFromGray);
+
+  Test_FillPattern((uint8_t*)pGray, width * height * 2, 11);
+  PixConv_Convert(pGray, width * 2, PIXFMT_GRAY16, pBGRA, width * 4, PIXFMT_PBGRA32, width, height);
+
+  assert_int_equal(width * height * 2, RenderImage(pGray, width, height, width * 2, PIXFMT_GRAY16, pFromGray));
+
+  /* Normalized on the GPU, the CPU rounds the 16 to 8 bits its own way */
+  for (size_t i = 0; i < width * height * 4; ++i) {
+    assert_in_range(pFromGray[i], pBGRA[i] > 0 ? pBGRA[i] - 1 : 0, pBGRA[i] + 1);
+  }
+
+  free(pFromGray);
+  free(pBGRA);
+  free(pGray);
+}
+
+static void gl_texture_format_test(void** state)
+{
+  (void)state;
+
+  GLTEXFORMAT format;
+  assert_int_equal(GLTEXTURE_ERROR_UNSUPPORTED, GLTexture_GetFormat(PIXFMT_RGB24, &format));
+  assert_int_equal(GLTEXTURE_OK, GLTexture_GetFormat(PIXFMT_GRAY16, &format));
+  assert_int_equal(2, format.nBytesPerPixel);
+  assert_true(format.bGray);
+
+  /* Strides that are not whole pixels are refused before OpenGL sees them */
+  uint8_t pixels[8] = { 0 };
+  assert_int_equal(GLTEXTURE_ERROR_UNSUPPORTED, GLTexture_Upload(pixels, 1, 1, 3, PIXFMT_GRAY16, NULL, NULL));
+  assert_int_equal(GLTEXTURE_ERROR_UNSUPPORTED, GLTexture_Upload(pixels, 2, 1, 4, PIXFMT_PBGRA32, NULL, NULL));
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(gl_texture_format_test),
+    cmocka_unit_test(gl_texture_gray8_test),
+    cmocka_unit_test(gl_texture_gray16_test)
+  };
+
+  return cmocka_run_group_tests(tests, gl_setup, gl_teardown);
+}
@@ -0,0 +1,327 @@
+#include "../gltiles.h"
+#include "../pixconv.h"
+#include "gltest.h"
+#include "testutil.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+static GLTESTCONTEXT g_gl;
+static GLuint g_programId;
+
+/* The viewer's own shaders, tiles bring their own vertices */
+static int gl_setup(void** state)
+{
+  (void)state;
+
+  if (!GLTest_Init(&g_gl)) {
+    return 0;
+  }
+
+  g_programId = GLTest_CreateProgram();
+  if (!g_programId) {
+    return -1;
+  }
+
+  return glGetError() == GL_NO_ERROR ? 0 : -1;
+}
+
+static int gl_teardown(void** state)
+{
+  (void)state;
+
+  if (g_gl.context != EGL_NO_CONTEXT) {
+    glDeleteProgram(g_programId);
+  }
+  GLTest_Cleanup(&g_gl);
+
+  return 0;
+}
+
+/*
+ * Draw a view of the image into a framebuffer of the view's size on screen
+ * and read it back as BGRA, image row 0 first
+ */
+static void RenderView(LPGLTILES pTiles, const TILEVIEW* pView, size_t width, size_t height, uint8_t* pOut)
+{
+  assert_int_equal(GLTILES_OK, GLTiles_Update(pTiles, pView));
+
+  GLuint renderbufferId = 0;
+  GLuint framebufferId = 0;
+  glGenRenderbuffers(1, &renderbufferId);
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbufferId);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, (GLsizei)width, (GLsizei)height);
+  glGenFramebuffers(1, &framebufferId);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebufferId);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbufferId);
+  assert_int_equal(GL_FRAMEBUFFER_COMPLETE, glCheckFramebufferStatus(GL_FRAMEBUFFER));
+
+  glViewport(0, 0, (GLsizei)width, (GLsizei)height);
+  glClearColor(1.0f, 0.0f, 1.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  /* View rectangle onto clip space, image top at the bottom of the framebuffer */
+  GLfloat sx = (GLfloat)(2.0 / (pView->right - pView->left));
+  GLfloat sy = (GLfloat)(2.0 / (pView->bottom - pView->top));
+  const GLfloat imageToClip[16] = {
+    sx, 0.0f, 0.0f, 0.0f,
+    0.0f, sy, 0.0f, 0.0f,
+    0.0f, 0.0f, 1.0f, 0.0f,
+    (GLfloat)(-1.0 - pView->left * sx), (GLfloat)(-1.0 - pView->top * sy), 0.0f, 1.0f,
+  };
+  glUniform1i(glGetUniformLocation(g_programId, "grayscale"), pTiles->format.bGray);
+  GLTiles_Draw(pTiles, glGetUniformLocation(g_programId, "transform"), imageToClip);
+
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, (GLsizei)width, (GLsizei)height, GL_BGRA, GL_UNSIGNED_BYTE, pOut);
+  assert_int_equal(GL_NO_ERROR, glGetError());
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glDeleteFramebuffers(1, &framebufferId);
+  glDeleteRenderbuffers(1, &renderbufferId);
+}
+
+/* Opaque noise, so premultiplied and straight agree */
+static uint8_t* CreateImage(size_t width, size_t height)
+{
+  uint8_t* pImage = (uint8_t*)malloc(width * height * 4);
+  assert_non_null(pImage);
+  Test_FillPattern(pImage, width * height * 4, 5);
+  for (size_t i = 0; i < width * height; ++i) {
+    pImage[i * 4 + 3] = 0xFF;
+  }
+
+  return pImage;
+}
+
+/* 1:1, across tile seams, the framebuffer is the image */
+static void gl_tiles_level0_test(void** state)
+{
+  (void)state;
+
+  if (!g_programId) {
+    skip();
+  }
+
+  const size_t width = 300, height = 200;
+  uint8_t* pImage = CreateImage(width, height);
+  uint8_t* pOut = (uint8_t*)malloc(width * height * 4);
+  assert_non_null(pOut);
+
+  GLTILES tiles;
+  assert_int_equal(GLTILES_OK, GLTiles_Init(&tiles, pImage, width, height, width * 4, PIXFMT_PBGRA32,
+      NULL, 64, (size_t)64 << 20));
+
+  TILEVIEW view = { 0.0, 0.0, (double)width, (double)height, 1.0 };
+  RenderView(&tiles, &view, width, height, pOut);
+  assert_int_equal(5 * 4, tiles.nVisible);
+  assert_memory_equal(pImage, pOut, width * height * 4);
+
+  /* Zoomed into a corner, only the tiles there are made resident */
+  view.left = 200.0;
+  view.top = 100.0;
+  view.right = 300.0;
+  view.bottom = 200.0;
+  TileMgr_Clear(&tiles.tileMgr);
+  RenderView(&tiles, &view, 100, 100, pOut);
+  assert_int_equal(2 * 3, tiles.nVisible);
+  for (size_t y = 0; y < 100; ++y) {
+    assert_memory_equal(pImage + ((100 + y) * width + 200) * 4, pOut + y * 100 * 4, 100 * 4);
+  }
+
+  TILEMGRSTATS stats;
+  TileMgr_GetStats(&tiles.tileMgr, &stats);
+  assert_int_equal(6, stats.count);
+
+  GLTiles_Cleanup(&tiles);
+  free(pOut);
+  free(pImage);
+}
+
+/* Zoomed out, the coarser level is the 4x4 box average of the image */
+static void gl_tiles_level2_test(void** state)
+{
+  (void)state;
+
+  if (!g_programId) {
+    skip();
+  }
+
+  const size_t width = 300, height = 200;
+  uint8_t* pImage = CreateImage(width, height);
+  uint8_t* pExpected = (uint8_t*)malloc(75 * 50 * 4);
+  uint8_t* pOut = (uint8_t*)malloc(75 * 50 * 4);
+  assert_non_null(pExpected);
+  assert_non_null(pOut);
+
+  for (size_t y = 0; y < 50; ++y) {
+    for (size_t x = 0; x < 75; ++x) {
+      for (size_t c = 0; c < 4; ++c) {
+        unsigned int sum = 0;
+        for (size_t dy = 0; dy < 4; ++dy) {
+          for (size_t dx = 0; dx < 4; ++dx) {
+            sum += pImage[((y * 4 + dy) * width + x * 4 + dx) * 4 + c];
+          }
+        }
+        pExpected[(y * 75 + x) * 4 + c] = (uint8_t)((sum + 8) / 16);
+      }
+    }
+  }
+
+  GLTILES tiles;
+  assert_int_equal(GLTILES_OK, GLTiles_Init(&tiles, pImage, width, height, width * 4, PIXFMT_PBGRA32,
+      NULL, 64, (size_t)64 << 20));
+
+  TILEVIEW view = { 0.0, 0.0, (double)width, (double)height, 0.25 };
+  RenderView(&tiles, &view, 75, 50, pOut);
+  assert_int_equal(2, tiles.nVisible);
+  assert_int_equal(2, tiles.ppVisible[0]->level);
+  assert_memory_equal(pExpected, pOut, 75 * 50 * 4);
+
+  GLTiles_Cleanup(&tiles);
+  free(pOut);
+  free(pExpected);
+  free(pImage);
+}
+
+/* With a pyramid, coarser tiles are its levels as they are */
+static void gl_tiles_pyramid_test(void** state)
+{
+  (void)state;
+
+  if (!g_programId) {
+    skip();
+  }
+
+  const size_t width = 300, height = 200;
+  uint8_t* pImage = CreateImage(width, height);
+  uint8_t* pOut = (uint8_t*)malloc(75 * 50 * 4);
+  assert_non_null(pOut);
+
+  LPPIXBUF pPixBuf = NULL;
+  assert_int_equal(PIXBUF_OK, PixBuf_Create(width, height, PIXFMT_PBGRA32, NULL, &pPixBuf));
+  memcpy(pPixBuf->pData, pImage, width * height * 4);
+
+  PYRAMID pyramid;
+  assert_int_equal(PYRAMID_OK, Pyramid_Build(&pyramid, pPixBuf, 64, NULL));
+  assert_true(pyramid.nLevels > 2);
+
+  GLTILES tiles;
+  assert_int_equal(GLTILES_OK, GLTiles_Init(&tiles, pPixBuf->pData, width, height, pPixBuf->stride,
+      PIXFMT_PBGRA32, &pyramid, 64, (size_t)64 << 20));
+
+  TILEVIEW view = { 0.0, 0.0, (double)width, (double)height, 0.25 };
+  RenderView(&tiles, &view, 75, 50, pOut);
+  assert_int_equal(2, tiles.ppVisible[0]->level);
+  assert_memory_equal(pyramid.pLevels[2]->pData, pOut, 75 * 50 * 4);
+
+  GLTiles_Cleanup(&tiles);
+
+  /* A pyramid of another image is ignored */
+  assert_int_equal(GLTILES_OK, GLTiles_Init(&tiles, pImage, 200, 200, width * 4, PIXFMT_PBGRA32,
+      &pyramid, 64, (size_t)64 << 20));
+  assert_null(tiles.pPyramid);
+  GLTiles_Cleanup(&tiles);
+
+  Pyramid_Cleanup(&pyramid);
+  PixBuf_Release(pPixBuf);
+  free(pOut);
+  free(pImage);
+}
+
+/* Reads levels by point sampling a BGRA image, as a file decoded on demand would */
+typedef struct _tagFAKEREADER {
+  const uint8_t* pImage;
+  size_t width;
+  size_t nReads;
+  int bFail;
+} FAKEREADER;
+
+static int FakeRead(void* pUserData, size_t nLevel, size_t left, size_t top, size_t right, size_t bottom,
+    void* pDest, size_t destStride)
+{
+  FAKEREADER* pReader = (FAKEREADER*)pUserData;
+  if (pReader->bFail) {
+    return 0;
+  }
+
+  for (size_t y = top; y < bottom; ++y) {
+    uint8_t* pRow = (uint8_t*)pDest + (y - top) * destStride;
+    for (size_t x = left; x < right; ++x) {
+      memcpy(pRow + (x - left) * 4, pReader->pImage + ((y << nLevel) * pReader->width + (x << nLevel)) * 4, 4);
+    }
+  }
+
+  ++pReader->nReads;
+  return 1;
+}
+
+/* Without pixels in memory every tile is read at its own level, once */
+static void gl_tiles_reader_test(void** state)
+{
+  (void)state;
+
+  if (!g_programId) {
+    skip();
+  }
+
+  const size_t width = 300, height = 200;
+  uint8_t* pImage = CreateImage(width, height);
+  uint8_t* pExpected = (uint8_t*)malloc(75 * 50 * 4);
+  uint8_t* pOut = (uint8_t*)malloc(width * height * 4);
+  assert_non_null(pExpected);
+  assert_non_null(pOut);
+
+  for (size_t y = 0; y < 50; ++y) {
+    for (size_t x = 0; x < 75; ++x) {
+      memcpy(pExpected + (y * 75 + x) * 4, pImage + (y * 4 * width + x * 4) * 4, 4);
+    }
+  }
+
+  FAKEREADER reader = { pImage, width, 0, 0 };
+  GLTILES tiles;
+  assert_int_equal(GLTILES_OK, GLTiles_InitReader(&tiles, width, height, PIXFMT_PBGRA32, FakeRead, &reader,
+      64, (size_t)64 << 20));
+
+  TILEVIEW view = { 0.0, 0.0, (double)width, (double)height, 1.0 };
+  RenderView(&tiles, &view, width, height, pOut);
+  assert_int_equal(5 * 4, reader.nReads);
+  assert_memory_equal(pImage, pOut, width * height * 4);
+
+  view.scale = 0.25;
+  RenderView(&tiles, &view, 75, 50, pOut);
+  assert_int_equal(2, tiles.ppVisible[0]->level);
+  assert_int_equal(5 * 4 + 2, reader.nReads);
+  assert_memory_equal(pExpected, pOut, 75 * 50 * 4);
+
+  /* A failed read leaves the tile out and is reported */
+  reader.bFail = 1;
+  TileMgr_Clear(&tiles.tileMgr);
+  assert_int_equal(GLTILES_ERROR_READ, GLTiles_Update(&tiles, &view));
+  assert_int_equal(0, tiles.nVisible);
+
+  GLTiles_Cleanup(&tiles);
+
+  assert_int_equal(GLTILES_ERROR_INVALID, GLTiles_InitReader(&tiles, width, height, PIXFMT_PBGRA32, NULL,
+      NULL, 64, (size_t)64 << 20));
+
+  free(pOut);
+  free(pExpected);
+  free(pImage);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(gl_tiles_level0_test),
+    cmocka_unit_test(gl_tiles_level2_test),
+    cmocka_unit_test(gl_tiles_pyramid_test),
+    cmocka_unit_test(gl_tiles_reader_test)
+  };
+
+  return cmocka_run_group_tests(tests, gl_setup, gl_teardown);
+}
@@ -0,0 +1,199 @@
+#include "../glupload.h"
+#include "../pixconv.h"
+#include "gltest.h"
+#include "testutil.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+static GLTESTCONTEXT g_gl;
+static GLuint g_textureId;
+
+static int gl_setup(void** state)
+{
+  (void)state;
+
+  if (!GLTest_Init(&g_gl)) {
+    return 0;
+  }
+
+  glGenTextures(1, &g_textureId);
+  glBindTexture(GL_TEXTURE_2D, g_textureId);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+  return glGetError() == GL_NO_ERROR ? 0 : -1;
+}
+
+static int gl_teardown(void** state)
+{
+  (void)state;
+
+  if (g_gl.context != EGL_NO_CONTEXT) {
+    glDeleteTextures(1, &g_textureId);
+  }
+  GLTest_Cleanup(&g_gl);
+
+  return 0;
+}
+
+/* Level 0 of the bound texture, tightly packed */
+static void ReadTexture(size_t width, size_t height, int nPixFmt, uint8_t* pOut)
+{
+  GLTEXFORMAT format;
+  assert_int_equal(GLTEXTURE_OK, GLTexture_GetFormat(nPixFmt, &format));
+
+  GLint texWidth = 0;
+  GLint texHeight = 0;
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &texWidth);
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &texHeight);
+  assert_int_equal(width, texWidth);
+  assert_int_equal(height, texHeight);
+
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glGetTexImage(GL_TEXTURE_2D, 0, format.format, format.type, pOut);
+  assert_int_equal(GL_NO_ERROR, glGetError());
+}
+
+/* More images than slots, sizes and formats changing, each one read back intact */
+static void RunRing(int bPersistent)
+{
+  static const struct {
+    size_t width;
+    size_t height;
+    size_t stride;
+    int nPixFmt;
+    int bSameLevel;
+  } images[] = {
+    { 64, 48, 256, PIXFMT_PBGRA32, 0 },
+    { 64, 48, 272, PIXFMT_PBGRA32, 1 },
+    { 64, 48, 64, PIXFMT_GRAY8, 0 },
+    { 64, 48, 80, PIXFMT_GRAY8, 1 },
+    { 200, 120, 400, PIXFMT_GRAY16, 0 },
+    { 37, 5, 148, PIXFMT_PBGRA32, 0 },
+    { 37, 5, 148, PIXFMT_PBGRA32, 1 },
+  };
+
+  GLUPLOADRING ring;
+  assert_int_equal(GLUPLOAD_OK, GLUpload_Init(&ring, bPersistent));
+  assert_int_equal(bPersistent && GLUpload_IsPersistentSupported(), ring.bPersistent);
+
+  GLTEXLEVEL level = { 0 };
+  glBindTexture(GL_TEXTURE_2D, g_textureId);
+
+  for (size_t i = 0; i < sizeof(images) / sizeof(images[0]); ++i) {
+    size_t width = images[i].width, height = images[i].height, stride = images[i].stride;
+    size_t rowSize = width * (size_t)PixConv_GetBytesPerPixel(images[i].nPixFmt);
+
+    uint8_t* pExpected = (uint8_t*)malloc(rowSize * height);
+    uint8_t* pActual = (uint8_t*)malloc(rowSize * height);
+    assert_non_null(pExpected);
+    assert_non_null(pActual);
+    Test_FillPattern(pExpected, rowSize * height, (unsigned int)i + 1);
+
+    uint8_t* pMapped = (uint8_t*)GLUpload_Map(&ring, stride * height);
+    assert_non_null(pMapped);
+    for (size_t y = 0; y < height; ++y) {
+      memcpy(pMapped + y * stride, pExpected + y * rowSize, rowSize);
+    }
+
+    GLTEXLEVEL before = level;
+    size_t cbUploaded = 0;
+    assert_int_equal(GLUPLOAD_OK, GLUpload_Commit(&ring, width, height, stride, images[i].nPixFmt,
+        &level, &cbUploaded));
+    assert_int_equal(rowSize * height, cbUploaded);
+    assert_int_equal(images[i].bSameLevel, !memcmp(&before, &level, sizeof(level)));
+    assert_int_equal(width, level.width);
+    assert_int_equal(images[i].nPixFmt, level.nPixFmt);
+
+    ReadTexture(width, height, images[i].nPixFmt, pActual);
+    assert_memory_equal(pExpected, pActual, rowSize * height);
+
+    free(pActual);
+    free(pExpected);
+  }
+
+  assert_int_equal(0, ring.bMapped);
+  assert_int_equal(sizeof(images) / sizeof(images[0]), ring.submitCounter.count);
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  GLUpload_Cleanup(&ring);
+}
+
+static void gl_upload_persistent_test(void** state)
+{
+  (void)state;
+
+  if (!g_textureId) {
+    skip();
+  }
+
+  if (!GLUpload_IsPersistentSupported()) {
+    skip();
+  }
+
+  RunRing(1);
+}
+
+static void gl_upload_orphan_test(void** state)
+{
+  (void)state;
+
+  if (!g_textureId) {
+    skip();
+  }
+
+  RunRing(0);
+}
+
+static void gl_upload_misuse_test(void** state)
+{
+  (void)state;
+
+  if (!g_textureId) {
+    skip();
+  }
+
+  GLUPLOADRING ring;
+  assert_int_equal(GLUPLOAD_OK, GLUpload_Init(&ring, 1));
+  glBindTexture(GL_TEXTURE_2D, g_textureId);
+
+  /* Nothing handed out, nothing to commit */
+  assert_int_equal(GLUPLOAD_ERROR_INVALID, GLUpload_Commit(&ring, 4, 4, 16, PIXFMT_PBGRA32, NULL, NULL));
+  assert_null(GLUpload_Map(&ring, 0));
+
+  /* One buffer at a time; a cancelled one is handed out again */
+  assert_non_null(GLUpload_Map(&ring, 64));
+  assert_null(GLUpload_Map(&ring, 64));
+  GLUpload_Cancel(&ring);
+  assert_int_equal(0, ring.nNext);
+  assert_non_null(GLUpload_Map(&ring, 64));
+
+  /* An image larger than the buffer is refused, and the buffer given back */
+  assert_int_equal(GLUPLOAD_ERROR_INVALID, GLUpload_Commit(&ring, 4, 5, 16, PIXFMT_PBGRA32, NULL, NULL));
+  assert_int_equal(0, ring.bMapped);
+  assert_non_null(GLUpload_Map(&ring, 64));
+  assert_int_equal(GLUPLOAD_ERROR_INVALID, GLUpload_Commit(&ring, 4, 4, 16, PIXFMT_RGB24, NULL, NULL));
+  assert_non_null(GLUpload_Map(&ring, 64));
+  assert_int_equal(GLUPLOAD_OK, GLUpload_Commit(&ring, 4, 4, 16, PIXFMT_PBGRA32, NULL, NULL));
+  assert_int_equal(1, ring.nNext);
+  assert_int_equal(GL_NO_ERROR, glGetError());
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  GLUpload_Cleanup(&ring);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(gl_upload_persistent_test),
+    cmocka_unit_test(gl_upload_orphan_test),
+    cmocka_unit_test(gl_upload_misuse_test)
+  };
+
+  return cmocka_run_group_tests(tests, gl_setup, gl_teardown);
+}
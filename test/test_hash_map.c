@@ -1,5 +1,7 @@
 #include "../hashmap.h"
 
+#include <stdint.h>
+#include <stdarg.h>
 #include <setjmp.h>
 #include <cmocka.h>
 
@@ -13,64 +15,24 @@ static void hash_map_insert_test(void** state)
   int key = 1000;
   int value = 51000;
   HashMap_Insert(&hashMap, &key, &value, sizeof(int));
-  /*
-   *  (1000)
-   */
-  assert_int_equal(1000, *(int*)hashMap.pRoot->pair.pKey);
+  assert_int_equal(1, HashTable_GetCount(&hashMap.table));
+
+  /* Re-inserting a key replaces its value, even with a different size */
+  long long wide = 0x123456789LL;
+  HashMap_Insert(&hashMap, &key, &wide, sizeof(wide));
+  assert_int_equal(1, HashTable_GetCount(&hashMap.table));
+  assert_true(wide == *(long long*)HashMap_Get(&hashMap, &key));
 
   key = 50;
-  value = 50;
-  HashMap_Insert(&hashMap, &key, &value, sizeof(int));
-  /*
-   *    (1000)
-   *    /
-   *  [50]
-   */
-  assert_int_equal(1000, *(int*)hashMap.pRoot->pair.pKey);
-  assert_int_equal(50, *(int*)hashMap.pRoot->pLeft->pair.pKey);
+  assert_null(HashMap_Get(&hashMap, &key));
 
-  key = 40;
-  value = 40;
   HashMap_Insert(&hashMap, &key, &value, sizeof(int));
-  /*
-   *     (50)
-   *     /  \
-   *  [40]  [1000]
-   */
-  assert_int_equal(50, *(int*)hashMap.pRoot->pair.pKey);
-  assert_int_equal(40, *(int*)hashMap.pRoot->pLeft->pair.pKey);
-  assert_int_equal(1000, *(int*)hashMap.pRoot->pRight->pair.pKey);
+  assert_int_equal(2, HashTable_GetCount(&hashMap.table));
 
-  key = 80;
-  value = 80;
-  HashMap_Insert(&hashMap, &key, &value, sizeof(int));
-  /*
-   *     (50)
-   *     /  \
-   *  (40)  (1000)
-   *        /
-   *      [80]
-   */
-  assert_int_equal(50, *(int*)hashMap.pRoot->pair.pKey);
-  assert_int_equal(40, *(int*)hashMap.pRoot->pLeft->pair.pKey);
-  assert_int_equal(1000, *(int*)hashMap.pRoot->pRight->pair.pKey);
-  assert_int_equal(80, *(int*)hashMap.pRoot->pRight->pLeft->pair.pKey);
-
-  key = 1500;
-  value = 1500;
-  HashMap_Insert(&hashMap, &key, &value, sizeof(int));
-  /*
-   *     (50)
-   *     /  \
-   *  (40)  (1000)
-   *        /   \
-   *      [80]  [1500]
-   */
-  assert_int_equal(50, *(int*)hashMap.pRoot->pair.pKey);
-  assert_int_equal(40, *(int*)hashMap.pRoot->pLeft->pair.pKey);
-  assert_int_equal(1000, *(int*)hashMap.pRoot->pRight->pair.pKey);
-  assert_int_equal(80, *(int*)hashMap.pRoot->pRight->pLeft->pair.pKey);
-  assert_int_equal(1500, *(int*)hashMap.pRoot->pRight->pRight->pair.pKey);
+  assert_true(HashMap_Erase(&hashMap, &key));
+  assert_false(HashMap_Erase(&hashMap, &key));
+  assert_null(HashMap_Get(&hashMap, &key));
+  assert_int_equal(1, HashTable_GetCount(&hashMap.table));
 
   HashMap_Cleanup(&hashMap);
 }
@@ -113,10 +75,143 @@ static void hash_map_get_test(void** state)
   HashMap_Cleanup(&hashMap);
 }
 
+static void hash_table_growth_test(void** state)
+{
+  (void)state;
+
+  HASHTABLE table;
+  HashTable_Init(&table, sizeof(int), sizeof(void*), NULL);
+
+  assert_null(HashTable_Find(&table, &(int){ 1 }));
+
+  /* Many rehashes along the way */
+  const int nKeys = 5000;
+  for (int i = 0; i < nKeys; ++i) {
+    int key = i * 7919;
+    void* pValue = (void*)(uintptr_t)(i + 1);
+    assert_int_equal(HASHTABLE_OK, HashTable_Insert(&table, &key, &pValue));
+  }
+
+  assert_int_equal(nKeys, HashTable_GetCount(&table));
+  assert_true(table.count <= table.capacity - table.capacity / 8);
+
+  for (int i = 0; i < nKeys; ++i) {
+    int key = i * 7919;
+    void** ppValue = (void**)HashTable_Find(&table, &key);
+    assert_non_null(ppValue);
+    assert_int_equal(i + 1, (uintptr_t)*ppValue);
+  }
+
+  int missing = 3;
+  assert_null(HashTable_Find(&table, &missing));
+
+  /* Every entry is visited exactly once */
+  size_t iter = 0;
+  size_t nVisited = 0;
+  void* pKey = NULL;
+  void* pValue = NULL;
+  long long keySum = 0;
+  while (HashTable_Next(&table, &iter, &pKey, &pValue)) {
+    keySum += *(int*)pKey / 7919;
+    ++nVisited;
+  }
+  assert_int_equal(nKeys, nVisited);
+  assert_true(keySum == (long long)nKeys * (nKeys - 1) / 2);
+
+  HashTable_Cleanup(&table);
+}
+
+static int compareUInt64(const void* key1, size_t key1Size, const void* key2, size_t key2Size)
+{
+  (void)key1Size;
+  (void)key2Size;
+
+  return memcmp(key1, key2, sizeof(uint64_t));
+}
+
+static void hash_table_erase_test(void** state)
+{
+  (void)state;
+
+  HASHTABLE table;
+  HashTable_Init(&table, sizeof(uint64_t), sizeof(unsigned char), compareUInt64);
+  assert_int_equal(HASHTABLE_OK, HashTable_Reserve(&table, 64));
+  size_t capacity = table.capacity;
+
+  for (uint64_t key = 0; key < 64; ++key) {
+    unsigned char value = (unsigned char)key;
+    assert_int_equal(HASHTABLE_OK, HashTable_Insert(&table, &key, &value));
+  }
+  assert_int_equal(capacity, table.capacity);
+
+  /* Remove the even keys; followers in each probe chain shift back */
+  for (uint64_t key = 0; key < 64; key += 2) {
+    assert_true(HashTable_Erase(&table, &key));
+    assert_false(HashTable_Erase(&table, &key));
+  }
+
+  assert_int_equal(32, HashTable_GetCount(&table));
+
+  for (uint64_t key = 0; key < 64; ++key) {
+    unsigned char* pValue = (unsigned char*)HashTable_Find(&table, &key);
+    if (key & 1) {
+      assert_non_null(pValue);
+      assert_int_equal(key, *pValue);
+    }
+    else {
+      assert_null(pValue);
+    }
+  }
+
+  /* Probe chains stay intact after reinsertion */
+  for (uint64_t key = 0; key < 64; key += 2) {
+    unsigned char value = (unsigned char)(key + 100);
+    assert_int_equal(HASHTABLE_OK, HashTable_Insert(&table, &key, &value));
+  }
+
+  for (uint64_t key = 0; key < 64; ++key) {
+    unsigned char* pValue = (unsigned char*)HashTable_Find(&table, &key);
+    assert_non_null(pValue);
+    assert_int_equal(key & 1 ? key : key + 100, *pValue);
+  }
+
+  HashTable_Cleanup(&table);
+}
+
+/* Odd-sized keys go through the generic hash and keep values aligned */
+static void hash_table_layout_test(void** state)
+{
+  (void)state;
+
+  HASHTABLE table;
+  HashTable_Init(&table, 3, sizeof(double), NULL);
+  assert_int_equal(8, table.valueOffset);
+  assert_int_equal(16, table.entrySize);
+
+  for (int i = 0; i < 100; ++i) {
+    unsigned char key[3] = { (unsigned char)i, (unsigned char)(i * 3), 0x5A };
+    double value = i * 0.5;
+    assert_int_equal(HASHTABLE_OK, HashTable_Insert(&table, key, &value));
+  }
+
+  for (int i = 0; i < 100; ++i) {
+    unsigned char key[3] = { (unsigned char)i, (unsigned char)(i * 3), 0x5A };
+    double* pValue = (double*)HashTable_Find(&table, key);
+    assert_non_null(pValue);
+    assert_int_equal(0, (uintptr_t)pValue % sizeof(double));
+    assert_true(*pValue == i * 0.5);
+  }
+
+  HashTable_Cleanup(&table);
+}
+
 int main() {
   const struct CMUnitTest tests[] = {
     cmocka_unit_test(hash_map_insert_test),
-    cmocka_unit_test(hash_map_get_test)
+    cmocka_unit_test(hash_map_get_test),
+    cmocka_unit_test(hash_table_growth_test),
+    cmocka_unit_test(hash_table_erase_test),
+    cmocka_unit_test(hash_table_layout_test)
   };
 
   return cmocka_run_group_tests(tests, NULL, NULL);
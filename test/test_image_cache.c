@@ -0,0 +1,133 @@
+#include "../imgcache.h"
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+/* Images are plain integers here; releasing one records it */
+static int g_images[16];
+static int g_nReleased[16];
+
+static void ReleaseImage(void* pImage, void* pUserData)
+{
+  (void)pUserData;
+
+  ++g_nReleased[(int*)pImage - g_images];
+}
+
+static void ResetImages(void)
+{
+  for (int i = 0; i < 16; ++i) {
+    g_images[i] = i;
+    g_nReleased[i] = 0;
+  }
+}
+
+static void image_cache_hit_miss_test(void** state)
+{
+  (void)state;
+
+  ResetImages();
+
+  IMGCACHE cache;
+  ImgCache_Init(&cache, 1000, ReleaseImage, NULL);
+
+  assert_null(ImgCache_Find(&cache, "a.png", 10, 1));
+  assert_int_equal(IMGCACHE_OK, ImgCache_Insert(&cache, "a.png", 10, 1, &g_images[0], 100));
+  assert_ptr_equal(&g_images[0], ImgCache_Find(&cache, "a.png", 10, 1));
+
+  /* Same path but a rewritten file: the stale entry goes away */
+  assert_null(ImgCache_Find(&cache, "a.png", 10, 2));
+  assert_int_equal(1, g_nReleased[0]);
+  assert_null(ImgCache_Find(&cache, "a.png", 10, 1));
+
+  /* Replacing an entry releases the old image */
+  ImgCache_Insert(&cache, "b.png", 10, 1, &g_images[1], 100);
+  ImgCache_Insert(&cache, "b.png", 20, 1, &g_images[2], 150);
+  assert_int_equal(1, g_nReleased[1]);
+  assert_ptr_equal(&g_images[2], ImgCache_Find(&cache, "b.png", 20, 1));
+
+  IMGCACHESTATS stats;
+  ImgCache_GetStats(&cache, &stats);
+  assert_int_equal(2, stats.hits);
+  assert_int_equal(3, stats.misses);
+  assert_int_equal(1, stats.invalidations);
+  assert_int_equal(0, stats.evictions);
+  assert_int_equal(1, stats.count);
+  assert_int_equal(150, stats.bytes);
+
+  ImgCache_Cleanup(&cache);
+  assert_int_equal(1, g_nReleased[2]);
+}
+
+static void image_cache_lru_test(void** state)
+{
+  (void)state;
+
+  ResetImages();
+
+  IMGCACHE cache;
+  ImgCache_Init(&cache, 300, ReleaseImage, NULL);
+
+  ImgCache_Insert(&cache, "0", 0, 0, &g_images[0], 100);
+  ImgCache_Insert(&cache, "1", 0, 0, &g_images[1], 100);
+  ImgCache_Insert(&cache, "2", 0, 0, &g_images[2], 100);
+
+  /* Touching 0 makes 1 the least recently used */
+  assert_non_null(ImgCache_Find(&cache, "0", 0, 0));
+  ImgCache_Insert(&cache, "3", 0, 0, &g_images[3], 100);
+  assert_int_equal(1, g_nReleased[1]);
+  assert_null(ImgCache_Find(&cache, "1", 0, 0));
+
+  /* A large image evicts as many as needed */
+  ImgCache_Insert(&cache, "4", 0, 0, &g_images[4], 250);
+  assert_int_equal(1, g_nReleased[2]);
+  assert_int_equal(1, g_nReleased[0]);
+  assert_int_equal(1, g_nReleased[3]);
+  assert_ptr_equal(&g_images[4], ImgCache_Find(&cache, "4", 0, 0));
+
+  /* Images beyond the whole budget are refused and stay with the caller */
+  assert_int_equal(IMGCACHE_ERROR_TOO_LARGE, ImgCache_Insert(&cache, "5", 0, 0, &g_images[5], 301));
+  assert_int_equal(0, g_nReleased[5]);
+
+  /* Shrinking the budget evicts right away */
+  ImgCache_SetBudget(&cache, 200);
+  assert_int_equal(1, g_nReleased[4]);
+
+  IMGCACHESTATS stats;
+  ImgCache_GetStats(&cache, &stats);
+  assert_int_equal(5, stats.evictions);
+  assert_int_equal(0, stats.count);
+  assert_int_equal(0, stats.bytes);
+
+  /* Touching counts neither hits nor misses but still refreshes recency */
+  ImgCache_Insert(&cache, "7", 0, 0, &g_images[7], 100);
+  ImgCache_Insert(&cache, "8", 0, 0, &g_images[8], 100);
+  assert_int_equal(1, ImgCache_Touch(&cache, "7", 0, 0));
+  assert_int_equal(0, ImgCache_Touch(&cache, "9", 0, 0));
+  ImgCache_Insert(&cache, "9", 0, 0, &g_images[9], 100);
+  assert_int_equal(1, g_nReleased[8]);
+  assert_int_equal(0, g_nReleased[7]);
+  ImgCache_GetStats(&cache, &stats);
+  assert_int_equal(6, stats.evictions);
+  assert_int_equal(2, stats.hits);
+  assert_int_equal(1, stats.misses);
+  ImgCache_Clear(&cache);
+
+  assert_int_equal(IMGCACHE_OK, ImgCache_Insert(&cache, "6", 0, 0, &g_images[6], 200));
+  assert_int_equal(1, ImgCache_Remove(&cache, "6"));
+  assert_int_equal(0, ImgCache_Remove(&cache, "6"));
+  assert_int_equal(1, g_nReleased[6]);
+
+  ImgCache_Cleanup(&cache);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(image_cache_hit_miss_test),
+    cmocka_unit_test(image_cache_lru_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
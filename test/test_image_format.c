@@ -0,0 +1,237 @@
+#include "../imgformat.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+static const unsigned char g_png[] = {
+  0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n',
+  0x00, 0x00, 0x00, 0x0D, 'I', 'H', 'D', 'R',
+  0x00, 0x00, 0x07, 0x80, 0x00, 0x00, 0x04, 0x38,
+  0x08, 0x06, 0x00, 0x00, 0x00
+};
+
+static const unsigned char g_gif[] = {
+  'G', 'I', 'F', '8', '9', 'a', 0x40, 0x01, 0xF0, 0x00, 0x00, 0x00, 0x00
+};
+
+/* SOI, a short APP0 segment, then a baseline SOF0 */
+static const unsigned char g_jpeg[] = {
+  0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x06, 'J', 'F', 'I', 'F',
+  0xFF, 0xC0, 0x00, 0x11, 0x08, 0x02, 0x58, 0x03, 0x20, 0x03
+};
+
+static const unsigned char g_webpLossless[] = {
+  'R', 'I', 'F', 'F', 0x1A, 0x00, 0x00, 0x00, 'W', 'E', 'B', 'P',
+  'V', 'P', '8', 'L', 0x0D, 0x00, 0x00, 0x00, 0x2F,
+  /* 14 bits width - 1 = 99, 14 bits height - 1 = 49 */
+  0x63, 0x40, 0x0C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static const unsigned char g_webpExtended[] = {
+  'R', 'I', 'F', 'F', 0x00, 0x10, 0x00, 0x00, 'W', 'E', 'B', 'P',
+  'V', 'P', '8', 'X', 0x0A, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00,
+  0xFF, 0x0E, 0x00, 0x37, 0x0A, 0x00
+};
+
+/* 24-bit bitmap with a BITMAPINFOHEADER */
+static const unsigned char g_bmp[] = {
+  'B', 'M', 0x36, 0x10, 0x0E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x36, 0x00, 0x00, 0x00,
+  0x28, 0x00, 0x00, 0x00, 0x80, 0x02, 0x00, 0x00, 0x20, 0xFE, 0xFF, 0xFF, 0x01, 0x00, 0x18, 0x00
+};
+
+static void image_format_builtin_test(void** state)
+{
+  (void)state;
+
+  IMGFORMATREGISTRY registry;
+  ImgFormat_InitRegistry(&registry);
+
+  IMGINFO info;
+  const IMGFORMAT* pFormat = ImgFormat_Probe(&registry, g_png, sizeof(g_png), &info);
+  assert_non_null(pFormat);
+  assert_int_equal(IMGFORMAT_PNG, info.nFormat);
+  assert_int_equal(1920, info.width);
+  assert_int_equal(1080, info.height);
+  assert_int_equal(4, info.nChannels);
+  assert_int_equal(8, info.nBitDepth);
+
+  ImgFormat_Probe(&registry, g_gif, sizeof(g_gif), &info);
+  assert_int_equal(IMGFORMAT_GIF, info.nFormat);
+  assert_int_equal(320, info.width);
+  assert_int_equal(240, info.height);
+
+  ImgFormat_Probe(&registry, g_jpeg, sizeof(g_jpeg), &info);
+  assert_int_equal(IMGFORMAT_JPEG, info.nFormat);
+  assert_int_equal(800, info.width);
+  assert_int_equal(600, info.height);
+  assert_int_equal(3, info.nChannels);
+  assert_int_equal(8, info.nBitDepth);
+  assert_int_equal(1, info.nFrames);
+
+  ImgFormat_Probe(&registry, g_webpLossless, sizeof(g_webpLossless), &info);
+  assert_int_equal(IMGFORMAT_WEBP, info.nFormat);
+  assert_int_equal(100, info.width);
+  assert_int_equal(50, info.height);
+  assert_int_equal(3, info.nChannels);
+  assert_int_equal(1, info.nFrames);
+
+  ImgFormat_Probe(&registry, g_webpExtended, sizeof(g_webpExtended), &info);
+  assert_int_equal(IMGFORMAT_WEBP, info.nFormat);
+  assert_int_equal(3840, info.width);
+  assert_int_equal(2616, info.height);
+  assert_int_equal(4, info.nChannels);
+
+  const char* pszPGM = "P2\n# comment\n 640\t480\n255\n";
+  ImgFormat_Probe(&registry, pszPGM, strlen(pszPGM), &info);
+  assert_int_equal(IMGFORMAT_PGM, info.nFormat);
+  assert_int_equal(640, info.width);
+  assert_int_equal(480, info.height);
+  assert_int_equal(1, info.nChannels);
+  assert_int_equal(8, info.nBitDepth);
+
+  const char* pszPPM = "P3 4 2 1023 ";
+  ImgFormat_Probe(&registry, pszPPM, strlen(pszPPM), &info);
+  assert_int_equal(IMGFORMAT_PPM, info.nFormat);
+  assert_int_equal(4, info.width);
+  assert_int_equal(3, info.nChannels);
+  assert_int_equal(10, info.nBitDepth);
+
+  /* Top-down, with a negative height */
+  ImgFormat_Probe(&registry, g_bmp, sizeof(g_bmp), &info);
+  assert_int_equal(IMGFORMAT_BMP, info.nFormat);
+  assert_int_equal(640, info.width);
+  assert_int_equal(480, info.height);
+  assert_int_equal(3, info.nChannels);
+  assert_int_equal(8, info.nBitDepth);
+  assert_int_equal(1, info.nFrames);
+
+  /* Recognized, but the dimensions are cut off */
+  ImgFormat_Probe(&registry, g_jpeg, 12, &info);
+  assert_int_equal(IMGFORMAT_JPEG, info.nFormat);
+  assert_int_equal(0, info.width);
+  assert_int_equal(0, info.height);
+  assert_int_equal(0, info.nChannels);
+
+  ImgFormat_Probe(&registry, "P5 64", 5, &info);
+  assert_int_equal(IMGFORMAT_PGM, info.nFormat);
+  assert_int_equal(0, info.width);
+
+  /* A RIFF file that is not WebP, and plain noise */
+  unsigned char wave[16];
+  memcpy(wave, g_webpExtended, sizeof(wave));
+  memcpy(wave + 8, "WAVE", 4);
+  assert_null(ImgFormat_Probe(&registry, wave, sizeof(wave), &info));
+  assert_int_equal(IMGFORMAT_UNKNOWN, info.nFormat);
+  assert_null(ImgFormat_Probe(&registry, "GIF", 3, NULL));
+  assert_null(ImgFormat_Probe(&registry, "BMW service notes", 17, NULL));
+  assert_null(ImgFormat_Probe(&registry, NULL, 0, NULL));
+}
+
+static int TestInfo(const unsigned char* pData, size_t size, LPIMGINFO pInfo)
+{
+  if (size < 8) {
+    return 0;
+  }
+
+  pInfo->width = pData[6];
+  pInfo->height = pData[7];
+  return 1;
+}
+
+static void image_format_register_test(void** state)
+{
+  (void)state;
+
+  IMGFORMATREGISTRY registry;
+  ImgFormat_InitRegistry(&registry);
+
+  /* A format with its signature away from the start */
+  static const int decoder = 42;
+  const IMGFORMAT custom = { IMGFORMAT_USER, "Test", TestInfo, NULL };
+  assert_int_equal(IMGFORMAT_OK, ImgFormat_AddFormat(&registry, &custom));
+  assert_int_equal(IMGFORMAT_OK, ImgFormat_AddSignature(&registry, IMGFORMAT_USER, 2, "TI", NULL, 2));
+  assert_int_equal(IMGFORMAT_OK, ImgFormat_SetDecoder(&registry, IMGFORMAT_USER, &decoder));
+
+  IMGINFO info;
+  const unsigned char data[] = { 0, 0, 'T', 'I', 0, 0, 7, 9 };
+  const IMGFORMAT* pFormat = ImgFormat_Probe(&registry, data, sizeof(data), &info);
+  assert_non_null(pFormat);
+  assert_string_equal("Test", pFormat->pszName);
+  assert_ptr_equal(&decoder, pFormat->pDecoder);
+  assert_int_equal(7, info.width);
+  assert_int_equal(9, info.height);
+  assert_ptr_equal(pFormat, ImgFormat_Find(&registry, IMGFORMAT_USER));
+
+  /* Masked bytes are ignored */
+  const unsigned char mask[] = { 0xFF, 0xF0 };
+  assert_int_equal(IMGFORMAT_OK, ImgFormat_AddSignature(&registry, IMGFORMAT_USER, 0, "Z\x30", mask, 2));
+  assert_non_null(ImgFormat_Probe(&registry, "Z7", 2, NULL));
+  assert_null(ImgFormat_Probe(&registry, "Z\x47", 2, NULL));
+
+  assert_int_equal(IMGFORMAT_ERROR_INVALID, ImgFormat_AddSignature(&registry, 99, 0, "X", NULL, 1));
+  assert_int_equal(IMGFORMAT_ERROR_INVALID,
+      ImgFormat_AddSignature(&registry, IMGFORMAT_USER, IMGFORMAT_PROBE_SIZE, "X", NULL, 1));
+  assert_int_equal(IMGFORMAT_ERROR_INVALID, ImgFormat_SetDecoder(&registry, 99, &decoder));
+  assert_null(ImgFormat_Find(&registry, 99));
+}
+
+static void image_format_extension_test(void** state)
+{
+  (void)state;
+
+  IMGFORMATREGISTRY registry;
+  ImgFormat_InitRegistry(&registry);
+
+  /* By the last extension, whatever its case */
+  assert_int_equal(IMGFORMAT_JPEG, ImgFormat_FindByName(&registry, "IMG_0001.JPG")->nFormat);
+  assert_int_equal(IMGFORMAT_JPEG, ImgFormat_FindByName(&registry, "a.b.Jpeg")->nFormat);
+  assert_int_equal(IMGFORMAT_PNG, ImgFormat_FindByName(&registry, "scan.png")->nFormat);
+  assert_null(ImgFormat_FindByName(&registry, "scan.png.txt"));
+  assert_null(ImgFormat_FindByName(&registry, "png"));
+  assert_null(ImgFormat_FindByName(&registry, ".png"));
+  assert_null(ImgFormat_FindByName(&registry, "trailing."));
+  assert_null(ImgFormat_FindByName(&registry, "long.pngpngpng"));
+
+  const IMGFORMAT custom = { IMGFORMAT_USER, "Test", NULL, NULL };
+  assert_int_equal(IMGFORMAT_OK, ImgFormat_AddFormat(&registry, &custom));
+  assert_int_equal(IMGFORMAT_OK, ImgFormat_AddExtension(&registry, IMGFORMAT_USER, "TsT"));
+  assert_int_equal(IMGFORMAT_USER, ImgFormat_FindByName(&registry, "x.tst")->nFormat);
+
+  assert_int_equal(IMGFORMAT_ERROR_INVALID, ImgFormat_AddExtension(&registry, 99, "x"));
+  assert_int_equal(IMGFORMAT_ERROR_INVALID, ImgFormat_AddExtension(&registry, IMGFORMAT_USER, ""));
+  assert_int_equal(IMGFORMAT_ERROR_INVALID, ImgFormat_AddExtension(&registry, IMGFORMAT_USER, "toolong8"));
+}
+
+static void image_format_file_test(void** state)
+{
+  (void)state;
+
+  IMGFORMATREGISTRY registry;
+  ImgFormat_InitRegistry(&registry);
+
+  /* A whole file shorter than any fixed probe size still counts */
+  FILE* fp = tmpfile();
+  assert_non_null(fp);
+  fwrite(g_gif, 1, sizeof(g_gif), fp);
+  rewind(fp);
+
+  IMGINFO info;
+  assert_non_null(ImgFormat_ProbeFile(&registry, fp, &info));
+  assert_int_equal(IMGFORMAT_GIF, info.nFormat);
+  assert_int_equal(320, info.width);
+  fclose(fp);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(image_format_builtin_test),
+    cmocka_unit_test(image_format_register_test),
+    cmocka_unit_test(image_format_extension_test),
+    cmocka_unit_test(image_format_file_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,182 @@
+#include "../imageinfo.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+/* Two frames of 2x2 after a looping extension, then a third without control extension */
+static const unsigned char g_gif[] = {
+  'G', 'I', 'F', '8', '9', 'a', 0x02, 0x00, 0x02, 0x00, 0x80, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF,
+  0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00,
+  0x21, 0xF9, 0x04, 0x00, 0x0A, 0x00, 0x00, 0x00,
+  0x2C, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x02, 0x00, 0x00, 0x02, 0x02, 0x44, 0x01, 0x00,
+  0x21, 0xF9, 0x04, 0x00, 0x0A, 0x00, 0x00, 0x00,
+  0x2C, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x02, 0x00, 0x80, 0x00, 0x00, 0x00, 0xFF, 0x00, 0x00,
+  0x02, 0x02, 0x44, 0x01, 0x00,
+  0x2C, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x02, 0x00, 0x00, 0x02, 0x02, 0x44, 0x01, 0x00,
+  0x3B
+};
+
+static const unsigned char g_webp[] = {
+  'R', 'I', 'F', 'F', 0x3A, 0x00, 0x00, 0x00, 'W', 'E', 'B', 'P',
+  'V', 'P', '8', 'X', 0x0A, 0x00, 0x00, 0x00, 0x12, 0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x1F, 0x00, 0x00,
+  'A', 'N', 'I', 'M', 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  'A', 'N', 'M', 'F', 0x03, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x00,
+  'A', 'N', 'M', 'F', 0x03, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x00
+};
+
+static FILE* TempFile(const void* pData, size_t size)
+{
+  FILE* fp = tmpfile();
+  assert_non_null(fp);
+  assert_int_equal(size, fwrite(pData, 1, size, fp));
+  rewind(fp);
+  return fp;
+}
+
+/* An APNG whose acTL chunk lies past the probed bytes, behind a long comment */
+static FILE* TempAPNG(unsigned int nFrames)
+{
+  static const unsigned char header[] = {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n',
+    0x00, 0x00, 0x00, 0x0D, 'I', 'H', 'D', 'R',
+    0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x30, 0x08, 0x02, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00
+  };
+
+  unsigned char data[sizeof(header) + 12 + 2000 + 20 + 12];
+  unsigned char* p = data;
+  memcpy(p, header, sizeof(header));
+  p += sizeof(header);
+
+  const unsigned char text[8] = { 0x00, 0x00, 0x07, 0xD0, 't', 'E', 'X', 't' };
+  memcpy(p, text, sizeof(text));
+  memset(p + 8, 'x', 2000 + 4);
+  p += 12 + 2000;
+
+  const unsigned char actl[20] = {
+    0x00, 0x00, 0x00, 0x08, 'a', 'c', 'T', 'L', 0x00, 0x00, 0x00, (unsigned char)nFrames,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+  };
+  memcpy(p, actl, sizeof(actl));
+  p += sizeof(actl);
+
+  const unsigned char idat[12] = { 0x00, 0x00, 0x00, 0x00, 'I', 'D', 'A', 'T', 0x00, 0x00, 0x00, 0x00 };
+  memcpy(p, idat, sizeof(idat));
+
+  return TempFile(data, sizeof(data));
+}
+
+static void image_info_frames_test(void** state)
+{
+  (void)state;
+
+  IMGFORMATREGISTRY registry;
+  ImgFormat_InitRegistry(&registry);
+
+  /* Header only, the frames of a GIF are unknown */
+  IMGINFO info;
+  FILE* fp = TempFile(g_gif, sizeof(g_gif));
+  assert_int_equal(IMAGEINFO_OK, ImageInfo_ProbeFile(&registry, fp, &info, 0));
+  assert_int_equal(IMGFORMAT_GIF, info.nFormat);
+  assert_int_equal(2, info.width);
+  assert_int_equal(3, info.nChannels);
+  assert_int_equal(1, info.nBitDepth);
+  assert_int_equal(0, info.nFrames);
+
+  rewind(fp);
+  assert_int_equal(IMAGEINFO_OK, ImageInfo_ProbeFile(&registry, fp, &info, IMAGEINFO_COUNT_FRAMES));
+  assert_int_equal(3, info.nFrames);
+  fclose(fp);
+
+  /* A truncated GIF has the frames found before the cut */
+  fp = TempFile(g_gif, 70);
+  assert_int_equal(IMAGEINFO_OK, ImageInfo_ProbeFile(&registry, fp, &info, IMAGEINFO_COUNT_FRAMES));
+  assert_int_equal(1, info.nFrames);
+  fclose(fp);
+
+  fp = TempFile(g_webp, sizeof(g_webp));
+  assert_int_equal(IMAGEINFO_OK, ImageInfo_ProbeFile(&registry, fp, &info, 0));
+  assert_int_equal(IMGFORMAT_WEBP, info.nFormat);
+  assert_int_equal(64, info.width);
+  assert_int_equal(32, info.height);
+  assert_int_equal(4, info.nChannels);
+  assert_int_equal(0, info.nFrames);
+
+  rewind(fp);
+  assert_int_equal(IMAGEINFO_OK, ImageInfo_ProbeFile(&registry, fp, &info, IMAGEINFO_COUNT_FRAMES));
+  assert_int_equal(2, info.nFrames);
+  fclose(fp);
+
+  fp = TempAPNG(5);
+  assert_int_equal(IMAGEINFO_OK, ImageInfo_ProbeFile(&registry, fp, &info, 0));
+  assert_int_equal(IMGFORMAT_PNG, info.nFormat);
+  assert_int_equal(64, info.width);
+  assert_int_equal(48, info.height);
+  assert_int_equal(3, info.nChannels);
+  assert_int_equal(8, info.nBitDepth);
+  assert_int_equal(0, info.nFrames);
+
+  rewind(fp);
+  assert_int_equal(IMAGEINFO_OK, ImageInfo_ProbeFile(&registry, fp, &info, IMAGEINFO_COUNT_FRAMES));
+  assert_int_equal(5, info.nFrames);
+  fclose(fp);
+}
+
+static void image_info_path_test(void** state)
+{
+  (void)state;
+
+  IMGFORMATREGISTRY registry;
+  ImgFormat_InitRegistry(&registry);
+
+  const char* pszPath = "test_image_info.ppm";
+  FILE* fp = fopen(pszPath, "wb");
+  assert_non_null(fp);
+  fputs("P6\n# 16 bits per sample\n320 200\n65535\n", fp);
+  fclose(fp);
+
+  IMGINFO info;
+  assert_int_equal(IMAGEINFO_OK, ImageInfo_Probe(&registry, pszPath, &info, IMAGEINFO_COUNT_FRAMES));
+  assert_int_equal(IMGFORMAT_PPM, info.nFormat);
+  assert_int_equal(320, info.width);
+  assert_int_equal(200, info.height);
+  assert_int_equal(3, info.nChannels);
+  assert_int_equal(16, info.nBitDepth);
+  assert_int_equal(1, info.nFrames);
+
+  fp = fopen(pszPath, "wb");
+  assert_non_null(fp);
+  fputs("P6 is not a format for notes\n", fp);
+  fclose(fp);
+
+  /* Recognized by its signature, but without a usable header */
+  assert_int_equal(IMAGEINFO_OK, ImageInfo_Probe(&registry, pszPath, &info, 0));
+  assert_int_equal(IMGFORMAT_PPM, info.nFormat);
+  assert_int_equal(0, info.width);
+  assert_int_equal(0, info.nChannels);
+
+  fp = fopen(pszPath, "wb");
+  assert_non_null(fp);
+  fputs("Just notes\n", fp);
+  fclose(fp);
+
+  assert_int_equal(IMAGEINFO_ERROR_FORMAT, ImageInfo_Probe(&registry, pszPath, &info, 0));
+  assert_int_equal(IMGFORMAT_UNKNOWN, info.nFormat);
+
+  remove(pszPath);
+  assert_int_equal(IMAGEINFO_ERROR_IO, ImageInfo_Probe(&registry, pszPath, &info, 0));
+  assert_int_equal(0, info.width);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(image_info_frames_test),
+    cmocka_unit_test(image_info_path_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
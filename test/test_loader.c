@@ -0,0 +1,382 @@
+#include "../loader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+/*
+ * The callbacks run on the workers, where cmocka must not be used; they only
+ * record into preallocated slots that the test thread checks afterwards.
+ */
+
+#define TEST_MAX_REQUESTS 256
+
+typedef struct _tagTESTJOB {
+  int nIndex;
+  int nDecodeMs;
+  int bResumable;             /* Yields when asked, keeping nDone */
+  volatile long nDone;        /* Milliseconds decoded so far */
+  volatile long nOrder;       /* Of its completion, from 1 */
+  volatile long nCompletions;
+  volatile long status;
+  volatile long nResult;
+  double submitted;
+  double completed;
+} TESTJOB;
+
+static TESTJOB g_jobs[TEST_MAX_REQUESTS];
+static long g_results[TEST_MAX_REQUESTS];
+static volatile long g_nCompleted;
+
+static double Test_Now(void)
+{
+#ifdef _WIN32
+  LARGE_INTEGER freq;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / (double)freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+static void Test_SleepMs(int ms)
+{
+#ifdef _WIN32
+  Sleep((DWORD)ms);
+#else
+  struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+  nanosleep(&ts, NULL);
+#endif
+}
+
+static void Test_ResetJobs(int nDecodeMs)
+{
+  memset(g_jobs, 0, sizeof(g_jobs));
+  Atomic_Store(&g_nCompleted, 0);
+  for (int i = 0; i < TEST_MAX_REQUESTS; ++i) {
+    g_jobs[i].nIndex = i;
+    g_jobs[i].nDecodeMs = nDecodeMs;
+    g_jobs[i].status = 1;
+    g_results[i] = i * 10;
+  }
+}
+
+/* Pretend to decode in 1 ms units, polling the token in between */
+static int TestDecode(void* pArg, LPLOADTOKEN pToken, void** ppResult, void* pUserData)
+{
+  (void)pUserData;
+
+  TESTJOB* pJob = (TESTJOB*)pArg;
+  while (Atomic_Load(&pJob->nDone) < pJob->nDecodeMs) {
+    if (LoadToken_IsCancelled(pToken)) {
+      return LOADER_CANCELLED;
+    }
+    if (pJob->bResumable && LoadToken_ShouldYield(pToken)) {
+      return LOADER_PREEMPTED;
+    }
+    Test_SleepMs(1);
+    Atomic_Increment(&pJob->nDone);
+  }
+
+  *ppResult = &g_results[pJob->nIndex];
+  return LOADER_OK;
+}
+
+static void TestComplete(void* pArg, void* pResult, int status, uint64_t nGeneration, void* pUserData)
+{
+  (void)nGeneration;
+  (void)pUserData;
+
+  TESTJOB* pJob = (TESTJOB*)pArg;
+  pJob->completed = Test_Now();
+  Atomic_Store(&pJob->nOrder, Atomic_Increment(&g_nCompleted));
+  Atomic_Store(&pJob->status, status);
+  Atomic_Store(&pJob->nResult, pResult ? *(long*)pResult : -1);
+  Atomic_Increment(&pJob->nCompletions);
+}
+
+static const LOADERCALLBACKS g_callbacks = { NULL, NULL, TestDecode, TestComplete };
+
+static void loader_queue_test(void** state)
+{
+  (void)state;
+
+  Test_ResetJobs(0);
+
+  LOADER loader;
+  assert_int_equal(LOADER_OK, Loader_Init(&loader, 3, &g_callbacks, NULL));
+
+  uint64_t nLast = 0;
+  for (int i = 0; i < 64; ++i) {
+    uint64_t nGeneration = Loader_Submit(&loader, &g_jobs[i], 0);
+    assert_true(nGeneration > nLast);
+    nLast = nGeneration;
+  }
+  assert_int_equal(nLast, Loader_GetGeneration(&loader));
+
+  Loader_WaitIdle(&loader);
+
+  /* Without superseding every request is decoded */
+  for (int i = 0; i < 64; ++i) {
+    assert_int_equal(1, Atomic_Load(&g_jobs[i].nCompletions));
+    assert_int_equal(LOADER_OK, Atomic_Load(&g_jobs[i].status));
+    assert_int_equal(i * 10, Atomic_Load(&g_jobs[i].nResult));
+  }
+
+  Loader_Shutdown(&loader);
+}
+
+/*
+ * Hold-the-arrow-key stress: a burst of superseding requests, each of which
+ * would take 20 ms to decode. Only the last one must be finished, and its
+ * latency from request to ready buffer must not include the decodes it
+ * superseded (serially those alone would take about a second).
+ */
+static void loader_supersede_stress_test(void** state)
+{
+  (void)state;
+
+  const int nRequests = 100;
+  Test_ResetJobs(20);
+
+  LOADER loader;
+  assert_int_equal(LOADER_OK, Loader_Init(&loader, 2, &g_callbacks, NULL));
+
+  for (int i = 0; i < nRequests; ++i) {
+    g_jobs[i].submitted = Test_Now();
+    assert_true(Loader_Submit(&loader, &g_jobs[i], 1) > 0);
+  }
+
+  Loader_WaitIdle(&loader);
+
+  int nCancelled = 0;
+  for (int i = 0; i < nRequests; ++i) {
+    assert_int_equal(1, Atomic_Load(&g_jobs[i].nCompletions));
+    if (Atomic_Load(&g_jobs[i].status) == LOADER_CANCELLED) {
+      assert_int_equal(-1, Atomic_Load(&g_jobs[i].nResult));
+      ++nCancelled;
+    }
+  }
+
+  TESTJOB* pLast = &g_jobs[nRequests - 1];
+  assert_int_equal(LOADER_OK, Atomic_Load(&pLast->status));
+  assert_int_equal((nRequests - 1) * 10, Atomic_Load(&pLast->nResult));
+  assert_int_equal(nRequests - 1, nCancelled);
+
+  double latency = pLast->completed - pLast->submitted;
+  assert_true(latency < 0.5);
+
+  Loader_Shutdown(&loader);
+}
+
+/* Prefetches wait for regular requests and can be dropped on their own */
+static void loader_prefetch_test(void** state)
+{
+  (void)state;
+
+  Test_ResetJobs(20);
+
+  LOADER loader;
+  assert_int_equal(LOADER_OK, Loader_Init(&loader, 1, &g_callbacks, NULL));
+
+  /* The worker is held up by the first request while the rest arrive */
+  g_jobs[0].nDecodeMs = 100;
+  Loader_Submit(&loader, &g_jobs[0], 0);
+  for (int i = 1; i < 5; ++i) {
+    assert_true(Loader_Prefetch(&loader, &g_jobs[i]) > 0);
+  }
+  Loader_Submit(&loader, &g_jobs[5], 0);
+  Loader_WaitIdle(&loader);
+
+  /* The later regular request overtakes the queued prefetches */
+  assert_int_equal(LOADER_OK, Atomic_Load(&g_jobs[5].status));
+  for (int i = 1; i < 5; ++i) {
+    assert_int_equal(LOADER_OK, Atomic_Load(&g_jobs[i].status));
+    assert_true(g_jobs[i].completed > g_jobs[5].completed);
+  }
+
+  Test_ResetJobs(20);
+  Loader_Submit(&loader, &g_jobs[0], 0);
+  for (int i = 1; i < 5; ++i) {
+    Loader_Prefetch(&loader, &g_jobs[i]);
+  }
+  Loader_CancelPrefetch(&loader);
+  Loader_WaitIdle(&loader);
+
+  assert_int_equal(LOADER_OK, Atomic_Load(&g_jobs[0].status));
+  for (int i = 1; i < 5; ++i) {
+    assert_int_equal(1, Atomic_Load(&g_jobs[i].nCompletions));
+    assert_int_equal(LOADER_CANCELLED, Atomic_Load(&g_jobs[i].status));
+  }
+
+  /* Superseding cancels prefetches too */
+  Test_ResetJobs(20);
+  Loader_Prefetch(&loader, &g_jobs[0]);
+  Loader_Prefetch(&loader, &g_jobs[1]);
+  Loader_Submit(&loader, &g_jobs[2], 1);
+  Loader_WaitIdle(&loader);
+
+  assert_int_equal(LOADER_CANCELLED, Atomic_Load(&g_jobs[0].status));
+  assert_int_equal(LOADER_CANCELLED, Atomic_Load(&g_jobs[1].status));
+  assert_int_equal(LOADER_OK, Atomic_Load(&g_jobs[2].status));
+
+  Loader_Shutdown(&loader);
+}
+
+/* Classes in order, deadlines in order within them, ties as they came */
+static void loader_class_order_test(void** state)
+{
+  (void)state;
+
+  Test_ResetJobs(2);
+
+  LOADER loader;
+  assert_int_equal(LOADER_OK, Loader_Init(&loader, 1, &g_callbacks, NULL));
+
+  /* The worker is held up by the first request while the rest arrive */
+  g_jobs[0].nDecodeMs = 100;
+  Loader_Submit(&loader, &g_jobs[0], 0);
+  while (!Atomic_Load(&g_jobs[0].nDone)) {
+    Test_SleepMs(1);
+  }
+  Loader_SubmitClass(&loader, &g_jobs[1], LOADER_CLASS_THUMBNAIL, LOADER_NO_DEADLINE, 0);
+  Loader_SubmitClass(&loader, &g_jobs[2], LOADER_CLASS_THUMBNAIL, 50, 0);
+  Loader_SubmitClass(&loader, &g_jobs[3], LOADER_CLASS_PREFETCH, 30, 0);
+  Loader_SubmitClass(&loader, &g_jobs[4], LOADER_CLASS_PREFETCH, 20, 0);
+  Loader_SubmitClass(&loader, &g_jobs[5], LOADER_CLASS_PREFETCH, 30, 0);
+  Loader_SubmitClass(&loader, &g_jobs[6], LOADER_CLASS_VISIBLE, 40, 0);
+  Loader_WaitIdle(&loader);
+
+  const int order[] = { 0, 6, 4, 3, 5, 2, 1 };
+  for (int i = 0; i < 7; ++i) {
+    assert_int_equal(LOADER_OK, Atomic_Load(&g_jobs[order[i]].status));
+    assert_int_equal(i + 1, Atomic_Load(&g_jobs[order[i]].nOrder));
+  }
+
+  /* Superseding stays within the navigation classes; thumbnails carry on */
+  Test_ResetJobs(2);
+  g_jobs[0].nDecodeMs = 100;
+  Loader_Submit(&loader, &g_jobs[0], 0);
+  Loader_SubmitClass(&loader, &g_jobs[1], LOADER_CLASS_THUMBNAIL, LOADER_NO_DEADLINE, 0);
+  Loader_Prefetch(&loader, &g_jobs[2]);
+  Loader_Submit(&loader, &g_jobs[3], 1);
+  Loader_SubmitClass(&loader, &g_jobs[4], LOADER_CLASS_THUMBNAIL, LOADER_NO_DEADLINE, 1);
+  Loader_WaitIdle(&loader);
+
+  assert_int_equal(LOADER_CANCELLED, Atomic_Load(&g_jobs[0].status));
+  assert_int_equal(LOADER_CANCELLED, Atomic_Load(&g_jobs[1].status));
+  assert_int_equal(LOADER_CANCELLED, Atomic_Load(&g_jobs[2].status));
+  assert_int_equal(LOADER_OK, Atomic_Load(&g_jobs[3].status));
+  assert_int_equal(LOADER_OK, Atomic_Load(&g_jobs[4].status));
+
+  /* Cancelling one class leaves the others be */
+  Test_ResetJobs(2);
+  g_jobs[0].nDecodeMs = 50;
+  Loader_Submit(&loader, &g_jobs[0], 0);
+  while (!Atomic_Load(&g_jobs[0].nDone)) {
+    Test_SleepMs(1);
+  }
+  Loader_Prefetch(&loader, &g_jobs[1]);
+  Loader_SubmitClass(&loader, &g_jobs[2], LOADER_CLASS_THUMBNAIL, LOADER_NO_DEADLINE, 0);
+  Loader_SubmitClass(&loader, &g_jobs[3], LOADER_CLASS_THUMBNAIL, LOADER_NO_DEADLINE, 0);
+  Loader_CancelClass(&loader, LOADER_CLASS_THUMBNAIL);
+  Loader_CancelClass(&loader, LOADER_CLASSES);
+  Loader_WaitIdle(&loader);
+
+  assert_int_equal(LOADER_OK, Atomic_Load(&g_jobs[0].status));
+  assert_int_equal(LOADER_OK, Atomic_Load(&g_jobs[1].status));
+  assert_int_equal(LOADER_CANCELLED, Atomic_Load(&g_jobs[2].status));
+  assert_int_equal(LOADER_CANCELLED, Atomic_Load(&g_jobs[3].status));
+
+  Loader_Shutdown(&loader);
+}
+
+/* A visible request takes the only worker from a thumbnail, which resumes after */
+static void loader_preempt_test(void** state)
+{
+  (void)state;
+
+  Test_ResetJobs(5);
+
+  LOADER loader;
+  assert_int_equal(LOADER_OK, Loader_Init(&loader, 1, &g_callbacks, NULL));
+
+  g_jobs[0].nDecodeMs = 60;
+  g_jobs[0].bResumable = 1;
+  Loader_SubmitClass(&loader, &g_jobs[0], LOADER_CLASS_THUMBNAIL, LOADER_NO_DEADLINE, 0);
+  while (!Atomic_Load(&g_jobs[0].nDone)) {
+    Test_SleepMs(1);
+  }
+
+  Loader_Submit(&loader, &g_jobs[1], 0);
+  Loader_WaitIdle(&loader);
+
+  assert_int_equal(LOADER_OK, Atomic_Load(&g_jobs[1].status));
+  assert_int_equal(1, Atomic_Load(&g_jobs[1].nOrder));
+  assert_int_equal(LOADER_OK, Atomic_Load(&g_jobs[0].status));
+  assert_int_equal(1, Atomic_Load(&g_jobs[0].nCompletions));
+  assert_int_equal(60, Atomic_Load(&g_jobs[0].nDone));
+  assert_int_equal(1, Loader_GetPreemptions(&loader));
+
+  /* One that does not yield runs to its end first; nothing was preempted */
+  Test_ResetJobs(5);
+  g_jobs[0].nDecodeMs = 30;
+  Loader_Prefetch(&loader, &g_jobs[0]);
+  while (!Atomic_Load(&g_jobs[0].nDone)) {
+    Test_SleepMs(1);
+  }
+  Loader_Submit(&loader, &g_jobs[1], 0);
+  Loader_WaitIdle(&loader);
+
+  assert_int_equal(1, Atomic_Load(&g_jobs[0].nOrder));
+  assert_int_equal(2, Atomic_Load(&g_jobs[1].nOrder));
+  assert_int_equal(1, Loader_GetPreemptions(&loader));
+
+  Loader_Shutdown(&loader);
+}
+
+static void loader_shutdown_cancels_test(void** state)
+{
+  (void)state;
+
+  Test_ResetJobs(50);
+
+  LOADER loader;
+  assert_int_equal(LOADER_OK, Loader_Init(&loader, 1, &g_callbacks, NULL));
+
+  for (int i = 0; i < 16; ++i) {
+    Loader_Submit(&loader, &g_jobs[i], 0);
+  }
+
+  /* Queued and running requests are all completed as cancelled */
+  Loader_Shutdown(&loader);
+
+  for (int i = 0; i < 16; ++i) {
+    assert_int_equal(1, Atomic_Load(&g_jobs[i].nCompletions));
+    assert_int_equal(LOADER_CANCELLED, Atomic_Load(&g_jobs[i].status));
+  }
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(loader_queue_test),
+    cmocka_unit_test(loader_supersede_stress_test),
+    cmocka_unit_test(loader_prefetch_test),
+    cmocka_unit_test(loader_class_order_test),
+    cmocka_unit_test(loader_preempt_test),
+    cmocka_unit_test(loader_shutdown_cancels_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
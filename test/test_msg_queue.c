@@ -0,0 +1,229 @@
+#include "../msgqueue.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#define ITEMS_PER_PRODUCER 20000
+#define PRODUCERS 4
+
+/* Values are 1 + the producer index in the top byte and a count below it */
+#define MAKE_VALUE(producer, n) ((void*)(uintptr_t)(((uintptr_t)(producer) + 1) << 24 | (uintptr_t)(n)))
+#define VALUE_PRODUCER(p) ((size_t)((uintptr_t)(p) >> 24) - 1)
+#define VALUE_COUNT(p) ((size_t)((uintptr_t)(p) & 0xFFFFFF))
+
+typedef struct _tagPRODUCER {
+  THREAD thread;
+  size_t nIndex;
+  LPSPSCQUEUE pSpsc;
+  LPMPSCQUEUE pMpsc;
+  LPQUEUEWAKE pWake;
+  volatile long* pPosts;      /* Stands in for PostMessage */
+} PRODUCER;
+
+static int ProduceThread(void* pArg)
+{
+  PRODUCER* pProducer = (PRODUCER*)pArg;
+
+  for (size_t n = 0; n < ITEMS_PER_PRODUCER; ++n) {
+    void* pValue = MAKE_VALUE(pProducer->nIndex, n);
+    while (pProducer->pSpsc ? !SpscQueue_Push(pProducer->pSpsc, pValue) : !MpscQueue_Push(pProducer->pMpsc, pValue)) {
+      Thread_Yield();
+    }
+
+    if (pProducer->pWake && QueueWake_Raise(pProducer->pWake)) {
+      Atomic_Increment(pProducer->pPosts);
+    }
+  }
+
+  return 0;
+}
+
+static void spsc_queue_test(void** state)
+{
+  (void)state;
+
+  SPSCQUEUE queue;
+  assert_int_equal(MSGQUEUE_OK, SpscQueue_Init(&queue, 5));
+  assert_int_equal(7, queue.mask);
+
+  /* Rounded up to 8, first in first out, NULL is a value like any other */
+  void* pValue = NULL;
+  assert_int_equal(0, SpscQueue_Pop(&queue, &pValue));
+  for (uintptr_t i = 0; i < 8; ++i) {
+    assert_int_equal(1, SpscQueue_Push(&queue, (void*)i));
+  }
+  assert_int_equal(0, SpscQueue_Push(&queue, (void*)99));
+  for (uintptr_t i = 0; i < 8; ++i) {
+    assert_int_equal(1, SpscQueue_Pop(&queue, &pValue));
+    assert_int_equal(i, (uintptr_t)pValue);
+  }
+  assert_int_equal(0, SpscQueue_Pop(&queue, &pValue));
+
+  /* Many laps around the ring */
+  for (uintptr_t i = 0; i < 1000; ++i) {
+    assert_int_equal(1, SpscQueue_Push(&queue, (void*)i));
+    assert_int_equal(1, SpscQueue_Push(&queue, (void*)(i + 1)));
+    assert_int_equal(1, SpscQueue_Pop(&queue, &pValue));
+    assert_int_equal(i, (uintptr_t)pValue);
+    assert_int_equal(1, SpscQueue_Pop(&queue, &pValue));
+    assert_int_equal(i + 1, (uintptr_t)pValue);
+  }
+
+  SpscQueue_Cleanup(&queue);
+}
+
+static void mpsc_queue_test(void** state)
+{
+  (void)state;
+
+  MPSCQUEUE queue;
+  assert_int_equal(MSGQUEUE_OK, MpscQueue_Init(&queue, 4));
+  assert_int_equal(3, queue.mask);
+
+  void* pValue = NULL;
+  assert_int_equal(0, MpscQueue_Pop(&queue, &pValue));
+  for (uintptr_t i = 0; i < 4; ++i) {
+    assert_int_equal(1, MpscQueue_Push(&queue, (void*)i));
+  }
+  assert_int_equal(0, MpscQueue_Push(&queue, (void*)99));
+
+  /* Room for one more once one is taken */
+  assert_int_equal(1, MpscQueue_Pop(&queue, &pValue));
+  assert_int_equal(0, (uintptr_t)pValue);
+  assert_int_equal(1, MpscQueue_Push(&queue, (void*)4));
+  for (uintptr_t i = 1; i < 5; ++i) {
+    assert_int_equal(1, MpscQueue_Pop(&queue, &pValue));
+    assert_int_equal(i, (uintptr_t)pValue);
+  }
+  assert_int_equal(0, MpscQueue_Pop(&queue, &pValue));
+
+  MpscQueue_Cleanup(&queue);
+
+  /* Never fewer than 2 */
+  assert_int_equal(MSGQUEUE_OK, MpscQueue_Init(&queue, 0));
+  assert_int_equal(1, MpscQueue_Push(&queue, NULL));
+  assert_int_equal(1, MpscQueue_Push(&queue, NULL));
+  assert_int_equal(0, MpscQueue_Push(&queue, NULL));
+  MpscQueue_Cleanup(&queue);
+}
+
+static void spsc_queue_threaded_test(void** state)
+{
+  (void)state;
+
+  /* Small, so the producer keeps running into a full ring */
+  SPSCQUEUE queue;
+  assert_int_equal(MSGQUEUE_OK, SpscQueue_Init(&queue, 16));
+
+  PRODUCER producer;
+  memset(&producer, 0, sizeof(PRODUCER));
+  producer.pSpsc = &queue;
+  assert_int_equal(THREAD_OK, Thread_Create(&producer.thread, ProduceThread, &producer));
+
+  size_t nNext = 0;
+  while (nNext < ITEMS_PER_PRODUCER) {
+    void* pValue;
+    if (!SpscQueue_Pop(&queue, &pValue)) {
+      Thread_Yield();
+      continue;
+    }
+    assert_int_equal(0, VALUE_PRODUCER(pValue));
+    assert_int_equal(nNext, VALUE_COUNT(pValue));
+    ++nNext;
+  }
+
+  Thread_Join(&producer.thread);
+  void* pValue;
+  assert_int_equal(0, SpscQueue_Pop(&queue, &pValue));
+  SpscQueue_Cleanup(&queue);
+}
+
+static void mpsc_queue_threaded_test(void** state)
+{
+  (void)state;
+
+  MPSCQUEUE queue;
+  assert_int_equal(MSGQUEUE_OK, MpscQueue_Init(&queue, 64));
+
+  QUEUEWAKE wake;
+  QueueWake_Init(&wake);
+  volatile long nPosts = 0;
+
+  PRODUCER producers[PRODUCERS];
+  memset(producers, 0, sizeof(producers));
+  for (size_t i = 0; i < PRODUCERS; ++i) {
+    producers[i].nIndex = i;
+    producers[i].pMpsc = &queue;
+    producers[i].pWake = &wake;
+    producers[i].pPosts = &nPosts;
+    assert_int_equal(THREAD_OK, Thread_Create(&producers[i].thread, ProduceThread, &producers[i]));
+  }
+
+  /*
+   * As the UI thread does: wait for a posted message, reset, drain. A
+   * wakeup lost between the drain and the reset would hang here.
+   */
+  size_t nNext[PRODUCERS] = { 0 };
+  size_t nReceived = 0;
+  long nHandled = 0;
+  while (nReceived < PRODUCERS * ITEMS_PER_PRODUCER) {
+    if (Atomic_Load(&nPosts) == nHandled) {
+      Thread_Yield();
+      continue;
+    }
+    ++nHandled;
+
+    QueueWake_Reset(&wake);
+    void* pValue;
+    while (MpscQueue_Pop(&queue, &pValue)) {
+      size_t nProducer = VALUE_PRODUCER(pValue);
+      assert_true(nProducer < PRODUCERS);
+      assert_int_equal(nNext[nProducer], VALUE_COUNT(pValue));
+      ++nNext[nProducer];
+      ++nReceived;
+    }
+  }
+
+  for (size_t i = 0; i < PRODUCERS; ++i) {
+    Thread_Join(&producers[i].thread);
+    assert_int_equal(ITEMS_PER_PRODUCER, nNext[i]);
+  }
+
+  /* Coalesced: never more messages than pushes */
+  assert_true(Atomic_Load(&nPosts) <= PRODUCERS * ITEMS_PER_PRODUCER);
+  MpscQueue_Cleanup(&queue);
+}
+
+static void queue_wake_test(void** state)
+{
+  (void)state;
+
+  QUEUEWAKE wake;
+  QueueWake_Init(&wake);
+
+  /* One message until the consumer comes round, then one again */
+  assert_int_equal(1, QueueWake_Raise(&wake));
+  assert_int_equal(0, QueueWake_Raise(&wake));
+  assert_int_equal(0, QueueWake_Raise(&wake));
+  QueueWake_Reset(&wake);
+  assert_int_equal(1, QueueWake_Raise(&wake));
+  QueueWake_Reset(&wake);
+  QueueWake_Reset(&wake);
+  assert_int_equal(1, QueueWake_Raise(&wake));
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(spsc_queue_test),
+    cmocka_unit_test(mpsc_queue_test),
+    cmocka_unit_test(spsc_queue_threaded_test),
+    cmocka_unit_test(mpsc_queue_threaded_test),
+    cmocka_unit_test(queue_wake_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
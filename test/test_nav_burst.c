@@ -0,0 +1,192 @@
+#include "../navburst.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#define SETTLE_MS 150
+#define DECODE_MS 80
+#define BURST_KEYS 200
+
+/* A recorded hold of the right arrow: the first repeat after the typematic
+ * delay, then repeats around 30 per second, jittered by the message loop */
+#define BURST_DELAY_MS 500
+#define BURST_RELEASE_MS 20
+static const unsigned int g_repeatJitter[] = { 33, 31, 34, 33, 36, 30, 33, 32, 35, 33, 29, 34 };
+
+typedef struct _tagSIMDECODER {
+  int bBusy;
+  size_t nPos;
+  uint64_t nStart;
+  uint64_t nStarted;
+  uint64_t nFull;             /* Decodes that ran to the end */
+  uint64_t nWastedMs;         /* Spent on decodes that were cancelled */
+  size_t nShown;
+} SIMDECODER;
+
+/* The loader, one worker: a new decode or a placeholder cancels the one in flight */
+static void SimDecoder_Advance(SIMDECODER* pDecoder, uint64_t nNow)
+{
+  if (pDecoder->bBusy && nNow >= pDecoder->nStart + DECODE_MS) {
+    pDecoder->bBusy = 0;
+    ++pDecoder->nFull;
+    pDecoder->nShown = pDecoder->nPos;
+  }
+}
+
+static void SimDecoder_Cancel(SIMDECODER* pDecoder, uint64_t nNow)
+{
+  SimDecoder_Advance(pDecoder, nNow);
+  if (pDecoder->bBusy) {
+    pDecoder->bBusy = 0;
+    pDecoder->nWastedMs += nNow - pDecoder->nStart;
+  }
+}
+
+static void SimDecoder_Start(SIMDECODER* pDecoder, size_t nPos, uint64_t nNow)
+{
+  SimDecoder_Cancel(pDecoder, nNow);
+  pDecoder->bBusy = 1;
+  pDecoder->nPos = nPos;
+  pDecoder->nStart = nNow;
+  ++pDecoder->nStarted;
+}
+
+static uint64_t Burst_KeyTime(size_t i)
+{
+  uint64_t nTime = 0;
+  for (size_t k = 1; k <= i; ++k) {
+    nTime += k == 1 ? BURST_DELAY_MS : g_repeatJitter[k % (sizeof(g_repeatJitter) / sizeof(g_repeatJitter[0]))];
+  }
+
+  return nTime;
+}
+
+/* Replays the burst as the frame does; bCoalesce 0 decodes every step, superseding */
+static void Burst_Replay(SIMDECODER* pDecoder, LPNAVBURST pBurst, int bCoalesce)
+{
+  uint64_t nTime = 0;
+  for (size_t i = 0; i < BURST_KEYS; ++i) {
+    nTime = Burst_KeyTime(i);
+
+    /* The settle timer fires before the next keypress arrives */
+    if (bCoalesce && pBurst->bDeferred && pBurst->nLastStep + pBurst->nSettleMs <= nTime) {
+      uint64_t nFired = pBurst->nLastStep + pBurst->nSettleMs;
+      if (NavBurst_OnTimer(pBurst, nFired)) {
+        SimDecoder_Start(pDecoder, i, nFired);
+      }
+    }
+
+    /* Positions count from 1, 0 is where the burst started */
+    if (!bCoalesce || NavBurst_OnStep(pBurst, nTime, i > 0)) {
+      SimDecoder_Start(pDecoder, i + 1, nTime);
+    }
+    else {
+      SimDecoder_Cancel(pDecoder, nTime);
+    }
+  }
+
+  nTime += BURST_RELEASE_MS;
+  if (bCoalesce && NavBurst_OnRelease(pBurst)) {
+    SimDecoder_Start(pDecoder, BURST_KEYS, nTime);
+  }
+  SimDecoder_Advance(pDecoder, nTime + DECODE_MS);
+}
+
+static void nav_burst_single_steps_test(void** state)
+{
+  (void)state;
+
+  NAVBURST burst;
+  NavBurst_Init(&burst, SETTLE_MS);
+
+  /* Steps apart from each other decode right away and leave nothing behind */
+  assert_int_equal(1, NavBurst_OnStep(&burst, 1000, 0));
+  assert_int_equal(0, NavBurst_GetDelay(&burst, 1000));
+  assert_int_equal(1, NavBurst_OnStep(&burst, 1000 + SETTLE_MS, 0));
+  assert_int_equal(0, NavBurst_OnRelease(&burst));
+  assert_int_equal(0, NavBurst_OnTimer(&burst, 5000));
+  assert_int_equal(2, burst.stats.decodes);
+  assert_int_equal(0, burst.stats.deferred);
+
+  /* A quick second click is deferred until the clicks stop */
+  assert_int_equal(1, NavBurst_OnStep(&burst, 2000, 0));
+  assert_int_equal(0, NavBurst_OnStep(&burst, 2100, 0));
+  assert_int_equal(SETTLE_MS - 40, NavBurst_GetDelay(&burst, 2140));
+  assert_int_equal(0, NavBurst_OnTimer(&burst, 2249));
+  assert_int_equal(1, NavBurst_OnTimer(&burst, 2250));
+  assert_int_equal(0, NavBurst_OnTimer(&burst, 2251));
+  assert_int_equal(0, NavBurst_GetDelay(&burst, 2251));
+
+  /* A repeat decodes nothing however late it comes, a reset drops it */
+  assert_int_equal(0, NavBurst_OnStep(&burst, 9000, 1));
+  NavBurst_Reset(&burst);
+  assert_int_equal(0, NavBurst_OnRelease(&burst));
+  assert_int_equal(1, NavBurst_OnStep(&burst, 9001, 0));
+  assert_int_equal(5, burst.stats.decodes);
+}
+
+static void nav_burst_replay_test(void** state)
+{
+  (void)state;
+
+  NAVBURST burst;
+  SIMDECODER every = { 0 };
+  NavBurst_Init(&burst, SETTLE_MS);
+  Burst_Replay(&every, &burst, 0);
+
+  SIMDECODER coalesced = { 0 };
+  NavBurst_Init(&burst, SETTLE_MS);
+  Burst_Replay(&coalesced, &burst, 1);
+
+  print_message("%d keypresses, %d ms per decode\n", BURST_KEYS, DECODE_MS);
+  print_message("  synchronous: %d full decodes\n", BURST_KEYS);
+  print_message("  superseding: %llu started, %llu full decodes, %llu ms spent on cancelled ones\n",
+      (unsigned long long)every.nStarted, (unsigned long long)every.nFull, (unsigned long long)every.nWastedMs);
+  print_message("  coalesced  : %llu started, %llu full decodes, %llu ms spent on cancelled ones, %llu placeholders\n",
+      (unsigned long long)coalesced.nStarted, (unsigned long long)coalesced.nFull,
+      (unsigned long long)coalesced.nWastedMs, (unsigned long long)burst.stats.deferred);
+
+  /* Both end on the image the key stopped at */
+  assert_int_equal(BURST_KEYS, every.nShown);
+  assert_int_equal(BURST_KEYS, coalesced.nShown);
+  assert_int_equal(BURST_KEYS, every.nStarted);
+
+  /* The first press and where it stopped, nothing in between */
+  assert_int_equal(2, coalesced.nStarted);
+  assert_int_equal(2, coalesced.nFull);
+  assert_int_equal(0, coalesced.nWastedMs);
+  assert_int_equal(BURST_KEYS, burst.stats.steps);
+  assert_int_equal(BURST_KEYS - 1, burst.stats.deferred);
+}
+
+/* With the key up lost, e.g. to a focus change, the timer still settles it */
+static void nav_burst_lost_release_test(void** state)
+{
+  (void)state;
+
+  NAVBURST burst;
+  NavBurst_Init(&burst, SETTLE_MS);
+
+  assert_int_equal(1, NavBurst_OnStep(&burst, 0, 0));
+  for (uint64_t t = 500; t < 1000; t += 33) {
+    assert_int_equal(0, NavBurst_OnStep(&burst, t, 1));
+    assert_int_equal(0, NavBurst_OnTimer(&burst, t + 20));
+  }
+  uint64_t nLast = burst.nLastStep;
+  assert_int_equal(SETTLE_MS, NavBurst_GetDelay(&burst, nLast));
+  assert_int_equal(1, NavBurst_OnTimer(&burst, nLast + SETTLE_MS));
+  assert_int_equal(0, NavBurst_OnRelease(&burst));
+  assert_int_equal(2, burst.stats.decodes);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(nav_burst_single_steps_test),
+    cmocka_unit_test(nav_burst_replay_test),
+    cmocka_unit_test(nav_burst_lost_release_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
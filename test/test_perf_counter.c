@@ -0,0 +1,57 @@
+#include "../perfcounter.h"
+
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+static void perf_counter_add_test(void** state)
+{
+  (void)state;
+
+  PERFCOUNTER counter;
+  PerfCounter_Reset(&counter);
+  assert_int_equal(0, PerfCounter_GetMean(&counter));
+
+  PerfCounter_Add(&counter, 300);
+  PerfCounter_Add(&counter, 100);
+  PerfCounter_Add(&counter, 200);
+
+  assert_int_equal(3, counter.count);
+  assert_int_equal(600, counter.totalNs);
+  assert_int_equal(300, counter.maxNs);
+  assert_int_equal(200, counter.lastNs);
+  assert_int_equal(200, PerfCounter_GetMean(&counter));
+
+  PerfCounter_Reset(&counter);
+  assert_int_equal(0, counter.count);
+  assert_int_equal(0, counter.maxNs);
+}
+
+static void perf_counter_clock_test(void** state)
+{
+  (void)state;
+
+  /* Never goes back, and elapsed time lands in the counter */
+  PERFCOUNTER counter;
+  PerfCounter_Reset(&counter);
+
+  uint64_t start = PerfCounter_Now();
+  volatile unsigned int sink = 0;
+  for (unsigned int i = 0; i < 100000; ++i) {
+    sink += i;
+  }
+  uint64_t ns = PerfCounter_AddSince(&counter, start);
+
+  assert_true(PerfCounter_Now() >= start + ns);
+  assert_int_equal(1, counter.count);
+  assert_int_equal(ns, counter.lastNs);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(perf_counter_add_test),
+    cmocka_unit_test(perf_counter_clock_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,279 @@
+#include "../pgm.h"
+
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+typedef struct _tagMEMREADER {
+  const unsigned char* pData;
+  size_t size;
+  size_t pos;
+  size_t chunk;  /* Maximum bytes returned per call, 0 for unlimited */
+} MEMREADER;
+
+static size_t MemReader_Read(void* pUserData, void* pBuffer, size_t size)
+{
+  MEMREADER* pReader = (MEMREADER*)pUserData;
+
+  size_t nAvail = pReader->size - pReader->pos;
+  if (size > nAvail) {
+    size = nAvail;
+  }
+
+  if (pReader->chunk && size > pReader->chunk) {
+    size = pReader->chunk;
+  }
+
+  memcpy(pBuffer, pReader->pData + pReader->pos, size);
+  pReader->pos += size;
+
+  return size;
+}
+
+static void pgm_p5_gray8_test(void** state)
+{
+  (void)state;
+
+  static const unsigned char data[] =
+    "P5\n# produced by a scanner\n3 2 # trailing comment\n255\n"
+    "\x00\x10\x20"
+    "\xFF\x80\x01";
+
+  MEMREADER reader = { data, sizeof(data) - 1, 0, 0 };
+  PGMDECODER decoder;
+  PGMDecoder_Init(&decoder, MemReader_Read, &reader);
+
+  assert_int_equal(PGM_OK, PGMDecoder_ReadHeader(&decoder));
+  assert_int_equal(PGM_ENCODING_BINARY, decoder.header.nEncoding);
+  assert_int_equal(3, decoder.header.width);
+  assert_int_equal(2, decoder.header.height);
+  assert_int_equal(255, decoder.header.maxval);
+  assert_int_equal(3, PGMDecoder_GetRowSize(&decoder, PGM_OUTPUT_GRAY8));
+
+  /* Rows are delivered incrementally */
+  unsigned char pixels[2][4] = { { 0 } };
+  size_t nRows = 0;
+  assert_int_equal(PGM_OK, PGMDecoder_ReadRows(&decoder, pixels[0], 4, 1, PGM_OUTPUT_GRAY8, &nRows));
+  assert_int_equal(1, nRows);
+  assert_memory_equal("\x00\x10\x20", pixels[0], 3);
+
+  assert_int_equal(PGM_OK, PGMDecoder_ReadRows(&decoder, pixels[1], 4, 8, PGM_OUTPUT_GRAY8, &nRows));
+  assert_int_equal(1, nRows);
+  assert_memory_equal("\xFF\x80\x01", pixels[1], 3);
+
+  /* Nothing left */
+  assert_int_equal(PGM_OK, PGMDecoder_ReadRows(&decoder, pixels[0], 4, 1, PGM_OUTPUT_GRAY8, &nRows));
+  assert_int_equal(0, nRows);
+
+  PGMDecoder_Cleanup(&decoder);
+}
+
+static void pgm_p5_gray16_test(void** state)
+{
+  (void)state;
+
+  static const unsigned char data[] =
+    "P5 2 1 65535\n"
+    "\x12\x34\xFF\xFF";
+
+  MEMREADER reader = { data, sizeof(data) - 1, 0, 1 };
+  PGMDECODER decoder;
+  PGMDecoder_Init(&decoder, MemReader_Read, &reader);
+
+  assert_int_equal(PGM_OK, PGMDecoder_ReadHeader(&decoder));
+  assert_int_equal(65535, decoder.header.maxval);
+
+  uint16_t wide[2] = { 0 };
+  size_t nRows = 0;
+  assert_int_equal(PGM_OK, PGMDecoder_ReadRows(&decoder, wide, sizeof(wide), 1, PGM_OUTPUT_GRAY16, &nRows));
+  assert_int_equal(1, nRows);
+  assert_int_equal(0x1234, wide[0]);
+  assert_int_equal(0xFFFF, wide[1]);
+
+  PGMDecoder_Cleanup(&decoder);
+
+  /* Same raster narrowed to 8 bits */
+  reader.pos = 0;
+  PGMDecoder_Init(&decoder, MemReader_Read, &reader);
+  assert_int_equal(PGM_OK, PGMDecoder_ReadHeader(&decoder));
+
+  unsigned char narrow[2] = { 0 };
+  assert_int_equal(PGM_OK, PGMDecoder_ReadRows(&decoder, narrow, sizeof(narrow), 1, PGM_OUTPUT_GRAY8, &nRows));
+  assert_int_equal(0x12, narrow[0]);
+  assert_int_equal(0xFF, narrow[1]);
+
+  PGMDecoder_Cleanup(&decoder);
+}
+
+static void pgm_p2_maxval_test(void** state)
+{
+  (void)state;
+
+  static const unsigned char data[] =
+    "P2\n"
+    "# ascii graymap\n"
+    "4 2\n"
+    "15\n"
+    "0 5 10 15\n"
+    "15 10\n5 0\n";
+
+  MEMREADER reader = { data, sizeof(data) - 1, 0, 3 };
+  PGMDECODER decoder;
+  PGMDecoder_Init(&decoder, MemReader_Read, &reader);
+
+  assert_int_equal(PGM_OK, PGMDecoder_ReadHeader(&decoder));
+  assert_int_equal(PGM_ENCODING_ASCII, decoder.header.nEncoding);
+
+  unsigned char pixels[8] = { 0 };
+  size_t nRows = 0;
+  assert_int_equal(PGM_OK, PGMDecoder_ReadRows(&decoder, pixels, 4, 2, PGM_OUTPUT_GRAY8, &nRows));
+  assert_int_equal(2, nRows);
+  assert_memory_equal("\x00\x55\xAA\xFF\xFF\xAA\x55\x00", pixels, 8);
+
+  PGMDecoder_Cleanup(&decoder);
+}
+
+static void pgm_large_row_test(void** state)
+{
+  (void)state;
+
+  /* Rows wider than the staging buffer bypass it */
+  const size_t width = 200000;
+  const char szHeader[] = "P5 200000 2 255\n";
+  size_t size = sizeof(szHeader) - 1 + width * 2;
+
+  unsigned char* data = test_malloc(size);
+  memcpy(data, szHeader, sizeof(szHeader) - 1);
+  for (size_t i = 0; i < width * 2; ++i) {
+    data[sizeof(szHeader) - 1 + i] = (unsigned char)(i * 7);
+  }
+
+  MEMREADER reader = { data, size, 0, 0 };
+  PGMDECODER decoder;
+  PGMDecoder_Init(&decoder, MemReader_Read, &reader);
+  assert_int_equal(PGM_OK, PGMDecoder_ReadHeader(&decoder));
+
+  unsigned char* pixels = test_malloc(width * 2);
+  size_t nRows = 0;
+  assert_int_equal(PGM_OK, PGMDecoder_ReadRows(&decoder, pixels, width, 2, PGM_OUTPUT_GRAY8, &nRows));
+  assert_int_equal(2, nRows);
+  assert_memory_equal(data + sizeof(szHeader) - 1, pixels, width * 2);
+
+  PGMDecoder_Cleanup(&decoder);
+  test_free(pixels);
+  test_free(data);
+}
+
+static void pgm_truncated_test(void** state)
+{
+  (void)state;
+
+  static const unsigned char data[] = "P5 2 3 255\n\x01\x02\x03\x04\x05";
+
+  MEMREADER reader = { data, sizeof(data) - 1, 0, 0 };
+  PGMDECODER decoder;
+  PGMDecoder_Init(&decoder, MemReader_Read, &reader);
+  assert_int_equal(PGM_OK, PGMDecoder_ReadHeader(&decoder));
+
+  unsigned char pixels[6] = { 0 };
+  size_t nRows = 0;
+  assert_int_equal(PGM_ERROR_TRUNCATED, PGMDecoder_ReadRows(&decoder, pixels, 2, 3, PGM_OUTPUT_GRAY8, &nRows));
+  assert_int_equal(2, nRows);
+  assert_memory_equal("\x01\x02\x03\x04", pixels, 4);
+
+  PGMDecoder_Cleanup(&decoder);
+}
+
+static void pgm_invalid_header_test(void** state)
+{
+  (void)state;
+
+  static const char* const headers[] = {
+    "P6 1 1 255\n",
+    "P5 0 1 255\n",
+    "P5 1 1 0\n",
+    "P5 1 1 65536\n",
+    "P5 1x 1 255\n",
+    "P5 99999999999999999999 1 255\n",
+    "P5 1 1",
+  };
+
+  for (size_t i = 0; i < sizeof(headers) / sizeof(headers[0]); ++i) {
+    MEMREADER reader = { (const unsigned char*)headers[i], strlen(headers[i]), 0, 0 };
+    PGMDECODER decoder;
+    PGMDecoder_Init(&decoder, MemReader_Read, &reader);
+
+    assert_true(PGMDecoder_ReadHeader(&decoder) < 0);
+
+    PGMDecoder_Cleanup(&decoder);
+  }
+}
+
+static void pgm_memory_test(void** state)
+{
+  (void)state;
+
+  static const unsigned char data[] = "P5 3 3 255\n\x01\x02\x03\x04\x05\x06\x07\x08";
+
+  PGMDECODER decoder;
+  PGMDecoder_InitMemory(&decoder, data, sizeof(data) - 1);
+  assert_int_equal(PGM_OK, PGMDecoder_ReadHeader(&decoder));
+
+  /* The rows point into the input; the truncated last row is left out */
+  size_t nRows = 0;
+  const unsigned char* pRows = PGMDecoder_GetRawRows(&decoder, &nRows);
+  assert_ptr_equal(data + 11, pRows);
+  assert_int_equal(2, nRows);
+
+  unsigned char pixels[6] = { 0 };
+  assert_int_equal(PGM_OK, PGMDecoder_ReadRows(&decoder, pixels, 3, 1, PGM_OUTPUT_GRAY8, &nRows));
+  assert_memory_equal("\x01\x02\x03", pixels, 3);
+
+  pRows = PGMDecoder_GetRawRows(&decoder, &nRows);
+  assert_ptr_equal(data + 14, pRows);
+  assert_int_equal(1, nRows);
+
+  assert_int_equal(PGM_ERROR_TRUNCATED, PGMDecoder_ReadRows(&decoder, pixels, 3, 2, PGM_OUTPUT_GRAY8, &nRows));
+  assert_int_equal(1, nRows);
+  assert_memory_equal("\x04\x05\x06", pixels, 3);
+
+  PGMDecoder_Cleanup(&decoder);
+
+  /* Samples that need rescaling cannot be used in place */
+  static const unsigned char scaled[] = "P5 2 1 15\n\x0F\x00";
+  PGMDecoder_InitMemory(&decoder, scaled, sizeof(scaled) - 1);
+  assert_int_equal(PGM_OK, PGMDecoder_ReadHeader(&decoder));
+  assert_null(PGMDecoder_GetRawRows(&decoder, &nRows));
+  assert_int_equal(0, nRows);
+  assert_int_equal(PGM_OK, PGMDecoder_ReadRows(&decoder, pixels, 2, 1, PGM_OUTPUT_GRAY8, &nRows));
+  assert_memory_equal("\xFF\x00", pixels, 2);
+  PGMDecoder_Cleanup(&decoder);
+
+  /* Nor can ASCII ones */
+  static const unsigned char ascii[] = "P2 2 1 255\n7 9\n";
+  PGMDecoder_InitMemory(&decoder, ascii, sizeof(ascii) - 1);
+  assert_int_equal(PGM_OK, PGMDecoder_ReadHeader(&decoder));
+  assert_null(PGMDecoder_GetRawRows(&decoder, &nRows));
+  assert_int_equal(PGM_OK, PGMDecoder_ReadRows(&decoder, pixels, 2, 1, PGM_OUTPUT_GRAY8, &nRows));
+  assert_memory_equal("\x07\x09", pixels, 2);
+  PGMDecoder_Cleanup(&decoder);
+
+  /* An empty mapping */
+  PGMDecoder_InitMemory(&decoder, NULL, 0);
+  assert_int_equal(PGM_ERROR_TRUNCATED, PGMDecoder_ReadHeader(&decoder));
+  PGMDecoder_Cleanup(&decoder);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(pgm_p5_gray8_test),
+    cmocka_unit_test(pgm_p5_gray16_test),
+    cmocka_unit_test(pgm_p2_maxval_test),
+    cmocka_unit_test(pgm_large_row_test),
+    cmocka_unit_test(pgm_truncated_test),
+    cmocka_unit_test(pgm_invalid_header_test),
+    cmocka_unit_test(pgm_memory_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,150 @@
+#include "../pixbuf.h"
+#include "../pixconv.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+/* Stands in for a DIB section: one aligned block and a handle to it */
+typedef struct _tagTESTSURFACE {
+  unsigned char block[4096];
+  size_t nAllocs;
+  size_t nFrees;
+  size_t lastSize;
+  void* pLastHandle;
+} TESTSURFACE, *LPTESTSURFACE;
+
+static void* TestSurface_Alloc(const PIXBUF* pPixBuf, void** ppHandle, void* pUserData)
+{
+  LPTESTSURFACE pSurface = (LPTESTSURFACE)pUserData;
+
+  pSurface->lastSize = pPixBuf->stride * pPixBuf->height;
+  if (pSurface->lastSize > sizeof(pSurface->block)) {
+    return NULL;
+  }
+
+  pSurface->nAllocs++;
+  *ppHandle = pSurface;
+  return pSurface->block;
+}
+
+static void TestSurface_Free(void* pData, void* pHandle, void* pUserData)
+{
+  LPTESTSURFACE pSurface = (LPTESTSURFACE)pUserData;
+
+  assert_ptr_equal(pSurface->block, pData);
+  pSurface->pLastHandle = pHandle;
+  pSurface->nFrees++;
+}
+
+static void pix_buf_heap_test(void** state)
+{
+  (void)state;
+
+  LPPIXBUF pPixBuf = NULL;
+  assert_int_equal(PIXBUF_OK, PixBuf_Create(13, 7, PIXFMT_PBGRA32, NULL, &pPixBuf));
+  assert_non_null(pPixBuf);
+  assert_int_equal(0, (uintptr_t)pPixBuf->pData % PIXBUF_ALIGNMENT);
+  assert_int_equal(13 * 4, pPixBuf->stride);
+  assert_null(pPixBuf->pHandle);
+
+  /* Every byte is writable */
+  memset(pPixBuf->pData, 0xAB, pPixBuf->stride * pPixBuf->height);
+  assert_ptr_equal(pPixBuf->pData + 6 * 13 * 4, PixBuf_GetRow(pPixBuf, 6));
+
+  /* Gray rows are padded to 4 bytes */
+  LPPIXBUF pGray = NULL;
+  assert_int_equal(PIXBUF_OK, PixBuf_Create(5, 3, PIXFMT_GRAY8, NULL, &pGray));
+  assert_int_equal(8, pGray->stride);
+
+  PixBuf_Release(pGray);
+  PixBuf_Release(pPixBuf);
+}
+
+static void pix_buf_allocator_test(void** state)
+{
+  (void)state;
+
+  TESTSURFACE surface = { { 0 }, 0, 0, 0, NULL };
+  PIXBUFALLOCATOR allocator = { TestSurface_Alloc, TestSurface_Free, &surface };
+
+  LPPIXBUF pPixBuf = NULL;
+  assert_int_equal(PIXBUF_OK, PixBuf_Create(16, 16, PIXFMT_PBGRA32, &allocator, &pPixBuf));
+  assert_int_equal(1, surface.nAllocs);
+  assert_int_equal(16 * 16 * 4, surface.lastSize);
+  assert_ptr_equal(surface.block, pPixBuf->pData);
+  assert_ptr_equal(&surface, pPixBuf->pHandle);
+
+  /* Freed with the last reference only, handle and all */
+  assert_ptr_equal(pPixBuf, PixBuf_AddRef(pPixBuf));
+  PixBuf_Release(pPixBuf);
+  assert_int_equal(0, surface.nFrees);
+  PixBuf_Release(pPixBuf);
+  assert_int_equal(1, surface.nFrees);
+  assert_ptr_equal(&surface, surface.pLastHandle);
+
+  /* The allocator running out fails the buffer */
+  assert_int_equal(PIXBUF_ERROR_MEMORY, PixBuf_Create(64, 64, PIXFMT_PBGRA32, &allocator, &pPixBuf));
+  assert_null(pPixBuf);
+  assert_int_equal(1, surface.nAllocs);
+}
+
+static void pix_buf_wrap_test(void** state)
+{
+  (void)state;
+
+  TESTSURFACE surface = { { 0 }, 0, 0, 0, NULL };
+  PIXBUFALLOCATOR allocator = { NULL, TestSurface_Free, &surface };
+
+  /* Unpadded gray rows, as they lie in a file */
+  LPPIXBUF pPixBuf = NULL;
+  assert_int_equal(PIXBUF_OK, PixBuf_Wrap(surface.block, 5, 3, 5, PIXFMT_GRAY8, &allocator, &pPixBuf));
+  assert_ptr_equal(surface.block, pPixBuf->pData);
+  assert_int_equal(5, pPixBuf->stride);
+  assert_null(pPixBuf->pHandle);
+  assert_ptr_equal(surface.block + 10, PixBuf_GetRow(pPixBuf, 2));
+
+  PixBuf_AddRef(pPixBuf);
+  PixBuf_Release(pPixBuf);
+  assert_int_equal(0, surface.nFrees);
+  PixBuf_Release(pPixBuf);
+  assert_int_equal(1, surface.nFrees);
+
+  /* Without an allocator the memory stays the caller's */
+  assert_int_equal(PIXBUF_OK, PixBuf_Wrap(surface.block, 4, 4, 16, PIXFMT_PBGRA32, NULL, &pPixBuf));
+  PixBuf_Release(pPixBuf);
+  assert_int_equal(1, surface.nFrees);
+
+  assert_int_equal(PIXBUF_ERROR_INVALID, PixBuf_Wrap(surface.block, 4, 4, 15, PIXFMT_PBGRA32, NULL, &pPixBuf));
+  assert_int_equal(PIXBUF_ERROR_INVALID, PixBuf_Wrap(NULL, 4, 4, 16, PIXFMT_PBGRA32, NULL, &pPixBuf));
+  assert_int_equal(PIXBUF_ERROR_INVALID, PixBuf_Wrap(surface.block, 0, 4, 16, PIXFMT_PBGRA32, NULL, &pPixBuf));
+  assert_null(pPixBuf);
+}
+
+static void pix_buf_invalid_test(void** state)
+{
+  (void)state;
+
+  LPPIXBUF pPixBuf = NULL;
+  assert_int_equal(PIXBUF_ERROR_INVALID, PixBuf_Create(0, 10, PIXFMT_PBGRA32, NULL, &pPixBuf));
+  assert_int_equal(PIXBUF_ERROR_INVALID, PixBuf_Create(10, 10, PIXFMT_UNKNOWN, NULL, &pPixBuf));
+  assert_int_equal(PIXBUF_ERROR_INVALID, PixBuf_Create(SIZE_MAX / 2, 1, PIXFMT_PBGRA32, NULL, &pPixBuf));
+  assert_int_equal(PIXBUF_ERROR_INVALID, PixBuf_Create(1 << 20, SIZE_MAX / 2, PIXFMT_PBGRA32, NULL, &pPixBuf));
+  assert_null(pPixBuf);
+
+  PixBuf_Release(NULL);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(pix_buf_heap_test),
+    cmocka_unit_test(pix_buf_allocator_test),
+    cmocka_unit_test(pix_buf_wrap_test),
+    cmocka_unit_test(pix_buf_invalid_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
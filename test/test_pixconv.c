@@ -0,0 +1,158 @@
+#include "../pixconv.h"
+#include "testutil.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+static const int g_srcFormats[] = {
+  PIXFMT_GRAY8,
+  PIXFMT_GRAY16,
+  PIXFMT_RGB24,
+  PIXFMT_BGR24,
+  PIXFMT_RGBA32,
+  PIXFMT_BGRA32,
+  PIXFMT_PBGRA32,
+};
+
+static void pixconv_premultiply_test(void** state)
+{
+  (void)state;
+
+  const uint8_t bgra[] = {
+    10, 20, 30, 0xFF,   /* Opaque stays untouched */
+    200, 100, 50, 0x80,
+    255, 255, 255, 0,   /* Transparent collapses to zero */
+    77, 0, 255, 1,
+  };
+  uint8_t pbgra[sizeof(bgra)];
+
+  assert_int_equal(PIXCONV_OK, PixConv_Convert(bgra, sizeof(bgra), PIXFMT_BGRA32,
+      pbgra, sizeof(pbgra), PIXFMT_PBGRA32, 4, 1));
+
+  for (size_t i = 0; i < sizeof(bgra); i += 4) {
+    unsigned int a = bgra[i + 3];
+    for (size_t c = 0; c < 3; ++c) {
+      unsigned int expected = (bgra[i + c] * a + 127) / 255;
+      assert_int_equal(expected, pbgra[i + c]);
+    }
+    assert_int_equal(a, pbgra[i + 3]);
+  }
+}
+
+static void pixconv_round_trip_test(void** state)
+{
+  (void)state;
+
+  const uint8_t gray[] = { 0, 1, 127, 128, 254, 255 };
+  uint8_t pbgra[sizeof(gray) * 4];
+  uint8_t back[sizeof(gray)];
+
+  assert_int_equal(PIXCONV_OK, PixConv_Convert(gray, sizeof(gray), PIXFMT_GRAY8,
+      pbgra, sizeof(pbgra), PIXFMT_PBGRA32, sizeof(gray), 1));
+  assert_int_equal(PIXCONV_OK, PixConv_Convert(pbgra, sizeof(pbgra), PIXFMT_PBGRA32,
+      back, sizeof(back), PIXFMT_GRAY8, sizeof(gray), 1));
+  assert_memory_equal(gray, back, sizeof(gray));
+
+  const uint8_t rgb[] = { 1, 2, 3, 250, 128, 0 };
+  uint8_t rgbBack[sizeof(rgb)];
+  assert_int_equal(PIXCONV_OK, PixConv_Convert(rgb, sizeof(rgb), PIXFMT_RGB24,
+      pbgra, sizeof(pbgra), PIXFMT_PBGRA32, 2, 1));
+  assert_int_equal(3, pbgra[0]);
+  assert_int_equal(1, pbgra[2]);
+  assert_int_equal(PIXCONV_OK, PixConv_Convert(pbgra, sizeof(pbgra), PIXFMT_PBGRA32,
+      rgbBack, sizeof(rgbBack), PIXFMT_RGB24, 2, 1));
+  assert_memory_equal(rgb, rgbBack, sizeof(rgb));
+
+  /* Unpremultiplying recovers opaque and half-transparent colors */
+  const uint8_t rgba[] = { 10, 20, 30, 255, 200, 100, 50, 128 };
+  uint8_t rgbaBack[sizeof(rgba)];
+  assert_int_equal(PIXCONV_OK, PixConv_Convert(rgba, sizeof(rgba), PIXFMT_RGBA32,
+      pbgra, sizeof(pbgra), PIXFMT_PBGRA32, 2, 1));
+  assert_int_equal(PIXCONV_OK, PixConv_Convert(pbgra, sizeof(pbgra), PIXFMT_PBGRA32,
+      rgbaBack, sizeof(rgbaBack), PIXFMT_RGBA32, 2, 1));
+  for (size_t i = 0; i < sizeof(rgba); ++i) {
+    assert_in_range(rgbaBack[i], rgba[i] > 0 ? rgba[i] - 1 : 0, rgba[i] + 1);
+  }
+}
+
+static void pixconv_unsupported_test(void** state)
+{
+  (void)state;
+
+  uint8_t src[4] = { 0 };
+  uint8_t dst[4] = { 0 };
+
+  assert_null(PixConv_GetRowFunc(PIXFMT_RGB24, PIXFMT_GRAY8));
+  assert_int_equal(PIXCONV_ERROR_UNSUPPORTED, PixConv_Convert(src, 4, PIXFMT_RGB24,
+      dst, 4, PIXFMT_GRAY8, 1, 1));
+}
+
+/* Every SIMD kernel must match the scalar one bit for bit, tails included */
+static void pixconv_isa_equivalence_test(void** state)
+{
+  (void)state;
+
+  const size_t maxPixels = 67;
+  uint8_t* pSrc = test_malloc(maxPixels * 4);
+  uint8_t* pExpected = test_malloc(maxPixels * 4);
+  uint8_t* pActual = test_malloc(maxPixels * 4);
+
+  Test_FillPattern(pSrc, maxPixels * 4, 42);
+
+  for (size_t f = 0; f < sizeof(g_srcFormats) / sizeof(g_srcFormats[0]); ++f) {
+    PIXCONVROWFUNC pfnScalar = PixConv_GetRowFuncIsa(g_srcFormats[f], PIXFMT_PBGRA32, PIXCONV_ISA_SCALAR);
+    assert_non_null(pfnScalar);
+
+    for (int nIsa = PIXCONV_ISA_SSE2; nIsa <= PixConv_GetCpuIsa(); ++nIsa) {
+      PIXCONVROWFUNC pfnSimd = PixConv_GetRowFuncIsa(g_srcFormats[f], PIXFMT_PBGRA32, nIsa);
+      assert_non_null(pfnSimd);
+
+      for (size_t n = 0; n <= maxPixels; ++n) {
+        memset(pExpected, 0xCD, maxPixels * 4);
+        memset(pActual, 0xCD, maxPixels * 4);
+
+        pfnScalar(pSrc, pExpected, n);
+        pfnSimd(pSrc, pActual, n);
+
+        assert_memory_equal(pExpected, pActual, maxPixels * 4);
+      }
+    }
+  }
+
+  test_free(pSrc);
+  test_free(pExpected);
+  test_free(pActual);
+}
+
+static void pixconv_stride_test(void** state)
+{
+  (void)state;
+
+  /* Padding between rows must be left alone */
+  const uint8_t gray[2][4] = { { 1, 2, 3, 0xAA }, { 4, 5, 6, 0xAA } };
+  uint8_t pbgra[2][16];
+  memset(pbgra, 0xEE, sizeof(pbgra));
+
+  assert_int_equal(PIXCONV_OK, PixConv_Convert(gray, 4, PIXFMT_GRAY8,
+      pbgra, 16, PIXFMT_PBGRA32, 3, 2));
+
+  assert_int_equal(4, pbgra[1][0]);
+  assert_int_equal(0xFF, pbgra[1][3]);
+  assert_int_equal(0xEE, pbgra[0][12]);
+  assert_int_equal(0xEE, pbgra[1][12]);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(pixconv_premultiply_test),
+    cmocka_unit_test(pixconv_round_trip_test),
+    cmocka_unit_test(pixconv_unsupported_test),
+    cmocka_unit_test(pixconv_isa_equivalence_test),
+    cmocka_unit_test(pixconv_stride_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,133 @@
+#include "../prefetch.h"
+
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+static void prefetch_open_test(void** state)
+{
+  (void)state;
+
+  PREFETCH prefetch;
+  Prefetch_Init(&prefetch, 2);
+
+  /* Nothing known yet: both ways, nearest first, forward leading */
+  size_t positions[8];
+  assert_int_equal(4, Prefetch_Plan(&prefetch, 5, 10, positions, 8));
+  assert_int_equal(6, positions[0]);
+  assert_int_equal(4, positions[1]);
+  assert_int_equal(7, positions[2]);
+  assert_int_equal(3, positions[3]);
+
+  /* Truncated to the room given */
+  assert_int_equal(3, Prefetch_Plan(&prefetch, 5, 10, positions, 3));
+  assert_int_equal(7, positions[2]);
+}
+
+static void prefetch_direction_test(void** state)
+{
+  (void)state;
+
+  PREFETCH prefetch;
+  Prefetch_Init(&prefetch, 3);
+
+  /* One step back leads with backward but keeps both sides */
+  size_t positions[8];
+  Prefetch_OnStep(&prefetch, 0);
+  assert_int_equal(6, Prefetch_Plan(&prefetch, 5, 10, positions, 8));
+  assert_int_equal(4, positions[0]);
+  assert_int_equal(6, positions[1]);
+
+  /* Settled backward: three behind, then one ahead */
+  Prefetch_OnStep(&prefetch, 0);
+  assert_int_equal(4, Prefetch_Plan(&prefetch, 5, 10, positions, 8));
+  assert_int_equal(4, positions[0]);
+  assert_int_equal(3, positions[1]);
+  assert_int_equal(2, positions[2]);
+  assert_int_equal(6, positions[3]);
+
+  /* Reversing starts over with both sides */
+  Prefetch_OnStep(&prefetch, 1);
+  assert_int_equal(6, Prefetch_Plan(&prefetch, 5, 10, positions, 8));
+  assert_int_equal(6, positions[0]);
+
+  Prefetch_OnOpen(&prefetch);
+  assert_int_equal(6, Prefetch_Plan(&prefetch, 5, 10, positions, 8));
+  assert_int_equal(6, positions[0]);
+  assert_int_equal(4, positions[1]);
+}
+
+static void prefetch_wrap_test(void** state)
+{
+  (void)state;
+
+  PREFETCH prefetch;
+  Prefetch_Init(&prefetch, 2);
+
+  /* Wraps around the ends like navigation */
+  size_t positions[8];
+  Prefetch_OnStep(&prefetch, 1);
+  Prefetch_OnStep(&prefetch, 1);
+  assert_int_equal(3, Prefetch_Plan(&prefetch, 9, 10, positions, 8));
+  assert_int_equal(0, positions[0]);
+  assert_int_equal(1, positions[1]);
+  assert_int_equal(8, positions[2]);
+
+  /* Small folders plan every other file once, never the current one */
+  Prefetch_OnOpen(&prefetch);
+  assert_int_equal(2, Prefetch_Plan(&prefetch, 0, 3, positions, 8));
+  assert_int_equal(1, positions[0]);
+  assert_int_equal(2, positions[1]);
+
+  assert_int_equal(0, Prefetch_Plan(&prefetch, 0, 1, positions, 8));
+
+  Prefetch_Init(&prefetch, 0);
+  assert_int_equal(0, Prefetch_Plan(&prefetch, 5, 10, positions, 8));
+}
+
+static void prefetch_pending_test(void** state)
+{
+  (void)state;
+
+  PREFETCH prefetch;
+  Prefetch_Init(&prefetch, 2);
+  Prefetch_OnStep(&prefetch, 1);
+  Prefetch_OnStep(&prefetch, 1);
+
+  size_t positions[8];
+  size_t nPlanned = Prefetch_Plan(&prefetch, 5, 10, positions, 8);
+  for (size_t i = 0; i < nPlanned; ++i) {
+    assert_true(Prefetch_AddPending(&prefetch, positions[i], 100 + i));
+  }
+  assert_true(Prefetch_IsPending(&prefetch, 7));
+  assert_false(Prefetch_IsPending(&prefetch, 8));
+  assert_true(Prefetch_OnDone(&prefetch, 100));
+  assert_false(Prefetch_OnDone(&prefetch, 100));
+  assert_false(Prefetch_IsPending(&prefetch, 6));
+
+  /* One step further still wants 7; 4 fell out of the plan */
+  Prefetch_OnStep(&prefetch, 1);
+  nPlanned = Prefetch_Plan(&prefetch, 6, 10, positions, 8);
+  assert_true(Prefetch_IsPlanStale(&prefetch, positions, nPlanned));
+  assert_true(Prefetch_OnDone(&prefetch, 102));
+  assert_false(Prefetch_IsPlanStale(&prefetch, positions, nPlanned));
+
+  Prefetch_ClearPending(&prefetch);
+  assert_false(Prefetch_IsPending(&prefetch, 7));
+
+  for (size_t i = 0; i < PREFETCH_MAX_PENDING; ++i) {
+    assert_true(Prefetch_AddPending(&prefetch, i, i + 1));
+  }
+  assert_false(Prefetch_AddPending(&prefetch, 99, 99));
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(prefetch_open_test),
+    cmocka_unit_test(prefetch_direction_test),
+    cmocka_unit_test(prefetch_wrap_test),
+    cmocka_unit_test(prefetch_pending_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,203 @@
+#include "../pixconv.h"
+#include "../pyramid.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+static LPPIXBUF CreateNoise(size_t width, size_t height, int nFormat, unsigned int seed)
+{
+  LPPIXBUF pPixBuf = NULL;
+  assert_int_equal(PIXBUF_OK, PixBuf_Create(width, height, nFormat, NULL, &pPixBuf));
+
+  for (size_t i = 0; i < pPixBuf->stride * height; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    pPixBuf->pData[i] = (uint8_t)(seed >> 16);
+  }
+
+  return pPixBuf;
+}
+
+/* The 2x2 average of a level, clamped to the last row and column, in any format */
+static void CheckLevel(const PIXBUF* pSrc, const PIXBUF* pDst)
+{
+  assert_int_equal((pSrc->width + 1) / 2, pDst->width);
+  assert_int_equal((pSrc->height + 1) / 2, pDst->height);
+  assert_int_equal(pSrc->nFormat, pDst->nFormat);
+
+  int bWide = pSrc->nFormat == PIXFMT_GRAY16;
+  size_t nChannels = bWide ? 1 : (size_t)PixConv_GetBytesPerPixel(pSrc->nFormat);
+
+  for (size_t y = 0; y < pDst->height; ++y) {
+    const uint8_t* r0 = PixBuf_GetRow(pSrc, y * 2);
+    const uint8_t* r1 = PixBuf_GetRow(pSrc, y * 2 + 1 < pSrc->height ? y * 2 + 1 : y * 2);
+    const uint8_t* d = PixBuf_GetRow(pDst, y);
+
+    for (size_t x = 0; x < pDst->width; ++x) {
+      size_t x0 = x * 2;
+      size_t x1 = x * 2 + 1 < pSrc->width ? x * 2 + 1 : x * 2;
+      for (size_t c = 0; c < nChannels; ++c) {
+        if (bWide) {
+          const uint16_t* s0 = (const uint16_t*)r0;
+          const uint16_t* s1 = (const uint16_t*)r1;
+          uint32_t sum = (uint32_t)s0[x0] + s0[x1] + s1[x0] + s1[x1];
+          assert_int_equal((sum + 2) / 4, ((const uint16_t*)d)[x]);
+        }
+        else {
+          unsigned int sum = r0[x0 * nChannels + c] + r0[x1 * nChannels + c] +
+              r1[x0 * nChannels + c] + r1[x1 * nChannels + c];
+          assert_int_equal((sum + 2) / 4, d[x * nChannels + c]);
+        }
+      }
+    }
+  }
+}
+
+static void pyramid_levels_test(void** state)
+{
+  (void)state;
+
+  /* 1000 x 301 -> 500 x 151 -> 250 x 76 -> 125 x 38 -> 63 x 19, stopping at 64 */
+  LPPIXBUF pSource = CreateNoise(1000, 301, PIXFMT_PBGRA32, 1);
+
+  PYRAMID pyramid;
+  assert_int_equal(PYRAMID_OK, Pyramid_Build(&pyramid, pSource, 64, NULL));
+  assert_int_equal(5, pyramid.nLevels);
+  assert_ptr_equal(pSource, pyramid.pLevels[0]);
+  assert_int_equal(63, pyramid.pLevels[4]->width);
+  assert_int_equal(19, pyramid.pLevels[4]->height);
+
+  size_t cbSize = 0;
+  for (size_t i = 1; i < pyramid.nLevels; ++i) {
+    CheckLevel(pyramid.pLevels[i - 1], pyramid.pLevels[i]);
+    cbSize += pyramid.pLevels[i]->stride * pyramid.pLevels[i]->height;
+  }
+  assert_int_equal(cbSize, pyramid.cbSize);
+
+  /* The coarsest level not coarser than the screen */
+  assert_int_equal(0, Pyramid_SelectLevel(&pyramid, 2.0));
+  assert_int_equal(0, Pyramid_SelectLevel(&pyramid, 0.51));
+  assert_int_equal(1, Pyramid_SelectLevel(&pyramid, 0.5));
+  assert_int_equal(3, Pyramid_SelectLevel(&pyramid, 0.1));
+  assert_int_equal(4, Pyramid_SelectLevel(&pyramid, 0.001));
+  assert_int_equal(4, Pyramid_SelectLevel(&pyramid, 0.0));
+
+  /* The levels keep the source alive */
+  PixBuf_Release(pSource);
+  assert_int_equal(1000, pyramid.pLevels[0]->width);
+  Pyramid_Cleanup(&pyramid);
+  assert_int_equal(0, pyramid.nLevels);
+
+  /* Already small enough, down to a single pixel, or not a format levels are kept in */
+  pSource = CreateNoise(3, 1, PIXFMT_GRAY8, 2);
+  assert_int_equal(PYRAMID_OK, Pyramid_Build(&pyramid, pSource, 4, NULL));
+  assert_int_equal(1, pyramid.nLevels);
+  assert_int_equal(0, pyramid.cbSize);
+  assert_int_equal(0, Pyramid_SelectLevel(&pyramid, 0.1));
+  Pyramid_Cleanup(&pyramid);
+
+  assert_int_equal(PYRAMID_OK, Pyramid_Build(&pyramid, pSource, 0, NULL));
+  assert_int_equal(3, pyramid.nLevels);
+  assert_int_equal(1, pyramid.pLevels[2]->width);
+  CheckLevel(pyramid.pLevels[0], pyramid.pLevels[1]);
+  CheckLevel(pyramid.pLevels[1], pyramid.pLevels[2]);
+  Pyramid_Cleanup(&pyramid);
+  PixBuf_Release(pSource);
+
+  pSource = CreateNoise(16, 16, PIXFMT_BGR24, 3);
+  assert_int_equal(PYRAMID_ERROR_UNSUPPORTED, Pyramid_Build(&pyramid, pSource, 1, NULL));
+  assert_int_equal(0, pyramid.nLevels);
+  PixBuf_Release(pSource);
+}
+
+/* Every kernel against the definition, at widths around the SIMD block sizes */
+static void pyramid_isa_test(void** state)
+{
+  (void)state;
+
+  static const int formats[] = { PIXFMT_PBGRA32, PIXFMT_GRAY8, PIXFMT_GRAY16 };
+  static const size_t widths[] = { 1, 2, 15, 16, 17, 31, 33, 63, 64, 65, 127, 130 };
+
+  int nCpuIsa = PixConv_GetCpuIsa();
+  for (int nIsa = PIXCONV_ISA_SCALAR; nIsa <= nCpuIsa; ++nIsa) {
+    PixConv_SetIsa(nIsa);
+
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
+      for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); ++w) {
+        LPPIXBUF pSource = CreateNoise(widths[w], 5, formats[f], (unsigned int)(w + 1));
+
+        PYRAMID pyramid;
+        assert_int_equal(PYRAMID_OK, Pyramid_Build(&pyramid, pSource, 1, NULL));
+        for (size_t i = 1; i < pyramid.nLevels; ++i) {
+          CheckLevel(pyramid.pLevels[i - 1], pyramid.pLevels[i]);
+        }
+
+        Pyramid_Cleanup(&pyramid);
+        PixBuf_Release(pSource);
+      }
+    }
+  }
+
+  PixConv_SetIsa(nCpuIsa);
+}
+
+/* Splitting the rows over a pool changes nothing in the result */
+static void pyramid_threads_test(void** state)
+{
+  (void)state;
+
+  TASKPOOL pool;
+  assert_int_equal(TASKPOOL_OK, TaskPool_Init(&pool, 6));
+
+  LPPIXBUF pSource = CreateNoise(517, 1029, PIXFMT_GRAY8, 4);
+
+  PYRAMID single;
+  PYRAMID multi;
+  assert_int_equal(PYRAMID_OK, Pyramid_Build(&single, pSource, 1, NULL));
+  assert_int_equal(PYRAMID_OK, Pyramid_Build(&multi, pSource, 1, &pool));
+  assert_int_equal(single.nLevels, multi.nLevels);
+
+  /* Rows only, the padding up to the stride is never written */
+  for (size_t i = 1; i < single.nLevels; ++i) {
+    for (size_t y = 0; y < single.pLevels[i]->height; ++y) {
+      assert_memory_equal(PixBuf_GetRow(single.pLevels[i], y), PixBuf_GetRow(multi.pLevels[i], y),
+          single.pLevels[i]->width);
+    }
+  }
+
+  /* A flat image stays flat all the way down, partial blocks included */
+  LPPIXBUF pFlat = NULL;
+  assert_int_equal(PIXBUF_OK, PixBuf_Create(333, 77, PIXFMT_PBGRA32, NULL, &pFlat));
+  for (size_t y = 0; y < pFlat->height; ++y) {
+    for (size_t x = 0; x < pFlat->width; ++x) {
+      memcpy(PixBuf_GetRow(pFlat, y) + x * 4, "\x10\x20\x30\x80", 4);
+    }
+  }
+
+  PYRAMID flat;
+  assert_int_equal(PYRAMID_OK, Pyramid_Build(&flat, pFlat, 1, &pool));
+  const PIXBUF* pLast = flat.pLevels[flat.nLevels - 1];
+  assert_int_equal(1, pLast->width);
+  assert_int_equal(1, pLast->height);
+  assert_memory_equal("\x10\x20\x30\x80", pLast->pData, 4);
+
+  Pyramid_Cleanup(&flat);
+  Pyramid_Cleanup(&multi);
+  Pyramid_Cleanup(&single);
+  TaskPool_Cleanup(&pool);
+  PixBuf_Release(pFlat);
+  PixBuf_Release(pSource);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(pyramid_levels_test),
+    cmocka_unit_test(pyramid_isa_test),
+    cmocka_unit_test(pyramid_threads_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
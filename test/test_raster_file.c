@@ -0,0 +1,348 @@
+#include "../pixconv.h"
+#include "../rasterfile.h"
+#include "testutil.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+static FILE* CreateFile(const void* pData, size_t size)
+{
+  FILE* fp = tmpfile();
+  assert_non_null(fp);
+  assert_int_equal(size, fwrite(pData, 1, size, fp));
+  rewind(fp);
+  return fp;
+}
+
+static void WriteLE16(uint8_t* p, uint32_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void WriteLE32(uint8_t* p, uint32_t v)
+{
+  WriteLE16(p, v & 0xFFFF);
+  WriteLE16(p + 2, v >> 16);
+}
+
+/* BITMAPFILEHEADER and BITMAPINFOHEADER; the palette or pixels follow at dataOffset */
+static void WriteBMPHeader(uint8_t* p, int32_t width, int32_t height, uint32_t bpp, uint32_t compression,
+    uint32_t dataOffset, uint32_t nColors)
+{
+  memset(p, 0, 54);
+  p[0] = 'B';
+  p[1] = 'M';
+  WriteLE32(p + 10, dataOffset);
+  WriteLE32(p + 14, 40);
+  WriteLE32(p + 18, (uint32_t)width);
+  WriteLE32(p + 22, (uint32_t)height);
+  WriteLE16(p + 26, 1);
+  WriteLE16(p + 28, bpp);
+  WriteLE32(p + 30, compression);
+  WriteLE32(p + 46, nColors);
+}
+
+/* Read a region and compare it with point sampling of the whole image, in pixels of nBytes */
+static void CheckRegion(LPRASTERFILE pRaster, const uint8_t* pImage, size_t nBytes, size_t left, size_t top,
+    size_t right, size_t bottom, unsigned int nScale, int nPixFmt)
+{
+  size_t outWidth = (right - left + nScale - 1) / nScale;
+  size_t outHeight = (bottom - top + nScale - 1) / nScale;
+  size_t stride = outWidth * nBytes + 3;
+  uint8_t* pOut = (uint8_t*)malloc(stride * outHeight);
+  assert_non_null(pOut);
+
+  assert_int_equal(RASTERFILE_OK, RasterFile_ReadRegion(pRaster, left, top, right, bottom, nScale, pOut, stride,
+      nPixFmt));
+
+  for (size_t y = 0; y < outHeight; ++y) {
+    size_t sy = top + y * nScale + nScale / 2 < bottom ? top + y * nScale + nScale / 2 : bottom - 1;
+    for (size_t x = 0; x < outWidth; ++x) {
+      size_t sx = left + x * nScale + nScale / 2 < right ? left + x * nScale + nScale / 2 : right - 1;
+      assert_memory_equal(pImage + (sy * pRaster->width + sx) * nBytes, pOut + y * stride + x * nBytes, nBytes);
+    }
+  }
+
+  free(pOut);
+}
+
+static void raster_file_pgm_test(void** state)
+{
+  (void)state;
+
+  /* 8-bit samples after a header with a comment */
+  const size_t width = 37, height = 23;
+  static const char szHeader[] = "P5\n# region\n37 23\n255\n";
+  size_t cbHeader = sizeof(szHeader) - 1;
+  uint8_t* pFile = (uint8_t*)malloc(cbHeader + width * height);
+  assert_non_null(pFile);
+  memcpy(pFile, szHeader, cbHeader);
+  Test_FillPattern(pFile + cbHeader, width * height, 1);
+  const uint8_t* pSamples = pFile + cbHeader;
+
+  FILE* fp = CreateFile(pFile, cbHeader + width * height);
+  RASTERFILE raster;
+  assert_int_equal(RASTERFILE_OK, RasterFile_Init(&raster, fp));
+  assert_int_equal(width, raster.width);
+  assert_int_equal(height, raster.height);
+  assert_int_equal(cbHeader, raster.dataOffset);
+  assert_int_equal(PIXFMT_GRAY8, raster.nPixFmt);
+
+  CheckRegion(&raster, pSamples, 1, 0, 0, width, height, 1, PIXFMT_GRAY8);
+  CheckRegion(&raster, pSamples, 1, 5, 3, 20, 17, 1, PIXFMT_GRAY8);
+  CheckRegion(&raster, pSamples, 1, 5, 3, 20, 17, 3, PIXFMT_GRAY8);
+  CheckRegion(&raster, pSamples, 1, 0, 0, width, height, 8, PIXFMT_GRAY8);
+  CheckRegion(&raster, pSamples, 1, 36, 22, 37, 23, 4, PIXFMT_GRAY8);
+
+  /* One read per sampled row, of the sampled columns only */
+  RASTERFILESTATS before, after;
+  RasterFile_GetStats(&raster, &before);
+  CheckRegion(&raster, pSamples, 1, 10, 0, 30, 20, 4, PIXFMT_GRAY8);
+  RasterFile_GetStats(&raster, &after);
+  assert_int_equal(5, after.reads - before.reads);
+  assert_int_equal(5 * 17, after.bytesRead - before.bytesRead);
+
+  /* Gray expanded to opaque BGRA */
+  uint8_t* pExpanded = (uint8_t*)malloc(width * height * 4);
+  assert_non_null(pExpanded);
+  for (size_t i = 0; i < width * height; ++i) {
+    memset(pExpanded + i * 4, pSamples[i], 3);
+    pExpanded[i * 4 + 3] = 0xFF;
+  }
+  CheckRegion(&raster, pExpanded, 4, 3, 4, 33, 21, 2, PIXFMT_PBGRA32);
+  free(pExpanded);
+
+  RasterFile_Cleanup(&raster);
+  fclose(fp);
+
+  /* Cut short: the missing rows come out black */
+  fp = CreateFile(pFile, cbHeader + width * 10 + 5);
+  assert_int_equal(RASTERFILE_OK, RasterFile_Init(&raster, fp));
+  memset(pFile + cbHeader + width * 10 + 5, 0, width * height - width * 10 - 5);
+  CheckRegion(&raster, pSamples, 1, 0, 0, width, height, 1, PIXFMT_GRAY8);
+  RasterFile_Cleanup(&raster);
+  fclose(fp);
+  free(pFile);
+
+  /* 16-bit big-endian samples to both ranges, rescaled from maxval and clamped to it */
+  static const uint8_t wide[] = "P5 3 1 1000\n\x00\x00\x01\xF4\xFF\xFF";
+  fp = CreateFile(wide, sizeof(wide) - 1);
+  assert_int_equal(RASTERFILE_OK, RasterFile_Init(&raster, fp));
+  assert_int_equal(PIXFMT_GRAY16, raster.nPixFmt);
+
+  uint16_t out16[3] = { 0 };
+  assert_int_equal(RASTERFILE_OK, RasterFile_ReadRegion(&raster, 0, 0, 3, 1, 1, out16, sizeof(out16),
+      PIXFMT_GRAY16));
+  assert_int_equal(0, out16[0]);
+  assert_int_equal((500u * 65535u + 500u) / 1000u, out16[1]);
+  assert_int_equal(65535, out16[2]);
+
+  uint8_t out8[3] = { 0 };
+  assert_int_equal(RASTERFILE_OK, RasterFile_ReadRegion(&raster, 0, 0, 3, 1, 1, out8, sizeof(out8),
+      PIXFMT_GRAY8));
+  assert_int_equal(0, out8[0]);
+  assert_int_equal(128, out8[1]);
+  assert_int_equal(255, out8[2]);
+
+  RasterFile_Cleanup(&raster);
+  fclose(fp);
+}
+
+static void raster_file_bmp_test(void** state)
+{
+  (void)state;
+
+  /* 24-bit bottom-up, rows padded to 4 bytes */
+  const size_t width = 13, height = 7;
+  size_t stride24 = (width * 3 + 3) & ~(size_t)3;
+  uint8_t* pFile = (uint8_t*)malloc(54 + 1024 + stride24 * height + width * height * 4);
+  uint8_t* pImage = (uint8_t*)malloc(width * height * 4);
+  assert_non_null(pFile);
+  assert_non_null(pImage);
+
+  Test_FillPattern(pImage, width * height * 4, 2);
+  for (size_t i = 0; i < width * height; ++i) {
+    pImage[i * 4 + 3] = 0xFF;
+  }
+
+  WriteBMPHeader(pFile, (int32_t)width, (int32_t)height, 24, 0, 54, 0);
+  for (size_t y = 0; y < height; ++y) {
+    uint8_t* pRow = pFile + 54 + (height - 1 - y) * stride24;
+    memset(pRow, 0xEE, stride24);
+    for (size_t x = 0; x < width; ++x) {
+      memcpy(pRow + x * 3, pImage + (y * width + x) * 4, 3);
+    }
+  }
+
+  FILE* fp = CreateFile(pFile, 54 + stride24 * height);
+  RASTERFILE raster;
+  assert_int_equal(RASTERFILE_OK, RasterFile_Init(&raster, fp));
+  assert_int_equal(PIXFMT_PBGRA32, raster.nPixFmt);
+  assert_true(raster.bBottomUp);
+  CheckRegion(&raster, pImage, 4, 0, 0, width, height, 1, PIXFMT_PBGRA32);
+  CheckRegion(&raster, pImage, 4, 2, 1, 12, 7, 3, PIXFMT_PBGRA32);
+
+  uint8_t gray[4];
+  assert_int_equal(RASTERFILE_ERROR_UNSUPPORTED, RasterFile_ReadRegion(&raster, 0, 0, 1, 1, 1, gray, 4,
+      PIXFMT_GRAY8));
+  RasterFile_Cleanup(&raster);
+  fclose(fp);
+
+  /* 32-bit top-down; the fourth byte is not alpha */
+  WriteBMPHeader(pFile, (int32_t)width, -(int32_t)height, 32, 0, 54, 0);
+  for (size_t i = 0; i < width * height; ++i) {
+    memcpy(pFile + 54 + i * 4, pImage + i * 4, 3);
+    pFile[54 + i * 4 + 3] = 0x00;
+  }
+
+  fp = CreateFile(pFile, 54 + width * height * 4);
+  assert_int_equal(RASTERFILE_OK, RasterFile_Init(&raster, fp));
+  assert_false(raster.bBottomUp);
+  CheckRegion(&raster, pImage, 4, 0, 0, width, height, 1, PIXFMT_PBGRA32);
+  CheckRegion(&raster, pImage, 4, 1, 2, 11, 6, 2, PIXFMT_PBGRA32);
+  RasterFile_Cleanup(&raster);
+  fclose(fp);
+
+  /* 8-bit indices into a 4 color palette; the rest of the palette is black */
+  size_t stride8 = (width + 3) & ~(size_t)3;
+  WriteBMPHeader(pFile, (int32_t)width, (int32_t)height, 8, 0, 54 + 4 * 4, 4);
+  static const uint8_t palette[5][4] = {
+    { 0x10, 0x20, 0x30, 0x00 }, { 0x40, 0x50, 0x60, 0x00 }, { 0x70, 0x80, 0x90, 0x00 },
+    { 0xA0, 0xB0, 0xC0, 0x00 }, { 0x00, 0x00, 0x00, 0x00 },
+  };
+  memcpy(pFile + 54, palette, 4 * 4);
+  for (size_t y = 0; y < height; ++y) {
+    for (size_t x = 0; x < width; ++x) {
+      size_t index = (x + y * 2) % 5;
+      pFile[54 + 16 + (height - 1 - y) * stride8 + x] = (uint8_t)index;
+      memcpy(pImage + (y * width + x) * 4, palette[index], 3);
+      pImage[(y * width + x) * 4 + 3] = 0xFF;
+    }
+  }
+
+  fp = CreateFile(pFile, 54 + 16 + stride8 * height);
+  assert_int_equal(RASTERFILE_OK, RasterFile_Init(&raster, fp));
+  CheckRegion(&raster, pImage, 4, 0, 0, width, height, 1, PIXFMT_PBGRA32);
+  CheckRegion(&raster, pImage, 4, 3, 0, 13, 7, 2, PIXFMT_PBGRA32);
+  RasterFile_Cleanup(&raster);
+  fclose(fp);
+
+  free(pImage);
+  free(pFile);
+}
+
+static void raster_file_memory_test(void** state)
+{
+  (void)state;
+
+  const size_t width = 29, height = 19;
+  static const char szHeader[] = "P5 29 19 255\n";
+  size_t cbHeader = sizeof(szHeader) - 1;
+  uint8_t* pFile = (uint8_t*)malloc(cbHeader + width * height);
+  assert_non_null(pFile);
+  memcpy(pFile, szHeader, cbHeader);
+  Test_FillPattern(pFile + cbHeader, width * height, 3);
+  const uint8_t* pSamples = pFile + cbHeader;
+
+  RASTERFILE raster;
+  assert_int_equal(RASTERFILE_OK, RasterFile_InitMemory(&raster, pFile, cbHeader + width * height));
+  assert_null(raster.fp);
+  assert_int_equal(cbHeader, raster.dataOffset);
+
+  /* Spans are used in place, and still counted */
+  RASTERFILESTATS before, after;
+  RasterFile_GetStats(&raster, &before);
+  CheckRegion(&raster, pSamples, 1, 0, 0, width, height, 1, PIXFMT_GRAY8);
+  CheckRegion(&raster, pSamples, 1, 4, 2, 25, 18, 3, PIXFMT_GRAY8);
+  RasterFile_GetStats(&raster, &after);
+  assert_int_equal(height + 6, after.reads - before.reads);
+  RasterFile_Cleanup(&raster);
+
+  /* Cut short, through the span buffer */
+  assert_int_equal(RASTERFILE_OK, RasterFile_InitMemory(&raster, pFile, cbHeader + width * 7 + 3));
+  memset(pFile + cbHeader + width * 7 + 3, 0, width * height - width * 7 - 3);
+  CheckRegion(&raster, pSamples, 1, 0, 0, width, height, 1, PIXFMT_GRAY8);
+  CheckRegion(&raster, pSamples, 1, 1, 5, 28, 11, 2, PIXFMT_GRAY8);
+  RasterFile_Cleanup(&raster);
+
+  /* A bottom-up BMP with a palette */
+  uint8_t bmp[54 + 8 + 8] = { 0 };
+  WriteBMPHeader(bmp, 3, 2, 8, 0, 54 + 8, 2);
+  static const uint8_t palette[2][4] = { { 0x01, 0x02, 0x03, 0x00 }, { 0x04, 0x05, 0x06, 0x00 } };
+  memcpy(bmp + 54, palette, sizeof(palette));
+  static const uint8_t indices[8] = { 1, 1, 0, 0, 0, 1, 0, 0 };
+  memcpy(bmp + 62, indices, sizeof(indices));
+
+  static const uint8_t expected[6][4] = {
+    { 0x01, 0x02, 0x03, 0xFF }, { 0x04, 0x05, 0x06, 0xFF }, { 0x01, 0x02, 0x03, 0xFF },
+    { 0x04, 0x05, 0x06, 0xFF }, { 0x04, 0x05, 0x06, 0xFF }, { 0x01, 0x02, 0x03, 0xFF },
+  };
+  assert_int_equal(RASTERFILE_OK, RasterFile_InitMemory(&raster, bmp, sizeof(bmp)));
+  assert_true(raster.bBottomUp);
+  CheckRegion(&raster, &expected[0][0], 4, 0, 0, 3, 2, 1, PIXFMT_PBGRA32);
+  RasterFile_Cleanup(&raster);
+
+  assert_int_equal(RASTERFILE_ERROR_FORMAT, RasterFile_InitMemory(&raster, NULL, 0));
+  assert_int_equal(RASTERFILE_ERROR_FORMAT, RasterFile_InitMemory(&raster, "P", 1));
+
+  free(pFile);
+}
+
+static void raster_file_invalid_test(void** state)
+{
+  (void)state;
+
+  RASTERFILE raster;
+
+  /* ASCII and run length encoded rasters have no fixed row offsets */
+  static const char ascii[] = "P2 2 1 255\n0 255\n";
+  FILE* fp = CreateFile(ascii, sizeof(ascii) - 1);
+  assert_int_equal(RASTERFILE_ERROR_UNSUPPORTED, RasterFile_Init(&raster, fp));
+  fclose(fp);
+
+  uint8_t bmp[64] = { 0 };
+  WriteBMPHeader(bmp, 2, 2, 8, 1, 54, 0);
+  fp = CreateFile(bmp, sizeof(bmp));
+  assert_int_equal(RASTERFILE_ERROR_UNSUPPORTED, RasterFile_Init(&raster, fp));
+  fclose(fp);
+
+  static const char png[] = "\x89PNG\r\n\x1a\n";
+  fp = CreateFile(png, sizeof(png) - 1);
+  assert_int_equal(RASTERFILE_ERROR_FORMAT, RasterFile_Init(&raster, fp));
+  fclose(fp);
+
+  /* Regions must be within the image and not empty */
+  static const char pgm[] = "P5 4 4 255\n0123456789abcdef";
+  fp = CreateFile(pgm, sizeof(pgm) - 1);
+  assert_int_equal(RASTERFILE_OK, RasterFile_Init(&raster, fp));
+
+  uint8_t out[16];
+  assert_int_equal(RASTERFILE_ERROR_INVALID, RasterFile_ReadRegion(&raster, 0, 0, 5, 4, 1, out, 4, PIXFMT_GRAY8));
+  assert_int_equal(RASTERFILE_ERROR_INVALID, RasterFile_ReadRegion(&raster, 2, 0, 2, 4, 1, out, 4, PIXFMT_GRAY8));
+  assert_int_equal(RASTERFILE_ERROR_INVALID, RasterFile_ReadRegion(&raster, 0, 0, 4, 4, 0, out, 4, PIXFMT_GRAY8));
+  assert_int_equal(RASTERFILE_ERROR_UNSUPPORTED, RasterFile_ReadRegion(&raster, 0, 0, 4, 4, 1, out, 4,
+      PIXFMT_BGR24));
+
+  assert_int_equal(RASTERFILE_OK, RasterFile_ReadRegion(&raster, 1, 1, 3, 3, 1, out, 2, PIXFMT_GRAY8));
+  assert_memory_equal("569a", out, 4);
+
+  RasterFile_Cleanup(&raster);
+  fclose(fp);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(raster_file_pgm_test),
+    cmocka_unit_test(raster_file_bmp_test),
+    cmocka_unit_test(raster_file_memory_test),
+    cmocka_unit_test(raster_file_invalid_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,124 @@
+#include "../rbtree.h"
+#include "../hashmap.h"
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+static void rb_tree_insert_test(void** state)
+{
+  (void)state;
+
+  RBTREE tree;
+  InitializeRBTree(&tree, sizeof(int), compareInt);
+
+  int key = 1000;
+  int value = 51000;
+  RBTree_Insert(&tree, &key, &value, sizeof(int));
+  /*
+   *  (1000)
+   */
+  assert_int_equal(1000, *(int*)tree.pRoot->pair.pKey);
+
+  key = 50;
+  value = 50;
+  RBTree_Insert(&tree, &key, &value, sizeof(int));
+  /*
+   *    (1000)
+   *    /
+   *  [50]
+   */
+  assert_int_equal(1000, *(int*)tree.pRoot->pair.pKey);
+  assert_int_equal(50, *(int*)tree.pRoot->pLeft->pair.pKey);
+
+  key = 40;
+  value = 40;
+  RBTree_Insert(&tree, &key, &value, sizeof(int));
+  /*
+   *     (50)
+   *     /  \
+   *  [40]  [1000]
+   */
+  assert_int_equal(50, *(int*)tree.pRoot->pair.pKey);
+  assert_int_equal(40, *(int*)tree.pRoot->pLeft->pair.pKey);
+  assert_int_equal(1000, *(int*)tree.pRoot->pRight->pair.pKey);
+
+  key = 80;
+  value = 80;
+  RBTree_Insert(&tree, &key, &value, sizeof(int));
+  /*
+   *     (50)
+   *     /  \
+   *  (40)  (1000)
+   *        /
+   *      [80]
+   */
+  assert_int_equal(50, *(int*)tree.pRoot->pair.pKey);
+  assert_int_equal(40, *(int*)tree.pRoot->pLeft->pair.pKey);
+  assert_int_equal(1000, *(int*)tree.pRoot->pRight->pair.pKey);
+  assert_int_equal(80, *(int*)tree.pRoot->pRight->pLeft->pair.pKey);
+
+  key = 1500;
+  value = 1500;
+  RBTree_Insert(&tree, &key, &value, sizeof(int));
+  /*
+   *     (50)
+   *     /  \
+   *  (40)  (1000)
+   *        /   \
+   *      [80]  [1500]
+   */
+  assert_int_equal(50, *(int*)tree.pRoot->pair.pKey);
+  assert_int_equal(40, *(int*)tree.pRoot->pLeft->pair.pKey);
+  assert_int_equal(1000, *(int*)tree.pRoot->pRight->pair.pKey);
+  assert_int_equal(80, *(int*)tree.pRoot->pRight->pLeft->pair.pKey);
+  assert_int_equal(1500, *(int*)tree.pRoot->pRight->pRight->pair.pKey);
+
+  RBTree_Cleanup(&tree);
+}
+
+static void rb_tree_get_test(void** state)
+{
+  (void)state;
+
+  RBTREE tree;
+  InitializeRBTree(&tree, sizeof(int), compareInt);
+
+  int key = 1000;
+  int value = 51000;
+  RBTree_Insert(&tree, &key, &value, sizeof(int));
+
+  key = 50;
+  value = 50;
+  RBTree_Insert(&tree, &key, &value, sizeof(int));
+
+  key = 40;
+  value = 740;
+  RBTree_Insert(&tree, &key, &value, sizeof(int));
+
+  key = 80;
+  value = 80;
+  RBTree_Insert(&tree, &key, &value, sizeof(int));
+
+  key = 1500;
+  value = 1500;
+  RBTree_Insert(&tree, &key, &value, sizeof(int));
+
+  key = 1000;
+  value = *(int*)RBTree_Get(&tree, &key);
+  assert_int_equal(51000, value);
+
+  key = 40;
+  value = *(int*)RBTree_Get(&tree, &key);
+  assert_int_equal(740, value);
+
+  RBTree_Cleanup(&tree);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(rb_tree_insert_test),
+    cmocka_unit_test(rb_tree_get_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
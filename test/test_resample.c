@@ -0,0 +1,248 @@
+#include "../pixconv.h"
+#include "../resample.h"
+#include "testutil.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+/* Random premultiplied pixels, colour never above alpha */
+static void FillPBGRA(uint8_t* pData, size_t nPixels, unsigned int seed)
+{
+  Test_FillPattern(pData, nPixels * 4, seed);
+  for (size_t i = 0; i < nPixels; ++i) {
+    uint8_t* p = pData + i * 4;
+    for (int c = 0; c < 3; ++c) {
+      p[c] = (uint8_t)(p[c] * p[3] / 255);
+    }
+  }
+}
+
+static void resample_identity_test(void** state)
+{
+  (void)state;
+
+  uint8_t src[7 * 5 * 4];
+  uint8_t dst[7 * 5 * 4];
+  FillPBGRA(src, 7 * 5, 1);
+
+  for (int nFilter = 0; nFilter < RESAMPLE_FILTER_COUNT; ++nFilter) {
+    RESAMPLER resampler;
+    assert_int_equal(RESAMPLE_OK, Resample_Init(&resampler, 7, 5, 7, 5, nFilter));
+    assert_int_equal(RESAMPLE_OK, Resample_Run(&resampler, src, 7 * 4, PIXFMT_PBGRA32, dst, 7 * 4, NULL));
+    assert_memory_equal(src, dst, sizeof(src));
+    Resample_Cleanup(&resampler);
+  }
+}
+
+static void resample_box_test(void** state)
+{
+  (void)state;
+
+  /* Halving with a box filter averages 2x2 blocks, rounding half up */
+  const uint8_t gray[4 * 2] = {
+    0, 10, 200, 201,
+    4, 20, 100, 101,
+  };
+  uint8_t dst[2 * 4];
+
+  RESAMPLER resampler;
+  assert_int_equal(RESAMPLE_OK, Resample_Init(&resampler, 4, 2, 2, 1, RESAMPLE_FILTER_BOX));
+  assert_int_equal(RESAMPLE_OK, Resample_Run(&resampler, gray, 4, PIXFMT_GRAY8, dst, 2 * 4, NULL));
+  Resample_Cleanup(&resampler);
+
+  assert_int_equal(9, dst[0]);
+  assert_int_equal(9, dst[2]);
+  assert_int_equal(0xFF, dst[3]);
+  assert_int_equal(151, dst[4]);
+  assert_int_equal(0xFF, dst[7]);
+}
+
+static void resample_flat_test(void** state)
+{
+  (void)state;
+
+  /* A flat colour stays flat through every filter, down and up */
+  const size_t sizes[][4] = { { 97, 61, 23, 17 }, { 31, 9, 80, 40 }, { 640, 480, 3, 2 } };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    size_t srcWidth = sizes[i][0], srcHeight = sizes[i][1];
+    size_t dstWidth = sizes[i][2], dstHeight = sizes[i][3];
+
+    uint8_t* pSrc = (uint8_t*)malloc(srcWidth * srcHeight * 4);
+    uint8_t* pDst = (uint8_t*)malloc(dstWidth * dstHeight * 4);
+    assert_non_null(pSrc);
+    assert_non_null(pDst);
+    for (size_t p = 0; p < srcWidth * srcHeight; ++p) {
+      pSrc[p * 4 + 0] = 30;
+      pSrc[p * 4 + 1] = 60;
+      pSrc[p * 4 + 2] = 90;
+      pSrc[p * 4 + 3] = 200;
+    }
+
+    for (int nFilter = 0; nFilter < RESAMPLE_FILTER_COUNT; ++nFilter) {
+      RESAMPLER resampler;
+      assert_int_equal(RESAMPLE_OK, Resample_Init(&resampler, srcWidth, srcHeight, dstWidth, dstHeight, nFilter));
+      assert_int_equal(RESAMPLE_OK, Resample_Run(&resampler, pSrc, srcWidth * 4, PIXFMT_PBGRA32,
+          pDst, dstWidth * 4, NULL));
+      for (size_t p = 0; p < dstWidth * dstHeight; ++p) {
+        assert_memory_equal(pSrc, pDst + p * 4, 4);
+      }
+      Resample_Cleanup(&resampler);
+    }
+
+    free(pDst);
+    free(pSrc);
+  }
+}
+
+/* Every ISA level, with and without a pool, gives the same bytes, and alpha bounds colour */
+static void resample_kernels_test(void** state)
+{
+  (void)state;
+
+  TASKPOOL pool;
+  assert_int_equal(TASKPOOL_OK, TaskPool_Init(&pool, 2));
+
+  const size_t srcWidth = 203, srcHeight = 157;
+  const size_t dstWidth = 77, dstHeight = 45;
+  const int formats[] = { PIXFMT_PBGRA32, PIXFMT_GRAY8 };
+
+  uint8_t* pSrc = (uint8_t*)malloc(srcWidth * srcHeight * 4);
+  uint8_t* pExpected = (uint8_t*)malloc(dstWidth * dstHeight * 4);
+  uint8_t* pActual = (uint8_t*)malloc(dstWidth * dstHeight * 4);
+  assert_non_null(pSrc);
+  assert_non_null(pExpected);
+  assert_non_null(pActual);
+  FillPBGRA(pSrc, srcWidth * srcHeight, 7);
+
+  int nCpuIsa = PixConv_GetCpuIsa();
+  for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
+    size_t srcStride = srcWidth * (size_t)PixConv_GetBytesPerPixel(formats[f]);
+
+    for (int nFilter = 0; nFilter < RESAMPLE_FILTER_COUNT; ++nFilter) {
+      RESAMPLER resampler;
+      assert_int_equal(RESAMPLE_OK, Resample_Init(&resampler, srcWidth, srcHeight, dstWidth, dstHeight, nFilter));
+
+      PixConv_SetIsa(PIXCONV_ISA_SCALAR);
+      assert_int_equal(RESAMPLE_OK, Resample_Run(&resampler, pSrc, srcStride, formats[f],
+          pExpected, dstWidth * 4, NULL));
+
+      for (size_t p = 0; p < dstWidth * dstHeight; ++p) {
+        const uint8_t* px = pExpected + p * 4;
+        assert_true(px[0] <= px[3] && px[1] <= px[3] && px[2] <= px[3]);
+      }
+
+      for (int nIsa = PIXCONV_ISA_SCALAR; nIsa <= nCpuIsa; ++nIsa) {
+        PixConv_SetIsa(nIsa);
+        memset(pActual, 0, dstWidth * dstHeight * 4);
+        assert_int_equal(RESAMPLE_OK, Resample_Run(&resampler, pSrc, srcStride, formats[f],
+            pActual, dstWidth * 4, &pool));
+        assert_memory_equal(pExpected, pActual, dstWidth * dstHeight * 4);
+      }
+
+      Resample_Cleanup(&resampler);
+    }
+  }
+
+  PixConv_SetIsa(nCpuIsa);
+  TaskPool_Cleanup(&pool);
+  free(pActual);
+  free(pExpected);
+  free(pSrc);
+}
+
+static void resample_region_test(void** state)
+{
+  (void)state;
+
+  /* Zoomed in and out, in BGRA and gray: a region is that part of the whole */
+  const struct { size_t srcWidth, srcHeight, dstWidth, dstHeight; int nFormat; } cases[] = {
+    { 40, 30, 170, 130, PIXFMT_PBGRA32 },
+    { 90, 70, 33, 25, PIXFMT_GRAY8 },
+    { 40, 30, 40, 30, PIXFMT_PBGRA32 },
+  };
+  const size_t left = 7, top = 3;
+
+  TASKPOOL pool;
+  assert_int_equal(TASKPOOL_OK, TaskPool_Init(&pool, 2));
+
+  for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+    size_t srcWidth = cases[c].srcWidth, srcHeight = cases[c].srcHeight;
+    size_t dstWidth = cases[c].dstWidth, dstHeight = cases[c].dstHeight;
+    size_t right = dstWidth - 5, bottom = dstHeight - 2;
+    size_t bpp = PixConv_GetBytesPerPixel(cases[c].nFormat);
+
+    uint8_t* pSrc = (uint8_t*)malloc(srcWidth * srcHeight * bpp);
+    uint8_t* pWhole = (uint8_t*)malloc(dstWidth * dstHeight * 4);
+    uint8_t* pRegion = (uint8_t*)malloc((right - left) * (bottom - top) * 4);
+    assert_non_null(pSrc);
+    assert_non_null(pWhole);
+    assert_non_null(pRegion);
+    if (bpp == 4) {
+      FillPBGRA(pSrc, srcWidth * srcHeight, 7);
+    }
+    else {
+      Test_FillPattern(pSrc, srcWidth * srcHeight, 7);
+    }
+
+    for (int nFilter = 0; nFilter < RESAMPLE_FILTER_COUNT; ++nFilter) {
+      RESAMPLER resampler;
+      assert_int_equal(RESAMPLE_OK, Resample_Init(&resampler, srcWidth, srcHeight, dstWidth, dstHeight, nFilter));
+      assert_int_equal(RESAMPLE_OK, Resample_Run(&resampler, pSrc, srcWidth * bpp, cases[c].nFormat, pWhole,
+          dstWidth * 4, &pool));
+      Resample_Cleanup(&resampler);
+
+      assert_int_equal(RESAMPLE_OK, Resample_InitRegion(&resampler, srcWidth, srcHeight, dstWidth, dstHeight,
+          left, top, right, bottom, nFilter));
+      assert_int_equal(RESAMPLE_OK, Resample_Run(&resampler, pSrc, srcWidth * bpp, cases[c].nFormat, pRegion,
+          (right - left) * 4, &pool));
+      Resample_Cleanup(&resampler);
+
+      for (size_t y = top; y < bottom; ++y) {
+        assert_memory_equal(pWhole + (y * dstWidth + left) * 4, pRegion + (y - top) * (right - left) * 4,
+            (right - left) * 4);
+      }
+    }
+
+    free(pRegion);
+    free(pWhole);
+    free(pSrc);
+  }
+
+  TaskPool_Cleanup(&pool);
+}
+
+static void resample_invalid_test(void** state)
+{
+  (void)state;
+
+  RESAMPLER resampler;
+  assert_int_equal(RESAMPLE_ERROR_INVALID, Resample_Init(&resampler, 0, 10, 5, 5, RESAMPLE_FILTER_BOX));
+  assert_int_equal(RESAMPLE_ERROR_INVALID, Resample_Init(&resampler, 10, 10, 5, 5, RESAMPLE_FILTER_COUNT));
+  assert_int_equal(RESAMPLE_ERROR_INVALID, Resample_InitRegion(&resampler, 10, 10, 5, 5, 2, 0, 2, 5,
+      RESAMPLE_FILTER_BOX));
+  assert_int_equal(RESAMPLE_ERROR_INVALID, Resample_InitRegion(&resampler, 10, 10, 5, 5, 0, 0, 5, 6,
+      RESAMPLE_FILTER_BOX));
+
+  uint8_t src[16 * 3] = { 0 };
+  uint8_t dst[4 * 4];
+  assert_int_equal(RESAMPLE_OK, Resample_Init(&resampler, 4, 4, 2, 2, RESAMPLE_FILTER_BILINEAR));
+  assert_int_equal(RESAMPLE_ERROR_UNSUPPORTED, Resample_Run(&resampler, src, 12, PIXFMT_RGB24, dst, 8, NULL));
+  Resample_Cleanup(&resampler);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(resample_identity_test),
+    cmocka_unit_test(resample_box_test),
+    cmocka_unit_test(resample_flat_test),
+    cmocka_unit_test(resample_kernels_test),
+    cmocka_unit_test(resample_region_test),
+    cmocka_unit_test(resample_invalid_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,268 @@
+#include "../taskpool.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#define RANGE_SIZE 10000
+#define NESTED_ROWS 16
+#define NESTED_COLUMNS 100
+
+/* Workers must not assert; they leave what they saw here */
+typedef struct _tagRANGESTATE {
+  LPTASKPOOL pPool;
+  volatile long hits[RANGE_SIZE];
+  volatile long nCalls;
+  volatile long nRows;
+  volatile long nOversized;
+  size_t nGrain;
+} RANGESTATE;
+
+static void CountTask(void* pArg)
+{
+  Atomic_Increment((volatile long*)pArg);
+}
+
+static void MarkRange(void* pArg, size_t nBegin, size_t nEnd)
+{
+  RANGESTATE* pState = (RANGESTATE*)pArg;
+
+  Atomic_Increment(&pState->nCalls);
+  if (nEnd - nBegin > pState->nGrain) {
+    Atomic_Increment(&pState->nOversized);
+  }
+  for (size_t i = nBegin; i < nEnd; ++i) {
+    Atomic_Increment(&pState->hits[i]);
+  }
+}
+
+static void MarkRow(void* pArg, size_t nBegin, size_t nEnd)
+{
+  RANGESTATE* pState = (RANGESTATE*)pArg;
+
+  for (size_t i = nBegin; i < nEnd; ++i) {
+    Atomic_Increment(&pState->nRows);
+    TaskPool_ParallelFor(pState->pPool, i * NESTED_COLUMNS, (i + 1) * NESTED_COLUMNS, 3, MarkRange, pState);
+  }
+}
+
+/* Set on the test thread only, to tell which tasks ran there */
+static THREAD_LOCAL int g_bTestThread;
+
+typedef struct _tagGROUPSTATE {
+  volatile long nStarted;
+  volatile long bRelease;
+  volatile long nRan;
+  volatile long nRanOnTest;
+} GROUPSTATE;
+
+static void BlockTask(void* pArg)
+{
+  GROUPSTATE* pState = (GROUPSTATE*)pArg;
+
+  Atomic_StoreRelease(&pState->nStarted, 1);
+  while (!Atomic_LoadAcquire(&pState->bRelease)) {
+    Thread_Yield();
+  }
+}
+
+static void GroupTask(void* pArg)
+{
+  GROUPSTATE* pState = (GROUPSTATE*)pArg;
+
+  Atomic_Increment(&pState->nRan);
+  if (g_bTestThread) {
+    Atomic_Increment(&pState->nRanOnTest);
+  }
+}
+
+static void task_pool_submit_test(void** state)
+{
+  (void)state;
+
+  TASKPOOL pool;
+  assert_int_equal(TASKPOOL_OK, TaskPool_Init(&pool, 4));
+  assert_int_equal(4, TaskPool_GetWorkerCount(&pool));
+
+  /* Dealt over 4 deques, none of which has to grow */
+  volatile long nCount = 0;
+  TASKGROUP group;
+  TaskGroup_Init(&group);
+  for (int i = 0; i < 800; ++i) {
+    assert_int_equal(TASKPOOL_OK, TaskPool_Submit(&pool, &group, CountTask, (void*)&nCount));
+  }
+  TaskPool_Wait(&pool, &group);
+  assert_int_equal(800, Atomic_Load(&nCount));
+  assert_int_equal(0, Atomic_Load(&group.nPending));
+
+  TASKPOOLSTATS stats;
+  TaskPool_GetStats(&pool, &stats);
+  assert_int_equal(800, stats.executed);
+  assert_true(stats.stolen >= stats.steals);
+
+  /* Nothing to wait for */
+  TaskPool_Wait(&pool, &group);
+
+  TaskPool_Cleanup(&pool);
+}
+
+static void task_pool_parallel_for_test(void** state)
+{
+  (void)state;
+
+  RANGESTATE* pState = (RANGESTATE*)malloc(sizeof(RANGESTATE));
+  assert_non_null(pState);
+
+  const unsigned int workers[] = { 1, 3 };
+  const size_t grains[] = { 1, 7, 0, RANGE_SIZE * 2 };
+  for (size_t w = 0; w < sizeof(workers) / sizeof(workers[0]); ++w) {
+    TASKPOOL pool;
+    assert_int_equal(TASKPOOL_OK, TaskPool_Init(&pool, workers[w]));
+
+    for (size_t g = 0; g < sizeof(grains) / sizeof(grains[0]); ++g) {
+      memset(pState, 0, sizeof(RANGESTATE));
+      pState->nGrain = grains[g] ? grains[g] : RANGE_SIZE;
+
+      /* Every index once, in pieces no larger than the grain */
+      TaskPool_ParallelFor(&pool, 100, RANGE_SIZE, grains[g], MarkRange, pState);
+      for (size_t i = 0; i < RANGE_SIZE; ++i) {
+        assert_int_equal(i < 100 ? 0 : 1, pState->hits[i]);
+      }
+      assert_int_equal(0, pState->nOversized);
+      if (grains[g] > RANGE_SIZE) {
+        assert_int_equal(1, pState->nCalls);
+      }
+    }
+
+    /* Empty ranges call nothing */
+    memset(pState, 0, sizeof(RANGESTATE));
+    TaskPool_ParallelFor(&pool, 5, 5, 1, MarkRange, pState);
+    TaskPool_ParallelFor(&pool, 6, 5, 1, MarkRange, pState);
+    assert_int_equal(0, pState->nCalls);
+
+    TaskPool_Cleanup(&pool);
+  }
+
+  free(pState);
+}
+
+static void task_pool_nested_test(void** state)
+{
+  (void)state;
+
+  RANGESTATE* pState = (RANGESTATE*)malloc(sizeof(RANGESTATE));
+  assert_non_null(pState);
+  memset(pState, 0, sizeof(RANGESTATE));
+  pState->nGrain = 3;
+
+  TASKPOOL pool;
+  assert_int_equal(TASKPOOL_OK, TaskPool_Init(&pool, 3));
+  pState->pPool = &pool;
+
+  /* Each row waits for its own columns from inside a task */
+  TaskPool_ParallelFor(&pool, 0, NESTED_ROWS, 1, MarkRow, pState);
+  assert_int_equal(NESTED_ROWS, pState->nRows);
+  for (size_t i = 0; i < NESTED_ROWS * NESTED_COLUMNS; ++i) {
+    assert_int_equal(1, pState->hits[i]);
+  }
+  for (size_t i = NESTED_ROWS * NESTED_COLUMNS; i < RANGE_SIZE; ++i) {
+    assert_int_equal(0, pState->hits[i]);
+  }
+  assert_int_equal(0, pState->nOversized);
+
+  TaskPool_Cleanup(&pool);
+  free(pState);
+}
+
+static void task_pool_cleanup_test(void** state)
+{
+  (void)state;
+
+  TASKPOOL pool;
+  assert_int_equal(TASKPOOL_OK, TaskPool_Init(&pool, 2));
+
+  /* Not waited for, yet all run before the workers stop */
+  volatile long nCount = 0;
+  for (int i = 0; i < 300; ++i) {
+    assert_int_equal(TASKPOOL_OK, TaskPool_Submit(&pool, NULL, CountTask, (void*)&nCount));
+  }
+  TaskPool_Cleanup(&pool);
+  assert_int_equal(300, Atomic_Load(&nCount));
+  assert_null(pool.pWorkers);
+
+  /* Twice is harmless */
+  TaskPool_Cleanup(&pool);
+}
+
+static void task_pool_inline_test(void** state)
+{
+  (void)state;
+
+  RANGESTATE* pState = (RANGESTATE*)malloc(sizeof(RANGESTATE));
+  assert_non_null(pState);
+  memset(pState, 0, sizeof(RANGESTATE));
+  pState->nGrain = RANGE_SIZE;
+
+  /* Without a pool the whole range goes in one call, whatever the grain */
+  TaskPool_ParallelFor(NULL, 0, RANGE_SIZE, 1, MarkRange, pState);
+  assert_int_equal(1, pState->nCalls);
+  assert_int_equal(1, pState->hits[0]);
+  assert_int_equal(1, pState->hits[RANGE_SIZE - 1]);
+
+  TaskPool_ParallelFor(NULL, 3, 3, 1, MarkRange, pState);
+  assert_int_equal(1, pState->nCalls);
+
+  free(pState);
+}
+
+static void task_pool_group_test(void** state)
+{
+  (void)state;
+
+  TASKPOOL pool;
+  assert_int_equal(TASKPOOL_OK, TaskPool_Init(&pool, 1));
+  g_bTestThread = 1;
+
+  /* The only worker is kept busy with group B, so group A is left to its waiter */
+  GROUPSTATE a = { 0 }, b = { 0 };
+  TASKGROUP groupA, groupB;
+  TaskGroup_Init(&groupA);
+  TaskGroup_Init(&groupB);
+  assert_int_equal(TASKPOOL_OK, TaskPool_Submit(&pool, &groupB, BlockTask, &b));
+  while (!Atomic_LoadAcquire(&b.nStarted)) {
+    Thread_Yield();
+  }
+
+  for (int i = 0; i < 8; ++i) {
+    assert_int_equal(TASKPOOL_OK, TaskPool_Submit(&pool, &groupB, GroupTask, &b));
+    assert_int_equal(TASKPOOL_OK, TaskPool_Submit(&pool, &groupA, GroupTask, &a));
+  }
+  TaskPool_Wait(&pool, &groupA);
+  assert_int_equal(8, Atomic_Load(&a.nRan));
+  assert_int_equal(8, Atomic_Load(&a.nRanOnTest));
+  assert_int_equal(0, Atomic_Load(&b.nRan));
+
+  /* Waiting for group B now, the test thread may help with it */
+  Atomic_StoreRelease(&b.bRelease, 1);
+  TaskPool_Wait(&pool, &groupB);
+  assert_int_equal(8, Atomic_Load(&b.nRan));
+
+  g_bTestThread = 0;
+  TaskPool_Cleanup(&pool);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(task_pool_submit_test),
+    cmocka_unit_test(task_pool_parallel_for_test),
+    cmocka_unit_test(task_pool_nested_test),
+    cmocka_unit_test(task_pool_cleanup_test),
+    cmocka_unit_test(task_pool_inline_test),
+    cmocka_unit_test(task_pool_group_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,256 @@
+#include "../tilemgr.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+/* Stands in for textures: counts loads and frees, fails tiles on request */
+typedef struct _tagFAKERESIDENCY {
+  size_t nLoads;
+  size_t nFrees;
+  size_t cost;
+  int failColumn;
+  int failRow;
+} FAKERESIDENCY;
+
+static int FakeLoad(LPTILE pTile, void* pUserData)
+{
+  FAKERESIDENCY* pFake = (FAKERESIDENCY*)pUserData;
+  if ((int)pTile->column == pFake->failColumn && (int)pTile->row == pFake->failRow) {
+    return 0;
+  }
+
+  pTile->pHandle = pFake;
+  pTile->cost = pFake->cost;
+  ++pFake->nLoads;
+  return 1;
+}
+
+static void FakeFree(LPTILE pTile, void* pUserData)
+{
+  FAKERESIDENCY* pFake = (FAKERESIDENCY*)pUserData;
+  assert_ptr_equal(pFake, pTile->pHandle);
+  ++pFake->nFrees;
+}
+
+static void InitFake(FAKERESIDENCY* pFake)
+{
+  memset(pFake, 0, sizeof(FAKERESIDENCY));
+  pFake->cost = 100;
+  pFake->failColumn = -1;
+  pFake->failRow = -1;
+}
+
+static TILEVIEW MakeView(double left, double top, double right, double bottom, double scale)
+{
+  TILEVIEW view = { left, top, right, bottom, scale };
+  return view;
+}
+
+static void tile_mgr_levels_test(void** state)
+{
+  (void)state;
+
+  FAKERESIDENCY fake;
+  InitFake(&fake);
+
+  /* 3000 -> 1500 -> 750 -> 375, the last fitting one tile */
+  TILEMGR tileMgr;
+  assert_int_equal(TILEMGR_OK, TileMgr_Init(&tileMgr, 3000, 1001, 512, 1000, FakeLoad, FakeFree, &fake));
+  assert_int_equal(4, tileMgr.nLevels);
+
+  size_t width = 0, height = 0;
+  TileMgr_GetLevelSize(&tileMgr, 2, &width, &height);
+  assert_int_equal(750, width);
+  assert_int_equal(251, height);
+
+  /* The coarsest level not coarser than the screen */
+  assert_int_equal(0, TileMgr_SelectLevel(&tileMgr, 4.0));
+  assert_int_equal(0, TileMgr_SelectLevel(&tileMgr, 1.0));
+  assert_int_equal(0, TileMgr_SelectLevel(&tileMgr, 0.51));
+  assert_int_equal(1, TileMgr_SelectLevel(&tileMgr, 0.5));
+  assert_int_equal(1, TileMgr_SelectLevel(&tileMgr, 0.26));
+  assert_int_equal(2, TileMgr_SelectLevel(&tileMgr, 0.25));
+  assert_int_equal(3, TileMgr_SelectLevel(&tileMgr, 0.001));
+  assert_int_equal(3, TileMgr_SelectLevel(&tileMgr, 0.0));
+
+  TileMgr_Cleanup(&tileMgr);
+
+  /* A single tile has a single level */
+  assert_int_equal(TILEMGR_OK, TileMgr_Init(&tileMgr, 512, 1, 512, 1000, FakeLoad, FakeFree, &fake));
+  assert_int_equal(1, tileMgr.nLevels);
+  TileMgr_Cleanup(&tileMgr);
+
+  assert_int_equal(TILEMGR_ERROR_INVALID, TileMgr_Init(&tileMgr, 0, 10, 512, 1000, FakeLoad, FakeFree, &fake));
+  assert_int_equal(TILEMGR_ERROR_INVALID, TileMgr_Init(&tileMgr, 10, 10, 0, 1000, FakeLoad, FakeFree, &fake));
+  assert_int_equal(TILEMGR_ERROR_INVALID, TileMgr_Init(&tileMgr, 10, 10, 512, 1000, NULL, FakeFree, &fake));
+  TileMgr_Cleanup(&tileMgr);
+}
+
+static void tile_mgr_visible_test(void** state)
+{
+  (void)state;
+
+  FAKERESIDENCY fake;
+  InitFake(&fake);
+
+  TILEMGR tileMgr;
+  assert_int_equal(TILEMGR_OK, TileMgr_Init(&tileMgr, 3000, 1001, 512, 100000, FakeLoad, FakeFree, &fake));
+
+  /* The whole image 1:1: 6 x 2 tiles, short ones along the right and bottom */
+  LPTILE tiles[16];
+  size_t nTiles = 0;
+  TILEVIEW view = MakeView(0, 0, 3000, 1001, 1.0);
+  assert_int_equal(TILEMGR_OK, TileMgr_Update(&tileMgr, &view, tiles, 16, &nTiles));
+  assert_int_equal(12, nTiles);
+  assert_int_equal(12, fake.nLoads);
+  assert_int_equal(5, tiles[5]->column);
+  assert_int_equal(0, tiles[5]->row);
+  assert_int_equal(2560, tiles[5]->x);
+  assert_int_equal(440, tiles[5]->width);
+  assert_int_equal(512, tiles[5]->height);
+  assert_int_equal(489, tiles[11]->height);
+
+  /* Views partly outside the image are clipped; a view straddling tiles takes all it touches */
+  view = MakeView(-100, -100, 513, 1, 1.0);
+  assert_int_equal(TILEMGR_OK, TileMgr_Update(&tileMgr, &view, tiles, 16, &nTiles));
+  assert_int_equal(2, nTiles);
+  assert_int_equal(12, fake.nLoads);
+
+  view = MakeView(3000, 0, 4000, 1001, 1.0);
+  assert_int_equal(TILEMGR_OK, TileMgr_Update(&tileMgr, &view, tiles, 16, &nTiles));
+  assert_int_equal(0, nTiles);
+
+  /* Zoomed out to a quarter: level 2, 750 x 251, two tiles */
+  view = MakeView(0, 0, 3000, 1001, 0.25);
+  assert_int_equal(TILEMGR_OK, TileMgr_Update(&tileMgr, &view, tiles, 16, &nTiles));
+  assert_int_equal(2, nTiles);
+  assert_int_equal(2, tiles[1]->level);
+  assert_int_equal(238, tiles[1]->width);
+  assert_int_equal(251, tiles[1]->height);
+  assert_int_equal(14, fake.nLoads);
+
+  /* More visible than the caller has room for: counted, and resident all the same */
+  view = MakeView(0, 0, 3000, 1001, 1.0);
+  assert_int_equal(TILEMGR_OK, TileMgr_Update(&tileMgr, &view, tiles, 4, &nTiles));
+  assert_int_equal(12, nTiles);
+
+  TILEMGRSTATS stats;
+  TileMgr_GetStats(&tileMgr, &stats);
+  assert_int_equal(14, stats.count);
+  assert_int_equal(1400, stats.bytes);
+  assert_int_equal(14, stats.hits);
+
+  TileMgr_Cleanup(&tileMgr);
+  assert_int_equal(fake.nLoads, fake.nFrees);
+}
+
+static void tile_mgr_evict_test(void** state)
+{
+  (void)state;
+
+  FAKERESIDENCY fake;
+  InitFake(&fake);
+
+  /* 8 x 8 tiles of 100 bytes, room for 5 */
+  TILEMGR tileMgr;
+  assert_int_equal(TILEMGR_OK, TileMgr_Init(&tileMgr, 1024, 1024, 128, 500, FakeLoad, FakeFree, &fake));
+
+  LPTILE tiles[64];
+  size_t nTiles = 0;
+  TILEVIEW view = MakeView(0, 0, 256, 256, 1.0);
+  assert_int_equal(TILEMGR_OK, TileMgr_Update(&tileMgr, &view, tiles, 64, &nTiles));
+  assert_int_equal(4, nTiles);
+
+  /* Four more: the least recently drawn of the first four go */
+  view = MakeView(512, 512, 768, 768, 1.0);
+  assert_int_equal(TILEMGR_OK, TileMgr_Update(&tileMgr, &view, tiles, 64, &nTiles));
+  TILEMGRSTATS stats;
+  TileMgr_GetStats(&tileMgr, &stats);
+  assert_int_equal(5, stats.count);
+  assert_int_equal(3, stats.evictions);
+  assert_int_equal(3, fake.nFrees);
+
+  /* The tile kept is the last of the first view, drawn again without a load */
+  size_t nLoads = fake.nLoads;
+  view = MakeView(128, 128, 256, 256, 1.0);
+  assert_int_equal(TILEMGR_OK, TileMgr_Update(&tileMgr, &view, tiles, 64, &nTiles));
+  assert_int_equal(1, nTiles);
+  assert_int_equal(nLoads, fake.nLoads);
+
+  /* A view larger than the budget keeps all of its tiles, over budget */
+  view = MakeView(0, 0, 1024, 384, 1.0);
+  assert_int_equal(TILEMGR_OK, TileMgr_Update(&tileMgr, &view, tiles, 64, &nTiles));
+  assert_int_equal(24, nTiles);
+  TileMgr_GetStats(&tileMgr, &stats);
+  assert_int_equal(24, stats.count);
+  assert_int_equal(2400, stats.bytes);
+
+  /* Back under budget as soon as the view shrinks */
+  view = MakeView(0, 0, 128, 128, 1.0);
+  assert_int_equal(TILEMGR_OK, TileMgr_Update(&tileMgr, &view, tiles, 64, &nTiles));
+  TileMgr_GetStats(&tileMgr, &stats);
+  assert_int_equal(5, stats.count);
+  assert_true(stats.bytes <= stats.budget);
+
+  /* Lowering the budget evicts at once, but not the tile in view */
+  TileMgr_SetBudget(&tileMgr, 0);
+  TileMgr_GetStats(&tileMgr, &stats);
+  assert_int_equal(1, stats.count);
+  assert_ptr_equal(tiles[0], tileMgr.pHead);
+
+  TileMgr_Clear(&tileMgr);
+  TileMgr_GetStats(&tileMgr, &stats);
+  assert_int_equal(0, stats.count);
+  assert_int_equal(0, stats.bytes);
+  assert_int_equal(fake.nLoads, fake.nFrees);
+
+  TileMgr_Cleanup(&tileMgr);
+}
+
+static void tile_mgr_failure_test(void** state)
+{
+  (void)state;
+
+  FAKERESIDENCY fake;
+  InitFake(&fake);
+  fake.failColumn = 1;
+  fake.failRow = 0;
+
+  TILEMGR tileMgr;
+  assert_int_equal(TILEMGR_OK, TileMgr_Init(&tileMgr, 256, 128, 128, 1000, FakeLoad, FakeFree, &fake));
+
+  /* A tile that fails is left out of the frame and tried again the next */
+  LPTILE tiles[4];
+  size_t nTiles = 0;
+  TILEVIEW view = MakeView(0, 0, 256, 128, 1.0);
+  assert_int_equal(TILEMGR_OK, TileMgr_Update(&tileMgr, &view, tiles, 4, &nTiles));
+  assert_int_equal(1, nTiles);
+  assert_int_equal(0, tiles[0]->column);
+
+  fake.failColumn = -1;
+  assert_int_equal(TILEMGR_OK, TileMgr_Update(&tileMgr, &view, tiles, 4, &nTiles));
+  assert_int_equal(2, nTiles);
+
+  TILEMGRSTATS stats;
+  TileMgr_GetStats(&tileMgr, &stats);
+  assert_int_equal(1, stats.failures);
+  assert_int_equal(2, stats.loads);
+
+  TileMgr_Cleanup(&tileMgr);
+  assert_int_equal(2, fake.nFrees);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(tile_mgr_levels_test),
+    cmocka_unit_test(tile_mgr_visible_test),
+    cmocka_unit_test(tile_mgr_evict_test),
+    cmocka_unit_test(tile_mgr_failure_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
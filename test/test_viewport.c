@@ -0,0 +1,239 @@
+#include "../viewport.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#define EPSILON 1e-9
+
+/* Within epsilon of the expected value */
+#define assert_near(expected, actual) assert_true(fabs((double)(expected) - (double)(actual)) < EPSILON)
+
+static void viewport_fit_test(void** state)
+{
+  (void)state;
+
+  VIEWPORT viewport;
+  Viewport_Init(&viewport);
+  assert_int_equal(1, Viewport_SetViewSize(&viewport, 1000, 1000));
+
+  /* Shrunk to the width, centred the other way */
+  Viewport_SetImage(&viewport, 4000, 2000, VIEWPORT_MODE_FIT);
+  assert_int_equal(VIEWPORT_MODE_FIT, viewport.nMode);
+  assert_near(0.25, viewport.xform.m11);
+  assert_near(0.25, viewport.xform.m22);
+  assert_near(0.0, viewport.xform.m12);
+  assert_near(0.0, viewport.xform.m21);
+  assert_near(0.0, viewport.xform.dx);
+  assert_near(250.0, viewport.xform.dy);
+
+  /* Follows the window */
+  assert_int_equal(1, Viewport_SetViewSize(&viewport, 500, 1000));
+  assert_near(0.125, viewport.scale);
+  assert_near(375.0, viewport.xform.dy);
+  assert_int_equal(0, Viewport_SetViewSize(&viewport, 500, 1000));
+
+  /* Never enlarged */
+  Viewport_SetImage(&viewport, 101, 50, VIEWPORT_MODE_FIT);
+  assert_near(1.0, viewport.scale);
+  assert_near(200.0, viewport.xform.dx);
+  assert_near(475.0, viewport.xform.dy);
+
+  /* 1:1 in the middle, cropped */
+  Viewport_SetImage(&viewport, 4000, 2000, VIEWPORT_MODE_FREE);
+  assert_int_equal(VIEWPORT_MODE_FREE, viewport.nMode);
+  assert_near(1.0, viewport.scale);
+  assert_near(-1750.0, viewport.xform.dx);
+  assert_near(-500.0, viewport.xform.dy);
+
+  assert_int_equal(1, Viewport_Fit(&viewport));
+  assert_int_equal(VIEWPORT_MODE_FIT, viewport.nMode);
+  assert_near(0.125, viewport.scale);
+}
+
+static void viewport_zoom_anchor_test(void** state)
+{
+  (void)state;
+
+  VIEWPORT viewport;
+  Viewport_Init(&viewport);
+  Viewport_SetViewSize(&viewport, 500, 500);
+  Viewport_SetImage(&viewport, 1000, 1000, VIEWPORT_MODE_FIT);
+  assert_near(0.5, viewport.scale);
+
+  double x, y;
+  Viewport_WindowToImage(&viewport, 100, 150, &x, &y);
+  assert_near(200.0, x);
+  assert_near(300.0, y);
+
+  /* The image point under the cursor stays there */
+  assert_int_equal(1, Viewport_ZoomAt(&viewport, 2.0, 100, 150));
+  assert_int_equal(VIEWPORT_MODE_FREE, viewport.nMode);
+  assert_near(2.0, viewport.xform.m11);
+  Viewport_WindowToImage(&viewport, 100, 150, &x, &y);
+  assert_near(200.0, x);
+  assert_near(300.0, y);
+
+  assert_int_equal(1, Viewport_ZoomAt(&viewport, 1.0, 100, 150));
+  Viewport_WindowToImage(&viewport, 100, 150, &x, &y);
+  assert_near(200.0, x);
+  assert_near(300.0, y);
+
+  /* Near an edge the image is held against it rather than the cursor */
+  assert_int_equal(1, Viewport_ZoomAt(&viewport, 0.5, 0, 0));
+  assert_near(0.0, viewport.xform.dx);
+  assert_near(0.0, viewport.xform.dy);
+
+  /* Limited to the fit and VIEWPORT_MAX_SCALE */
+  Viewport_ZoomAt(&viewport, 0.01, 250, 250);
+  assert_near(0.5, viewport.scale);
+  Viewport_ZoomAt(&viewport, 1000.0, 250, 250);
+  assert_near(VIEWPORT_MAX_SCALE, viewport.scale);
+  assert_int_equal(0, Viewport_ZoomAt(&viewport, 1000.0, 250, 250));
+
+  /* Nothing to zoom */
+  Viewport_SetImage(&viewport, 0, 0, VIEWPORT_MODE_FIT);
+  assert_int_equal(0, Viewport_ZoomAt(&viewport, 2.0, 250, 250));
+}
+
+static void viewport_zoom_step_test(void** state)
+{
+  (void)state;
+
+  VIEWPORT viewport;
+  Viewport_Init(&viewport);
+  Viewport_SetViewSize(&viewport, 500, 500);
+  Viewport_SetImage(&viewport, 1000, 1000, VIEWPORT_MODE_FIT);
+
+  /* On the ladder: a full octave in lands on 1:1 */
+  assert_int_equal(1, Viewport_ZoomStep(&viewport, 1, 250, 250));
+  assert_near(pow(2.0, -3.0 / VIEWPORT_STEPS_PER_OCTAVE), viewport.scale);
+  Viewport_ZoomStep(&viewport, VIEWPORT_STEPS_PER_OCTAVE - 1, 250, 250);
+  assert_near(1.0, viewport.scale);
+
+  /* Back out to the fit, which is fit mode again */
+  Viewport_ZoomStep(&viewport, -VIEWPORT_STEPS_PER_OCTAVE, 250, 250);
+  assert_near(0.5, viewport.scale);
+  assert_int_equal(VIEWPORT_MODE_FIT, viewport.nMode);
+  assert_int_equal(0, Viewport_ZoomStep(&viewport, -1, 250, 250));
+  assert_int_equal(0, Viewport_ZoomStep(&viewport, 0, 250, 250));
+
+  /* Off the ladder: the first step goes to the next scale on it */
+  Viewport_SetViewSize(&viewport, 300, 300);
+  assert_near(0.3, viewport.scale);
+  Viewport_ZoomStep(&viewport, 1, 150, 150);
+  assert_near(pow(2.0, -6.0 / VIEWPORT_STEPS_PER_OCTAVE), viewport.scale);
+  Viewport_ZoomStep(&viewport, -1, 150, 150);
+  assert_near(0.3, viewport.scale);
+  assert_int_equal(VIEWPORT_MODE_FIT, viewport.nMode);
+
+  /* Held at the limit */
+  Viewport_ZoomStep(&viewport, 1000, 150, 150);
+  assert_near(VIEWPORT_MAX_SCALE, viewport.scale);
+  assert_int_equal(0, Viewport_ZoomStep(&viewport, 1, 150, 150));
+}
+
+static void viewport_pan_test(void** state)
+{
+  (void)state;
+
+  VIEWPORT viewport;
+  Viewport_Init(&viewport);
+  Viewport_SetViewSize(&viewport, 400, 300);
+  Viewport_SetImage(&viewport, 1000, 200, VIEWPORT_MODE_FREE);
+  assert_near(-300.0, viewport.xform.dx);
+  assert_near(50.0, viewport.xform.dy);
+
+  /* Sideways it moves, up and down it stays centred */
+  assert_int_equal(1, Viewport_Pan(&viewport, 100.4, 80));
+  assert_near(-200.0, viewport.xform.dx);
+  assert_near(50.0, viewport.xform.dy);
+
+  /* Whole pixels, but the fractions add up */
+  assert_int_equal(1, Viewport_Pan(&viewport, 0.2, 0));
+  assert_near(-199.0, viewport.xform.dx);
+
+  /* Against the edges */
+  Viewport_Pan(&viewport, 10000, 0);
+  assert_near(0.0, viewport.xform.dx);
+  assert_int_equal(0, Viewport_Pan(&viewport, 1, 0));
+  Viewport_Pan(&viewport, -10000, 0);
+  assert_near(-600.0, viewport.xform.dx);
+
+  /* A fit image can not move, and stays fit */
+  Viewport_Fit(&viewport);
+  assert_int_equal(0, Viewport_Pan(&viewport, 50, 50));
+  assert_int_equal(VIEWPORT_MODE_FIT, viewport.nMode);
+}
+
+static void viewport_resize_test(void** state)
+{
+  (void)state;
+
+  VIEWPORT viewport;
+  Viewport_Init(&viewport);
+  Viewport_SetViewSize(&viewport, 400, 400);
+  Viewport_SetImage(&viewport, 2000, 2000, VIEWPORT_MODE_FREE);
+  Viewport_Pan(&viewport, 300, 200);
+
+  /* The image point in the middle stays in the middle */
+  double x, y;
+  Viewport_WindowToImage(&viewport, 200, 200, &x, &y);
+  Viewport_SetViewSize(&viewport, 600, 500);
+  double x2, y2;
+  Viewport_WindowToImage(&viewport, 300, 250, &x2, &y2);
+  assert_near(x, x2);
+  assert_near(y, y2);
+  assert_int_equal(VIEWPORT_MODE_FREE, viewport.nMode);
+  assert_near(1.0, viewport.scale);
+}
+
+static void viewport_tile_view_test(void** state)
+{
+  (void)state;
+
+  VIEWPORT viewport;
+  Viewport_Init(&viewport);
+  Viewport_SetViewSize(&viewport, 800, 600);
+  Viewport_SetImage(&viewport, 8000, 6000, VIEWPORT_MODE_FIT);
+
+  TILEVIEW view;
+  Viewport_GetTileView(&viewport, &view);
+  assert_near(0.0, view.left);
+  assert_near(0.0, view.top);
+  assert_near(8000.0, view.right);
+  assert_near(6000.0, view.bottom);
+  assert_near(0.1, view.scale);
+
+  /* 1:1 at the bottom right corner */
+  Viewport_ZoomAt(&viewport, 1.0, 800, 600);
+  Viewport_GetTileView(&viewport, &view);
+  assert_near(7200.0, view.left);
+  assert_near(5400.0, view.top);
+  assert_near(8000.0, view.right);
+  assert_near(6000.0, view.bottom);
+  assert_near(1.0, view.scale);
+
+  /* Wider than the image: the view reaches past it */
+  Viewport_SetImage(&viewport, 400, 600, VIEWPORT_MODE_FREE);
+  Viewport_GetTileView(&viewport, &view);
+  assert_near(-200.0, view.left);
+  assert_near(600.0, view.right);
+}
+
+int main() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(viewport_fit_test),
+    cmocka_unit_test(viewport_zoom_anchor_test),
+    cmocka_unit_test(viewport_zoom_step_test),
+    cmocka_unit_test(viewport_pan_test),
+    cmocka_unit_test(viewport_resize_test),
+    cmocka_unit_test(viewport_tile_view_test)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,22 @@
+/*
+ * testutil.h
+ *
+ * Shared helpers for the unit tests
+ */
+
+#ifndef PANIVIEW_TESTUTIL_H
+#define PANIVIEW_TESTUTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Deterministic bytes, the same seed always gives the same pattern */
+static inline void Test_FillPattern(uint8_t* pData, size_t size, unsigned int seed)
+{
+  for (size_t i = 0; i < size; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    pData[i] = (uint8_t)(seed >> 16);
+  }
+}
+
+#endif /* PANIVIEW_TESTUTIL_H */
@@ -0,0 +1,176 @@
+#include "thread.h"
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+static unsigned __stdcall Thread_Trampoline(void* pArg)
+{
+  LPTHREAD pThread = (LPTHREAD)pArg;
+  pThread->nResult = pThread->pfnStart(pThread->pArg);
+  return 0;
+}
+
+int Thread_Create(LPTHREAD pThread, THREADFUNC pfnStart, void* pArg)
+{
+  pThread->pfnStart = pfnStart;
+  pThread->pArg = pArg;
+  pThread->nResult = 0;
+
+  /* _beginthreadex rather than CreateThread so the CRT is set up per thread */
+  pThread->hThread = (HANDLE)_beginthreadex(NULL, 0, Thread_Trampoline, pThread, 0, NULL);
+  return pThread->hThread ? THREAD_OK : THREAD_ERROR;
+}
+
+int Thread_Join(LPTHREAD pThread)
+{
+  WaitForSingleObject(pThread->hThread, INFINITE);
+  CloseHandle(pThread->hThread);
+  pThread->hThread = NULL;
+
+  return pThread->nResult;
+}
+
+unsigned int Thread_GetCPUCount(void)
+{
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  return si.dwNumberOfProcessors ? (unsigned int)si.dwNumberOfProcessors : 1;
+}
+
+void Thread_Yield(void)
+{
+  SwitchToThread();
+}
+
+void Mutex_Init(LPMUTEX pMutex)
+{
+  InitializeSRWLock(&pMutex->lock);
+}
+
+void Mutex_Lock(LPMUTEX pMutex)
+{
+  AcquireSRWLockExclusive(&pMutex->lock);
+}
+
+void Mutex_Unlock(LPMUTEX pMutex)
+{
+  ReleaseSRWLockExclusive(&pMutex->lock);
+}
+
+void Mutex_Destroy(LPMUTEX pMutex)
+{
+  (void)pMutex;
+}
+
+void CondVar_Init(LPCONDVAR pCond)
+{
+  InitializeConditionVariable(&pCond->cond);
+}
+
+void CondVar_Wait(LPCONDVAR pCond, LPMUTEX pMutex)
+{
+  SleepConditionVariableSRW(&pCond->cond, &pMutex->lock, INFINITE, 0);
+}
+
+void CondVar_Signal(LPCONDVAR pCond)
+{
+  WakeConditionVariable(&pCond->cond);
+}
+
+void CondVar_Broadcast(LPCONDVAR pCond)
+{
+  WakeAllConditionVariable(&pCond->cond);
+}
+
+void CondVar_Destroy(LPCONDVAR pCond)
+{
+  (void)pCond;
+}
+
+#else
+
+static void* Thread_Trampoline(void* pArg)
+{
+  LPTHREAD pThread = (LPTHREAD)pArg;
+  pThread->nResult = pThread->pfnStart(pThread->pArg);
+  return NULL;
+}
+
+int Thread_Create(LPTHREAD pThread, THREADFUNC pfnStart, void* pArg)
+{
+  pThread->pfnStart = pfnStart;
+  pThread->pArg = pArg;
+  pThread->nResult = 0;
+
+  return pthread_create(&pThread->thread, NULL, Thread_Trampoline, pThread) ? THREAD_ERROR : THREAD_OK;
+}
+
+int Thread_Join(LPTHREAD pThread)
+{
+  pthread_join(pThread->thread, NULL);
+  return pThread->nResult;
+}
+
+unsigned int Thread_GetCPUCount(void)
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (unsigned int)n : 1;
+}
+
+void Thread_Yield(void)
+{
+  sched_yield();
+}
+
+void Mutex_Init(LPMUTEX pMutex)
+{
+  pthread_mutex_init(&pMutex->mutex, NULL);
+}
+
+void Mutex_Lock(LPMUTEX pMutex)
+{
+  pthread_mutex_lock(&pMutex->mutex);
+}
+
+void Mutex_Unlock(LPMUTEX pMutex)
+{
+  pthread_mutex_unlock(&pMutex->mutex);
+}
+
+void Mutex_Destroy(LPMUTEX pMutex)
+{
+  pthread_mutex_destroy(&pMutex->mutex);
+}
+
+void CondVar_Init(LPCONDVAR pCond)
+{
+  pthread_cond_init(&pCond->cond, NULL);
+}
+
+void CondVar_Wait(LPCONDVAR pCond, LPMUTEX pMutex)
+{
+  pthread_cond_wait(&pCond->cond, &pMutex->mutex);
+}
+
+void CondVar_Signal(LPCONDVAR pCond)
+{
+  pthread_cond_signal(&pCond->cond);
+}
+
+void CondVar_Broadcast(LPCONDVAR pCond)
+{
+  pthread_cond_broadcast(&pCond->cond);
+}
+
+void CondVar_Destroy(LPCONDVAR pCond)
+{
+  pthread_cond_destroy(&pCond->cond);
+}
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ * thread.h
+ *
+ * Minimal threading primitives over Win32 and pthreads
+ *
+ * Threads, mutexes, condition variables and the few atomic operations the
+ * background pipelines need, with the same semantics on both backends.
+ */
+
+#ifndef PANIVIEW_THREAD_H
+#define PANIVIEW_THREAD_H
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+enum {
+  THREAD_OK = 0,
+  THREAD_ERROR = -1,
+};
+
+typedef int (*THREADFUNC)(void* pArg);
+
+/* Storage class of a per-thread variable */
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+typedef struct _tagTHREAD THREAD, *LPTHREAD;
+typedef struct _tagMUTEX MUTEX, *LPMUTEX;
+typedef struct _tagCONDVAR CONDVAR, *LPCONDVAR;
+
+struct _tagTHREAD {
+#ifdef _WIN32
+  HANDLE hThread;
+#else
+  pthread_t thread;
+#endif
+  THREADFUNC pfnStart;
+  void* pArg;
+  int nResult;
+};
+
+struct _tagMUTEX {
+#ifdef _WIN32
+  SRWLOCK lock;
+#else
+  pthread_mutex_t mutex;
+#endif
+};
+
+struct _tagCONDVAR {
+#ifdef _WIN32
+  CONDITION_VARIABLE cond;
+#else
+  pthread_cond_t cond;
+#endif
+};
+
+/* The THREAD must stay at the same address until Thread_Join returns */
+int Thread_Create(LPTHREAD pThread, THREADFUNC pfnStart, void* pArg);
+int Thread_Join(LPTHREAD pThread);
+unsigned int Thread_GetCPUCount(void);
+
+/* Give the rest of the time slice to another ready thread */
+void Thread_Yield(void);
+
+void Mutex_Init(LPMUTEX pMutex);
+void Mutex_Lock(LPMUTEX pMutex);
+void Mutex_Unlock(LPMUTEX pMutex);
+void Mutex_Destroy(LPMUTEX pMutex);
+
+void CondVar_Init(LPCONDVAR pCond);
+void CondVar_Wait(LPCONDVAR pCond, LPMUTEX pMutex);
+void CondVar_Signal(LPCONDVAR pCond);
+void CondVar_Broadcast(LPCONDVAR pCond);
+void CondVar_Destroy(LPCONDVAR pCond);
+
+/* Sequentially consistent operations on naturally aligned values */
+static inline long Atomic_Load(volatile long* pValue)
+{
+#ifdef _WIN32
+  return InterlockedCompareExchange(pValue, 0, 0);
+#else
+  return __atomic_load_n(pValue, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline void Atomic_Store(volatile long* pValue, long value)
+{
+#ifdef _WIN32
+  InterlockedExchange(pValue, value);
+#else
+  __atomic_store_n(pValue, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/* Returns the incremented value */
+static inline long Atomic_Increment(volatile long* pValue)
+{
+#ifdef _WIN32
+  return InterlockedIncrement(pValue);
+#else
+  return __atomic_add_fetch(pValue, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/* For one-way handoffs: the acquiring load sees everything written before the releasing store */
+static inline long Atomic_LoadAcquire(volatile long* pValue)
+{
+#ifdef _WIN32
+  return ReadAcquire((const volatile LONG*)pValue);
+#else
+  return __atomic_load_n(pValue, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void Atomic_StoreRelease(volatile long* pValue, long value)
+{
+#ifdef _WIN32
+  WriteRelease((volatile LONG*)pValue, value);
+#else
+  __atomic_store_n(pValue, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/* Returns the previous value */
+static inline long Atomic_Exchange(volatile long* pValue, long value)
+{
+#ifdef _WIN32
+  return InterlockedExchange(pValue, value);
+#else
+  return __atomic_exchange_n(pValue, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/* Stores value if *pValue is comparand; returns the previous value either way */
+static inline long Atomic_CompareExchange(volatile long* pValue, long value, long comparand)
+{
+#ifdef _WIN32
+  return InterlockedCompareExchange(pValue, value, comparand);
+#else
+  __atomic_compare_exchange_n(pValue, &comparand, value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  return comparand;
+#endif
+}
+
+/* Returns the sum */
+static inline long Atomic_Add(volatile long* pValue, long value)
+{
+#ifdef _WIN32
+  return InterlockedExchangeAdd(pValue, value) + value;
+#else
+  return __atomic_add_fetch(pValue, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/* Returns the decremented value */
+static inline long Atomic_Decrement(volatile long* pValue)
+{
+#ifdef _WIN32
+  return InterlockedDecrement(pValue);
+#else
+  return __atomic_sub_fetch(pValue, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+#endif /* PANIVIEW_THREAD_H */
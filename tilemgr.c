@@ -0,0 +1,289 @@
+#include "tilemgr.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef UNIT_TESTING
+extern void* _test_malloc(const size_t size, const char* file, const int line);
+
+#define malloc(size) _test_malloc(size, __FILE__, __LINE__)
+
+extern void* _test_calloc(const size_t num, const size_t size, const char* file,
+  const int line);
+
+#define calloc(num, size) _test_calloc(num, size, __FILE__, __LINE__)
+
+extern void* _test_realloc(void* const ptr, const size_t size, const char* file,
+  const int line);
+
+#define realloc(ptr, size) _test_realloc(ptr, size, __FILE__, __LINE__)
+
+extern void _test_free(void* const ptr, const char* file, const int line);
+
+#define free(ptr) _test_free(ptr, __FILE__, __LINE__)
+#endif
+
+/* 8 bits of level, 28 of column and row each */
+#define TILEMGR_MAX_INDEX ((1u << 28) - 1)
+
+static uint64_t TileMgr_MakeKey(size_t nLevel, size_t column, size_t row)
+{
+  return ((uint64_t)nLevel << 56) | ((uint64_t)column << 28) | (uint64_t)row;
+}
+
+static void TileMgr_Unlink(LPTILEMGR pTileMgr, LPTILE pTile)
+{
+  if (pTile->pPrev) {
+    pTile->pPrev->pNext = pTile->pNext;
+  }
+  else {
+    pTileMgr->pHead = pTile->pNext;
+  }
+
+  if (pTile->pNext) {
+    pTile->pNext->pPrev = pTile->pPrev;
+  }
+  else {
+    pTileMgr->pTail = pTile->pPrev;
+  }
+
+  pTile->pPrev = NULL;
+  pTile->pNext = NULL;
+}
+
+static void TileMgr_PushFront(LPTILEMGR pTileMgr, LPTILE pTile)
+{
+  pTile->pPrev = NULL;
+  pTile->pNext = pTileMgr->pHead;
+  if (pTileMgr->pHead) {
+    pTileMgr->pHead->pPrev = pTile;
+  }
+  else {
+    pTileMgr->pTail = pTile;
+  }
+  pTileMgr->pHead = pTile;
+}
+
+/* Drop a tile and give its resources back to the owner */
+static void TileMgr_Drop(LPTILEMGR pTileMgr, LPTILE pTile)
+{
+  TileMgr_Unlink(pTileMgr, pTile);
+
+  uint64_t key = TileMgr_MakeKey(pTile->level, pTile->column, pTile->row);
+  HashTable_Erase(&pTileMgr->tiles, &key);
+
+  pTileMgr->stats.bytes -= pTile->cost;
+  --pTileMgr->stats.count;
+
+  if (pTileMgr->pfnFree) {
+    pTileMgr->pfnFree(pTile, pTileMgr->pUserData);
+  }
+
+  free(pTile);
+}
+
+/* Evict from the cold end, sparing the tiles of the current frame */
+static void TileMgr_MakeRoom(LPTILEMGR pTileMgr)
+{
+  while (pTileMgr->pTail && pTileMgr->pTail->nFrame != pTileMgr->nFrame &&
+      pTileMgr->stats.bytes > pTileMgr->stats.budget) {
+    TileMgr_Drop(pTileMgr, pTileMgr->pTail);
+    ++pTileMgr->stats.evictions;
+  }
+}
+
+int TileMgr_Init(LPTILEMGR pTileMgr, size_t width, size_t height, size_t tileSize, size_t budget,
+    TILELOADFUNC pfnLoad, TILEFREEFUNC pfnFree, void* pUserData)
+{
+  memset(pTileMgr, 0, sizeof(TILEMGR));
+
+  if (!width || !height || !tileSize || !pfnLoad ||
+      (width - 1) / tileSize > TILEMGR_MAX_INDEX || (height - 1) / tileSize > TILEMGR_MAX_INDEX) {
+    return TILEMGR_ERROR_INVALID;
+  }
+
+  pTileMgr->width = width;
+  pTileMgr->height = height;
+  pTileMgr->tileSize = tileSize;
+
+  /* Halve until a single tile holds the level */
+  size_t levelWidth = width;
+  size_t levelHeight = height;
+  pTileMgr->nLevels = 1;
+  while ((levelWidth > tileSize || levelHeight > tileSize) && pTileMgr->nLevels < TILEMGR_MAX_LEVELS) {
+    levelWidth = (levelWidth + 1) / 2;
+    levelHeight = (levelHeight + 1) / 2;
+    ++pTileMgr->nLevels;
+  }
+
+  HashTable_Init(&pTileMgr->tiles, sizeof(uint64_t), sizeof(LPTILE), NULL);
+
+  pTileMgr->pfnLoad = pfnLoad;
+  pTileMgr->pfnFree = pfnFree;
+  pTileMgr->pUserData = pUserData;
+  pTileMgr->stats.budget = budget;
+
+  return TILEMGR_OK;
+}
+
+void TileMgr_Cleanup(LPTILEMGR pTileMgr)
+{
+  TileMgr_Clear(pTileMgr);
+  HashTable_Cleanup(&pTileMgr->tiles);
+}
+
+void TileMgr_GetLevelSize(const TILEMGR* pTileMgr, size_t nLevel, size_t* pWidth, size_t* pHeight)
+{
+  size_t width = pTileMgr->width;
+  size_t height = pTileMgr->height;
+  for (size_t i = 0; i < nLevel; ++i) {
+    width = (width + 1) / 2;
+    height = (height + 1) / 2;
+  }
+
+  *pWidth = width;
+  *pHeight = height;
+}
+
+/*
+ * The coarsest level whose pixels do not come out larger than a screen
+ * pixel; the coarsest of all when zoomed out further than the chain goes.
+ */
+size_t TileMgr_SelectLevel(const TILEMGR* pTileMgr, double scale)
+{
+  size_t nLevel = 0;
+  if (!(scale > 0.0)) {
+    return pTileMgr->nLevels - 1;
+  }
+
+  while (nLevel + 1 < pTileMgr->nLevels && ldexp(scale, (int)nLevel + 1) <= 1.0) {
+    ++nLevel;
+  }
+
+  return nLevel;
+}
+
+/* First and one past the last tile index covering [start, end) level pixels */
+static void TileMgr_GetSpan(double start, double end, size_t size, size_t tileSize, size_t* pFirst,
+    size_t* pLast)
+{
+  start = start < 0.0 ? 0.0 : start;
+  end = end > (double)size ? (double)size : end;
+  if (!(start < end)) {
+    *pFirst = *pLast = 0;
+    return;
+  }
+
+  *pFirst = (size_t)(start / (double)tileSize);
+  *pLast = (size_t)ceil(end / (double)tileSize);
+}
+
+static LPTILE TileMgr_Load(LPTILEMGR pTileMgr, size_t nLevel, size_t column, size_t row,
+    size_t levelWidth, size_t levelHeight, int* pStatus)
+{
+  LPTILE pTile = (LPTILE)calloc(1, sizeof(TILE));
+  if (!pTile) {
+    *pStatus = TILEMGR_ERROR_MEMORY;
+    return NULL;
+  }
+
+  size_t tileSize = pTileMgr->tileSize;
+  pTile->level = (uint32_t)nLevel;
+  pTile->column = (uint32_t)column;
+  pTile->row = (uint32_t)row;
+  pTile->x = column * tileSize;
+  pTile->y = row * tileSize;
+  pTile->width = levelWidth - pTile->x < tileSize ? levelWidth - pTile->x : tileSize;
+  pTile->height = levelHeight - pTile->y < tileSize ? levelHeight - pTile->y : tileSize;
+
+  if (!pTileMgr->pfnLoad(pTile, pTileMgr->pUserData)) {
+    ++pTileMgr->stats.failures;
+    free(pTile);
+    return NULL;
+  }
+
+  uint64_t key = TileMgr_MakeKey(nLevel, column, row);
+  if (HashTable_Insert(&pTileMgr->tiles, &key, &pTile) != HASHTABLE_OK) {
+    if (pTileMgr->pfnFree) {
+      pTileMgr->pfnFree(pTile, pTileMgr->pUserData);
+    }
+    free(pTile);
+    *pStatus = TILEMGR_ERROR_MEMORY;
+    return NULL;
+  }
+
+  TileMgr_PushFront(pTileMgr, pTile);
+  pTileMgr->stats.bytes += pTile->cost;
+  ++pTileMgr->stats.count;
+  ++pTileMgr->stats.loads;
+
+  return pTile;
+}
+
+int TileMgr_Update(LPTILEMGR pTileMgr, const TILEVIEW* pView, LPTILE* ppTiles, size_t nMaxTiles,
+    size_t* pnTiles)
+{
+  ++pTileMgr->nFrame;
+  *pnTiles = 0;
+
+  size_t nLevel = TileMgr_SelectLevel(pTileMgr, pView->scale);
+  size_t levelWidth = 0;
+  size_t levelHeight = 0;
+  TileMgr_GetLevelSize(pTileMgr, nLevel, &levelWidth, &levelHeight);
+
+  size_t firstColumn, lastColumn, firstRow, lastRow;
+  TileMgr_GetSpan(ldexp(pView->left, -(int)nLevel), ldexp(pView->right, -(int)nLevel),
+      levelWidth, pTileMgr->tileSize, &firstColumn, &lastColumn);
+  TileMgr_GetSpan(ldexp(pView->top, -(int)nLevel), ldexp(pView->bottom, -(int)nLevel),
+      levelHeight, pTileMgr->tileSize, &firstRow, &lastRow);
+
+  int status = TILEMGR_OK;
+  for (size_t row = firstRow; row < lastRow && status == TILEMGR_OK; ++row) {
+    for (size_t column = firstColumn; column < lastColumn && status == TILEMGR_OK; ++column) {
+      uint64_t key = TileMgr_MakeKey(nLevel, column, row);
+      LPTILE* ppTile = (LPTILE*)HashTable_Find(&pTileMgr->tiles, &key);
+      LPTILE pTile = NULL;
+      if (ppTile) {
+        pTile = *ppTile;
+        if (pTileMgr->pHead != pTile) {
+          TileMgr_Unlink(pTileMgr, pTile);
+          TileMgr_PushFront(pTileMgr, pTile);
+        }
+        ++pTileMgr->stats.hits;
+      }
+      else {
+        pTile = TileMgr_Load(pTileMgr, nLevel, column, row, levelWidth, levelHeight, &status);
+      }
+
+      if (pTile) {
+        pTile->nFrame = pTileMgr->nFrame;
+        if (*pnTiles < nMaxTiles) {
+          ppTiles[*pnTiles] = pTile;
+        }
+        ++*pnTiles;
+      }
+    }
+  }
+
+  TileMgr_MakeRoom(pTileMgr);
+  return status;
+}
+
+void TileMgr_SetBudget(LPTILEMGR pTileMgr, size_t budget)
+{
+  pTileMgr->stats.budget = budget;
+  TileMgr_MakeRoom(pTileMgr);
+}
+
+void TileMgr_GetStats(const TILEMGR* pTileMgr, LPTILEMGRSTATS pStats)
+{
+  *pStats = pTileMgr->stats;
+}
+
+void TileMgr_Clear(LPTILEMGR pTileMgr)
+{
+  while (pTileMgr->pHead) {
+    TileMgr_Drop(pTileMgr, pTileMgr->pHead);
+  }
+}
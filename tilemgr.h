@@ -0,0 +1,116 @@
+/*
+ * tilemgr.h
+ *
+ * Visible tiles of a mip-mapped image under a memory budget
+ *
+ * The image is cut into square tiles at every level of its mip chain,
+ * level n being the image halved n times, rounded up, down to the level
+ * that fits a single tile. Each frame the view, the part of the image in
+ * the window and the zoom, picks the coarsest level still at least as
+ * fine as the screen, and the tiles of that level the view intersects.
+ * Tiles missing are made resident through the owner's load callback, e.g.
+ * uploaded as textures, and charged the cost it reports. The least
+ * recently drawn tiles are then evicted until the total fits the budget;
+ * tiles of the current frame never are, so a budget below one screen of
+ * tiles is exceeded rather than drawn with holes.
+ *
+ * Nothing here talks to a graphics API. Not thread-safe: use it from the
+ * thread that draws.
+ */
+
+#ifndef PANIVIEW_TILEMGR_H
+#define PANIVIEW_TILEMGR_H
+
+#include "hashmap.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TILEMGR_MAX_LEVELS 32
+
+enum {
+  TILEMGR_OK = 0,
+  TILEMGR_ERROR_MEMORY = -1,
+  TILEMGR_ERROR_INVALID = -2,
+};
+
+typedef struct _tagTILE TILE, *LPTILE;
+typedef struct _tagTILEVIEW TILEVIEW, *LPTILEVIEW;
+typedef struct _tagTILEMGRSTATS TILEMGRSTATS, *LPTILEMGRSTATS;
+typedef struct _tagTILEMGR TILEMGR, *LPTILEMGR;
+
+/*
+ * Make a tile resident: set pHandle and cost. Returns nonzero on success;
+ * a tile that fails to load is skipped this frame and tried again the next.
+ */
+typedef int (*TILELOADFUNC)(LPTILE pTile, void* pUserData);
+typedef void (*TILEFREEFUNC)(LPTILE pTile, void* pUserData);
+
+struct _tagTILE {
+  uint32_t level;
+  uint32_t column;
+  uint32_t row;
+  size_t x;                   /* Pixels covered, in the tile's level */
+  size_t y;
+  size_t width;               /* Less than the tile size at the right and bottom edges */
+  size_t height;
+  void* pHandle;              /* Owned by the callbacks */
+  size_t cost;
+  uint64_t nFrame;            /* Last frame the tile was visible in */
+  LPTILE pPrev;               /* Towards the most recently drawn */
+  LPTILE pNext;               /* Towards the least recently drawn */
+};
+
+struct _tagTILEVIEW {
+  double left;                /* Level 0 pixels, may reach past the image */
+  double top;
+  double right;
+  double bottom;
+  double scale;               /* Screen pixels per level 0 pixel */
+};
+
+struct _tagTILEMGRSTATS {
+  uint64_t hits;
+  uint64_t loads;
+  uint64_t failures;
+  uint64_t evictions;
+  size_t bytes;
+  size_t count;
+  size_t budget;
+};
+
+struct _tagTILEMGR {
+  size_t width;
+  size_t height;
+  size_t tileSize;
+  size_t nLevels;
+  HASHTABLE tiles;            /* Packed level, column and row -> LPTILE */
+  LPTILE pHead;               /* Most recently drawn */
+  LPTILE pTail;               /* Least recently drawn */
+  TILELOADFUNC pfnLoad;
+  TILEFREEFUNC pfnFree;
+  void* pUserData;
+  uint64_t nFrame;
+  TILEMGRSTATS stats;
+};
+
+int TileMgr_Init(LPTILEMGR pTileMgr, size_t width, size_t height, size_t tileSize, size_t budget,
+    TILELOADFUNC pfnLoad, TILEFREEFUNC pfnFree, void* pUserData);
+void TileMgr_Cleanup(LPTILEMGR pTileMgr);
+void TileMgr_GetLevelSize(const TILEMGR* pTileMgr, size_t nLevel, size_t* pWidth, size_t* pHeight);
+size_t TileMgr_SelectLevel(const TILEMGR* pTileMgr, double scale);
+
+/*
+ * Start a frame: make the tiles of the view resident, then evict down to
+ * the budget. Up to nMaxTiles of them are stored in ppTiles, in rows from
+ * the top left; *pnTiles receives how many the view holds, which may be
+ * more. The tiles stay valid until the next update.
+ */
+int TileMgr_Update(LPTILEMGR pTileMgr, const TILEVIEW* pView, LPTILE* ppTiles, size_t nMaxTiles,
+    size_t* pnTiles);
+
+void TileMgr_SetBudget(LPTILEMGR pTileMgr, size_t budget);
+void TileMgr_GetStats(const TILEMGR* pTileMgr, LPTILEMGRSTATS pStats);
+void TileMgr_Clear(LPTILEMGR pTileMgr);
+
+#endif /* PANIVIEW_TILEMGR_H */
@@ -0,0 +1,184 @@
+#include "viewport.h"
+
+#include <math.h>
+#include <string.h>
+
+/* Centred when it fits, else kept covering the window */
+static double Viewport_ClampAxis(double pos, double extent, double view)
+{
+  if (extent <= view) {
+    return (view - extent) / 2.0;
+  }
+  if (pos > 0.0) {
+    return 0.0;
+  }
+  if (pos < view - extent) {
+    return view - extent;
+  }
+  return pos;
+}
+
+/* Clamp the position and derive the transform from it, once per change */
+static int Viewport_Update(LPVIEWPORT pViewport)
+{
+  pViewport->left = Viewport_ClampAxis(pViewport->left, pViewport->imageWidth * pViewport->scale,
+      pViewport->viewWidth);
+  pViewport->top = Viewport_ClampAxis(pViewport->top, pViewport->imageHeight * pViewport->scale,
+      pViewport->viewHeight);
+
+  VIEWXFORM xform;
+  memset(&xform, 0, sizeof(VIEWXFORM));
+  xform.m11 = pViewport->scale;
+  xform.m22 = pViewport->scale;
+  xform.dx = floor(pViewport->left + 0.5);
+  xform.dy = floor(pViewport->top + 0.5);
+
+  int bChanged = memcmp(&xform, &pViewport->xform, sizeof(VIEWXFORM)) != 0;
+  pViewport->xform = xform;
+
+  return bChanged;
+}
+
+void Viewport_Init(LPVIEWPORT pViewport)
+{
+  memset(pViewport, 0, sizeof(VIEWPORT));
+  pViewport->nMode = VIEWPORT_MODE_FIT;
+  pViewport->scale = 1.0;
+  Viewport_Update(pViewport);
+}
+
+void Viewport_SetImage(LPVIEWPORT pViewport, double width, double height, int nMode)
+{
+  pViewport->imageWidth = width;
+  pViewport->imageHeight = height;
+
+  if (nMode == VIEWPORT_MODE_FIT) {
+    Viewport_Fit(pViewport);
+    return;
+  }
+
+  pViewport->nMode = VIEWPORT_MODE_FREE;
+  pViewport->scale = 1.0;
+  pViewport->left = (pViewport->viewWidth - width) / 2.0;
+  pViewport->top = (pViewport->viewHeight - height) / 2.0;
+  Viewport_Update(pViewport);
+}
+
+int Viewport_SetViewSize(LPVIEWPORT pViewport, double width, double height)
+{
+  double cx = pViewport->viewWidth / 2.0 - pViewport->left;
+  double cy = pViewport->viewHeight / 2.0 - pViewport->top;
+
+  pViewport->viewWidth = width;
+  pViewport->viewHeight = height;
+
+  if (pViewport->nMode == VIEWPORT_MODE_FIT) {
+    return Viewport_Fit(pViewport);
+  }
+
+  pViewport->left = width / 2.0 - cx;
+  pViewport->top = height / 2.0 - cy;
+  return Viewport_Update(pViewport);
+}
+
+int Viewport_Fit(LPVIEWPORT pViewport)
+{
+  pViewport->nMode = VIEWPORT_MODE_FIT;
+  pViewport->scale = Viewport_GetFitScale(pViewport);
+
+  return Viewport_Update(pViewport);
+}
+
+int Viewport_ZoomAt(LPVIEWPORT pViewport, double scale, double x, double y)
+{
+  if (pViewport->imageWidth <= 0.0 || pViewport->imageHeight <= 0.0) {
+    return 0;
+  }
+
+  /* Out no further than the fit, in no further than the limit */
+  double minScale = Viewport_GetFitScale(pViewport);
+  double maxScale = minScale > VIEWPORT_MAX_SCALE ? minScale : VIEWPORT_MAX_SCALE;
+  scale = scale < minScale ? minScale : (scale > maxScale ? maxScale : scale);
+
+  double imageX = (x - pViewport->left) / pViewport->scale;
+  double imageY = (y - pViewport->top) / pViewport->scale;
+
+  pViewport->nMode = VIEWPORT_MODE_FREE;
+  pViewport->scale = scale;
+  pViewport->left = x - imageX * scale;
+  pViewport->top = y - imageY * scale;
+
+  return Viewport_Update(pViewport);
+}
+
+/*
+ * Viewport_ZoomStep
+ *
+ * Scales on the ladder are 2^(k / VIEWPORT_STEPS_PER_OCTAVE). A scale off
+ * it, the fit, counts as the first step up or down to the next one, so
+ * steps in and back out always come back to the same scales.
+ */
+int Viewport_ZoomStep(LPVIEWPORT pViewport, int nSteps, double x, double y)
+{
+  if (!nSteps) {
+    return 0;
+  }
+
+  double k = log2(pViewport->scale) * VIEWPORT_STEPS_PER_OCTAVE;
+  double target = nSteps > 0 ? floor(k + 1e-6) + nSteps : ceil(k - 1e-6) + nSteps;
+  double scale = exp2(target / VIEWPORT_STEPS_PER_OCTAVE);
+
+  if (nSteps < 0 && scale <= Viewport_GetFitScale(pViewport)) {
+    return Viewport_Fit(pViewport);
+  }
+
+  return Viewport_ZoomAt(pViewport, scale, x, y);
+}
+
+int Viewport_Pan(LPVIEWPORT pViewport, double dx, double dy)
+{
+  int nMode = pViewport->nMode;
+
+  pViewport->nMode = VIEWPORT_MODE_FREE;
+  pViewport->left += dx;
+  pViewport->top += dy;
+
+  /* A fit image that could not move stays fit */
+  int bChanged = Viewport_Update(pViewport);
+  if (!bChanged) {
+    pViewport->nMode = nMode;
+  }
+
+  return bChanged;
+}
+
+double Viewport_GetFitScale(const VIEWPORT* pViewport)
+{
+  double scale = 1.0;
+  if (pViewport->imageWidth <= 0.0 || pViewport->imageHeight <= 0.0
+      || pViewport->viewWidth <= 0.0 || pViewport->viewHeight <= 0.0) {
+    return scale;
+  }
+
+  if (pViewport->imageWidth * scale > pViewport->viewWidth) {
+    scale = pViewport->viewWidth / pViewport->imageWidth;
+  }
+  if (pViewport->imageHeight * scale > pViewport->viewHeight) {
+    scale = pViewport->viewHeight / pViewport->imageHeight;
+  }
+
+  return scale;
+}
+
+void Viewport_WindowToImage(const VIEWPORT* pViewport, double x, double y, double* pX, double* pY)
+{
+  *pX = (x - pViewport->xform.dx) / pViewport->xform.m11;
+  *pY = (y - pViewport->xform.dy) / pViewport->xform.m22;
+}
+
+void Viewport_GetTileView(const VIEWPORT* pViewport, LPTILEVIEW pView)
+{
+  Viewport_WindowToImage(pViewport, 0.0, 0.0, &pView->left, &pView->top);
+  Viewport_WindowToImage(pViewport, pViewport->viewWidth, pViewport->viewHeight, &pView->right, &pView->bottom);
+  pView->scale = pViewport->scale;
+}
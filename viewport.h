@@ -0,0 +1,93 @@
+/*
+ * viewport.h
+ *
+ * Zoom and pan of an image in a window
+ *
+ * The viewport holds how the image lies in the window: its scale, screen
+ * pixels per image pixel, and where its top left corner is. Every input
+ * event, a zoom step at the cursor, a drag, a resize, updates it once and
+ * derives the 3x2 transform from image pixels to window pixels that all
+ * renderers draw with, so zooming and panning never touch the pixels
+ * themselves. An axis of the image smaller than the window is centred on
+ * it; a larger one is kept covering the window, so the image can not be
+ * dragged away. In fit mode the image follows the window size, shrunk to
+ * fit but never enlarged; any zoom or pan leaves that mode.
+ *
+ * Nothing here talks to a window or a graphics API.
+ */
+
+#ifndef PANIVIEW_VIEWPORT_H
+#define PANIVIEW_VIEWPORT_H
+
+#include "tilemgr.h"
+
+/* Zoom steps double the scale every this many, landing on 1:1 */
+#define VIEWPORT_STEPS_PER_OCTAVE 4
+#define VIEWPORT_MAX_SCALE 32.0
+
+enum {
+  VIEWPORT_MODE_FIT = 0,
+  VIEWPORT_MODE_FREE = 1,
+};
+
+typedef struct _tagVIEWXFORM VIEWXFORM, *LPVIEWXFORM;
+typedef struct _tagVIEWPORT VIEWPORT, *LPVIEWPORT;
+
+/* x' = x * m11 + y * m21 + dx, y' = x * m12 + y * m22 + dy, as D2D1_MATRIX_3X2_F */
+struct _tagVIEWXFORM {
+  double m11;
+  double m12;
+  double m21;
+  double m22;
+  double dx;                  /* Whole pixels, so 1:1 is never filtered */
+  double dy;
+};
+
+struct _tagVIEWPORT {
+  double imageWidth;
+  double imageHeight;
+  double viewWidth;
+  double viewHeight;
+  int nMode;
+  double scale;               /* Screen pixels per image pixel */
+  double left;                /* Window position of the image's top left corner */
+  double top;
+  VIEWXFORM xform;            /* Image pixels to window pixels */
+};
+
+void Viewport_Init(LPVIEWPORT pViewport);
+
+/* A new image, fit to the window or shown 1:1 in its middle as nMode says */
+void Viewport_SetImage(LPVIEWPORT pViewport, double width, double height, int nMode);
+
+/*
+ * The window was resized: refit, or keep the image point in its middle
+ * there. These and the calls below return nonzero when the transform
+ * changed, and so the window needs to be drawn again.
+ */
+int Viewport_SetViewSize(LPVIEWPORT pViewport, double width, double height);
+
+int Viewport_Fit(LPVIEWPORT pViewport);
+
+/* Zoom to scale keeping the image point under window point x, y in place */
+int Viewport_ZoomAt(LPVIEWPORT pViewport, double scale, double x, double y);
+
+/*
+ * Zoom in by nSteps, or out for a negative count, from the nearest step of
+ * the ladder past the current scale. Zoomed out to the fit, the viewport
+ * goes back to fit mode.
+ */
+int Viewport_ZoomStep(LPVIEWPORT pViewport, int nSteps, double x, double y);
+
+/* Move the image by dx, dy window pixels */
+int Viewport_Pan(LPVIEWPORT pViewport, double dx, double dy);
+
+/* Scale the image is fit with, never above 1 */
+double Viewport_GetFitScale(const VIEWPORT* pViewport);
+
+void Viewport_WindowToImage(const VIEWPORT* pViewport, double x, double y, double* pX, double* pY);
+
+/* The part of the image in the window, for TileMgr_Update */
+void Viewport_GetTileView(const VIEWPORT* pViewport, LPTILEVIEW pView);
+
+#endif /* PANIVIEW_VIEWPORT_H */